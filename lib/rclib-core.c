@@ -29,6 +29,8 @@
 #include "rclib-db.h"
 #include "rclib-cue.h"
 #include "rclib-tag.h"
+#include "rclib-dsp.h"
+#include <math.h>
 
 /**
  * SECTION: rclib-core
@@ -38,9 +40,50 @@
  *
  * The #RCLibCore is a class which plays audio files, controls the player,
  * and manages sound effects. The core uses GStreamer as its backend.
+ *
+ * In gapless mode, the URI of the next music can be queued by
+ * rclib_core_set_next_uri_with_play_source() while the current one is
+ * playing. The core hands it to the pipeline when the current stream is
+ * about to finish, so the next music starts without stopping the
+ * pipeline, and the play source is switched (with the #RCLibCore::uri-changed
+ * signal emitted) when the new stream starts. Gapless mode needs
+ * GStreamer 1.0, and CUE tracks are not queued.
+ *
+ * Crossfade works on gapless mode. A few seconds before the current music
+ * ends, the core decodes its last part in a second branch, which is
+ * prepared and paused in the background. When the main branch reaches the
+ * crossfade point, the rest of the current music is skipped, so the next
+ * music starts in the main branch, and the two branches are mixed with
+ * the volume curve before the effect bin.
+ *
+ * The sound effects of the core (the ReplayGain volume, the equalizer and
+ * the balance) and the effects from plug-ins are stages of one
+ * #RCLibDsp element in the effect bin, which is returned by
+ * rclib_core_effect_get_dsp(). Other GStreamer sound effect plug-ins can
+ * still be added to the effect bin by rclib_core_effect_plugin_add().
+ *
+ * The ReplayGain volume is the first stage of the DSP element. The gain
+ * values are read from the library when the music starts, which are
+ * read from the tags when the music is imported, or measured in
+ * background if the music has no ReplayGain tags. The gain values in
+ * the stream tags are used if the music is not in the library.
+ *
+ * The samples before the effect bin are copied into a PCM ring buffer in
+ * 32-bit float, which can be read by rclib_core_pcm_read() from any
+ * thread. The visualizations read it at their own frame rate, so they do
+ * not slow down the playing thread.
+ *
+ * In the instrumentation mode (rclib_core_set_instrumentation()), pad
+ * probes measure each element from the identity to the audio sink, and
+ * the histograms can be read by rclib_core_get_pipeline_stats().
  */
 
 #define RCLIB_CORE_ERROR rclib_core_error_quark()
+#define RCLIB_CORE_CROSSFADE_PREROLL (3 * GST_SECOND)
+#define RCLIB_CORE_CROSSFADE_CHECK_INTERVAL 250
+#define RCLIB_CORE_PCM_RING_FRAMES 32768
+#define RCLIB_CORE_PCM_RING_GUARD (RCLIB_CORE_PCM_RING_FRAMES / 4)
+#define RCLIB_CORE_PCM_CHANNELS_MAX 8
 
 #if GST_VERSION_MAJOR==1
     #define CORE_PLAYBIN "playbin"
@@ -62,6 +105,166 @@ typedef enum
     GST_PLAY_FLAG_DEINTERLACE = (1 << 9)
 }GstPlayFlags;
 
+typedef struct _RCLibCoreNextSource
+{
+    gchar *uri;
+    RCLibCorePlaySource source_type;
+    gpointer source_reference;
+    GDestroyNotify source_destroy_notify;
+    gchar *cookie;
+}RCLibCoreNextSource;
+
+typedef enum
+{
+    RCLIB_CORE_CROSSFADE_MAIN_NONE = 0,
+    RCLIB_CORE_CROSSFADE_MAIN_CUT = 1,
+    RCLIB_CORE_CROSSFADE_MAIN_FADE_IN = 2
+}RCLibCoreCrossfadeMainState;
+
+typedef enum
+{
+    RCLIB_CORE_CROSSFADE_TAIL_NONE = 0,
+    RCLIB_CORE_CROSSFADE_TAIL_SEEKING = 1,
+    RCLIB_CORE_CROSSFADE_TAIL_READY = 2,
+    RCLIB_CORE_CROSSFADE_TAIL_PLAYING = 3
+}RCLibCoreCrossfadeTailState;
+
+/*
+ * The crossfade bin is inserted before the effect bin if crossfade is
+ * enabled. The main branch comes from playbin, and the tail branch decodes
+ * the last part of the current music. The times are in the running time
+ * of the mixer, and the stream time of the music. The states and the
+ * times are protected by the mutex.
+ */
+
+typedef struct _RCLibCoreCrossfade
+{
+    GstElement *bin;
+    GstElement *capsfilter;
+    GstElement *mixer;
+    GstPad *main_pad;
+    GstElement *tail;
+    GstElement *tail_capsfilter;
+    GstPad *tail_pad;
+    gulong tail_block_id;
+    gboolean tail_seeked;
+    gboolean tail_done;
+    RCLibCoreCrossfadeMainState main_state;
+    RCLibCoreCrossfadeTailState tail_state;
+    gint64 duration;
+    RCLibCoreCrossfadeCurve curve;
+    gint64 cut_position;
+    gint64 cut_running_time;
+    gint64 tail_position;
+    gint64 tail_running_time;
+    gboolean main_valid;
+    gint64 main_position;
+    gint64 main_running_time;
+    guint timer_id;
+    GMutex mutex;
+}RCLibCoreCrossfade;
+
+typedef struct _RCLibCoreReplayGain
+{
+    RCLibCoreReplayGainMode mode;
+    gdouble preamp;
+    gdouble track_gain;
+    gdouble track_peak;
+    gdouble album_gain;
+    gdouble album_peak;
+    gboolean track_flag;
+    gboolean album_flag;
+}RCLibCoreReplayGain;
+
+typedef struct _RCLibCoreEffectSwap
+{
+    GstElement *effectbin;
+    GstElement *bin;
+    gboolean add;
+}RCLibCoreEffectSwap;
+
+typedef enum
+{
+    RCLIB_CORE_PCM_FORMAT_NONE = 0,
+    RCLIB_CORE_PCM_FORMAT_U8 = 1,
+    RCLIB_CORE_PCM_FORMAT_S16 = 2,
+    RCLIB_CORE_PCM_FORMAT_S24 = 3,
+    RCLIB_CORE_PCM_FORMAT_S32 = 4,
+    RCLIB_CORE_PCM_FORMAT_F32 = 5,
+    RCLIB_CORE_PCM_FORMAT_F64 = 6
+}RCLibCorePcmFormat;
+
+/*
+ * The PCM ring keeps the latest samples passing through the identity in
+ * the audio bin, in interleaved 32-bit float. It has only one writer (the
+ * streaming thread), and the readers never block it: each reader keeps
+ * its own position, and checks the write position again after copying
+ * the samples. The writer publishes at most RCLIB_CORE_PCM_RING_GUARD
+ * frames each time, so the frames older than that are never being
+ * written. The format is guarded by a sequence number, which is odd
+ * while the format is being changed.
+ */
+
+typedef struct _RCLibCorePcmRing
+{
+    gfloat *data;
+    volatile gsize write_pos;
+    volatile gint format_seq;
+    gsize format_pos;
+    gint rate;
+    gint channels;
+    RCLibCorePcmFormat format;
+    gint stream_channels;
+    gint frame_size;
+    gfloat scale;
+    GstCaps *caps;
+}RCLibCorePcmRing;
+
+typedef struct _RCLibCoreStatsHistogram
+{
+    volatile gint count;
+    volatile gsize sum;
+    volatile gint max;
+    volatile gint buckets[RCLIB_CORE_HISTOGRAM_BUCKETS];
+}RCLibCoreStatsHistogram;
+
+typedef struct _RCLibCoreStatsStage
+{
+    volatile gint ref_count;
+    gchar *name;
+    GstPad *sink_pad;
+    GstPad *src_pad;
+    gulong sink_probe_id;
+    gulong src_probe_id;
+    GstClockTime start_time;
+    RCLibCoreStatsHistogram process_time;
+}RCLibCoreStatsStage;
+
+/*
+ * The instrumentation mode attaches pad probes on both sides of the
+ * elements in the audio bin. The probes only update the histograms with
+ * atomic operations, so the main thread reads them without blocking the
+ * streaming thread. The stages are referenced by their probes, and freed
+ * after both probes are removed. The stage list is only changed in the
+ * main thread.
+ */
+
+typedef struct _RCLibCoreStats
+{
+    gboolean enabled;
+    GPtrArray *stages;
+    GstPad *input_pad;
+    gulong input_probe_id;
+    GstPad *output_pad;
+    gulong output_probe_id;
+    GstSegment segment;
+    RCLibCoreStatsHistogram buffer_size;
+    RCLibCoreStatsHistogram headroom;
+    volatile gint late_buffers;
+    volatile gsize frames;
+    gint64 start_time;
+}RCLibCoreStats;
+
 struct _RCLibCorePrivate
 {
     GstElement *playbin;
@@ -70,8 +273,7 @@ struct _RCLibCorePrivate
     GstElement *videosink;
     GstElement *identity;
     GstElement *effectbin;
-    GstElement *bal_plugin; /* balance: audiopanorama */
-    GstElement *eq_plugin; /* equalizer: equalizer-10bands */
+    GstElement *dsp_plugin; /* ReplayGain, equalizer, balance: RCLibDsp */
     RCLibCoreAudioOutputType output_sink_type;
     GstBus *bus;
     GstPad *query_pad;
@@ -97,11 +299,20 @@ struct _RCLibCorePrivate
     gchar *ext_cookie_pre;
     GAsyncQueue *tag_update_queue;
     gboolean tag_signal_emitted;
+    gboolean gapless;
+    GMutex next_mutex;
+    RCLibCoreNextSource *next_source;
+    RCLibCoreNextSource *pending_source;
+    RCLibCoreCrossfade crossfade;
+    RCLibCoreReplayGain replaygain;
+    RCLibCorePcmRing pcm_ring;
+    RCLibCoreStats stats;
     gulong identity_id;
     gulong message_id;
     gulong volume_id;
     gulong audio_tag_changed_id;
     gulong source_id;
+    gulong about_to_finish_id;
     guint tag_update_id;
 };
 
@@ -170,6 +381,58 @@ static void rclib_core_metadata_free(RCLibCoreMetadata *metadata)
     memset(metadata, 0, sizeof(RCLibCoreMetadata));
 }
 
+static void rclib_core_next_source_free(RCLibCoreNextSource *source)
+{
+    if(source==NULL) return;
+    if(source->source_reference!=NULL &&
+        source->source_destroy_notify!=NULL)
+    {
+        source->source_destroy_notify(source->source_reference);
+    }
+    g_free(source->uri);
+    g_free(source->cookie);
+    g_free(source);
+}
+
+static void rclib_core_play_source_clear(RCLibCorePrivate *priv)
+{
+    if(priv->uri!=NULL)
+    {
+        g_free(priv->uri);
+        priv->uri = NULL;
+    }
+    if(priv->source_reference!=NULL)
+    {
+        if(priv->source_destroy_notify!=NULL)
+        {
+            priv->source_destroy_notify(priv->source_reference);
+        }
+        priv->source_reference = NULL;
+    }
+    priv->source_destroy_notify = NULL;
+    if(priv->ext_cookie!=NULL)
+    {
+        g_free(priv->ext_cookie);
+        priv->ext_cookie = NULL;
+    }
+}
+
+static void rclib_core_tag_update_queue_flush(RCLibCorePrivate *priv)
+{
+    GstTagList *tags;
+    g_async_queue_lock(priv->tag_update_queue);
+    while((tags=g_async_queue_try_pop_unlocked(priv->tag_update_queue))!=
+        NULL)
+    {
+        #if GST_VERSION_MAJOR==1
+            gst_tag_list_unref(tags);
+        #else
+            gst_tag_list_free(tags);
+        #endif
+    }
+    g_async_queue_unlock(priv->tag_update_queue);
+}
+
 static inline gboolean rclib_core_parse_metadata(const GstTagList *tags,
     RCLibCoreMetadata *metadata, guint64 start_time,
     guint64 end_time)
@@ -304,6 +567,291 @@ static inline gboolean rclib_core_parse_metadata(const GstTagList *tags,
     return update;
 }
 
+static void rclib_core_stats_histogram_add(RCLibCoreStatsHistogram *hist,
+    guint64 value)
+{
+    /* WARNING: This function is not called in main thread! */
+    gint bucket = 0;
+    gint max;
+    if(value>G_MAXINT) value = G_MAXINT;
+    while(bucket<RCLIB_CORE_HISTOGRAM_BUCKETS-1 && (value>>(bucket+1))>0)
+        bucket++;
+    g_atomic_int_inc(&(hist->buckets[bucket]));
+    g_atomic_int_inc(&(hist->count));
+    g_atomic_pointer_add(&(hist->sum), (gssize)value);
+    do
+    {
+        max = g_atomic_int_get(&(hist->max));
+        if((gint)value<=max) break;
+    }
+    while(!g_atomic_int_compare_and_exchange(&(hist->max), max,
+        (gint)value));
+}
+
+static void rclib_core_stats_histogram_read(RCLibCoreStatsHistogram *hist,
+    RCLibCoreHistogram *result)
+{
+    guint i;
+    result->count = g_atomic_int_get(&(hist->count));
+    result->sum = (gsize)g_atomic_pointer_get(&(hist->sum));
+    result->max = g_atomic_int_get(&(hist->max));
+    for(i=0;i<RCLIB_CORE_HISTOGRAM_BUCKETS;i++)
+        result->buckets[i] = g_atomic_int_get(&(hist->buckets[i]));
+}
+
+static void rclib_core_stats_stage_unref(RCLibCoreStatsStage *stage)
+{
+    if(stage==NULL) return;
+    if(!g_atomic_int_dec_and_test(&(stage->ref_count))) return;
+    if(stage->sink_pad!=NULL)
+        gst_object_unref(stage->sink_pad);
+    if(stage->src_pad!=NULL)
+        gst_object_unref(stage->src_pad);
+    g_free(stage->name);
+    g_free(stage);
+}
+
+#if GST_VERSION_MAJOR==1
+static GstPadProbeReturn rclib_core_stats_stage_sink_probe_cb(GstPad *pad,
+    GstPadProbeInfo *info, gpointer data)
+{
+    /* WARNING: This function is not called in main thread! */
+    RCLibCoreStatsStage *stage = (RCLibCoreStatsStage *)data;
+    stage->start_time = gst_util_get_timestamp();
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn rclib_core_stats_stage_src_probe_cb(GstPad *pad,
+    GstPadProbeInfo *info, gpointer data)
+{
+    /* WARNING: This function is not called in main thread! */
+    RCLibCoreStatsStage *stage = (RCLibCoreStatsStage *)data;
+    GstClockTime now;
+    if(stage->start_time==0) return GST_PAD_PROBE_OK;
+    now = gst_util_get_timestamp();
+    if(now>=stage->start_time)
+    {
+        rclib_core_stats_histogram_add(&(stage->process_time),
+            (now - stage->start_time) / GST_USECOND);
+    }
+    stage->start_time = 0;
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn rclib_core_stats_input_probe_cb(GstPad *pad,
+    GstPadProbeInfo *info, gpointer data)
+{
+    /* WARNING: This function is not called in main thread! */
+    RCLibCorePrivate *priv = (RCLibCorePrivate *)data;
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    gsize frames;
+    if(buffer==NULL || priv->pcm_ring.frame_size<=0)
+        return GST_PAD_PROBE_OK;
+    frames = gst_buffer_get_size(buffer) / priv->pcm_ring.frame_size;
+    rclib_core_stats_histogram_add(&(priv->stats.buffer_size), frames);
+    g_atomic_pointer_add(&(priv->stats.frames), (gssize)frames);
+    return GST_PAD_PROBE_OK;
+}
+
+/* Measure how early the buffers reach the audio sink. */
+static GstPadProbeReturn rclib_core_stats_output_probe_cb(GstPad *pad,
+    GstPadProbeInfo *info, gpointer data)
+{
+    /* WARNING: This function is not called in main thread! */
+    RCLibCorePrivate *priv = (RCLibCorePrivate *)data;
+    RCLibCoreStats *stats = &(priv->stats);
+    GstEvent *event;
+    GstBuffer *buffer;
+    GstClock *clock;
+    GstClockTime running_time, now;
+    gint64 headroom;
+    if(GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM)
+    {
+        event = GST_PAD_PROBE_INFO_EVENT(info);
+        if(GST_EVENT_TYPE(event)==GST_EVENT_SEGMENT)
+            gst_event_copy_segment(event, &(stats->segment));
+        return GST_PAD_PROBE_OK;
+    }
+    buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if(buffer==NULL || !GST_BUFFER_PTS_IS_VALID(buffer))
+        return GST_PAD_PROBE_OK;
+    if(stats->segment.format!=GST_FORMAT_TIME) return GST_PAD_PROBE_OK;
+    if(GST_STATE(priv->playbin)!=GST_STATE_PLAYING)
+        return GST_PAD_PROBE_OK;
+    clock = gst_element_get_clock(priv->playbin);
+    if(clock==NULL) return GST_PAD_PROBE_OK;
+    now = gst_clock_get_time(clock) -
+        gst_element_get_base_time(priv->playbin);
+    gst_object_unref(clock);
+    running_time = gst_segment_to_running_time(&(stats->segment),
+        GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+    if(!GST_CLOCK_TIME_IS_VALID(running_time)) return GST_PAD_PROBE_OK;
+    headroom = GST_CLOCK_DIFF(now, running_time) / GST_USECOND;
+    if(headroom<0)
+        g_atomic_int_inc(&(stats->late_buffers));
+    else
+        rclib_core_stats_histogram_add(&(stats->headroom), headroom);
+    return GST_PAD_PROBE_OK;
+}
+#endif
+
+/* Get the name of the effect element in a plug-in bin. */
+static gchar *rclib_core_stats_get_element_name(GstElement *element)
+{
+    GstPad *ghost, *target, *src_pad, *peer;
+    GstElement *inner = NULL;
+    GstElement *audioconvert;
+    gchar *name;
+    if(!GST_IS_BIN(element)) return gst_element_get_name(element);
+    ghost = gst_element_get_static_pad(element, "sink");
+    if(ghost!=NULL && GST_IS_GHOST_PAD(ghost))
+    {
+        target = gst_ghost_pad_get_target(GST_GHOST_PAD(ghost));
+        if(target!=NULL)
+        {
+            audioconvert = gst_pad_get_parent_element(target);
+            gst_object_unref(target);
+            src_pad = gst_element_get_static_pad(audioconvert, "src");
+            gst_object_unref(audioconvert);
+            peer = gst_pad_get_peer(src_pad);
+            gst_object_unref(src_pad);
+            if(peer!=NULL)
+            {
+                inner = gst_pad_get_parent_element(peer);
+                gst_object_unref(peer);
+            }
+        }
+    }
+    if(ghost!=NULL) gst_object_unref(ghost);
+    if(inner==NULL) return gst_element_get_name(element);
+    name = gst_element_get_name(inner);
+    gst_object_unref(inner);
+    return name;
+}
+
+static void rclib_core_stats_add_stage(RCLibCorePrivate *priv,
+    GstElement *element)
+{
+    RCLibCoreStatsStage *stage;
+    stage = g_new0(RCLibCoreStatsStage, 1);
+    stage->ref_count = 1;
+    stage->name = rclib_core_stats_get_element_name(element);
+    stage->sink_pad = gst_element_get_static_pad(element, "sink");
+    stage->src_pad = gst_element_get_static_pad(element, "src");
+    g_ptr_array_add(priv->stats.stages, stage);
+    #if GST_VERSION_MAJOR==1
+        if(stage->sink_pad==NULL || stage->src_pad==NULL) return;
+        g_atomic_int_add(&(stage->ref_count), 2);
+        stage->sink_probe_id = gst_pad_add_probe(stage->sink_pad,
+            GST_PAD_PROBE_TYPE_BUFFER, rclib_core_stats_stage_sink_probe_cb,
+            stage, (GDestroyNotify)rclib_core_stats_stage_unref);
+        stage->src_probe_id = gst_pad_add_probe(stage->src_pad,
+            GST_PAD_PROBE_TYPE_BUFFER, rclib_core_stats_stage_src_probe_cb,
+            stage, (GDestroyNotify)rclib_core_stats_stage_unref);
+    #endif
+}
+
+static void rclib_core_stats_stage_detach(RCLibCoreStatsStage *stage)
+{
+    #if GST_VERSION_MAJOR==1
+        if(stage->sink_probe_id>0)
+            gst_pad_remove_probe(stage->sink_pad, stage->sink_probe_id);
+        if(stage->src_probe_id>0)
+            gst_pad_remove_probe(stage->src_pad, stage->src_probe_id);
+    #endif
+    stage->sink_probe_id = 0;
+    stage->src_probe_id = 0;
+    rclib_core_stats_stage_unref(stage);
+}
+
+static void rclib_core_stats_detach(RCLibCorePrivate *priv)
+{
+    RCLibCoreStats *stats = &(priv->stats);
+    if(!stats->enabled) return;
+    stats->enabled = FALSE;
+    #if GST_VERSION_MAJOR==1
+        if(stats->input_probe_id>0)
+            gst_pad_remove_probe(stats->input_pad, stats->input_probe_id);
+        if(stats->output_probe_id>0)
+            gst_pad_remove_probe(stats->output_pad, stats->output_probe_id);
+    #endif
+    stats->input_probe_id = 0;
+    stats->output_probe_id = 0;
+    if(stats->input_pad!=NULL)
+        gst_object_unref(stats->input_pad);
+    if(stats->output_pad!=NULL)
+        gst_object_unref(stats->output_pad);
+    stats->input_pad = NULL;
+    stats->output_pad = NULL;
+    if(stats->stages!=NULL)
+    {
+        g_ptr_array_foreach(stats->stages, (GFunc)
+            rclib_core_stats_stage_detach, NULL);
+        g_ptr_array_free(stats->stages, TRUE);
+        stats->stages = NULL;
+    }
+}
+
+/*
+ * Attach the probes on the identity, the effect bin and the elements in
+ * the effect bin, in the order of the audio path.
+ */
+
+static void rclib_core_stats_attach(RCLibCorePrivate *priv)
+{
+    RCLibCoreStats *stats = &(priv->stats);
+    GstElement *element, *next;
+    GstPad *pad, *peer;
+    gchar *name;
+    if(stats->enabled) return;
+    memset(&(stats->buffer_size), 0, sizeof(RCLibCoreStatsHistogram));
+    memset(&(stats->headroom), 0, sizeof(RCLibCoreStatsHistogram));
+    stats->late_buffers = 0;
+    stats->frames = 0;
+    gst_segment_init(&(stats->segment), GST_FORMAT_UNDEFINED);
+    stats->start_time = g_get_monotonic_time();
+    stats->stages = g_ptr_array_new();
+    rclib_core_stats_add_stage(priv, priv->identity);
+    rclib_core_stats_add_stage(priv, priv->effectbin);
+    element = gst_bin_get_by_name(GST_BIN(priv->effectbin),
+        "effect-audioconvert");
+    while(element!=NULL)
+    {
+        name = gst_element_get_name(element);
+        if(g_strcmp0(name, "effect-identity")==0)
+        {
+            g_free(name);
+            gst_object_unref(element);
+            break;
+        }
+        g_free(name);
+        rclib_core_stats_add_stage(priv, element);
+        next = NULL;
+        pad = gst_element_get_static_pad(element, "src");
+        gst_object_unref(element);
+        if(pad==NULL) break;
+        peer = gst_pad_get_peer(pad);
+        gst_object_unref(pad);
+        if(peer!=NULL)
+        {
+            next = gst_pad_get_parent_element(peer);
+            gst_object_unref(peer);
+        }
+        element = next;
+    }
+    stats->input_pad = gst_element_get_static_pad(priv->identity, "sink");
+    stats->output_pad = gst_element_get_static_pad(priv->effectbin, "src");
+    #if GST_VERSION_MAJOR==1
+        stats->input_probe_id = gst_pad_add_probe(stats->input_pad,
+            GST_PAD_PROBE_TYPE_BUFFER, rclib_core_stats_input_probe_cb,
+            priv, NULL);
+        stats->output_probe_id = gst_pad_add_probe(stats->output_pad,
+            GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+            rclib_core_stats_output_probe_cb, priv, NULL);
+    #endif
+    stats->enabled = TRUE;
+}
+
 
 static void rclib_core_finalize(GObject *object)
 {
@@ -321,8 +869,12 @@ static void rclib_core_finalize(GObject *object)
     }
     if(priv->tag_update_id!=0)
         g_source_remove(priv->tag_update_id);
+    rclib_core_stats_detach(priv);
     if(priv->identity!=NULL && priv->identity_id>0)
         g_signal_handler_disconnect(priv->identity, priv->identity_id);
+    if(priv->pcm_ring.caps!=NULL)
+        gst_caps_unref(priv->pcm_ring.caps);
+    g_free(priv->pcm_ring.data);
     if(priv->playbin!=NULL)
     {
         if(priv->volume_id>0)
@@ -334,8 +886,30 @@ static void rclib_core_finalize(GObject *object)
         }
         if(priv->source_id>0)
             g_signal_handler_disconnect(priv->playbin, priv->source_id);
+        if(priv->about_to_finish_id>0)
+        {
+            g_signal_handler_disconnect(priv->playbin,
+                priv->about_to_finish_id);
+        }
+        #if GST_VERSION_MAJOR==1
+            if(priv->crossfade.tail!=NULL)
+            {
+                gst_element_set_state(priv->crossfade.tail,
+                    GST_STATE_NULL);
+            }
+        #endif
         gst_element_set_state(priv->playbin, GST_STATE_NULL);
     }
+    #if GST_VERSION_MAJOR==1
+        if(priv->crossfade.timer_id>0)
+            g_source_remove(priv->crossfade.timer_id);
+        if(priv->crossfade.main_pad!=NULL)
+            gst_object_unref(priv->crossfade.main_pad);
+    #endif
+    rclib_core_next_source_free(priv->next_source);
+    rclib_core_next_source_free(priv->pending_source);
+    g_mutex_clear(&(priv->next_mutex));
+    g_mutex_clear(&(priv->crossfade.mutex));
     if(priv->tag_update_queue!=NULL)
         g_async_queue_unref(priv->tag_update_queue);
     if(priv->extra_plugin_list!=NULL)
@@ -489,7 +1063,9 @@ static void rclib_core_class_init(RCLibCoreClass *klass)
      *
      * The ::buffering signal is emitted when the buffer data pass through
      *     the pipeline.
-     * Warning: This signal is emitted from the working thread of GStreamer.
+     * Warning: This signal is emitted from the working thread of GStreamer,
+     *     and the handlers block the playing. Use rclib_core_pcm_read()
+     *     to read the samples at the rate of the reader instead.
      */
     core_signals[SIGNAL_BUFFER_PROBE] = g_signal_new("buffer-probe",
         RCLIB_TYPE_CORE, G_SIGNAL_RUN_FIRST, G_STRUCT_OFFSET(RCLibCoreClass,
@@ -508,19 +1084,17 @@ static void rclib_core_class_init(RCLibCoreClass *klass)
         G_TYPE_NONE, 1, G_TYPE_STRING, NULL);
 }
 
-static gboolean rclib_core_effect_add_element_internal(GstElement *effectbin,
-    GstElement *new_element, gboolean block)
+/*
+ * Put the effect element in a bin between two audioconvert elements, so
+ * that it can be linked in the effect bin whatever format it supports.
+ */
+
+static GstElement *rclib_core_effect_bin_new(GstElement *new_element)
 {
-    GstPad *binsinkpad;
-    GstPad *binsrcpad;
     GstPad *realpad;
-    GstPad *prevpad;
-    GstPad *srcpad, *blockpad;
     GstElement *bin = NULL;
-    GstElement *identity = NULL;
     GstElement *audioconvert = NULL;
     GstElement *audioconvert2 = NULL;
-    GstPadLinkReturn link;
     gboolean flag = FALSE;
     G_STMT_START
     {
@@ -547,143 +1121,1170 @@ static gboolean rclib_core_effect_add_element_internal(GstElement *effectbin,
             if(audioconvert!=NULL) gst_object_unref(audioconvert);
             if(audioconvert2!=NULL) gst_object_unref(audioconvert2);
         }
-        return FALSE;
-    }
-    if(block)
-    {
-        srcpad = gst_element_get_static_pad(effectbin, "sink");
-        blockpad = gst_pad_get_peer(srcpad);
-        gst_object_unref(srcpad);
-        #if GST_VERSION_MAJOR==1
-        #else
-            gst_pad_set_blocked(blockpad, TRUE);
-        #endif
-        gst_object_unref(blockpad);
+        return NULL;
     }
     realpad = gst_element_get_static_pad(audioconvert, "sink");
-    binsinkpad = gst_ghost_pad_new("sink", realpad);
-    gst_element_add_pad(bin, binsinkpad);
+    gst_element_add_pad(bin, gst_ghost_pad_new("sink", realpad));
     gst_object_unref(realpad);
     realpad = gst_element_get_static_pad(audioconvert2, "src");
-    binsrcpad = gst_ghost_pad_new("src", realpad);
-    gst_element_add_pad(bin, binsrcpad);
+    gst_element_add_pad(bin, gst_ghost_pad_new("src", realpad));
     gst_object_unref(realpad);
-    gst_bin_add(GST_BIN(effectbin), bin);
+    return bin;
+}
+
+/* Link the bin (already in the effect bin) before the effect identity. */
+
+static gboolean rclib_core_effect_link_bin(GstElement *effectbin,
+    GstElement *bin)
+{
+    GstPad *binsinkpad, *binsrcpad;
+    GstPad *realpad, *prevpad;
+    GstElement *identity;
+    GstPadLinkReturn link;
     identity = gst_bin_get_by_name(GST_BIN(effectbin), "effect-identity");
     realpad = gst_element_get_static_pad(identity, "sink");
-    prevpad = gst_pad_get_peer(realpad);
     gst_object_unref(identity);
+    prevpad = gst_pad_get_peer(realpad);
+    binsinkpad = gst_element_get_static_pad(bin, "sink");
+    binsrcpad = gst_element_get_static_pad(bin, "src");
     gst_pad_unlink(prevpad, realpad);
     link = gst_pad_link(prevpad, binsinkpad);
-    gst_object_unref(prevpad);
-    if(link!=GST_PAD_LINK_OK)
+    if(link==GST_PAD_LINK_OK)
     {
-        gst_pad_link(prevpad, realpad);
-        if(block)
-        {
-            srcpad = gst_element_get_static_pad(effectbin, "sink");
-            blockpad = gst_pad_get_peer(srcpad);
-            gst_object_unref(srcpad);
-            #if GST_VERSION_MAJOR==1
-            #else
-                gst_pad_set_blocked(blockpad, FALSE);
-            #endif
-            gst_object_unref(blockpad);
-        }
-        gst_object_unref(realpad);
-        gst_bin_remove(GST_BIN(effectbin), bin);
-        return FALSE;
+        link = gst_pad_link(binsrcpad, realpad);
+        if(link!=GST_PAD_LINK_OK)
+            gst_pad_unlink(prevpad, binsinkpad);
     }
-    link = gst_pad_link(binsrcpad, realpad);
-    gst_object_unref(realpad);
     if(link!=GST_PAD_LINK_OK)
-    {
-        if(block)
-        {
-            srcpad = gst_element_get_static_pad(effectbin, "sink");
-            blockpad = gst_pad_get_peer(srcpad);
-            gst_object_unref(srcpad);
-            #if GST_VERSION_MAJOR==1
-            #else
-                gst_pad_set_blocked(blockpad, FALSE);
-            #endif
-            gst_object_unref(blockpad);
-        }
-        return FALSE;
-    }
+        gst_pad_link(prevpad, realpad);
+    gst_object_unref(prevpad);
+    gst_object_unref(realpad);
+    gst_object_unref(binsinkpad);
+    gst_object_unref(binsrcpad);
+    if(link!=GST_PAD_LINK_OK) return FALSE;
     gst_element_sync_state_with_parent(bin);
-    if(block)
-    {
-        srcpad = gst_element_get_static_pad(effectbin, "sink");
-        blockpad = gst_pad_get_peer(srcpad);
-        gst_object_unref(srcpad);
-        #if GST_VERSION_MAJOR==1
-        #else
-            gst_pad_set_blocked(blockpad, FALSE);
-        #endif
-        gst_object_unref(blockpad);
-    }
     return TRUE;
 }
 
-static void rclib_core_effect_remove_element_internal(GstElement *effectbin,
-    GstElement *element, gboolean block)
+#if GST_VERSION_MAJOR==1
+
+static GstPadProbeReturn rclib_core_effect_drain_probe_cb(GstPad *pad,
+    GstPadProbeInfo *info, gpointer data)
 {
-    GstPad *mypad;
-    GstPad *prevpad, *nextpad;
-    GstPad *srcpad, *blockpad;
-    GstElement *bin;
-    bin = GST_ELEMENT(gst_element_get_parent(element));
-    if(bin==NULL) return;
-    gst_object_unref(bin);
-    gst_element_set_state(bin, GST_STATE_NULL);
-    if(block)
-    {
-        srcpad = gst_element_get_static_pad(effectbin, "sink");
-        blockpad = gst_pad_get_peer(srcpad);
-        gst_object_unref(srcpad);
-        #if GST_VERSION_MAJOR==1
-        #else
-            gst_pad_set_blocked(blockpad, TRUE);
-        #endif
-        gst_object_unref(blockpad);
-    }
-    mypad = gst_element_get_static_pad(bin, "sink");
-    prevpad = gst_pad_get_peer(mypad);
-    gst_pad_unlink(prevpad, mypad);
-    gst_object_unref(mypad);
-    mypad = gst_element_get_static_pad(bin, "src");
-    nextpad = gst_pad_get_peer(mypad);
-    gst_pad_unlink(mypad, nextpad);
-    gst_object_unref(mypad);
-    gst_pad_link(prevpad, nextpad);
-    gst_object_unref(prevpad);
-    gst_object_unref(nextpad);
-    if(block)
-    {
-        srcpad = gst_element_get_static_pad(effectbin, "sink");
-        blockpad = gst_pad_get_peer(srcpad);
-        gst_object_unref(srcpad);
-        #if GST_VERSION_MAJOR==1
-        #else
-            gst_pad_set_blocked(blockpad, FALSE);
-        #endif
-        gst_object_unref(blockpad);
-    }
-    gst_bin_remove(GST_BIN(effectbin), bin);
+    /* WARNING: This function may be not called in main thread! */
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+    if(event==NULL || GST_EVENT_TYPE(event)!=GST_EVENT_EOS)
+        return GST_PAD_PROBE_OK;
+    return GST_PAD_PROBE_DROP;
 }
 
-static void rclib_core_bus_callback(GstBus *bus, GstMessage *msg,
-    gpointer data)
-{
-    RCLibCorePrivate *priv = NULL;
-    GObject *object = G_OBJECT(data);    
+#endif
+
+/*
+ * Unlink the bin from the effect bin, and link its neighbours together.
+ * If the bin should be drained, an EOS event is sent to the bin first,
+ * so the data kept in the elements is pushed out before they are
+ * unlinked, and the EOS event is dropped at the end of the bin.
+ */
+
+static void rclib_core_effect_unlink_bin(GstElement *effectbin,
+    GstElement *bin, gboolean drain)
+{
+    GstPad *binsinkpad, *binsrcpad;
+    GstPad *prevpad, *nextpad;
+    #if GST_VERSION_MAJOR==1
+        gulong probe_id;
+    #endif
+    if(GST_OBJECT_PARENT(bin)!=GST_OBJECT_CAST(effectbin)) return;
+    binsinkpad = gst_element_get_static_pad(bin, "sink");
+    binsrcpad = gst_element_get_static_pad(bin, "src");
+    #if GST_VERSION_MAJOR==1
+        if(drain)
+        {
+            probe_id = gst_pad_add_probe(binsrcpad,
+                GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+                rclib_core_effect_drain_probe_cb, NULL, NULL);
+            gst_pad_send_event(binsinkpad, gst_event_new_eos());
+            gst_pad_remove_probe(binsrcpad, probe_id);
+        }
+    #endif
+    gst_element_set_state(bin, GST_STATE_NULL);
+    prevpad = gst_pad_get_peer(binsinkpad);
+    nextpad = gst_pad_get_peer(binsrcpad);
+    if(prevpad!=NULL)
+        gst_pad_unlink(prevpad, binsinkpad);
+    if(nextpad!=NULL)
+        gst_pad_unlink(binsrcpad, nextpad);
+    if(prevpad!=NULL && nextpad!=NULL)
+        gst_pad_link(prevpad, nextpad);
+    if(prevpad!=NULL) gst_object_unref(prevpad);
+    if(nextpad!=NULL) gst_object_unref(nextpad);
+    gst_object_unref(binsinkpad);
+    gst_object_unref(binsrcpad);
+    gst_bin_remove(GST_BIN(effectbin), bin);
+}
+
+#if GST_VERSION_MAJOR==1
+
+static void rclib_core_effect_swap_free(RCLibCoreEffectSwap *swap)
+{
+    if(swap==NULL) return;
+    gst_object_unref(swap->bin);
+    gst_object_unref(swap->effectbin);
+    g_free(swap);
+}
+
+static GstPadProbeReturn rclib_core_effect_swap_probe_cb(GstPad *pad,
+    GstPadProbeInfo *info, gpointer data)
+{
+    /* WARNING: This function may be not called in main thread! */
+    RCLibCoreEffectSwap *swap = (RCLibCoreEffectSwap *)data;
+    if(!swap->add)
+        rclib_core_effect_unlink_bin(swap->effectbin, swap->bin, TRUE);
+    else if(!rclib_core_effect_link_bin(swap->effectbin, swap->bin))
+    {
+        g_warning("Cannot link the sound effect plug-in!");
+        gst_element_set_state(swap->bin, GST_STATE_NULL);
+        gst_bin_remove(GST_BIN(swap->effectbin), swap->bin);
+    }
+    return GST_PAD_PROBE_REMOVE;
+}
+
+/*
+ * Link or unlink the bin when the pad before the effect bin is idle.
+ * The idle probe is called at once if no data is flowing, or after the
+ * buffer being pushed is done, and the pad is kept blocked until the
+ * effect chain is relinked, so no buffer is pushed into a half linked
+ * chain. The sticky events (caps, segment) of the pad are sent to the
+ * new peer before the next buffer, so the chain keeps the same format
+ * and the audio sink does not need to be negotiated again.
+ */
+
+static void rclib_core_effect_swap(GstElement *effectbin, GstElement *bin,
+    gboolean add)
+{
+    GstPad *sinkpad, *blockpad;
+    RCLibCoreEffectSwap *swap;
+    sinkpad = gst_element_get_static_pad(effectbin, "sink");
+    blockpad = gst_pad_get_peer(sinkpad);
+    gst_object_unref(sinkpad);
+    swap = g_new0(RCLibCoreEffectSwap, 1);
+    swap->effectbin = gst_object_ref(effectbin);
+    swap->bin = gst_object_ref(bin);
+    swap->add = add;
+    if(blockpad==NULL)
+    {
+        rclib_core_effect_swap_probe_cb(NULL, NULL, swap);
+        rclib_core_effect_swap_free(swap);
+        return;
+    }
+    gst_pad_add_probe(blockpad, GST_PAD_PROBE_TYPE_IDLE,
+        rclib_core_effect_swap_probe_cb, swap,
+        (GDestroyNotify)rclib_core_effect_swap_free);
+    gst_object_unref(blockpad);
+}
+
+#else
+
+static void rclib_core_effect_set_blocked(GstElement *effectbin,
+    gboolean blocked)
+{
+    GstPad *sinkpad, *blockpad;
+    sinkpad = gst_element_get_static_pad(effectbin, "sink");
+    blockpad = gst_pad_get_peer(sinkpad);
+    gst_object_unref(sinkpad);
+    if(blockpad==NULL) return;
+    gst_pad_set_blocked(blockpad, blocked);
+    gst_object_unref(blockpad);
+}
+
+#endif
+
+static gboolean rclib_core_effect_add_element_internal(GstElement *effectbin,
+    GstElement *new_element, gboolean block)
+{
+    GstElement *bin;
+    gboolean flag;
+    bin = rclib_core_effect_bin_new(new_element);
+    if(bin==NULL) return FALSE;
+    gst_bin_add(GST_BIN(effectbin), bin);
+    #if GST_VERSION_MAJOR==1
+        if(block)
+        {
+            rclib_core_effect_swap(effectbin, bin, TRUE);
+            return TRUE;
+        }
+        flag = rclib_core_effect_link_bin(effectbin, bin);
+    #else
+        if(block) rclib_core_effect_set_blocked(effectbin, TRUE);
+        flag = rclib_core_effect_link_bin(effectbin, bin);
+        if(block) rclib_core_effect_set_blocked(effectbin, FALSE);
+    #endif
+    if(!flag)
+        gst_bin_remove(GST_BIN(effectbin), bin);
+    return flag;
+}
+
+static void rclib_core_effect_remove_element_internal(GstElement *effectbin,
+    GstElement *element, gboolean block)
+{
+    GstElement *bin;
+    bin = GST_ELEMENT(gst_element_get_parent(element));
+    if(bin==NULL) return;
+    gst_object_unref(bin);
+    #if GST_VERSION_MAJOR==1
+        if(block)
+        {
+            rclib_core_effect_swap(effectbin, bin, FALSE);
+            return;
+        }
+        rclib_core_effect_unlink_bin(effectbin, bin, FALSE);
+    #else
+        if(block) rclib_core_effect_set_blocked(effectbin, TRUE);
+        rclib_core_effect_unlink_bin(effectbin, bin, FALSE);
+        if(block) rclib_core_effect_set_blocked(effectbin, FALSE);
+    #endif
+}
+
+#if GST_VERSION_MAJOR==1
+
+static inline gdouble rclib_core_crossfade_gain(
+    RCLibCoreCrossfadeCurve curve, gdouble x)
+{
+    gdouble u;
+    if(x<=0.0) return 0.0;
+    if(x>=1.0) return 1.0;
+    switch(curve)
+    {
+        case RCLIB_CORE_CROSSFADE_CURVE_EQUAL_POWER:
+        {
+            /* Bhaskara's approximation of sin(x*PI/2). */
+            u = x * (2.0 - x);
+            return 4.0 * u / (5.0 - u);
+        }
+        case RCLIB_CORE_CROSSFADE_CURVE_S_CURVE:
+            return x * x * (3.0 - 2.0 * x);
+        default:
+            break;
+    }
+    return x;
+}
+
+static GstCaps *rclib_core_crossfade_caps_new()
+{
+    return gst_caps_new_simple("audio/x-raw", "format", G_TYPE_STRING,
+        GST_AUDIO_NE(F32), "layout", G_TYPE_STRING, "interleaved", NULL);
+}
+
+/*
+ * Get the running time (without the pad offset) and the stream time of
+ * the buffer on the pad.
+ */
+
+static gboolean rclib_core_crossfade_buffer_time(GstPad *pad,
+    GstBuffer *buffer, gint64 *running_time, gint64 *stream_time)
+{
+    GstEvent *event;
+    const GstSegment *segment;
+    GstClockTime timestamp;
+    gint64 rtime, stime;
+    timestamp = GST_BUFFER_PTS(buffer);
+    if(!GST_CLOCK_TIME_IS_VALID(timestamp)) return FALSE;
+    event = gst_pad_get_sticky_event(pad, GST_EVENT_SEGMENT, 0);
+    if(event==NULL) return FALSE;
+    gst_event_parse_segment(event, &segment);
+    if(segment->format!=GST_FORMAT_TIME)
+    {
+        gst_event_unref(event);
+        return FALSE;
+    }
+    rtime = gst_segment_to_running_time(segment, GST_FORMAT_TIME,
+        timestamp);
+    stime = gst_segment_to_stream_time(segment, GST_FORMAT_TIME,
+        timestamp);
+    gst_event_unref(event);
+    if(rtime<0 || stime<0) return FALSE;
+    if(running_time!=NULL) *running_time = rtime;
+    if(stream_time!=NULL) *stream_time = stime;
+    return TRUE;
+}
+
+/*
+ * Apply the volume curve to the buffer in interleaved float samples,
+ * the buffer starts at the given running time.
+ */
+
+static GstBuffer *rclib_core_crossfade_apply(GstBuffer *buffer,
+    GstPad *pad, gint64 running_time, gint64 start, gint64 duration,
+    RCLibCoreCrossfadeCurve curve, gboolean fade_in)
+{
+    GstCaps *caps;
+    GstAudioInfo audio_info;
+    GstMapInfo map_info;
+    gfloat *samples;
+    gint rate, channels, j;
+    gsize frames, i;
+    gdouble x, gain;
+    if(duration<=0) return buffer;
+    caps = gst_pad_get_current_caps(pad);
+    if(caps==NULL) return buffer;
+    gst_audio_info_init(&audio_info);
+    if(!gst_audio_info_from_caps(&audio_info, caps) ||
+        GST_AUDIO_INFO_FORMAT(&audio_info)!=GST_AUDIO_FORMAT_F32)
+    {
+        gst_caps_unref(caps);
+        return buffer;
+    }
+    gst_caps_unref(caps);
+    rate = GST_AUDIO_INFO_RATE(&audio_info);
+    channels = GST_AUDIO_INFO_CHANNELS(&audio_info);
+    if(rate<=0 || channels<=0) return buffer;
+    buffer = gst_buffer_make_writable(buffer);
+    if(!gst_buffer_map(buffer, &map_info, GST_MAP_READWRITE))
+        return buffer;
+    samples = (gfloat *)map_info.data;
+    frames = map_info.size / (sizeof(gfloat) * channels);
+    for(i=0;i<frames;i++)
+    {
+        x = (gdouble)(running_time - start + (gint64)
+            gst_util_uint64_scale_int(i, GST_SECOND, rate)) / duration;
+        gain = rclib_core_crossfade_gain(curve, fade_in ? x : 1.0 - x);
+        for(j=0;j<channels;j++)
+            samples[i*channels+j] *= gain;
+    }
+    gst_buffer_unmap(buffer, &map_info);
+    return buffer;
+}
+
+static void rclib_core_crossfade_post(RCLibCoreCrossfade *crossfade,
+    const gchar *name)
+{
+    gst_element_post_message(crossfade->bin, gst_message_new_element(
+        GST_OBJECT(crossfade->bin), gst_structure_new_empty(name)));
+}
+
+/*
+ * Link the prepared tail branch to the mixer at the crossfade point, the
+ * mutex must be held. The tail is mixed from the running time of the
+ * buffer at the given position in the main branch.
+ */
+
+static void rclib_core_crossfade_tail_start(RCLibCoreCrossfade *crossfade,
+    gint64 running_time, gint64 position)
+{
+    GstPad *src_pad, *mixer_pad;
+    GstCaps *caps;
+    mixer_pad = gst_element_get_request_pad(crossfade->mixer, "sink_%u");
+    if(mixer_pad==NULL) return;
+    src_pad = gst_element_get_static_pad(crossfade->tail, "src");
+    if(gst_pad_link(src_pad, mixer_pad)!=GST_PAD_LINK_OK)
+    {
+        gst_object_unref(src_pad);
+        gst_element_release_request_pad(crossfade->mixer, mixer_pad);
+        gst_object_unref(mixer_pad);
+        return;
+    }
+    gst_object_unref(src_pad);
+    gst_pad_set_offset(mixer_pad, running_time - position +
+        crossfade->tail_position - crossfade->tail_running_time);
+
+    /* The next music is mixed in the format of the current one. */
+    caps = gst_pad_get_current_caps(crossfade->main_pad);
+    if(caps!=NULL)
+    {
+        g_object_set(crossfade->capsfilter, "caps", caps, NULL);
+        gst_caps_unref(caps);
+    }
+    crossfade->tail_pad = mixer_pad;
+    crossfade->cut_running_time = running_time;
+    crossfade->main_state = RCLIB_CORE_CROSSFADE_MAIN_CUT;
+    crossfade->tail_state = RCLIB_CORE_CROSSFADE_TAIL_PLAYING;
+    src_pad = gst_element_get_static_pad(crossfade->tail_capsfilter, "src");
+    gst_pad_remove_probe(src_pad, crossfade->tail_block_id);
+    gst_object_unref(src_pad);
+    crossfade->tail_block_id = 0;
+}
+
+static GstPadProbeReturn rclib_core_crossfade_main_probe_cb(GstPad *pad,
+    GstPadProbeInfo *info, gpointer data)
+{
+    /* WARNING: This function is not called in main thread! */
+    RCLibCorePrivate *priv = (RCLibCorePrivate *)data;
+    RCLibCoreCrossfade *crossfade = &(priv->crossfade);
+    GstPadProbeReturn ret = GST_PAD_PROBE_OK;
+    GstEvent *event;
+    GstBuffer *buffer;
+    const GstSegment *segment;
+    gint64 running_time, position;
+    if(info->type & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM)
+    {
+        event = GST_PAD_PROBE_INFO_EVENT(info);
+        switch(GST_EVENT_TYPE(event))
+        {
+            case GST_EVENT_STREAM_START:
+            {
+                /* The mixer does not pass the stream-start event. */
+                rclib_core_crossfade_post(crossfade,
+                    "rclib-crossfade-stream-start");
+                break;
+            }
+            case GST_EVENT_SEGMENT:
+            {
+                /* The next music starts at the crossfade point. */
+                g_mutex_lock(&(crossfade->mutex));
+                if(crossfade->main_state==RCLIB_CORE_CROSSFADE_MAIN_CUT)
+                {
+                    gst_event_parse_segment(event, &segment);
+                    gst_pad_set_offset(crossfade->main_pad,
+                        crossfade->cut_running_time - (gint64)
+                        gst_segment_to_running_time(segment,
+                        GST_FORMAT_TIME, segment->start));
+                    crossfade->main_state =
+                        RCLIB_CORE_CROSSFADE_MAIN_FADE_IN;
+                }
+                g_mutex_unlock(&(crossfade->mutex));
+                break;
+            }
+            case GST_EVENT_FLUSH_STOP:
+            case GST_EVENT_EOS:
+            {
+                g_mutex_lock(&(crossfade->mutex));
+                crossfade->main_state = RCLIB_CORE_CROSSFADE_MAIN_NONE;
+                crossfade->main_valid = FALSE;
+                gst_pad_set_offset(crossfade->main_pad, 0);
+                g_mutex_unlock(&(crossfade->mutex));
+                break;
+            }
+            default:
+                break;
+        }
+        return GST_PAD_PROBE_OK;
+    }
+    buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if(buffer==NULL) return GST_PAD_PROBE_OK;
+    if(!rclib_core_crossfade_buffer_time(pad, buffer, &running_time,
+        &position))
+    {
+        return GST_PAD_PROBE_OK;
+    }
+    running_time += gst_pad_get_offset(crossfade->main_pad);
+    g_mutex_lock(&(crossfade->mutex));
+    if(crossfade->main_state==RCLIB_CORE_CROSSFADE_MAIN_NONE &&
+        crossfade->tail_state==RCLIB_CORE_CROSSFADE_TAIL_READY &&
+        position>=crossfade->cut_position)
+    {
+        rclib_core_crossfade_tail_start(crossfade, running_time, position);
+    }
+    switch(crossfade->main_state)
+    {
+        case RCLIB_CORE_CROSSFADE_MAIN_CUT:
+        {
+            /* Skip the rest of the current music, the tail plays it. */
+            ret = GST_PAD_PROBE_DROP;
+            break;
+        }
+        case RCLIB_CORE_CROSSFADE_MAIN_FADE_IN:
+        {
+            if(running_time>=crossfade->cut_running_time+
+                crossfade->duration)
+            {
+                crossfade->main_state = RCLIB_CORE_CROSSFADE_MAIN_NONE;
+                break;
+            }
+            GST_PAD_PROBE_INFO_DATA(info) = rclib_core_crossfade_apply(
+                buffer, pad, running_time, crossfade->cut_running_time,
+                crossfade->duration, crossfade->curve, TRUE);
+            break;
+        }
+        default:
+            break;
+    }
+    if(ret==GST_PAD_PROBE_OK)
+    {
+        crossfade->main_valid = TRUE;
+        crossfade->main_position = position;
+        crossfade->main_running_time = running_time;
+    }
+    g_mutex_unlock(&(crossfade->mutex));
+    return ret;
+}
+
+static gboolean rclib_core_crossfade_tail_seek_idle_cb(gpointer data)
+{
+    RCLibCorePrivate *priv = (RCLibCorePrivate *)data;
+    RCLibCoreCrossfade *crossfade = &(priv->crossfade);
+    GstElement *capsfilter = NULL;
+    gint64 position = 0;
+    g_mutex_lock(&(crossfade->mutex));
+    if(crossfade->tail_state==RCLIB_CORE_CROSSFADE_TAIL_SEEKING &&
+        !crossfade->tail_seeked)
+    {
+        capsfilter = gst_object_ref(crossfade->tail_capsfilter);
+        position = crossfade->cut_position;
+        crossfade->tail_seeked = TRUE;
+    }
+    g_mutex_unlock(&(crossfade->mutex));
+    if(capsfilter==NULL) return FALSE;
+    gst_element_send_event(capsfilter, gst_event_new_seek(1.0,
+        GST_FORMAT_TIME, GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE,
+        GST_SEEK_TYPE_SET, position, GST_SEEK_TYPE_NONE, -1));
+    gst_object_unref(capsfilter);
+    return FALSE;
+}
+
+/*
+ * The tail branch is blocked on its first buffer, and is seeked to the
+ * crossfade point in the main loop. It is ready when the first buffer
+ * after the seek is blocked.
+ */
+
+static GstPadProbeReturn rclib_core_crossfade_tail_block_cb(GstPad *pad,
+    GstPadProbeInfo *info, gpointer data)
+{
+    /* WARNING: This function is not called in main thread! */
+    RCLibCorePrivate *priv = (RCLibCorePrivate *)data;
+    RCLibCoreCrossfade *crossfade = &(priv->crossfade);
+    GstBuffer *buffer;
+    gint64 running_time, position;
+    gboolean seek = FALSE;
+    buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if(buffer==NULL) return GST_PAD_PROBE_OK;
+    g_mutex_lock(&(crossfade->mutex));
+    if(crossfade->tail_state==RCLIB_CORE_CROSSFADE_TAIL_SEEKING)
+    {
+        if(!crossfade->tail_seeked)
+            seek = TRUE;
+        else if(rclib_core_crossfade_buffer_time(pad, buffer,
+            &running_time, &position))
+        {
+            if(position+GST_SECOND<crossfade->cut_position)
+            {
+                /* The seek did not reach the decoder, try again. */
+                crossfade->tail_seeked = FALSE;
+                seek = TRUE;
+            }
+            else
+            {
+                crossfade->tail_running_time = running_time;
+                crossfade->tail_position = position;
+                crossfade->tail_state = RCLIB_CORE_CROSSFADE_TAIL_READY;
+            }
+        }
+    }
+    g_mutex_unlock(&(crossfade->mutex));
+    if(seek)
+    {
+        g_idle_add((GSourceFunc)rclib_core_crossfade_tail_seek_idle_cb,
+            priv);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn rclib_core_crossfade_tail_probe_cb(GstPad *pad,
+    GstPadProbeInfo *info, gpointer data)
+{
+    /* WARNING: This function is not called in main thread! */
+    RCLibCorePrivate *priv = (RCLibCorePrivate *)data;
+    RCLibCoreCrossfade *crossfade = &(priv->crossfade);
+    GstPadProbeReturn ret = GST_PAD_PROBE_OK;
+    GstBuffer *buffer;
+    gint64 running_time;
+    if(info->type & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM)
+    {
+        if(GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info))==GST_EVENT_EOS)
+            rclib_core_crossfade_post(crossfade, "rclib-crossfade-tail-eos");
+        return GST_PAD_PROBE_OK;
+    }
+    buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if(buffer==NULL) return GST_PAD_PROBE_OK;
+    g_mutex_lock(&(crossfade->mutex));
+    if(crossfade->tail_state==RCLIB_CORE_CROSSFADE_TAIL_PLAYING &&
+        rclib_core_crossfade_buffer_time(pad, buffer, &running_time, NULL))
+    {
+        running_time += gst_pad_get_offset(crossfade->tail_pad);
+        if(running_time>=crossfade->cut_running_time+crossfade->duration)
+            ret = GST_PAD_PROBE_DROP;
+        else
+        {
+            GST_PAD_PROBE_INFO_DATA(info) = rclib_core_crossfade_apply(
+                buffer, pad, running_time, crossfade->cut_running_time,
+                crossfade->duration, crossfade->curve, FALSE);
+        }
+    }
+    g_mutex_unlock(&(crossfade->mutex));
+    return ret;
+}
+
+static void rclib_core_crossfade_tail_pad_added_cb(GstElement *decoder,
+    GstPad *pad, gpointer data)
+{
+    GstElement *audioconvert = GST_ELEMENT(data);
+    GstPad *sink_pad;
+    sink_pad = gst_element_get_static_pad(audioconvert, "sink");
+    if(!gst_pad_is_linked(sink_pad))
+        gst_pad_link(pad, sink_pad);
+    gst_object_unref(sink_pad);
+}
+
+/*
+ * Prepare the tail branch which decodes the URI from the crossfade point,
+ * it is paused on its own until the main branch reaches the point.
+ */
+
+static void rclib_core_crossfade_tail_add(RCLibCorePrivate *priv,
+    const gchar *uri, gint64 cut_position)
+{
+    RCLibCoreCrossfade *crossfade = &(priv->crossfade);
+    GstElement *tail, *decoder, *audioconvert, *audioresample;
+    GstElement *capsfilter;
+    GstCaps *caps;
+    GstPad *pad;
+    crossfade->tail_done = TRUE;
+    tail = gst_bin_new("rclib-crossfade-tail");
+    decoder = gst_element_factory_make("uridecodebin", NULL);
+    audioconvert = gst_element_factory_make("audioconvert", NULL);
+    audioresample = gst_element_factory_make("audioresample", NULL);
+    capsfilter = gst_element_factory_make("capsfilter", NULL);
+    if(tail==NULL || decoder==NULL || audioconvert==NULL ||
+        audioresample==NULL || capsfilter==NULL)
+    {
+        g_warning("Cannot load necessary plugins for crossfade!");
+        if(tail!=NULL) gst_object_unref(tail);
+        if(decoder!=NULL) gst_object_unref(decoder);
+        if(audioconvert!=NULL) gst_object_unref(audioconvert);
+        if(audioresample!=NULL) gst_object_unref(audioresample);
+        if(capsfilter!=NULL) gst_object_unref(capsfilter);
+        return;
+    }
+    caps = gst_caps_new_empty_simple("audio/x-raw");
+    g_object_set(decoder, "uri", uri, "caps", caps, NULL);
+    gst_caps_unref(caps);
+
+    /* Mix the tail in the format of the mixer. */
+    pad = gst_element_get_static_pad(crossfade->mixer, "src");
+    caps = gst_pad_get_current_caps(pad);
+    gst_object_unref(pad);
+    if(caps==NULL) caps = rclib_core_crossfade_caps_new();
+    g_object_set(capsfilter, "caps", caps, NULL);
+    gst_caps_unref(caps);
+    gst_bin_add_many(GST_BIN(tail), decoder, audioconvert, audioresample,
+        capsfilter, NULL);
+    if(!gst_element_link_many(audioconvert, audioresample, capsfilter,
+        NULL))
+    {
+        g_warning("Cannot link the crossfade tail!");
+        gst_object_unref(tail);
+        return;
+    }
+    g_signal_connect(decoder, "pad-added",
+        G_CALLBACK(rclib_core_crossfade_tail_pad_added_cb), audioconvert);
+    pad = gst_element_get_static_pad(capsfilter, "src");
+    gst_element_add_pad(tail, gst_ghost_pad_new("src", pad));
+    g_mutex_lock(&(crossfade->mutex));
+    crossfade->tail = tail;
+    crossfade->tail_capsfilter = capsfilter;
+    crossfade->tail_seeked = FALSE;
+    crossfade->tail_state = RCLIB_CORE_CROSSFADE_TAIL_SEEKING;
+    crossfade->cut_position = cut_position;
+    crossfade->tail_block_id = gst_pad_add_probe(pad,
+        GST_PAD_PROBE_TYPE_BLOCK | GST_PAD_PROBE_TYPE_BUFFER,
+        rclib_core_crossfade_tail_block_cb, priv, NULL);
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER |
+        GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+        rclib_core_crossfade_tail_probe_cb, priv, NULL);
+    g_mutex_unlock(&(crossfade->mutex));
+    gst_object_unref(pad);
+    gst_element_set_locked_state(tail, TRUE);
+    gst_bin_add(GST_BIN(crossfade->bin), tail);
+    gst_element_set_state(tail, GST_STATE_PAUSED);
+    g_debug("Crossfade tail prepared at %"G_GINT64_FORMAT, cut_position);
+}
+
+static void rclib_core_crossfade_tail_remove(RCLibCorePrivate *priv)
+{
+    RCLibCoreCrossfade *crossfade = &(priv->crossfade);
+    GstElement *tail;
+    GstPad *mixer_pad, *src_pad;
+    g_mutex_lock(&(crossfade->mutex));
+    tail = crossfade->tail;
+    mixer_pad = crossfade->tail_pad;
+    crossfade->tail = NULL;
+    crossfade->tail_capsfilter = NULL;
+    crossfade->tail_pad = NULL;
+    crossfade->tail_block_id = 0;
+    crossfade->tail_state = RCLIB_CORE_CROSSFADE_TAIL_NONE;
+    g_mutex_unlock(&(crossfade->mutex));
+    if(tail==NULL) return;
+    gst_element_set_state(tail, GST_STATE_NULL);
+    if(mixer_pad!=NULL)
+    {
+        src_pad = gst_element_get_static_pad(tail, "src");
+        gst_pad_unlink(src_pad, mixer_pad);
+        gst_object_unref(src_pad);
+        gst_element_release_request_pad(crossfade->mixer, mixer_pad);
+        gst_object_unref(mixer_pad);
+    }
+    gst_bin_remove(GST_BIN(crossfade->bin), tail);
+}
+
+/*
+ * Prepare the tail branch a few seconds before the crossfade point, if
+ * the next music is queued.
+ */
+
+static gboolean rclib_core_crossfade_timer_cb(gpointer data)
+{
+    RCLibCorePrivate *priv = (RCLibCorePrivate *)data;
+    RCLibCoreCrossfade *crossfade = &(priv->crossfade);
+    gint64 duration, position, cut_position;
+    gboolean queued;
+    if(priv->last_state!=GST_STATE_PLAYING) return TRUE;
+    if(crossfade->tail!=NULL || crossfade->tail_done) return TRUE;
+    if(crossfade->duration<=0) return TRUE;
+    if(priv->type!=RCLIB_CORE_SOURCE_NORMAL || priv->uri==NULL)
+        return TRUE;
+    g_mutex_lock(&(priv->next_mutex));
+    queued = (priv->gapless && priv->next_source!=NULL);
+    g_mutex_unlock(&(priv->next_mutex));
+    if(!queued) return TRUE;
+    duration = rclib_core_query_duration();
+    if(duration<=2*crossfade->duration) return TRUE;
+    cut_position = duration - crossfade->duration;
+    position = rclib_core_query_position();
+    if(position<cut_position-RCLIB_CORE_CROSSFADE_PREROLL ||
+        position>=cut_position)
+    {
+        return TRUE;
+    }
+    rclib_core_crossfade_tail_add(priv, priv->uri, cut_position);
+    return TRUE;
+}
+
+/* Reset the crossfade when the pipeline is stopped. */
+
+static void rclib_core_crossfade_reset(RCLibCorePrivate *priv)
+{
+    RCLibCoreCrossfade *crossfade = &(priv->crossfade);
+    GstCaps *caps;
+    if(crossfade->bin==NULL) return;
+    rclib_core_crossfade_tail_remove(priv);
+    g_mutex_lock(&(crossfade->mutex));
+    crossfade->main_state = RCLIB_CORE_CROSSFADE_MAIN_NONE;
+    crossfade->main_valid = FALSE;
+    crossfade->tail_done = FALSE;
+    gst_pad_set_offset(crossfade->main_pad, 0);
+    g_mutex_unlock(&(crossfade->mutex));
+    caps = rclib_core_crossfade_caps_new();
+    g_object_set(crossfade->capsfilter, "caps", caps, NULL);
+    gst_caps_unref(caps);
+}
+
+/* Drop the tail which is not playing when the music changes. */
+
+static void rclib_core_crossfade_stream_changed(RCLibCorePrivate *priv)
+{
+    RCLibCoreCrossfade *crossfade = &(priv->crossfade);
+    gboolean playing;
+    if(crossfade->bin==NULL) return;
+    g_mutex_lock(&(crossfade->mutex));
+    playing = (crossfade->tail_state==RCLIB_CORE_CROSSFADE_TAIL_PLAYING);
+    g_mutex_unlock(&(crossfade->mutex));
+    crossfade->tail_done = FALSE;
+    if(!playing) rclib_core_crossfade_tail_remove(priv);
+}
+
+/*
+ * The mixer makes its own segment, so the position of the music is
+ * calculated from the last buffer passed the main branch.
+ */
+
+static gboolean rclib_core_crossfade_query_position(RCLibCorePrivate *priv,
+    gint64 output_position, gint64 *position)
+{
+    RCLibCoreCrossfade *crossfade = &(priv->crossfade);
+    GstEvent *event;
+    const GstSegment *segment;
+    GstPad *pad;
+    gint64 running_time;
+    gboolean flag = FALSE;
+    pad = gst_element_get_static_pad(crossfade->mixer, "src");
+    event = gst_pad_get_sticky_event(pad, GST_EVENT_SEGMENT, 0);
+    gst_object_unref(pad);
+    if(event==NULL) return FALSE;
+    gst_event_parse_segment(event, &segment);
+    running_time = gst_segment_to_running_time(segment, GST_FORMAT_TIME,
+        output_position);
+    gst_event_unref(event);
+    if(running_time<0) return FALSE;
+    g_mutex_lock(&(crossfade->mutex));
+    if(crossfade->main_valid)
+    {
+        *position = crossfade->main_position -
+            (crossfade->main_running_time - running_time);
+        if(*position<0) *position = 0;
+        flag = TRUE;
+    }
+    g_mutex_unlock(&(crossfade->mutex));
+    return flag;
+}
+
+static gboolean rclib_core_crossfade_bin_insert(RCLibCorePrivate *priv)
+{
+    RCLibCoreCrossfade *crossfade = &(priv->crossfade);
+    GstElement *bin, *audioconvert, *audioresample, *capsfilter, *mixer;
+    GstPad *pad, *ghost_pad;
+    GstCaps *caps;
+    if(crossfade->bin!=NULL) return TRUE;
+    bin = gst_bin_new("rclib-crossfadebin");
+    audioconvert = gst_element_factory_make("audioconvert",
+        "crossfade-audioconvert");
+    audioresample = gst_element_factory_make("audioresample",
+        "crossfade-audioresample");
+    capsfilter = gst_element_factory_make("capsfilter",
+        "crossfade-capsfilter");
+    mixer = gst_element_factory_make("audiomixer", "crossfade-mixer");
+    if(bin==NULL || audioconvert==NULL || audioresample==NULL ||
+        capsfilter==NULL || mixer==NULL)
+    {
+        g_warning("Cannot load necessary plugins for crossfade!");
+        if(bin!=NULL) gst_object_unref(bin);
+        if(audioconvert!=NULL) gst_object_unref(audioconvert);
+        if(audioresample!=NULL) gst_object_unref(audioresample);
+        if(capsfilter!=NULL) gst_object_unref(capsfilter);
+        if(mixer!=NULL) gst_object_unref(mixer);
+        return FALSE;
+    }
+    caps = rclib_core_crossfade_caps_new();
+    g_object_set(capsfilter, "caps", caps, NULL);
+    gst_caps_unref(caps);
+    gst_bin_add_many(GST_BIN(bin), audioconvert, audioresample, capsfilter,
+        mixer, NULL);
+    crossfade->main_pad = gst_element_get_request_pad(mixer, "sink_%u");
+    pad = gst_element_get_static_pad(capsfilter, "src");
+    if(crossfade->main_pad==NULL || !gst_element_link_many(audioconvert,
+        audioresample, capsfilter, NULL) ||
+        gst_pad_link(pad, crossfade->main_pad)!=GST_PAD_LINK_OK)
+    {
+        g_warning("Cannot link the crossfade bin!");
+        gst_object_unref(pad);
+        if(crossfade->main_pad!=NULL)
+        {
+            gst_element_release_request_pad(mixer, crossfade->main_pad);
+            gst_object_unref(crossfade->main_pad);
+            crossfade->main_pad = NULL;
+        }
+        gst_object_unref(bin);
+        return FALSE;
+    }
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER |
+        GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+        rclib_core_crossfade_main_probe_cb, priv, NULL);
+    gst_object_unref(pad);
+    pad = gst_element_get_static_pad(audioconvert, "sink");
+    gst_element_add_pad(bin, gst_ghost_pad_new("sink", pad));
+    gst_object_unref(pad);
+    pad = gst_element_get_static_pad(mixer, "src");
+    gst_element_add_pad(bin, gst_ghost_pad_new("src", pad));
+    gst_object_unref(pad);
+    crossfade->bin = bin;
+    crossfade->capsfilter = capsfilter;
+    crossfade->mixer = mixer;
+
+    /* Insert the crossfade bin before the identity in the audio bin. */
+    gst_bin_add(GST_BIN(priv->audiobin), bin);
+    ghost_pad = gst_element_get_static_pad(priv->audiobin, "sink");
+    pad = gst_element_get_static_pad(bin, "sink");
+    gst_ghost_pad_set_target(GST_GHOST_PAD(ghost_pad), pad);
+    gst_object_unref(pad);
+    gst_object_unref(ghost_pad);
+    gst_element_link(bin, priv->identity);
+    crossfade->timer_id = g_timeout_add(RCLIB_CORE_CROSSFADE_CHECK_INTERVAL,
+        (GSourceFunc)rclib_core_crossfade_timer_cb, priv);
+    return TRUE;
+}
+
+static void rclib_core_crossfade_bin_remove(RCLibCorePrivate *priv)
+{
+    RCLibCoreCrossfade *crossfade = &(priv->crossfade);
+    GstPad *pad, *ghost_pad;
+    if(crossfade->bin==NULL) return;
+    rclib_core_crossfade_tail_remove(priv);
+    if(crossfade->timer_id>0)
+        g_source_remove(crossfade->timer_id);
+    crossfade->timer_id = 0;
+    gst_element_unlink(crossfade->bin, priv->identity);
+    ghost_pad = gst_element_get_static_pad(priv->audiobin, "sink");
+    pad = gst_element_get_static_pad(priv->identity, "sink");
+    gst_ghost_pad_set_target(GST_GHOST_PAD(ghost_pad), pad);
+    gst_object_unref(pad);
+    gst_object_unref(ghost_pad);
+    gst_element_set_state(crossfade->bin, GST_STATE_NULL);
+    gst_element_release_request_pad(crossfade->mixer, crossfade->main_pad);
+    gst_object_unref(crossfade->main_pad);
+    gst_bin_remove(GST_BIN(priv->audiobin), crossfade->bin);
+    crossfade->bin = NULL;
+    crossfade->capsfilter = NULL;
+    crossfade->mixer = NULL;
+    crossfade->main_pad = NULL;
+    crossfade->main_state = RCLIB_CORE_CROSSFADE_MAIN_NONE;
+    crossfade->main_valid = FALSE;
+    crossfade->tail_done = FALSE;
+}
+
+#endif
+
+/* Convert the gain in dB to the linear volume. */
+
+static gdouble rclib_core_replaygain_to_volume(gdouble gain)
+{
+    gain = CLAMP(gain, -60.0, 20.0);
+    return pow(10.0, gain / 20.0);
+}
+
+static void rclib_core_replaygain_apply(RCLibCorePrivate *priv)
+{
+    RCLibCoreReplayGain *replaygain = &(priv->replaygain);
+    gdouble gain = 0.0, peak = 0.0;
+    gdouble volume = 1.0;
+    gboolean flag = TRUE;
+    if(priv->dsp_plugin==NULL) return;
+    if(replaygain->mode==RCLIB_CORE_REPLAYGAIN_MODE_ALBUM &&
+        replaygain->album_flag)
+    {
+        gain = replaygain->album_gain;
+        peak = replaygain->album_peak;
+    }
+    else if(replaygain->mode!=RCLIB_CORE_REPLAYGAIN_MODE_NONE &&
+        replaygain->track_flag)
+    {
+        gain = replaygain->track_gain;
+        peak = replaygain->track_peak;
+    }
+    else
+        flag = FALSE;
+    if(flag)
+    {
+        volume = rclib_core_replaygain_to_volume(gain +
+            replaygain->preamp);
+
+        /* Do not amplify the peak over the full scale. */
+        if(peak>0.0 && volume*peak>1.0)
+            volume = 1.0 / peak;
+        volume = CLAMP(volume, 0.0, 10.0);
+    }
+    g_object_set(priv->dsp_plugin, "gain", volume, NULL);
+}
+
+/*
+ * Load the gain values of the music from the library, the URI is the
+ * one in the library (the CUE track URI for CUE tracks).
+ */
+
+static void rclib_core_replaygain_load(RCLibCorePrivate *priv,
+    const gchar *uri)
+{
+    RCLibCoreReplayGain *replaygain = &(priv->replaygain);
+    guint flags = 0;
+    replaygain->track_gain = 0.0;
+    replaygain->track_peak = 0.0;
+    replaygain->album_gain = 0.0;
+    replaygain->album_peak = 0.0;
+    if(uri!=NULL && rclib_db_library_has_uri(uri))
+    {
+        rclib_db_library_data_uri_get(uri,
+            RCLIB_DB_LIBRARY_DATA_TYPE_TRACK_GAIN, &(replaygain->track_gain),
+            RCLIB_DB_LIBRARY_DATA_TYPE_TRACK_PEAK, &(replaygain->track_peak),
+            RCLIB_DB_LIBRARY_DATA_TYPE_ALBUM_GAIN, &(replaygain->album_gain),
+            RCLIB_DB_LIBRARY_DATA_TYPE_ALBUM_PEAK, &(replaygain->album_peak),
+            RCLIB_DB_LIBRARY_DATA_TYPE_GAIN_FLAGS, &flags,
+            RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
+    }
+    replaygain->track_flag = (flags & RCLIB_DB_GAIN_FLAG_TRACK)!=0;
+    replaygain->album_flag = (flags & RCLIB_DB_GAIN_FLAG_ALBUM)!=0;
+    rclib_core_replaygain_apply(priv);
+}
+
+/*
+ * Take the gain values which are not found in the library from the
+ * stream tags.
+ */
+
+static void rclib_core_replaygain_update_tags(RCLibCorePrivate *priv,
+    const GstTagList *tags)
+{
+    RCLibCoreReplayGain *replaygain = &(priv->replaygain);
+    gdouble value;
+    gboolean changed = FALSE;
+    if(!replaygain->track_flag && gst_tag_list_get_double(tags,
+        GST_TAG_TRACK_GAIN, &value))
+    {
+        replaygain->track_gain = value;
+        replaygain->track_peak = 0.0;
+        gst_tag_list_get_double(tags, GST_TAG_TRACK_PEAK,
+            &(replaygain->track_peak));
+        replaygain->track_flag = TRUE;
+        changed = TRUE;
+    }
+    if(!replaygain->album_flag && gst_tag_list_get_double(tags,
+        GST_TAG_ALBUM_GAIN, &value))
+    {
+        replaygain->album_gain = value;
+        replaygain->album_peak = 0.0;
+        gst_tag_list_get_double(tags, GST_TAG_ALBUM_PEAK,
+            &(replaygain->album_peak));
+        replaygain->album_flag = TRUE;
+        changed = TRUE;
+    }
+    if(changed) rclib_core_replaygain_apply(priv);
+}
+
+static gboolean rclib_core_audio_tags_changed_idle_cb(gpointer data)
+{
+    /* WARNING: This function is not called in main thread! */
+    RCLibCorePrivate *priv = (RCLibCorePrivate *)data;
+    GstTagList *tags;
+    GstTagList *merged_tags = NULL;
+    gboolean flag = FALSE;
+    gboolean pending;
+    if(data==NULL) return FALSE;
+    if(priv->tag_update_queue==NULL) return FALSE;
+    g_mutex_lock(&(priv->next_mutex));
+    pending = (priv->pending_source!=NULL);
+    g_mutex_unlock(&(priv->next_mutex));
+    g_async_queue_lock(priv->tag_update_queue);
+    if(pending)
+    {
+        /* The tags are read again when the new stream starts. */
+        priv->tag_update_id = 0;
+        g_async_queue_unlock(priv->tag_update_queue);
+        return FALSE;
+    }
+    while((tags=g_async_queue_try_pop_unlocked(priv->tag_update_queue))!=
+        NULL)
+    {
+        if(merged_tags==NULL)
+            merged_tags = gst_tag_list_copy(tags);
+        else
+            gst_tag_list_insert(merged_tags, tags, GST_TAG_MERGE_REPLACE);
+        #if GST_VERSION_MAJOR==1
+            gst_tag_list_unref(tags);
+        #else
+            gst_tag_list_free(tags);
+        #endif
+    }
+    priv->tag_update_id = 0;
+    g_async_queue_unlock(priv->tag_update_queue);
+    if(merged_tags==NULL) return FALSE;
+    rclib_core_replaygain_update_tags(priv, merged_tags);
+    flag = rclib_core_parse_metadata(merged_tags, &(priv->metadata),
+        priv->start_time, priv->end_time);
+    #if GST_VERSION_MAJOR==1
+        gst_tag_list_unref(merged_tags);
+    #else
+        gst_tag_list_free(merged_tags);
+    #endif
+    if(!flag) return FALSE;
+    g_signal_emit(core_instance, core_signals[SIGNAL_TAG_FOUND], 0,
+        &(priv->metadata), priv->uri);
+    priv->tag_signal_emitted = TRUE;
+    return FALSE;
+}
+
+static void rclib_core_tag_update_queue_push(RCLibCorePrivate *priv,
+    GstTagList *tags)
+{
+    g_async_queue_lock(priv->tag_update_queue);
+    g_async_queue_push_unlocked(priv->tag_update_queue, tags);
+    if(priv->tag_update_id==0)
+    {
+        priv->tag_update_id = g_idle_add((GSourceFunc)
+            rclib_core_audio_tags_changed_idle_cb, priv);
+    }
+    g_async_queue_unlock(priv->tag_update_queue);
+}
+
+/*
+ * Switch to the source handed to the pipeline when the new stream starts,
+ * so the play source, the metadata and the URI change at the boundary.
+ */
+
+static void rclib_core_pending_source_switch(RCLibCore *core)
+{
+    RCLibCorePrivate *priv = core->priv;
+    RCLibCoreNextSource *source;
+    GstTagList *tags = NULL;
+    gint stream_id = 0;
+    gint64 duration;
+    g_mutex_lock(&(priv->next_mutex));
+    source = priv->pending_source;
+    priv->pending_source = NULL;
+    g_mutex_unlock(&(priv->next_mutex));
+    if(source==NULL) return;
+    #if GST_VERSION_MAJOR==1
+        rclib_core_crossfade_stream_changed(priv);
+    #endif
+    rclib_core_play_source_clear(priv);
+    rclib_core_metadata_free(&(priv->metadata));
+    rclib_core_tag_update_queue_flush(priv);
+    priv->tag_signal_emitted = FALSE;
+    priv->start_time = 0;
+    priv->end_time = 0;
+    priv->type = RCLIB_CORE_SOURCE_NORMAL;
+    priv->uri = source->uri;
+    source->uri = NULL;
+    if(source->source_type==RCLIB_CORE_PLAY_SOURCE_PLAYLIST &&
+        source->source_reference!=NULL && !rclib_db_playlist_is_valid_iter(
+        (RCLibDbPlaylistIter *)source->source_reference))
+    {
+        source->source_reference = NULL;
+    }
+    priv->source_type = source->source_type;
+    if(priv->source_type!=RCLIB_CORE_PLAY_SOURCE_NONE)
+    {
+        priv->source_reference = source->source_reference;
+        priv->source_destroy_notify = source->source_destroy_notify;
+        source->source_reference = NULL;
+    }
+    if(priv->source_type==RCLIB_CORE_PLAY_SOURCE_THIRDPARTY)
+    {
+        priv->ext_cookie = source->cookie;
+        source->cookie = NULL;
+    }
+    rclib_core_next_source_free(source);
+    rclib_core_replaygain_load(priv, priv->uri);
+    g_signal_emit(core, core_signals[SIGNAL_URI_CHANGED], 0, priv->uri);
+    duration = rclib_core_query_duration();
+    if(duration>0)
+    {
+        g_signal_emit(core, core_signals[SIGNAL_NEW_DURATION], 0,
+            duration);
+    }
+
+    /* The tags of the new stream may come before the boundary. */
+    g_object_get(priv->playbin, "current-audio", &stream_id, NULL);
+    g_signal_emit_by_name(priv->playbin, "get-audio-tags", stream_id, &tags);
+    if(tags!=NULL)
+        rclib_core_tag_update_queue_push(priv, tags);
+}
+
+static void rclib_core_bus_callback(GstBus *bus, GstMessage *msg,
+    gpointer data)
+{
+    RCLibCorePrivate *priv = NULL;
+    GObject *object = G_OBJECT(data);    
     if(object==NULL) return;
     priv = RCLIB_CORE(object)->priv;
     switch(GST_MESSAGE_TYPE(msg))
     {
         case GST_MESSAGE_EOS:
         {
+            g_mutex_lock(&(priv->next_mutex));
+            rclib_core_next_source_free(priv->pending_source);
+            priv->pending_source = NULL;
+            g_mutex_unlock(&(priv->next_mutex));
+            #if GST_VERSION_MAJOR==1
+                rclib_core_crossfade_reset(priv);
+            #endif
             gst_element_set_state(priv->playbin, GST_STATE_NULL); 
             gst_element_set_state(priv->playbin, GST_STATE_READY);
             g_signal_emit(object, core_signals[SIGNAL_EOS], 0);
@@ -718,6 +2319,13 @@ static void rclib_core_bus_callback(GstBus *bus, GstMessage *msg,
         {
             break;
         }
+        #if GST_VERSION_MAJOR==1
+        case GST_MESSAGE_STREAM_START:
+        {
+            rclib_core_pending_source_switch(RCLIB_CORE(object));
+            break;
+        }
+        #endif
         case GST_MESSAGE_ASYNC_DONE:
         {
             gint64 duration;
@@ -793,6 +2401,18 @@ static void rclib_core_bus_callback(GstBus *bus, GstMessage *msg,
         }
         case GST_MESSAGE_ELEMENT:
         {
+            #if GST_VERSION_MAJOR==1
+                if(gst_message_has_name(msg,
+                    "rclib-crossfade-stream-start"))
+                {
+                    rclib_core_pending_source_switch(RCLIB_CORE(object));
+                }
+                else if(gst_message_has_name(msg,
+                    "rclib-crossfade-tail-eos"))
+                {
+                    rclib_core_crossfade_tail_remove(priv);
+                }
+            #endif
             break;
         }
         case GST_MESSAGE_ERROR:
@@ -825,48 +2445,211 @@ static void rclib_core_bus_callback(GstBus *bus, GstMessage *msg,
     return;
 }
 
-static void rclib_core_identity_buffer_cb(GstElement *identity,
-    GstBuffer *buf, gpointer data)
+static void rclib_core_pcm_ring_convert(const RCLibCorePcmRing *ring,
+    gfloat *dst, const guint8 *src, gsize frames)
+{
+    /* WARNING: This function is not called in main thread! */
+    gint channels = ring->channels;
+    gint frame_size = ring->frame_size;
+    gfloat scale = ring->scale;
+    gint32 value;
+    gsize i;
+    gint j;
+    for(i=0;i<frames;i++)
+    {
+        switch(ring->format)
+        {
+            case RCLIB_CORE_PCM_FORMAT_U8:
+                for(j=0;j<channels;j++)
+                    dst[j] = ((gint)src[j] - 128) * scale;
+                break;
+            case RCLIB_CORE_PCM_FORMAT_S16:
+                for(j=0;j<channels;j++)
+                    dst[j] = ((const gint16 *)src)[j] * scale;
+                break;
+            case RCLIB_CORE_PCM_FORMAT_S24:
+                for(j=0;j<channels;j++)
+                {
+                    #if G_BYTE_ORDER==G_BIG_ENDIAN
+                        value = GST_READ_UINT24_BE(src + j * 3);
+                    #else
+                        value = GST_READ_UINT24_LE(src + j * 3);
+                    #endif
+                    if(value & 0x00800000)
+                        value |= 0xFF000000;
+                    dst[j] = value * scale;
+                }
+                break;
+            case RCLIB_CORE_PCM_FORMAT_S32:
+                for(j=0;j<channels;j++)
+                    dst[j] = ((const gint32 *)src)[j] * scale;
+                break;
+            case RCLIB_CORE_PCM_FORMAT_F32:
+                for(j=0;j<channels;j++)
+                    dst[j] = ((const gfloat *)src)[j];
+                break;
+            case RCLIB_CORE_PCM_FORMAT_F64:
+                for(j=0;j<channels;j++)
+                    dst[j] = ((const gdouble *)src)[j];
+                break;
+            default:
+                return;
+        }
+        dst += channels;
+        src += frame_size;
+    }
+}
+
+static void rclib_core_pcm_ring_write(RCLibCorePcmRing *ring,
+    const guint8 *src, gsize size)
+{
+    /* WARNING: This function is not called in main thread! */
+    gsize frames, block, offset;
+    gsize pos;
+    if(ring->data==NULL || ring->format==RCLIB_CORE_PCM_FORMAT_NONE)
+        return;
+    frames = size / ring->frame_size;
+    pos = ring->write_pos;
+    while(frames>0)
+    {
+        offset = pos & (RCLIB_CORE_PCM_RING_FRAMES - 1);
+        block = MIN(frames, RCLIB_CORE_PCM_RING_GUARD);
+        block = MIN(block, RCLIB_CORE_PCM_RING_FRAMES - offset);
+        rclib_core_pcm_ring_convert(ring, ring->data + offset *
+            ring->channels, src, block);
+        src += block * ring->frame_size;
+        frames -= block;
+        pos += block;
+        g_atomic_pointer_set(&(ring->write_pos), pos);
+    }
+}
+
+/* Parse the caps only when they are changed. */
+static void rclib_core_identity_set_caps(RCLibCorePrivate *priv,
+    GstCaps *caps)
 {
     /* WARNING: This function is not called in main thread! */
+    RCLibCorePcmRing *ring = &(priv->pcm_ring);
+    RCLibCorePcmFormat format = RCLIB_CORE_PCM_FORMAT_NONE;
     GstAudioInfo audio_info;
+    gboolean is_float = FALSE;
+    gboolean is_signed = FALSE;
+    gboolean native = FALSE;
     gint rate = 0;
     gint channels = 0;
     gint width = 0;
     gint depth = 0;
-    GstPad *pad;
-    GstCaps *caps;
-    RCLibCorePrivate *priv = NULL;
-    GObject *object = G_OBJECT(data);
-    if(object==NULL) return;
-    priv = RCLIB_CORE(object)->priv;
-    if(priv==NULL) return;
-    pad = gst_element_get_static_pad(identity, "src");
-    if(pad==NULL) return;
-    #if GST_VERSION_MAJOR==1
-        caps = gst_pad_get_current_caps(pad);
-    #else
-        caps = gst_pad_get_negotiated_caps(pad);
+    #if GST_VERSION_MAJOR!=1
+        GstStructure *structure;
+        gint endianness = G_BYTE_ORDER;
     #endif
-    gst_object_unref(pad);
-    if(caps==NULL) return;
-    g_signal_emit(object, core_signals[SIGNAL_BUFFER_PROBE], 0, buf, caps);
+    gst_caps_replace(&(ring->caps), caps);
     gst_audio_info_init(&audio_info);
-    if(gst_audio_info_from_caps(&audio_info, caps))
+    if(caps!=NULL && gst_audio_info_from_caps(&audio_info, caps))
     {
         rate = GST_AUDIO_INFO_RATE(&audio_info);
         channels = GST_AUDIO_INFO_CHANNELS(&audio_info);
         width = GST_AUDIO_INFO_WIDTH(&audio_info);
         depth = GST_AUDIO_INFO_DEPTH(&audio_info);
+        #if GST_VERSION_MAJOR==1
+            is_float = GST_AUDIO_INFO_IS_FLOAT(&audio_info);
+            is_signed = GST_AUDIO_INFO_IS_SIGNED(&audio_info);
+            native = (GST_AUDIO_INFO_LAYOUT(&audio_info)==
+                GST_AUDIO_LAYOUT_INTERLEAVED) && (width==8 ||
+                GST_AUDIO_INFO_ENDIANNESS(&audio_info)==G_BYTE_ORDER);
+        #else
+            structure = gst_caps_get_structure(caps, 0);
+            is_float = gst_structure_has_name(structure,
+                "audio/x-raw-float");
+            if(!gst_structure_get_boolean(structure, "signed", &is_signed))
+                is_signed = is_float;
+            gst_structure_get_int(structure, "endianness", &endianness);
+            native = (width==8 || endianness==G_BYTE_ORDER);
+        #endif
     }
-    gst_caps_unref(caps);
     if(depth==0) depth = width;
+    if(native && is_float)
+    {
+        if(width==32) format = RCLIB_CORE_PCM_FORMAT_F32;
+        else if(width==64) format = RCLIB_CORE_PCM_FORMAT_F64;
+    }
+    else if(native && is_signed)
+    {
+        if(width==16) format = RCLIB_CORE_PCM_FORMAT_S16;
+        else if(width==24) format = RCLIB_CORE_PCM_FORMAT_S24;
+        else if(width==32) format = RCLIB_CORE_PCM_FORMAT_S32;
+    }
+    else if(native && width==8)
+        format = RCLIB_CORE_PCM_FORMAT_U8;
+    if(rate==0 || channels==0) format = RCLIB_CORE_PCM_FORMAT_NONE;
+    g_atomic_int_inc(&(ring->format_seq));
+    ring->format = format;
+    ring->rate = rate;
+    ring->stream_channels = channels;
+    ring->channels = 0;
+    if(format!=RCLIB_CORE_PCM_FORMAT_NONE)
+        ring->channels = MIN(channels, RCLIB_CORE_PCM_CHANNELS_MAX);
+    ring->frame_size = channels * width / 8;
+    ring->scale = 1.0;
+    if(!is_float && depth>1)
+        ring->scale = 1.0 / (gfloat)(1U << (depth - 1));
+    ring->format_pos = ring->write_pos;
+    g_atomic_int_inc(&(ring->format_seq));
     if(rate==0 || width==0 || channels==0) return;
     priv->sample_rate = rate;
     priv->channels = channels;
     priv->depth = depth;
 }
 
+#if GST_VERSION_MAJOR==1
+static GstPadProbeReturn rclib_core_identity_event_probe_cb(GstPad *pad,
+    GstPadProbeInfo *info, gpointer data)
+{
+    /* WARNING: This function is not called in main thread! */
+    RCLibCorePrivate *priv = (RCLibCorePrivate *)data;
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+    GstCaps *caps = NULL;
+    if(event==NULL || GST_EVENT_TYPE(event)!=GST_EVENT_CAPS)
+        return GST_PAD_PROBE_OK;
+    gst_event_parse_caps(event, &caps);
+    rclib_core_identity_set_caps(priv, caps);
+    return GST_PAD_PROBE_OK;
+}
+#endif
+
+static void rclib_core_identity_buffer_cb(GstElement *identity,
+    GstBuffer *buf, gpointer data)
+{
+    /* WARNING: This function is not called in main thread! */
+    RCLibCorePrivate *priv = NULL;
+    RCLibCorePcmRing *ring;
+    GObject *object = G_OBJECT(data);
+    if(object==NULL) return;
+    priv = RCLIB_CORE(object)->priv;
+    if(priv==NULL) return;
+    ring = &(priv->pcm_ring);
+    #if GST_VERSION_MAJOR==1
+        GstMapInfo map_info;
+        if(gst_buffer_map(buf, &map_info, GST_MAP_READ))
+        {
+            rclib_core_pcm_ring_write(ring, map_info.data, map_info.size);
+            gst_buffer_unmap(buf, &map_info);
+        }
+    #else
+        if(GST_BUFFER_CAPS(buf)!=NULL && GST_BUFFER_CAPS(buf)!=ring->caps)
+            rclib_core_identity_set_caps(priv, GST_BUFFER_CAPS(buf));
+        rclib_core_pcm_ring_write(ring, GST_BUFFER_DATA(buf),
+            GST_BUFFER_SIZE(buf));
+    #endif
+    if(ring->caps==NULL) return;
+    if(g_signal_has_handler_pending(object,
+        core_signals[SIGNAL_BUFFER_PROBE], 0, FALSE))
+    {
+        g_signal_emit(object, core_signals[SIGNAL_BUFFER_PROBE], 0, buf,
+            ring->caps);
+    }
+}
+
 static gboolean rclib_core_volume_changed_idle(GObject *object)
 {
     gdouble volume;
@@ -892,46 +2675,6 @@ static void rclib_core_source_notify_cb(GObject *object, GParamSpec *spec,
 
 }
 
-static gboolean rclib_core_audio_tags_changed_idle_cb(gpointer data)
-{
-    /* WARNING: This function is not called in main thread! */
-    RCLibCorePrivate *priv = (RCLibCorePrivate *)data;
-    GstTagList *tags;
-    GstTagList *merged_tags = NULL;
-    gboolean flag = FALSE;
-    if(data==NULL) return FALSE;
-    if(priv->tag_update_queue==NULL) return FALSE;
-    g_async_queue_lock(priv->tag_update_queue);
-    while((tags=g_async_queue_try_pop_unlocked(priv->tag_update_queue))!=
-        NULL)
-    {
-        if(merged_tags==NULL)
-            merged_tags = gst_tag_list_copy(tags);
-        else
-            gst_tag_list_insert(merged_tags, tags, GST_TAG_MERGE_REPLACE);
-        #if GST_VERSION_MAJOR==1
-            gst_tag_list_unref(tags);
-        #else
-            gst_tag_list_free(tags);
-        #endif
-    }
-    priv->tag_update_id = 0;
-    g_async_queue_unlock(priv->tag_update_queue);
-    if(merged_tags==NULL) return FALSE;
-    flag = rclib_core_parse_metadata(merged_tags, &(priv->metadata),
-        priv->start_time, priv->end_time);
-    #if GST_VERSION_MAJOR==1
-        gst_tag_list_unref(merged_tags);
-    #else
-        gst_tag_list_free(merged_tags);
-    #endif
-    if(!flag) return FALSE;
-    g_signal_emit(core_instance, core_signals[SIGNAL_TAG_FOUND], 0,
-        &(priv->metadata), priv->uri);
-    priv->tag_signal_emitted = TRUE;
-    return FALSE;
-}
-
 static void rclib_core_audio_tags_changed_cb(GstElement *playbin2,
     gint stream_id, gpointer data)
 {
@@ -948,16 +2691,7 @@ static void rclib_core_audio_tags_changed_cb(GstElement *playbin2,
     if(current_stream_id!=stream_id) return;
     g_signal_emit_by_name(playbin2, "get-audio-tags", stream_id, &tags);
     if(tags!=NULL)
-    {
-        g_async_queue_lock(priv->tag_update_queue);
-        g_async_queue_push_unlocked(priv->tag_update_queue, tags);
-        if(priv->tag_update_id==0)
-        {
-            priv->tag_update_id = g_idle_add((GSourceFunc)
-                rclib_core_audio_tags_changed_idle_cb, priv);
-        }
-        g_async_queue_unlock(priv->tag_update_queue);
-    }
+        rclib_core_tag_update_queue_push(priv, tags);
     g_signal_emit_by_name(playbin2, "get-audio-pad", stream_id, &pad);
     if(pad!=NULL)
     {
@@ -980,6 +2714,23 @@ static void rclib_core_audio_tags_changed_cb(GstElement *playbin2,
     }
 }
 
+static void rclib_core_about_to_finish_cb(GstElement *playbin2,
+    gpointer data)
+{
+    /* WARNING: This signal callback is not called on main thread! */
+    RCLibCorePrivate *priv = (RCLibCorePrivate *)data;
+    if(data==NULL) return;
+    g_mutex_lock(&(priv->next_mutex));
+    if(priv->gapless && priv->next_source!=NULL &&
+        priv->pending_source==NULL)
+    {
+        priv->pending_source = priv->next_source;
+        priv->next_source = NULL;
+        g_object_set(playbin2, "uri", priv->pending_source->uri, NULL);
+    }
+    g_mutex_unlock(&(priv->next_mutex));
+}
+
 static void rclib_core_instance_init(RCLibCore *core)
 {
     GstElement *playbin = NULL;
@@ -999,6 +2750,8 @@ static void rclib_core_instance_init(RCLibCore *core)
     priv = G_TYPE_INSTANCE_GET_PRIVATE(core, RCLIB_TYPE_CORE,
         RCLibCorePrivate);
     core->priv = priv;
+    g_mutex_init(&(priv->next_mutex));
+    g_mutex_init(&(priv->crossfade.mutex));
     GstPlayFlags flags;
     G_STMT_START
     {
@@ -1104,7 +2857,7 @@ static void rclib_core_instance_init(RCLibCore *core)
             break;
         }
         pad = gst_element_get_static_pad(identity, "sink");
-        gst_element_add_pad(audiobin, gst_ghost_pad_new(NULL, pad));
+        gst_element_add_pad(audiobin, gst_ghost_pad_new("sink", pad));
         gst_object_unref(pad);
         flag = TRUE;
     }
@@ -1143,25 +2896,32 @@ static void rclib_core_instance_init(RCLibCore *core)
     memset(&(priv->metadata), 0, sizeof(RCLibCoreMetadata));
     priv->playbin = playbin;
     priv->audiobin = audiobin;
+    priv->identity = identity;
     priv->effectbin = effectbin;
     priv->audiosink = audiosink;
     priv->videosink = videosink;
     priv->output_sink_type = RCLIB_CORE_AUDIO_OUTPUT_AUTO;
-    priv->eq_plugin = gst_element_factory_make("equalizer-10bands",
-        "effect-equalizer");
-    priv->bal_plugin = gst_element_factory_make("audiopanorama",
-        "effect-balance");
-    if(priv->eq_plugin!=NULL)
-        rclib_core_effect_add_element_internal(effectbin, priv->eq_plugin,
-            FALSE);
-    if(priv->bal_plugin!=NULL)
-    {
-        g_object_set(priv->bal_plugin, "method", 1, NULL);
-        rclib_core_effect_add_element_internal(effectbin, priv->bal_plugin,
-            FALSE);
+    priv->dsp_plugin = rclib_dsp_new();
+    gst_object_set_name(GST_OBJECT(priv->dsp_plugin), "effect-dsp");
+    if(rclib_core_effect_add_element_internal(effectbin, priv->dsp_plugin,
+        FALSE))
+    {
+        rclib_dsp_stage_add(RCLIB_DSP(priv->dsp_plugin),
+            RCLIB_DSP_STAGE_GAIN);
+        rclib_dsp_stage_add(RCLIB_DSP(priv->dsp_plugin),
+            RCLIB_DSP_STAGE_EQUALIZER);
+        rclib_dsp_stage_add(RCLIB_DSP(priv->dsp_plugin),
+            RCLIB_DSP_STAGE_BALANCE);
     }
+    else
+        priv->dsp_plugin = NULL;
     priv->extra_plugin_list = NULL;
+    memset(&(priv->replaygain), 0, sizeof(RCLibCoreReplayGain));
+    priv->replaygain.mode = RCLIB_CORE_REPLAYGAIN_MODE_TRACK;
     priv->tag_update_id = 0;
+    priv->gapless = FALSE;
+    priv->next_source = NULL;
+    priv->pending_source = NULL;
     #if GST_VERSION_MAJOR==1
         priv->tag_update_queue = g_async_queue_new_full((GDestroyNotify)
             gst_tag_list_unref);
@@ -1176,8 +2936,16 @@ static void rclib_core_instance_init(RCLibCore *core)
     priv->bus = bus;
     pad = gst_element_get_static_pad(audioconvert, "sink");
     priv->query_pad = pad;
+    priv->pcm_ring.data = g_new0(gfloat, RCLIB_CORE_PCM_RING_FRAMES *
+        RCLIB_CORE_PCM_CHANNELS_MAX);
     priv->identity_id = g_signal_connect(identity, "handoff",
         G_CALLBACK(rclib_core_identity_buffer_cb), core);
+    #if GST_VERSION_MAJOR==1
+        pad = gst_element_get_static_pad(identity, "src");
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+            rclib_core_identity_event_probe_cb, priv, NULL);
+        gst_object_unref(pad);
+    #endif
     priv->volume_id = g_signal_connect(priv->playbin, "notify::volume",
         G_CALLBACK(rclib_core_volume_notify_cb), priv);
     priv->source_id = g_signal_connect(priv->playbin, "notify::source",
@@ -1185,6 +2953,11 @@ static void rclib_core_instance_init(RCLibCore *core)
     priv->audio_tag_changed_id = g_signal_connect(priv->playbin,
         "audio-tags-changed", G_CALLBACK(rclib_core_audio_tags_changed_cb),
         priv);
+    #if GST_VERSION_MAJOR==1
+        priv->about_to_finish_id = g_signal_connect(priv->playbin,
+            "about-to-finish", G_CALLBACK(rclib_core_about_to_finish_cb),
+            priv);
+    #endif
     gst_element_set_state(playbin, GST_STATE_NULL);
     gst_element_set_state(playbin, GST_STATE_READY);
 }
@@ -1347,25 +3120,13 @@ void rclib_core_set_uri_with_play_source(const gchar *uri,
     if(core_instance==NULL || uri==NULL) return;
     priv = RCLIB_CORE(core_instance)->priv;
     rclib_core_stop();
-    if(priv->uri!=NULL)
-    {
-        g_free(priv->uri);
-        priv->uri = NULL;
-    }
-    if(priv->source_reference!=NULL)
-    {
-        if(priv->source_destroy_notify!=NULL)
-        {
-            priv->source_destroy_notify(priv->source_reference);
-        }
-        priv->source_reference = NULL;
-    }
-    priv->source_destroy_notify = NULL;
-    if(priv->ext_cookie!=NULL)
-    {
-        g_free(priv->ext_cookie);
-        priv->ext_cookie = NULL;
-    }
+    rclib_core_play_source_clear(priv);
+
+    /* The queued next URI follows the old one, the player queues again. */
+    g_mutex_lock(&(priv->next_mutex));
+    rclib_core_next_source_free(priv->next_source);
+    priv->next_source = NULL;
+    g_mutex_unlock(&(priv->next_mutex));
     scheme = g_uri_parse_scheme(uri);
     /* We can only read CUE file on local machine. */
     if(g_strcmp0(scheme, "file")==0)
@@ -1443,6 +3204,7 @@ void rclib_core_set_uri_with_play_source(const gchar *uri,
     {
         priv->ext_cookie = g_strdup(cookie);
     }
+    rclib_core_replaygain_load(priv, uri);
     gst_element_set_state(priv->playbin, GST_STATE_PAUSED);
     g_signal_emit(core_instance, core_signals[SIGNAL_URI_CHANGED], 0,
         priv->uri);
@@ -1489,6 +3251,60 @@ gboolean rclib_core_update_play_source(RCLibCorePlaySource source_type,
     return TRUE;
 }
 
+/**
+ * rclib_core_set_next_uri_with_play_source:
+ * @uri: (allow-none): the URI to play after the current one
+ * @source_type: the source type
+ * @source_reference: (allow-none): the source reference
+ * @notify: (allow-none): the reference destroy notify
+ * @cookie: (allow-none): the cookie for third-party play item
+ *
+ * Queue the URI and the music source reference to play after the current
+ * one in gapless mode, the former queued one is dropped. The queued URI is
+ * also dropped when the URI is set by rclib_core_set_uri_with_play_source().
+ * If @uri is NULL, the queued URI is dropped only. CUE tracks cannot be
+ * queued. If the URI is not queued, the source reference is not taken.
+ *
+ * Returns: Whether the URI is queued.
+ */
+
+gboolean rclib_core_set_next_uri_with_play_source(const gchar *uri,
+    RCLibCorePlaySource source_type, gpointer source_reference,
+    GDestroyNotify notify, const gchar *cookie)
+{
+    RCLibCorePrivate *priv;
+    RCLibCoreNextSource *source = NULL;
+    gchar *scheme;
+    gboolean cue_flag = FALSE;
+    if(core_instance==NULL) return FALSE;
+    priv = RCLIB_CORE(core_instance)->priv;
+    if(priv==NULL) return FALSE;
+    if(uri!=NULL)
+    {
+        if(!priv->gapless) return FALSE;
+        scheme = g_uri_parse_scheme(uri);
+        if(g_strcmp0(scheme, "file")==0)
+            cue_flag = rclib_cue_get_track_num(uri, NULL, NULL);
+        g_free(scheme);
+        if(cue_flag) return FALSE;
+        source = g_new0(RCLibCoreNextSource, 1);
+        source->uri = g_strdup(uri);
+        source->source_type = source_type;
+        if(source_type!=RCLIB_CORE_PLAY_SOURCE_NONE)
+        {
+            source->source_reference = source_reference;
+            source->source_destroy_notify = notify;
+        }
+        if(source_type==RCLIB_CORE_PLAY_SOURCE_THIRDPARTY)
+            source->cookie = g_strdup(cookie);
+    }
+    g_mutex_lock(&(priv->next_mutex));
+    rclib_core_next_source_free(priv->next_source);
+    priv->next_source = source;
+    g_mutex_unlock(&(priv->next_mutex));
+    return (source!=NULL || uri==NULL);
+}
+
 /**
  * rclib_core_get_uri:
  *
@@ -1587,6 +3403,13 @@ gboolean rclib_core_set_position(gint64 pos)
     RCLibCorePrivate *priv;
     if(core_instance==NULL) return FALSE;
     priv = RCLIB_CORE(core_instance)->priv;
+    #if GST_VERSION_MAJOR==1
+        if(priv->crossfade.bin!=NULL)
+        {
+            rclib_core_crossfade_tail_remove(priv);
+            priv->crossfade.tail_done = FALSE;
+        }
+    #endif
     if(priv->start_time>0)
     {
         return gst_element_seek_simple(priv->playbin, GST_FORMAT_TIME, 
@@ -1621,6 +3444,8 @@ gint64 rclib_core_query_position()
             if(position<0) position = 0;
         }
         else return 0;
+        if(priv->crossfade.bin!=NULL)
+            rclib_core_crossfade_query_position(priv, position, &position);
     #else
         if(gst_element_query_position(priv->playbin, &format, &position))
         {
@@ -1648,6 +3473,9 @@ gint64 rclib_core_query_position()
 gint64 rclib_core_query_duration()
 {
     RCLibCorePrivate *priv;
+    #if GST_VERSION_MAJOR==1
+        GstPad *pad;
+    #endif
     gint64 duration = 0;
     GstFormat format = GST_FORMAT_TIME;
     if(core_instance==NULL) return 0;
@@ -1658,7 +3486,18 @@ gint64 rclib_core_query_duration()
         return duration;
     }
     #if GST_VERSION_MAJOR==1
-        if(gst_element_query_duration(priv->playbin, format, &duration))
+        if(priv->crossfade.bin!=NULL)
+        {
+            /* The mixer does not answer the duration of the music. */
+            pad = gst_element_get_static_pad(priv->crossfade.bin, "sink");
+            if(gst_pad_peer_query_duration(pad, format, &duration))
+            {
+                if(duration<0) duration = 0;
+            }
+            gst_object_unref(pad);
+        }
+        else if(gst_element_query_duration(priv->playbin, format,
+            &duration))
         {
             if(duration<0) duration = 0;
         }
@@ -1808,10 +3647,12 @@ gboolean rclib_core_stop()
     RCLibCorePrivate *priv;
     GstBus *bus;
     GstMessage *msg;
-    GstTagList *tags;
     if(core_instance==NULL) return FALSE;
     priv = RCLIB_CORE(core_instance)->priv;
     bus = gst_element_get_bus(priv->playbin);
+    #if GST_VERSION_MAJOR==1
+        rclib_core_crossfade_reset(priv);
+    #endif
     gst_element_set_state(priv->playbin, GST_STATE_READY);
     rclib_core_metadata_free(&(priv->metadata));
     priv->duration = 0;
@@ -1819,17 +3660,7 @@ gboolean rclib_core_stop()
     priv->channels = 0;
     priv->depth = 0;
     priv->tag_signal_emitted = FALSE;
-    g_async_queue_lock(priv->tag_update_queue);
-    while((tags=g_async_queue_try_pop_unlocked(priv->tag_update_queue))!=
-        NULL)
-    {
-        #if GST_VERSION_MAJOR==1
-            gst_tag_list_unref(tags);
-        #else
-            gst_tag_list_free(tags);
-        #endif
-    }
-    g_async_queue_unlock(priv->tag_update_queue);
+    rclib_core_tag_update_queue_flush(priv);
     while((msg=gst_bus_pop_filtered(bus, GST_MESSAGE_STATE_CHANGED))!=NULL)
     {
         gst_bus_async_signal_func(bus, msg, NULL);
@@ -1838,6 +3669,10 @@ gboolean rclib_core_stop()
     gst_bus_set_flushing(bus, TRUE);
     gst_object_unref(bus);
     gst_element_set_state(priv->playbin, GST_STATE_NULL);
+    g_mutex_lock(&(priv->next_mutex));
+    rclib_core_next_source_free(priv->pending_source);
+    priv->pending_source = NULL;
+    g_mutex_unlock(&(priv->next_mutex));
     rclib_core_set_position(0);
     return TRUE;
 }
@@ -1897,7 +3732,7 @@ gboolean rclib_core_set_eq(RCLibCoreEQType type, gdouble *band)
     gchar band_name[16];
     if(core_instance==NULL) return FALSE;
     priv = RCLIB_CORE(core_instance)->priv;
-    if(priv->eq_plugin==NULL) return FALSE;
+    if(priv->dsp_plugin==NULL) return FALSE;
     if(type>=RCLIB_CORE_EQ_TYPE_NONE && type<RCLIB_CORE_EQ_TYPE_CUSTOM)
     {
         band = core_eq_data[type].data;
@@ -1911,7 +3746,7 @@ gboolean rclib_core_set_eq(RCLibCoreEQType type, gdouble *band)
     for(i=0;i<10;i++)
     {
         g_snprintf(band_name, 15, "band%d", i);
-        g_object_set(G_OBJECT(priv->eq_plugin), band_name, band[i],
+        g_object_set(G_OBJECT(priv->dsp_plugin), band_name, band[i],
             NULL);
     }
     g_signal_emit(core_instance, core_signals[SIGNAL_EQ_CHANGED], 0,
@@ -1938,13 +3773,13 @@ gboolean rclib_core_get_eq(RCLibCoreEQType *type, gdouble *band)
     gdouble value;
     if(core_instance==NULL) return FALSE;
     priv = RCLIB_CORE(core_instance)->priv;
-    if(priv->eq_plugin==NULL) return FALSE;
+    if(priv->dsp_plugin==NULL) return FALSE;
     if(type!=NULL) *type = priv->eq_type;
     if(band==NULL) return TRUE;
     for(i=0;i<10;i++)
     {
         g_snprintf(band_name, 15, "band%d", i);
-        g_object_get(G_OBJECT(priv->eq_plugin), band_name, &value,
+        g_object_get(G_OBJECT(priv->dsp_plugin), band_name, &value,
             NULL);
         band[i] = value;
     }
@@ -1984,8 +3819,8 @@ gboolean rclib_core_set_balance(gfloat balance)
     RCLibCorePrivate *priv;
     if(core_instance==NULL) return FALSE;
     priv = RCLIB_CORE(core_instance)->priv;
-    if(priv->eq_plugin==NULL) return FALSE;
-    g_object_set(G_OBJECT(priv->bal_plugin), "panorama", balance, NULL);
+    if(priv->dsp_plugin==NULL) return FALSE;
+    g_object_set(G_OBJECT(priv->dsp_plugin), "panorama", balance, NULL);
     g_signal_emit(core_instance, core_signals[SIGNAL_BALANCE_CHANGED], 0,
         balance);
     return TRUE;
@@ -2007,8 +3842,8 @@ gboolean rclib_core_get_balance(gfloat *balance)
     gfloat bal;
     if(core_instance==NULL) return FALSE;
     priv = RCLIB_CORE(core_instance)->priv;
-    if(priv->eq_plugin==NULL) return FALSE;
-    g_object_get(G_OBJECT(priv->bal_plugin), "panorama", &bal, NULL);
+    if(priv->dsp_plugin==NULL) return FALSE;
+    g_object_get(G_OBJECT(priv->dsp_plugin), "panorama", &bal, NULL);
     if(balance!=NULL) *balance = bal;
     return TRUE;
 }
@@ -2018,8 +3853,9 @@ gboolean rclib_core_get_balance(gfloat *balance)
  * @element: a new GStreamer sound effect plugin to add
  * 
  * Add a new GStreamer sound effect plugin to the player.
- * Notice that this operation must be done when the player is not
- * in playing or paused state.
+ * With GStreamer 1.0, the plugin is linked when no data is flowing
+ * into the effect bin, so it can be added while the player is playing.
+ * With GStreamer 0.10, the player is stopped before the plugin is added.
  *
  * Returns: Whether the operation succeeded.
  */
@@ -2030,15 +3866,20 @@ gboolean rclib_core_effect_plugin_add(GstElement *element)
     if(core_instance==NULL) return FALSE;
     RCLibCorePrivate *priv = RCLIB_CORE(core_instance)->priv;
     if(priv==NULL || priv->effectbin==NULL) return FALSE;
-    rclib_core_stop();
-    flag = rclib_core_effect_add_element_internal(priv->effectbin, element,
-        FALSE);
+    #if GST_VERSION_MAJOR==1
+        flag = rclib_core_effect_add_element_internal(priv->effectbin,
+            element, TRUE);
+    #else
+        rclib_core_stop();
+        flag = rclib_core_effect_add_element_internal(priv->effectbin,
+            element, FALSE);
+    #endif
     if(flag)
     {
         priv->extra_plugin_list = g_list_append(priv->extra_plugin_list,
             element);
     }
-    return TRUE;
+    return flag;
 }
 
 /**
@@ -2046,8 +3887,10 @@ gboolean rclib_core_effect_plugin_add(GstElement *element)
  * @element: a new GStreamer sound effect plugin to remove
  * 
  * Remove an existed GStreamer sound effect plugin to the player.
- * Notice that this operation must be done when the player is not
- * in playing or paused state.
+ * With GStreamer 1.0, the plugin is drained and unlinked when no data
+ * is flowing into the effect bin, so it can be removed while the player
+ * is playing. With GStreamer 0.10, the player is stopped before the
+ * plugin is removed.
  */
 
 void rclib_core_effect_plugin_remove(GstElement *element)
@@ -2055,9 +3898,14 @@ void rclib_core_effect_plugin_remove(GstElement *element)
     if(core_instance==NULL) return;
     RCLibCorePrivate *priv = RCLIB_CORE(core_instance)->priv;
     if(priv==NULL || priv->effectbin==NULL) return;
-    rclib_core_stop();
-    rclib_core_effect_remove_element_internal(priv->effectbin, element,
-        FALSE);
+    #if GST_VERSION_MAJOR==1
+        rclib_core_effect_remove_element_internal(priv->effectbin,
+            element, TRUE);
+    #else
+        rclib_core_stop();
+        rclib_core_effect_remove_element_internal(priv->effectbin,
+            element, FALSE);
+    #endif
     priv->extra_plugin_list = g_list_remove(priv->extra_plugin_list,
         element);   
 }
@@ -2079,6 +3927,26 @@ GList *rclib_core_effect_plugin_get_list()
     return priv->extra_plugin_list;
 }
 
+/**
+ * rclib_core_effect_get_dsp:
+ *
+ * Get the #RCLibDsp element of the player, which processes the sound
+ * effects of the player. Plug-ins can add their stages to it by
+ * rclib_dsp_stage_add(), and set the parameters of the stages by the
+ * properties of the element. The stages can be added or removed at any
+ * time, without relinking any element in the pipeline.
+ *
+ * Returns: (transfer none): The DSP element, NULL if it is not available.
+ */
+
+GstElement *rclib_core_effect_get_dsp()
+{
+    if(core_instance==NULL) return NULL;
+    RCLibCorePrivate *priv = RCLIB_CORE(core_instance)->priv;
+    if(priv==NULL) return NULL;
+    return priv->dsp_plugin;
+}
+
 /**
  * rclib_core_query_sample_rate:
  *
@@ -2127,6 +3995,93 @@ gint rclib_core_query_depth()
     return priv->depth;
 }
 
+/**
+ * rclib_core_pcm_get_position:
+ *
+ * Get the write position of the PCM ring buffer, which is the number of
+ * the frames which have passed through the player. A new reader can
+ * start from this position to read only the samples after it.
+ *
+ * Returns: The write position.
+ */
+
+gsize rclib_core_pcm_get_position()
+{
+    if(core_instance==NULL) return 0;
+    RCLibCorePrivate *priv = RCLIB_CORE(core_instance)->priv;
+    if(priv==NULL) return 0;
+    return (gsize)g_atomic_pointer_get(&(priv->pcm_ring.write_pos));
+}
+
+/**
+ * rclib_core_pcm_read:
+ * @position: the read position of the reader
+ * @data: the buffer to store the samples
+ * @size: the number of the samples which the buffer can hold
+ * @rate: return location for the sample rate, or NULL
+ * @channels: return location for the channel number, or NULL
+ *
+ * Read the samples which have passed through the player after @position
+ * from the PCM ring buffer in the core, as interleaved 32-bit float. The
+ * ring buffer only keeps the latest samples, and it never blocks the
+ * playing: each reader (like the spectrum widget or a visualization
+ * plug-in) keeps its own position and reads at its own rate. If the
+ * reader falls behind, the oldest samples are skipped. At most 8
+ * channels are kept in the ring buffer. The @position is moved to the
+ * end of the samples read.
+ *
+ * Returns: The number of the frames read.
+ */
+
+guint rclib_core_pcm_read(gsize *position, gfloat *data, guint size,
+    gint *rate, gint *channels)
+{
+    RCLibCorePrivate *priv;
+    RCLibCorePcmRing *ring;
+    gsize start, end, format_pos;
+    gsize frames, offset, count;
+    gint seq, pcm_rate, pcm_channels;
+    if(core_instance==NULL || position==NULL || data==NULL) return 0;
+    priv = RCLIB_CORE(core_instance)->priv;
+    if(priv==NULL || priv->pcm_ring.data==NULL) return 0;
+    ring = &(priv->pcm_ring);
+    seq = g_atomic_int_get(&(ring->format_seq));
+    if(seq % 2!=0) return 0;
+    pcm_rate = ring->rate;
+    pcm_channels = ring->channels;
+    format_pos = ring->format_pos;
+    end = (gsize)g_atomic_pointer_get(&(ring->write_pos));
+    if(g_atomic_int_get(&(ring->format_seq))!=seq) return 0;
+    if(rate!=NULL) *rate = pcm_rate;
+    if(channels!=NULL) *channels = pcm_channels;
+    if(pcm_channels<=0) return 0;
+    start = *position;
+    if(end - start > RCLIB_CORE_PCM_RING_FRAMES - RCLIB_CORE_PCM_RING_GUARD)
+        start = end - (RCLIB_CORE_PCM_RING_FRAMES - RCLIB_CORE_PCM_RING_GUARD);
+    if(end - format_pos < end - start)
+        start = format_pos;
+    frames = MIN(end - start, size / pcm_channels);
+    offset = start & (RCLIB_CORE_PCM_RING_FRAMES - 1);
+    count = MIN(frames, RCLIB_CORE_PCM_RING_FRAMES - offset);
+    memcpy(data, ring->data + offset * pcm_channels,
+        count * pcm_channels * sizeof(gfloat));
+    if(frames>count)
+    {
+        memcpy(data + count * pcm_channels, ring->data,
+            (frames - count) * pcm_channels * sizeof(gfloat));
+    }
+    /* Drop the samples if the writer has reached them while copying. */
+    end = (gsize)g_atomic_pointer_get(&(ring->write_pos));
+    if(g_atomic_int_get(&(ring->format_seq))!=seq || end - start >
+        RCLIB_CORE_PCM_RING_FRAMES - RCLIB_CORE_PCM_RING_GUARD)
+    {
+        *position = end;
+        return 0;
+    }
+    *position = start + frames;
+    return frames;
+}
+
 /**
  * rclib_core_audio_output_set:
  * @output_type: the audio output plug-in type
@@ -2233,3 +4188,284 @@ gboolean rclib_core_audio_output_get(RCLibCoreAudioOutputType *output_type)
     return TRUE;
 }
 
+
+/**
+ * rclib_core_set_gapless:
+ * @gapless: whether to enable gapless mode
+ *
+ * Set whether the music queued by
+ * rclib_core_set_next_uri_with_play_source() is played without stopping
+ * the pipeline. Gapless mode needs GStreamer 1.0.
+ *
+ * Returns: Whether the operation succeeded.
+ */
+
+gboolean rclib_core_set_gapless(gboolean gapless)
+{
+    RCLibCorePrivate *priv;
+    if(core_instance==NULL) return FALSE;
+    priv = RCLIB_CORE(core_instance)->priv;
+    if(priv==NULL) return FALSE;
+    #if GST_VERSION_MAJOR!=1
+        if(gapless) return FALSE;
+    #endif
+    g_mutex_lock(&(priv->next_mutex));
+    priv->gapless = gapless;
+    if(!gapless)
+    {
+        rclib_core_next_source_free(priv->next_source);
+        priv->next_source = NULL;
+    }
+    g_mutex_unlock(&(priv->next_mutex));
+    return TRUE;
+}
+
+/**
+ * rclib_core_get_gapless:
+ *
+ * Get whether gapless mode is enabled.
+ *
+ * Returns: Whether gapless mode is enabled.
+ */
+
+gboolean rclib_core_get_gapless()
+{
+    RCLibCorePrivate *priv;
+    if(core_instance==NULL) return FALSE;
+    priv = RCLIB_CORE(core_instance)->priv;
+    if(priv==NULL) return FALSE;
+    return priv->gapless;
+}
+
+/**
+ * rclib_core_set_crossfade:
+ * @duration: the crossfade duration (in nanosecond), 0 to disable
+ * @curve: the volume curve of the crossfade
+ *
+ * Set the crossfade between the current music and the next one queued in
+ * gapless mode. Enabling or disabling crossfade stops the player. The
+ * crossfade needs GStreamer 1.0 and the audiomixer plugin.
+ *
+ * Returns: Whether the operation succeeded.
+ */
+
+gboolean rclib_core_set_crossfade(gint64 duration,
+    RCLibCoreCrossfadeCurve curve)
+{
+    RCLibCorePrivate *priv;
+    if(core_instance==NULL) return FALSE;
+    priv = RCLIB_CORE(core_instance)->priv;
+    if(priv==NULL) return FALSE;
+    if(duration<0) duration = 0;
+    #if GST_VERSION_MAJOR==1
+        if(duration>0 && priv->crossfade.bin==NULL)
+        {
+            rclib_core_stop();
+            if(!rclib_core_crossfade_bin_insert(priv)) return FALSE;
+        }
+        else if(duration==0 && priv->crossfade.bin!=NULL)
+        {
+            rclib_core_stop();
+            rclib_core_crossfade_bin_remove(priv);
+        }
+        g_mutex_lock(&(priv->crossfade.mutex));
+        priv->crossfade.duration = duration;
+        priv->crossfade.curve = curve;
+        g_mutex_unlock(&(priv->crossfade.mutex));
+        return TRUE;
+    #else
+        return (duration==0);
+    #endif
+}
+
+/**
+ * rclib_core_get_crossfade:
+ * @duration: (out) (allow-none): the crossfade duration (in nanosecond)
+ * @curve: (out) (allow-none): the volume curve of the crossfade
+ *
+ * Get the crossfade settings.
+ *
+ * Returns: Whether the crossfade is enabled.
+ */
+
+gboolean rclib_core_get_crossfade(gint64 *duration,
+    RCLibCoreCrossfadeCurve *curve)
+{
+    RCLibCorePrivate *priv;
+    if(core_instance==NULL) return FALSE;
+    priv = RCLIB_CORE(core_instance)->priv;
+    if(priv==NULL) return FALSE;
+    if(duration!=NULL) *duration = priv->crossfade.duration;
+    if(curve!=NULL) *curve = priv->crossfade.curve;
+    return (priv->crossfade.duration>0);
+}
+
+/**
+ * rclib_core_set_replaygain:
+ * @mode: the ReplayGain mode
+ * @preamp: the pre-amplification (in dB) added to the gain
+ *
+ * Set the ReplayGain mode and the pre-amplification. The gain values
+ * are read from the library, which uses the ReplayGain tags, or the
+ * loudness measured by the library if the music has no such tags.
+ *
+ * Returns: Whether the operation succeeded.
+ */
+
+gboolean rclib_core_set_replaygain(RCLibCoreReplayGainMode mode,
+    gdouble preamp)
+{
+    RCLibCorePrivate *priv;
+    if(core_instance==NULL) return FALSE;
+    priv = RCLIB_CORE(core_instance)->priv;
+    if(priv==NULL || priv->dsp_plugin==NULL) return FALSE;
+    priv->replaygain.mode = mode;
+    priv->replaygain.preamp = CLAMP(preamp, -15.0, 15.0);
+    rclib_core_replaygain_apply(priv);
+    return TRUE;
+}
+
+/**
+ * rclib_core_get_replaygain:
+ * @mode: (out) (allow-none): the ReplayGain mode
+ * @preamp: (out) (allow-none): the pre-amplification (in dB)
+ *
+ * Get the ReplayGain settings.
+ *
+ * Returns: Whether the operation succeeded.
+ */
+
+gboolean rclib_core_get_replaygain(RCLibCoreReplayGainMode *mode,
+    gdouble *preamp)
+{
+    RCLibCorePrivate *priv;
+    if(core_instance==NULL) return FALSE;
+    priv = RCLIB_CORE(core_instance)->priv;
+    if(priv==NULL || priv->dsp_plugin==NULL) return FALSE;
+    if(mode!=NULL) *mode = priv->replaygain.mode;
+    if(preamp!=NULL) *preamp = priv->replaygain.preamp;
+    return TRUE;
+}
+
+
+/**
+ * rclib_core_set_instrumentation:
+ * @enabled: whether to enable the instrumentation mode
+ *
+ * Enable or disable the instrumentation mode of the playback pipeline.
+ * In this mode, the core measures the processing time of the elements in
+ * the audio path, the size of the buffers, and how early the buffers
+ * reach the audio sink, which can be read by
+ * rclib_core_get_pipeline_stats(). The statistics are reset when the
+ * mode is enabled. The effect plug-ins added later are not measured
+ * until the mode is enabled again. It needs GStreamer 1.0.
+ *
+ * Returns: Whether the operation succeeded.
+ */
+
+gboolean rclib_core_set_instrumentation(gboolean enabled)
+{
+    RCLibCorePrivate *priv;
+    if(core_instance==NULL) return FALSE;
+    priv = RCLIB_CORE(core_instance)->priv;
+    if(priv==NULL || priv->identity==NULL) return FALSE;
+    #if GST_VERSION_MAJOR!=1
+        if(enabled) return FALSE;
+    #endif
+    if(enabled)
+        rclib_core_stats_attach(priv);
+    else
+        rclib_core_stats_detach(priv);
+    return TRUE;
+}
+
+/**
+ * rclib_core_get_instrumentation:
+ *
+ * Get whether the instrumentation mode is enabled.
+ *
+ * Returns: Whether the instrumentation mode is enabled.
+ */
+
+gboolean rclib_core_get_instrumentation()
+{
+    RCLibCorePrivate *priv;
+    if(core_instance==NULL) return FALSE;
+    priv = RCLIB_CORE(core_instance)->priv;
+    if(priv==NULL) return FALSE;
+    return priv->stats.enabled;
+}
+
+/**
+ * rclib_core_get_pipeline_stats:
+ *
+ * Get a snapshot of the statistics of the playback pipeline, which are
+ * collected in the instrumentation mode. The histograms are updated
+ * without locks, so the values in the snapshot may be from slightly
+ * different moments.
+ *
+ * Returns: The statistics, NULL if the instrumentation mode is not
+ *     enabled. Free it with rclib_core_pipeline_stats_free() after
+ *     usage.
+ */
+
+RCLibCorePipelineStats *rclib_core_get_pipeline_stats()
+{
+    RCLibCorePrivate *priv;
+    RCLibCorePipelineStats *result;
+    RCLibCoreStatsStage *stage;
+    GstQuery *query;
+    GstClockTime min_latency, max_latency;
+    gboolean live;
+    guint i;
+    if(core_instance==NULL) return NULL;
+    priv = RCLIB_CORE(core_instance)->priv;
+    if(priv==NULL || !priv->stats.enabled) return NULL;
+    result = g_new0(RCLibCorePipelineStats, 1);
+    result->stage_num = priv->stats.stages->len;
+    result->stages = g_new0(RCLibCoreStageStats, result->stage_num);
+    for(i=0;i<result->stage_num;i++)
+    {
+        stage = g_ptr_array_index(priv->stats.stages, i);
+        result->stages[i].name = g_strdup(stage->name);
+        rclib_core_stats_histogram_read(&(stage->process_time),
+            &(result->stages[i].process_time));
+    }
+    rclib_core_stats_histogram_read(&(priv->stats.buffer_size),
+        &(result->buffer_size));
+    rclib_core_stats_histogram_read(&(priv->stats.headroom),
+        &(result->headroom));
+    result->late_buffers = g_atomic_int_get(&(priv->stats.late_buffers));
+    result->frames = (gsize)g_atomic_pointer_get(&(priv->stats.frames));
+    result->elapsed = g_get_monotonic_time() - priv->stats.start_time;
+    result->min_latency = -1;
+    result->max_latency = -1;
+    query = gst_query_new_latency();
+    if(gst_element_query(priv->audiosink, query))
+    {
+        gst_query_parse_latency(query, &live, &min_latency, &max_latency);
+        if(GST_CLOCK_TIME_IS_VALID(min_latency))
+            result->min_latency = min_latency;
+        if(GST_CLOCK_TIME_IS_VALID(max_latency))
+            result->max_latency = max_latency;
+    }
+    gst_query_unref(query);
+    return result;
+}
+
+/**
+ * rclib_core_pipeline_stats_free:
+ * @stats: the statistics
+ *
+ * Free the statistics returned by rclib_core_get_pipeline_stats().
+ */
+
+void rclib_core_pipeline_stats_free(RCLibCorePipelineStats *stats)
+{
+    guint i;
+    if(stats==NULL) return;
+    for(i=0;i<stats->stage_num;i++)
+        g_free(stats->stages[i].name);
+    g_free(stats->stages);
+    g_free(stats);
+}
@@ -152,7 +152,45 @@ typedef enum {
     RCLIB_CORE_PLAY_SOURCE_THIRDPARTY = 3
 }RCLibCorePlaySource;
 
+/**
+ * RCLibCoreCrossfadeCurve:
+ * @RCLIB_CORE_CROSSFADE_CURVE_LINEAR: the volume changes linearly
+ * @RCLIB_CORE_CROSSFADE_CURVE_EQUAL_POWER: the total power of the two
+ *     music keeps constant
+ * @RCLIB_CORE_CROSSFADE_CURVE_S_CURVE: the volume changes slowly at the
+ *     beginning and the end
+ *
+ * The enum type for the volume curve of crossfade.
+ */
+
+typedef enum {
+    RCLIB_CORE_CROSSFADE_CURVE_LINEAR = 0,
+    RCLIB_CORE_CROSSFADE_CURVE_EQUAL_POWER = 1,
+    RCLIB_CORE_CROSSFADE_CURVE_S_CURVE = 2
+}RCLibCoreCrossfadeCurve;
+
+/**
+ * RCLibCoreReplayGainMode:
+ * @RCLIB_CORE_REPLAYGAIN_MODE_NONE: do not apply ReplayGain
+ * @RCLIB_CORE_REPLAYGAIN_MODE_TRACK: apply the track gain
+ * @RCLIB_CORE_REPLAYGAIN_MODE_ALBUM: apply the album gain, or the track
+ *     gain if the album gain is not found
+ *
+ * The enum type for the ReplayGain mode.
+ */
+
+typedef enum {
+    RCLIB_CORE_REPLAYGAIN_MODE_NONE = 0,
+    RCLIB_CORE_REPLAYGAIN_MODE_TRACK = 1,
+    RCLIB_CORE_REPLAYGAIN_MODE_ALBUM = 2
+}RCLibCoreReplayGainMode;
+
+#define RCLIB_CORE_HISTOGRAM_BUCKETS 20
+
 typedef struct _RCLibCoreMetadata RCLibCoreMetadata;
+typedef struct _RCLibCoreHistogram RCLibCoreHistogram;
+typedef struct _RCLibCoreStageStats RCLibCoreStageStats;
+typedef struct _RCLibCorePipelineStats RCLibCorePipelineStats;
 typedef struct _RCLibCore RCLibCore;
 typedef struct _RCLibCoreClass RCLibCoreClass;
 typedef struct _RCLibCorePrivate RCLibCorePrivate;
@@ -186,6 +224,72 @@ struct _RCLibCoreMetadata {
     GstBuffer *image;
 };
 
+/**
+ * RCLibCoreHistogram:
+ * @count: the number of the values
+ * @sum: the sum of the values
+ * @max: the maximum value
+ * @buckets: the number of the values in each bucket, the bucket 0 holds
+ *     the values less than 2, the bucket n holds the values from 2^n to
+ *     2^(n+1)-1, and the last bucket also holds all larger values
+ *
+ * The structure for a histogram in the pipeline statistics.
+ */
+
+struct _RCLibCoreHistogram {
+    guint count;
+    guint64 sum;
+    guint max;
+    guint buckets[RCLIB_CORE_HISTOGRAM_BUCKETS];
+};
+
+/**
+ * RCLibCoreStageStats:
+ * @name: the name of the element
+ * @process_time: the processing time of the buffers (unit: microsecond)
+ *
+ * The structure for the statistics of an element in the audio path.
+ */
+
+struct _RCLibCoreStageStats {
+    gchar *name;
+    RCLibCoreHistogram process_time;
+};
+
+/**
+ * RCLibCorePipelineStats:
+ * @stages: the statistics of the elements, in the order of the audio path
+ * @stage_num: the number of the elements in @stages
+ * @buffer_size: the size of the buffers entering the audio bin
+ *     (unit: frame)
+ * @headroom: how early the buffers reach the audio sink before their
+ *     running time (unit: microsecond)
+ * @late_buffers: the number of the buffers which reach the audio sink
+ *     after their running time
+ * @frames: the number of the frames which have passed through the
+ *     audio bin
+ * @elapsed: the time since the instrumentation is enabled
+ *     (unit: microsecond)
+ * @min_latency: the minimum latency of the audio sink (unit: nanosecond),
+ *     -1 if unknown
+ * @max_latency: the maximum latency of the audio sink (unit: nanosecond),
+ *     -1 if unknown or unlimited
+ *
+ * The structure for the statistics of the playback pipeline.
+ */
+
+struct _RCLibCorePipelineStats {
+    RCLibCoreStageStats *stages;
+    guint stage_num;
+    RCLibCoreHistogram buffer_size;
+    RCLibCoreHistogram headroom;
+    guint late_buffers;
+    guint64 frames;
+    gint64 elapsed;
+    gint64 min_latency;
+    gint64 max_latency;
+};
+
 /**
  * RCLibCore:
  *
@@ -239,6 +343,9 @@ void rclib_core_set_uri_with_play_source(const gchar *uri,
     GDestroyNotify notify, const gchar *cookie);
 gboolean rclib_core_update_play_source(RCLibCorePlaySource source_type,
     gpointer source_reference, GDestroyNotify notify, const gchar *cookie);
+gboolean rclib_core_set_next_uri_with_play_source(const gchar *uri,
+    RCLibCorePlaySource source_type, gpointer source_reference,
+    GDestroyNotify notify, const gchar *cookie);
 gchar *rclib_core_get_uri();
 gboolean rclib_core_get_play_source(RCLibCorePlaySource *source_type,
     gpointer *source_reference, gchar **cookie);
@@ -265,11 +372,29 @@ gboolean rclib_core_get_balance(gfloat *balance);
 gboolean rclib_core_effect_plugin_add(GstElement *element);
 void rclib_core_effect_plugin_remove(GstElement *element);
 GList *rclib_core_effect_plugin_get_list();
+GstElement *rclib_core_effect_get_dsp();
 gint rclib_core_query_sample_rate();
 gint rclib_core_query_channels();
 gint rclib_core_query_depth();
+gsize rclib_core_pcm_get_position();
+guint rclib_core_pcm_read(gsize *position, gfloat *data, guint size,
+    gint *rate, gint *channels);
 gboolean rclib_core_audio_output_set(RCLibCoreAudioOutputType output_type);
 gboolean rclib_core_audio_output_get(RCLibCoreAudioOutputType *output_type);
+gboolean rclib_core_set_gapless(gboolean gapless);
+gboolean rclib_core_get_gapless();
+gboolean rclib_core_set_crossfade(gint64 duration,
+    RCLibCoreCrossfadeCurve curve);
+gboolean rclib_core_get_crossfade(gint64 *duration,
+    RCLibCoreCrossfadeCurve *curve);
+gboolean rclib_core_set_replaygain(RCLibCoreReplayGainMode mode,
+    gdouble preamp);
+gboolean rclib_core_get_replaygain(RCLibCoreReplayGainMode *mode,
+    gdouble *preamp);
+gboolean rclib_core_set_instrumentation(gboolean enabled);
+gboolean rclib_core_get_instrumentation();
+RCLibCorePipelineStats *rclib_core_get_pipeline_stats();
+void rclib_core_pipeline_stats_free(RCLibCorePipelineStats *stats);
 
 G_END_DECLS
 
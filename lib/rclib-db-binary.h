@@ -0,0 +1,103 @@
+/*
+ * RhythmCat Library Music Database Binary Format Declaration
+ * The layout of the binary database file, shared with the tools.
+ *
+ * rclib-db-binary.h
+ * This file is part of RhythmCat Library (LibRhythmCat)
+ *
+ * Copyright (C) 2012 - SuperCat, license: GPL v3
+ *
+ * RhythmCat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RhythmCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RhythmCat; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, 
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef HAVE_RC_LIB_DB_BINARY_H
+#define HAVE_RC_LIB_DB_BINARY_H
+
+#include <glib.h>
+
+/*
+ * The binary database file: a header, followed by the catalog, playlist
+ * and library record arrays, and then the string table. All strings are
+ * stored as offsets in the string table, offset 0 means NULL. All values
+ * are stored in the byte order of the host which wrote the file. The
+ * file is mapped when it is loaded, but the records are not read in
+ * place: every record is copied into the database at startup.
+ */
+
+#define RCLIB_DB_BINARY_MAGIC "RCLIBDB\x1a"
+#define RCLIB_DB_BINARY_VERSION 2
+#define RCLIB_DB_BINARY_BYTE_ORDER 0x01020304
+
+typedef struct RCLibDbBinaryHeader
+{
+    gchar magic[8];
+    guint32 version;
+    guint32 byte_order;
+    guint32 header_size;
+    guint32 record_size;
+    guint32 catalog_count;
+    guint32 playlist_count;
+    guint32 library_count;
+    guint32 reserved;
+    guint64 catalog_offset;
+    guint64 playlist_offset;
+    guint64 library_offset;
+    guint64 string_offset;
+    guint64 string_size;
+}RCLibDbBinaryHeader;
+
+typedef struct RCLibDbBinaryCatalogRecord
+{
+    guint32 name;
+    guint32 type;
+    guint32 playlist_index;
+    guint32 playlist_count;
+}RCLibDbBinaryCatalogRecord;
+
+typedef struct RCLibDbBinaryItemRecord
+{
+    guint32 type;
+    guint32 uri;
+    guint32 title;
+    guint32 artist;
+    guint32 album;
+    guint32 ftype;
+    guint32 genre;
+    guint32 lyricfile;
+    guint32 lyricsecfile;
+    guint32 albumfile;
+    gint32 tracknum;
+    gint32 year;
+    gfloat rating;
+    guint32 reserved;
+    gint64 length;
+    gint64 mtime;
+    gint64 filesize;
+    guint64 inode;
+    gdouble track_gain;
+    gdouble track_peak;
+    gdouble album_gain;
+    gdouble album_peak;
+    guint32 gain_flags;
+    guint32 reserved2;
+}RCLibDbBinaryItemRecord;
+
+/* The records in version 1 end before the gain fields. */
+#define RCLIB_DB_BINARY_RECORD_SIZE_V1 \
+    G_STRUCT_OFFSET(RCLibDbBinaryItemRecord, track_gain)
+
+#endif
+
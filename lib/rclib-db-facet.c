@@ -0,0 +1,414 @@
+/*
+ * RhythmCat Library Music Database Module (Library Facet Part.)
+ * The genre, artist and album counts of the library for browsing.
+ *
+ * rclib-db-facet.c
+ * This file is part of RhythmCat Library (LibRhythmCat)
+ *
+ * Copyright (C) 2012 - SuperCat, license: GPL v3
+ *
+ * RhythmCat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RhythmCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RhythmCat; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include "rclib-db.h"
+#include "rclib-db-priv.h"
+#include "rclib-common.h"
+
+/*
+ * The facets are the genre, artist and album of the library items, in
+ * this order. Each node of the tree counts the items under it, and has
+ * one child table for each later facet, which maps the values of that
+ * facet (interned in the string pool) to the child nodes. So the root
+ * counts all items, the node of a genre counts the items in the genre,
+ * and the node of an artist under that genre counts the items of the
+ * artist in the genre, and so on. The counts of the values of a facet
+ * under some selected values of the former facets are then read from
+ * the children of the selected nodes, without looking at the items.
+ *
+ * The items without a value are counted in separate children, because
+ * they do not match a query which asks for an empty value. They are
+ * merged into the empty value when the counts are read.
+ *
+ * The index is built on the first lookup, and kept up to date by the
+ * library signals after that.
+ */
+
+struct _RCLibDbFacetNode
+{
+    guint count;
+    GHashTable *children[RCLIB_DB_FACET_NUM];
+    RCLibDbFacetNode *null_children[RCLIB_DB_FACET_NUM];
+};
+
+typedef struct RCLibDbFacetRecord
+{
+    gchar *values[RCLIB_DB_FACET_NUM];
+}RCLibDbFacetRecord;
+
+static RCLibDbFacetNode *rclib_db_facet_node_new()
+{
+    return g_new0(RCLibDbFacetNode, 1);
+}
+
+static void rclib_db_facet_node_free(RCLibDbFacetNode *node)
+{
+    guint i;
+    if(node==NULL) return;
+    for(i=0;i<RCLIB_DB_FACET_NUM;i++)
+    {
+        if(node->children[i]!=NULL)
+            g_hash_table_destroy(node->children[i]);
+        rclib_db_facet_node_free(node->null_children[i]);
+    }
+    g_free(node);
+}
+
+static void rclib_db_facet_record_free(RCLibDbFacetRecord *record)
+{
+    guint i;
+    if(record==NULL) return;
+    for(i=0;i<RCLIB_DB_FACET_NUM;i++)
+        _rclib_db_string_release(record->values[i]);
+    g_free(record);
+}
+
+static RCLibDbFacetNode *rclib_db_facet_node_get_child(
+    RCLibDbFacetNode *node, guint facet, const gchar *value,
+    gboolean create)
+{
+    RCLibDbFacetNode *child;
+    if(value==NULL)
+    {
+        if(node->null_children[facet]==NULL && create)
+            node->null_children[facet] = rclib_db_facet_node_new();
+        return node->null_children[facet];
+    }
+    if(node->children[facet]==NULL)
+    {
+        if(!create) return NULL;
+        node->children[facet] = g_hash_table_new_full(g_str_hash,
+            g_str_equal, (GDestroyNotify)_rclib_db_string_release,
+            (GDestroyNotify)rclib_db_facet_node_free);
+    }
+    child = g_hash_table_lookup(node->children[facet], value);
+    if(child==NULL && create)
+    {
+        child = rclib_db_facet_node_new();
+        g_hash_table_insert(node->children[facet],
+            _rclib_db_string_intern(value), child);
+    }
+    return child;
+}
+
+static void rclib_db_facet_node_add(RCLibDbFacetNode *node,
+    gchar * const *values, guint first)
+{
+    RCLibDbFacetNode *child;
+    guint i;
+    node->count++;
+    for(i=first;i<RCLIB_DB_FACET_NUM;i++)
+    {
+        child = rclib_db_facet_node_get_child(node, i, values[i], TRUE);
+        rclib_db_facet_node_add(child, values, i+1);
+    }
+}
+
+static void rclib_db_facet_node_remove(RCLibDbFacetNode *node,
+    gchar * const *values, guint first)
+{
+    RCLibDbFacetNode *child;
+    guint i;
+    if(node->count>0) node->count--;
+    for(i=first;i<RCLIB_DB_FACET_NUM;i++)
+    {
+        child = rclib_db_facet_node_get_child(node, i, values[i], FALSE);
+        if(child==NULL) continue;
+        rclib_db_facet_node_remove(child, values, i+1);
+        if(child->count>0) continue;
+        if(values[i]==NULL)
+        {
+            rclib_db_facet_node_free(child);
+            node->null_children[i] = NULL;
+        }
+        else
+            g_hash_table_remove(node->children[i], values[i]);
+    }
+}
+
+static void rclib_db_facet_add(RCLibDbPrivate *priv,
+    RCLibDbLibraryData *library_data)
+{
+    RCLibDbLibraryDataView view;
+    RCLibDbFacetRecord *record;
+    rclib_db_library_data_view_begin(library_data, &view);
+    if(view.uri==NULL)
+    {
+        rclib_db_library_data_view_end(library_data, &view);
+        return;
+    }
+    record = g_new0(RCLibDbFacetRecord, 1);
+    record->values[RCLIB_DB_FACET_GENRE] = _rclib_db_string_intern(
+        view.genre);
+    record->values[RCLIB_DB_FACET_ARTIST] = _rclib_db_string_intern(
+        view.artist);
+    record->values[RCLIB_DB_FACET_ALBUM] = _rclib_db_string_intern(
+        view.album);
+    g_hash_table_replace(priv->library_facet_record_table,
+        g_strdup(view.uri), record);
+    rclib_db_library_data_view_end(library_data, &view);
+    rclib_db_facet_node_add(priv->library_facet_root, record->values, 0);
+}
+
+static void rclib_db_facet_remove(RCLibDbPrivate *priv, const gchar *uri)
+{
+    RCLibDbFacetRecord *record;
+    record = g_hash_table_lookup(priv->library_facet_record_table, uri);
+    if(record==NULL) return;
+    rclib_db_facet_node_remove(priv->library_facet_root, record->values, 0);
+    g_hash_table_remove(priv->library_facet_record_table, uri);
+}
+
+static void rclib_db_facet_clear(RCLibDbPrivate *priv)
+{
+    g_hash_table_remove_all(priv->library_facet_record_table);
+    rclib_db_facet_node_free(priv->library_facet_root);
+    priv->library_facet_root = rclib_db_facet_node_new();
+    priv->library_facet_valid = FALSE;
+}
+
+/* The library read lock must be held by the caller. */
+
+static void rclib_db_facet_build(RCLibDbPrivate *priv)
+{
+    GHashTableIter iter;
+    RCLibDbLibraryData *library_data;
+    rclib_db_facet_clear(priv);
+    g_hash_table_iter_init(&iter, priv->library_table);
+    while(g_hash_table_iter_next(&iter, NULL, (gpointer *)&library_data))
+    {
+        if(library_data==NULL) continue;
+        rclib_db_facet_add(priv, library_data);
+    }
+    priv->library_facet_valid = TRUE;
+}
+
+static void rclib_db_facet_library_added_cb(RCLibDb *db, const gchar *uri,
+    gpointer data)
+{
+    RCLibDbPrivate *priv = (RCLibDbPrivate *)data;
+    RCLibDbLibraryData *library_data;
+    if(priv==NULL || uri==NULL) return;
+    library_data = rclib_db_library_get_data(uri);
+    g_rw_lock_writer_lock(&(priv->library_facet_lock));
+    if(priv->library_facet_valid)
+    {
+        rclib_db_facet_remove(priv, uri);
+        if(library_data!=NULL)
+            rclib_db_facet_add(priv, library_data);
+    }
+    g_rw_lock_writer_unlock(&(priv->library_facet_lock));
+    if(library_data!=NULL)
+        rclib_db_library_data_unref(library_data);
+}
+
+static void rclib_db_facet_library_deleted_cb(RCLibDb *db,
+    const gchar *uri, gpointer data)
+{
+    RCLibDbPrivate *priv = (RCLibDbPrivate *)data;
+    if(priv==NULL || uri==NULL) return;
+    g_rw_lock_writer_lock(&(priv->library_facet_lock));
+    if(priv->library_facet_valid)
+        rclib_db_facet_remove(priv, uri);
+    g_rw_lock_writer_unlock(&(priv->library_facet_lock));
+}
+
+static void rclib_db_facet_count_clear(RCLibDbFacetCount *count)
+{
+    g_free(count->name);
+}
+
+static void rclib_db_facet_count_merge(GArray *counts, GHashTable *positions,
+    const gchar *name, guint count)
+{
+    RCLibDbFacetCount facet_count;
+    guint position;
+    position = GPOINTER_TO_UINT(g_hash_table_lookup(positions, name));
+    if(position>0)
+    {
+        g_array_index(counts, RCLibDbFacetCount, position-1).count += count;
+        return;
+    }
+    facet_count.name = g_strdup(name);
+    facet_count.count = count;
+    g_array_append_val(counts, facet_count);
+    g_hash_table_insert(positions, facet_count.name,
+        GUINT_TO_POINTER(counts->len));
+}
+
+/*
+ * Get the facet of a query property, or -1 if the property is not a
+ * facet.
+ */
+
+gint _rclib_db_facet_from_propid(guint propid)
+{
+    switch(propid)
+    {
+        case RCLIB_DB_QUERY_DATA_TYPE_GENRE:
+            return RCLIB_DB_FACET_GENRE;
+        case RCLIB_DB_QUERY_DATA_TYPE_ARTIST:
+            return RCLIB_DB_FACET_ARTIST;
+        case RCLIB_DB_QUERY_DATA_TYPE_ALBUM:
+            return RCLIB_DB_FACET_ALBUM;
+        default:
+            break;
+    }
+    return -1;
+}
+
+/*
+ * Count the values of the facet in the library items which match the
+ * selection. The selection has one array for each facet, which holds
+ * the values the items may have in the facet, or NULL if the facet is
+ * not selected. Only the facets before the counted one can be selected.
+ * The number of the matched items is returned in @total. Returns an
+ * array of #RCLibDbFacetCount in no particular order, or NULL if the
+ * selection is not supported. Free it with g_array_free().
+ */
+
+GArray *_rclib_db_library_facet_lookup(RCLibDbPrivate *priv,
+    GPtrArray * const *selection, guint facet, guint *total)
+{
+    GHashTable *nodes, *next_nodes, *positions;
+    GHashTableIter node_iter, child_iter;
+    RCLibDbFacetNode *node, *child;
+    GArray *counts;
+    const gchar *name;
+    guint i, j, sum = 0;
+    if(priv==NULL || priv->library_facet_record_table==NULL) return NULL;
+    if(facet>=RCLIB_DB_FACET_NUM) return NULL;
+    for(i=facet;selection!=NULL && i<RCLIB_DB_FACET_NUM;i++)
+    {
+        if(selection[i]!=NULL) return NULL;
+    }
+    g_rw_lock_reader_lock(&(priv->library_facet_lock));
+    if(!priv->library_facet_valid)
+    {
+        g_rw_lock_reader_unlock(&(priv->library_facet_lock));
+        g_rw_lock_reader_lock(&(priv->library_rw_lock));
+        g_rw_lock_writer_lock(&(priv->library_facet_lock));
+        if(!priv->library_facet_valid)
+            rclib_db_facet_build(priv);
+        g_rw_lock_writer_unlock(&(priv->library_facet_lock));
+        g_rw_lock_reader_unlock(&(priv->library_rw_lock));
+        g_rw_lock_reader_lock(&(priv->library_facet_lock));
+    }
+    nodes = g_hash_table_new(g_direct_hash, g_direct_equal);
+    g_hash_table_add(nodes, priv->library_facet_root);
+    for(i=0;selection!=NULL && i<facet;i++)
+    {
+        if(selection[i]==NULL) continue;
+        next_nodes = g_hash_table_new(g_direct_hash, g_direct_equal);
+        g_hash_table_iter_init(&node_iter, nodes);
+        while(g_hash_table_iter_next(&node_iter, (gpointer *)&node, NULL))
+        {
+            for(j=0;j<selection[i]->len;j++)
+            {
+                child = rclib_db_facet_node_get_child(node, i,
+                    g_ptr_array_index(selection[i], j), FALSE);
+                if(child!=NULL)
+                    g_hash_table_add(next_nodes, child);
+            }
+        }
+        g_hash_table_destroy(nodes);
+        nodes = next_nodes;
+    }
+    counts = g_array_new(FALSE, FALSE, sizeof(RCLibDbFacetCount));
+    g_array_set_clear_func(counts, (GDestroyNotify)
+        rclib_db_facet_count_clear);
+    positions = g_hash_table_new(g_str_hash, g_str_equal);
+    g_hash_table_iter_init(&node_iter, nodes);
+    while(g_hash_table_iter_next(&node_iter, (gpointer *)&node, NULL))
+    {
+        sum += node->count;
+        if(node->children[facet]!=NULL)
+        {
+            g_hash_table_iter_init(&child_iter, node->children[facet]);
+            while(g_hash_table_iter_next(&child_iter, (gpointer *)&name,
+                (gpointer *)&child))
+            {
+                rclib_db_facet_count_merge(counts, positions, name,
+                    child->count);
+            }
+        }
+        if(node->null_children[facet]!=NULL)
+        {
+            rclib_db_facet_count_merge(counts, positions, "",
+                node->null_children[facet]->count);
+        }
+    }
+    g_rw_lock_reader_unlock(&(priv->library_facet_lock));
+    g_hash_table_destroy(positions);
+    g_hash_table_destroy(nodes);
+    if(total!=NULL) *total = sum;
+    return counts;
+}
+
+/*
+ * Drop the facet index, it will be built again on the next lookup. Call
+ * this after the library is loaded without the library signals.
+ */
+
+void _rclib_db_library_facet_invalidate(RCLibDbPrivate *priv)
+{
+    if(priv==NULL || priv->library_facet_record_table==NULL) return;
+    g_rw_lock_writer_lock(&(priv->library_facet_lock));
+    rclib_db_facet_clear(priv);
+    g_rw_lock_writer_unlock(&(priv->library_facet_lock));
+}
+
+gboolean _rclib_db_instance_init_facet(RCLibDb *db, RCLibDbPrivate *priv)
+{
+    if(db==NULL || priv==NULL) return FALSE;
+    g_rw_lock_init(&(priv->library_facet_lock));
+    priv->library_facet_root = rclib_db_facet_node_new();
+
+    /* GHashTable<gchar *, RCLibDbFacetRecord *> */
+    priv->library_facet_record_table = g_hash_table_new_full(g_str_hash,
+        g_str_equal, g_free, (GDestroyNotify)rclib_db_facet_record_free);
+
+    priv->library_facet_valid = FALSE;
+    g_signal_connect(db, "library-added",
+        G_CALLBACK(rclib_db_facet_library_added_cb), priv);
+    g_signal_connect(db, "library-changed",
+        G_CALLBACK(rclib_db_facet_library_added_cb), priv);
+    g_signal_connect(db, "library-deleted",
+        G_CALLBACK(rclib_db_facet_library_deleted_cb), priv);
+    return TRUE;
+}
+
+void _rclib_db_instance_finalize_facet(RCLibDbPrivate *priv)
+{
+    if(priv==NULL || priv->library_facet_record_table==NULL) return;
+    g_rw_lock_writer_lock(&(priv->library_facet_lock));
+    g_hash_table_destroy(priv->library_facet_record_table);
+    rclib_db_facet_node_free(priv->library_facet_root);
+    priv->library_facet_record_table = NULL;
+    priv->library_facet_root = NULL;
+    priv->library_facet_valid = FALSE;
+    g_rw_lock_writer_unlock(&(priv->library_facet_lock));
+    g_rw_lock_clear(&(priv->library_facet_lock));
+}
@@ -0,0 +1,569 @@
+/*
+ * RhythmCat Library Music Database Module (Loudness Part.)
+ * Measure the loudness of the library items without ReplayGain tags.
+ *
+ * rclib-db-gain.c
+ * This file is part of RhythmCat Library (LibRhythmCat)
+ *
+ * Copyright (C) 2012 - SuperCat, license: GPL v3
+ *
+ * RhythmCat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RhythmCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RhythmCat; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include "rclib-db.h"
+#include "rclib-db-priv.h"
+#include "rclib-common.h"
+#include <gst/audio/audio.h>
+#include <string.h>
+#include <math.h>
+
+/*
+ * The library items which have no ReplayGain tags are decoded here, and
+ * their integrated loudness is measured as EBU R128 (ITU-R BS.1770)
+ * describes: the samples are resampled to 48kHz and filtered by the
+ * K-weighting filters, the mean square of each 400ms block (with 75%
+ * overlap) is gated by the absolute gate (-70 LUFS) and then by the
+ * relative gate (10 LU below the loudness of the blocks passed the
+ * absolute gate). The track gain is stored relative to -18 LUFS, which
+ * is the reference level of ReplayGain 2.0.
+ *
+ * Only one item is measured at the same time, and the worker waits until
+ * the import and refresh jobs are done, so the analysis never slows down
+ * the other jobs of the database. The results are written back in main
+ * thread, and saved with the other data of the library item.
+ */
+
+#define GAIN_SAMPLERATE 48000
+#define GAIN_STEP_FRAMES (GAIN_SAMPLERATE / 10)
+#define GAIN_CHANNEL_MAX 8
+#define GAIN_SCHEDULE_DELAY 10
+
+/* 10 ^ ((-70 + 0.691) / 10), the absolute gate in mean square. */
+#define GAIN_ABSOLUTE_GATE 1.1724653e-7
+
+/* The loudness offset of BS.1770 plus the ReplayGain 2.0 reference. */
+#define GAIN_REFERENCE (-18.0 + 0.691)
+
+typedef struct RCLibDbGainMeter
+{
+    gint channels;
+    gdouble weights[GAIN_CHANNEL_MAX];
+    gdouble state[GAIN_CHANNEL_MAX][4];
+    gdouble steps[4];
+    gdouble step_sum;
+    guint step_frames;
+    guint step_count;
+    gdouble peak;
+    GArray *blocks;
+}RCLibDbGainMeter;
+
+typedef struct RCLibDbGainResult
+{
+    gchar *uri;
+    gdouble gain;
+    gdouble peak;
+    gboolean done;
+    gboolean success;
+}RCLibDbGainResult;
+
+/* The K-weighting filters at 48kHz: the pre-filter and the RLB filter. */
+static const gdouble db_gain_pre_b[3] = {1.53512485958697,
+    -2.69169618940638, 1.19839281085285};
+static const gdouble db_gain_pre_a[2] = {-1.69065929318241,
+    0.73248077421585};
+static const gdouble db_gain_rlb_a[2] = {-1.99004745483398,
+    0.99007225036621};
+
+static void rclib_db_gain_meter_init(RCLibDbGainMeter *meter)
+{
+    memset(meter, 0, sizeof(RCLibDbGainMeter));
+    meter->blocks = g_array_new(FALSE, FALSE, sizeof(gdouble));
+}
+
+static void rclib_db_gain_meter_set_channels(RCLibDbGainMeter *meter,
+    gint channels)
+{
+    gint i;
+    if(channels<1 || channels>GAIN_CHANNEL_MAX) return;
+    meter->channels = channels;
+    for(i=0;i<channels;i++)
+        meter->weights[i] = 1.0;
+
+    /* The LFE channel is ignored, and the surround channels are louder. */
+    if(channels==6)
+    {
+        meter->weights[3] = 0.0;
+        meter->weights[4] = 1.41;
+        meter->weights[5] = 1.41;
+    }
+}
+
+static void rclib_db_gain_meter_step(RCLibDbGainMeter *meter)
+{
+    gdouble block;
+    meter->steps[meter->step_count % 4] = meter->step_sum;
+    meter->step_count++;
+    meter->step_sum = 0.0;
+    meter->step_frames = 0;
+    if(meter->step_count<4) return;
+    block = (meter->steps[0] + meter->steps[1] + meter->steps[2] +
+        meter->steps[3]) / (4 * GAIN_STEP_FRAMES);
+    g_array_append_val(meter->blocks, block);
+}
+
+static void rclib_db_gain_meter_process(RCLibDbGainMeter *meter,
+    const gfloat *samples, gsize count)
+{
+    gsize frames, i;
+    gint c;
+    gdouble x, y, sum;
+    gdouble *state;
+    if(meter->channels<=0) return;
+    frames = count / meter->channels;
+    for(i=0;i<frames;i++)
+    {
+        sum = 0.0;
+        for(c=0;c<meter->channels;c++)
+        {
+            x = *samples;
+            samples++;
+            if(x>meter->peak) meter->peak = x;
+            else if(-x>meter->peak) meter->peak = -x;
+            state = meter->state[c];
+            y = db_gain_pre_b[0] * x + state[0];
+            state[0] = db_gain_pre_b[1] * x - db_gain_pre_a[0] * y +
+                state[1];
+            state[1] = db_gain_pre_b[2] * x - db_gain_pre_a[1] * y;
+            x = y;
+            y = x + state[2];
+            state[2] = -2.0 * x - db_gain_rlb_a[0] * y + state[3];
+            state[3] = x - db_gain_rlb_a[1] * y;
+            sum += meter->weights[c] * y * y;
+        }
+        meter->step_sum += sum;
+        meter->step_frames++;
+        if(meter->step_frames>=GAIN_STEP_FRAMES)
+            rclib_db_gain_meter_step(meter);
+    }
+}
+
+static gboolean rclib_db_gain_meter_get_gain(RCLibDbGainMeter *meter,
+    gdouble *gain)
+{
+    gdouble block, threshold, sum = 0.0;
+    guint i, count = 0;
+    for(i=0;i<meter->blocks->len;i++)
+    {
+        block = g_array_index(meter->blocks, gdouble, i);
+        if(block<=GAIN_ABSOLUTE_GATE) continue;
+        sum += block;
+        count++;
+    }
+    if(count==0) return FALSE;
+    threshold = sum / count * 0.1;
+    sum = 0.0;
+    count = 0;
+    for(i=0;i<meter->blocks->len;i++)
+    {
+        block = g_array_index(meter->blocks, gdouble, i);
+        if(block<=GAIN_ABSOLUTE_GATE || block<=threshold) continue;
+        sum += block;
+        count++;
+    }
+    if(count==0) return FALSE;
+    *gain = GAIN_REFERENCE - 10.0 * log10(sum / count);
+    return TRUE;
+}
+
+static void rclib_db_gain_handoff_cb(GstElement *fakesink,
+    GstBuffer *buffer, GstPad *pad, RCLibDbGainMeter *meter)
+{
+    GstCaps *caps;
+    gint channels = 0;
+    #if GST_VERSION_MAJOR==1
+        GstMapInfo map_info;
+    #endif
+    if(meter->channels==0)
+    {
+        #if GST_VERSION_MAJOR==1
+            caps = gst_pad_get_current_caps(pad);
+        #else
+            caps = gst_pad_get_negotiated_caps(pad);
+        #endif
+        if(caps==NULL) return;
+        gst_structure_get_int(gst_caps_get_structure(caps, 0), "channels",
+            &channels);
+        gst_caps_unref(caps);
+        rclib_db_gain_meter_set_channels(meter, channels);
+    }
+    #if GST_VERSION_MAJOR==1
+        if(!gst_buffer_map(buffer, &map_info, GST_MAP_READ)) return;
+        rclib_db_gain_meter_process(meter, (const gfloat *)map_info.data,
+            map_info.size / sizeof(gfloat));
+        gst_buffer_unmap(buffer, &map_info);
+    #else
+        rclib_db_gain_meter_process(meter,
+            (const gfloat *)GST_BUFFER_DATA(buffer),
+            GST_BUFFER_SIZE(buffer) / sizeof(gfloat));
+    #endif
+}
+
+static void rclib_db_gain_pad_added_cb(GstElement *decoder, GstPad *pad,
+    GstElement *audioconvert)
+{
+    GstCaps *caps;
+    GstPad *sink_pad;
+    gboolean audio_flag;
+    #if GST_VERSION_MAJOR==1
+        caps = gst_pad_query_caps(pad, NULL);
+    #else
+        caps = gst_pad_get_caps(pad);
+    #endif
+    if(caps==NULL) return;
+    audio_flag = !gst_caps_is_empty(caps) && !gst_caps_is_any(caps) &&
+        g_str_has_prefix(gst_structure_get_name(gst_caps_get_structure(
+        caps, 0)), "audio/x-raw");
+    gst_caps_unref(caps);
+    if(!audio_flag) return;
+    sink_pad = gst_element_get_static_pad(audioconvert, "sink");
+    if(!gst_pad_is_linked(sink_pad))
+        gst_pad_link(pad, sink_pad);
+    gst_object_unref(sink_pad);
+}
+
+/*
+ * Decode the music and measure its loudness, returns FALSE if the
+ * music cannot be decoded, or it is too short or too quiet to measure.
+ */
+
+static gboolean rclib_db_gain_analyze(RCLibDbPrivate *priv,
+    const gchar *uri, gdouble *gain, gdouble *peak)
+{
+    GstElement *pipeline = NULL;
+    GstElement *decoder = NULL;
+    GstElement *audioconvert = NULL;
+    GstElement *audioresample = NULL;
+    GstElement *capsfilter = NULL;
+    GstElement *fakesink = NULL;
+    GstCaps *caps;
+    GstBus *bus;
+    GstMessage *msg;
+    RCLibDbGainMeter meter;
+    gboolean flag = FALSE;
+    G_STMT_START
+    {
+        pipeline = gst_pipeline_new("rclib-db-gain-pipeline");
+        if(pipeline==NULL) break;
+        decoder = gst_element_factory_make("uridecodebin", NULL);
+        if(decoder==NULL) break;
+        audioconvert = gst_element_factory_make("audioconvert", NULL);
+        if(audioconvert==NULL) break;
+        audioresample = gst_element_factory_make("audioresample", NULL);
+        if(audioresample==NULL) break;
+        capsfilter = gst_element_factory_make("capsfilter", NULL);
+        if(capsfilter==NULL) break;
+        fakesink = gst_element_factory_make("fakesink", NULL);
+        if(fakesink==NULL) break;
+        flag = TRUE;
+    }
+    G_STMT_END;
+    if(!flag)
+    {
+        if(pipeline!=NULL) gst_object_unref(pipeline);
+        if(decoder!=NULL) gst_object_unref(decoder);
+        if(audioconvert!=NULL) gst_object_unref(audioconvert);
+        if(audioresample!=NULL) gst_object_unref(audioresample);
+        if(capsfilter!=NULL) gst_object_unref(capsfilter);
+        if(fakesink!=NULL) gst_object_unref(fakesink);
+        return FALSE;
+    }
+    #if GST_VERSION_MAJOR==1
+        caps = gst_caps_new_simple("audio/x-raw", "format", G_TYPE_STRING,
+            GST_AUDIO_NE(F32), "layout", G_TYPE_STRING, "interleaved",
+            "rate", G_TYPE_INT, GAIN_SAMPLERATE, "channels",
+            GST_TYPE_INT_RANGE, 1, GAIN_CHANNEL_MAX, NULL);
+    #else
+        caps = gst_caps_new_simple("audio/x-raw-float", "width", G_TYPE_INT,
+            32, "endianness", G_TYPE_INT, G_BYTE_ORDER, "rate", G_TYPE_INT,
+            GAIN_SAMPLERATE, "channels", GST_TYPE_INT_RANGE, 1,
+            GAIN_CHANNEL_MAX, NULL);
+    #endif
+    g_object_set(capsfilter, "caps", caps, NULL);
+    gst_caps_unref(caps);
+    g_object_set(decoder, "uri", uri, NULL);
+    g_object_set(fakesink, "signal-handoffs", TRUE, "sync", FALSE, NULL);
+    gst_bin_add_many(GST_BIN(pipeline), decoder, audioconvert,
+        audioresample, capsfilter, fakesink, NULL);
+    if(!gst_element_link_many(audioconvert, audioresample, capsfilter,
+        fakesink, NULL))
+    {
+        g_warning("Cannot link the loudness analysis pipeline!");
+        gst_object_unref(pipeline);
+        return FALSE;
+    }
+    rclib_db_gain_meter_init(&meter);
+    g_signal_connect(decoder, "pad-added",
+        G_CALLBACK(rclib_db_gain_pad_added_cb), audioconvert);
+    g_signal_connect(fakesink, "handoff",
+        G_CALLBACK(rclib_db_gain_handoff_cb), &meter);
+    flag = FALSE;
+    bus = gst_element_get_bus(pipeline);
+    if(gst_element_set_state(pipeline, GST_STATE_PLAYING)!=
+        GST_STATE_CHANGE_FAILURE)
+    {
+        while(priv->gain_work_flag && priv->gain_analysis_flag)
+        {
+            msg = gst_bus_timed_pop_filtered(bus, GST_SECOND / 2,
+                GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+            if(msg==NULL) continue;
+            flag = GST_MESSAGE_TYPE(msg)==GST_MESSAGE_EOS;
+            gst_message_unref(msg);
+            break;
+        }
+    }
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(bus);
+    gst_object_unref(pipeline);
+    if(flag) flag = rclib_db_gain_meter_get_gain(&meter, gain);
+    *peak = meter.peak;
+    g_array_free(meter.blocks, TRUE);
+    if(!flag)
+        g_debug("Cannot measure the loudness of URI: %s", uri);
+    return flag;
+}
+
+static gboolean rclib_db_gain_apply_idle_cb(gpointer data)
+{
+    RCLibDbGainResult *result = (RCLibDbGainResult *)data;
+    RCLibDbPrivate *priv = NULL;
+    GObject *instance;
+    guint flags = 0;
+    if(data==NULL) return FALSE;
+    instance = rclib_db_get_instance();
+    if(instance!=NULL) priv = RCLIB_DB(instance)->priv;
+    if(priv==NULL || priv->gain_pending_table==NULL)
+    {
+        g_free(result->uri);
+        g_free(result);
+        return FALSE;
+    }
+    if(result->done && rclib_db_library_has_uri(result->uri))
+    {
+        rclib_db_library_data_uri_get(result->uri,
+            RCLIB_DB_LIBRARY_DATA_TYPE_GAIN_FLAGS, &flags,
+            RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
+
+        /* The tags may be read again while the item is measured. */
+        if(!(flags & (RCLIB_DB_GAIN_FLAG_TRACK |
+            RCLIB_DB_GAIN_FLAG_ANALYZED)))
+        {
+            flags |= RCLIB_DB_GAIN_FLAG_ANALYZED;
+            if(result->success)
+            {
+                flags |= RCLIB_DB_GAIN_FLAG_TRACK;
+                rclib_db_library_data_uri_set(result->uri,
+                    RCLIB_DB_LIBRARY_DATA_TYPE_TRACK_GAIN, result->gain,
+                    RCLIB_DB_LIBRARY_DATA_TYPE_TRACK_PEAK, result->peak,
+                    RCLIB_DB_LIBRARY_DATA_TYPE_GAIN_FLAGS, flags,
+                    RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
+            }
+            else
+            {
+                rclib_db_library_data_uri_set(result->uri,
+                    RCLIB_DB_LIBRARY_DATA_TYPE_GAIN_FLAGS, flags,
+                    RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
+            }
+        }
+    }
+    g_hash_table_remove(priv->gain_pending_table, result->uri);
+    g_free(result->uri);
+    g_free(result);
+    return FALSE;
+}
+
+static void rclib_db_gain_thread_cb(gpointer data, gpointer user_data)
+{
+    RCLibDbPrivate *priv = (RCLibDbPrivate *)user_data;
+    RCLibDbGainResult *result;
+    gchar *uri = (gchar *)data;
+    if(!priv->gain_work_flag)
+    {
+        g_free(uri);
+        return;
+    }
+
+    /* Wait until the import and refresh jobs are done. */
+    while(priv->gain_work_flag && priv->gain_analysis_flag &&
+        (priv->import_work_flag || priv->refresh_work_flag))
+        g_usleep(G_USEC_PER_SEC);
+    result = g_new0(RCLibDbGainResult, 1);
+    result->uri = uri;
+    if(priv->gain_work_flag && priv->gain_analysis_flag)
+    {
+        result->success = rclib_db_gain_analyze(priv, uri,
+            &(result->gain), &(result->peak));
+
+        /* The analysis is stopped if it is disabled at the same time. */
+        result->done = priv->gain_work_flag && priv->gain_analysis_flag;
+    }
+    if(!priv->gain_work_flag)
+    {
+        g_free(result->uri);
+        g_free(result);
+        return;
+    }
+    g_idle_add_full(G_PRIORITY_LOW, rclib_db_gain_apply_idle_cb, result,
+        NULL);
+}
+
+static inline gboolean rclib_db_gain_need_analysis(
+    RCLibDbLibraryData *library_data)
+{
+    gboolean flag;
+    g_rw_lock_reader_lock(&(library_data->lock));
+    flag = library_data->type==RCLIB_DB_LIBRARY_TYPE_MUSIC &&
+        !(library_data->gain_flags & (RCLIB_DB_GAIN_FLAG_TRACK |
+        RCLIB_DB_GAIN_FLAG_ANALYZED));
+    g_rw_lock_reader_unlock(&(library_data->lock));
+    return flag;
+}
+
+static gboolean rclib_db_gain_schedule_cb(gpointer data)
+{
+    RCLibDbPrivate *priv = (RCLibDbPrivate *)data;
+    RCLibDbLibraryData *library_data;
+    GHashTableIter iter;
+    const gchar *uri;
+    priv->gain_schedule_id = 0;
+    if(!priv->gain_analysis_flag || priv->gain_pool==NULL) return FALSE;
+    g_rw_lock_reader_lock(&(priv->library_rw_lock));
+    g_hash_table_iter_init(&iter, priv->library_table);
+    while(g_hash_table_iter_next(&iter, (gpointer *)&uri,
+        (gpointer *)&library_data))
+    {
+        if(library_data==NULL || g_hash_table_contains(
+            priv->gain_pending_table, uri))
+            continue;
+        if(!rclib_db_gain_need_analysis(library_data)) continue;
+        g_hash_table_add(priv->gain_pending_table, g_strdup(uri));
+        g_thread_pool_push(priv->gain_pool, g_strdup(uri), NULL);
+    }
+    g_rw_lock_reader_unlock(&(priv->library_rw_lock));
+    return FALSE;
+}
+
+static void rclib_db_gain_schedule(RCLibDbPrivate *priv)
+{
+    if(!priv->gain_analysis_flag || priv->gain_schedule_id!=0) return;
+    priv->gain_schedule_id = g_timeout_add_seconds_full(G_PRIORITY_LOW,
+        GAIN_SCHEDULE_DELAY, rclib_db_gain_schedule_cb, priv, NULL);
+}
+
+static void rclib_db_gain_library_changed_cb(RCLibDb *db, const gchar *uri,
+    gpointer data)
+{
+    RCLibDbPrivate *priv = (RCLibDbPrivate *)data;
+    if(priv==NULL || priv->gain_pending_table==NULL) return;
+
+    /* Ignore the changes made by the analysis itself. */
+    if(uri!=NULL && g_hash_table_contains(priv->gain_pending_table, uri))
+        return;
+    rclib_db_gain_schedule(priv);
+}
+
+gboolean _rclib_db_instance_init_gain(RCLibDb *db, RCLibDbPrivate *priv)
+{
+    if(db==NULL || priv==NULL) return FALSE;
+
+    /* GHashTable<gchar *, gchar *> */
+    priv->gain_pending_table = g_hash_table_new_full(g_str_hash,
+        g_str_equal, g_free, NULL);
+    priv->gain_pool = g_thread_pool_new(rclib_db_gain_thread_cb, priv, 1,
+        FALSE, NULL);
+    priv->gain_work_flag = TRUE;
+    priv->gain_analysis_flag = TRUE;
+    priv->gain_schedule_id = 0;
+    g_signal_connect(db, "library-added",
+        G_CALLBACK(rclib_db_gain_library_changed_cb), priv);
+    g_signal_connect(db, "library-changed",
+        G_CALLBACK(rclib_db_gain_library_changed_cb), priv);
+    return TRUE;
+}
+
+void _rclib_db_instance_finalize_gain(RCLibDbPrivate *priv)
+{
+    if(priv==NULL || priv->gain_pending_table==NULL) return;
+    priv->gain_work_flag = FALSE;
+    if(priv->gain_schedule_id>0)
+        g_source_remove(priv->gain_schedule_id);
+    priv->gain_schedule_id = 0;
+    if(priv->gain_pool!=NULL)
+        g_thread_pool_free(priv->gain_pool, FALSE, TRUE);
+    priv->gain_pool = NULL;
+    g_hash_table_destroy(priv->gain_pending_table);
+    priv->gain_pending_table = NULL;
+}
+
+/**
+ * rclib_db_library_set_gain_analysis:
+ * @enabled: whether to measure the loudness of the library items
+ *
+ * Set whether to measure the loudness of the library items which have
+ * no ReplayGain tags in background. The measured gain is stored in
+ * the library item, so that the player can use it as the track gain.
+ * Must be called in main thread.
+ */
+
+void rclib_db_library_set_gain_analysis(gboolean enabled)
+{
+    RCLibDbPrivate *priv;
+    GObject *instance;
+    instance = rclib_db_get_instance();
+    if(instance==NULL) return;
+    priv = RCLIB_DB(instance)->priv;
+    if(priv==NULL || priv->gain_pending_table==NULL) return;
+    enabled = enabled ? TRUE : FALSE;
+    if(priv->gain_analysis_flag==enabled) return;
+    priv->gain_analysis_flag = enabled;
+    if(enabled)
+        rclib_db_gain_schedule(priv);
+    else if(priv->gain_schedule_id>0)
+    {
+        g_source_remove(priv->gain_schedule_id);
+        priv->gain_schedule_id = 0;
+    }
+}
+
+/**
+ * rclib_db_library_get_gain_analysis:
+ *
+ * Get whether the loudness of the library items which have no
+ * ReplayGain tags is measured in background.
+ *
+ * Returns: Whether the loudness analysis is enabled.
+ */
+
+gboolean rclib_db_library_get_gain_analysis()
+{
+    RCLibDbPrivate *priv;
+    GObject *instance;
+    instance = rclib_db_get_instance();
+    if(instance==NULL) return FALSE;
+    priv = RCLIB_DB(instance)->priv;
+    if(priv==NULL) return FALSE;
+    return priv->gain_analysis_flag;
+}
+
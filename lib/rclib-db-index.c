@@ -0,0 +1,452 @@
+/*
+ * RhythmCat Library Music Database Module (Library Index Part.)
+ * The trigram index of the library for searching.
+ *
+ * rclib-db-index.c
+ * This file is part of RhythmCat Library (LibRhythmCat)
+ *
+ * Copyright (C) 2012 - SuperCat, license: GPL v3
+ *
+ * RhythmCat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RhythmCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RhythmCat; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include "rclib-db.h"
+#include "rclib-db-priv.h"
+#include "rclib-common.h"
+#include "rclib-tag.h"
+
+/*
+ * The title, artist, album and genre of each library item are split
+ * into byte trigrams, and each trigram maps to the ascending list of
+ * the IDs of the items which contain it. An item which contains a
+ * sub-string must contain all trigrams of the sub-string, so the LIKE
+ * and PREFIX conditions can be answered by intersecting these lists,
+ * and the query plan is then evaluated only on the found items.
+ *
+ * The IDs are never reused: when an item is changed it gets a new ID,
+ * and the old one is only marked as dead, so the lists stay sorted by
+ * appending. The index is rebuilt when too many IDs are dead. It is
+ * built on the first lookup, and kept up to date by the library
+ * signals after that.
+ */
+
+#define RCLIB_DB_INDEX_FIELD_TITLE 0
+#define RCLIB_DB_INDEX_FIELD_ARTIST 1
+#define RCLIB_DB_INDEX_FIELD_ALBUM 2
+#define RCLIB_DB_INDEX_FIELD_GENRE 3
+
+static const guint db_index_dead_limit = 4096;
+
+static inline guint32 rclib_db_index_key(guint field, const gchar *str)
+{
+    return (field << 24) | ((guint32)(guchar)str[0] << 16) |
+        ((guint32)(guchar)str[1] << 8) | (guint32)(guchar)str[2];
+}
+
+static gint rclib_db_index_field_from_propid(guint propid)
+{
+    switch(propid)
+    {
+        case RCLIB_DB_QUERY_DATA_TYPE_TITLE:
+            return RCLIB_DB_INDEX_FIELD_TITLE;
+        case RCLIB_DB_QUERY_DATA_TYPE_ARTIST:
+            return RCLIB_DB_INDEX_FIELD_ARTIST;
+        case RCLIB_DB_QUERY_DATA_TYPE_ALBUM:
+            return RCLIB_DB_INDEX_FIELD_ALBUM;
+        case RCLIB_DB_QUERY_DATA_TYPE_GENRE:
+            return RCLIB_DB_INDEX_FIELD_GENRE;
+        default:
+            break;
+    }
+    return -1;
+}
+
+static void rclib_db_index_list_free(GArray *list)
+{
+    if(list==NULL) return;
+    g_array_free(list, TRUE);
+}
+
+static void rclib_db_index_add_string(RCLibDbPrivate *priv, guint field,
+    const gchar *str, guint32 id)
+{
+    GArray *list;
+    guint32 key;
+    gsize i, len;
+    if(str==NULL) return;
+    len = strlen(str);
+    for(i=0;i+3<=len;i++)
+    {
+        key = rclib_db_index_key(field, str+i);
+        list = g_hash_table_lookup(priv->library_index_table,
+            GUINT_TO_POINTER(key));
+        if(list==NULL)
+        {
+            list = g_array_new(FALSE, FALSE, sizeof(guint32));
+            g_hash_table_insert(priv->library_index_table,
+                GUINT_TO_POINTER(key), list);
+        }
+        else if(list->len>0 && g_array_index(list, guint32,
+            list->len-1)==id)
+            continue;
+        g_array_append_val(list, id);
+    }
+}
+
+static void rclib_db_index_add(RCLibDbPrivate *priv,
+    RCLibDbLibraryData *library_data)
+{
+    RCLibDbLibraryDataView view;
+    gchar *name = NULL;
+    const gchar *title;
+    guint32 id;
+    rclib_db_library_data_view_begin(library_data, &view);
+    if(view.uri==NULL)
+    {
+        rclib_db_library_data_view_end(library_data, &view);
+        return;
+    }
+    id = priv->library_index_items->len;
+    g_ptr_array_add(priv->library_index_items,
+        rclib_db_library_data_ref(library_data));
+    g_hash_table_replace(priv->library_index_id_table, g_strdup(view.uri),
+        GUINT_TO_POINTER(id+1));
+    title = view.title;
+    if(title==NULL || *title=='\0')
+    {
+        name = rclib_tag_get_name_from_uri(view.uri);
+        title = name;
+    }
+    rclib_db_index_add_string(priv, RCLIB_DB_INDEX_FIELD_TITLE, title, id);
+    rclib_db_index_add_string(priv, RCLIB_DB_INDEX_FIELD_ARTIST,
+        view.artist, id);
+    rclib_db_index_add_string(priv, RCLIB_DB_INDEX_FIELD_ALBUM,
+        view.album, id);
+    rclib_db_index_add_string(priv, RCLIB_DB_INDEX_FIELD_GENRE,
+        view.genre, id);
+    rclib_db_library_data_view_end(library_data, &view);
+    g_free(name);
+}
+
+static void rclib_db_index_clear(RCLibDbPrivate *priv)
+{
+    g_hash_table_remove_all(priv->library_index_table);
+    g_hash_table_remove_all(priv->library_index_id_table);
+    g_ptr_array_set_size(priv->library_index_items, 0);
+    priv->library_index_dead = 0;
+    priv->library_index_valid = FALSE;
+}
+
+static void rclib_db_index_remove(RCLibDbPrivate *priv, const gchar *uri)
+{
+    gpointer value;
+    RCLibDbLibraryData **item;
+    value = g_hash_table_lookup(priv->library_index_id_table, uri);
+    if(value==NULL) return;
+    item = (RCLibDbLibraryData **)&g_ptr_array_index(
+        priv->library_index_items, GPOINTER_TO_UINT(value)-1);
+    if(*item!=NULL)
+    {
+        rclib_db_library_data_unref(*item);
+        *item = NULL;
+        priv->library_index_dead++;
+    }
+    g_hash_table_remove(priv->library_index_id_table, uri);
+    if(priv->library_index_dead>db_index_dead_limit &&
+        priv->library_index_dead>priv->library_index_items->len / 2)
+        rclib_db_index_clear(priv);
+}
+
+/* The library read lock must be held by the caller. */
+
+static void rclib_db_index_build(RCLibDbPrivate *priv)
+{
+    GHashTableIter iter;
+    RCLibDbLibraryData *library_data;
+    rclib_db_index_clear(priv);
+    g_hash_table_iter_init(&iter, priv->library_table);
+    while(g_hash_table_iter_next(&iter, NULL, (gpointer *)&library_data))
+    {
+        if(library_data==NULL) continue;
+        rclib_db_index_add(priv, library_data);
+    }
+    priv->library_index_valid = TRUE;
+}
+
+static void rclib_db_index_library_added_cb(RCLibDb *db, const gchar *uri,
+    gpointer data)
+{
+    RCLibDbPrivate *priv = (RCLibDbPrivate *)data;
+    RCLibDbLibraryData *library_data;
+    if(priv==NULL || uri==NULL) return;
+    library_data = rclib_db_library_get_data(uri);
+    g_rw_lock_writer_lock(&(priv->library_index_lock));
+    if(priv->library_index_valid)
+    {
+        rclib_db_index_remove(priv, uri);
+        if(priv->library_index_valid && library_data!=NULL)
+            rclib_db_index_add(priv, library_data);
+    }
+    g_rw_lock_writer_unlock(&(priv->library_index_lock));
+    if(library_data!=NULL)
+        rclib_db_library_data_unref(library_data);
+}
+
+static void rclib_db_index_library_deleted_cb(RCLibDb *db,
+    const gchar *uri, gpointer data)
+{
+    RCLibDbPrivate *priv = (RCLibDbPrivate *)data;
+    if(priv==NULL || uri==NULL) return;
+    g_rw_lock_writer_lock(&(priv->library_index_lock));
+    if(priv->library_index_valid)
+        rclib_db_index_remove(priv, uri);
+    g_rw_lock_writer_unlock(&(priv->library_index_lock));
+}
+
+static inline void rclib_db_index_list_intersect(GArray *target,
+    const GArray *list)
+{
+    guint i = 0, j = 0, k = 0;
+    guint32 a, b;
+    while(i<target->len && j<list->len)
+    {
+        a = g_array_index(target, guint32, i);
+        b = g_array_index(list, guint32, j);
+        if(a<b) i++;
+        else if(a>b) j++;
+        else
+        {
+            g_array_index(target, guint32, k) = a;
+            i++;
+            j++;
+            k++;
+        }
+    }
+    g_array_set_size(target, k);
+}
+
+static GArray *rclib_db_index_list_union(GArray *list1, GArray *list2)
+{
+    GArray *list;
+    guint i = 0, j = 0;
+    guint32 a, b;
+    list = g_array_sized_new(FALSE, FALSE, sizeof(guint32),
+        list1->len + list2->len);
+    while(i<list1->len || j<list2->len)
+    {
+        a = i<list1->len ? g_array_index(list1, guint32, i) : G_MAXUINT32;
+        b = j<list2->len ? g_array_index(list2, guint32, j) : G_MAXUINT32;
+        if(i<list1->len && (j>=list2->len || a<=b))
+        {
+            g_array_append_val(list, a);
+            if(j<list2->len && a==b) j++;
+            i++;
+        }
+        else
+        {
+            g_array_append_val(list, b);
+            j++;
+        }
+    }
+    g_array_free(list1, TRUE);
+    g_array_free(list2, TRUE);
+    return list;
+}
+
+static gint rclib_db_index_list_compare(gconstpointer a, gconstpointer b)
+{
+    const GArray *list1 = *(const GArray **)a;
+    const GArray *list2 = *(const GArray **)b;
+    if(list1->len<list2->len) return -1;
+    if(list1->len>list2->len) return 1;
+    return 0;
+}
+
+/* Get the ascending IDs of the items which contain all trigrams of
+ * the needle. */
+
+static GArray *rclib_db_index_term_lookup(RCLibDbPrivate *priv, guint field,
+    const gchar *needle, gsize needle_len)
+{
+    GPtrArray *lists;
+    GArray *list, *result;
+    gsize i;
+    lists = g_ptr_array_new();
+    for(i=0;i+3<=needle_len;i++)
+    {
+        list = g_hash_table_lookup(priv->library_index_table,
+            GUINT_TO_POINTER(rclib_db_index_key(field, needle+i)));
+        if(list==NULL)
+        {
+            g_ptr_array_free(lists, TRUE);
+            return g_array_new(FALSE, FALSE, sizeof(guint32));
+        }
+        g_ptr_array_add(lists, list);
+    }
+    g_ptr_array_sort(lists, rclib_db_index_list_compare);
+    list = g_ptr_array_index(lists, 0);
+    result = g_array_sized_new(FALSE, FALSE, sizeof(guint32), list->len);
+    g_array_append_vals(result, list->data, list->len);
+    for(i=1;i<lists->len && result->len>0;i++)
+        rclib_db_index_list_intersect(result, g_ptr_array_index(lists, i));
+    g_ptr_array_free(lists, TRUE);
+    return result;
+}
+
+/*
+ * Look up the items which may satisfy the plan in the index. Return
+ * NULL if the plan cannot be answered by the index, that is, some OR
+ * group of the plan has no LIKE or PREFIX condition on the title,
+ * artist, album or genre with a needle of at least 3 bytes. Otherwise
+ * return an array of the referenced items, which may be changed or
+ * deleted from the library already, so the caller must check them and
+ * evaluate the plan on them. The library read lock must be held by the
+ * caller.
+ */
+
+GPtrArray *_rclib_db_library_index_lookup(RCLibDbPrivate *priv,
+    const RCLibDbQueryPlan *plan)
+{
+    GArray *terms, *group_list, *term_list, *result_list = NULL;
+    GPtrArray *result;
+    const RCLibDbQueryPlanTerm *term;
+    RCLibDbLibraryData *library_data;
+    guint group_count = 0;
+    guint i, group;
+    gint field;
+    gboolean usable_flag;
+    if(priv==NULL || plan==NULL) return NULL;
+    terms = _rclib_db_query_plan_get_terms(plan, &group_count);
+    for(group=0;group<group_count;group++)
+    {
+        usable_flag = FALSE;
+        for(i=0;i<terms->len && !usable_flag;i++)
+        {
+            term = &g_array_index(terms, RCLibDbQueryPlanTerm, i);
+            usable_flag = (term->group==group && term->needle_len>=3 &&
+                rclib_db_index_field_from_propid(term->propid)>=0);
+        }
+        if(!usable_flag) break;
+    }
+    if(group_count==0 || group<group_count)
+    {
+        g_array_free(terms, TRUE);
+        return NULL;
+    }
+    g_rw_lock_reader_lock(&(priv->library_index_lock));
+    if(!priv->library_index_valid)
+    {
+        g_rw_lock_reader_unlock(&(priv->library_index_lock));
+        g_rw_lock_writer_lock(&(priv->library_index_lock));
+        if(!priv->library_index_valid)
+            rclib_db_index_build(priv);
+        g_rw_lock_writer_unlock(&(priv->library_index_lock));
+        g_rw_lock_reader_lock(&(priv->library_index_lock));
+    }
+    for(group=0;group<group_count;group++)
+    {
+        group_list = NULL;
+        for(i=0;i<terms->len;i++)
+        {
+            term = &g_array_index(terms, RCLibDbQueryPlanTerm, i);
+            field = rclib_db_index_field_from_propid(term->propid);
+            if(term->group!=group || term->needle_len<3 || field<0)
+                continue;
+            term_list = rclib_db_index_term_lookup(priv, field,
+                term->needle, term->needle_len);
+            if(group_list!=NULL)
+            {
+                rclib_db_index_list_intersect(group_list, term_list);
+                g_array_free(term_list, TRUE);
+            }
+            else
+                group_list = term_list;
+            if(group_list->len==0) break;
+        }
+        if(result_list!=NULL)
+            result_list = rclib_db_index_list_union(result_list, group_list);
+        else
+            result_list = group_list;
+    }
+    result = g_ptr_array_new_with_free_func((GDestroyNotify)
+        rclib_db_library_data_unref);
+    for(i=0;i<result_list->len;i++)
+    {
+        library_data = g_ptr_array_index(priv->library_index_items,
+            g_array_index(result_list, guint32, i));
+        if(library_data==NULL) continue;
+        g_ptr_array_add(result, rclib_db_library_data_ref(library_data));
+    }
+    g_rw_lock_reader_unlock(&(priv->library_index_lock));
+    g_array_free(result_list, TRUE);
+    g_array_free(terms, TRUE);
+    return result;
+}
+
+/*
+ * Drop the index, it will be built again on the next lookup. Call this
+ * after the library is loaded without the library signals.
+ */
+
+void _rclib_db_library_index_invalidate(RCLibDbPrivate *priv)
+{
+    if(priv==NULL || priv->library_index_table==NULL) return;
+    g_rw_lock_writer_lock(&(priv->library_index_lock));
+    rclib_db_index_clear(priv);
+    g_rw_lock_writer_unlock(&(priv->library_index_lock));
+}
+
+gboolean _rclib_db_instance_init_index(RCLibDb *db, RCLibDbPrivate *priv)
+{
+    if(db==NULL || priv==NULL) return FALSE;
+    g_rw_lock_init(&(priv->library_index_lock));
+
+    /* GHashTable<guint32, GArray<guint32>> */
+    priv->library_index_table = g_hash_table_new_full(g_direct_hash,
+        g_direct_equal, NULL, (GDestroyNotify)rclib_db_index_list_free);
+
+    /* GPtrArray<RCLibDbLibraryData *> */
+    priv->library_index_items = g_ptr_array_new_with_free_func(
+        (GDestroyNotify)rclib_db_library_data_unref);
+
+    /* GHashTable<gchar *, guint> */
+    priv->library_index_id_table = g_hash_table_new_full(g_str_hash,
+        g_str_equal, g_free, NULL);
+
+    priv->library_index_valid = FALSE;
+    g_signal_connect(db, "library-added",
+        G_CALLBACK(rclib_db_index_library_added_cb), priv);
+    g_signal_connect(db, "library-changed",
+        G_CALLBACK(rclib_db_index_library_added_cb), priv);
+    g_signal_connect(db, "library-deleted",
+        G_CALLBACK(rclib_db_index_library_deleted_cb), priv);
+    return TRUE;
+}
+
+void _rclib_db_instance_finalize_index(RCLibDbPrivate *priv)
+{
+    if(priv==NULL || priv->library_index_table==NULL) return;
+    g_rw_lock_writer_lock(&(priv->library_index_lock));
+    g_hash_table_destroy(priv->library_index_table);
+    g_hash_table_destroy(priv->library_index_id_table);
+    g_ptr_array_free(priv->library_index_items, TRUE);
+    priv->library_index_table = NULL;
+    priv->library_index_id_table = NULL;
+    priv->library_index_items = NULL;
+    priv->library_index_valid = FALSE;
+    g_rw_lock_writer_unlock(&(priv->library_index_lock));
+    g_rw_lock_clear(&(priv->library_index_lock));
+}
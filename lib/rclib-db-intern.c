@@ -0,0 +1,160 @@
+/*
+ * RhythmCat Library Music Database Module (String Pool Part.)
+ * Share the repeated strings between the database records.
+ *
+ * rclib-db-intern.c
+ * This file is part of RhythmCat Library (LibRhythmCat)
+ *
+ * Copyright (C) 2012 - SuperCat, license: GPL v3
+ *
+ * RhythmCat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RhythmCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RhythmCat; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include "rclib-db.h"
+#include "rclib-db-priv.h"
+#include "rclib-common.h"
+
+/*
+ * The artist, album, file type and genre fields of the library and
+ * playlist records are stored in this pool. Each string is stored only
+ * once with a reference count, and it is freed when the last record
+ * which uses it releases it. The pool is not bound to the database
+ * instance, because the records may live longer than the database.
+ */
+
+typedef struct RCLibDbStringPoolEntry
+{
+    gchar *str;
+    guint ref_count;
+}RCLibDbStringPoolEntry;
+
+static GHashTable *db_string_pool_table = NULL;
+static GMutex db_string_pool_mutex;
+static guint64 db_string_pool_ref_count = 0;
+static guint64 db_string_pool_size = 0;
+static guint64 db_string_pool_saved_size = 0;
+
+static void rclib_db_string_pool_entry_free(gpointer data)
+{
+    RCLibDbStringPoolEntry *entry = (RCLibDbStringPoolEntry *)data;
+    if(entry==NULL) return;
+    g_free(entry->str);
+    g_slice_free(RCLibDbStringPoolEntry, entry);
+}
+
+/*
+ * Get the interned copy of the string, and increase its reference count.
+ * The returned string must not be modified, and must be released by
+ * _rclib_db_string_release().
+ */
+
+gchar *_rclib_db_string_intern(const gchar *str)
+{
+    RCLibDbStringPoolEntry *entry;
+    gsize len;
+    if(str==NULL) return NULL;
+    len = strlen(str) + 1;
+    g_mutex_lock(&db_string_pool_mutex);
+    if(db_string_pool_table==NULL)
+    {
+        /* The key is owned by the entry, so it must not be freed by
+         * the table itself. */
+        db_string_pool_table = g_hash_table_new_full(g_str_hash,
+            g_str_equal, NULL, rclib_db_string_pool_entry_free);
+    }
+    entry = g_hash_table_lookup(db_string_pool_table, str);
+    if(entry!=NULL)
+    {
+        entry->ref_count++;
+        db_string_pool_saved_size += len;
+    }
+    else
+    {
+        entry = g_slice_new(RCLibDbStringPoolEntry);
+        entry->str = g_strdup(str);
+        entry->ref_count = 1;
+        g_hash_table_insert(db_string_pool_table, entry->str, entry);
+        db_string_pool_size += len;
+    }
+    db_string_pool_ref_count++;
+    g_mutex_unlock(&db_string_pool_mutex);
+    return entry->str;
+}
+
+/*
+ * Release a string returned by _rclib_db_string_intern(), it is freed
+ * when its reference count drops to 0.
+ */
+
+void _rclib_db_string_release(gchar *str)
+{
+    RCLibDbStringPoolEntry *entry = NULL;
+    gsize len;
+    if(str==NULL) return;
+    len = strlen(str) + 1;
+    g_mutex_lock(&db_string_pool_mutex);
+    if(db_string_pool_table!=NULL)
+        entry = g_hash_table_lookup(db_string_pool_table, str);
+    if(entry==NULL || entry->str!=str)
+    {
+        g_mutex_unlock(&db_string_pool_mutex);
+        g_warning("The string %p is not in the string pool!", str);
+        return;
+    }
+    if(entry->ref_count>1)
+    {
+        entry->ref_count--;
+        db_string_pool_saved_size -= len;
+    }
+    else
+    {
+        g_hash_table_remove(db_string_pool_table, str);
+        db_string_pool_size -= len;
+    }
+    db_string_pool_ref_count--;
+    g_mutex_unlock(&db_string_pool_mutex);
+}
+
+/**
+ * rclib_db_string_pool_get_stats:
+ * @count: (out) (allow-none): return the number of the distinct strings
+ *     in the pool
+ * @refs: (out) (allow-none): return the number of the references to the
+ *     strings in the pool
+ * @size: (out) (allow-none): return the memory used by the strings in
+ *     the pool, in bytes
+ * @saved: (out) (allow-none): return the memory saved by sharing the
+ *     strings, in bytes
+ *
+ * Get the statistics of the string pool, which stores the artist, album,
+ * file type and genre strings of the library and playlist items. MT safe.
+ */
+
+void rclib_db_string_pool_get_stats(guint *count, guint64 *refs,
+    guint64 *size, guint64 *saved)
+{
+    g_mutex_lock(&db_string_pool_mutex);
+    if(count!=NULL)
+    {
+        *count = db_string_pool_table!=NULL ?
+            g_hash_table_size(db_string_pool_table) : 0;
+    }
+    if(refs!=NULL) *refs = db_string_pool_ref_count;
+    if(size!=NULL) *size = db_string_pool_size;
+    if(saved!=NULL) *saved = db_string_pool_saved_size;
+    g_mutex_unlock(&db_string_pool_mutex);
+}
+
@@ -32,6 +32,17 @@
 #include "rclib-util.h"
 #include "rclib-marshal.h"
 
+/* The query thread hands the matched items to the main loop in chunks of
+ * at most this number of items, or after this time (in microseconds) if
+ * the items are found slowly. The main loop also merges at most this
+ * number of items in this time into the loaded items on each idle call. */
+#define RCLIB_DB_LIBRARY_QUERY_CHUNK_SIZE 512
+#define RCLIB_DB_LIBRARY_QUERY_CHUNK_TIME 8000
+
+/* The library is only scanned in parallel if each partition has at least
+ * this number of items. */
+#define RCLIB_DB_LIBRARY_SCAN_PARTITION_MIN 2048
+
 enum
 {
     SIGNAL_LIBRARY_QUERY_RESULT_ADDED,
@@ -42,6 +53,7 @@ enum
     SIGNAL_LIBRARY_QUERY_RESULT_PROP_DELETE,
     SIGNAL_LIBRARY_QUERY_RESULT_PROP_CHANGED,
     SIGNAL_LIBRARY_QUERY_RESULT_PROP_REORDERED,
+    SIGNAL_LIBRARY_QUERY_RESULT_RESET,
     SIGNAL_LIBRARY_QUERY_RESULT_LAST
 };
 
@@ -63,6 +75,7 @@ typedef struct _RCLibDbLibraryQueryResultPropItem
     GHashTable *prop_uri_table;
     guint count;
     gboolean sort_direction;
+    gboolean facet_flag;
 }RCLibDbLibraryQueryResultPropItem;
 
 typedef struct _RCLibDbLibraryQueryResultPropData
@@ -117,6 +130,48 @@ static inline RCLibDbLibraryDataType rclib_db_library_query_type_to_data_type(
     return RCLIB_DB_LIBRARY_DATA_TYPE_NONE;
 }
 
+static inline RCLibDbQueryDataType rclib_db_library_data_type_to_query_type(
+    RCLibDbLibraryDataType data_type)
+{
+    switch(data_type)
+    {
+        case RCLIB_DB_LIBRARY_DATA_TYPE_URI:
+            return RCLIB_DB_QUERY_DATA_TYPE_URI;
+        case RCLIB_DB_LIBRARY_DATA_TYPE_TITLE:
+            return RCLIB_DB_QUERY_DATA_TYPE_TITLE;
+        case RCLIB_DB_LIBRARY_DATA_TYPE_ARTIST:
+            return RCLIB_DB_QUERY_DATA_TYPE_ARTIST;
+        case RCLIB_DB_LIBRARY_DATA_TYPE_ALBUM:
+            return RCLIB_DB_QUERY_DATA_TYPE_ALBUM;
+        case RCLIB_DB_LIBRARY_DATA_TYPE_FTYPE:
+            return RCLIB_DB_QUERY_DATA_TYPE_FTYPE;
+        case RCLIB_DB_LIBRARY_DATA_TYPE_LENGTH:
+            return RCLIB_DB_QUERY_DATA_TYPE_LENGTH;
+        case RCLIB_DB_LIBRARY_DATA_TYPE_TRACKNUM:
+            return RCLIB_DB_QUERY_DATA_TYPE_TRACKNUM;
+        case RCLIB_DB_LIBRARY_DATA_TYPE_YEAR:
+            return RCLIB_DB_QUERY_DATA_TYPE_YEAR;
+        case RCLIB_DB_LIBRARY_DATA_TYPE_RATING:
+            return RCLIB_DB_QUERY_DATA_TYPE_RATING;
+        case RCLIB_DB_LIBRARY_DATA_TYPE_GENRE:
+            return RCLIB_DB_QUERY_DATA_TYPE_GENRE;
+        default:
+            break;
+    }
+    return RCLIB_DB_QUERY_DATA_TYPE_NONE;
+}
+
+static inline gboolean rclib_db_library_data_query_plan(
+    RCLibDbLibraryData *library_data, const RCLibDbQueryPlan *plan)
+{
+    RCLibDbLibraryDataView view;
+    gboolean ret;
+    rclib_db_library_data_view_begin(library_data, &view);
+    ret = _rclib_db_query_plan_eval(plan, &view);
+    rclib_db_library_data_view_end(library_data, &view);
+    return ret;
+}
+
 static gint rclib_db_variant_sort_asc_func(GSequenceIter *a, GSequenceIter *b,
     gpointer user_data)
 {
@@ -141,166 +196,17 @@ static gint rclib_db_library_query_result_item_compare_func(gconstpointer a,
     gconstpointer b, gpointer data)
 {
     RCLibDbLibraryQueryResultPrivate *priv;
-    gint ret = 0;
-    GType column_type;
-    GVariant *variant1, *variant2;
-    RCLibDbLibraryData *data1 = (RCLibDbLibraryData *)a;
-    RCLibDbLibraryData *data2 = (RCLibDbLibraryData *)b;
+    gint ret;
     priv = (RCLibDbLibraryQueryResultPrivate *)data;
     if(data==NULL) return 0;
-    switch(priv->sort_column)
-    {
-        case RCLIB_DB_LIBRARY_DATA_TYPE_TITLE:
-        case RCLIB_DB_LIBRARY_DATA_TYPE_ARTIST:
-        case RCLIB_DB_LIBRARY_DATA_TYPE_ALBUM:
-        case RCLIB_DB_LIBRARY_DATA_TYPE_FTYPE:
-        case RCLIB_DB_LIBRARY_DATA_TYPE_GENRE:
-        {
-            column_type = G_TYPE_STRING;
-            break;
-        }
-        case RCLIB_DB_LIBRARY_DATA_TYPE_LENGTH:
-        {
-            column_type = G_TYPE_INT64;
-            break;
-        }
-        case RCLIB_DB_LIBRARY_DATA_TYPE_TRACKNUM:
-        case RCLIB_DB_LIBRARY_DATA_TYPE_YEAR:
-        {
-            column_type = G_TYPE_INT;
-            break;
-        }
-        case RCLIB_DB_LIBRARY_DATA_TYPE_RATING:
-        {
-            column_type = G_TYPE_FLOAT;
-            break;
-        }
-        default:
-        {
-            g_warning("Error column type: %u", priv->sort_column);
-            return 0;
-            break;
-        }
-    }
-    switch(column_type)
-    {
-        case G_TYPE_STRING:
-        {
-            gchar *vstr = NULL;
-            gchar *cstr = NULL;
-            gchar *uri = NULL;
-            if(data1!=NULL)
-            {
-                rclib_db_library_data_get(data1, priv->sort_column, &vstr,
-                    RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                if(priv->sort_column==RCLIB_DB_LIBRARY_DATA_TYPE_TITLE &&
-                    (vstr==NULL || strlen(vstr)==0))
-                {
-                    rclib_db_library_data_get(data1,
-                        RCLIB_DB_LIBRARY_DATA_TYPE_URI, &uri,
-                        RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                    if(uri!=NULL)
-                        vstr = rclib_tag_get_name_from_uri(uri);
-                    g_free(uri);
-                }
-            }                
-            if(vstr==NULL) vstr = g_strdup("");
-            cstr = g_utf8_collate_key(vstr, -1);
-            variant1 = g_variant_new_string(cstr);
-            g_free(cstr);
-            g_free(vstr);
-            vstr = NULL;
-            if(data2!=NULL)
-            {
-                rclib_db_library_data_get(data2, priv->sort_column, &vstr,
-                    RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                if(priv->sort_column==RCLIB_DB_LIBRARY_DATA_TYPE_TITLE &&
-                    (vstr==NULL || strlen(vstr)==0))
-                {
-                    rclib_db_library_data_get(data2,
-                        RCLIB_DB_LIBRARY_DATA_TYPE_URI, &uri,
-                        RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                    if(uri!=NULL)
-                        vstr = rclib_tag_get_name_from_uri(uri);
-                    g_free(uri);
-                }
-            }                
-            if(vstr==NULL) vstr = g_strdup("");
-            cstr = g_utf8_collate_key(vstr, -1);
-            variant2 = g_variant_new_string(cstr);
-            g_free(cstr);
-            g_free(vstr);
-            break;
-        }
-        case G_TYPE_INT:
-        {
-            gint vint = 0;
-            if(data1!=NULL)
-            {
-                rclib_db_library_data_get(data1, priv->sort_column, &vint,
-                    RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-            }
-            variant1 = g_variant_new_int32(vint);
-            vint = 0;
-            if(data2!=NULL)
-            {
-                rclib_db_library_data_get(data2, priv->sort_column, &vint,
-                    RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-            }
-            variant2 = g_variant_new_int32(vint);
-            break;
-        }
-        case G_TYPE_INT64:
-        {
-            gint64 vint64 = 0;
-            if(data1!=NULL)
-            {
-                rclib_db_library_data_get(data1, priv->sort_column, &vint64,
-                    RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-            }
-            variant1 = g_variant_new_int64(vint64);
-            vint64 = 0;
-            if(data2!=NULL)
-            {
-                rclib_db_library_data_get(data2, priv->sort_column, &vint64,
-                    RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-            }
-            variant2 = g_variant_new_int64(vint64);
-            break;
-        }
-        case G_TYPE_FLOAT:
-        {
-            gfloat vfloat = 0;
-            if(data1!=NULL)
-            {
-                rclib_db_library_data_get(data1, priv->sort_column, &vfloat,
-                    RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-            }
-            variant1 = g_variant_new_double(vfloat);
-            if(data2!=NULL)
-            {
-                rclib_db_library_data_get(data2, priv->sort_column, &vfloat,
-                    RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-            }
-            variant2 = g_variant_new_double(vfloat);
-            break;
-        }
-        default:
-        {
-            variant1 = g_variant_new_boolean(FALSE);
-            variant2 = g_variant_new_boolean(FALSE);
-            g_warning("Wrong column data type, this should not happen!");
-            break;
-        }
-    }
-    ret = g_variant_compare(variant1, variant2);
+    ret = _rclib_db_sort_data_compare((gpointer)a, (gpointer)b, FALSE,
+        priv->sort_columns, priv->sort_column_num);
     if(priv->sort_direction)
         return -ret;
     else
         return ret;
 }
 
-
 static gint rclib_db_library_query_result_prop_item_compare_func(
     gconstpointer a, gconstpointer b, gpointer data)
 {
@@ -380,141 +286,526 @@ static void rclib_db_library_query_result_prop_item_free(
     g_free(item);
 }
 
-static gboolean rclib_db_library_changed_entry_idle_cb(gpointer data)
+static inline gboolean rclib_db_library_query_order_equal(
+    const RCLibDbLibraryQueryOrder *order1,
+    const RCLibDbLibraryQueryOrder *order2)
 {
-    GObject *instance;
-    RCLibDbPrivate *priv;
-    gchar *uri = (gchar *)data;
-    if(data==NULL) return FALSE;
-    instance = rclib_db_get_instance();
-    if(instance==NULL) return FALSE;
-    priv = RCLIB_DB(instance)->priv;
-    if(priv==NULL) return FALSE;
-    g_rw_lock_reader_lock(&(priv->library_rw_lock));
-    if(!g_hash_table_contains(priv->library_table, uri)) return FALSE;
-    g_signal_emit_by_name(instance, "library-changed", uri);
-    g_free(uri);
-    g_rw_lock_reader_unlock(&(priv->library_rw_lock));
-    return FALSE;
+    guint i;
+    if(order1==NULL || order2==NULL) return FALSE;
+    if(order1->column_num==0 || order1->column_num!=order2->column_num)
+        return FALSE;
+    if(order1->direction!=order2->direction) return FALSE;
+    for(i=0;i<order1->column_num;i++)
+    {
+        if(order1->columns[i]!=order2->columns[i]) return FALSE;
+    }
+    return TRUE;
 }
 
-static gboolean rclib_db_library_deleted_entry_idle_cb(gpointer data)
+static gint rclib_db_library_query_order_compare_func(gconstpointer a,
+    gconstpointer b, gpointer data)
 {
-    GObject *instance;
-    RCLibDbPrivate *priv;
-    gchar *uri = (gchar *)data;
-    if(data==NULL) return FALSE;
-    instance = rclib_db_get_instance();
-    if(instance==NULL) return FALSE;
-    priv = RCLIB_DB(instance)->priv;
-    if(priv==NULL) return FALSE;
-    g_signal_emit_by_name(instance, "library-deleted", uri);
-    g_free(uri);
-    return FALSE;
+    const RCLibDbLibraryQueryOrder *order =
+        (const RCLibDbLibraryQueryOrder *)data;
+    gint ret;
+    if(data==NULL) return 0;
+    ret = _rclib_db_sort_data_compare(*(gpointer *)a, *(gpointer *)b,
+        FALSE, order->columns, order->column_num);
+    if(order->direction)
+        return -ret;
+    else
+        return ret;
 }
 
-static void rclib_db_library_query_result_added_cb(RCLibDb *db,
-    const gchar *uri, gpointer data)
+typedef struct _RCLibDbLibraryQuerySortEntry
 {
-    RCLibDbLibraryQueryResult *object;
-    RCLibDbLibraryQueryResultPrivate *priv;
-    RCLibDbLibraryData *library_data;
+    gpointer data;
+    guint32 mask;
+}RCLibDbLibraryQuerySortEntry;
+
+/*
+ * Sort the items in the order, and move their masks with them if masks
+ * is not NULL. The entries start with the items, so they can be compared
+ * with the same function as the items.
+ */
+
+static void rclib_db_library_query_sort_items(GPtrArray *items,
+    GArray *masks, const RCLibDbLibraryQueryOrder *order)
+{
+    RCLibDbLibraryQuerySortEntry *entries;
+    guint i;
+    if(items==NULL || order==NULL || order->column_num==0) return;
+    if(masks==NULL || masks->len!=items->len)
+    {
+        g_ptr_array_sort_with_data(items,
+            rclib_db_library_query_order_compare_func, (gpointer)order);
+        return;
+    }
+    entries = g_new(RCLibDbLibraryQuerySortEntry, items->len>0 ?
+        items->len : 1);
+    for(i=0;i<items->len;i++)
+    {
+        entries[i].data = g_ptr_array_index(items, i);
+        entries[i].mask = g_array_index(masks, guint32, i);
+    }
+    g_qsort_with_data(entries, items->len,
+        sizeof(RCLibDbLibraryQuerySortEntry),
+        rclib_db_library_query_order_compare_func, (gpointer)order);
+    for(i=0;i<items->len;i++)
+    {
+        items->pdata[i] = entries[i].data;
+        g_array_index(masks, guint32, i) = entries[i].mask;
+    }
+    g_free(entries);
+}
+
+static inline const gchar *rclib_db_library_view_get_prop_string(
+    const RCLibDbLibraryDataView *view, RCLibDbQueryDataType prop_type)
+{
+    const gchar *str = NULL;
+    switch(prop_type)
+    {
+        case RCLIB_DB_QUERY_DATA_TYPE_URI:
+            str = view->uri;
+            break;
+        case RCLIB_DB_QUERY_DATA_TYPE_TITLE:
+            str = view->title;
+            break;
+        case RCLIB_DB_QUERY_DATA_TYPE_ARTIST:
+            str = view->artist;
+            break;
+        case RCLIB_DB_QUERY_DATA_TYPE_ALBUM:
+            str = view->album;
+            break;
+        case RCLIB_DB_QUERY_DATA_TYPE_FTYPE:
+            str = view->ftype;
+            break;
+        case RCLIB_DB_QUERY_DATA_TYPE_GENRE:
+            str = view->genre;
+            break;
+        default:
+            break;
+    }
+    return str!=NULL ? str : "";
+}
+
+/*
+ * Drop all items and property items in the query result without
+ * emitting any signal, the caller should emit the reset signal later.
+ */
+
+static void rclib_db_library_query_result_reset_contents(
+    RCLibDbLibraryQueryResultPrivate *priv)
+{
+    GHashTableIter hash_iter;
     RCLibDbLibraryQueryResultPropItem *prop_item;
-    RCLibDbLibraryQueryResultPropData *prop_data;
-    guint prop_type;
-    GHashTableIter prop_iter;
-    gchar *prop_string;
-    GSequenceIter *iter = NULL;
-    object = (RCLibDbLibraryQueryResult *)data;
-    if(data==NULL || uri==NULL) return;
-    priv = object->priv;
     if(priv==NULL) return;
-    if(priv->query==NULL) return;
-    library_data = rclib_db_library_get_data(uri);
-    if(library_data==NULL) return;
-    if(rclib_db_library_data_query(library_data, priv->query, NULL) &&
-        !g_hash_table_contains(priv->query_uri_table, uri))
+    if(priv->query_iter_table!=NULL)
+        g_hash_table_remove_all(priv->query_iter_table);
+    if(priv->query_uri_table!=NULL)
+        g_hash_table_remove_all(priv->query_uri_table);
+    if(priv->query_sequence!=NULL)
     {
-        if(priv->list_need_sort && priv->query_sequence!=NULL)
-        {
-            iter = g_sequence_insert_sorted(priv->query_sequence, 
-                rclib_db_library_data_ref(library_data),
-                rclib_db_library_query_result_item_compare_func, priv);
-            g_hash_table_replace(priv->query_iter_table, iter, iter);
-        }
-        
-        g_hash_table_replace(priv->query_uri_table, g_strdup(uri), iter);
-        g_signal_emit(object, db_library_query_result_signals[
-            SIGNAL_LIBRARY_QUERY_RESULT_ADDED], 0, uri);
-            
-        g_hash_table_iter_init(&prop_iter, priv->prop_table);
-        while(g_hash_table_iter_next(&prop_iter, (gpointer *)&prop_type,
-            (gpointer *)&prop_item))
+        g_sequence_remove_range(g_sequence_get_begin_iter(
+            priv->query_sequence), g_sequence_get_end_iter(
+            priv->query_sequence));
+    }
+    if(priv->prop_table==NULL) return;
+    g_hash_table_iter_init(&hash_iter, priv->prop_table);
+    while(g_hash_table_iter_next(&hash_iter, NULL, (gpointer *)&prop_item))
+    {
+        if(prop_item==NULL) continue;
+        if(prop_item->prop_iter_table!=NULL)
+            g_hash_table_remove_all(prop_item->prop_iter_table);
+        if(prop_item->prop_name_table!=NULL)
+            g_hash_table_remove_all(prop_item->prop_name_table);
+        if(prop_item->prop_uri_table!=NULL)
+            g_hash_table_remove_all(prop_item->prop_uri_table);
+        if(prop_item->prop_sequence!=NULL)
         {
-            if(prop_item==NULL) continue;
-            if(rclib_db_query_get_query_data_type((RCLibDbQueryDataType)
-                prop_type)!=G_TYPE_STRING)
-            {
-                continue;
-            }
-            prop_string = NULL;
-            rclib_db_library_data_get(library_data,
-                rclib_db_library_query_type_to_data_type(prop_type),
-                &prop_string, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-            if(prop_string==NULL)
-                prop_string = g_strdup("");
-            iter = g_hash_table_lookup(prop_item->prop_name_table,
-                prop_string);
-            if(iter!=NULL)
-            {
-                g_hash_table_insert(prop_item->prop_uri_table, g_strdup(uri),
-                    iter);
-                prop_data = g_sequence_get(iter);
-                prop_data->prop_count++;
-                prop_item->count++;
-                g_signal_emit(object, db_library_query_result_signals[
-                    SIGNAL_LIBRARY_QUERY_RESULT_PROP_CHANGED], 0, prop_type,
-                    prop_string);
-            }
-            else
-            {
-                prop_data = rclib_db_library_query_result_prop_data_new();
-                prop_data->prop_count = 1;
-                prop_item->count++;
-                prop_data->prop_name = g_strdup(prop_string);
-                iter = g_sequence_insert_sorted(prop_item->prop_sequence,
-                    prop_data,
-                    rclib_db_library_query_result_prop_item_compare_func,
-                    priv);
-                g_hash_table_insert(prop_item->prop_iter_table, iter, iter);
-                g_hash_table_insert(prop_item->prop_name_table,
-                    g_strdup(prop_string), iter);
-                g_hash_table_insert(prop_item->prop_uri_table,
-                    g_strdup(uri), iter);
-                g_signal_emit(object, db_library_query_result_signals[
-                    SIGNAL_LIBRARY_QUERY_RESULT_PROP_ADDED], 0, prop_type,
-                    prop_string);
-            }
-            g_free(prop_string);
+            g_sequence_remove_range(g_sequence_get_begin_iter(
+                prop_item->prop_sequence), g_sequence_get_end_iter(
+                prop_item->prop_sequence));
         }
+        prop_item->count = 0;
+        prop_item->facet_flag = FALSE;
     }
-    rclib_db_library_data_unref(library_data);
 }
 
-static void rclib_db_library_query_result_deleted_cb(RCLibDb *db,
-    const gchar *uri, gpointer data)
+static void rclib_db_library_query_result_facet_selection_free(
+    GPtrArray **selection)
 {
-    RCLibDbLibraryQueryResult *object;
-    RCLibDbLibraryQueryResultPrivate *priv;
-    GSequenceIter *iter;
-    GHashTableIter prop_iter;
-    RCLibDbLibraryQueryResultPropItem *prop_item;
-    RCLibDbLibraryQueryResultPropData *prop_data;
-    guint prop_type;
-    object = (RCLibDbLibraryQueryResult *)data;
-    if(data==NULL || uri==NULL) return;
-    priv = object->priv;
-    if(priv==NULL) return;
+    guint i;
+    for(i=0;i<RCLIB_DB_FACET_NUM;i++)
+    {
+        if(selection[i]!=NULL)
+            g_ptr_array_free(selection[i], TRUE);
+        selection[i] = NULL;
+    }
+}
+
+/*
+ * Count the values of the property in the items of the query result
+ * with the facet index, if the queries of the query result and its base
+ * query results only select some genres, artists or albums. Returns
+ * NULL if the facet index can not be used.
+ */
+
+static GArray *rclib_db_library_query_result_facet_lookup(
+    RCLibDbLibraryQueryResult *object, guint prop_type, guint *total)
+{
+    RCLibDbLibraryQueryResult *query_result;
+    RCLibDbLibraryQueryResultPrivate *priv = NULL;
+    GPtrArray *selection[RCLIB_DB_FACET_NUM] = {NULL};
+    GPtrArray *values;
+    GArray *counts = NULL;
+    GObject *instance;
+    gboolean value = FALSE;
+    guint propid = 0;
+    gint facet, selected;
+    facet = _rclib_db_facet_from_propid(prop_type);
+    if(facet<0) return NULL;
+    for(query_result=object;query_result!=NULL;
+        query_result=priv->base_query_result)
+    {
+        priv = query_result->priv;
+        if(priv==NULL || priv->query_plan==NULL) break;
+        if(_rclib_db_query_plan_is_constant(priv->query_plan, &value))
+        {
+            if(!value) break;
+            continue;
+        }
+        values = g_ptr_array_new();
+        if(!_rclib_db_query_plan_get_equals(priv->query_plan, &propid,
+            values))
+        {
+            g_ptr_array_free(values, TRUE);
+            break;
+        }
+        selected = _rclib_db_facet_from_propid(propid);
+        if(selected<0 || selection[selected]!=NULL)
+        {
+            g_ptr_array_free(values, TRUE);
+            break;
+        }
+        selection[selected] = values;
+    }
+    if(query_result==NULL)
+    {
+        instance = rclib_db_get_instance();
+        if(instance!=NULL)
+        {
+            counts = _rclib_db_library_facet_lookup(RCLIB_DB(instance)->priv,
+                selection, facet, total);
+        }
+    }
+    rclib_db_library_query_result_facet_selection_free(selection);
+    return counts;
+}
+
+/*
+ * Fill the property item with the counts from the facet index, without
+ * emitting any signal. The property item is then refreshed from the
+ * facet index after the items are changed, instead of being updated by
+ * each item.
+ */
+
+static void rclib_db_library_query_result_prop_item_fill(
+    RCLibDbLibraryQueryResultPropItem *prop_item, const GArray *counts,
+    guint total)
+{
+    RCLibDbLibraryQueryResultPropData *prop_data;
+    const RCLibDbFacetCount *facet_count;
+    GSequenceIter *iter;
+    guint i;
+    for(i=0;i<counts->len;i++)
+    {
+        facet_count = &g_array_index(counts, RCLibDbFacetCount, i);
+        prop_data = rclib_db_library_query_result_prop_data_new();
+        prop_data->prop_name = g_strdup(facet_count->name);
+        prop_data->prop_count = facet_count->count;
+        iter = g_sequence_append(prop_item->prop_sequence, prop_data);
+        g_hash_table_insert(prop_item->prop_iter_table, iter, iter);
+        g_hash_table_insert(prop_item->prop_name_table,
+            g_strdup(facet_count->name), iter);
+    }
+    prop_item->count = total;
+    prop_item->facet_flag = TRUE;
+}
+
+/*
+ * Update the property item to the counts from the facet index, and emit
+ * the signals for the property names which are added, changed or
+ * deleted.
+ */
+
+static void rclib_db_library_query_result_prop_item_update(
+    RCLibDbLibraryQueryResult *object, guint prop_type,
+    RCLibDbLibraryQueryResultPropItem *prop_item, const GArray *counts,
+    guint total)
+{
+    RCLibDbLibraryQueryResultPrivate *priv = object->priv;
+    RCLibDbLibraryQueryResultPropData *prop_data;
+    const RCLibDbFacetCount *facet_count;
+    GSequenceIter *iter, *next_iter;
+    GHashTable *count_table;
+    guint i;
+    count_table = g_hash_table_new(g_str_hash, g_str_equal);
+    for(i=0;i<counts->len;i++)
+    {
+        facet_count = &g_array_index(counts, RCLibDbFacetCount, i);
+        g_hash_table_insert(count_table, facet_count->name,
+            (gpointer)facet_count);
+    }
+    iter = g_sequence_get_begin_iter(prop_item->prop_sequence);
+    while(!g_sequence_iter_is_end(iter))
+    {
+        next_iter = g_sequence_iter_next(iter);
+        prop_data = g_sequence_get(iter);
+        facet_count = g_hash_table_lookup(count_table, prop_data->prop_name);
+        if(facet_count==NULL)
+        {
+            prop_item->count -= prop_data->prop_count;
+            g_signal_emit(object, db_library_query_result_signals[
+                SIGNAL_LIBRARY_QUERY_RESULT_PROP_DELETE], 0, prop_type,
+                prop_data->prop_name);
+            g_hash_table_remove(prop_item->prop_name_table,
+                prop_data->prop_name);
+            g_hash_table_remove(prop_item->prop_iter_table, iter);
+            g_sequence_remove(iter);
+        }
+        else
+        {
+            g_hash_table_remove(count_table, facet_count->name);
+            if(facet_count->count!=prop_data->prop_count)
+            {
+                prop_item->count = prop_item->count -
+                    prop_data->prop_count + facet_count->count;
+                prop_data->prop_count = facet_count->count;
+                g_signal_emit(object, db_library_query_result_signals[
+                    SIGNAL_LIBRARY_QUERY_RESULT_PROP_CHANGED], 0, prop_type,
+                    prop_data->prop_name);
+            }
+        }
+        iter = next_iter;
+    }
+    for(i=0;i<counts->len;i++)
+    {
+        facet_count = &g_array_index(counts, RCLibDbFacetCount, i);
+        if(!g_hash_table_contains(count_table, facet_count->name))
+            continue;
+        prop_data = rclib_db_library_query_result_prop_data_new();
+        prop_data->prop_name = g_strdup(facet_count->name);
+        prop_data->prop_count = facet_count->count;
+        prop_item->count += facet_count->count;
+        iter = g_sequence_insert_sorted(prop_item->prop_sequence, prop_data,
+            rclib_db_library_query_result_prop_item_compare_func, priv);
+        g_hash_table_insert(prop_item->prop_iter_table, iter, iter);
+        g_hash_table_insert(prop_item->prop_name_table,
+            g_strdup(facet_count->name), iter);
+        g_signal_emit(object, db_library_query_result_signals[
+            SIGNAL_LIBRARY_QUERY_RESULT_PROP_ADDED], 0, prop_type,
+            facet_count->name);
+    }
+    g_hash_table_destroy(count_table);
+    prop_item->count = total;
+}
+
+static gboolean rclib_db_library_query_result_facet_refresh_cb(
+    gpointer data)
+{
+    RCLibDbLibraryQueryResult *object = (RCLibDbLibraryQueryResult *)data;
+    RCLibDbLibraryQueryResultPrivate *priv;
+    RCLibDbLibraryQueryResultPropItem *prop_item;
+    GHashTableIter prop_iter;
+    GArray *counts;
+    guint prop_type;
+    guint total = 0;
+    if(data==NULL) return FALSE;
+    priv = object->priv;
+    if(priv==NULL) return FALSE;
+    priv->facet_refresh_id = 0;
+    g_hash_table_iter_init(&prop_iter, priv->prop_table);
+    while(g_hash_table_iter_next(&prop_iter, (gpointer *)&prop_type,
+        (gpointer *)&prop_item))
+    {
+        if(prop_item==NULL || !prop_item->facet_flag) continue;
+        counts = rclib_db_library_query_result_facet_lookup(object,
+            prop_type, &total);
+        if(counts==NULL) continue;
+        rclib_db_library_query_result_prop_item_update(object, prop_type,
+            prop_item, counts, total);
+        g_array_free(counts, TRUE);
+    }
+    return FALSE;
+}
+
+/*
+ * Refresh the property items which are filled from the facet index in
+ * the main loop, so the changes of many items are merged.
+ */
+
+static void rclib_db_library_query_result_facet_schedule(
+    RCLibDbLibraryQueryResult *object)
+{
+    RCLibDbLibraryQueryResultPrivate *priv = object->priv;
+    if(priv==NULL || priv->facet_refresh_id>0) return;
+    priv->facet_refresh_id = g_idle_add(
+        rclib_db_library_query_result_facet_refresh_cb, object);
+}
+
+static gboolean rclib_db_library_changed_entry_idle_cb(gpointer data)
+{
+    GObject *instance;
+    RCLibDbPrivate *priv;
+    gchar *uri = (gchar *)data;
+    if(data==NULL) return FALSE;
+    instance = rclib_db_get_instance();
+    if(instance==NULL) return FALSE;
+    priv = RCLIB_DB(instance)->priv;
+    if(priv==NULL) return FALSE;
+    g_rw_lock_reader_lock(&(priv->library_rw_lock));
+    if(!g_hash_table_contains(priv->library_table, uri)) return FALSE;
+    g_signal_emit_by_name(instance, "library-changed", uri);
+    g_free(uri);
+    g_rw_lock_reader_unlock(&(priv->library_rw_lock));
+    return FALSE;
+}
+
+static gboolean rclib_db_library_deleted_entry_idle_cb(gpointer data)
+{
+    GObject *instance;
+    RCLibDbPrivate *priv;
+    gchar *uri = (gchar *)data;
+    if(data==NULL) return FALSE;
+    instance = rclib_db_get_instance();
+    if(instance==NULL) return FALSE;
+    priv = RCLIB_DB(instance)->priv;
+    if(priv==NULL) return FALSE;
+    g_signal_emit_by_name(instance, "library-deleted", uri);
+    g_free(uri);
+    return FALSE;
+}
+
+/*
+ * Add the item to the query result, and emit the signals for it and its
+ * properties. The item should match the query.
+ */
+
+static void rclib_db_library_query_result_add_data(
+    RCLibDbLibraryQueryResult *object, RCLibDbLibraryData *library_data,
+    const gchar *uri)
+{
+    RCLibDbLibraryQueryResultPrivate *priv;
+    RCLibDbLibraryQueryResultPropItem *prop_item;
+    RCLibDbLibraryQueryResultPropData *prop_data;
+    guint prop_type;
+    GHashTableIter prop_iter;
+    gchar *prop_string;
+    GSequenceIter *iter = NULL;
+    priv = object->priv;
+    if(g_hash_table_contains(priv->query_uri_table, uri)) return;
+    if(priv->list_need_sort && priv->query_sequence!=NULL)
+    {
+        iter = g_sequence_insert_sorted(priv->query_sequence, 
+            rclib_db_library_data_ref(library_data),
+            rclib_db_library_query_result_item_compare_func, priv);
+        g_hash_table_replace(priv->query_iter_table, iter, iter);
+    }
+    
+    g_hash_table_replace(priv->query_uri_table, g_strdup(uri), iter);
+    g_signal_emit(object, db_library_query_result_signals[
+        SIGNAL_LIBRARY_QUERY_RESULT_ADDED], 0, uri);
+        
+    g_hash_table_iter_init(&prop_iter, priv->prop_table);
+    while(g_hash_table_iter_next(&prop_iter, (gpointer *)&prop_type,
+        (gpointer *)&prop_item))
+    {
+        if(prop_item==NULL) continue;
+        if(prop_item->facet_flag)
+        {
+            rclib_db_library_query_result_facet_schedule(object);
+            continue;
+        }
+        if(rclib_db_query_get_query_data_type((RCLibDbQueryDataType)
+            prop_type)!=G_TYPE_STRING)
+        {
+            continue;
+        }
+        prop_string = NULL;
+        rclib_db_library_data_get(library_data,
+            rclib_db_library_query_type_to_data_type(prop_type),
+            &prop_string, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
+        if(prop_string==NULL)
+            prop_string = g_strdup("");
+        iter = g_hash_table_lookup(prop_item->prop_name_table,
+            prop_string);
+        if(iter!=NULL)
+        {
+            g_hash_table_insert(prop_item->prop_uri_table, g_strdup(uri),
+                iter);
+            prop_data = g_sequence_get(iter);
+            prop_data->prop_count++;
+            prop_item->count++;
+            g_signal_emit(object, db_library_query_result_signals[
+                SIGNAL_LIBRARY_QUERY_RESULT_PROP_CHANGED], 0, prop_type,
+                prop_string);
+        }
+        else
+        {
+            prop_data = rclib_db_library_query_result_prop_data_new();
+            prop_data->prop_count = 1;
+            prop_item->count++;
+            prop_data->prop_name = g_strdup(prop_string);
+            iter = g_sequence_insert_sorted(prop_item->prop_sequence,
+                prop_data,
+                rclib_db_library_query_result_prop_item_compare_func,
+                priv);
+            g_hash_table_insert(prop_item->prop_iter_table, iter, iter);
+            g_hash_table_insert(prop_item->prop_name_table,
+                g_strdup(prop_string), iter);
+            g_hash_table_insert(prop_item->prop_uri_table,
+                g_strdup(uri), iter);
+            g_signal_emit(object, db_library_query_result_signals[
+                SIGNAL_LIBRARY_QUERY_RESULT_PROP_ADDED], 0, prop_type,
+                prop_string);
+        }
+        g_free(prop_string);
+    }
+}
+
+static void rclib_db_library_query_result_added_cb(RCLibDb *db,
+    const gchar *uri, gpointer data)
+{
+    RCLibDbLibraryQueryResult *object;
+    RCLibDbLibraryQueryResultPrivate *priv;
+    RCLibDbLibraryData *library_data;
+    object = (RCLibDbLibraryQueryResult *)data;
+    if(data==NULL || uri==NULL) return;
+    priv = object->priv;
+    if(priv==NULL) return;
+    if(priv->query_plan==NULL) return;
+    library_data = rclib_db_library_get_data(uri);
+    if(library_data==NULL) return;
+    if(rclib_db_library_data_query_plan(library_data, priv->query_plan))
+        rclib_db_library_query_result_add_data(object, library_data, uri);
+    rclib_db_library_data_unref(library_data);
+}
+
+static void rclib_db_library_query_result_deleted_cb(RCLibDb *db,
+    const gchar *uri, gpointer data)
+{
+    RCLibDbLibraryQueryResult *object;
+    RCLibDbLibraryQueryResultPrivate *priv;
+    GSequenceIter *iter;
+    GHashTableIter prop_iter;
+    RCLibDbLibraryQueryResultPropItem *prop_item;
+    RCLibDbLibraryQueryResultPropData *prop_data;
+    guint prop_type;
+    object = (RCLibDbLibraryQueryResult *)data;
+    if(data==NULL || uri==NULL) return;
+    priv = object->priv;
+    if(priv==NULL) return;
     if(g_hash_table_contains(priv->query_uri_table, uri))
     {
         g_signal_emit(object, db_library_query_result_signals[
@@ -533,6 +824,11 @@ static void rclib_db_library_query_result_deleted_cb(RCLibDb *db,
         (gpointer *)&prop_item))
     {
         if(prop_item==NULL) continue;
+        if(prop_item->facet_flag)
+        {
+            rclib_db_library_query_result_facet_schedule(object);
+            continue;
+        }
         iter = g_hash_table_lookup(prop_item->prop_uri_table, uri);
         if(iter==NULL) continue;
         prop_data = g_sequence_get(iter);
@@ -602,7 +898,8 @@ static void rclib_db_library_query_result_changed_cb(RCLibDb *db,
         iter = g_hash_table_lookup(priv->query_uri_table, uri);
         if(library_data!=NULL)
         {
-            if(!rclib_db_library_data_query(library_data, priv->query, NULL))
+            if(!rclib_db_library_data_query_plan(library_data,
+                priv->query_plan))
             {
                 g_signal_emit(object, db_library_query_result_signals[
                     SIGNAL_LIBRARY_QUERY_RESULT_DELETE], 0, uri);
@@ -618,6 +915,11 @@ static void rclib_db_library_query_result_changed_cb(RCLibDb *db,
                     (gpointer *)&prop_type, (gpointer *)&prop_item))
                 {
                     if(prop_item==NULL) continue;
+                    if(prop_item->facet_flag)
+                    {
+                        rclib_db_library_query_result_facet_schedule(object);
+                        continue;
+                    }
                     if(rclib_db_query_get_query_data_type(
                         (RCLibDbQueryDataType)prop_type)!=G_TYPE_STRING)
                     {
@@ -682,6 +984,11 @@ static void rclib_db_library_query_result_changed_cb(RCLibDb *db,
                 (gpointer *)&prop_type, (gpointer *)&prop_item))
             {
                 if(prop_item==NULL) continue;
+                if(prop_item->facet_flag)
+                {
+                    rclib_db_library_query_result_facet_schedule(object);
+                    continue;
+                }
                 if(rclib_db_query_get_query_data_type(
                     (RCLibDbQueryDataType)prop_type)!=G_TYPE_STRING)
                 {
@@ -764,12 +1071,35 @@ static void rclib_db_library_query_result_changed_cb(RCLibDb *db,
     }
 }
 
+/*
+ * Get the bit of the query result in the masks of the chain, or 0 if the
+ * query result is not in the chain, or its query has been changed after
+ * the chain was made.
+ */
+
+static guint32 rclib_db_library_query_chain_bit(
+    const RCLibDbLibraryQueryChain *chain,
+    RCLibDbLibraryQueryResult *query_result, gint serial)
+{
+    guint i;
+    if(chain==NULL) return 0;
+    for(i=0;i<chain->length;i++)
+    {
+        if(chain->query_results[i]==query_result &&
+            chain->serials[i]==serial)
+        {
+            return 1U << i;
+        }
+    }
+    return 0;
+}
+
 static void rclib_db_library_query_result_base_added_cb(
     RCLibDbLibraryQueryResult *base, const gchar *uri,
     gpointer data)
 {
     RCLibDbLibraryQueryResult *qr;
-    RCLibDbLibraryQueryResultPrivate *priv;
+    RCLibDbLibraryQueryResultPrivate *priv, *base_priv;
     RCLibDbLibraryData *library_data;
     RCLibDbLibraryQueryResultPropItem *prop_item;
     RCLibDbLibraryQueryResultPropData *prop_data;
@@ -777,16 +1107,33 @@ static void rclib_db_library_query_result_base_added_cb(
     guint prop_type;
     GHashTableIter prop_iter;
     GSequenceIter *iter = NULL;
+    guint32 bit = 0;
+    gboolean matched = TRUE;
     qr = (RCLibDbLibraryQueryResult *)data;
     if(data==NULL) return;
     priv = qr->priv;
     if(uri==NULL) return;
     if(priv==NULL || priv->base_query_result==NULL) return;
+    base_priv = priv->base_query_result->priv;
     library_data = rclib_db_library_get_data(uri);
     if(library_data==NULL) return;
     library_data = rclib_db_library_data_ref(library_data);
-    if(priv->query!=NULL && !rclib_db_library_data_query(library_data,
-        priv->query, NULL))
+    
+    /* If the item comes from a streamed query, the query of this query
+     * result has been evaluated in the scan, so use its mask. */
+    if(base_priv!=NULL && base_priv->load_chain!=NULL)
+    {
+        bit = rclib_db_library_query_chain_bit(base_priv->load_chain, qr,
+            priv->plan_serial);
+    }
+    if(bit!=0)
+        matched = (base_priv->load_mask & bit)!=0;
+    else if(priv->query_plan!=NULL)
+    {
+        matched = rclib_db_library_data_query_plan(library_data,
+            priv->query_plan);
+    }
+    if(!matched)
     {
         rclib_db_library_data_unref(library_data);
         return;
@@ -805,14 +1152,25 @@ static void rclib_db_library_query_result_base_added_cb(
     }
     
     g_hash_table_replace(priv->query_uri_table, g_strdup(uri), iter);
+    if(bit!=0)
+    {
+        priv->load_chain = base_priv->load_chain;
+        priv->load_mask = base_priv->load_mask;
+    }
     g_signal_emit(qr, db_library_query_result_signals[
         SIGNAL_LIBRARY_QUERY_RESULT_ADDED], 0, uri);
+    priv->load_chain = NULL;
     
     g_hash_table_iter_init(&prop_iter, priv->prop_table);
     while(g_hash_table_iter_next(&prop_iter, (gpointer *)&prop_type,
         (gpointer *)&prop_item))
     {
         if(prop_item==NULL) continue;
+        if(prop_item->facet_flag)
+        {
+            rclib_db_library_query_result_facet_schedule(qr);
+            continue;
+        }
         if(rclib_db_query_get_query_data_type((RCLibDbQueryDataType)
             prop_type)!=G_TYPE_STRING)
         {
@@ -894,6 +1252,11 @@ static void rclib_db_library_query_result_base_delete_cb(
         (gpointer *)&prop_item))
     {
         if(prop_item==NULL) continue;
+        if(prop_item->facet_flag)
+        {
+            rclib_db_library_query_result_facet_schedule(qr);
+            continue;
+        }
         iter = g_hash_table_lookup(prop_item->prop_uri_table, uri);
         if(iter==NULL) continue;
         prop_data = g_sequence_get(iter);
@@ -965,8 +1328,8 @@ static void rclib_db_library_query_result_base_changed_cb(
         rclib_db_library_data_unref(library_data);
         return;
     }
-    if(priv->query!=NULL && !rclib_db_library_data_query(library_data,
-        priv->query, NULL))
+    if(priv->query_plan!=NULL && !rclib_db_library_data_query_plan(
+        library_data, priv->query_plan))
     {
         iter = g_hash_table_lookup(priv->query_uri_table, uri);
         g_signal_emit(qr, db_library_query_result_signals[
@@ -983,6 +1346,11 @@ static void rclib_db_library_query_result_base_changed_cb(
             (gpointer *)&prop_type, (gpointer *)&prop_item))
         {
             if(prop_item==NULL) continue;
+            if(prop_item->facet_flag)
+            {
+                rclib_db_library_query_result_facet_schedule(qr);
+                continue;
+            }
             prop_item_iter = g_hash_table_lookup(prop_item->prop_uri_table,
                 uri);
             if(prop_item_iter==NULL) continue;
@@ -1042,6 +1410,11 @@ static void rclib_db_library_query_result_base_changed_cb(
             (gpointer *)&prop_type, (gpointer *)&prop_item))
         {
             if(prop_item==NULL) continue;
+            if(prop_item->facet_flag)
+            {
+                rclib_db_library_query_result_facet_schedule(qr);
+                continue;
+            }
             if(rclib_db_query_get_query_data_type(
                 (RCLibDbQueryDataType)prop_type)!=G_TYPE_STRING)
             {
@@ -1118,69 +1491,6 @@ static void rclib_db_library_query_result_base_changed_cb(
     rclib_db_library_data_unref(library_data);
 }
 
-static inline gboolean rclib_db_library_keyword_table_add_entry(
-    GHashTable *library_keyword_table, RCLibDbLibraryData *library_data,
-    const gchar *keyword)
-{
-    gboolean present = TRUE;
-    GHashTable *keyword_table;
-    keyword_table = g_hash_table_lookup(library_keyword_table, keyword);
-    if(keyword_table!=NULL)
-    {
-        present = (g_hash_table_lookup(keyword_table, library_data)!=NULL);
-        g_hash_table_insert(keyword_table, library_data, GINT_TO_POINTER(1));
-    }
-    else
-    {
-        present = FALSE;
-        keyword_table = g_hash_table_new(g_direct_hash, g_direct_equal);
-        g_hash_table_insert(keyword_table, library_data, GINT_TO_POINTER(1));
-        g_hash_table_insert(library_keyword_table, g_strdup(keyword),
-            keyword_table);
-    }
-    return present;
-}
-
-static inline gboolean rclib_db_library_keyword_table_remove_entry(
-    GHashTable *library_keyword_table, RCLibDbLibraryData *library_data,
-    const gchar *keyword)
-{
-    GHashTable *keyword_table;
-    gboolean ret;
-    keyword_table = g_hash_table_lookup(library_keyword_table, keyword);
-    if(keyword_table!=NULL)
-    {
-        ret = g_hash_table_remove(keyword_table, library_data);
-        if(g_hash_table_size(keyword_table)==0)
-        {
-            g_hash_table_remove(library_keyword_table, keyword);
-        }
-    }
-    else
-    {
-        ret = FALSE;
-    }
-    return ret;
-}
-
-static inline gboolean rclib_db_library_keyword_table_contains_entry(
-    GHashTable *library_keyword_table, RCLibDbLibraryData *library_data,
-    const gchar *keyword)
-{
-    GHashTable *keyword_table;
-    gboolean ret;
-    keyword_table = g_hash_table_lookup(library_keyword_table, keyword);
-    if(keyword_table!=NULL)
-    {
-        ret = (g_hash_table_lookup(keyword_table, library_data)!=NULL);
-    }
-    else
-    {
-        ret = FALSE;
-    }
-    return ret;
-}
-
 static inline void rclib_db_library_import_idle_data_free(
     RCLibDbLibraryImportIdleData *data)
 {
@@ -1194,9 +1504,29 @@ static inline void rclib_db_library_refresh_idle_data_free(
 {
     if(data==NULL) return;
     if(data->mmd!=NULL) rclib_tag_free(data->mmd);
+    g_free(data->uri);
     g_free(data);
 }
 
+/*
+ * Take the ReplayGain values from the tags, the measured values are
+ * dropped because the file may have been changed.
+ */
+
+static inline void rclib_db_library_data_gain_from_tag(
+    RCLibDbLibraryData *library_data, const RCLibTagMetadata *mmd)
+{
+    library_data->gain_flags = 0;
+    library_data->track_gain = mmd->track_gain;
+    library_data->track_peak = mmd->track_peak;
+    library_data->album_gain = mmd->album_gain;
+    library_data->album_peak = mmd->album_peak;
+    if(mmd->track_gain_flag)
+        library_data->gain_flags |= RCLIB_DB_GAIN_FLAG_TRACK;
+    if(mmd->album_gain_flag)
+        library_data->gain_flags |= RCLIB_DB_GAIN_FLAG_ALBUM;
+}
+
 gboolean _rclib_db_library_import_idle_cb(gpointer data)
 {
     RCLibDbPrivate *priv;
@@ -1221,14 +1551,18 @@ gboolean _rclib_db_library_import_idle_cb(gpointer data)
     library_data->type = idle_data->type;
     library_data->uri = g_strdup(mmd->uri);
     library_data->title = g_strdup(mmd->title);
-    library_data->artist = g_strdup(mmd->artist);
-    library_data->album = g_strdup(mmd->album);
-    library_data->ftype = g_strdup(mmd->ftype);
-    library_data->genre = g_strdup(mmd->genre);
+    library_data->artist = _rclib_db_string_intern(mmd->artist);
+    library_data->album = _rclib_db_string_intern(mmd->album);
+    library_data->ftype = _rclib_db_string_intern(mmd->ftype);
+    library_data->genre = _rclib_db_string_intern(mmd->genre);
     library_data->length = mmd->length;
     library_data->tracknum = mmd->tracknum;
     library_data->year = mmd->year;
     library_data->rating = 3.0;
+    rclib_db_library_data_gain_from_tag(library_data, mmd);
+    library_data->mtime = idle_data->fingerprint.mtime;
+    library_data->filesize = idle_data->fingerprint.filesize;
+    library_data->inode = idle_data->fingerprint.inode;
     _rclib_db_library_append_data_internal(library_data->uri,
         library_data);
     rclib_db_library_data_unref(library_data);
@@ -1251,42 +1585,50 @@ gboolean _rclib_db_library_refresh_idle_cb(gpointer data)
     priv = RCLIB_DB(instance)->priv;
     if(priv==NULL) return FALSE;
     if(instance==NULL) return FALSE;
-    if(idle_data->mmd->uri==NULL)
+    if(idle_data->uri==NULL)
     {
         rclib_db_library_refresh_idle_data_free(idle_data);
         return FALSE;
     }
     mmd = idle_data->mmd;
     g_rw_lock_writer_lock(&(priv->library_rw_lock));
-    library_data = g_hash_table_lookup(priv->library_table, mmd->uri);
+    library_data = g_hash_table_lookup(priv->library_table, idle_data->uri);
     if(library_data==NULL)
     {
         rclib_db_library_refresh_idle_data_free(idle_data);
         g_rw_lock_writer_unlock(&(priv->library_rw_lock));
         return FALSE;
     }
+    g_rw_lock_writer_lock(&(library_data->lock));
     library_data->type = idle_data->type;
+    library_data->mtime = idle_data->fingerprint.mtime;
+    library_data->filesize = idle_data->fingerprint.filesize;
+    library_data->inode = idle_data->fingerprint.inode;
     if(mmd!=NULL)
     {
         g_free(library_data->title);
-        g_free(library_data->artist);
-        g_free(library_data->album);
-        g_free(library_data->ftype);
+        _rclib_db_string_release(library_data->artist);
+        _rclib_db_string_release(library_data->album);
+        _rclib_db_string_release(library_data->ftype);
+        _rclib_db_string_release(library_data->genre);
         library_data->title = g_strdup(mmd->title);
-        library_data->artist = g_strdup(mmd->artist);
-        library_data->album = g_strdup(mmd->album);
-        library_data->ftype = g_strdup(mmd->ftype);
-        library_data->genre = g_strdup(mmd->genre);
+        library_data->artist = _rclib_db_string_intern(mmd->artist);
+        library_data->album = _rclib_db_string_intern(mmd->album);
+        library_data->ftype = _rclib_db_string_intern(mmd->ftype);
+        library_data->genre = _rclib_db_string_intern(mmd->genre);
         library_data->length = mmd->length;
         library_data->tracknum = mmd->tracknum;
         library_data->year = mmd->year;
+        rclib_db_library_data_gain_from_tag(library_data, mmd);
+        _rclib_db_sort_keys_clear(library_data->sort_keys);
     }
+    g_rw_lock_writer_unlock(&(library_data->lock));
     g_rw_lock_writer_unlock(&(priv->library_rw_lock));
     priv->dirty_flag = TRUE;
     
     /* Send a signal that the operation succeeded. */
     g_signal_emit_by_name(instance, "library-changed",
-        library_data->uri);
+        idle_data->uri);
     
     rclib_db_library_refresh_idle_data_free(idle_data);
     return FALSE;
@@ -1381,147 +1723,420 @@ void rclib_db_library_data_free(RCLibDbLibraryData *data)
     g_rw_lock_writer_lock(&(data->lock));
     g_free(data->uri);
     g_free(data->title);
-    g_free(data->artist);
-    g_free(data->album);
-    g_free(data->ftype);
+    _rclib_db_string_release(data->artist);
+    _rclib_db_string_release(data->album);
+    _rclib_db_string_release(data->ftype);
     g_free(data->lyricfile);
     g_free(data->lyricsecfile);
     g_free(data->albumfile);
-    g_free(data->genre);
+    _rclib_db_string_release(data->genre);
+    _rclib_db_sort_keys_clear(data->sort_keys);
     g_rw_lock_writer_unlock(&(data->lock));
     g_rw_lock_clear(&(data->lock));
     g_slice_free(RCLibDbLibraryData, data);
 }
 
-static gboolean rclib_db_library_query_result_query_idle_cb(gpointer data)
+static void rclib_db_library_query_job_free(RCLibDbLibraryQueryJob *job)
+{
+    guint i;
+    if(job==NULL) return;
+    for(i=0;i<RCLIB_DB_LIBRARY_QUERY_CHAIN_MAX;i++)
+    {
+        if(job->plans[i]!=NULL)
+            _rclib_db_query_plan_free(job->plans[i]);
+    }
+    if(job->result!=NULL)
+        g_ptr_array_free(job->result, TRUE);
+    if(job->masks!=NULL)
+        g_array_free(job->masks, TRUE);
+    g_free(job);
+}
+
+/*
+ * Replace all items in the query result with the items in result, which
+ * is sorted in the given order (or not sorted if the column number of the
+ * order is 0). The items are appended in one pass if result is already in
+ * the order of the query result, and the property items are sorted once
+ * after all of them are collected. Only one reset signal is emitted, the
+ * chained query results load their items from result in the handler.
+ * If masks is not NULL, it holds the masks of the items for the query
+ * results in chain, which tell the chained query results which items
+ * match their queries.
+ */
+
+static void rclib_db_library_query_result_bulk_load(
+    RCLibDbLibraryQueryResult *object, GPtrArray *result, GArray *masks,
+    const RCLibDbLibraryQueryChain *chain,
+    const RCLibDbLibraryQueryOrder *order)
 {
-    RCLibDbLibraryQueryResult *object;
     RCLibDbLibraryQueryResultPrivate *priv;
-    GPtrArray *result = NULL;
+    RCLibDbLibraryQueryOrder list_order;
     RCLibDbLibraryData *library_data;
+    RCLibDbLibraryDataView view;
     RCLibDbLibraryQueryResultPropItem *prop_item;
     RCLibDbLibraryQueryResultPropData *prop_data;
     GHashTableIter prop_iter;
-    guint prop_type;
-    gchar *prop_string;
-    guint i;
-    gchar *uri;
-    gpointer *idle_data = (gpointer *)data;
     GSequenceIter *iter;
-    if(data==NULL) return FALSE;
-    object = (RCLibDbLibraryQueryResult *)idle_data[0];
-    result = (GPtrArray *)idle_data[1];
-    if(result==NULL)
-        return FALSE;
-    if(object==NULL || object->priv==NULL)
+    GArray *counts;
+    const gchar *prop_string;
+    guint prop_type;
+    guint i, total = 0;
+    if(object==NULL || result==NULL) return;
+    priv = object->priv;
+    if(priv==NULL) return;
+    rclib_db_library_query_result_reset_contents(priv);
+    
+    /* The property items are filled from the facet index if it can be
+     * used, so they are not counted by each item. */
+    g_hash_table_iter_init(&prop_iter, priv->prop_table);
+    while(g_hash_table_iter_next(&prop_iter, (gpointer *)&prop_type,
+        (gpointer *)&prop_item))
     {
-        if(result!=NULL)
-        {
-            g_ptr_array_free(result, TRUE);
-            g_free(idle_data);
-            return FALSE;
-        }
+        if(prop_item==NULL) continue;
+        counts = rclib_db_library_query_result_facet_lookup(object,
+            prop_type, &total);
+        if(counts==NULL) continue;
+        rclib_db_library_query_result_prop_item_fill(prop_item, counts,
+            total);
+        g_array_free(counts, TRUE);
+    }
+    memcpy(list_order.columns, priv->sort_columns,
+        sizeof(list_order.columns));
+    list_order.column_num = priv->sort_column_num;
+    list_order.direction = priv->sort_direction;
+    if(priv->list_need_sort && priv->query_sequence!=NULL)
+    {
+        if(!rclib_db_library_query_order_equal(order, &list_order))
+            rclib_db_library_query_sort_items(result, masks, &list_order);
+        order = &list_order;
     }
-    priv = object->priv;
     for(i=0;i<result->len;i++)
     {
         library_data = g_ptr_array_index(result, i);
         if(library_data==NULL) continue;
-        uri = NULL;
+        rclib_db_library_data_view_begin(library_data, &view);
+        if(view.uri==NULL || g_hash_table_contains(priv->query_uri_table,
+            view.uri))
+        {
+            rclib_db_library_data_view_end(library_data, &view);
+            continue;
+        }
         iter = NULL;
-        library_data = rclib_db_library_data_ref(library_data);
-        rclib_db_library_data_get(library_data, RCLIB_DB_LIBRARY_DATA_TYPE_URI,
-            &uri, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
         if(priv->list_need_sort && priv->query_sequence!=NULL)
         {
-            iter = g_sequence_insert_sorted(priv->query_sequence, library_data,
-                rclib_db_library_query_result_item_compare_func, priv);
+            iter = g_sequence_append(priv->query_sequence,
+                rclib_db_library_data_ref(library_data));
             g_hash_table_replace(priv->query_iter_table, iter, iter);
         }
-        
-        g_hash_table_replace(priv->query_uri_table, g_strdup(uri), iter);
-        g_signal_emit(object, db_library_query_result_signals[
-            SIGNAL_LIBRARY_QUERY_RESULT_ADDED], 0, uri);
-            
+        g_hash_table_replace(priv->query_uri_table, g_strdup(view.uri),
+            iter);
         g_hash_table_iter_init(&prop_iter, priv->prop_table);
         while(g_hash_table_iter_next(&prop_iter, (gpointer *)&prop_type,
             (gpointer *)&prop_item))
         {
-            if(prop_item==NULL) continue;
+            if(prop_item==NULL || prop_item->facet_flag) continue;
             if(rclib_db_query_get_query_data_type((RCLibDbQueryDataType)
                 prop_type)!=G_TYPE_STRING)
             {
                 continue;
             }
-            prop_string = NULL;
-            rclib_db_library_data_get(library_data,
-                rclib_db_library_query_type_to_data_type(prop_type),
-                &prop_string, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-            if(prop_string==NULL)
-                prop_string = g_strdup("");
+            prop_string = rclib_db_library_view_get_prop_string(&view,
+                prop_type);
             iter = g_hash_table_lookup(prop_item->prop_name_table,
                 prop_string);
-            if(iter!=NULL)
-            {
-                prop_data = g_sequence_get(iter);
-                prop_data->prop_count++;
-                prop_item->count++;
-                g_hash_table_insert(prop_item->prop_uri_table, g_strdup(uri),
-                    iter);
-                g_signal_emit(object, db_library_query_result_signals[
-                    SIGNAL_LIBRARY_QUERY_RESULT_PROP_CHANGED], 0, prop_type,
-                    prop_string);
-            }
-            else
+            if(iter==NULL)
             {
                 prop_data = rclib_db_library_query_result_prop_data_new();
-                prop_data->prop_count = 1;
                 prop_data->prop_name = g_strdup(prop_string);
-                prop_item->count++;
-                iter = g_sequence_insert_sorted(prop_item->prop_sequence,
-                    prop_data,
-                    rclib_db_library_query_result_prop_item_compare_func,
-                    priv);
+                iter = g_sequence_append(prop_item->prop_sequence,
+                    prop_data);
                 g_hash_table_insert(prop_item->prop_iter_table, iter, iter);
                 g_hash_table_insert(prop_item->prop_name_table,
                     g_strdup(prop_string), iter);
-                g_hash_table_insert(prop_item->prop_uri_table, g_strdup(uri),
-                    iter);
-                g_signal_emit(object, db_library_query_result_signals[
-                    SIGNAL_LIBRARY_QUERY_RESULT_PROP_ADDED], 0, prop_type,
-                    prop_string);
             }
-            
-            g_free(prop_string);
+            else
+                prop_data = g_sequence_get(iter);
+            prop_data->prop_count++;
+            prop_item->count++;
+            g_hash_table_insert(prop_item->prop_uri_table,
+                g_strdup(view.uri), iter);
+        }
+        rclib_db_library_data_view_end(library_data, &view);
+    }
+    g_hash_table_iter_init(&prop_iter, priv->prop_table);
+    while(g_hash_table_iter_next(&prop_iter, NULL, (gpointer *)&prop_item))
+    {
+        if(prop_item==NULL) continue;
+        g_sequence_sort(prop_item->prop_sequence,
+            rclib_db_library_query_result_prop_item_compare_func, priv);
+    }
+    priv->bulk_result = result;
+    priv->bulk_order = order;
+    if(masks!=NULL && chain!=NULL && masks->len==result->len)
+    {
+        priv->bulk_masks = masks;
+        priv->bulk_chain = chain;
+    }
+    g_signal_emit(object, db_library_query_result_signals[
+        SIGNAL_LIBRARY_QUERY_RESULT_RESET], 0);
+    priv->bulk_result = NULL;
+    priv->bulk_masks = NULL;
+    priv->bulk_chain = NULL;
+    priv->bulk_order = NULL;
+}
+
+/*
+ * Load the items which match the query from the base query result. The
+ * items are taken from the array which the base query result is loading
+ * if it is in a bulk load, so they keep the order of the array. If the
+ * query of this query result was evaluated in the scan of the base query
+ * result, the masks of the items are used instead.
+ */
+
+static void rclib_db_library_query_result_load_base(
+    RCLibDbLibraryQueryResult *object)
+{
+    RCLibDbLibraryQueryResultPrivate *priv, *base_priv;
+    RCLibDbLibraryQueryOrder order = {{0}};
+    const RCLibDbLibraryQueryChain *chain = NULL;
+    RCLibDbLibraryData *library_data;
+    GHashTableIter uri_iter;
+    GPtrArray *result;
+    GArray *masks = NULL;
+    guint32 mask, bit = 0;
+    gchar *uri;
+    guint i;
+    if(object==NULL) return;
+    priv = object->priv;
+    if(priv==NULL || priv->base_query_result==NULL) return;
+    base_priv = priv->base_query_result->priv;
+    if(base_priv==NULL) return;
+    result = g_ptr_array_new_with_free_func((GDestroyNotify)
+        rclib_db_library_data_unref);
+    if(base_priv->bulk_result!=NULL)
+    {
+        chain = base_priv->bulk_chain;
+        bit = rclib_db_library_query_chain_bit(chain, object,
+            priv->plan_serial);
+        if(bit!=0)
+            masks = g_array_new(FALSE, FALSE, sizeof(guint32));
+        else
+            chain = NULL;
+        for(i=0;i<base_priv->bulk_result->len;i++)
+        {
+            library_data = g_ptr_array_index(base_priv->bulk_result, i);
+            if(library_data==NULL) continue;
+            if(bit!=0)
+            {
+                mask = g_array_index(base_priv->bulk_masks, guint32, i);
+                if(!(mask & bit)) continue;
+                g_array_append_val(masks, mask);
+            }
+            else if(priv->query_plan!=NULL &&
+                !rclib_db_library_data_query_plan(library_data,
+                priv->query_plan))
+            {
+                continue;
+            }
+            g_ptr_array_add(result, rclib_db_library_data_ref(
+                library_data));
+        }
+        if(base_priv->bulk_order!=NULL)
+            order = *base_priv->bulk_order;
+    }
+    else if(base_priv->query_uri_table!=NULL)
+    {
+        g_hash_table_iter_init(&uri_iter, base_priv->query_uri_table);
+        while(g_hash_table_iter_next(&uri_iter, (gpointer *)&uri, NULL))
+        {
+            if(uri==NULL) continue;
+            library_data = rclib_db_library_get_data(uri);
+            if(library_data==NULL) continue;
+            if(priv->query_plan!=NULL && !rclib_db_library_data_query_plan(
+                library_data, priv->query_plan))
+            {
+                rclib_db_library_data_unref(library_data);
+                continue;
+            }
+            g_ptr_array_add(result, library_data);
+        }
+    }
+    rclib_db_library_query_result_bulk_load(object, result, masks, chain,
+        &order);
+    g_ptr_array_free(result, TRUE);
+    if(masks!=NULL)
+        g_array_free(masks, TRUE);
+}
+
+static void rclib_db_library_query_result_base_reset_cb(
+    RCLibDbLibraryQueryResult *base, gpointer data)
+{
+    if(data==NULL) return;
+    rclib_db_library_query_result_load_base(
+        (RCLibDbLibraryQueryResult *)data);
+}
+
+/*
+ * Load the chunks which the query thread has found. The first chunk of a
+ * query is loaded at once with one reset signal, so the first screen of
+ * the items is shown as soon as possible. The later chunks are merged
+ * into the loaded items in their sorted positions, at most a chunk of
+ * items or a chunk time on each idle call, with an added signal for each
+ * item, so the views keep their scroll position and selection. The masks
+ * of the chunks are passed to the chained query results, so they do not
+ * evaluate their queries again.
+ */
+
+static gboolean rclib_db_library_query_result_load_idle_cb(gpointer data)
+{
+    RCLibDbLibraryQueryResult *object;
+    RCLibDbLibraryQueryResultPrivate *priv;
+    RCLibDbLibraryQueryJob *job;
+    RCLibDbLibraryData *library_data;
+    gchar *uri;
+    gint64 start_time;
+    guint count = 0;
+    if(data==NULL) return FALSE;
+    object = (RCLibDbLibraryQueryResult *)data;
+    priv = object->priv;
+    if(priv==NULL) return FALSE;
+    start_time = g_get_monotonic_time();
+    while(count<RCLIB_DB_LIBRARY_QUERY_CHUNK_SIZE && g_get_monotonic_time()-
+        start_time<RCLIB_DB_LIBRARY_QUERY_CHUNK_TIME)
+    {
+        job = priv->load_job;
+        if(job==NULL)
+        {
+            job = g_async_queue_try_pop(priv->load_queue);
+            if(job==NULL) break;
+            if(job->serial!=g_atomic_int_get(&priv->query_serial))
+            {
+                rclib_db_library_query_job_free(job);
+                continue;
+            }
+            if(g_hash_table_size(priv->query_uri_table)==0)
+            {
+                rclib_db_library_query_result_bulk_load(object, job->result,
+                    job->masks, &job->chain, &job->order);
+                count += job->result->len;
+                rclib_db_library_query_job_free(job);
+                continue;
+            }
+            priv->load_job = job;
+        }
+        if(job->masks!=NULL && job->masks->len==job->result->len)
+            priv->load_chain = &job->chain;
+        while(job->offset<job->result->len &&
+            count<RCLIB_DB_LIBRARY_QUERY_CHUNK_SIZE)
+        {
+            library_data = g_ptr_array_index(job->result, job->offset);
+            if(priv->load_chain!=NULL)
+            {
+                priv->load_mask = g_array_index(job->masks, guint32,
+                    job->offset);
+            }
+            job->offset++;
+            count++;
+            uri = NULL;
+            rclib_db_library_data_get(library_data,
+                RCLIB_DB_LIBRARY_DATA_TYPE_URI, &uri,
+                RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
+            if(uri!=NULL)
+            {
+                rclib_db_library_query_result_add_data(object, library_data,
+                    uri);
+                g_free(uri);
+            }
+            if(count % 64==0 && g_get_monotonic_time()-start_time>=
+                RCLIB_DB_LIBRARY_QUERY_CHUNK_TIME)
+            {
+                break;
+            }
+        }
+        priv->load_chain = NULL;
+        if(job->offset>=job->result->len)
+        {
+            rclib_db_library_query_job_free(job);
+            priv->load_job = NULL;
         }
     }
-    g_free(idle_data);
+    if(priv->load_job!=NULL || g_async_queue_length(priv->load_queue)>0)
+        return TRUE;
+
+    /* The query thread only adds a new idle call when this flag is not
+     * set, so check the queue again after clearing it. */
+    g_atomic_int_set(&priv->load_scheduled, FALSE);
+    if(g_async_queue_length(priv->load_queue)>0 &&
+        g_atomic_int_compare_and_exchange(&priv->load_scheduled, FALSE, TRUE))
+    {
+        return TRUE;
+    }
     return FALSE;
 }
 
+static gboolean rclib_db_library_query_result_query_chunk_cb(
+    GPtrArray *chunk, GArray *masks, gpointer data)
+{
+    RCLibDbLibraryQueryJob *job = (RCLibDbLibraryQueryJob *)data;
+    RCLibDbLibraryQueryJob *chunk_job;
+    RCLibDbLibraryQueryResultPrivate *priv;
+    priv = job->query_result->priv;
+    if(job->serial!=g_atomic_int_get(&priv->query_serial))
+    {
+        g_ptr_array_free(chunk, TRUE);
+        if(masks!=NULL)
+            g_array_free(masks, TRUE);
+        return FALSE;
+    }
+    
+    /* Sort the chunk here, so the main thread only merges them. */
+    rclib_db_library_query_sort_items(chunk, masks, &job->order);
+    chunk_job = g_new0(RCLibDbLibraryQueryJob, 1);
+    chunk_job->query_result = job->query_result;
+    chunk_job->chain = job->chain;
+    chunk_job->result = chunk;
+    chunk_job->masks = masks;
+    chunk_job->order = job->order;
+    chunk_job->serial = job->serial;
+    g_async_queue_push(priv->load_queue, chunk_job);
+    if(g_atomic_int_compare_and_exchange(&priv->load_scheduled, FALSE, TRUE))
+    {
+        g_idle_add(rclib_db_library_query_result_load_idle_cb,
+            job->query_result);
+    }
+    return TRUE;
+}
+
 static gpointer rclib_db_library_query_result_query_thread_cb(gpointer data)
 {
     RCLibDbLibraryQueryResultPrivate *priv = NULL;
     RCLibDbLibraryQueryResult *object = RCLIB_DB_LIBRARY_QUERY_RESULT(data);
-    RCLibDbQuery **query_data = NULL;
-    RCLibDbQuery *query = NULL;
-    gpointer *idle_data;
-    GPtrArray *result;
+    RCLibDbLibraryQueryJob *job;
     if(data==NULL) return NULL;
     priv = object->priv;
     if(priv==NULL) return NULL;
     while(priv->query_queue!=NULL)
     {
-        query_data = g_async_queue_pop(priv->query_queue);
-        query = *query_data;
-        g_free(query_data);
-        if(query==NULL) break;
-        result = rclib_db_library_query(query, priv->cancellable);
-        if(result==NULL) continue;
-        idle_data = g_new(gpointer, 2);
-        idle_data[0] = object;
-        idle_data[1] = result;
-        g_idle_add(rclib_db_library_query_result_query_idle_cb, idle_data);
+        job = g_async_queue_pop(priv->query_queue);
+        if(job->plans[0]==NULL)
+        {
+            rclib_db_library_query_job_free(job);
+            break;
+        }
+        
+        /* Skip the query if a newer one has been started. */
+        if(job->serial!=g_atomic_int_get(&priv->query_serial))
+        {
+            rclib_db_library_query_job_free(job);
+            continue;
+        }
+        if(priv->cancellable!=NULL)
+            g_cancellable_reset(priv->cancellable);
+        job->query_result = object;
+        _rclib_db_library_query_chunked(job->plans, job->chain.parents,
+            job->chain.length, priv->cancellable,
+            rclib_db_library_query_result_query_chunk_cb, job);
+        rclib_db_library_query_job_free(job);
     }
     return NULL;
 }
@@ -1530,7 +2145,8 @@ static void rclib_db_library_query_result_finalize(GObject *object)
 {
     RCLibDbLibraryQueryResultPrivate *priv =
         RCLIB_DB_LIBRARY_QUERY_RESULT(object)->priv;
-    RCLibDbQuery **query_data = NULL;
+    RCLibDbLibraryQueryResultPrivate *base_priv;
+    RCLibDbLibraryQueryJob *job;
     RCLIB_DB_LIBRARY_QUERY_RESULT(object)->priv = NULL;
     if(priv->base_added_id>0)
     {
@@ -1550,11 +2166,26 @@ static void rclib_db_library_query_result_finalize(GObject *object)
             priv->base_delete_id);
         priv->base_delete_id = 0;
     }
+    if(priv->base_reset_id>0)
+    {
+        g_signal_handler_disconnect(priv->base_query_result,
+            priv->base_reset_id);
+        priv->base_reset_id = 0;
+    }
     if(priv->base_query_result!=NULL)
     {
+        base_priv = RCLIB_DB_LIBRARY_QUERY_RESULT(
+            priv->base_query_result)->priv;
+        if(base_priv!=NULL)
+        {
+            base_priv->chain_children = g_slist_remove(
+                base_priv->chain_children, object);
+        }
         g_object_unref(priv->base_query_result);
         priv->base_query_result = NULL;
     }
+    g_slist_free(priv->chain_children);
+    priv->chain_children = NULL;
     if(priv->library_added_id>0)
     {
         rclib_db_signal_disconnect(priv->library_added_id);
@@ -1570,33 +2201,55 @@ static void rclib_db_library_query_result_finalize(GObject *object)
         rclib_db_signal_disconnect(priv->library_deleted_id);
         priv->library_deleted_id = 0;
     }
+    g_atomic_int_inc(&priv->query_serial);
     if(priv->cancellable!=NULL)
-    {
         g_cancellable_cancel(priv->cancellable);
-        g_object_unref(priv->cancellable);
-        priv->cancellable = NULL;
-    }
     if(priv->query_queue!=NULL)
     {
-        query_data = g_new(RCLibDbQuery *, 1);
-        *query_data = NULL;
-        g_async_queue_push(priv->query_queue, query_data);
+        job = g_new0(RCLibDbLibraryQueryJob, 1);
+        g_async_queue_push(priv->query_queue, job);
     }
     if(priv->query_thread!=NULL)
     {
         g_thread_join(priv->query_thread);
         priv->query_thread = NULL;
     }
+    if(priv->cancellable!=NULL)
+    {
+        g_object_unref(priv->cancellable);
+        priv->cancellable = NULL;
+    }
     if(priv->query_queue!=NULL)
     {
         g_async_queue_unref(priv->query_queue);
         priv->query_queue = NULL;
     }
+    if(priv->facet_refresh_id>0)
+    {
+        g_source_remove(priv->facet_refresh_id);
+        priv->facet_refresh_id = 0;
+    }
+    g_idle_remove_by_data(object);
+    if(priv->load_job!=NULL)
+    {
+        rclib_db_library_query_job_free(priv->load_job);
+        priv->load_job = NULL;
+    }
+    if(priv->load_queue!=NULL)
+    {
+        g_async_queue_unref(priv->load_queue);
+        priv->load_queue = NULL;
+    }
     if(priv->query!=NULL)
     {
         rclib_db_query_free(priv->query);
         priv->query = NULL;
     }
+    if(priv->query_plan!=NULL)
+    {
+        _rclib_db_query_plan_free(priv->query_plan);
+        priv->query_plan = NULL;
+    }
     if(priv->query_iter_table!=NULL)
     {
         g_hash_table_destroy(priv->query_iter_table);
@@ -1753,6 +2406,23 @@ static void rclib_db_library_query_result_class_init(
         G_STRUCT_OFFSET(RCLibDbLibraryQueryResultClass, prop_reordered),
         NULL, NULL, rclib_marshal_VOID__UINT_POINTER, G_TYPE_NONE, 2,
         G_TYPE_UINT, G_TYPE_POINTER, NULL);
+
+    /**
+     * RCLibDbLibraryQueryResult::query-result-reset:
+     * @qr: the #RCLibDb that received the signal
+     * 
+     * The ::query-result-reset signal is emitted when all items and
+     * property items in the query result have been replaced at once, e.g.
+     * the query result is loaded or cleared. No ::query-result-added or
+     * ::prop-added signal is emitted for the new items, so the views
+     * should reload the whole query result.
+     */
+    db_library_query_result_signals[SIGNAL_LIBRARY_QUERY_RESULT_RESET] =
+        g_signal_new("query-result-reset",
+        RCLIB_TYPE_DB_LIBRARY_QUERY_RESULT, G_SIGNAL_RUN_FIRST,
+        G_STRUCT_OFFSET(RCLibDbLibraryQueryResultClass, query_result_reset),
+        NULL, NULL, g_cclosure_marshal_VOID__VOID, G_TYPE_NONE, 0,
+        G_TYPE_NONE, NULL);
 }
 
 static void rclib_db_library_query_result_instance_init(
@@ -1762,8 +2432,12 @@ static void rclib_db_library_query_result_instance_init(
         object, RCLIB_TYPE_DB_LIBRARY_QUERY_RESULT,
         RCLibDbLibraryQueryResultPrivate);
     object->priv = priv;
-    priv->sort_column = RCLIB_DB_LIBRARY_DATA_TYPE_TITLE;
+    priv->sort_columns[0] = RCLIB_DB_QUERY_DATA_TYPE_TITLE;
+    priv->sort_column_num = 1;
     priv->sort_direction = FALSE;
+    priv->load_order.columns[0] = RCLIB_DB_QUERY_DATA_TYPE_TITLE;
+    priv->load_order.column_num = 1;
+    priv->load_order.direction = FALSE;
     priv->query_sequence = g_sequence_new((GDestroyNotify)
         rclib_db_library_data_unref);
     priv->query_iter_table = g_hash_table_new(g_direct_hash,
@@ -1802,6 +2476,270 @@ GType rclib_db_library_query_result_get_type()
     return g_define_type_id__volatile;
 }
 
+/*
+ * The library is scanned in partitions by the workers in the scan thread
+ * pool, and the thread which starts the scan also scans the first
+ * partition. Each worker adds the matched items to its own buffers, which
+ * are merged in the partition order after all workers finish. The reader
+ * lock of the library is held by the thread which starts the scan until
+ * the workers finish, so the workers only lock the items.
+ *
+ * Besides the plan of the query, the plans of the query results chained
+ * to the query result can be evaluated in the same pass. The mask of each
+ * matched item has bit i set if the item matches plan i and the plan of
+ * its parent, and bit 0 is always set.
+ */
+
+typedef struct _RCLibDbLibraryScan
+{
+    RCLibDbPrivate *priv;
+    RCLibDbQueryPlan * const *plans;
+    const gint *parents;
+    guint n_plans;
+    GCancellable *cancellable;
+    gboolean uri_flag;
+    gboolean check_flag;
+    RCLibDbLibraryQueryChunkFunc chunk_func;
+    gpointer chunk_data;
+    volatile gint stop_flag;
+    GMutex mutex;
+    GCond cond;
+    guint pending;
+}RCLibDbLibraryScan;
+
+typedef struct _RCLibDbLibraryScanTask
+{
+    RCLibDbLibraryScan *scan;
+    RCLibDbLibraryData **items;
+    guint begin;
+    guint end;
+    GPtrArray *result;
+    GArray *masks;
+}RCLibDbLibraryScanTask;
+
+static inline GPtrArray *rclib_db_library_scan_result_new(
+    gboolean uri_flag)
+{
+    if(uri_flag)
+        return g_ptr_array_new_with_free_func(g_free);
+    return g_ptr_array_new_with_free_func((GDestroyNotify)
+        rclib_db_library_data_unref);
+}
+
+static inline void rclib_db_library_scan_eval(RCLibDbLibraryScanTask *task,
+    RCLibDbLibraryData *library_data)
+{
+    const RCLibDbLibraryScan *scan = task->scan;
+    RCLibDbLibraryDataView view;
+    gboolean flag;
+    guint32 mask = 1;
+    guint i;
+    rclib_db_library_data_view_begin(library_data, &view);
+    flag = (view.uri!=NULL);
+    if(flag && scan->check_flag)
+    {
+        flag = (g_hash_table_lookup(scan->priv->library_table, view.uri)==
+            library_data);
+    }
+    if(flag)
+        flag = _rclib_db_query_plan_eval(scan->plans[0], &view);
+    if(flag)
+    {
+        for(i=1;i<scan->n_plans;i++)
+        {
+            if(!(mask & (1U << scan->parents[i]))) continue;
+            if(scan->plans[i]==NULL ||
+                _rclib_db_query_plan_eval(scan->plans[i], &view))
+            {
+                mask |= 1U << i;
+            }
+        }
+        if(scan->uri_flag)
+            g_ptr_array_add(task->result, g_strdup(view.uri));
+        else
+        {
+            g_ptr_array_add(task->result, rclib_db_library_data_ref(
+                library_data));
+        }
+        if(task->masks!=NULL)
+            g_array_append_val(task->masks, mask);
+    }
+    rclib_db_library_data_view_end(library_data, &view);
+}
+
+/*
+ * Hand the matched items to the chunk function if there are enough of
+ * them, or if they have waited for too long, and start a new chunk.
+ * Returns FALSE if the scan should stop.
+ */
+
+static inline gboolean rclib_db_library_scan_flush(
+    RCLibDbLibraryScanTask *task, guint scanned, gint64 *flush_time)
+{
+    const RCLibDbLibraryScan *scan = task->scan;
+    GPtrArray *chunk = task->result;
+    GArray *masks = task->masks;
+    if(chunk->len==0) return TRUE;
+    if(chunk->len<RCLIB_DB_LIBRARY_QUERY_CHUNK_SIZE)
+    {
+        if(scanned % 64!=0) return TRUE;
+        if(g_get_monotonic_time()-*flush_time<
+            RCLIB_DB_LIBRARY_QUERY_CHUNK_TIME)
+        {
+            return TRUE;
+        }
+    }
+    *flush_time = g_get_monotonic_time();
+    task->result = rclib_db_library_scan_result_new(scan->uri_flag);
+    if(masks!=NULL)
+        task->masks = g_array_new(FALSE, FALSE, sizeof(guint32));
+    return scan->chunk_func(chunk, masks, scan->chunk_data);
+}
+
+static void rclib_db_library_scan_task_run(RCLibDbLibraryScanTask *task)
+{
+    RCLibDbLibraryScan *scan = task->scan;
+    gint64 flush_time = 0;
+    guint i;
+    if(scan->chunk_func!=NULL)
+        flush_time = g_get_monotonic_time();
+    for(i=task->begin;i<task->end;i++)
+    {
+        if(g_atomic_int_get(&scan->stop_flag)) break;
+        if(scan->cancellable!=NULL &&
+            g_cancellable_is_cancelled(scan->cancellable))
+        {
+            break;
+        }
+        if(task->items[i]==NULL) continue;
+        rclib_db_library_scan_eval(task, task->items[i]);
+        if(scan->chunk_func!=NULL && !rclib_db_library_scan_flush(task,
+            i-task->begin+1, &flush_time))
+        {
+            g_atomic_int_set(&scan->stop_flag, TRUE);
+            break;
+        }
+    }
+}
+
+static void rclib_db_library_scan_pool_func(gpointer data,
+    gpointer user_data)
+{
+    RCLibDbLibraryScanTask *task = (RCLibDbLibraryScanTask *)data;
+    RCLibDbLibraryScan *scan = task->scan;
+    rclib_db_library_scan_task_run(task);
+    g_mutex_lock(&(scan->mutex));
+    scan->pending--;
+    if(scan->pending==0)
+        g_cond_signal(&(scan->cond));
+    g_mutex_unlock(&(scan->mutex));
+}
+
+/*
+ * Scan the library with the plans, the reader lock of the library must
+ * be held. The matched items are added to query_result, and their masks
+ * are added to masks if it is not NULL. If chunk_func is not NULL, the
+ * items are handed to it in chunks while scanning (from the workers, so
+ * it must be thread safe), and the items left at the end are returned in
+ * a new array.
+ */
+
+static GPtrArray *rclib_db_library_query_scan(RCLibDbPrivate *priv,
+    RCLibDbQueryPlan * const *plans, const gint *parents, guint n_plans,
+    GCancellable *cancellable, GPtrArray *query_result, GArray **masks,
+    gboolean uri_flag, RCLibDbLibraryQueryChunkFunc chunk_func,
+    gpointer chunk_data)
+{
+    RCLibDbLibraryScan scan;
+    RCLibDbLibraryScanTask *tasks;
+    GHashTableIter iter;
+    RCLibDbLibraryData *library_data = NULL;
+    GPtrArray *candidates;
+    guint n_items, n_tasks = 1;
+    guint i, j;
+    memset(&scan, 0, sizeof(RCLibDbLibraryScan));
+    scan.priv = priv;
+    scan.plans = plans;
+    scan.parents = parents;
+    scan.n_plans = n_plans;
+    scan.cancellable = cancellable;
+    scan.uri_flag = uri_flag;
+    scan.chunk_func = chunk_func;
+    scan.chunk_data = chunk_data;
+    candidates = _rclib_db_library_index_lookup(priv, plans[0]);
+    if(candidates!=NULL)
+        scan.check_flag = TRUE;
+    else
+    {
+        candidates = g_ptr_array_sized_new(g_hash_table_size(
+            priv->library_table));
+        g_hash_table_iter_init(&iter, priv->library_table);
+        while(g_hash_table_iter_next(&iter, NULL, (gpointer *)&library_data))
+            g_ptr_array_add(candidates, library_data);
+    }
+    n_items = candidates->len;
+    if(priv->library_scan_pool!=NULL && priv->library_scan_thread_num>1 &&
+        n_items>=2*RCLIB_DB_LIBRARY_SCAN_PARTITION_MIN)
+    {
+        n_tasks = MIN(priv->library_scan_thread_num,
+            n_items / RCLIB_DB_LIBRARY_SCAN_PARTITION_MIN);
+    }
+    tasks = g_new0(RCLibDbLibraryScanTask, n_tasks);
+    for(i=0;i<n_tasks;i++)
+    {
+        tasks[i].scan = &scan;
+        tasks[i].items = (RCLibDbLibraryData **)candidates->pdata;
+        tasks[i].begin = (guint)((guint64)n_items * i / n_tasks);
+        tasks[i].end = (guint)((guint64)n_items * (i+1) / n_tasks);
+        if(i==0)
+            tasks[i].result = query_result;
+        else
+            tasks[i].result = rclib_db_library_scan_result_new(uri_flag);
+        if(masks!=NULL && n_plans>1)
+            tasks[i].masks = g_array_new(FALSE, FALSE, sizeof(guint32));
+    }
+    if(n_tasks>1)
+    {
+        g_mutex_init(&(scan.mutex));
+        g_cond_init(&(scan.cond));
+        scan.pending = n_tasks - 1;
+        for(i=1;i<n_tasks;i++)
+            g_thread_pool_push(priv->library_scan_pool, &tasks[i], NULL);
+    }
+    rclib_db_library_scan_task_run(&tasks[0]);
+    if(n_tasks>1)
+    {
+        g_mutex_lock(&(scan.mutex));
+        while(scan.pending>0)
+            g_cond_wait(&(scan.cond), &(scan.mutex));
+        g_mutex_unlock(&(scan.mutex));
+        g_mutex_clear(&(scan.mutex));
+        g_cond_clear(&(scan.cond));
+    }
+    query_result = tasks[0].result;
+    for(i=1;i<n_tasks;i++)
+    {
+        for(j=0;j<tasks[i].result->len;j++)
+        {
+            g_ptr_array_add(query_result,
+                g_ptr_array_index(tasks[i].result, j));
+        }
+        g_ptr_array_set_free_func(tasks[i].result, NULL);
+        g_ptr_array_free(tasks[i].result, TRUE);
+        if(tasks[i].masks!=NULL)
+        {
+            g_array_append_vals(tasks[0].masks, tasks[i].masks->data,
+                tasks[i].masks->len);
+            g_array_free(tasks[i].masks, TRUE);
+        }
+    }
+    if(masks!=NULL)
+        *masks = tasks[0].masks;
+    g_free(tasks);
+    g_ptr_array_free(candidates, TRUE);
+    return query_result;
+}
+
 gboolean _rclib_db_instance_init_library(RCLibDb *db, RCLibDbPrivate *priv)
 {
     RCLibDbQueryDataType prop_types[2] = {RCLIB_DB_QUERY_DATA_TYPE_NONE,
@@ -1817,12 +2755,16 @@ gboolean _rclib_db_instance_init_library(RCLibDb *db, RCLibDbPrivate *priv)
         g_str_equal, g_free, (GDestroyNotify)rclib_db_library_data_unref);
     priv->library_ptr_table = g_hash_table_new(g_direct_hash, g_direct_equal);
         
-    /* GHashTable<gchar *, GHashTable<RCLibDbLibraryData *, 1>> */
-    priv->library_keyword_table = g_hash_table_new_full(g_str_hash,
-        g_str_equal, g_free, (GDestroyNotify)g_hash_table_destroy);
-    
     g_rw_lock_init(&(priv->library_rw_lock));
     
+    priv->library_scan_thread_num = rclib_util_get_processor_count();
+    if(priv->library_scan_thread_num>1)
+    {
+        priv->library_scan_pool = g_thread_pool_new(
+            rclib_db_library_scan_pool_func, NULL,
+            priv->library_scan_thread_num - 1, FALSE, NULL);
+    }
+    
     prop_types[0] = RCLIB_DB_QUERY_DATA_TYPE_GENRE;
     priv->library_query_base = rclib_db_library_query_result_new(db, NULL, 
         prop_types);
@@ -1862,11 +2804,14 @@ void _rclib_db_instance_finalize_library(RCLibDbPrivate *priv)
         g_object_unref(priv->library_query_base);
         priv->library_query_base = NULL;
     }
+    if(priv->library_scan_pool!=NULL)
+    {
+        g_thread_pool_free(priv->library_scan_pool, FALSE, TRUE);
+        priv->library_scan_pool = NULL;
+    }
     g_rw_lock_writer_lock(&(priv->library_rw_lock));
     if(priv->library_query!=NULL)
         g_sequence_free(priv->library_query);
-    if(priv->library_keyword_table!=NULL)
-        g_hash_table_destroy(priv->library_keyword_table);
     if(priv->library_table!=NULL)
         g_hash_table_destroy(priv->library_table);
     if(priv->library_ptr_table!=NULL)
@@ -1887,8 +2832,11 @@ static inline gboolean rclib_db_library_data_set_valist(
     RCLibDbLibraryType new_type;
     const gchar *str;   
     gint64 length;
+    guint64 inode;
     gint vint;
+    guint flags;
     gdouble rating;
+    gdouble gain;
     type = type1;
     g_rw_lock_writer_lock(&(data->lock));
     while(type!=RCLIB_DB_LIBRARY_DATA_TYPE_NONE)
@@ -1925,8 +2873,8 @@ static inline gboolean rclib_db_library_data_set_valist(
             {
                 str = va_arg(var_args, const gchar *);
                 if(g_strcmp0(str, data->artist)==0) break;
-                if(data->artist!=NULL) g_free(data->artist);
-                data->artist = g_strdup(str);
+                _rclib_db_string_release(data->artist);
+                data->artist = _rclib_db_string_intern(str);
                 send_signal = TRUE;
                 break;
             }
@@ -1934,8 +2882,8 @@ static inline gboolean rclib_db_library_data_set_valist(
             {
                 str = va_arg(var_args, const gchar *);
                 if(g_strcmp0(str, data->album)==0) break;
-                if(data->album!=NULL) g_free(data->album);
-                data->album = g_strdup(str);
+                _rclib_db_string_release(data->album);
+                data->album = _rclib_db_string_intern(str);
                 send_signal = TRUE;
                 break;
             }
@@ -1943,8 +2891,8 @@ static inline gboolean rclib_db_library_data_set_valist(
             {
                 str = va_arg(var_args, const gchar *);
                 if(g_strcmp0(str, data->ftype)==0) break;
-                if(data->ftype!=NULL) g_free(data->ftype);
-                data->ftype = g_strdup(str);
+                _rclib_db_string_release(data->ftype);
+                data->ftype = _rclib_db_string_intern(str);
                 send_signal = TRUE;
                 break;
             }
@@ -2012,11 +2960,75 @@ static inline gboolean rclib_db_library_data_set_valist(
             {
                 str = va_arg(var_args, const gchar *);
                 if(g_strcmp0(str, data->genre)==0) break;
-                if(data->genre!=NULL) g_free(data->genre);
-                data->genre = g_strdup(str);
+                _rclib_db_string_release(data->genre);
+                data->genre = _rclib_db_string_intern(str);
+                send_signal = TRUE;
+                break;
+            }
+            case RCLIB_DB_LIBRARY_DATA_TYPE_MTIME:
+            {
+                length = va_arg(var_args, gint64);
+                if(data->mtime==length) break;
+                data->mtime = length;
+                send_signal = TRUE;
+                break;
+            }
+            case RCLIB_DB_LIBRARY_DATA_TYPE_FILESIZE:
+            {
+                length = va_arg(var_args, gint64);
+                if(data->filesize==length) break;
+                data->filesize = length;
+                send_signal = TRUE;
+                break;
+            }
+            case RCLIB_DB_LIBRARY_DATA_TYPE_INODE:
+            {
+                inode = va_arg(var_args, guint64);
+                if(data->inode==inode) break;
+                data->inode = inode;
+                send_signal = TRUE;
+                break;
+            }
+            case RCLIB_DB_LIBRARY_DATA_TYPE_TRACK_GAIN:
+            {
+                gain = va_arg(var_args, gdouble);
+                if(data->track_gain==gain) break;
+                data->track_gain = gain;
+                send_signal = TRUE;
+                break;
+            }
+            case RCLIB_DB_LIBRARY_DATA_TYPE_TRACK_PEAK:
+            {
+                gain = va_arg(var_args, gdouble);
+                if(data->track_peak==gain) break;
+                data->track_peak = gain;
+                send_signal = TRUE;
+                break;
+            }
+            case RCLIB_DB_LIBRARY_DATA_TYPE_ALBUM_GAIN:
+            {
+                gain = va_arg(var_args, gdouble);
+                if(data->album_gain==gain) break;
+                data->album_gain = gain;
+                send_signal = TRUE;
+                break;
+            }
+            case RCLIB_DB_LIBRARY_DATA_TYPE_ALBUM_PEAK:
+            {
+                gain = va_arg(var_args, gdouble);
+                if(data->album_peak==gain) break;
+                data->album_peak = gain;
+                send_signal = TRUE;
+                break;
+            }
+            case RCLIB_DB_LIBRARY_DATA_TYPE_GAIN_FLAGS:
+            {
+                flags = va_arg(var_args, guint);
+                if(data->gain_flags==flags) break;
+                data->gain_flags = flags;
                 send_signal = TRUE;
                 break;
-            }           
+            }
             default:
             {
                 g_warning("rclib_db_library_data_set: Wrong data type %d!",
@@ -2026,6 +3038,7 @@ static inline gboolean rclib_db_library_data_set_valist(
         }
         type = va_arg(var_args, RCLibDbLibraryDataType);
     }
+    if(send_signal) _rclib_db_sort_keys_clear(data->sort_keys);
     g_rw_lock_writer_unlock(&(data->lock));
     return send_signal;
 }
@@ -2038,8 +3051,11 @@ static inline void rclib_db_library_data_get_valist(
     RCLibDbLibraryType *library_type;
     gchar **str;   
     gint64 *length;
+    guint64 *inode;
     gint *vint;
+    guint *flags;
     gfloat *rating;
+    gdouble *gain;
     type = type1;
     g_rw_lock_reader_lock(&(data->lock));
     while(type!=RCLIB_DB_LIBRARY_DATA_TYPE_NONE)
@@ -2130,6 +3146,54 @@ static inline void rclib_db_library_data_get_valist(
                 *str = g_strdup(data->genre);
                 break;
             }
+            case RCLIB_DB_LIBRARY_DATA_TYPE_MTIME:
+            {
+                length = va_arg(var_args, gint64 *);
+                *length = data->mtime;
+                break;
+            }
+            case RCLIB_DB_LIBRARY_DATA_TYPE_FILESIZE:
+            {
+                length = va_arg(var_args, gint64 *);
+                *length = data->filesize;
+                break;
+            }
+            case RCLIB_DB_LIBRARY_DATA_TYPE_INODE:
+            {
+                inode = va_arg(var_args, guint64 *);
+                *inode = data->inode;
+                break;
+            }
+            case RCLIB_DB_LIBRARY_DATA_TYPE_TRACK_GAIN:
+            {
+                gain = va_arg(var_args, gdouble *);
+                *gain = data->track_gain;
+                break;
+            }
+            case RCLIB_DB_LIBRARY_DATA_TYPE_TRACK_PEAK:
+            {
+                gain = va_arg(var_args, gdouble *);
+                *gain = data->track_peak;
+                break;
+            }
+            case RCLIB_DB_LIBRARY_DATA_TYPE_ALBUM_GAIN:
+            {
+                gain = va_arg(var_args, gdouble *);
+                *gain = data->album_gain;
+                break;
+            }
+            case RCLIB_DB_LIBRARY_DATA_TYPE_ALBUM_PEAK:
+            {
+                gain = va_arg(var_args, gdouble *);
+                *gain = data->album_peak;
+                break;
+            }
+            case RCLIB_DB_LIBRARY_DATA_TYPE_GAIN_FLAGS:
+            {
+                flags = va_arg(var_args, guint *);
+                *flags = data->gain_flags;
+                break;
+            }
             default:
             {
                 g_warning("rclib_db_library_data_get: Wrong data type %d!",
@@ -2223,6 +3287,101 @@ void rclib_db_library_data_get(RCLibDbLibraryData *data,
     va_end(var_args);
 }
 
+/**
+ * rclib_db_library_data_get_interned:
+ * @data: the #RCLibDbLibraryData data
+ * @type: the property to get, must be #RCLIB_DB_LIBRARY_DATA_TYPE_ARTIST,
+ *     #RCLIB_DB_LIBRARY_DATA_TYPE_ALBUM, #RCLIB_DB_LIBRARY_DATA_TYPE_FTYPE
+ *     or #RCLIB_DB_LIBRARY_DATA_TYPE_GENRE
+ *
+ * Get a string property of a #RCLibDbLibraryData without copying it.
+ * The string is shared in the string pool, it is valid until the
+ * property is changed or @data is freed, use rclib_db_library_data_get()
+ * instead if the string should be kept. MT safe.
+ *
+ * Returns: (transfer none): The shared string, do not modify or free it.
+ */
+
+const gchar *rclib_db_library_data_get_interned(RCLibDbLibraryData *data,
+    RCLibDbLibraryDataType type)
+{
+    const gchar *str = NULL;
+    if(data==NULL) return NULL;
+    g_rw_lock_reader_lock(&(data->lock));
+    switch(type)
+    {
+        case RCLIB_DB_LIBRARY_DATA_TYPE_ARTIST:
+            str = data->artist;
+            break;
+        case RCLIB_DB_LIBRARY_DATA_TYPE_ALBUM:
+            str = data->album;
+            break;
+        case RCLIB_DB_LIBRARY_DATA_TYPE_FTYPE:
+            str = data->ftype;
+            break;
+        case RCLIB_DB_LIBRARY_DATA_TYPE_GENRE:
+            str = data->genre;
+            break;
+        default:
+            g_warning("The property is not stored in the string pool!");
+            break;
+    }
+    g_rw_lock_reader_unlock(&(data->lock));
+    return str;
+}
+
+/**
+ * rclib_db_library_data_view_begin:
+ * @data: the #RCLibDbLibraryData data
+ * @view: (out caller-allocates): the view to fill
+ *
+ * Fill @view with the properties of @data without copying them, and keep
+ * @data locked for reading until rclib_db_library_data_view_end() is
+ * called, so that a lot of items can be scanned without allocating
+ * memory. Do not modify @data or call this function on @data again before
+ * the view is ended. MT safe.
+ */
+
+void rclib_db_library_data_view_begin(RCLibDbLibraryData *data,
+    RCLibDbLibraryDataView *view)
+{
+    if(view==NULL) return;
+    memset(view, 0, sizeof(RCLibDbLibraryDataView));
+    if(data==NULL) return;
+    g_rw_lock_reader_lock(&(data->lock));
+    view->type = data->type;
+    view->uri = data->uri;
+    view->title = data->title;
+    view->artist = data->artist;
+    view->album = data->album;
+    view->ftype = data->ftype;
+    view->genre = data->genre;
+    view->length = data->length;
+    view->tracknum = data->tracknum;
+    view->year = data->year;
+    view->rating = data->rating;
+    view->lyricfile = data->lyricfile;
+    view->lyricsecfile = data->lyricsecfile;
+    view->albumfile = data->albumfile;
+}
+
+/**
+ * rclib_db_library_data_view_end:
+ * @data: the #RCLibDbLibraryData data
+ * @view: the view filled by rclib_db_library_data_view_begin()
+ *
+ * End the view of @data, and unlock @data. The strings in @view must not
+ * be used after this call. MT safe.
+ */
+
+void rclib_db_library_data_view_end(RCLibDbLibraryData *data,
+    RCLibDbLibraryDataView *view)
+{
+    if(data==NULL || view==NULL) return;
+    memset(view, 0, sizeof(RCLibDbLibraryDataView));
+    g_rw_lock_reader_unlock(&(data->lock));
+}
+
 /**
  * rclib_db_get_library_table:
  *
@@ -2365,1056 +3524,304 @@ void rclib_db_library_delete(const gchar *uri)
     priv->dirty_flag = TRUE;
 }
 
-/**
- * rclib_db_library_get_data:
- * @uri: the URI of the #RCLibDbPlaylistData entry 
- * 
- * Get the library entry data which @uri points to. MT safe.
- * 
- * Returns: (transfer full): The library entry data, #NULL if not found.
- *     Free the data with #rclib_db_library_data_unref() after usage.
- */
- 
-RCLibDbLibraryData *rclib_db_library_get_data(const gchar *uri)
+static void rclib_db_library_refresh_internal(gboolean incremental)
 {
-    RCLibDbLibraryData *library_data = NULL;
+    RCLibDbRefreshData *refresh_data;
+    RCLibDbLibraryData *library_data;
     RCLibDbPrivate *priv;
     GObject *instance;
+    GHashTableIter iter;
+    GSList *refresh_list = NULL, *foreach;
     instance = rclib_db_get_instance();
-    if(instance==NULL) return NULL;
+    if(instance==NULL) return;
     priv = RCLIB_DB(instance)->priv;
-    if(priv==NULL) return NULL;
+    if(priv==NULL || priv->refresh_queue==NULL) return;
     g_rw_lock_reader_lock(&(priv->library_rw_lock));
-    library_data = g_hash_table_lookup(priv->library_table, uri);
-    if(library_data!=NULL)
-        library_data = rclib_db_library_data_ref(library_data);
+    g_hash_table_iter_init(&iter, priv->library_table);
+    while(g_hash_table_iter_next(&iter, NULL, (gpointer *)&library_data))
+    {
+        if(library_data==NULL) continue;
+        g_rw_lock_reader_lock(&(library_data->lock));
+        if(library_data->uri!=NULL)
+        {
+            refresh_data = g_new0(RCLibDbRefreshData, 1);
+            refresh_data->type = RCLIB_DB_REFRESH_TYPE_LIBRARY;
+            refresh_data->uri = g_strdup(library_data->uri);
+            refresh_data->incremental_flag = incremental;
+            refresh_data->fingerprint.mtime = library_data->mtime;
+            refresh_data->fingerprint.filesize = library_data->filesize;
+            refresh_data->fingerprint.inode = library_data->inode;
+            refresh_list = g_slist_prepend(refresh_list, refresh_data);
+        }
+        g_rw_lock_reader_unlock(&(library_data->lock));
+    }
     g_rw_lock_reader_unlock(&(priv->library_rw_lock));
-    return library_data;
+    for(foreach=refresh_list;foreach!=NULL;foreach=g_slist_next(foreach))
+        g_async_queue_push(priv->refresh_queue, foreach->data);
+    g_slist_free(refresh_list);
 }
 
 /**
- * rclib_db_library_data_uri_set: (skip)
- * @uri: the URI of the #RCLibDbPlaylistData entry 
- * @type1: the first property in playlist data to set
- * @...: value for the first property, followed optionally by more
- *  name/value pairs, followed by %RCLIB_DB_LIBRARY_DATA_TYPE_NONE
+ * rclib_db_library_refresh:
  *
- * Sets properties on the #RCLibDbPlaylistData which @uri points to.
+ * Refresh the metadata of all music in the music library. MT safe.
+ */
+
+void rclib_db_library_refresh()
+{
+    rclib_db_library_refresh_internal(FALSE);
+}
+
+/**
+ * rclib_db_library_refresh_incremental:
+ *
+ * Refresh the metadata of the music in the music library, like
+ * rclib_db_library_refresh(), but only the local files whose modification
+ * time, size or inode changed since the last reading are read again.
+ * The result is reported by the #RCLibDb::refresh-summary signal.
  * MT safe.
  */
 
-void rclib_db_library_data_uri_set(const gchar *uri,
-    RCLibDbLibraryDataType type1, ...)
+void rclib_db_library_refresh_incremental()
 {
-    RCLibDbPrivate *priv;
+    rclib_db_library_refresh_internal(TRUE);
+}
+
+guint _rclib_db_library_refresh_matched(RCLibDbPrivate *priv,
+    GHashTable *file_table, GSList *dir_list)
+{
+    RCLibDbRefreshData *refresh_data;
     RCLibDbLibraryData *library_data;
-    va_list var_args;
-    GObject *instance;
-    gboolean send_signal = FALSE;
-    instance = rclib_db_get_instance();
-    if(instance==NULL) return;
-    priv = RCLIB_DB(instance)->priv;
-    if(priv==NULL) return;
-    g_rw_lock_writer_lock(&(priv->library_rw_lock));
-    library_data = g_hash_table_lookup(priv->library_table, uri);
-    if(library_data!=NULL)
+    GHashTableIter iter;
+    GSList *refresh_list = NULL, *foreach;
+    const gchar *dir_uri;
+    gchar *file_uri;
+    gsize len;
+    gboolean matched;
+    guint count = 0;
+    if(priv==NULL || priv->refresh_queue==NULL) return 0;
+    g_rw_lock_reader_lock(&(priv->library_rw_lock));
+    g_hash_table_iter_init(&iter, priv->library_table);
+    while(g_hash_table_iter_next(&iter, NULL, (gpointer *)&library_data))
     {
-        va_start(var_args, type1);
-        send_signal = rclib_db_library_data_set_valist(library_data, type1,
-            var_args);
-        va_end(var_args);
-        if(send_signal)
+        if(library_data==NULL) continue;
+        g_rw_lock_reader_lock(&(library_data->lock));
+        if(library_data->uri==NULL)
         {
-            priv->dirty_flag = TRUE;
-            g_main_context_invoke(NULL, rclib_db_library_changed_entry_idle_cb,
-                g_strdup(uri));
+            g_rw_lock_reader_unlock(&(library_data->lock));
+            continue;
         }
+        matched = FALSE;
+        if(file_table!=NULL)
+        {
+            /* The CUE tracks are matched by the CUE (or audio) file. */
+            if(g_hash_table_contains(file_table, library_data->uri))
+                file_uri = g_strdup(library_data->uri);
+            else if(!rclib_cue_get_track_num(library_data->uri, &file_uri,
+                NULL))
+                file_uri = NULL;
+            if(file_uri!=NULL &&
+                g_hash_table_contains(file_table, file_uri))
+            {
+                g_hash_table_replace(file_table, file_uri,
+                    GINT_TO_POINTER(TRUE));
+                matched = TRUE;
+            }
+            else
+                g_free(file_uri);
+        }
+        for(foreach=dir_list;!matched && foreach!=NULL;
+            foreach=g_slist_next(foreach))
+        {
+            dir_uri = foreach->data;
+            len = strlen(dir_uri);
+            if(strncmp(library_data->uri, dir_uri, len)==0 &&
+                library_data->uri[len]=='/')
+                matched = TRUE;
+        }
+        if(matched)
+        {
+            refresh_data = g_new0(RCLibDbRefreshData, 1);
+            refresh_data->type = RCLIB_DB_REFRESH_TYPE_LIBRARY;
+            refresh_data->uri = g_strdup(library_data->uri);
+            refresh_data->incremental_flag = TRUE;
+            refresh_data->fingerprint.mtime = library_data->mtime;
+            refresh_data->fingerprint.filesize = library_data->filesize;
+            refresh_data->fingerprint.inode = library_data->inode;
+            refresh_list = g_slist_prepend(refresh_list, refresh_data);
+            count++;
+        }
+        g_rw_lock_reader_unlock(&(library_data->lock));
     }
-    g_rw_lock_writer_unlock(&(priv->library_rw_lock));
+    g_rw_lock_reader_unlock(&(priv->library_rw_lock));
+    for(foreach=refresh_list;foreach!=NULL;foreach=g_slist_next(foreach))
+        g_async_queue_push(priv->refresh_queue, foreach->data);
+    g_slist_free(refresh_list);
+    return count;
+}
+
+GHashTable *_rclib_db_library_get_file_table(RCLibDbPrivate *priv)
+{
+    RCLibDbLibraryData *library_data;
+    GHashTable *file_table;
+    GHashTableIter iter;
+    gchar *file_uri;
+    if(priv==NULL) return NULL;
+
+    /* GHashTable<gchar *, gpointer>, the URIs of the files in library. */
+    file_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+        NULL);
+    g_rw_lock_reader_lock(&(priv->library_rw_lock));
+    g_hash_table_iter_init(&iter, priv->library_table);
+    while(g_hash_table_iter_next(&iter, NULL, (gpointer *)&library_data))
+    {
+        if(library_data==NULL) continue;
+        g_rw_lock_reader_lock(&(library_data->lock));
+        if(library_data->uri!=NULL)
+        {
+            if(!rclib_cue_get_track_num(library_data->uri, &file_uri, NULL))
+                file_uri = g_strdup(library_data->uri);
+            g_hash_table_replace(file_table, file_uri, NULL);
+        }
+        g_rw_lock_reader_unlock(&(library_data->lock));
+    }
+    g_rw_lock_reader_unlock(&(priv->library_rw_lock));
+    return file_table;
 }
 
 /**
- * rclib_db_library_data_uri_get: (skip)
+ * rclib_db_library_get_data:
  * @uri: the URI of the #RCLibDbPlaylistData entry 
- * @type1: the first property in library data to get
- * @...: return location for the first property, followed optionally by more
- *  name/return location pairs, followed by %RCLIB_DB_LIBRARY_DATA_TYPE_NONE
+ * 
+ * Get the library entry data which @uri points to. MT safe.
+ * 
+ * Returns: (transfer full): The library entry data, #NULL if not found.
+ *     Free the data with #rclib_db_library_data_unref() after usage.
+ */
+ 
+RCLibDbLibraryData *rclib_db_library_get_data(const gchar *uri)
+{
+    RCLibDbLibraryData *library_data = NULL;
+    RCLibDbPrivate *priv;
+    GObject *instance;
+    instance = rclib_db_get_instance();
+    if(instance==NULL) return NULL;
+    priv = RCLIB_DB(instance)->priv;
+    if(priv==NULL) return NULL;
+    g_rw_lock_reader_lock(&(priv->library_rw_lock));
+    library_data = g_hash_table_lookup(priv->library_table, uri);
+    if(library_data!=NULL)
+        library_data = rclib_db_library_data_ref(library_data);
+    g_rw_lock_reader_unlock(&(priv->library_rw_lock));
+    return library_data;
+}
+
+/**
+ * rclib_db_library_data_uri_set: (skip)
+ * @uri: the URI of the #RCLibDbPlaylistData entry 
+ * @type1: the first property in playlist data to set
+ * @...: value for the first property, followed optionally by more
+ *  name/value pairs, followed by %RCLIB_DB_LIBRARY_DATA_TYPE_NONE
  *
- * Gets properties of the #RCLibDbLibraryData which @uri points to.
- * The property contents will be copied. MT safe.
+ * Sets properties on the #RCLibDbPlaylistData which @uri points to.
+ * MT safe.
  */
 
-void rclib_db_library_data_uri_get(const gchar *uri,
+void rclib_db_library_data_uri_set(const gchar *uri,
     RCLibDbLibraryDataType type1, ...)
 {
     RCLibDbPrivate *priv;
     RCLibDbLibraryData *library_data;
     va_list var_args;
     GObject *instance;
+    gboolean send_signal = FALSE;
     instance = rclib_db_get_instance();
     if(instance==NULL) return;
     priv = RCLIB_DB(instance)->priv;
     if(priv==NULL) return;
-    g_rw_lock_reader_lock(&(priv->library_rw_lock));
+    g_rw_lock_writer_lock(&(priv->library_rw_lock));
     library_data = g_hash_table_lookup(priv->library_table, uri);
     if(library_data!=NULL)
     {
         va_start(var_args, type1);
-        rclib_db_library_data_get_valist(library_data, type1,
+        send_signal = rclib_db_library_data_set_valist(library_data, type1,
             var_args);
         va_end(var_args);
+        if(send_signal)
+        {
+            priv->dirty_flag = TRUE;
+            g_main_context_invoke(NULL, rclib_db_library_changed_entry_idle_cb,
+                g_strdup(uri));
+        }
     }
-    g_rw_lock_reader_unlock(&(priv->library_rw_lock));
-}
-
-static inline RCLibDbLibraryDataType rclib_db_playlist_property_convert(
-    RCLibDbQueryDataType query_type)
-{
-    switch(query_type)
-    {
-        case RCLIB_DB_QUERY_DATA_TYPE_URI:
-            return RCLIB_DB_LIBRARY_DATA_TYPE_URI;
-            break;
-        case RCLIB_DB_QUERY_DATA_TYPE_TITLE:
-            return RCLIB_DB_LIBRARY_DATA_TYPE_TITLE;
-            break;
-        case RCLIB_DB_QUERY_DATA_TYPE_ARTIST:
-            return RCLIB_DB_LIBRARY_DATA_TYPE_ARTIST;
-            break;
-        case RCLIB_DB_QUERY_DATA_TYPE_ALBUM:
-            return RCLIB_DB_LIBRARY_DATA_TYPE_ALBUM;
-        case RCLIB_DB_QUERY_DATA_TYPE_FTYPE:
-            return RCLIB_DB_LIBRARY_DATA_TYPE_FTYPE;
-            break;
-        case RCLIB_DB_QUERY_DATA_TYPE_LENGTH:
-            return RCLIB_DB_LIBRARY_DATA_TYPE_LENGTH;
-            break;
-        case RCLIB_DB_QUERY_DATA_TYPE_TRACKNUM:
-            return RCLIB_DB_LIBRARY_DATA_TYPE_TRACKNUM;
-            break;
-        case RCLIB_DB_QUERY_DATA_TYPE_RATING:
-            return RCLIB_DB_LIBRARY_DATA_TYPE_RATING;
-            break;
-        case RCLIB_DB_QUERY_DATA_TYPE_YEAR:
-            return RCLIB_DB_LIBRARY_DATA_TYPE_YEAR;
-            break;
-        case RCLIB_DB_QUERY_DATA_TYPE_GENRE:
-            return RCLIB_DB_LIBRARY_DATA_TYPE_GENRE;
-            break;
-        default:
-            return RCLIB_DB_LIBRARY_DATA_TYPE_NONE;
-            break;
-    }
-    return RCLIB_DB_LIBRARY_DATA_TYPE_NONE;
-}
-
-static inline RCLibDbPlaylistDataType rclib_db_library_property_convert(
-    RCLibDbQueryDataType query_type)
-{
-    switch(query_type)
-    {
-        case RCLIB_DB_QUERY_DATA_TYPE_URI:
-            return RCLIB_DB_LIBRARY_DATA_TYPE_URI;
-            break;
-        case RCLIB_DB_QUERY_DATA_TYPE_TITLE:
-            return RCLIB_DB_LIBRARY_DATA_TYPE_TITLE;
-            break;
-        case RCLIB_DB_QUERY_DATA_TYPE_ARTIST:
-            return RCLIB_DB_LIBRARY_DATA_TYPE_ARTIST;
-            break;
-        case RCLIB_DB_QUERY_DATA_TYPE_ALBUM:
-            return RCLIB_DB_LIBRARY_DATA_TYPE_ALBUM;
-        case RCLIB_DB_QUERY_DATA_TYPE_FTYPE:
-            return RCLIB_DB_LIBRARY_DATA_TYPE_FTYPE;
-            break;
-        case RCLIB_DB_QUERY_DATA_TYPE_LENGTH:
-            return RCLIB_DB_LIBRARY_DATA_TYPE_LENGTH;
-            break;
-        case RCLIB_DB_QUERY_DATA_TYPE_TRACKNUM:
-            return RCLIB_DB_LIBRARY_DATA_TYPE_TRACKNUM;
-            break;
-        case RCLIB_DB_QUERY_DATA_TYPE_RATING:
-            return RCLIB_DB_LIBRARY_DATA_TYPE_RATING;
-            break;
-        case RCLIB_DB_QUERY_DATA_TYPE_YEAR:
-            return RCLIB_DB_LIBRARY_DATA_TYPE_YEAR;
-            break;
-        case RCLIB_DB_QUERY_DATA_TYPE_GENRE:
-            return RCLIB_DB_LIBRARY_DATA_TYPE_GENRE;
-            break;
-        default:
-            return RCLIB_DB_LIBRARY_DATA_TYPE_NONE;
-            break;
-    }
-    return RCLIB_DB_LIBRARY_DATA_TYPE_NONE;
+    g_rw_lock_writer_unlock(&(priv->library_rw_lock));
 }
 
 /**
- * rclib_db_library_data_query:
- * @library_data: the library data to check
- * @query: the query condition
- * @cancellable: (allow-none): optional #GCancellable object, NULL to ignore
+ * rclib_db_library_data_uri_get: (skip)
+ * @uri: the URI of the #RCLibDbPlaylistData entry 
+ * @type1: the first property in library data to get
+ * @...: return location for the first property, followed optionally by more
+ *  name/return location pairs, followed by %RCLIB_DB_LIBRARY_DATA_TYPE_NONE
  *
- * Check whether the library data satisfied the query condition.
- * MT safe.
- * 
- * Returns: Whether the library data satisfied the query condition.
+ * Gets properties of the #RCLibDbLibraryData which @uri points to.
+ * The property contents will be copied. MT safe.
  */
 
-gboolean rclib_db_library_data_query(RCLibDbLibraryData *library_data,
-    RCLibDbQuery *query, GCancellable *cancellable)
-{
-    RCLibDbQueryData *query_data;
-    gboolean result = FALSE;
-    gboolean or_flag = FALSE;
-    gboolean ret = TRUE;
-    guint i;
-    RCLibDbLibraryDataType ltype;
-    GType dtype;
-    gchar *lstring;
-    gint lint;
-    gint64 lint64;
-    gdouble ldouble;
-    gchar *uri;
-    if(library_data==NULL || query==NULL)
-        return FALSE;
-    if(cancellable!=NULL)
-        cancellable = g_object_ref(cancellable);
-    for(i=0;i<((GPtrArray *)query)->len;i++)
-    {
-        if(cancellable!=NULL)
-        {
-            if(g_cancellable_is_cancelled(cancellable))
-            {
-                g_object_unref(cancellable);
-                return FALSE;
-            }
-        }
-        query_data = g_ptr_array_index((GPtrArray *)query, i);
-        if(query_data==NULL) continue;
-        switch(query_data->type)
-        {
-            case RCLIB_DB_QUERY_CONDITION_TYPE_SUBQUERY:
-            {
-                if(query_data->subquery==NULL)
-                {
-                    result = FALSE;
-                    break;
-                }
-                result = rclib_db_library_data_query(library_data,
-                    query_data->subquery, cancellable);
-                break;
-            }
-            case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_EQUALS:
-            {
-                if(query_data->val==NULL)
-                {
-                    result = FALSE;
-                    break;
-                }
-                ltype = rclib_db_library_property_convert(
-                    query_data->propid);
-                dtype = rclib_db_query_get_query_data_type(
-                    query_data->propid);
-                switch(dtype)
-                {
-                    case G_TYPE_STRING:
-                    {
-                        if(!G_VALUE_HOLDS_STRING(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        lstring = NULL;
-                        rclib_db_library_data_get(library_data, ltype,
-                            &lstring, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                        if(lstring==NULL)
-                            lstring = g_strdup("");
-                        if(ltype==RCLIB_DB_LIBRARY_DATA_TYPE_TITLE &&
-                            (lstring==NULL || strlen(lstring)==0))
-                        {
-                            uri = NULL;
-                            if(lstring!=NULL) g_free(lstring);
-                            lstring = NULL;
-                            rclib_db_library_data_get(library_data,
-                                RCLIB_DB_LIBRARY_DATA_TYPE_URI, &uri,
-                                RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                            if(uri!=NULL)
-                            {
-                                lstring = rclib_tag_get_name_from_uri(uri);
-                            }
-                            g_free(uri);
-                        }
-                        result = (g_strcmp0(g_value_get_string(
-                            query_data->val), lstring)==0);
-                        g_free(lstring);
-                        break;
-                    }
-                    case G_TYPE_INT:
-                    {
-                        if(!G_VALUE_HOLDS_INT(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        lint = 0;
-                        rclib_db_library_data_get(library_data, ltype,
-                            &lint, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                        result = (g_value_get_int(query_data->val)==lint);
-                        break;
-                    }
-                    case G_TYPE_INT64:
-                    {
-                        if(!G_VALUE_HOLDS_INT64(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        lint64 = 0;
-                        rclib_db_library_data_get(library_data, ltype,
-                            &lint64, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                        result = (g_value_get_int64(query_data->val)==lint64);
-                        break;
-                    }
-                    case G_TYPE_DOUBLE:
-                    {
-                        if(!G_VALUE_HOLDS_DOUBLE(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        ldouble = 0;
-                        rclib_db_library_data_get(library_data, ltype,
-                            &ldouble, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                        result = (ABS(g_value_get_double(query_data->val) -
-                            ldouble)<=10e-5);
-                        break;
-                    }
-                    default:
-                    {
-                        result = FALSE;
-                        break;
-                    }
-                }
-                break;
-            }
-            case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_NOT_EQUAL:
-            {
-               if(query_data->val==NULL)
-                {
-                    result = FALSE;
-                    break;
-                }
-                ltype = rclib_db_library_property_convert(
-                    query_data->propid);
-                dtype = rclib_db_query_get_query_data_type(
-                    query_data->propid);
-                switch(dtype)
-                {
-                    case G_TYPE_STRING:
-                    {
-                        if(!G_VALUE_HOLDS_STRING(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        lstring = NULL;
-                        rclib_db_library_data_get(library_data, ltype,
-                            &lstring, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                        if(lstring==NULL)
-                            lstring = g_strdup("");
-                        if(ltype==RCLIB_DB_LIBRARY_DATA_TYPE_TITLE &&
-                            (lstring==NULL || strlen(lstring)==0))
-                        {
-                            uri = NULL;
-                            if(lstring!=NULL) g_free(lstring);
-                            lstring = NULL;
-                            rclib_db_library_data_get(library_data,
-                                RCLIB_DB_LIBRARY_DATA_TYPE_URI, &uri,
-                                RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                            if(uri!=NULL)
-                            {
-                                lstring = rclib_tag_get_name_from_uri(uri);
-                            }
-                            g_free(uri);
-                        }
-                        result = (g_strcmp0(g_value_get_string(
-                            query_data->val), lstring)!=0);
-                        g_free(lstring);
-                        break;
-                    }
-                    case G_TYPE_INT:
-                    {
-                        if(!G_VALUE_HOLDS_INT(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        lint = 0;
-                        rclib_db_library_data_get(library_data, ltype,
-                            &lint, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                        result = (g_value_get_int(query_data->val)!=lint);
-                        break;
-                    }
-                    case G_TYPE_INT64:
-                    {
-                        if(!G_VALUE_HOLDS_INT64(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        lint64 = 0;
-                        rclib_db_library_data_get(library_data, ltype,
-                            &lint64, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                        result = (g_value_get_int64(query_data->val)!=lint64);
-                        break;
-                    }
-                    case G_TYPE_DOUBLE:
-                    {
-                        if(!G_VALUE_HOLDS_DOUBLE(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        ldouble = 0;
-                        rclib_db_library_data_get(library_data, ltype,
-                            &ldouble, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                        result = (ABS(g_value_get_double(query_data->val) -
-                            ldouble)>10e-5);
-                        break;
-                    }
-                    default:
-                    {
-                        result = FALSE;
-                        break;
-                    }
-                }
-                break;
-            }
-            case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_GREATER:
-            {
-               if(query_data->val==NULL)
-                {
-                    result = FALSE;
-                    break;
-                }
-                ltype = rclib_db_library_property_convert(
-                    query_data->propid);
-                dtype = rclib_db_query_get_query_data_type(
-                    query_data->propid);
-                switch(dtype)
-                {
-                    case G_TYPE_STRING:
-                    {
-                        if(!G_VALUE_HOLDS_STRING(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        lstring = NULL;
-                        rclib_db_library_data_get(library_data, ltype,
-                            &lstring, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                        if(lstring==NULL)
-                            lstring = g_strdup("");
-                        if(ltype==RCLIB_DB_LIBRARY_DATA_TYPE_TITLE &&
-                            (lstring==NULL || strlen(lstring)==0))
-                        {
-                            uri = NULL;
-                            if(lstring!=NULL) g_free(lstring);
-                            lstring = NULL;
-                            rclib_db_library_data_get(library_data,
-                                RCLIB_DB_LIBRARY_DATA_TYPE_URI, &uri,
-                                RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                            if(uri!=NULL)
-                            {
-                                lstring = rclib_tag_get_name_from_uri(uri);
-                            }
-                            g_free(uri);
-                        }
-                        result = (g_strcmp0(g_value_get_string(
-                            query_data->val), lstring)>0);
-                        g_free(lstring);
-                        break;
-                    }
-                    case G_TYPE_INT:
-                    {
-                        if(!G_VALUE_HOLDS_INT(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        lint = 0;
-                        rclib_db_library_data_get(library_data, ltype,
-                            &lint, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                        result = (g_value_get_int(query_data->val)>lint);
-                        break;
-                    }
-                    case G_TYPE_INT64:
-                    {
-                        if(!G_VALUE_HOLDS_INT64(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        lint64 = 0;
-                        rclib_db_library_data_get(library_data, ltype,
-                            &lint64, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                        result = (g_value_get_int64(query_data->val)>lint64);
-                        break;
-                    }
-                    case G_TYPE_DOUBLE:
-                    {
-                        if(!G_VALUE_HOLDS_DOUBLE(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        ldouble = 0;
-                        rclib_db_library_data_get(library_data, ltype,
-                            &ldouble, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                        result = (g_value_get_double(query_data->val) -
-                            ldouble>10e-5);
-                        break;
-                    }
-                    default:
-                    {
-                        result = FALSE;
-                        break;
-                    }
-                }
-                break;
-            }
-            case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_GREATER_OR_EQUAL:
-            {
-               if(query_data->val==NULL)
-                {
-                    result = FALSE;
-                    break;
-                }
-                ltype = rclib_db_library_property_convert(
-                    query_data->propid);
-                dtype = rclib_db_query_get_query_data_type(
-                    query_data->propid);
-                switch(dtype)
-                {
-                    case G_TYPE_STRING:
-                    {
-                        if(!G_VALUE_HOLDS_STRING(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        lstring = NULL;
-                        rclib_db_library_data_get(library_data, ltype,
-                            &lstring, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                        if(lstring==NULL)
-                            lstring = g_strdup("");
-                        if(ltype==RCLIB_DB_LIBRARY_DATA_TYPE_TITLE &&
-                            (lstring==NULL || strlen(lstring)==0))
-                        {
-                            uri = NULL;
-                            if(lstring!=NULL) g_free(lstring);
-                            lstring = NULL;
-                            rclib_db_library_data_get(library_data,
-                                RCLIB_DB_LIBRARY_DATA_TYPE_URI, &uri,
-                                RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                            if(uri!=NULL)
-                            {
-                                lstring = rclib_tag_get_name_from_uri(uri);
-                            }
-                            g_free(uri);
-                        }
-                        result = (g_strcmp0(g_value_get_string(
-                            query_data->val), lstring)>=0);
-                        g_free(lstring);
-                        break;
-                    }
-                    case G_TYPE_INT:
-                    {
-                        if(!G_VALUE_HOLDS_INT(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        lint = 0;
-                        rclib_db_library_data_get(library_data, ltype,
-                            &lint, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                        result = (g_value_get_int(query_data->val)>=lint);
-                        break;
-                    }
-                    case G_TYPE_INT64:
-                    {
-                        if(!G_VALUE_HOLDS_INT64(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        lint64 = 0;
-                        rclib_db_library_data_get(library_data, ltype,
-                            &lint64, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                        result = (g_value_get_int64(query_data->val)>=lint64);
-                        break;
-                    }
-                    case G_TYPE_DOUBLE:
-                    {
-                        if(!G_VALUE_HOLDS_DOUBLE(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        ldouble = 0;
-                        rclib_db_library_data_get(library_data, ltype,
-                            &ldouble, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                        result = (g_value_get_double(query_data->val) -
-                            ldouble>=0);
-                        break;
-                    }
-                    default:
-                    {
-                        result = FALSE;
-                        break;
-                    }
-                }
-                break;
-            }
-            case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_LESS:
-            {
-               if(query_data->val==NULL)
-                {
-                    result = FALSE;
-                    break;
-                }
-                ltype = rclib_db_library_property_convert(
-                    query_data->propid);
-                dtype = rclib_db_query_get_query_data_type(
-                    query_data->propid);
-                switch(dtype)
-                {
-                    case G_TYPE_STRING:
-                    {
-                        if(!G_VALUE_HOLDS_STRING(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        lstring = NULL;
-                        rclib_db_library_data_get(library_data, ltype,
-                            &lstring, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                        if(lstring==NULL)
-                            lstring = g_strdup("");
-                        if(ltype==RCLIB_DB_LIBRARY_DATA_TYPE_TITLE &&
-                            (lstring==NULL || strlen(lstring)==0))
-                        {
-                            uri = NULL;
-                            if(lstring!=NULL) g_free(lstring);
-                            lstring = NULL;
-                            rclib_db_library_data_get(library_data,
-                                RCLIB_DB_LIBRARY_DATA_TYPE_URI, &uri,
-                                RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                            if(uri!=NULL)
-                            {
-                                lstring = rclib_tag_get_name_from_uri(uri);
-                            }
-                            g_free(uri);
-                        }
-                        result = (g_strcmp0(g_value_get_string(
-                            query_data->val), lstring)<0);
-                        g_free(lstring);
-                        break;
-                    }
-                    case G_TYPE_INT:
-                    {
-                        if(!G_VALUE_HOLDS_INT(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        lint = 0;
-                        rclib_db_library_data_get(library_data, ltype,
-                            &lint, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                        result = (g_value_get_int(query_data->val)<lint);
-                        break;
-                    }
-                    case G_TYPE_INT64:
-                    {
-                        if(!G_VALUE_HOLDS_INT64(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        lint64 = 0;
-                        rclib_db_library_data_get(library_data, ltype,
-                            &lint64, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                        result = (g_value_get_int64(query_data->val)<lint64);
-                        break;
-                    }
-                    case G_TYPE_DOUBLE:
-                    {
-                        if(!G_VALUE_HOLDS_DOUBLE(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        ldouble = 0;
-                        rclib_db_library_data_get(library_data, ltype,
-                            &ldouble, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                        result = (g_value_get_double(query_data->val) -
-                            ldouble<-10e-5);
-                        break;
-                    }
-                    default:
-                    {
-                        result = FALSE;
-                        break;
-                    }
-                }
-                break;
-            }
-            case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_LESS_OR_EQUAL:
-            {
-               if(query_data->val==NULL)
-                {
-                    result = FALSE;
-                    break;
-                }
-                ltype = rclib_db_library_property_convert(
-                    query_data->propid);
-                dtype = rclib_db_query_get_query_data_type(
-                    query_data->propid);
-                switch(dtype)
-                {
-                    case G_TYPE_STRING:
-                    {
-                        if(!G_VALUE_HOLDS_STRING(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        lstring = NULL;
-                        rclib_db_library_data_get(library_data, ltype,
-                            &lstring, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                        if(lstring==NULL)
-                            lstring = g_strdup("");
-                        if(ltype==RCLIB_DB_LIBRARY_DATA_TYPE_TITLE &&
-                            (lstring==NULL || strlen(lstring)==0))
-                        {
-                            uri = NULL;
-                            if(lstring!=NULL) g_free(lstring);
-                            lstring = NULL;
-                            rclib_db_library_data_get(library_data,
-                                RCLIB_DB_LIBRARY_DATA_TYPE_URI, &uri,
-                                RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                            if(uri!=NULL)
-                            {
-                                lstring = rclib_tag_get_name_from_uri(uri);
-                            }
-                            g_free(uri);
-                        }
-                        result = (g_strcmp0(g_value_get_string(
-                            query_data->val), lstring)<=0);
-                        g_free(lstring);
-                        break;
-                    }
-                    case G_TYPE_INT:
-                    {
-                        if(!G_VALUE_HOLDS_INT(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        lint = 0;
-                        rclib_db_library_data_get(library_data, ltype,
-                            &lint, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                        result = (g_value_get_int(query_data->val)<=lint);
-                        break;
-                    }
-                    case G_TYPE_INT64:
-                    {
-                        if(!G_VALUE_HOLDS_INT64(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        lint64 = 0;
-                        rclib_db_library_data_get(library_data, ltype,
-                            &lint64, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                        result = (g_value_get_int64(query_data->val)<=lint64);
-                        break;
-                    }
-                    case G_TYPE_DOUBLE:
-                    {
-                        if(!G_VALUE_HOLDS_DOUBLE(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        ldouble = 0;
-                        rclib_db_library_data_get(library_data, ltype,
-                            &ldouble, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                        result = (g_value_get_double(query_data->val) -
-                            ldouble<=0);
-                        break;
-                    }
-                    default:
-                    {
-                        result = FALSE;
-                        break;
-                    }
-                }
-                break;
-            }
-            case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_LIKE:
-            {
-                if(query_data->val==NULL)
-                {
-                    result = FALSE;
-                    break;
-                }
-
-                ltype = rclib_db_library_property_convert(
-                    query_data->propid);
-                dtype = rclib_db_query_get_query_data_type(
-                    query_data->propid);
-                switch(dtype)
-                {
-                    case G_TYPE_STRING:
-                    {
-                        if(!G_VALUE_HOLDS_STRING(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        lstring = NULL;
-                        rclib_db_library_data_get(library_data, ltype,
-                            &lstring, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                        if(lstring==NULL)
-                            lstring = g_strdup("");
-                        if(ltype==RCLIB_DB_LIBRARY_DATA_TYPE_TITLE &&
-                            (lstring==NULL || strlen(lstring)==0))
-                        {
-                            uri = NULL;
-                            if(lstring!=NULL) g_free(lstring);
-                            lstring = NULL;
-                            rclib_db_library_data_get(library_data,
-                                RCLIB_DB_LIBRARY_DATA_TYPE_URI, &uri,
-                                RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                            if(uri!=NULL)
-                            {
-                                lstring = rclib_tag_get_name_from_uri(uri);
-                            }
-                            g_free(uri);
-                        }
-                        if(lstring==NULL)
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        result = (g_strstr_len(lstring, -1,
-                            g_value_get_string(query_data->val))!=NULL);
-                        g_free(lstring);
-                        break;
-                    }
-                    default:
-                    {
-                        result = FALSE;
-                        break;
-                    }
-                }
-                break;
-            }
-            case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_NOT_LIKE:
-            {
-                if(query_data->val==NULL)
-                {
-                    result = FALSE;
-                    break;
-                }
-                ltype = rclib_db_library_property_convert(
-                    query_data->propid);
-                dtype = rclib_db_query_get_query_data_type(
-                    query_data->propid);
-                switch(dtype)
-                {
-                    case G_TYPE_STRING:
-                    {
-                        if(!G_VALUE_HOLDS_STRING(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        lstring = NULL;
-                        rclib_db_library_data_get(library_data, ltype,
-                            &lstring, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                        if(lstring==NULL)
-                            lstring = g_strdup("");
-                        if(ltype==RCLIB_DB_LIBRARY_DATA_TYPE_TITLE &&
-                            (lstring==NULL || strlen(lstring)==0))
-                        {
-                            uri = NULL;
-                            if(lstring!=NULL) g_free(lstring);
-                            lstring = NULL;
-                            rclib_db_library_data_get(library_data,
-                                RCLIB_DB_LIBRARY_DATA_TYPE_URI, &uri,
-                                RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                            if(uri!=NULL)
-                            {
-                                lstring = rclib_tag_get_name_from_uri(uri);
-                            }
-                            g_free(uri);
-                        }
-                        if(lstring==NULL)
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        result = (g_strstr_len(lstring, -1,
-                            g_value_get_string(query_data->val))==NULL);
-                        g_free(lstring);
-                        break;
-                    }
-                    default:
-                    {
-                        result = FALSE;
-                        break;
-                    }
-                }
-                break;
-            }
-            case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_PREFIX:
-            {
-                if(query_data->val==NULL)
-                {
-                    result = FALSE;
-                    break;
-                }
-                ltype = rclib_db_library_property_convert(
-                    query_data->propid);
-                dtype = rclib_db_query_get_query_data_type(
-                    query_data->propid);
-                switch(dtype)
-                {
-                    case G_TYPE_STRING:
-                    {
-                        if(!G_VALUE_HOLDS_STRING(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        lstring = NULL;
-                        rclib_db_library_data_get(library_data, ltype,
-                            &lstring, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                        if(lstring==NULL)
-                            lstring = g_strdup("");
-                        if(ltype==RCLIB_DB_LIBRARY_DATA_TYPE_TITLE &&
-                            (lstring==NULL || strlen(lstring)==0))
-                        {
-                            uri = NULL;
-                            if(lstring!=NULL) g_free(lstring);
-                            lstring = NULL;
-                            rclib_db_library_data_get(library_data,
-                                RCLIB_DB_LIBRARY_DATA_TYPE_URI, &uri,
-                                RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                            if(uri!=NULL)
-                            {
-                                lstring = rclib_tag_get_name_from_uri(uri);
-                            }
-                            g_free(uri);
-                        }
-                        result = g_str_has_prefix(lstring,
-                            g_value_get_string(query_data->val));
-                        g_free(lstring);
-                        break;
-                    }
-                    default:
-                    {
-                        result = FALSE;
-                        break;
-                    }
-                }
-                break;
-            }
-            case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_SUFFIX:
-            {
-                if(query_data->val==NULL)
-                {
-                    result = FALSE;
-                    break;
-                }
-                ltype = rclib_db_library_property_convert(
-                    query_data->propid);
-                dtype = rclib_db_query_get_query_data_type(
-                    query_data->propid);
-                switch(dtype)
-                {
-                    case G_TYPE_STRING:
-                    {
-                        if(!G_VALUE_HOLDS_STRING(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        lstring = NULL;
-                        rclib_db_library_data_get(library_data, ltype,
-                            &lstring, RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                        if(lstring==NULL)
-                            lstring = g_strdup("");
-                        if(ltype==RCLIB_DB_LIBRARY_DATA_TYPE_TITLE &&
-                            (lstring==NULL || strlen(lstring)==0))
-                        {
-                            uri = NULL;
-                            if(lstring!=NULL) g_free(lstring);
-                            lstring = NULL;
-                            rclib_db_library_data_get(library_data,
-                                RCLIB_DB_LIBRARY_DATA_TYPE_URI, &uri,
-                                RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                            if(uri!=NULL)
-                            {
-                                lstring = rclib_tag_get_name_from_uri(uri);
-                            }
-                            g_free(uri);
-                        }
-                        result = g_str_has_suffix(lstring,
-                            g_value_get_string(query_data->val));
-                        g_free(lstring);
-                        break;
-                    }
-                    default:
-                    {
-                        result = FALSE;
-                        break;
-                    }
-                }
-                break;
-            }
-            case RCLIB_DB_QUERY_CONDITION_TYPE_OR:
-            {
-                or_flag = TRUE;
-                break;
-            }
-            default:
-            {
-                result = (i==0);
-                break;
-            }
-        }
-        if(or_flag)
-        {
-            if(result) ret = TRUE;
-        }
-        else
-        {
-            if(!result) ret = FALSE;
-        }
-        if(or_flag && query_data->type!=RCLIB_DB_QUERY_CONDITION_TYPE_OR)
-        {
-            or_flag = FALSE;
-        }
+void rclib_db_library_data_uri_get(const gchar *uri,
+    RCLibDbLibraryDataType type1, ...)
+{
+    RCLibDbPrivate *priv;
+    RCLibDbLibraryData *library_data;
+    va_list var_args;
+    GObject *instance;
+    instance = rclib_db_get_instance();
+    if(instance==NULL) return;
+    priv = RCLIB_DB(instance)->priv;
+    if(priv==NULL) return;
+    g_rw_lock_reader_lock(&(priv->library_rw_lock));
+    library_data = g_hash_table_lookup(priv->library_table, uri);
+    if(library_data!=NULL)
+    {
+        va_start(var_args, type1);
+        rclib_db_library_data_get_valist(library_data, type1,
+            var_args);
+        va_end(var_args);
     }
-    if(cancellable!=NULL)
-        g_object_unref(cancellable);
+    g_rw_lock_reader_unlock(&(priv->library_rw_lock));
+}
+
+/**
+ * rclib_db_library_data_query:
+ * @library_data: the library data to check
+ * @query: the query condition
+ * @cancellable: (allow-none): optional #GCancellable object, NULL to ignore
+ *
+ * Check whether the library data satisfied the query condition.
+ * MT safe.
+ * 
+ * Returns: Whether the library data satisfied the query condition.
+ */
+
+gboolean rclib_db_library_data_query(RCLibDbLibraryData *library_data,
+    RCLibDbQuery *query, GCancellable *cancellable)
+{
+    RCLibDbQueryPlan *plan;
+    gboolean ret;
+    if(library_data==NULL || query==NULL)
+        return FALSE;
+    if(cancellable!=NULL && g_cancellable_is_cancelled(cancellable))
+        return FALSE;
+    plan = _rclib_db_query_plan_new(query);
+    ret = rclib_db_library_data_query_plan(library_data, plan);
+    _rclib_db_query_plan_free(plan);
     return ret;
 }
 
+/* Find the library items which satisfy the plan, and add them (or their
+ * URIs if uri_flag is TRUE) to the array. The index is used if the plan
+ * can be answered by it. The library read lock must be held. */
+
 /**
  * rclib_db_library_query:
  * @query: he query condition
@@ -3433,9 +3840,8 @@ GPtrArray *rclib_db_library_query(RCLibDbQuery *query,
     GPtrArray *query_result = NULL;
     GObject *instance;
     RCLibDbPrivate *priv;
-    GHashTableIter iter;
-    RCLibDbLibraryData *library_data = NULL;
-    gchar *uri = NULL;
+    RCLibDbQueryPlan *plan;
+    gboolean value = FALSE;
     instance = rclib_db_get_instance();
     if(instance==NULL) return NULL;
     priv = RCLIB_DB(instance)->priv;
@@ -3444,29 +3850,72 @@ GPtrArray *rclib_db_library_query(RCLibDbQuery *query,
         cancellable = g_object_ref(cancellable);
     query_result = g_ptr_array_new_with_free_func((GDestroyNotify)
         rclib_db_library_data_unref);
-    g_rw_lock_reader_lock(&(priv->library_rw_lock));
-    g_hash_table_iter_init(&iter, priv->library_table);
-    while(g_hash_table_iter_next(&iter, (gpointer *)&uri,
-        (gpointer *)&library_data))
+    plan = _rclib_db_query_plan_new(query);
+    if(_rclib_db_query_plan_is_constant(plan, &value) && !value)
     {
+        _rclib_db_query_plan_free(plan);
         if(cancellable!=NULL)
-        {
-            if(g_cancellable_is_cancelled(cancellable))
-                break;
-        }
-        if(library_data==NULL) continue;
-        if(rclib_db_library_data_query(library_data, query, cancellable))
-        {
-            g_ptr_array_add(query_result, rclib_db_library_data_ref(
-                library_data));
-        }
+            g_object_unref(cancellable);
+        return query_result;
     }
+    g_rw_lock_reader_lock(&(priv->library_rw_lock));
+    query_result = rclib_db_library_query_scan(priv, &plan, NULL, 1,
+        cancellable, query_result, NULL, FALSE, NULL, NULL);
     g_rw_lock_reader_unlock(&(priv->library_rw_lock));
+    _rclib_db_query_plan_free(plan);
     if(cancellable!=NULL) 
         g_object_unref(cancellable);   
     return query_result;
 }
 
+/*
+ * Query data from the music library with the plans like
+ * rclib_db_library_query(), but hand the matched items to chunk_func in
+ * chunks while scanning, so the caller can use the first items before the
+ * scan ends. The first plan is the plan of the query, and the others are
+ * the plans of the chained query results, see the parents and masks in
+ * #RCLibDbLibraryQueryChain. The chunks and masks are transferred to
+ * chunk_func, which may be called from the scan workers at the same time,
+ * and returns FALSE to stop the scan. The scan also stops if cancellable
+ * is cancelled. MT safe.
+ */
+
+void _rclib_db_library_query_chunked(RCLibDbQueryPlan * const *plans,
+    const gint *parents, guint n_plans, GCancellable *cancellable,
+    RCLibDbLibraryQueryChunkFunc chunk_func, gpointer chunk_data)
+{
+    GPtrArray *query_result = NULL;
+    GArray *masks = NULL;
+    GObject *instance;
+    RCLibDbPrivate *priv;
+    gboolean value = FALSE;
+    if(plans==NULL || n_plans==0 || chunk_func==NULL) return;
+    instance = rclib_db_get_instance();
+    if(instance==NULL) return;
+    priv = RCLIB_DB(instance)->priv;
+    if(priv==NULL) return;
+    if(_rclib_db_query_plan_is_constant(plans[0], &value) && !value)
+        return;
+    query_result = g_ptr_array_new_with_free_func((GDestroyNotify)
+        rclib_db_library_data_unref);
+    g_rw_lock_reader_lock(&(priv->library_rw_lock));
+    query_result = rclib_db_library_query_scan(priv, plans, parents,
+        n_plans, cancellable, query_result, &masks, FALSE, chunk_func,
+        chunk_data);
+    g_rw_lock_reader_unlock(&(priv->library_rw_lock));
+    if(query_result->len>0 && (cancellable==NULL ||
+        !g_cancellable_is_cancelled(cancellable)))
+    {
+        chunk_func(query_result, masks, chunk_data);
+    }
+    else
+    {
+        g_ptr_array_free(query_result, TRUE);
+        if(masks!=NULL)
+            g_array_free(masks, TRUE);
+    }
+}
+
 /**
  * rclib_db_library_query_get_uris:
  * @query: he query condition
@@ -3486,9 +3935,8 @@ GPtrArray *rclib_db_library_query_get_uris(RCLibDbQuery *query,
     GPtrArray *query_result = NULL;
     GObject *instance;
     RCLibDbPrivate *priv;
-    GHashTableIter iter;
-    RCLibDbLibraryData *library_data = NULL;
-    gchar *uri = NULL;
+    RCLibDbQueryPlan *plan;
+    gboolean value = FALSE;
     instance = rclib_db_get_instance();
     if(instance==NULL) return NULL;
     priv = RCLIB_DB(instance)->priv;
@@ -3496,23 +3944,19 @@ GPtrArray *rclib_db_library_query_get_uris(RCLibDbQuery *query,
     if(cancellable!=NULL)
         cancellable = g_object_ref(cancellable);
     query_result = g_ptr_array_new_with_free_func(g_free);
-    g_rw_lock_reader_lock(&(priv->library_rw_lock));
-    g_hash_table_iter_init(&iter, priv->library_table);
-    while(g_hash_table_iter_next(&iter, (gpointer *)&uri,
-        (gpointer *)&library_data))
+    plan = _rclib_db_query_plan_new(query);
+    if(_rclib_db_query_plan_is_constant(plan, &value) && !value)
     {
+        _rclib_db_query_plan_free(plan);
         if(cancellable!=NULL)
-        {
-            if(g_cancellable_is_cancelled(cancellable))
-                break;
-        }
-        if(uri==NULL || library_data==NULL) continue;
-        if(rclib_db_library_data_query(library_data, query, cancellable))
-        {
-            g_ptr_array_add(query_result, g_strdup(uri));
-        }
+            g_object_unref(cancellable);
+        return query_result;
     }
+    g_rw_lock_reader_lock(&(priv->library_rw_lock));
+    query_result = rclib_db_library_query_scan(priv, &plan, NULL, 1,
+        cancellable, query_result, NULL, TRUE, NULL, NULL);
     g_rw_lock_reader_unlock(&(priv->library_rw_lock));
+    _rclib_db_query_plan_free(plan);
     if(cancellable!=NULL)
         g_object_unref(cancellable);    
     return query_result;
@@ -3623,6 +4067,7 @@ GObject *rclib_db_library_query_result_new(RCLibDb *db,
         return NULL;
     
     priv->query = rclib_db_query_parse(RCLIB_DB_QUERY_CONDITION_TYPE_NONE);
+    priv->query_plan = _rclib_db_query_plan_new(priv->query);
     
     for(i=0;prop_types!=NULL && prop_types[i]!=RCLIB_DB_QUERY_DATA_TYPE_NONE;
         i++)
@@ -3634,7 +4079,11 @@ GObject *rclib_db_library_query_result_new(RCLibDb *db,
     
     if(base==NULL)
     {
-        priv->query_queue = g_async_queue_new_full(g_free);
+        priv->query_queue = g_async_queue_new_full(
+            (GDestroyNotify)rclib_db_library_query_job_free);
+        priv->load_queue = g_async_queue_new_full(
+            (GDestroyNotify)rclib_db_library_query_job_free);
+        priv->cancellable = g_cancellable_new();
         priv->query_thread = g_thread_new("RC2-Library-Query-Thread",
             rclib_db_library_query_result_query_thread_cb,
             query_result_instance);
@@ -3691,10 +4140,10 @@ void rclib_db_library_query_result_copy_contents(
         if(uri==NULL) continue;
         library_data = rclib_db_library_get_data(uri);
         if(library_data==NULL) continue;
-        if(dst_priv->query!=NULL)
+        if(dst_priv->query_plan!=NULL)
         {
-            if(!rclib_db_library_data_query(library_data, dst_priv->query,
-                NULL))
+            if(!rclib_db_library_data_query_plan(library_data,
+                dst_priv->query_plan))
             {
                 continue;
             }
@@ -3722,6 +4171,11 @@ void rclib_db_library_query_result_copy_contents(
             (gpointer *)&prop_item))
         {
             if(prop_item==NULL) continue;
+            if(prop_item->facet_flag)
+            {
+                rclib_db_library_query_result_facet_schedule(dst);
+                continue;
+            }
             if(rclib_db_query_get_query_data_type((RCLibDbQueryDataType)
                 prop_type)!=G_TYPE_STRING)
             {
@@ -3785,7 +4239,7 @@ void rclib_db_library_query_result_chain(
     gboolean import_entries)
 {
     RCLibDbLibraryQueryResultPrivate *priv, *base_priv;
-    RCLibDbQuery **query_data;
+    RCLibDbLibraryQueryJob *job;
     if(query_result==NULL || base==NULL) return;
     priv = query_result->priv;
     base_priv = base->priv;
@@ -3798,10 +4252,6 @@ void rclib_db_library_query_result_chain(
         g_sequence_free(base_priv->query_sequence);
         base_priv->query_sequence = NULL;
     }
-    if(import_entries)
-    {
-        rclib_db_library_query_result_copy_contents(query_result, base);
-    }
     if(priv->library_added_id>0)
     {
         rclib_db_signal_disconnect(priv->library_added_id);
@@ -3817,11 +4267,13 @@ void rclib_db_library_query_result_chain(
         rclib_db_signal_disconnect(priv->library_deleted_id);
         priv->library_deleted_id = 0;
     }
+    g_atomic_int_inc(&priv->query_serial);
+    if(priv->cancellable!=NULL)
+        g_cancellable_cancel(priv->cancellable);
     if(priv->query_queue!=NULL)
     {
-        query_data = g_new(RCLibDbQuery *, 1);
-        *query_data = NULL;
-        g_async_queue_push(priv->query_queue, query_data);
+        job = g_new0(RCLibDbLibraryQueryJob, 1);
+        g_async_queue_push(priv->query_queue, job);
     }
     if(priv->query_thread!=NULL)
     {
@@ -3833,6 +4285,11 @@ void rclib_db_library_query_result_chain(
         g_async_queue_unref(priv->query_queue);
         priv->query_queue = NULL;
     }
+    if(priv->load_job!=NULL)
+    {
+        rclib_db_library_query_job_free(priv->load_job);
+        priv->load_job = NULL;
+    }
     priv->base_added_id = g_signal_connect(base, "query-result-added",
         G_CALLBACK(rclib_db_library_query_result_base_added_cb), query_result);
     priv->base_delete_id = g_signal_connect(base, "query-result-delete",
@@ -3840,7 +4297,14 @@ void rclib_db_library_query_result_chain(
     priv->base_changed_id = g_signal_connect(base, "query-result-changed",
         G_CALLBACK(rclib_db_library_query_result_base_changed_cb),
         query_result);
+    priv->base_reset_id = g_signal_connect(base, "query-result-reset",
+        G_CALLBACK(rclib_db_library_query_result_base_reset_cb),
+        query_result);
     priv->base_query_result = base;
+    base_priv->chain_children = g_slist_append(base_priv->chain_children,
+        query_result);
+    if(import_entries)
+        rclib_db_library_query_result_load_base(query_result);
 }
 
 /**
@@ -4230,6 +4694,10 @@ void rclib_db_library_query_result_set_query(
         query = rclib_db_query_parse(RCLIB_DB_QUERY_CONDITION_TYPE_NONE);
     }
     priv->query = rclib_db_query_copy(query);
+    if(priv->query_plan!=NULL)
+        _rclib_db_query_plan_free(priv->query_plan);
+    priv->query_plan = _rclib_db_query_plan_new(priv->query);
+    priv->plan_serial++;
 }
 
 /**
@@ -4243,25 +4711,73 @@ void rclib_db_library_query_result_set_query(
 void rclib_db_library_query_result_query_start(
     RCLibDbLibraryQueryResult *query_result, gboolean clear)
 {
-    RCLibDbLibraryQueryResultPrivate *priv;
-    RCLibDbQuery **query_data = NULL;
+    RCLibDbLibraryQueryResultPrivate *priv, *child_priv;
+    RCLibDbLibraryQueryResult *child;
+    RCLibDbLibraryQueryJob *job;
+    RCLibDbLibraryQueryChain *chain;
+    RCLibDbQuery *query;
+    GSList *foreach;
+    guint i;
     if(query_result==NULL) return;
     priv = query_result->priv;
     if(priv==NULL) return;
-    rclib_db_library_query_result_query_clear(query_result);
     if(priv->base_query_result!=NULL)
     {
-        rclib_db_library_query_result_copy_contents(query_result,
-            priv->base_query_result);
+        rclib_db_library_query_result_load_base(query_result);
         return;
     }
+    
+    /* Stop the running query, and drop the items it has found. */
+    g_atomic_int_inc(&priv->query_serial);
+    if(priv->cancellable!=NULL)
+        g_cancellable_cancel(priv->cancellable);
+    if(priv->load_job!=NULL)
+    {
+        rclib_db_library_query_job_free(priv->load_job);
+        priv->load_job = NULL;
+    }
+    rclib_db_library_query_result_query_clear(query_result);
     if(priv->query_queue==NULL) return;
-    query_data = g_new(RCLibDbQuery *, 1);
+    job = g_new0(RCLibDbLibraryQueryJob, 1);
+    job->serial = g_atomic_int_get(&priv->query_serial);
     if(priv->query!=NULL)
-        *query_data = rclib_db_query_copy(priv->query);
+        job->plans[0] = _rclib_db_query_plan_new(priv->query);
     else
-        *query_data = rclib_db_query_parse(RCLIB_DB_QUERY_CONDITION_TYPE_NONE);
-    g_async_queue_push(priv->query_queue, query_data);
+    {
+        query = rclib_db_query_parse(RCLIB_DB_QUERY_CONDITION_TYPE_NONE);
+        job->plans[0] = _rclib_db_query_plan_new(query);
+        rclib_db_query_free(query);
+    }
+    
+    /* Add the queries of the chained query results to the job, so the
+     * scan evaluates all of them in one pass. */
+    chain = &job->chain;
+    chain->query_results[0] = query_result;
+    chain->parents[0] = -1;
+    chain->serials[0] = priv->plan_serial;
+    chain->length = 1;
+    for(i=0;i<chain->length;i++)
+    {
+        child_priv = chain->query_results[i]->priv;
+        for(foreach=child_priv->chain_children;foreach!=NULL &&
+            chain->length<RCLIB_DB_LIBRARY_QUERY_CHAIN_MAX;
+            foreach=g_slist_next(foreach))
+        {
+            child = foreach->data;
+            if(child==NULL || child->priv==NULL) continue;
+            chain->query_results[chain->length] = child;
+            chain->parents[chain->length] = i;
+            chain->serials[chain->length] = child->priv->plan_serial;
+            if(child->priv->query!=NULL)
+            {
+                job->plans[chain->length] = _rclib_db_query_plan_new(
+                    child->priv->query);
+            }
+            chain->length++;
+        }
+    }
+    job->order = priv->load_order;
+    g_async_queue_push(priv->query_queue, job);
 }
 
 /**
@@ -4299,73 +4815,15 @@ void rclib_db_library_query_result_query_clear(
     RCLibDbLibraryQueryResult *query_result)
 {
     RCLibDbLibraryQueryResultPrivate *priv;
-    GSequenceIter *iter;
-    GHashTableIter hash_iter, prop_iter;
-    gchar *uri, *prop_name;
-    guint prop_type;
-    RCLibDbLibraryQueryResultPropItem *prop_item;
     if(query_result==NULL) return;
     priv = RCLIB_DB_LIBRARY_QUERY_RESULT(query_result)->priv;
     if(priv==NULL)
     {
         return;
     }
-    
-    if(priv->query_uri_table!=NULL)
-    {
-        g_hash_table_iter_init(&hash_iter, priv->query_uri_table);
-        while(g_hash_table_iter_next(&hash_iter, (gpointer *)&uri,
-            (gpointer *)&iter))
-        {
-            if(uri!=NULL)
-            {
-                g_signal_emit(query_result, db_library_query_result_signals[
-                    SIGNAL_LIBRARY_QUERY_RESULT_DELETE], 0, uri);
-            }
-            if(iter!=NULL)
-            {
-                g_sequence_remove(iter);
-            }
-        }
-    }
-
-    if(priv->query_iter_table!=NULL)
-        g_hash_table_remove_all(priv->query_iter_table);
-    if(priv->query_uri_table)
-        g_hash_table_remove_all(priv->query_uri_table);
-    
-    if(priv->prop_table!=NULL)
-    {
-        g_hash_table_iter_init(&hash_iter, priv->prop_table);
-        while(g_hash_table_iter_next(&hash_iter, (gpointer *)&prop_type,
-            (gpointer *)&prop_item))
-        {
-            if(prop_item==NULL) continue;
-            if(prop_item->prop_name_table!=NULL)
-            {
-                g_hash_table_iter_init(&prop_iter, prop_item->prop_name_table);
-                while(g_hash_table_iter_next(&prop_iter, (gpointer *)&prop_name,
-                    (gpointer *)&iter))
-                {
-                    if(prop_name==NULL) continue;
-                    g_signal_emit(query_result,
-                        db_library_query_result_signals[
-                        SIGNAL_LIBRARY_QUERY_RESULT_PROP_DELETE], 0, prop_type, 
-                        prop_name);
-                    if(iter!=NULL)
-                        g_sequence_remove(iter);
-                }
-            }
-
-            if(prop_item->prop_iter_table!=NULL)
-                g_hash_table_remove_all(prop_item->prop_iter_table);
-            if(prop_item->prop_name_table)
-                g_hash_table_remove_all(prop_item->prop_name_table);
-            if(prop_item->prop_uri_table)
-                g_hash_table_remove_all(prop_item->prop_uri_table);
-            prop_item->count = 0;
-        }
-    }
+    rclib_db_library_query_result_reset_contents(priv);
+    g_signal_emit(query_result, db_library_query_result_signals[
+        SIGNAL_LIBRARY_QUERY_RESULT_RESET], 0);
 }
 
 /**
@@ -4403,161 +4861,74 @@ void rclib_db_library_query_result_sort(
     RCLibDbLibraryQueryResult *query_result, RCLibDbLibraryDataType column,
     gboolean direction)
 {
-    RCLibDbLibraryQueryResultPrivate *priv;
-    gint i;
+    rclib_db_library_query_result_sort_multi(query_result, &column, 1,
+        direction);
+}
+
+/**
+ * rclib_db_library_query_result_sort_multi:
+ * @query_result: the #RCLibDbLibraryQueryResult instance
+ * @columns: (array length=n_columns): the columns to sort
+ * @n_columns: the number of the columns
+ * @direction: the sort direction, #FALSE to use ascending, #TRUE to use
+ *     descending
+ * 
+ * Sort the query result items by the given @columns, the items which
+ * have the same value in a column are sorted by the next column, e.g.
+ * artist, album, and then track number. The items added later are also
+ * kept in this order.
+ */
+
+void rclib_db_library_query_result_sort_multi(
+    RCLibDbLibraryQueryResult *query_result,
+    const RCLibDbLibraryDataType *columns, guint n_columns,
+    gboolean direction)
+{
+    RCLibDbLibraryQueryResultPrivate *priv, *base_priv;
+    RCLibDbQueryDataType sort_columns[RCLIB_DB_SORT_COLUMN_MAX];
+    RCLibDbLibraryQueryResult *base;
     gint *order = NULL;
-    GHashTable *new_positions, *sort_table;
-    GSequenceIter *ptr;
-    gint length;
-    GType column_type = G_TYPE_NONE;
-    if(query_result==NULL) return;
+    gint length = 0;
+    guint i;
+    if(query_result==NULL || columns==NULL || n_columns==0) return;
     priv = RCLIB_DB_LIBRARY_QUERY_RESULT(query_result)->priv;
-    GVariant *variant;
-    RCLibDbLibraryData *library_data;
     if(priv==NULL) return;
-    switch(column)
+    if(n_columns>RCLIB_DB_SORT_COLUMN_MAX)
+        n_columns = RCLIB_DB_SORT_COLUMN_MAX;
+    for(i=0;i<n_columns;i++)
     {
-        case RCLIB_DB_LIBRARY_DATA_TYPE_TITLE:
-        case RCLIB_DB_LIBRARY_DATA_TYPE_ARTIST:
-        case RCLIB_DB_LIBRARY_DATA_TYPE_ALBUM:
-        case RCLIB_DB_LIBRARY_DATA_TYPE_FTYPE:
-        case RCLIB_DB_LIBRARY_DATA_TYPE_GENRE:
-        {
-            column_type = G_TYPE_STRING;
-            break;
-        }
-        case RCLIB_DB_LIBRARY_DATA_TYPE_LENGTH:
-        {
-            column_type = G_TYPE_INT64;
-            break;
-        }
-        case RCLIB_DB_LIBRARY_DATA_TYPE_TRACKNUM:
-        case RCLIB_DB_LIBRARY_DATA_TYPE_YEAR:
-        {
-            column_type = G_TYPE_INT;
-            break;
-        }
-        case RCLIB_DB_LIBRARY_DATA_TYPE_RATING:
-        {
-            column_type = G_TYPE_FLOAT;
-            break;
-        }
-        default:
+        sort_columns[i] = rclib_db_library_data_type_to_query_type(
+            columns[i]);
+        if(sort_columns[i]==RCLIB_DB_QUERY_DATA_TYPE_NONE)
         {
-            g_warning("Error column type: %u", column);
+            g_warning("Error column type: %u", columns[i]);
             return;
-            break;
-        }
-    }
-    sort_table = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
-        (GDestroyNotify)g_variant_unref);
-    new_positions = g_hash_table_new(g_direct_hash, g_direct_equal);
-    for(i=0, ptr=g_sequence_get_begin_iter(priv->query_sequence);
-        ptr!=NULL && !g_sequence_iter_is_end(ptr);
-        ptr=g_sequence_iter_next(ptr))
-    {
-        variant = NULL;
-        library_data = g_sequence_get(ptr);
-        switch(column_type)
-        {
-            case G_TYPE_STRING:
-            {
-                gchar *vstr = NULL;
-                gchar *cstr = NULL;
-                gchar *uri = NULL;
-                if(library_data!=NULL)
-                {
-                    rclib_db_library_data_get(library_data, column, &vstr,
-                        RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                    if(column==RCLIB_DB_LIBRARY_DATA_TYPE_TITLE &&
-                        (vstr==NULL || strlen(vstr)==0))
-                    {
-                        rclib_db_library_data_get(library_data,
-                            RCLIB_DB_LIBRARY_DATA_TYPE_URI, &uri,
-                            RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                        if(uri!=NULL)
-                            vstr = rclib_tag_get_name_from_uri(uri);
-                        g_free(uri);
-                    }
-                }                
-                if(vstr==NULL) vstr = g_strdup("");
-                cstr = g_utf8_casefold(vstr, -1);
-                variant = g_variant_new_string(cstr);
-                g_free(cstr);
-                g_free(vstr);
-                break;
-            }
-            case G_TYPE_INT:
-            {
-                gint vint = 0;
-                if(library_data!=NULL)
-                {
-                    rclib_db_library_data_get(library_data, column, &vint,
-                        RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                }
-                variant = g_variant_new_int32(vint);
-                break;
-            }
-            case G_TYPE_INT64:
-            {
-                gint64 vint64 = 0;
-                if(library_data!=NULL)
-                {
-                    rclib_db_library_data_get(library_data, column, &vint64,
-                        RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                }
-                variant = g_variant_new_int64(vint64);
-                break;
-            }
-            case G_TYPE_FLOAT:
-            {
-                gfloat vfloat = 0;
-                if(library_data!=NULL)
-                {
-                    rclib_db_library_data_get(library_data, column, &vfloat,
-                        RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                }
-                variant = g_variant_new_double(vfloat);
-                break;
-            }
-            default:
-            {
-                variant = g_variant_new_boolean(FALSE);
-                g_warning("Wrong column data type, this should not happen!");
-                break;
-            }
         }
-        g_hash_table_insert(new_positions, ptr, GINT_TO_POINTER(i));
-        g_hash_table_insert(sort_table, ptr, g_variant_take_ref(variant));
-        i++;
-    }
-    if(direction)
-    {
-        g_sequence_sort_iter(priv->query_sequence,
-            rclib_db_variant_sort_dsc_func, sort_table);
-    }
-    else
-    {
-        g_sequence_sort_iter(priv->query_sequence,
-            rclib_db_variant_sort_asc_func, sort_table);
     }
-    g_hash_table_destroy(sort_table);
-    length = g_hash_table_size(new_positions);
-    order = g_new(gint, length);
-    for(i=0, ptr=g_sequence_get_begin_iter(priv->query_sequence);
-        ptr!=NULL && !g_sequence_iter_is_end(ptr);
-        ptr=g_sequence_iter_next(ptr))
+    memcpy(priv->sort_columns, sort_columns, n_columns *
+        sizeof(RCLibDbQueryDataType));
+    priv->sort_column_num = n_columns;
+    priv->sort_direction = direction;
+    memcpy(priv->load_order.columns, sort_columns, n_columns *
+        sizeof(RCLibDbQueryDataType));
+    priv->load_order.column_num = n_columns;
+    priv->load_order.direction = direction;
+
+    /* Let the base query results sort their results in the query thread
+     * in this order, so this query result only appends the items. */
+    for(base=priv->base_query_result;base!=NULL;
+        base=base_priv->base_query_result)
     {
-        order[i] = GPOINTER_TO_INT(g_hash_table_lookup(new_positions,
-            ptr));
-        i++;
+        base_priv = base->priv;
+        if(base_priv==NULL) break;
+        base_priv->load_order = priv->load_order;
     }
-    g_hash_table_destroy(new_positions);
+    order = _rclib_db_sort_sequence(priv->query_sequence, FALSE,
+        priv->sort_columns, priv->sort_column_num, direction, &length);
+    if(order==NULL) return;
     g_signal_emit(query_result, db_library_query_result_signals[
         SIGNAL_LIBRARY_QUERY_RESULT_REORDERED], 0, order);
     g_free(order);
-    priv->sort_column = column;
-    priv->sort_direction = direction;
 }
 
 /**
@@ -51,8 +51,219 @@ struct _RCLibDbPlaylistIter
     gint dummy;
 };
 
+/*
+ * All playlist items are kept in a dense array, and also in the array
+ * of the bucket of their rating (one bucket for each distinct rating),
+ * so a random item (with or without a rating limit) can be picked by
+ * its position without walking all items, the cost only depends on the
+ * number of the distinct ratings. An item is removed from the arrays by
+ * moving the last item of the array to its position. The entries are
+ * kept by the random mutex, which is always the last lock taken.
+ */
+
+struct _RCLibDbPlaylistRatingBucket
+{
+    gfloat rating;
+    GPtrArray *entries;
+};
+
+struct _RCLibDbPlaylistRandomEntry
+{
+    RCLibDbPlaylistIter *iter;
+    RCLibDbPlaylistRatingBucket *bucket;
+    guint position;
+    guint bucket_position;
+};
+
 static gint db_import_depth = 5;
 
+static void rclib_db_playlist_rating_bucket_free(gpointer data)
+{
+    RCLibDbPlaylistRatingBucket *bucket =
+        (RCLibDbPlaylistRatingBucket *)data;
+    if(bucket==NULL) return;
+    g_ptr_array_free(bucket->entries, TRUE);
+    g_free(bucket);
+}
+
+static inline gboolean rclib_db_playlist_rating_match(gfloat prating,
+    gboolean condition, gfloat rating)
+{
+    if(prating<0.0) return FALSE;
+    return (prating<=rating && condition) || (prating>=rating && !condition);
+}
+
+static inline void rclib_db_playlist_random_array_remove(GPtrArray *array,
+    guint position, gboolean bucket_flag)
+{
+    RCLibDbPlaylistRandomEntry *moved;
+    g_ptr_array_remove_index_fast(array, position);
+    if(position>=array->len) return;
+    moved = g_ptr_array_index(array, position);
+    if(bucket_flag)
+        moved->bucket_position = position;
+    else
+        moved->position = position;
+}
+
+/* Put the entry into the bucket of the rating, create it if needed. */
+static void rclib_db_playlist_random_bucket_add(RCLibDbPrivate *priv,
+    RCLibDbPlaylistRandomEntry *entry, gfloat rating)
+{
+    RCLibDbPlaylistRatingBucket *bucket = NULL;
+    guint i;
+    for(i=0;i<priv->playlist_rating_buckets->len;i++)
+    {
+        bucket = g_ptr_array_index(priv->playlist_rating_buckets, i);
+        if(bucket->rating==rating) break;
+    }
+    if(i>=priv->playlist_rating_buckets->len)
+    {
+        bucket = g_new0(RCLibDbPlaylistRatingBucket, 1);
+        bucket->rating = rating;
+        bucket->entries = g_ptr_array_new();
+        g_ptr_array_add(priv->playlist_rating_buckets, bucket);
+    }
+    entry->bucket = bucket;
+    entry->bucket_position = bucket->entries->len;
+    g_ptr_array_add(bucket->entries, entry);
+}
+
+/* Take the entry out of its bucket, drop the bucket if it is empty. */
+static void rclib_db_playlist_random_bucket_remove(RCLibDbPrivate *priv,
+    RCLibDbPlaylistRandomEntry *entry)
+{
+    RCLibDbPlaylistRatingBucket *bucket = entry->bucket;
+    if(bucket==NULL) return;
+    rclib_db_playlist_random_array_remove(bucket->entries,
+        entry->bucket_position, TRUE);
+    entry->bucket = NULL;
+    if(bucket->entries->len==0)
+        g_ptr_array_remove_fast(priv->playlist_rating_buckets, bucket);
+}
+
+static void rclib_db_playlist_random_add(RCLibDbPrivate *priv,
+    RCLibDbPlaylistIter *iter, RCLibDbPlaylistData *data)
+{
+    RCLibDbPlaylistRandomEntry *entry;
+    if(priv->playlist_random_table==NULL || iter==NULL || data==NULL)
+        return;
+    g_rw_lock_reader_lock(&(data->lock));
+    g_mutex_lock(&(priv->playlist_random_mutex));
+    if(g_hash_table_contains(priv->playlist_random_table, iter))
+    {
+        g_mutex_unlock(&(priv->playlist_random_mutex));
+        g_rw_lock_reader_unlock(&(data->lock));
+        return;
+    }
+    entry = g_new0(RCLibDbPlaylistRandomEntry, 1);
+    entry->iter = iter;
+    entry->position = priv->playlist_random_array->len;
+    g_ptr_array_add(priv->playlist_random_array, entry);
+    rclib_db_playlist_random_bucket_add(priv, entry, data->rating);
+    g_hash_table_insert(priv->playlist_random_table, iter, entry);
+    g_mutex_unlock(&(priv->playlist_random_mutex));
+    g_rw_lock_reader_unlock(&(data->lock));
+}
+
+static void rclib_db_playlist_random_remove(RCLibDbPrivate *priv,
+    RCLibDbPlaylistIter *iter)
+{
+    RCLibDbPlaylistRandomEntry *entry;
+    if(priv->playlist_random_table==NULL || iter==NULL) return;
+    g_mutex_lock(&(priv->playlist_random_mutex));
+    entry = g_hash_table_lookup(priv->playlist_random_table, iter);
+    if(entry!=NULL)
+    {
+        rclib_db_playlist_random_array_remove(priv->playlist_random_array,
+            entry->position, FALSE);
+        rclib_db_playlist_random_bucket_remove(priv, entry);
+        g_hash_table_remove(priv->playlist_random_table, iter);
+    }
+    g_mutex_unlock(&(priv->playlist_random_mutex));
+}
+
+static void rclib_db_playlist_random_set_rating(RCLibDbPlaylistIter *iter,
+    gfloat rating)
+{
+    RCLibDbPlaylistRandomEntry *entry;
+    RCLibDbPrivate *priv;
+    GObject *instance;
+    instance = rclib_db_get_instance();
+    if(instance==NULL || iter==NULL) return;
+    priv = RCLIB_DB(instance)->priv;
+    if(priv==NULL || priv->playlist_random_table==NULL) return;
+    g_mutex_lock(&(priv->playlist_random_mutex));
+    entry = g_hash_table_lookup(priv->playlist_random_table, iter);
+    if(entry!=NULL && (entry->bucket==NULL ||
+        entry->bucket->rating!=rating))
+    {
+        rclib_db_playlist_random_bucket_remove(priv, entry);
+        rclib_db_playlist_random_bucket_add(priv, entry, rating);
+    }
+    g_mutex_unlock(&(priv->playlist_random_mutex));
+}
+
+/*
+ * Pick a random item in all catalogs. With a rating limit, the buckets
+ * which match the limit are weighted by their sizes, and the item is
+ * picked by its position in the chosen bucket.
+ */
+
+static RCLibDbPlaylistIter *rclib_db_playlist_random_pick(
+    RCLibDbPrivate *priv, gboolean rating_limit, gboolean condition,
+    gfloat rating)
+{
+    RCLibDbPlaylistRandomEntry *entry;
+    RCLibDbPlaylistRatingBucket *bucket;
+    RCLibDbPlaylistIter *result_iter = NULL;
+    guint i, total = 0, pos;
+    if(priv->playlist_random_table==NULL) return NULL;
+    g_mutex_lock(&(priv->playlist_random_mutex));
+    if(!rating_limit)
+    {
+        if(priv->playlist_random_array->len>0)
+        {
+            pos = g_random_int_range(0, priv->playlist_random_array->len);
+            entry = g_ptr_array_index(priv->playlist_random_array, pos);
+            result_iter = entry->iter;
+        }
+        g_mutex_unlock(&(priv->playlist_random_mutex));
+        return result_iter;
+    }
+    for(i=0;i<priv->playlist_rating_buckets->len;i++)
+    {
+        bucket = g_ptr_array_index(priv->playlist_rating_buckets, i);
+        if(rclib_db_playlist_rating_match(bucket->rating, condition,
+            rating))
+        {
+            total += bucket->entries->len;
+        }
+    }
+    if(total>0)
+    {
+        pos = g_random_int_range(0, total);
+        for(i=0;i<priv->playlist_rating_buckets->len;i++)
+        {
+            bucket = g_ptr_array_index(priv->playlist_rating_buckets, i);
+            if(!rclib_db_playlist_rating_match(bucket->rating, condition,
+                rating))
+            {
+                continue;
+            }
+            if(pos<bucket->entries->len)
+            {
+                entry = g_ptr_array_index(bucket->entries, pos);
+                result_iter = entry->iter;
+                break;
+            }
+            pos -= bucket->entries->len;
+        }
+    }
+    g_mutex_unlock(&(priv->playlist_random_mutex));
+    return result_iter;
+}
+
 static inline void rclib_db_playlist_import_idle_data_free(
     RCLibDbPlaylistImportIdleData *data)
 {
@@ -90,14 +301,17 @@ gboolean _rclib_db_playlist_import_idle_cb(gpointer data)
     playlist_data->type = idle_data->type;
     playlist_data->uri = g_strdup(mmd->uri);
     playlist_data->title = g_strdup(mmd->title);
-    playlist_data->artist = g_strdup(mmd->artist);
-    playlist_data->album = g_strdup(mmd->album);
-    playlist_data->ftype = g_strdup(mmd->ftype);
-    playlist_data->genre = g_strdup(mmd->genre);
+    playlist_data->artist = _rclib_db_string_intern(mmd->artist);
+    playlist_data->album = _rclib_db_string_intern(mmd->album);
+    playlist_data->ftype = _rclib_db_string_intern(mmd->ftype);
+    playlist_data->genre = _rclib_db_string_intern(mmd->genre);
     playlist_data->length = mmd->length;
     playlist_data->tracknum = mmd->tracknum;
     playlist_data->year = mmd->year;
     playlist_data->rating = 3.0;
+    playlist_data->mtime = idle_data->fingerprint.mtime;
+    playlist_data->filesize = idle_data->fingerprint.filesize;
+    playlist_data->inode = idle_data->fingerprint.inode;
     _rclib_db_playlist_append_data_internal(idle_data->catalog_iter,
         idle_data->playlist_insert_iter, playlist_data);
     priv->dirty_flag = TRUE;
@@ -128,7 +342,10 @@ gboolean _rclib_db_playlist_refresh_idle_cb(gpointer data)
     }
     mmd = idle_data->mmd;
     rclib_db_playlist_data_iter_set(idle_data->playlist_iter,
-        RCLIB_DB_PLAYLIST_DATA_TYPE_TYPE, idle_data->type,        
+        RCLIB_DB_PLAYLIST_DATA_TYPE_TYPE, idle_data->type,
+        RCLIB_DB_PLAYLIST_DATA_TYPE_MTIME, idle_data->fingerprint.mtime,
+        RCLIB_DB_PLAYLIST_DATA_TYPE_FILESIZE, idle_data->fingerprint.filesize,
+        RCLIB_DB_PLAYLIST_DATA_TYPE_INODE, idle_data->fingerprint.inode,
         RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
     if(mmd!=NULL)
     {
@@ -163,6 +380,14 @@ gboolean _rclib_db_instance_init_playlist(RCLibDb *db, RCLibDbPrivate *priv)
     priv->playlist_iter_table = g_hash_table_new_full(g_direct_hash,
         g_direct_equal, NULL, NULL);
         
+    /* GHashTable<RCLibDbPlaylistIter *, RCLibDbPlaylistRandomEntry *> */
+    g_mutex_init(&(priv->playlist_random_mutex));
+    priv->playlist_random_table = g_hash_table_new_full(g_direct_hash,
+        g_direct_equal, NULL, g_free);
+    priv->playlist_random_array = g_ptr_array_new();
+    priv->playlist_rating_buckets = g_ptr_array_new_with_free_func(
+        rclib_db_playlist_rating_bucket_free);
+        
     /* RCLibDbCatalogSequence<RCLibDbCatalogData *> */
     priv->catalog = (RCLibDbCatalogSequence *)g_sequence_new((GDestroyNotify)
         rclib_db_catalog_data_unref);
@@ -188,6 +413,18 @@ void _rclib_db_instance_finalize_playlist(RCLibDbPrivate *priv)
     priv->catalog = NULL;
     priv->catalog_iter_table = NULL;
     priv->playlist_iter_table = NULL;
+    g_mutex_lock(&(priv->playlist_random_mutex));
+    if(priv->playlist_random_array!=NULL)
+        g_ptr_array_free(priv->playlist_random_array, TRUE);
+    if(priv->playlist_rating_buckets!=NULL)
+        g_ptr_array_free(priv->playlist_rating_buckets, TRUE);
+    priv->playlist_rating_buckets = NULL;
+    if(priv->playlist_random_table!=NULL)
+        g_hash_table_destroy(priv->playlist_random_table);
+    priv->playlist_random_array = NULL;
+    priv->playlist_random_table = NULL;
+    g_mutex_unlock(&(priv->playlist_random_mutex));
+    g_mutex_clear(&(priv->playlist_random_mutex));
     g_rw_lock_writer_unlock(&(priv->catalog_rw_lock));
     g_rw_lock_writer_unlock(&(priv->playlist_rw_lock));
     g_rw_lock_clear(&(priv->catalog_rw_lock));
@@ -205,9 +442,11 @@ void _rclib_db_instance_finalize_playlist(RCLibDbPrivate *priv)
 
 RCLibDbCatalogData *rclib_db_catalog_data_new()
 {
+    static volatile gint journal_id = 0;
     RCLibDbCatalogData *data = g_slice_new0(RCLibDbCatalogData);
     g_rw_lock_init(&(data->lock));
     data->ref_count = 1;
+    data->journal_id = (guint)g_atomic_int_add(&journal_id, 1);
     return data;
 }
 
@@ -398,8 +637,10 @@ static inline gboolean rclib_db_playlist_data_set_valist(
     RCLibDbPlaylistType new_type;
     const gchar *str;   
     gint64 length;
+    guint64 inode;
     gint vint;
     gdouble rating;
+    gboolean rating_flag = FALSE;
     type = type1;
     g_rw_lock_writer_lock(&(data->lock));
     while(type!=RCLIB_DB_PLAYLIST_DATA_TYPE_NONE)
@@ -448,8 +689,8 @@ static inline gboolean rclib_db_playlist_data_set_valist(
             {
                 str = va_arg(var_args, const gchar *);
                 if(g_strcmp0(str, data->artist)==0) break;
-                if(data->artist!=NULL) g_free(data->artist);
-                data->artist = g_strdup(str);
+                _rclib_db_string_release(data->artist);
+                data->artist = _rclib_db_string_intern(str);
                 send_signal = TRUE;
                 break;
             }
@@ -457,8 +698,8 @@ static inline gboolean rclib_db_playlist_data_set_valist(
             {
                 str = va_arg(var_args, const gchar *);
                 if(g_strcmp0(str, data->album)==0) break;
-                if(data->album!=NULL) g_free(data->album);
-                data->album = g_strdup(str);
+                _rclib_db_string_release(data->album);
+                data->album = _rclib_db_string_intern(str);
                 send_signal = TRUE;
                 break;
             }
@@ -466,8 +707,8 @@ static inline gboolean rclib_db_playlist_data_set_valist(
             {
                 str = va_arg(var_args, const gchar *);
                 if(g_strcmp0(str, data->ftype)==0) break;
-                if(data->ftype!=NULL) g_free(data->ftype);
-                data->ftype = g_strdup(str);
+                _rclib_db_string_release(data->ftype);
+                data->ftype = _rclib_db_string_intern(str);
                 send_signal = TRUE;
                 break;
             }
@@ -500,6 +741,7 @@ static inline gboolean rclib_db_playlist_data_set_valist(
                 rating = va_arg(var_args, gdouble);
                 if(rating==data->rating) break;
                 data->rating = rating;
+                rating_flag = TRUE;
                 send_signal = TRUE;
                 break;
             }
@@ -535,8 +777,32 @@ static inline gboolean rclib_db_playlist_data_set_valist(
             {
                 str = va_arg(var_args, const gchar *);
                 if(g_strcmp0(str, data->genre)==0) break;
-                if(data->genre!=NULL) g_free(data->genre);
-                data->genre = g_strdup(str);
+                _rclib_db_string_release(data->genre);
+                data->genre = _rclib_db_string_intern(str);
+                send_signal = TRUE;
+                break;
+            }
+            case RCLIB_DB_PLAYLIST_DATA_TYPE_MTIME:
+            {
+                length = va_arg(var_args, gint64);
+                if(data->mtime==length) break;
+                data->mtime = length;
+                send_signal = TRUE;
+                break;
+            }
+            case RCLIB_DB_PLAYLIST_DATA_TYPE_FILESIZE:
+            {
+                length = va_arg(var_args, gint64);
+                if(data->filesize==length) break;
+                data->filesize = length;
+                send_signal = TRUE;
+                break;
+            }
+            case RCLIB_DB_PLAYLIST_DATA_TYPE_INODE:
+            {
+                inode = va_arg(var_args, guint64);
+                if(data->inode==inode) break;
+                data->inode = inode;
                 send_signal = TRUE;
                 break;
             }
@@ -549,6 +815,9 @@ static inline gboolean rclib_db_playlist_data_set_valist(
         }
         type = va_arg(var_args, RCLibDbPlaylistDataType);
     }
+    if(send_signal) _rclib_db_sort_keys_clear(data->sort_keys);
+    if(rating_flag && data->self_iter!=NULL)
+        rclib_db_playlist_random_set_rating(data->self_iter, data->rating);
     g_rw_lock_writer_unlock(&(data->lock));
     return send_signal;
 }
@@ -563,6 +832,7 @@ static inline void rclib_db_playlist_data_get_valist(
     RCLibDbPlaylistType *playlist_type;
     gchar **str;   
     gint64 *length;
+    guint64 *inode;
     gint *vint;
     gfloat *rating;
     type = type1;
@@ -666,7 +936,25 @@ static inline void rclib_db_playlist_data_get_valist(
                 str = va_arg(var_args, gchar **);
                 *str = g_strdup(data->genre);
                 break;
-            }            
+            }
+            case RCLIB_DB_PLAYLIST_DATA_TYPE_MTIME:
+            {
+                length = va_arg(var_args, gint64 *);
+                *length = data->mtime;
+                break;
+            }
+            case RCLIB_DB_PLAYLIST_DATA_TYPE_FILESIZE:
+            {
+                length = va_arg(var_args, gint64 *);
+                *length = data->filesize;
+                break;
+            }
+            case RCLIB_DB_PLAYLIST_DATA_TYPE_INODE:
+            {
+                inode = va_arg(var_args, guint64 *);
+                *inode = data->inode;
+                break;
+            }
             default:
             {
                 g_warning("rclib_db_playlist_data_get: Wrong data type %d!",
@@ -871,11 +1159,11 @@ void rclib_db_playlist_data_free(RCLibDbPlaylistData *data)
     data->uri = NULL;
     g_free(data->title);
     data->title = NULL;
-    g_free(data->artist);
+    _rclib_db_string_release(data->artist);
     data->artist = NULL;
-    g_free(data->album);
+    _rclib_db_string_release(data->album);
     data->album = NULL;
-    g_free(data->ftype);
+    _rclib_db_string_release(data->ftype);
     data->ftype = NULL;
     g_free(data->lyricfile);
     data->lyricfile = NULL;
@@ -883,8 +1171,9 @@ void rclib_db_playlist_data_free(RCLibDbPlaylistData *data)
     data->lyricsecfile = NULL;
     g_free(data->albumfile);
     data->albumfile = NULL;
-    g_free(data->genre);
+    _rclib_db_string_release(data->genre);
     data->genre = NULL;
+    _rclib_db_sort_keys_clear(data->sort_keys);
     g_rw_lock_writer_unlock(&(data->lock));
     g_rw_lock_clear(&(data->lock));
     g_slice_free(RCLibDbPlaylistData, data);
@@ -947,6 +1236,101 @@ void rclib_db_playlist_data_get(RCLibDbPlaylistData *data,
     va_end(var_args);
 }
 
+/**
+ * rclib_db_playlist_data_get_interned:
+ * @data: the #RCLibDbPlaylistData data
+ * @type: the property to get, must be #RCLIB_DB_PLAYLIST_DATA_TYPE_ARTIST,
+ *     #RCLIB_DB_PLAYLIST_DATA_TYPE_ALBUM, #RCLIB_DB_PLAYLIST_DATA_TYPE_FTYPE
+ *     or #RCLIB_DB_PLAYLIST_DATA_TYPE_GENRE
+ *
+ * Get a string property of a #RCLibDbPlaylistData without copying it.
+ * The string is shared in the string pool, it is valid until the
+ * property is changed or @data is freed, use rclib_db_playlist_data_get()
+ * instead if the string should be kept. MT safe.
+ *
+ * Returns: (transfer none): The shared string, do not modify or free it.
+ */
+
+const gchar *rclib_db_playlist_data_get_interned(RCLibDbPlaylistData *data,
+    RCLibDbPlaylistDataType type)
+{
+    const gchar *str = NULL;
+    if(data==NULL) return NULL;
+    g_rw_lock_reader_lock(&(data->lock));
+    switch(type)
+    {
+        case RCLIB_DB_PLAYLIST_DATA_TYPE_ARTIST:
+            str = data->artist;
+            break;
+        case RCLIB_DB_PLAYLIST_DATA_TYPE_ALBUM:
+            str = data->album;
+            break;
+        case RCLIB_DB_PLAYLIST_DATA_TYPE_FTYPE:
+            str = data->ftype;
+            break;
+        case RCLIB_DB_PLAYLIST_DATA_TYPE_GENRE:
+            str = data->genre;
+            break;
+        default:
+            g_warning("The property is not stored in the string pool!");
+            break;
+    }
+    g_rw_lock_reader_unlock(&(data->lock));
+    return str;
+}
+
+/**
+ * rclib_db_playlist_data_view_begin:
+ * @data: the #RCLibDbPlaylistData data
+ * @view: (out caller-allocates): the view to fill
+ *
+ * Fill @view with the properties of @data without copying them, and keep
+ * @data locked for reading until rclib_db_playlist_data_view_end() is
+ * called, so that a lot of items can be scanned without allocating
+ * memory. Do not modify @data or call this function on @data again before
+ * the view is ended. MT safe.
+ */
+
+void rclib_db_playlist_data_view_begin(RCLibDbPlaylistData *data,
+    RCLibDbPlaylistDataView *view)
+{
+    if(view==NULL) return;
+    memset(view, 0, sizeof(RCLibDbPlaylistDataView));
+    if(data==NULL) return;
+    g_rw_lock_reader_lock(&(data->lock));
+    view->type = data->type;
+    view->uri = data->uri;
+    view->title = data->title;
+    view->artist = data->artist;
+    view->album = data->album;
+    view->ftype = data->ftype;
+    view->genre = data->genre;
+    view->length = data->length;
+    view->tracknum = data->tracknum;
+    view->year = data->year;
+    view->rating = data->rating;
+    view->lyricfile = data->lyricfile;
+    view->lyricsecfile = data->lyricsecfile;
+    view->albumfile = data->albumfile;
+}
+
+/**
+ * rclib_db_playlist_data_view_end:
+ * @data: the #RCLibDbPlaylistData data
+ * @view: the view filled by rclib_db_playlist_data_view_begin()
+ *
+ * End the view of @data, and unlock @data. The strings in @view must not
+ * be used after this call. MT safe.
+ */
+
+void rclib_db_playlist_data_view_end(RCLibDbPlaylistData *data,
+    RCLibDbPlaylistDataView *view)
+{
+    if(data==NULL || view==NULL) return;
+    memset(view, 0, sizeof(RCLibDbPlaylistDataView));
+    g_rw_lock_reader_unlock(&(data->lock));
+}
+
 /**
  * rclib_db_playlist_data_iter_set: (skip)
  * @iter: the #RCLibDbPlaylistIter iter
@@ -2385,6 +2769,7 @@ void rclib_db_catalog_delete(RCLibDbCatalogIter *iter)
             (GSequenceIter *)iter_foreach))
         {
             g_hash_table_remove(priv->playlist_iter_table, iter_foreach);
+            rclib_db_playlist_random_remove(priv, iter_foreach);
         }
         g_rw_lock_writer_unlock(&(priv->playlist_rw_lock));
         rclib_db_catalog_data_iter_set(iter,
@@ -2509,6 +2894,8 @@ RCLibDbPlaylistIter *_rclib_db_playlist_append_data_internal(
     {
         g_hash_table_replace(priv->playlist_iter_table, playlist_iter,
             playlist_iter);
+        rclib_db_playlist_random_add(priv, playlist_iter,
+            playlist_data);
     }
     g_rw_lock_writer_unlock(&(priv->playlist_rw_lock));
     g_rw_lock_reader_unlock(&(priv->catalog_rw_lock));
@@ -2626,6 +3013,7 @@ void rclib_db_playlist_delete(RCLibDbPlaylistIter *iter)
     G_STMT_START
     {
         if(!g_hash_table_contains(priv->playlist_iter_table, iter)) break;
+        rclib_db_playlist_random_remove(priv, iter);
         g_sequence_remove((GSequenceIter *)iter);
         g_hash_table_remove(priv->playlist_iter_table, iter);
     }
@@ -2706,19 +3094,22 @@ void rclib_db_playlist_update_metadata(RCLibDbPlaylistIter *iter,
         g_debug("Playlist data updated, genre: %s -> %s",
             playlist_data->genre, data->genre);
     }
+    g_rw_lock_writer_lock(&(playlist_data->lock));
     g_free(playlist_data->title);
-    g_free(playlist_data->artist);
-    g_free(playlist_data->album);
-    g_free(playlist_data->ftype);
-    g_free(playlist_data->genre);
+    _rclib_db_string_release(playlist_data->artist);
+    _rclib_db_string_release(playlist_data->album);
+    _rclib_db_string_release(playlist_data->ftype);
+    _rclib_db_string_release(playlist_data->genre);
     playlist_data->title = g_strdup(data->title);
-    playlist_data->artist = g_strdup(data->artist);
-    playlist_data->album = g_strdup(data->album);
-    playlist_data->ftype = g_strdup(data->ftype);
-    playlist_data->genre = g_strdup(data->genre);
+    playlist_data->artist = _rclib_db_string_intern(data->artist);
+    playlist_data->album = _rclib_db_string_intern(data->album);
+    playlist_data->ftype = _rclib_db_string_intern(data->ftype);
+    playlist_data->genre = _rclib_db_string_intern(data->genre);
     playlist_data->tracknum = data->tracknum;
     playlist_data->year = data->year;
     playlist_data->type = data->type;
+    _rclib_db_sort_keys_clear(playlist_data->sort_keys);
+    g_rw_lock_writer_unlock(&(playlist_data->lock));
     rclib_db_playlist_data_unref(playlist_data);
     g_rw_lock_writer_unlock(&(priv->playlist_rw_lock));
     g_signal_emit_by_name(instance, "playlist-changed", iter);
@@ -2841,6 +3232,7 @@ void rclib_db_playlist_move_to_another_catalog(RCLibDbPlaylistIter **iters,
         }
         new_data->self_iter = new_iter;
         g_hash_table_replace(priv->playlist_iter_table, new_iter, new_iter);
+        rclib_db_playlist_random_add(priv, new_iter, new_data);
         g_rw_lock_writer_unlock(&(priv->playlist_rw_lock));
         g_rw_lock_writer_unlock(&(priv->catalog_rw_lock));
         g_signal_emit_by_name(instance, "playlist-added", new_iter);
@@ -3072,18 +3464,12 @@ gboolean rclib_db_playlist_export_all_m3u_files(const gchar *dir)
     return flag;
 }
 
-/**
- * rclib_db_playlist_refresh:
- * @iter: the catalog iter
- *
- * Refresh the metadata of the music in the playlist pointed to
- * by the given catalog #iter. MT safe.
- */
-
-void rclib_db_playlist_refresh(RCLibDbCatalogIter *iter)
+static void rclib_db_playlist_refresh_internal(RCLibDbCatalogIter *iter,
+    gboolean incremental)
 {
     RCLibDbRefreshData *refresh_data;
     RCLibDbPlaylistIter *iter_foreach;
+    RCLibDbFileFingerprint fingerprint;
     RCLibDbPrivate *priv;
     gchar *uri;
     GObject *instance;
@@ -3097,18 +3483,54 @@ void rclib_db_playlist_refresh(RCLibDbCatalogIter *iter)
         iter_foreach = rclib_db_playlist_iter_next(iter_foreach))
     {
         uri = NULL;
+        memset(&fingerprint, 0, sizeof(RCLibDbFileFingerprint));
         rclib_db_playlist_data_iter_get(iter_foreach,
             RCLIB_DB_PLAYLIST_DATA_TYPE_URI, &uri,
+            RCLIB_DB_PLAYLIST_DATA_TYPE_MTIME, &(fingerprint.mtime),
+            RCLIB_DB_PLAYLIST_DATA_TYPE_FILESIZE, &(fingerprint.filesize),
+            RCLIB_DB_PLAYLIST_DATA_TYPE_INODE, &(fingerprint.inode),
             RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
         if(uri==NULL) continue;
         refresh_data = g_new0(RCLibDbRefreshData, 1);
+        refresh_data->type = RCLIB_DB_REFRESH_TYPE_PLAYLIST;
         refresh_data->catalog_iter = iter;
         refresh_data->playlist_iter = iter_foreach;
         refresh_data->uri = uri;
+        refresh_data->incremental_flag = incremental;
+        refresh_data->fingerprint = fingerprint;
         g_async_queue_push(priv->refresh_queue, refresh_data);
     }
 }
 
+/**
+ * rclib_db_playlist_refresh:
+ * @iter: the catalog iter
+ *
+ * Refresh the metadata of the music in the playlist pointed to
+ * by the given catalog #iter. MT safe.
+ */
+
+void rclib_db_playlist_refresh(RCLibDbCatalogIter *iter)
+{
+    rclib_db_playlist_refresh_internal(iter, FALSE);
+}
+
+/**
+ * rclib_db_playlist_refresh_incremental:
+ * @iter: the catalog iter
+ *
+ * Refresh the metadata of the music in the playlist pointed to by the
+ * given catalog #iter, like rclib_db_playlist_refresh(), but only the
+ * local files whose modification time, size or inode changed since the
+ * last reading are read again. The result is reported by the
+ * #RCLibDb::refresh-summary signal. MT safe.
+ */
+
+void rclib_db_playlist_refresh_incremental(RCLibDbCatalogIter *iter)
+{
+    rclib_db_playlist_refresh_internal(iter, TRUE);
+}
+
 /**
  * rclib_db_load_legacy:
  *
@@ -3179,6 +3601,8 @@ gboolean rclib_db_load_legacy()
             playlist_data->self_iter = playlist_iter;
             g_hash_table_replace(priv->playlist_iter_table, playlist_iter,
                 playlist_iter);
+            rclib_db_playlist_random_add(priv, playlist_iter,
+                playlist_data);
             g_rw_lock_writer_unlock(&(priv->playlist_rw_lock));
             g_signal_emit_by_name(instance, "playlist-added", playlist_iter);
         }
@@ -3191,13 +3615,13 @@ gboolean rclib_db_load_legacy()
         else if(playlist_data!=NULL && strncmp(line, "AR=", 3)==0)
         {
             g_rw_lock_writer_lock(&(playlist_data->lock));
-            playlist_data->artist = g_strdup(line+3);
+            playlist_data->artist = _rclib_db_string_intern(line+3);
             g_rw_lock_writer_unlock(&(playlist_data->lock));
         }
         else if(playlist_data!=NULL && strncmp(line, "AL=", 3)==0)
         {
             g_rw_lock_writer_lock(&(playlist_data->lock));
-            playlist_data->album = g_strdup(line+3);
+            playlist_data->album = _rclib_db_string_intern(line+3);
             g_rw_lock_writer_unlock(&(playlist_data->lock));
         }
         /* time length */
@@ -3242,45 +3666,15 @@ gboolean rclib_db_load_legacy()
     return TRUE;
 }
 
-static inline RCLibDbPlaylistDataType rclib_db_playlist_property_convert(
-    RCLibDbQueryDataType query_type)
+static inline gboolean rclib_db_playlist_data_query_plan(
+    RCLibDbPlaylistData *playlist_data, const RCLibDbQueryPlan *plan)
 {
-    switch(query_type)
-    {
-        case RCLIB_DB_QUERY_DATA_TYPE_URI:
-            return RCLIB_DB_PLAYLIST_DATA_TYPE_URI;
-            break;
-        case RCLIB_DB_QUERY_DATA_TYPE_TITLE:
-            return RCLIB_DB_PLAYLIST_DATA_TYPE_TITLE;
-            break;
-        case RCLIB_DB_QUERY_DATA_TYPE_ARTIST:
-            return RCLIB_DB_PLAYLIST_DATA_TYPE_ARTIST;
-            break;
-        case RCLIB_DB_QUERY_DATA_TYPE_ALBUM:
-            return RCLIB_DB_PLAYLIST_DATA_TYPE_ALBUM;
-        case RCLIB_DB_QUERY_DATA_TYPE_FTYPE:
-            return RCLIB_DB_PLAYLIST_DATA_TYPE_FTYPE;
-            break;
-        case RCLIB_DB_QUERY_DATA_TYPE_LENGTH:
-            return RCLIB_DB_PLAYLIST_DATA_TYPE_LENGTH;
-            break;
-        case RCLIB_DB_QUERY_DATA_TYPE_TRACKNUM:
-            return RCLIB_DB_PLAYLIST_DATA_TYPE_TRACKNUM;
-            break;
-        case RCLIB_DB_QUERY_DATA_TYPE_RATING:
-            return RCLIB_DB_PLAYLIST_DATA_TYPE_RATING;
-            break;
-        case RCLIB_DB_QUERY_DATA_TYPE_YEAR:
-            return RCLIB_DB_PLAYLIST_DATA_TYPE_YEAR;
-            break;
-        case RCLIB_DB_QUERY_DATA_TYPE_GENRE:
-            return RCLIB_DB_PLAYLIST_DATA_TYPE_GENRE;
-            break;
-        default:
-            return RCLIB_DB_PLAYLIST_DATA_TYPE_NONE;
-            break;
-    }
-    return RCLIB_DB_PLAYLIST_DATA_TYPE_NONE;
+    RCLibDbPlaylistDataView view;
+    gboolean ret;
+    rclib_db_playlist_data_view_begin(playlist_data, &view);
+    ret = _rclib_db_query_plan_eval(plan, &view);
+    rclib_db_playlist_data_view_end(playlist_data, &view);
+    return ret;
 }
 
 /**
@@ -3298,853 +3692,15 @@ static inline RCLibDbPlaylistDataType rclib_db_playlist_property_convert(
 gboolean rclib_db_playlist_data_query(RCLibDbPlaylistData *playlist_data,
     RCLibDbQuery *query, GCancellable *cancellable)
 {
-    RCLibDbQueryData *query_data;
-    gboolean result = FALSE;
-    gboolean or_flag = FALSE;
-    gboolean ret = FALSE;
-    guint i;
-    RCLibDbPlaylistDataType ptype;
-    GType dtype;
-    gchar *pstring;
-    gint pint;
-    gint64 pint64;
-    gdouble pdouble;
-    gchar *uri;
+    RCLibDbQueryPlan *plan;
+    gboolean ret;
     if(playlist_data==NULL || query==NULL)
         return FALSE;
-    cancellable = g_object_ref(cancellable);
-    for(i=0;i<((GPtrArray *)query)->len;i++)
-    {
-        if(cancellable!=NULL)
-        {
-            if(g_cancellable_is_cancelled(cancellable))
-            {
-                g_object_unref(cancellable);
-                return FALSE;
-            }
-        }
-        query_data = g_ptr_array_index((GPtrArray *)query, i);
-        if(query_data==NULL) continue;
-        switch(query_data->type)
-        {
-            case RCLIB_DB_QUERY_CONDITION_TYPE_SUBQUERY:
-            {
-                if(query_data->subquery==NULL)
-                {
-                    result = FALSE;
-                    break;
-                }
-                result = rclib_db_playlist_data_query(playlist_data,
-                    query_data->subquery, cancellable);
-                break;
-            }
-            case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_EQUALS:
-            {
-                if(query_data->val==NULL)
-                {
-                    result = FALSE;
-                    break;
-                }
-                ptype = rclib_db_playlist_property_convert(
-                    query_data->propid);
-                dtype = rclib_db_query_get_query_data_type(
-                    query_data->propid);
-                switch(dtype)
-                {
-                    case G_TYPE_STRING:
-                    {
-                        if(!G_VALUE_HOLDS_STRING(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        pstring = NULL;
-                        rclib_db_playlist_data_get(playlist_data, ptype,
-                            &pstring, RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                        if(pstring==NULL)
-                            pstring = g_strdup("");
-                        if(ptype==RCLIB_DB_PLAYLIST_DATA_TYPE_TITLE &&
-                            (pstring==NULL || strlen(pstring)==0))
-                        {
-                            uri = NULL;
-                            if(pstring!=NULL) g_free(pstring);
-                            pstring = NULL;
-                            rclib_db_playlist_data_get(playlist_data,
-                                RCLIB_DB_PLAYLIST_DATA_TYPE_URI, &uri,
-                                RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                            if(uri!=NULL)
-                            {
-                                pstring = rclib_tag_get_name_from_uri(uri);
-                            }
-                            g_free(uri);
-                        }
-                        result = (g_strcmp0(g_value_get_string(
-                            query_data->val), pstring)==0);
-                        g_free(pstring);
-                        break;
-                    }
-                    case G_TYPE_INT:
-                    {
-                        if(!G_VALUE_HOLDS_INT(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        pint = 0;
-                        rclib_db_playlist_data_get(playlist_data, ptype,
-                            &pint, RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                        result = (g_value_get_int(query_data->val)==pint);
-                        break;
-                    }
-                    case G_TYPE_INT64:
-                    {
-                        if(!G_VALUE_HOLDS_INT64(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        pint64 = 0;
-                        rclib_db_playlist_data_get(playlist_data, ptype,
-                            &pint64, RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                        result = (g_value_get_int64(query_data->val)==pint64);
-                        break;
-                    }
-                    case G_TYPE_DOUBLE:
-                    {
-                        if(!G_VALUE_HOLDS_DOUBLE(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        pdouble = 0;
-                        rclib_db_playlist_data_get(playlist_data, ptype,
-                            &pdouble, RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                        result = (ABS(g_value_get_double(query_data->val) -
-                            pdouble)<=10e-5);
-                        break;
-                    }
-                    default:
-                    {
-                        result = FALSE;
-                        break;
-                    }
-                }
-                break;
-            }
-            case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_NOT_EQUAL:
-            {
-               if(query_data->val==NULL)
-                {
-                    result = FALSE;
-                    break;
-                }
-                ptype = rclib_db_playlist_property_convert(
-                    query_data->propid);
-                dtype = rclib_db_query_get_query_data_type(
-                    query_data->propid);
-                switch(dtype)
-                {
-                    case G_TYPE_STRING:
-                    {
-                        if(!G_VALUE_HOLDS_STRING(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        pstring = NULL;
-                        rclib_db_playlist_data_get(playlist_data, ptype,
-                            &pstring, RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                        if(pstring==NULL)
-                            pstring = g_strdup("");
-                        if(ptype==RCLIB_DB_PLAYLIST_DATA_TYPE_TITLE &&
-                            (pstring==NULL || strlen(pstring)==0))
-                        {
-                            uri = NULL;
-                            if(pstring!=NULL) g_free(pstring);
-                            pstring = NULL;
-                            rclib_db_playlist_data_get(playlist_data,
-                                RCLIB_DB_PLAYLIST_DATA_TYPE_URI, &uri,
-                                RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                            if(uri!=NULL)
-                            {
-                                pstring = rclib_tag_get_name_from_uri(uri);
-                            }
-                            g_free(uri);
-                        }
-                        result = (g_strcmp0(g_value_get_string(
-                            query_data->val), pstring)!=0);
-                        g_free(pstring);
-                        break;
-                    }
-                    case G_TYPE_INT:
-                    {
-                        if(!G_VALUE_HOLDS_INT(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        pint = 0;
-                        rclib_db_playlist_data_get(playlist_data, ptype,
-                            &pint, RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                        result = (g_value_get_int(query_data->val)!=pint);
-                        break;
-                    }
-                    case G_TYPE_INT64:
-                    {
-                        if(!G_VALUE_HOLDS_INT64(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        pint64 = 0;
-                        rclib_db_playlist_data_get(playlist_data, ptype,
-                            &pint64, RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                        result = (g_value_get_int64(query_data->val)!=pint64);
-                        break;
-                    }
-                    case G_TYPE_DOUBLE:
-                    {
-                        if(!G_VALUE_HOLDS_DOUBLE(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        pdouble = 0;
-                        rclib_db_playlist_data_get(playlist_data, ptype,
-                            &pdouble, RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                        result = (ABS(g_value_get_double(query_data->val) -
-                            pdouble)>10e-5);
-                        break;
-                    }
-                    default:
-                    {
-                        result = FALSE;
-                        break;
-                    }
-                }
-                break;
-            }
-            case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_GREATER:
-            {
-               if(query_data->val==NULL)
-                {
-                    result = FALSE;
-                    break;
-                }
-                ptype = rclib_db_playlist_property_convert(
-                    query_data->propid);
-                dtype = rclib_db_query_get_query_data_type(
-                    query_data->propid);
-                switch(dtype)
-                {
-                    case G_TYPE_STRING:
-                    {
-                        if(!G_VALUE_HOLDS_STRING(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        pstring = NULL;
-                        rclib_db_playlist_data_get(playlist_data, ptype,
-                            &pstring, RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                        if(pstring==NULL)
-                            pstring = g_strdup("");
-                        if(ptype==RCLIB_DB_PLAYLIST_DATA_TYPE_TITLE &&
-                            (pstring==NULL || strlen(pstring)==0))
-                        {
-                            uri = NULL;
-                            if(pstring!=NULL) g_free(pstring);
-                            pstring = NULL;
-                            rclib_db_playlist_data_get(playlist_data,
-                                RCLIB_DB_PLAYLIST_DATA_TYPE_URI, &uri,
-                                RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                            if(uri!=NULL)
-                            {
-                                pstring = rclib_tag_get_name_from_uri(uri);
-                            }
-                            g_free(uri);
-                        }
-                        result = (g_strcmp0(g_value_get_string(
-                            query_data->val), pstring)>0);
-                        g_free(pstring);
-                        break;
-                    }
-                    case G_TYPE_INT:
-                    {
-                        if(!G_VALUE_HOLDS_INT(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        pint = 0;
-                        rclib_db_playlist_data_get(playlist_data, ptype,
-                            &pint, RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                        result = (g_value_get_int(query_data->val)>pint);
-                        break;
-                    }
-                    case G_TYPE_INT64:
-                    {
-                        if(!G_VALUE_HOLDS_INT64(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        pint64 = 0;
-                        rclib_db_playlist_data_get(playlist_data, ptype,
-                            &pint64, RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                        result = (g_value_get_int64(query_data->val)>pint64);
-                        break;
-                    }
-                    case G_TYPE_DOUBLE:
-                    {
-                        if(!G_VALUE_HOLDS_DOUBLE(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        pdouble = 0;
-                        rclib_db_playlist_data_get(playlist_data, ptype,
-                            &pdouble, RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                        result = (g_value_get_double(query_data->val) -
-                            pdouble>10e-5);
-                        break;
-                    }
-                    default:
-                    {
-                        result = FALSE;
-                        break;
-                    }
-                }
-                break;
-            }
-            case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_GREATER_OR_EQUAL:
-            {
-               if(query_data->val==NULL)
-                {
-                    result = FALSE;
-                    break;
-                }
-                ptype = rclib_db_playlist_property_convert(
-                    query_data->propid);
-                dtype = rclib_db_query_get_query_data_type(
-                    query_data->propid);
-                switch(dtype)
-                {
-                    case G_TYPE_STRING:
-                    {
-                        if(!G_VALUE_HOLDS_STRING(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        pstring = NULL;
-                        rclib_db_playlist_data_get(playlist_data, ptype,
-                            &pstring, RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                        if(pstring==NULL)
-                            pstring = g_strdup("");
-                        if(ptype==RCLIB_DB_PLAYLIST_DATA_TYPE_TITLE &&
-                            (pstring==NULL || strlen(pstring)==0))
-                        {
-                            uri = NULL;
-                            if(pstring!=NULL) g_free(pstring);
-                            pstring = NULL;
-                            rclib_db_playlist_data_get(playlist_data,
-                                RCLIB_DB_PLAYLIST_DATA_TYPE_URI, &uri,
-                                RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                            if(uri!=NULL)
-                            {
-                                pstring = rclib_tag_get_name_from_uri(uri);
-                            }
-                            g_free(uri);
-                        }
-                        result = (g_strcmp0(g_value_get_string(
-                            query_data->val), pstring)>=0);
-                        g_free(pstring);
-                        break;
-                    }
-                    case G_TYPE_INT:
-                    {
-                        if(!G_VALUE_HOLDS_INT(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        pint = 0;
-                        rclib_db_playlist_data_get(playlist_data, ptype,
-                            &pint, RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                        result = (g_value_get_int(query_data->val)>=pint);
-                        break;
-                    }
-                    case G_TYPE_INT64:
-                    {
-                        if(!G_VALUE_HOLDS_INT64(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        pint64 = 0;
-                        rclib_db_playlist_data_get(playlist_data, ptype,
-                            &pint64, RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                        result = (g_value_get_int64(query_data->val)>=pint64);
-                        break;
-                    }
-                    case G_TYPE_DOUBLE:
-                    {
-                        if(!G_VALUE_HOLDS_DOUBLE(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        pdouble = 0;
-                        rclib_db_playlist_data_get(playlist_data, ptype,
-                            &pdouble, RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                        result = (g_value_get_double(query_data->val) -
-                            pdouble>=0);
-                        break;
-                    }
-                    default:
-                    {
-                        result = FALSE;
-                        break;
-                    }
-                }
-                break;
-            }
-            case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_LESS:
-            {
-               if(query_data->val==NULL)
-                {
-                    result = FALSE;
-                    break;
-                }
-                ptype = rclib_db_playlist_property_convert(
-                    query_data->propid);
-                dtype = rclib_db_query_get_query_data_type(
-                    query_data->propid);
-                switch(dtype)
-                {
-                    case G_TYPE_STRING:
-                    {
-                        if(!G_VALUE_HOLDS_STRING(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        pstring = NULL;
-                        rclib_db_playlist_data_get(playlist_data, ptype,
-                            &pstring, RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                        if(pstring==NULL)
-                            pstring = g_strdup("");
-                        if(ptype==RCLIB_DB_PLAYLIST_DATA_TYPE_TITLE &&
-                            (pstring==NULL || strlen(pstring)==0))
-                        {
-                            uri = NULL;
-                            if(pstring!=NULL) g_free(pstring);
-                            pstring = NULL;
-                            rclib_db_playlist_data_get(playlist_data,
-                                RCLIB_DB_PLAYLIST_DATA_TYPE_URI, &uri,
-                                RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                            if(uri!=NULL)
-                            {
-                                pstring = rclib_tag_get_name_from_uri(uri);
-                            }
-                            g_free(uri);
-                        }
-                        result = (g_strcmp0(g_value_get_string(
-                            query_data->val), pstring)<0);
-                        g_free(pstring);
-                        break;
-                    }
-                    case G_TYPE_INT:
-                    {
-                        if(!G_VALUE_HOLDS_INT(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        pint = 0;
-                        rclib_db_playlist_data_get(playlist_data, ptype,
-                            &pint, RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                        result = (g_value_get_int(query_data->val)<pint);
-                        break;
-                    }
-                    case G_TYPE_INT64:
-                    {
-                        if(!G_VALUE_HOLDS_INT64(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        pint64 = 0;
-                        rclib_db_playlist_data_get(playlist_data, ptype,
-                            &pint64, RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                        result = (g_value_get_int64(query_data->val)<pint64);
-                        break;
-                    }
-                    case G_TYPE_DOUBLE:
-                    {
-                        if(!G_VALUE_HOLDS_DOUBLE(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        pdouble = 0;
-                        rclib_db_playlist_data_get(playlist_data, ptype,
-                            &pdouble, RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                        result = (g_value_get_double(query_data->val) -
-                            pdouble<-10e-5);
-                        break;
-                    }
-                    default:
-                    {
-                        result = FALSE;
-                        break;
-                    }
-                }
-                break;
-            }
-            case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_LESS_OR_EQUAL:
-            {
-               if(query_data->val==NULL)
-                {
-                    result = FALSE;
-                    break;
-                }
-                ptype = rclib_db_playlist_property_convert(
-                    query_data->propid);
-                dtype = rclib_db_query_get_query_data_type(
-                    query_data->propid);
-                switch(dtype)
-                {
-                    case G_TYPE_STRING:
-                    {
-                        if(!G_VALUE_HOLDS_STRING(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        pstring = NULL;
-                        rclib_db_playlist_data_get(playlist_data, ptype,
-                            &pstring, RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                        if(pstring==NULL)
-                            pstring = g_strdup("");
-                        if(ptype==RCLIB_DB_PLAYLIST_DATA_TYPE_TITLE &&
-                            (pstring==NULL || strlen(pstring)==0))
-                        {
-                            uri = NULL;
-                            if(pstring!=NULL) g_free(pstring);
-                            pstring = NULL;
-                            rclib_db_playlist_data_get(playlist_data,
-                                RCLIB_DB_PLAYLIST_DATA_TYPE_URI, &uri,
-                                RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                            if(uri!=NULL)
-                            {
-                                pstring = rclib_tag_get_name_from_uri(uri);
-                            }
-                            g_free(uri);
-                        }
-                        result = (g_strcmp0(g_value_get_string(
-                            query_data->val), pstring)<=0);
-                        g_free(pstring);
-                        break;
-                    }
-                    case G_TYPE_INT:
-                    {
-                        if(!G_VALUE_HOLDS_INT(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        pint = 0;
-                        rclib_db_playlist_data_get(playlist_data, ptype,
-                            &pint, RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                        result = (g_value_get_int(query_data->val)<=pint);
-                        break;
-                    }
-                    case G_TYPE_INT64:
-                    {
-                        if(!G_VALUE_HOLDS_INT64(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        pint64 = 0;
-                        rclib_db_playlist_data_get(playlist_data, ptype,
-                            &pint64, RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                        result = (g_value_get_int64(query_data->val)<=pint64);
-                        break;
-                    }
-                    case G_TYPE_DOUBLE:
-                    {
-                        if(!G_VALUE_HOLDS_DOUBLE(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        pdouble = 0;
-                        rclib_db_playlist_data_get(playlist_data, ptype,
-                            &pdouble, RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                        result = (g_value_get_double(query_data->val) -
-                            pdouble<=0);
-                        break;
-                    }
-                    default:
-                    {
-                        result = FALSE;
-                        break;
-                    }
-                }
-                break;
-            }
-            case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_LIKE:
-            {
-                if(query_data->val==NULL)
-                {
-                    result = FALSE;
-                    break;
-                }
-
-                ptype = rclib_db_playlist_property_convert(
-                    query_data->propid);
-                dtype = rclib_db_query_get_query_data_type(
-                    query_data->propid);
-                switch(dtype)
-                {
-                    case G_TYPE_STRING:
-                    {
-                        if(!G_VALUE_HOLDS_STRING(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        pstring = NULL;
-                        rclib_db_playlist_data_get(playlist_data, ptype,
-                            &pstring, RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                        if(pstring==NULL)
-                            pstring = g_strdup("");
-                        if(ptype==RCLIB_DB_PLAYLIST_DATA_TYPE_TITLE &&
-                            (pstring==NULL || strlen(pstring)==0))
-                        {
-                            uri = NULL;
-                            if(pstring!=NULL) g_free(pstring);
-                            pstring = NULL;
-                            rclib_db_playlist_data_get(playlist_data,
-                                RCLIB_DB_PLAYLIST_DATA_TYPE_URI, &uri,
-                                RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                            if(uri!=NULL)
-                            {
-                                pstring = rclib_tag_get_name_from_uri(uri);
-                            }
-                            g_free(uri);
-                        }
-                        if(pstring==NULL)
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        result = (g_strstr_len(pstring, -1,
-                            g_value_get_string(query_data->val))!=NULL);
-                        g_free(pstring);
-                        break;
-                    }
-                    default:
-                    {
-                        result = FALSE;
-                        break;
-                    }
-                }
-                break;
-            }
-            case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_NOT_LIKE:
-            {
-                if(query_data->val==NULL)
-                {
-                    result = FALSE;
-                    break;
-                }
-                ptype = rclib_db_playlist_property_convert(
-                    query_data->propid);
-                dtype = rclib_db_query_get_query_data_type(
-                    query_data->propid);
-                switch(dtype)
-                {
-                    case G_TYPE_STRING:
-                    {
-                        if(!G_VALUE_HOLDS_STRING(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        pstring = NULL;
-                        rclib_db_playlist_data_get(playlist_data, ptype,
-                            &pstring, RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                        if(pstring==NULL)
-                            pstring = g_strdup("");
-                        if(ptype==RCLIB_DB_PLAYLIST_DATA_TYPE_TITLE &&
-                            (pstring==NULL || strlen(pstring)==0))
-                        {
-                            uri = NULL;
-                            if(pstring!=NULL) g_free(pstring);
-                            pstring = NULL;
-                            rclib_db_playlist_data_get(playlist_data,
-                                RCLIB_DB_PLAYLIST_DATA_TYPE_URI, &uri,
-                                RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                            if(uri!=NULL)
-                            {
-                                pstring = rclib_tag_get_name_from_uri(uri);
-                            }
-                            g_free(uri);
-                        }
-                        if(pstring==NULL)
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        result = (g_strstr_len(pstring, -1,
-                            g_value_get_string(query_data->val))==NULL);
-                        g_free(pstring);
-                        break;
-                    }
-                    default:
-                    {
-                        result = FALSE;
-                        break;
-                    }
-                }
-                break;
-            }
-            case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_PREFIX:
-            {
-                if(query_data->val==NULL)
-                {
-                    result = FALSE;
-                    break;
-                }
-                ptype = rclib_db_playlist_property_convert(
-                    query_data->propid);
-                dtype = rclib_db_query_get_query_data_type(
-                    query_data->propid);
-                switch(dtype)
-                {
-                    case G_TYPE_STRING:
-                    {
-                        if(!G_VALUE_HOLDS_STRING(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        pstring = NULL;
-                        rclib_db_playlist_data_get(playlist_data, ptype,
-                            &pstring, RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                        if(pstring==NULL)
-                            pstring = g_strdup("");
-                        if(ptype==RCLIB_DB_PLAYLIST_DATA_TYPE_TITLE &&
-                            (pstring==NULL || strlen(pstring)==0))
-                        {
-                            uri = NULL;
-                            if(pstring!=NULL) g_free(pstring);
-                            pstring = NULL;
-                            rclib_db_playlist_data_get(playlist_data,
-                                RCLIB_DB_PLAYLIST_DATA_TYPE_URI, &uri,
-                                RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                            if(uri!=NULL)
-                            {
-                                pstring = rclib_tag_get_name_from_uri(uri);
-                            }
-                            g_free(uri);
-                        }
-                        result = g_str_has_prefix(pstring,
-                            g_value_get_string(query_data->val));
-                        g_free(pstring);
-                        break;
-                    }
-                    default:
-                    {
-                        result = FALSE;
-                        break;
-                    }
-                }
-                break;
-            }
-            case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_SUFFIX:
-            {
-                if(query_data->val==NULL)
-                {
-                    result = FALSE;
-                    break;
-                }
-                ptype = rclib_db_playlist_property_convert(
-                    query_data->propid);
-                dtype = rclib_db_query_get_query_data_type(
-                    query_data->propid);
-                switch(dtype)
-                {
-                    case G_TYPE_STRING:
-                    {
-                        if(!G_VALUE_HOLDS_STRING(query_data->val))
-                        {
-                            result = FALSE;
-                            break;
-                        }
-                        pstring = NULL;
-                        rclib_db_playlist_data_get(playlist_data, ptype,
-                            &pstring, RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                        if(pstring==NULL)
-                            pstring = g_strdup("");
-                        if(ptype==RCLIB_DB_PLAYLIST_DATA_TYPE_TITLE &&
-                            (pstring==NULL || strlen(pstring)==0))
-                        {
-                            uri = NULL;
-                            if(pstring!=NULL) g_free(pstring);
-                            pstring = NULL;
-                            rclib_db_playlist_data_get(playlist_data,
-                                RCLIB_DB_PLAYLIST_DATA_TYPE_URI, &uri,
-                                RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                            if(uri!=NULL)
-                            {
-                                pstring = rclib_tag_get_name_from_uri(uri);
-                            }
-                            g_free(uri);
-                        }
-                        result = g_str_has_suffix(pstring,
-                            g_value_get_string(query_data->val));
-                        g_free(pstring);
-                        break;
-                    }
-                    default:
-                    {
-                        result = FALSE;
-                        break;
-                    }
-                }
-                break;
-            }
-            case RCLIB_DB_QUERY_CONDITION_TYPE_OR:
-            {
-                or_flag = TRUE;
-                break;
-            }
-            default:
-            {
-                if(i==0) result = TRUE;
-                break;
-            }
-        }
-        if(or_flag)
-        {
-            if(result) ret = TRUE;
-        }
-        else
-        {
-            ret = result;
-        }
-        if(!ret && !or_flag) break;
-        if(or_flag && query_data->type!=RCLIB_DB_QUERY_CONDITION_TYPE_OR)
-        {
-            or_flag = FALSE;
-        }
-    }
-    g_object_unref(cancellable);
+    if(cancellable!=NULL && g_cancellable_is_cancelled(cancellable))
+        return FALSE;
+    plan = _rclib_db_query_plan_new(query);
+    ret = rclib_db_playlist_data_query_plan(playlist_data, plan);
+    _rclib_db_query_plan_free(plan);
     return ret;
 }
 
@@ -4196,13 +3752,24 @@ GPtrArray *rclib_db_playlist_query(RCLibDbCatalogIter *catalog_iter,
     RCLibDbPlaylistData *playlist_data;
     RCLibDbPlaylistIter *playlist_iter;
     RCLibDbPrivate *priv;
+    RCLibDbQueryPlan *plan;
+    gboolean value = FALSE;
     instance = rclib_db_get_instance();
     if(instance==NULL) return NULL;
     priv = RCLIB_DB(instance)->priv;
     if(priv==NULL) return NULL;
-    cancellable = g_object_ref(cancellable);
+    if(cancellable!=NULL)
+        cancellable = g_object_ref(cancellable);
     query_result = g_ptr_array_new_with_free_func((GDestroyNotify)
         rclib_db_playlist_data_unref);
+    plan = _rclib_db_query_plan_new(query);
+    if(_rclib_db_query_plan_is_constant(plan, &value) && !value)
+    {
+        _rclib_db_query_plan_free(plan);
+        if(cancellable!=NULL)
+            g_object_unref(cancellable);
+        return query_result;
+    }
     if(catalog_iter!=NULL)
     {
         g_rw_lock_reader_lock(&(priv->playlist_rw_lock));
@@ -4217,7 +3784,7 @@ GPtrArray *rclib_db_playlist_query(RCLibDbCatalogIter *catalog_iter,
             }
             playlist_data = rclib_db_playlist_iter_get_data(playlist_iter);
             if(playlist_data==NULL) continue;
-            if(rclib_db_playlist_data_query(playlist_data, query, cancellable))
+            if(rclib_db_playlist_data_query_plan(playlist_data, plan))
                 g_ptr_array_add(query_result, playlist_data); 
             else
                 rclib_db_playlist_data_unref(playlist_data);
@@ -4239,14 +3806,16 @@ GPtrArray *rclib_db_playlist_query(RCLibDbCatalogIter *catalog_iter,
             if(playlist_iter==NULL) continue;
             playlist_data = rclib_db_playlist_iter_get_data(playlist_iter);
             if(playlist_data==NULL) continue;
-            if(rclib_db_playlist_data_query(playlist_data, query, cancellable))
+            if(rclib_db_playlist_data_query_plan(playlist_data, plan))
                 g_ptr_array_add(query_result, playlist_data);
             else
                 rclib_db_playlist_data_unref(playlist_data);
         }
         g_rw_lock_reader_unlock(&(priv->playlist_rw_lock));
     }
-    g_object_unref(cancellable);
+    _rclib_db_query_plan_free(plan);
+    if(cancellable!=NULL)
+        g_object_unref(cancellable);
     return query_result;
 }
 
@@ -4272,12 +3841,23 @@ GPtrArray *rclib_db_playlist_query_get_iters(RCLibDbCatalogIter *catalog_iter,
     RCLibDbPlaylistData *playlist_data;
     RCLibDbPlaylistIter *playlist_iter;
     RCLibDbPrivate *priv;
+    RCLibDbQueryPlan *plan;
+    gboolean value = FALSE;
     instance = rclib_db_get_instance();
     if(instance==NULL) return NULL;
     priv = RCLIB_DB(instance)->priv;
     if(priv==NULL) return NULL;
-    cancellable = g_object_ref(cancellable);
+    if(cancellable!=NULL)
+        cancellable = g_object_ref(cancellable);
     query_result = g_ptr_array_new();
+    plan = _rclib_db_query_plan_new(query);
+    if(_rclib_db_query_plan_is_constant(plan, &value) && !value)
+    {
+        _rclib_db_query_plan_free(plan);
+        if(cancellable!=NULL)
+            g_object_unref(cancellable);
+        return query_result;
+    }
     if(catalog_iter!=NULL)
     {
         g_rw_lock_reader_lock(&(priv->playlist_rw_lock));
@@ -4292,7 +3872,7 @@ GPtrArray *rclib_db_playlist_query_get_iters(RCLibDbCatalogIter *catalog_iter,
             }
             playlist_data = rclib_db_playlist_iter_get_data(playlist_iter);
             if(playlist_data==NULL) continue;
-            if(rclib_db_playlist_data_query(playlist_data, query, cancellable))
+            if(rclib_db_playlist_data_query_plan(playlist_data, plan))
                 g_ptr_array_add(query_result, playlist_iter); 
             rclib_db_playlist_data_unref(playlist_data);
         }
@@ -4313,13 +3893,15 @@ GPtrArray *rclib_db_playlist_query_get_iters(RCLibDbCatalogIter *catalog_iter,
             if(playlist_iter==NULL) continue;
             playlist_data = rclib_db_playlist_iter_get_data(playlist_iter);
             if(playlist_data==NULL) continue;
-            if(rclib_db_playlist_data_query(playlist_data, query, cancellable))
+            if(rclib_db_playlist_data_query_plan(playlist_data, plan))
                 g_ptr_array_add(query_result, playlist_iter);
             rclib_db_playlist_data_unref(playlist_data);
         }
         g_rw_lock_reader_unlock(&(priv->playlist_rw_lock));
     }
-    g_object_unref(cancellable);
+    _rclib_db_query_plan_free(plan);
+    if(cancellable!=NULL)
+        g_object_unref(cancellable);
     return query_result;
 }
 
@@ -4347,7 +3929,6 @@ RCLibDbPlaylistIter *rclib_db_playlist_get_random_iter(
     GObject *instance;
     gfloat prating;
     gint playlist_length, pos;
-    GHashTableIter iter;
     RCLibDbPlaylistIter *playlist_iter;
     RCLibDbPrivate *priv;
     RCLibDbPlaylistIter *result_iter = NULL;
@@ -4356,74 +3937,41 @@ RCLibDbPlaylistIter *rclib_db_playlist_get_random_iter(
     if(instance==NULL) return NULL;
     priv = RCLIB_DB(instance)->priv;
     if(priv==NULL) return NULL;
+    if(catalog_iter==NULL)
+    {
+        g_rw_lock_reader_lock(&(priv->playlist_rw_lock));
+        result_iter = rclib_db_playlist_random_pick(priv, rating_limit,
+            condition, rating);
+        g_rw_lock_reader_unlock(&(priv->playlist_rw_lock));
+        return result_iter;
+    }
     if(!rating_limit)
     {
-        if(catalog_iter!=NULL)
-        {
-            g_rw_lock_reader_lock(&(priv->playlist_rw_lock));
-            playlist_length = rclib_db_playlist_get_length(catalog_iter);
-            if(playlist_length>0)
-            {
-                pos = g_random_int_range(0, playlist_length);
-                result_iter = rclib_db_playlist_get_iter_at_pos(catalog_iter,
-                    pos);
-            }
-            g_rw_lock_reader_unlock(&(priv->playlist_rw_lock));
-        }
-        else
+        g_rw_lock_reader_lock(&(priv->playlist_rw_lock));
+        playlist_length = rclib_db_playlist_get_length(catalog_iter);
+        if(playlist_length>0)
         {
-            g_rw_lock_reader_lock(&(priv->playlist_rw_lock));
-            g_hash_table_iter_init(&iter, priv->playlist_iter_table);
-            playlist_length = g_hash_table_size(priv->playlist_iter_table);
             pos = g_random_int_range(0, playlist_length);
-            playlist_iter = NULL;
-            while(g_hash_table_iter_next(&iter, (gpointer *)&playlist_iter,
-                NULL) && pos>0)
-            {
-                pos--;
-            }
-            result_iter = playlist_iter;
-            g_rw_lock_reader_unlock(&(priv->playlist_rw_lock));
-            
+            result_iter = rclib_db_playlist_get_iter_at_pos(catalog_iter, pos);
         }
+        g_rw_lock_reader_unlock(&(priv->playlist_rw_lock));
         return result_iter;
     }
     playlist_array = g_ptr_array_new();
     g_rw_lock_reader_lock(&(priv->playlist_rw_lock));
-    if(catalog_iter!=NULL)
-    {        
-        for(playlist_iter=rclib_db_playlist_get_begin_iter(
-            catalog_iter);playlist_iter!=NULL;playlist_iter=
-            rclib_db_playlist_iter_next(playlist_iter))
-        {
-            prating = -1.0;
-            rclib_db_playlist_data_iter_get(playlist_iter,
-                RCLIB_DB_PLAYLIST_DATA_TYPE_RATING, &prating,
-                RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-            if(prating<0.0) continue;
-            if((prating<=rating && condition) || (prating>=rating &&
-                !condition))
-            {
-                g_ptr_array_add(playlist_array, playlist_iter);
-            }
-        }
-    }
-    else
+    for(playlist_iter=rclib_db_playlist_get_begin_iter(
+        catalog_iter);playlist_iter!=NULL;playlist_iter=
+        rclib_db_playlist_iter_next(playlist_iter))
     {
-        g_hash_table_iter_init(&iter, priv->playlist_iter_table);
-        while(g_hash_table_iter_next(&iter, (gpointer *)&playlist_iter, NULL))
+        prating = -1.0;
+        rclib_db_playlist_data_iter_get(playlist_iter,
+            RCLIB_DB_PLAYLIST_DATA_TYPE_RATING, &prating,
+            RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
+        if(prating<0.0) continue;
+        if((prating<=rating && condition) || (prating>=rating &&
+            !condition))
         {
-            if(playlist_iter==NULL) continue;
-            prating = -1.0;
-            rclib_db_playlist_data_iter_get(playlist_iter,
-                RCLIB_DB_PLAYLIST_DATA_TYPE_RATING, &prating,
-                RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-            if(prating<0.0) continue;
-            if((prating<=rating && condition) || (prating>=rating &&
-                !condition))
-            {
-                g_ptr_array_add(playlist_array, playlist_iter);
-            }
+            g_ptr_array_add(playlist_array, playlist_iter);
         }
     }
     playlist_length = playlist_array->len;
@@ -4461,7 +4009,6 @@ RCLibDbPlaylistIter *rclib_db_playlist_iter_get_random_iter(
     GObject *instance;
     gfloat prating;
     gint playlist_length, pos;
-    GHashTableIter iter;
     RCLibDbPlaylistIter *playlist_iter;
     RCLibDbPrivate *priv;
     RCLibDbPlaylistIter *result_iter = NULL;
@@ -4470,74 +4017,41 @@ RCLibDbPlaylistIter *rclib_db_playlist_iter_get_random_iter(
     if(instance==NULL) return NULL;
     priv = RCLIB_DB(instance)->priv;
     if(priv==NULL) return NULL;
+    if(piter==NULL)
+    {
+        g_rw_lock_reader_lock(&(priv->playlist_rw_lock));
+        result_iter = rclib_db_playlist_random_pick(priv, rating_limit,
+            condition, rating);
+        g_rw_lock_reader_unlock(&(priv->playlist_rw_lock));
+        return result_iter;
+    }
     if(!rating_limit)
     {
-        if(piter!=NULL)
-        {
-            g_rw_lock_reader_lock(&(priv->playlist_rw_lock));
-            playlist_length = rclib_db_playlist_iter_get_length(piter);
-            if(playlist_length>0)
-            {
-                pos = g_random_int_range(0, playlist_length);
-                result_iter = rclib_db_playlist_iter_get_iter_at_pos(piter,
-                    pos);
-            }
-            g_rw_lock_reader_unlock(&(priv->playlist_rw_lock));
-        }
-        else
+        g_rw_lock_reader_lock(&(priv->playlist_rw_lock));
+        playlist_length = rclib_db_playlist_iter_get_length(piter);
+        if(playlist_length>0)
         {
-            g_rw_lock_reader_lock(&(priv->playlist_rw_lock));
-            g_hash_table_iter_init(&iter, priv->playlist_iter_table);
-            playlist_length = g_hash_table_size(priv->playlist_iter_table);
             pos = g_random_int_range(0, playlist_length);
-            playlist_iter = NULL;
-            while(g_hash_table_iter_next(&iter, (gpointer *)&playlist_iter,
-                NULL) && pos>0)
-            {
-                pos--;
-            }
-            result_iter = playlist_iter;
-            g_rw_lock_reader_unlock(&(priv->playlist_rw_lock));
-            
+            result_iter = rclib_db_playlist_iter_get_iter_at_pos(piter, pos);
         }
+        g_rw_lock_reader_unlock(&(priv->playlist_rw_lock));
         return result_iter;
     }
     playlist_array = g_ptr_array_new();
     g_rw_lock_reader_lock(&(priv->playlist_rw_lock));
-    if(piter!=NULL)
-    {        
-        for(playlist_iter=rclib_db_playlist_iter_get_begin_iter(piter);
-            playlist_iter!=NULL;playlist_iter=
-            rclib_db_playlist_iter_next(playlist_iter))
-        {
-            prating = -1.0;
-            rclib_db_playlist_data_iter_get(playlist_iter,
-                RCLIB_DB_PLAYLIST_DATA_TYPE_RATING, &prating,
-                RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-            if(prating<0.0) continue;
-            if((prating<=rating && condition) || (prating>=rating &&
-                !condition))
-            {
-                g_ptr_array_add(playlist_array, playlist_iter);
-            }
-        }
-    }
-    else
+    for(playlist_iter=rclib_db_playlist_iter_get_begin_iter(piter);
+        playlist_iter!=NULL;playlist_iter=
+        rclib_db_playlist_iter_next(playlist_iter))
     {
-        g_hash_table_iter_init(&iter, priv->playlist_iter_table);
-        while(g_hash_table_iter_next(&iter, (gpointer *)&playlist_iter, NULL))
+        prating = -1.0;
+        rclib_db_playlist_data_iter_get(playlist_iter,
+            RCLIB_DB_PLAYLIST_DATA_TYPE_RATING, &prating,
+            RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
+        if(prating<0.0) continue;
+        if((prating<=rating && condition) || (prating>=rating &&
+            !condition))
         {
-            if(playlist_iter==NULL) continue;
-            prating = -1.0;
-            rclib_db_playlist_data_iter_get(playlist_iter,
-                RCLIB_DB_PLAYLIST_DATA_TYPE_RATING, &prating,
-                RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-            if(prating<0.0) continue;
-            if((prating<=rating && condition) || (prating>=rating &&
-                !condition))
-            {
-                g_ptr_array_add(playlist_array, playlist_iter);
-            }
+            g_ptr_array_add(playlist_array, playlist_iter);
         }
     }
     playlist_length = playlist_array->len;
@@ -4639,24 +4153,35 @@ void rclib_db_catalog_name_sort(gboolean direction)
     g_free(order);
 }
 
-static gint rclib_db_variant_sort_asc_func(GSequenceIter *a, GSequenceIter *b,
-    gpointer user_data)
-{
-    GHashTable *new_positions = user_data;
-    GVariant *variant1, *variant2;
-    variant1 = g_hash_table_lookup(new_positions, a);
-    variant2 = g_hash_table_lookup(new_positions, b);
-    return g_variant_compare(variant1, variant2);
-}
-
-static gint rclib_db_variant_sort_dsc_func(GSequenceIter *a, GSequenceIter *b,
-    gpointer user_data)
+static inline RCLibDbQueryDataType rclib_db_playlist_data_type_to_query_type(
+    RCLibDbPlaylistDataType data_type)
 {
-    GHashTable *new_positions = user_data;
-    GVariant *variant1, *variant2;
-    variant1 = g_hash_table_lookup(new_positions, a);
-    variant2 = g_hash_table_lookup(new_positions, b);
-    return g_variant_compare(variant2, variant1);
+    switch(data_type)
+    {
+        case RCLIB_DB_PLAYLIST_DATA_TYPE_URI:
+            return RCLIB_DB_QUERY_DATA_TYPE_URI;
+        case RCLIB_DB_PLAYLIST_DATA_TYPE_TITLE:
+            return RCLIB_DB_QUERY_DATA_TYPE_TITLE;
+        case RCLIB_DB_PLAYLIST_DATA_TYPE_ARTIST:
+            return RCLIB_DB_QUERY_DATA_TYPE_ARTIST;
+        case RCLIB_DB_PLAYLIST_DATA_TYPE_ALBUM:
+            return RCLIB_DB_QUERY_DATA_TYPE_ALBUM;
+        case RCLIB_DB_PLAYLIST_DATA_TYPE_FTYPE:
+            return RCLIB_DB_QUERY_DATA_TYPE_FTYPE;
+        case RCLIB_DB_PLAYLIST_DATA_TYPE_LENGTH:
+            return RCLIB_DB_QUERY_DATA_TYPE_LENGTH;
+        case RCLIB_DB_PLAYLIST_DATA_TYPE_TRACKNUM:
+            return RCLIB_DB_QUERY_DATA_TYPE_TRACKNUM;
+        case RCLIB_DB_PLAYLIST_DATA_TYPE_YEAR:
+            return RCLIB_DB_QUERY_DATA_TYPE_YEAR;
+        case RCLIB_DB_PLAYLIST_DATA_TYPE_RATING:
+            return RCLIB_DB_QUERY_DATA_TYPE_RATING;
+        case RCLIB_DB_PLAYLIST_DATA_TYPE_GENRE:
+            return RCLIB_DB_QUERY_DATA_TYPE_GENRE;
+        default:
+            break;
+    }
+    return RCLIB_DB_QUERY_DATA_TYPE_NONE;
 }
 
 /**
@@ -4672,159 +4197,65 @@ static gint rclib_db_variant_sort_dsc_func(GSequenceIter *a, GSequenceIter *b,
 
 void rclib_db_playlist_item_sort(RCLibDbCatalogIter *catalog_iter,
     RCLibDbPlaylistDataType column, gboolean direction)
+{
+    rclib_db_playlist_item_sort_multi(catalog_iter, &column, 1, direction);
+}
+
+/**
+ * rclib_db_playlist_item_sort_multi:
+ * @catalog_iter: the iter pointed to catalog
+ * @columns: (array length=n_columns): the columns to sort
+ * @n_columns: the number of the columns
+ * @direction: the sort direction, #FALSE to use ascending, #TRUE to use
+ *     descending
+ * 
+ * Sort the playlist items by the given @columns, the items which have
+ * the same value in a column are sorted by the next column, e.g. artist,
+ * album, and then track number. This function can only be called in
+ * main thread.
+ */
+
+void rclib_db_playlist_item_sort_multi(RCLibDbCatalogIter *catalog_iter,
+    const RCLibDbPlaylistDataType *columns, guint n_columns,
+    gboolean direction)
 {
     RCLibDbPrivate *priv;
     GObject *instance;
-    gint i;
-    gint *order = NULL;
+    RCLibDbQueryDataType sort_columns[RCLIB_DB_SORT_COLUMN_MAX];
     RCLibDbPlaylistSequence *playlist = NULL;
-    GHashTable *new_positions, *sort_table;
-    RCLibDbPlaylistIter *ptr;
-    gint length;
-    GType column_type = G_TYPE_NONE;
-    if(catalog_iter==NULL) return;
+    gint *order = NULL;
+    gint length = 0;
+    guint i;
+    if(catalog_iter==NULL || columns==NULL || n_columns==0) return;
     instance = rclib_db_get_instance();
     if(instance==NULL) return;
     priv = RCLIB_DB(instance)->priv;
-    GVariant *variant;
     if(priv==NULL) return;
-    switch(column)
+    if(n_columns>RCLIB_DB_SORT_COLUMN_MAX)
+        n_columns = RCLIB_DB_SORT_COLUMN_MAX;
+    for(i=0;i<n_columns;i++)
     {
-        case RCLIB_DB_PLAYLIST_DATA_TYPE_TITLE:
-        case RCLIB_DB_PLAYLIST_DATA_TYPE_ARTIST:
-        case RCLIB_DB_PLAYLIST_DATA_TYPE_ALBUM:
-        case RCLIB_DB_PLAYLIST_DATA_TYPE_FTYPE:
-        case RCLIB_DB_PLAYLIST_DATA_TYPE_GENRE:
-        {
-            column_type = G_TYPE_STRING;
-            break;
-        }
-        case RCLIB_DB_PLAYLIST_DATA_TYPE_LENGTH:
+        sort_columns[i] = rclib_db_playlist_data_type_to_query_type(
+            columns[i]);
+        if(sort_columns[i]==RCLIB_DB_QUERY_DATA_TYPE_NONE)
         {
-            column_type = G_TYPE_INT64;
-            break;
-        }
-        case RCLIB_DB_PLAYLIST_DATA_TYPE_TRACKNUM:
-        case RCLIB_DB_PLAYLIST_DATA_TYPE_YEAR:
-        {
-            column_type = G_TYPE_INT;
-            break;
-        }
-        case RCLIB_DB_PLAYLIST_DATA_TYPE_RATING:
-        {
-            column_type = G_TYPE_FLOAT;
-            break;
-        }
-        default:
-        {
-            g_warning("Error column type: %u", column);
+            g_warning("Error column type: %u", columns[i]);
             return;
-            break;
         }
     }
-    sort_table = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
-        (GDestroyNotify)g_variant_unref);
-    new_positions = g_hash_table_new(g_direct_hash, g_direct_equal);
-    g_rw_lock_reader_lock(&(priv->playlist_rw_lock));
-    ptr = rclib_db_playlist_get_begin_iter(catalog_iter);
-    for(i=0;ptr!=NULL;ptr=rclib_db_playlist_iter_next(ptr))
-    {
-        variant = NULL;
-        switch(column_type)
-        {
-            case G_TYPE_STRING:
-            {
-                gchar *vstr = NULL;
-                gchar *cstr = NULL;
-                gchar *uri = NULL;
-                rclib_db_playlist_data_iter_get(ptr, column, &vstr,
-                    RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                if(column==RCLIB_DB_PLAYLIST_DATA_TYPE_TITLE &&
-                    (vstr==NULL || strlen(vstr)==0))
-                {
-                    rclib_db_playlist_data_iter_get(ptr,
-                        RCLIB_DB_PLAYLIST_DATA_TYPE_URI, &uri,
-                        RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                    if(uri!=NULL)
-                        vstr = rclib_tag_get_name_from_uri(uri);
-                    g_free(uri);
-                }                
-                if(vstr==NULL) vstr = g_strdup("");
-                cstr = g_utf8_casefold(vstr, -1);
-                variant = g_variant_new_string(vstr);
-                g_free(cstr);
-                g_free(vstr);
-                break;
-            }
-            case G_TYPE_INT:
-            {
-                gint vint = 0;
-                rclib_db_playlist_data_iter_get(ptr, column, &vint,
-                    RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                variant = g_variant_new_int32(vint);
-                break;
-            }
-            case G_TYPE_INT64:
-            {
-                gint64 vint64 = 0;
-                rclib_db_playlist_data_iter_get(ptr, column, &vint64,
-                    RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                variant = g_variant_new_int64(vint64);
-                break;
-            }
-            case G_TYPE_FLOAT:
-            {
-                gfloat vfloat = 0;
-                rclib_db_playlist_data_iter_get(ptr, column, &vfloat,
-                    RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
-                variant = g_variant_new_double(vfloat);
-                break;
-            }
-            default:
-            {
-                variant = g_variant_new_boolean(FALSE);
-                g_warning("Wrong column data type, this should not happen!");
-                break;
-            }
-        }
-        g_hash_table_insert(new_positions, ptr, GINT_TO_POINTER(i));
-        g_hash_table_insert(sort_table, ptr, g_variant_take_ref(variant));
-        i++;
-    }
-    g_rw_lock_reader_unlock(&(priv->playlist_rw_lock));
     g_rw_lock_writer_lock(&(priv->playlist_rw_lock));
     g_rw_lock_reader_lock(&(priv->catalog_rw_lock));
     rclib_db_catalog_data_iter_get(catalog_iter,
         RCLIB_DB_CATALOG_DATA_TYPE_PLAYLIST, &playlist,
         RCLIB_DB_CATALOG_DATA_TYPE_NONE);
     if(playlist!=NULL)
-    {    
-        if(direction)
-        {
-            g_sequence_sort_iter((GSequence *)playlist,
-                rclib_db_variant_sort_dsc_func, sort_table);
-        }
-        else
-        {
-            g_sequence_sort_iter((GSequence *)playlist,
-                rclib_db_variant_sort_asc_func, sort_table);
-        }
+    {
+        order = _rclib_db_sort_sequence((GSequence *)playlist, TRUE,
+            sort_columns, n_columns, direction, &length);
     }
     g_rw_lock_reader_unlock(&(priv->catalog_rw_lock));
     g_rw_lock_writer_unlock(&(priv->playlist_rw_lock));
-    g_hash_table_destroy(sort_table);
-    g_rw_lock_reader_lock(&(priv->playlist_rw_lock));
-    length = rclib_db_playlist_get_length(catalog_iter);
-    order = g_new(gint, length);
-    ptr = rclib_db_playlist_get_begin_iter(catalog_iter);
-    for(i=0;ptr!=NULL;ptr=rclib_db_playlist_iter_next(ptr))
-    {
-        order[i] = GPOINTER_TO_INT(g_hash_table_lookup(new_positions,
-            ptr));
-        i++;
-    }
-    g_rw_lock_reader_unlock(&(priv->playlist_rw_lock));
-    g_hash_table_destroy(new_positions);
+    if(order==NULL) return;
     priv->dirty_flag = TRUE;
     g_signal_emit_by_name(instance, "playlist-reordered", catalog_iter,
         order);
@@ -26,6 +26,7 @@
 #define HAVE_RC_LIB_DB_PRIVATE_H
 
 #include "rclib-db.h"
+#include "rclib-db-binary.h"
 #include "rclib-tag.h"
 
 #define RCLIB_DB_ERROR rclib_db_error_quark()
@@ -42,8 +43,77 @@ typedef enum
     RCLIB_DB_REFRESH_TYPE_LIBRARY = 1
 }RCLibDbRefreshType;
 
+typedef enum
+{
+    RCLIB_DB_SORT_KEY_TITLE = 0,
+    RCLIB_DB_SORT_KEY_ARTIST = 1,
+    RCLIB_DB_SORT_KEY_ALBUM = 2,
+    RCLIB_DB_SORT_KEY_FTYPE = 3,
+    RCLIB_DB_SORT_KEY_GENRE = 4,
+    RCLIB_DB_SORT_KEY_NUM = 5
+}RCLibDbSortKeyType;
+
+#define RCLIB_DB_SORT_COLUMN_MAX 8
+#define RCLIB_DB_LIBRARY_QUERY_CHAIN_MAX 32
+
+#define RCLIB_DB_FACET_GENRE 0
+#define RCLIB_DB_FACET_ARTIST 1
+#define RCLIB_DB_FACET_ALBUM 2
+#define RCLIB_DB_FACET_NUM 3
+
 typedef struct _RCLibDbCatalogSequence RCLibDbCatalogSequence;
 typedef struct _RCLibDbPlaylistSequence RCLibDbPlaylistSequence;
+typedef struct _RCLibDbQueryPlan RCLibDbQueryPlan;
+typedef struct _RCLibDbFacetNode RCLibDbFacetNode;
+typedef struct _RCLibDbPlaylistRandomEntry RCLibDbPlaylistRandomEntry;
+typedef struct _RCLibDbPlaylistRatingBucket RCLibDbPlaylistRatingBucket;
+
+typedef struct RCLibDbFileFingerprint
+{
+    gint64 mtime;
+    gint64 filesize;
+    guint64 inode;
+}RCLibDbFileFingerprint;
+
+/*
+ * The journal file: a header, followed by the entries which record the
+ * changes since the database file was saved. Each entry is followed by
+ * its payload, padded to 8 bytes. The catalog and library update payloads
+ * are binary database images, the library delete payload is a list of
+ * NUL-terminated URIs. The playlist payload is a binary database image
+ * with all catalogs, but only the changed catalogs have their playlists,
+ * the others are marked with RCLIB_DB_JOURNAL_PLAYLIST_UNCHANGED as the
+ * playlist index. The catalog payload is written in the same way, except
+ * that an unchanged catalog uses its playlist count field to refer to its
+ * position in the catalog list written by the previous catalog entry or
+ * the database file, the new catalogs always have their playlists.
+ */
+
+#define RCLIB_DB_JOURNAL_MAGIC "RCLIBJN\x1a"
+#define RCLIB_DB_JOURNAL_VERSION 3
+#define RCLIB_DB_JOURNAL_PLAYLIST_UNCHANGED G_MAXUINT32
+
+typedef enum
+{
+    RCLIB_DB_JOURNAL_ENTRY_CATALOG = 1,
+    RCLIB_DB_JOURNAL_ENTRY_LIBRARY_UPDATE = 2,
+    RCLIB_DB_JOURNAL_ENTRY_LIBRARY_DELETE = 3,
+    RCLIB_DB_JOURNAL_ENTRY_PLAYLIST = 4
+}RCLibDbJournalEntryType;
+
+typedef struct RCLibDbJournalHeader
+{
+    gchar magic[8];
+    guint32 version;
+    guint32 byte_order;
+}RCLibDbJournalHeader;
+
+typedef struct RCLibDbJournalEntry
+{
+    guint32 type;
+    guint32 reserved;
+    guint64 size;
+}RCLibDbJournalEntry;
 
 typedef struct RCLibDbImportData
 {
@@ -60,6 +130,8 @@ typedef struct RCLibDbRefreshData
     gchar *uri;
     RCLibDbCatalogIter *catalog_iter;
     RCLibDbPlaylistIter *playlist_iter;
+    gboolean incremental_flag;
+    RCLibDbFileFingerprint fingerprint;
 }RCLibDbRefreshData;
 
 typedef struct RCLibDbPlaylistImportIdleData
@@ -69,6 +141,7 @@ typedef struct RCLibDbPlaylistImportIdleData
     RCLibDbPlaylistIter *playlist_insert_iter;
     RCLibDbPlaylistType type;
     gboolean play_flag;
+    RCLibDbFileFingerprint fingerprint;
 }RCLibDbPlaylistImportIdleData;
 
 typedef struct RCLibDbPlaylistRefreshIdleData
@@ -77,6 +150,7 @@ typedef struct RCLibDbPlaylistRefreshIdleData
     RCLibDbCatalogIter *catalog_iter;
     RCLibDbPlaylistIter *playlist_iter;
     RCLibDbPlaylistType type;
+    RCLibDbFileFingerprint fingerprint;
 }RCLibDbPlaylistRefreshIdleData;
 
 typedef struct RCLibDbLibraryImportIdleData
@@ -84,14 +158,54 @@ typedef struct RCLibDbLibraryImportIdleData
     RCLibTagMetadata *mmd;
     RCLibDbLibraryType type;
     gboolean play_flag;
+    RCLibDbFileFingerprint fingerprint;
 }RCLibDbLibraryImportIdleData;
 
 typedef struct RCLibDbLibraryRefreshIdleData
 {
     RCLibTagMetadata *mmd;
+    gchar *uri;
     RCLibDbLibraryType type;
+    RCLibDbFileFingerprint fingerprint;
 }RCLibDbLibraryRefreshIdleData;
 
+typedef struct RCLibDbLibraryQueryOrder
+{
+    RCLibDbQueryDataType columns[RCLIB_DB_SORT_COLUMN_MAX];
+    guint column_num;
+    gboolean direction;
+}RCLibDbLibraryQueryOrder;
+
+/*
+ * The query results chained to a base query result, in the order of their
+ * plans in a query job. The first one is the base query result, and the
+ * parent of each one is before it.
+ */
+
+typedef struct RCLibDbLibraryQueryChain
+{
+    RCLibDbLibraryQueryResult *query_results[
+        RCLIB_DB_LIBRARY_QUERY_CHAIN_MAX];
+    gint parents[RCLIB_DB_LIBRARY_QUERY_CHAIN_MAX];
+    gint serials[RCLIB_DB_LIBRARY_QUERY_CHAIN_MAX];
+    guint length;
+}RCLibDbLibraryQueryChain;
+
+typedef struct RCLibDbLibraryQueryJob
+{
+    RCLibDbLibraryQueryResult *query_result;
+    RCLibDbQueryPlan *plans[RCLIB_DB_LIBRARY_QUERY_CHAIN_MAX];
+    RCLibDbLibraryQueryChain chain;
+    GPtrArray *result;
+    GArray *masks;
+    RCLibDbLibraryQueryOrder order;
+    gint serial;
+    guint offset;
+}RCLibDbLibraryQueryJob;
+
+typedef gboolean (*RCLibDbLibraryQueryChunkFunc)(GPtrArray *chunk,
+    GArray *masks, gpointer data);
+
 struct _RCLibDbPrivate
 {
     gchar *filename;
@@ -101,50 +215,118 @@ struct _RCLibDbPrivate
     GHashTable *playlist_sequence_table;
     GRWLock catalog_rw_lock;
     GRWLock playlist_rw_lock;
+    GMutex playlist_random_mutex;
+    GHashTable *playlist_random_table;
+    GPtrArray *playlist_random_array;
+    GPtrArray *playlist_rating_buckets;
     GSequence *library_query;
     GHashTable *library_table;
     GHashTable *library_ptr_table;
     GRWLock library_rw_lock;
-    GHashTable *library_keyword_table;
+    GRWLock library_index_lock;
+    GHashTable *library_index_table;
+    GPtrArray *library_index_items;
+    GHashTable *library_index_id_table;
+    guint library_index_dead;
+    gboolean library_index_valid;
+    GRWLock library_facet_lock;
+    RCLibDbFacetNode *library_facet_root;
+    GHashTable *library_facet_record_table;
+    gboolean library_facet_valid;
     GObject *library_query_base;
     GObject *library_query_genre;
     GObject *library_query_artist;
     GObject *library_query_album;
-    GThread *import_thread;
+    GThreadPool *library_scan_pool;
+    guint library_scan_thread_num;
+    GThread **import_threads;
+    guint import_thread_num;
+    gint import_thread_started;
+    guint import_worker_limit;
+    GMutex import_worker_mutex;
+    GCond import_worker_cond;
+    GMutex import_order_mutex;
+    GHashTable *import_order_table;
+    guint import_pop_seq;
+    guint import_deliver_seq;
+    gint import_busy_count;
     GThread *refresh_thread;
     GThread *autosave_thread;
     GAsyncQueue *import_queue;
     GAsyncQueue *refresh_queue;
     gboolean import_work_flag;
     gboolean refresh_work_flag;
+    guint refresh_unchanged_count;
+    guint refresh_changed_count;
+    guint refresh_missing_count;
     gboolean dirty_flag;
     gboolean work_flag;
     gulong autosave_timeout;
     GMutex autosave_mutex;
     GCond autosave_cond;
-    GString *autosave_xml_data;
+    gboolean autosave_pending_flag;
+    gboolean autosave_catalog_flag;
+    GHashTable *autosave_playlist_table;
+    GHashTable *autosave_library_table;
+    GMutex journal_mutex;
+    gboolean journal_catalog_flag;
+    GArray *journal_catalog_array;
+    GHashTable *journal_playlist_table;
+    GHashTable *journal_library_table;
+    GHashTable *watch_root_table;
+    GHashTable *watch_monitor_table;
+    GHashTable *watch_pending_table;
+    GThread *watch_thread;
+    GAsyncQueue *watch_queue;
+    guint watch_limit;
+    guint watch_scan_interval;
+    guint watch_flush_timeout;
+    guint watch_scan_timeout;
+    gboolean watch_overflow_flag;
+    GThreadPool *gain_pool;
+    GHashTable *gain_pending_table;
+    guint gain_schedule_id;
+    gboolean gain_analysis_flag;
+    gboolean gain_work_flag;
 };
 
 struct _RCLibDbLibraryQueryResultPrivate
 {
     RCLibDbLibraryQueryResult *base_query_result;
     RCLibDbQuery *query;
+    RCLibDbQueryPlan *query_plan;
     GAsyncQueue *query_queue;
     GSequence *query_sequence;
     GHashTable *query_iter_table;
     GHashTable *query_uri_table;
     GHashTable *prop_table;
-    RCLibDbLibraryDataType sort_column;
+    RCLibDbQueryDataType sort_columns[RCLIB_DB_SORT_COLUMN_MAX];
+    guint sort_column_num;
     gboolean sort_direction;
+    RCLibDbLibraryQueryOrder load_order;
+    GPtrArray *bulk_result;
+    GArray *bulk_masks;
+    const RCLibDbLibraryQueryChain *bulk_chain;
+    const RCLibDbLibraryQueryOrder *bulk_order;
+    GSList *chain_children;
+    gint plan_serial;
     GThread *query_thread;
     GCancellable *cancellable;
+    GAsyncQueue *load_queue;
+    RCLibDbLibraryQueryJob *load_job;
+    const RCLibDbLibraryQueryChain *load_chain;
+    guint32 load_mask;
+    volatile gint load_scheduled;
+    volatile gint query_serial;
     gboolean list_need_sort;
+    guint facet_refresh_id;
     gulong library_added_id;
     gulong library_changed_id;
     gulong library_deleted_id;
     gulong base_added_id;
     gulong base_changed_id;
     gulong base_delete_id;
+    gulong base_reset_id;
 };
 
 struct _RCLibDbCatalogData
@@ -152,6 +334,7 @@ struct _RCLibDbCatalogData
     /*< private >*/
     gint ref_count;
     GRWLock lock;
+    guint journal_id;
     
     /*< public >*/
     RCLibDbPlaylistSequence *playlist;
@@ -184,6 +367,12 @@ struct _RCLibDbPlaylistData
     gchar *lyricfile;
     gchar *lyricsecfile;
     gchar *albumfile;
+    gint64 mtime;
+    gint64 filesize;
+    guint64 inode;
+
+    /*< private >*/
+    gchar *sort_keys[RCLIB_DB_SORT_KEY_NUM];
 };
 
 struct _RCLibDbLibraryData
@@ -207,6 +396,17 @@ struct _RCLibDbLibraryData
     gchar *lyricfile;
     gchar *lyricsecfile;
     gchar *albumfile;
+    gint64 mtime;
+    gint64 filesize;
+    guint64 inode;
+    gdouble track_gain;
+    gdouble track_peak;
+    gdouble album_gain;
+    gdouble album_peak;
+    guint gain_flags;
+
+    /*< private >*/
+    gchar *sort_keys[RCLIB_DB_SORT_KEY_NUM];
 };
 
 typedef struct _RCLibDbQueryData {
@@ -217,6 +417,20 @@ typedef struct _RCLibDbQueryData {
 	RCLibDbQuery *subquery;
 }RCLibDbQueryData;
 
+typedef struct RCLibDbQueryPlanTerm
+{
+    guint group;
+    guint propid;
+    const gchar *needle;
+    gsize needle_len;
+}RCLibDbQueryPlanTerm;
+
+typedef struct RCLibDbFacetCount
+{
+    gchar *name;
+    guint count;
+}RCLibDbFacetCount;
+
 /*< private >*/
 gboolean _rclib_db_instance_init_playlist(RCLibDb *db, RCLibDbPrivate *priv);
 gboolean _rclib_db_instance_init_library(RCLibDb *db, RCLibDbPrivate *priv);
@@ -233,6 +447,46 @@ gboolean _rclib_db_library_import_idle_cb(gpointer data);
 gboolean _rclib_db_library_refresh_idle_cb(gpointer data);
 void _rclib_db_library_append_data_internal(const gchar *uri,
     RCLibDbLibraryData *library_data);
+guint _rclib_db_library_refresh_matched(RCLibDbPrivate *priv,
+    GHashTable *file_table, GSList *dir_list);
+GHashTable *_rclib_db_library_get_file_table(RCLibDbPrivate *priv);
+void _rclib_db_library_query_chunked(RCLibDbQueryPlan * const *plans,
+    const gint *parents, guint n_plans, GCancellable *cancellable,
+    RCLibDbLibraryQueryChunkFunc chunk_func, gpointer chunk_data);
+gboolean _rclib_db_instance_init_watch(RCLibDb *db, RCLibDbPrivate *priv);
+void _rclib_db_instance_finalize_watch(RCLibDbPrivate *priv);
+gchar *_rclib_db_string_intern(const gchar *str);
+void _rclib_db_string_release(gchar *str);
+RCLibDbQueryPlan *_rclib_db_query_plan_new(const RCLibDbQuery *query);
+void _rclib_db_query_plan_free(RCLibDbQueryPlan *plan);
+gboolean _rclib_db_query_plan_is_constant(const RCLibDbQueryPlan *plan,
+    gboolean *value);
+gboolean _rclib_db_query_plan_eval(const RCLibDbQueryPlan *plan,
+    gconstpointer view);
+GArray *_rclib_db_query_plan_get_terms(const RCLibDbQueryPlan *plan,
+    guint *group_count);
+gboolean _rclib_db_query_plan_get_equals(const RCLibDbQueryPlan *plan,
+    guint *propid, GPtrArray *values);
+gboolean _rclib_db_instance_init_index(RCLibDb *db, RCLibDbPrivate *priv);
+void _rclib_db_instance_finalize_index(RCLibDbPrivate *priv);
+void _rclib_db_library_index_invalidate(RCLibDbPrivate *priv);
+GPtrArray *_rclib_db_library_index_lookup(RCLibDbPrivate *priv,
+    const RCLibDbQueryPlan *plan);
+gboolean _rclib_db_instance_init_facet(RCLibDb *db, RCLibDbPrivate *priv);
+void _rclib_db_instance_finalize_facet(RCLibDbPrivate *priv);
+void _rclib_db_library_facet_invalidate(RCLibDbPrivate *priv);
+gint _rclib_db_facet_from_propid(guint propid);
+GArray *_rclib_db_library_facet_lookup(RCLibDbPrivate *priv,
+    GPtrArray * const *selection, guint facet, guint *total);
+gint _rclib_db_sort_data_compare(gpointer data1, gpointer data2,
+    gboolean playlist_flag, const RCLibDbQueryDataType *columns,
+    guint n_columns);
+gint *_rclib_db_sort_sequence(GSequence *sequence, gboolean playlist_flag,
+    const RCLibDbQueryDataType *columns, guint n_columns,
+    gboolean direction, gint *length);
+void _rclib_db_sort_keys_clear(gchar **sort_keys);
+gboolean _rclib_db_instance_init_gain(RCLibDb *db, RCLibDbPrivate *priv);
+void _rclib_db_instance_finalize_gain(RCLibDbPrivate *priv);
 
 #endif
 
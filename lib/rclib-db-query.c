@@ -0,0 +1,717 @@
+/*
+ * RhythmCat Library Music Database Module (Query Plan Part.)
+ * Compile the query conditions into flat plans for scanning the database.
+ *
+ * rclib-db-query.c
+ * This file is part of RhythmCat Library (LibRhythmCat)
+ *
+ * Copyright (C) 2012 - SuperCat, license: GPL v3
+ *
+ * RhythmCat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RhythmCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RhythmCat; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include "rclib-db.h"
+#include "rclib-db-priv.h"
+#include "rclib-common.h"
+#include "rclib-tag.h"
+
+/*
+ * A query is evaluated from left to right without precedence: each
+ * condition is joined to the result of the conditions before it with
+ * AND, or with OR if an OR condition is in front of it, so the query
+ * "A B OR C D" means "((A AND B) OR C) AND D". Cut the query before
+ * each condition following an OR into segments, then the query is
+ * satisfied if the other conditions of the last segment (here "D") are
+ * all satisfied, and either the first condition of that segment (here
+ * "C") is satisfied, or the part before the segment is satisfied.
+ *
+ * So the plan stores the segments from the last one to the first one
+ * in one array, with the property types and the field offsets resolved.
+ * The tail conditions of a segment must all be satisfied, and they are
+ * sorted by cost. The head condition of a segment satisfies the whole
+ * plan, or moves on to the previous segment. Reaching the end of the
+ * plan gives the value of the plan. The conditions whose results do not
+ * depend on the items are folded while compiling, and the plan is a
+ * constant if no condition is left.
+ *
+ * The library view and the playlist view have the same layout, so the
+ * same plan can be evaluated on both of them.
+ */
+
+#define RCLIB_DB_QUERY_PLAN_VIEW_CHECK(field) \
+    G_STATIC_ASSERT(G_STRUCT_OFFSET(RCLibDbLibraryDataView, field)== \
+        G_STRUCT_OFFSET(RCLibDbPlaylistDataView, field))
+
+RCLIB_DB_QUERY_PLAN_VIEW_CHECK(uri);
+RCLIB_DB_QUERY_PLAN_VIEW_CHECK(title);
+RCLIB_DB_QUERY_PLAN_VIEW_CHECK(artist);
+RCLIB_DB_QUERY_PLAN_VIEW_CHECK(album);
+RCLIB_DB_QUERY_PLAN_VIEW_CHECK(ftype);
+RCLIB_DB_QUERY_PLAN_VIEW_CHECK(genre);
+RCLIB_DB_QUERY_PLAN_VIEW_CHECK(length);
+RCLIB_DB_QUERY_PLAN_VIEW_CHECK(tracknum);
+RCLIB_DB_QUERY_PLAN_VIEW_CHECK(year);
+RCLIB_DB_QUERY_PLAN_VIEW_CHECK(rating);
+
+#define RCLIB_DB_QUERY_PLAN_DOUBLE_EPSILON 10e-5
+
+typedef enum {
+    RCLIB_DB_QUERY_PLAN_FIELD_STRING = 0,
+    RCLIB_DB_QUERY_PLAN_FIELD_TITLE = 1,
+    RCLIB_DB_QUERY_PLAN_FIELD_INT = 2,
+    RCLIB_DB_QUERY_PLAN_FIELD_INT64 = 3,
+    RCLIB_DB_QUERY_PLAN_FIELD_FLOAT = 4,
+    RCLIB_DB_QUERY_PLAN_FIELD_SUBPLAN = 5
+}RCLibDbQueryPlanFieldType;
+
+typedef enum {
+    RCLIB_DB_QUERY_PLAN_FOLD_NONE = 0,
+    RCLIB_DB_QUERY_PLAN_FOLD_TRUE = 1,
+    RCLIB_DB_QUERY_PLAN_FOLD_FALSE = 2
+}RCLibDbQueryPlanFoldType;
+
+typedef struct RCLibDbQueryPlanNode
+{
+    RCLibDbQueryConditionType condition;
+    RCLibDbQueryPlanFieldType field_type;
+    guint propid;
+    gsize offset;
+    guint cost;
+    gboolean head;
+    gchar *needle;
+    gsize needle_len;
+    gint64 int_value;
+    gdouble double_value;
+    RCLibDbQueryPlan *subplan;
+}RCLibDbQueryPlanNode;
+
+struct _RCLibDbQueryPlan
+{
+    RCLibDbQueryPlanNode *nodes;
+    guint length;
+    gboolean constant;
+    gboolean value;
+};
+
+typedef struct RCLibDbQueryPlanSegment
+{
+    gint head;
+    GArray *tail;
+}RCLibDbQueryPlanSegment;
+
+static inline void rclib_db_query_plan_node_clear(RCLibDbQueryPlanNode *node)
+{
+    g_free(node->needle);
+    node->needle = NULL;
+    if(node->subplan!=NULL)
+        _rclib_db_query_plan_free(node->subplan);
+    node->subplan = NULL;
+}
+
+static gboolean rclib_db_query_plan_field_resolve(guint propid,
+    RCLibDbQueryPlanFieldType *type, gsize *offset)
+{
+    switch(propid)
+    {
+        case RCLIB_DB_QUERY_DATA_TYPE_URI:
+            *type = RCLIB_DB_QUERY_PLAN_FIELD_STRING;
+            *offset = G_STRUCT_OFFSET(RCLibDbLibraryDataView, uri);
+            break;
+        case RCLIB_DB_QUERY_DATA_TYPE_TITLE:
+            *type = RCLIB_DB_QUERY_PLAN_FIELD_TITLE;
+            *offset = G_STRUCT_OFFSET(RCLibDbLibraryDataView, title);
+            break;
+        case RCLIB_DB_QUERY_DATA_TYPE_ARTIST:
+            *type = RCLIB_DB_QUERY_PLAN_FIELD_STRING;
+            *offset = G_STRUCT_OFFSET(RCLibDbLibraryDataView, artist);
+            break;
+        case RCLIB_DB_QUERY_DATA_TYPE_ALBUM:
+            *type = RCLIB_DB_QUERY_PLAN_FIELD_STRING;
+            *offset = G_STRUCT_OFFSET(RCLibDbLibraryDataView, album);
+            break;
+        case RCLIB_DB_QUERY_DATA_TYPE_FTYPE:
+            *type = RCLIB_DB_QUERY_PLAN_FIELD_STRING;
+            *offset = G_STRUCT_OFFSET(RCLibDbLibraryDataView, ftype);
+            break;
+        case RCLIB_DB_QUERY_DATA_TYPE_GENRE:
+            *type = RCLIB_DB_QUERY_PLAN_FIELD_STRING;
+            *offset = G_STRUCT_OFFSET(RCLibDbLibraryDataView, genre);
+            break;
+        case RCLIB_DB_QUERY_DATA_TYPE_LENGTH:
+            *type = RCLIB_DB_QUERY_PLAN_FIELD_INT64;
+            *offset = G_STRUCT_OFFSET(RCLibDbLibraryDataView, length);
+            break;
+        case RCLIB_DB_QUERY_DATA_TYPE_TRACKNUM:
+            *type = RCLIB_DB_QUERY_PLAN_FIELD_INT;
+            *offset = G_STRUCT_OFFSET(RCLibDbLibraryDataView, tracknum);
+            break;
+        case RCLIB_DB_QUERY_DATA_TYPE_YEAR:
+            *type = RCLIB_DB_QUERY_PLAN_FIELD_INT;
+            *offset = G_STRUCT_OFFSET(RCLibDbLibraryDataView, year);
+            break;
+        case RCLIB_DB_QUERY_DATA_TYPE_RATING:
+            *type = RCLIB_DB_QUERY_PLAN_FIELD_FLOAT;
+            *offset = G_STRUCT_OFFSET(RCLibDbLibraryDataView, rating);
+            break;
+        default:
+            return FALSE;
+    }
+    return TRUE;
+}
+
+static RCLibDbQueryPlanFoldType rclib_db_query_plan_node_init(
+    RCLibDbQueryPlanNode *node, const RCLibDbQueryData *query_data,
+    gboolean first_flag)
+{
+    const gchar *str;
+    gboolean pattern_flag = FALSE;
+    gboolean value;
+    memset(node, 0, sizeof(RCLibDbQueryPlanNode));
+    node->condition = query_data->type;
+    switch(query_data->type)
+    {
+        case RCLIB_DB_QUERY_CONDITION_TYPE_SUBQUERY:
+        {
+            if(query_data->subquery==NULL)
+                return RCLIB_DB_QUERY_PLAN_FOLD_FALSE;
+            node->subplan = _rclib_db_query_plan_new(query_data->subquery);
+            if(node->subplan->constant)
+            {
+                value = node->subplan->value;
+                rclib_db_query_plan_node_clear(node);
+                return value ? RCLIB_DB_QUERY_PLAN_FOLD_TRUE :
+                    RCLIB_DB_QUERY_PLAN_FOLD_FALSE;
+            }
+            node->field_type = RCLIB_DB_QUERY_PLAN_FIELD_SUBPLAN;
+            node->cost = 8 + node->subplan->length;
+            return RCLIB_DB_QUERY_PLAN_FOLD_NONE;
+        }
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_LIKE:
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_NOT_LIKE:
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_PREFIX:
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_SUFFIX:
+            pattern_flag = TRUE;
+            /* Fall through */
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_EQUALS:
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_NOT_EQUAL:
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_GREATER:
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_LESS:
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_GREATER_OR_EQUAL:
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_LESS_OR_EQUAL:
+            break;
+        default:
+        {
+            /* Unknown conditions only pass as the first condition. */
+            return first_flag ? RCLIB_DB_QUERY_PLAN_FOLD_TRUE :
+                RCLIB_DB_QUERY_PLAN_FOLD_FALSE;
+        }
+    }
+    if(query_data->val==NULL)
+        return RCLIB_DB_QUERY_PLAN_FOLD_FALSE;
+    node->propid = query_data->propid;
+    if(!rclib_db_query_plan_field_resolve(query_data->propid,
+        &(node->field_type), &(node->offset)))
+    {
+        return RCLIB_DB_QUERY_PLAN_FOLD_FALSE;
+    }
+    switch(node->field_type)
+    {
+        case RCLIB_DB_QUERY_PLAN_FIELD_STRING:
+        case RCLIB_DB_QUERY_PLAN_FIELD_TITLE:
+        {
+            if(!G_VALUE_HOLDS_STRING(query_data->val))
+                return RCLIB_DB_QUERY_PLAN_FOLD_FALSE;
+            str = g_value_get_string(query_data->val);
+            if(pattern_flag && str==NULL)
+            {
+                if(node->condition==
+                    RCLIB_DB_QUERY_CONDITION_TYPE_PROP_NOT_LIKE)
+                    return RCLIB_DB_QUERY_PLAN_FOLD_TRUE;
+                return RCLIB_DB_QUERY_PLAN_FOLD_FALSE;
+            }
+            if(pattern_flag && *str=='\0')
+            {
+                if(node->condition==
+                    RCLIB_DB_QUERY_CONDITION_TYPE_PROP_NOT_LIKE)
+                    return RCLIB_DB_QUERY_PLAN_FOLD_FALSE;
+                return RCLIB_DB_QUERY_PLAN_FOLD_TRUE;
+            }
+            node->needle = g_strdup(str);
+            node->needle_len = str!=NULL ? strlen(str) : 0;
+            if(node->condition==RCLIB_DB_QUERY_CONDITION_TYPE_PROP_LIKE ||
+                node->condition==RCLIB_DB_QUERY_CONDITION_TYPE_PROP_NOT_LIKE)
+                node->cost = 4;
+            else if(node->condition==
+                RCLIB_DB_QUERY_CONDITION_TYPE_PROP_SUFFIX)
+                node->cost = 3;
+            else
+                node->cost = 2;
+            if(node->field_type==RCLIB_DB_QUERY_PLAN_FIELD_TITLE)
+                node->cost++;
+            break;
+        }
+        case RCLIB_DB_QUERY_PLAN_FIELD_INT:
+        {
+            if(pattern_flag || !G_VALUE_HOLDS_INT(query_data->val))
+                return RCLIB_DB_QUERY_PLAN_FOLD_FALSE;
+            node->int_value = g_value_get_int(query_data->val);
+            node->cost = 1;
+            break;
+        }
+        case RCLIB_DB_QUERY_PLAN_FIELD_INT64:
+        {
+            if(pattern_flag || !G_VALUE_HOLDS_INT64(query_data->val))
+                return RCLIB_DB_QUERY_PLAN_FOLD_FALSE;
+            node->int_value = g_value_get_int64(query_data->val);
+            node->cost = 1;
+            break;
+        }
+        case RCLIB_DB_QUERY_PLAN_FIELD_FLOAT:
+        {
+            if(pattern_flag)
+                return RCLIB_DB_QUERY_PLAN_FOLD_FALSE;
+            if(G_VALUE_HOLDS_DOUBLE(query_data->val))
+                node->double_value = g_value_get_double(query_data->val);
+            else if(G_VALUE_HOLDS_FLOAT(query_data->val))
+                node->double_value = g_value_get_float(query_data->val);
+            else
+                return RCLIB_DB_QUERY_PLAN_FOLD_FALSE;
+            node->cost = 1;
+            break;
+        }
+        default:
+            return RCLIB_DB_QUERY_PLAN_FOLD_FALSE;
+    }
+    return RCLIB_DB_QUERY_PLAN_FOLD_NONE;
+}
+
+static void rclib_db_query_plan_tail_sort(RCLibDbQueryPlanNode *nodes,
+    guint length)
+{
+    RCLibDbQueryPlanNode node;
+    guint i, j;
+    for(i=1;i<length;i++)
+    {
+        node = nodes[i];
+        for(j=i;j>0 && nodes[j-1].cost>node.cost;j--)
+            nodes[j] = nodes[j-1];
+        nodes[j] = node;
+    }
+}
+
+/*
+ * Compile the query into a plan. The plan does not refer to the query,
+ * so the query can be freed after this call. Free the plan with
+ * _rclib_db_query_plan_free().
+ */
+
+RCLibDbQueryPlan *_rclib_db_query_plan_new(const RCLibDbQuery *query)
+{
+    RCLibDbQueryPlan *plan;
+    RCLibDbQueryPlanNode node;
+    RCLibDbQueryPlanSegment segment;
+    const RCLibDbQueryPlanSegment *seg;
+    const RCLibDbQueryData *query_data;
+    GArray *segments, *nodes;
+    RCLibDbQueryPlanFoldType fold;
+    guint i, j, k, length, start, index;
+    gboolean or_flag = FALSE;
+    plan = g_new0(RCLibDbQueryPlan, 1);
+    if(query==NULL)
+    {
+        plan->constant = TRUE;
+        plan->value = FALSE;
+        return plan;
+    }
+    length = ((const GPtrArray *)query)->len;
+    segments = g_array_new(FALSE, TRUE, sizeof(RCLibDbQueryPlanSegment));
+    segment.head = -1;
+    segment.tail = g_array_new(FALSE, FALSE, sizeof(guint));
+    g_array_append_val(segments, segment);
+    for(i=0;i<length;i++)
+    {
+        query_data = g_ptr_array_index((const GPtrArray *)query, i);
+        if(query_data==NULL) continue;
+        if(query_data->type==RCLIB_DB_QUERY_CONDITION_TYPE_OR)
+            or_flag = TRUE;
+        else if(or_flag)
+        {
+            segment.head = i;
+            segment.tail = g_array_new(FALSE, FALSE, sizeof(guint));
+            g_array_append_val(segments, segment);
+            or_flag = FALSE;
+        }
+        else
+        {
+            g_array_append_val(g_array_index(segments,
+                RCLibDbQueryPlanSegment, segments->len - 1).tail, i);
+        }
+    }
+    nodes = g_array_new(FALSE, TRUE, sizeof(RCLibDbQueryPlanNode));
+    for(k=segments->len;k>0;k--)
+    {
+        seg = &g_array_index(segments, RCLibDbQueryPlanSegment, k-1);
+        start = nodes->len;
+        fold = RCLIB_DB_QUERY_PLAN_FOLD_NONE;
+        for(j=0;j<seg->tail->len;j++)
+        {
+            index = g_array_index(seg->tail, guint, j);
+            fold = rclib_db_query_plan_node_init(&node,
+                g_ptr_array_index((const GPtrArray *)query, index),
+                index==0);
+            if(fold==RCLIB_DB_QUERY_PLAN_FOLD_FALSE) break;
+            if(fold==RCLIB_DB_QUERY_PLAN_FOLD_NONE)
+                g_array_append_val(nodes, node);
+        }
+        if(fold==RCLIB_DB_QUERY_PLAN_FOLD_FALSE)
+        {
+            /* The segments before this one can never be reached. */
+            for(j=start;j<nodes->len;j++)
+            {
+                rclib_db_query_plan_node_clear(&g_array_index(nodes,
+                    RCLibDbQueryPlanNode, j));
+            }
+            g_array_set_size(nodes, start);
+            plan->value = FALSE;
+            break;
+        }
+        if(nodes->len>start+1)
+        {
+            rclib_db_query_plan_tail_sort(&g_array_index(nodes,
+                RCLibDbQueryPlanNode, start), nodes->len - start);
+        }
+        if(seg->head<0)
+        {
+            plan->value = TRUE;
+            break;
+        }
+        fold = rclib_db_query_plan_node_init(&node,
+            g_ptr_array_index((const GPtrArray *)query, seg->head), FALSE);
+        if(fold==RCLIB_DB_QUERY_PLAN_FOLD_TRUE)
+        {
+            plan->value = TRUE;
+            break;
+        }
+        if(fold==RCLIB_DB_QUERY_PLAN_FOLD_NONE)
+        {
+            node.head = TRUE;
+            g_array_append_val(nodes, node);
+        }
+    }
+    for(k=0;k<segments->len;k++)
+    {
+        g_array_free(g_array_index(segments, RCLibDbQueryPlanSegment,
+            k).tail, TRUE);
+    }
+    g_array_free(segments, TRUE);
+    if(nodes->len==0)
+    {
+        g_array_free(nodes, TRUE);
+        plan->constant = TRUE;
+        return plan;
+    }
+    plan->length = nodes->len;
+    plan->nodes = (RCLibDbQueryPlanNode *)g_array_free(nodes, FALSE);
+    return plan;
+}
+
+/*
+ * Free the plan created by _rclib_db_query_plan_new().
+ */
+
+void _rclib_db_query_plan_free(RCLibDbQueryPlan *plan)
+{
+    guint i;
+    if(plan==NULL) return;
+    for(i=0;i<plan->length;i++)
+        rclib_db_query_plan_node_clear(&(plan->nodes[i]));
+    g_free(plan->nodes);
+    g_free(plan);
+}
+
+/*
+ * Check whether the result of the plan does not depend on the items,
+ * and return the constant result in @value.
+ */
+
+gboolean _rclib_db_query_plan_is_constant(const RCLibDbQueryPlan *plan,
+    gboolean *value)
+{
+    if(plan==NULL) return FALSE;
+    if(plan->constant && value!=NULL)
+        *value = plan->value;
+    return plan->constant;
+}
+
+static inline gboolean rclib_db_query_plan_node_is_term(
+    const RCLibDbQueryPlanNode *node)
+{
+    return node->condition==RCLIB_DB_QUERY_CONDITION_TYPE_PROP_LIKE ||
+        node->condition==RCLIB_DB_QUERY_CONDITION_TYPE_PROP_PREFIX;
+}
+
+static inline void rclib_db_query_plan_term_append(GArray *terms,
+    const RCLibDbQueryPlanNode *node, guint group)
+{
+    RCLibDbQueryPlanTerm term;
+    term.group = group;
+    term.propid = node->propid;
+    term.needle = node->needle;
+    term.needle_len = node->needle_len;
+    g_array_append_val(terms, term);
+}
+
+/*
+ * Get the LIKE and PREFIX conditions in the plan, which can be answered
+ * by an index. The plan is satisfied only if all conditions of one of
+ * the groups are satisfied: a group is made for each head condition,
+ * with the tail conditions before it, and one more group is made for
+ * all tail conditions if the plan is satisfied at its end. The needles
+ * are owned by the plan. The groups are numbered from 0, and the number
+ * of the groups is returned in @group_count. Free the returned array
+ * with g_array_free().
+ */
+
+GArray *_rclib_db_query_plan_get_terms(const RCLibDbQueryPlan *plan,
+    guint *group_count)
+{
+    GArray *terms;
+    GPtrArray *tails;
+    const RCLibDbQueryPlanNode *node;
+    guint i, j, group = 0;
+    terms = g_array_new(FALSE, FALSE, sizeof(RCLibDbQueryPlanTerm));
+    tails = g_ptr_array_new();
+    for(i=0;plan!=NULL && i<plan->length;i++)
+    {
+        node = plan->nodes + i;
+        if(!node->head)
+        {
+            if(rclib_db_query_plan_node_is_term(node))
+                g_ptr_array_add(tails, (gpointer)node);
+            continue;
+        }
+        for(j=0;j<tails->len;j++)
+        {
+            rclib_db_query_plan_term_append(terms,
+                g_ptr_array_index(tails, j), group);
+        }
+        if(rclib_db_query_plan_node_is_term(node))
+            rclib_db_query_plan_term_append(terms, node, group);
+        group++;
+    }
+    if(plan!=NULL && plan->value)
+    {
+        for(j=0;j<tails->len;j++)
+        {
+            rclib_db_query_plan_term_append(terms,
+                g_ptr_array_index(tails, j), group);
+        }
+        group++;
+    }
+    g_ptr_array_free(tails, TRUE);
+    if(group_count!=NULL) *group_count = group;
+    return terms;
+}
+
+/*
+ * Check whether the plan only matches the items whose string property
+ * equals one of some values, which means it is a list of PROP_EQUALS
+ * conditions on the same property joined by OR conditions. The
+ * property is returned in @propid, and the values (owned by the plan)
+ * are appended to @values.
+ */
+
+gboolean _rclib_db_query_plan_get_equals(const RCLibDbQueryPlan *plan,
+    guint *propid, GPtrArray *values)
+{
+    const RCLibDbQueryPlanNode *node;
+    guint i;
+    if(plan==NULL || plan->constant || plan->length==0) return FALSE;
+    for(i=0;i<plan->length;i++)
+    {
+        node = plan->nodes + i;
+        if(node->condition!=RCLIB_DB_QUERY_CONDITION_TYPE_PROP_EQUALS ||
+            node->field_type!=RCLIB_DB_QUERY_PLAN_FIELD_STRING ||
+            node->needle==NULL || node->propid!=plan->nodes[0].propid)
+        {
+            return FALSE;
+        }
+
+        /* Only the last condition can be a tail one, which ends it. */
+        if(i+1<plan->length && !node->head) return FALSE;
+    }
+    if(node->head==plan->value) return FALSE;
+    if(propid!=NULL) *propid = plan->nodes[0].propid;
+    for(i=0;values!=NULL && i<plan->length;i++)
+        g_ptr_array_add(values, plan->nodes[i].needle);
+    return TRUE;
+}
+
+static inline gboolean rclib_db_query_plan_string_match(
+    const RCLibDbQueryPlanNode *node, const gchar *str)
+{
+    gsize len;
+    switch(node->condition)
+    {
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_EQUALS:
+            return g_strcmp0(node->needle, str)==0;
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_NOT_EQUAL:
+            return g_strcmp0(node->needle, str)!=0;
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_GREATER:
+            return g_strcmp0(node->needle, str)>0;
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_GREATER_OR_EQUAL:
+            return g_strcmp0(node->needle, str)>=0;
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_LESS:
+            return g_strcmp0(node->needle, str)<0;
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_LESS_OR_EQUAL:
+            return g_strcmp0(node->needle, str)<=0;
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_LIKE:
+            return strstr(str, node->needle)!=NULL;
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_NOT_LIKE:
+            return strstr(str, node->needle)==NULL;
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_PREFIX:
+            return strncmp(str, node->needle, node->needle_len)==0;
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_SUFFIX:
+        {
+            len = strlen(str);
+            if(len<node->needle_len) return FALSE;
+            return memcmp(str+len-node->needle_len, node->needle,
+                node->needle_len)==0;
+        }
+        default:
+            break;
+    }
+    return FALSE;
+}
+
+static inline gboolean rclib_db_query_plan_int_match(
+    const RCLibDbQueryPlanNode *node, gint64 value)
+{
+    switch(node->condition)
+    {
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_EQUALS:
+            return node->int_value==value;
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_NOT_EQUAL:
+            return node->int_value!=value;
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_GREATER:
+            return node->int_value>value;
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_GREATER_OR_EQUAL:
+            return node->int_value>=value;
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_LESS:
+            return node->int_value<value;
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_LESS_OR_EQUAL:
+            return node->int_value<=value;
+        default:
+            break;
+    }
+    return FALSE;
+}
+
+static inline gboolean rclib_db_query_plan_double_match(
+    const RCLibDbQueryPlanNode *node, gdouble value)
+{
+    gdouble diff = node->double_value - value;
+    switch(node->condition)
+    {
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_EQUALS:
+            return ABS(diff)<=RCLIB_DB_QUERY_PLAN_DOUBLE_EPSILON;
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_NOT_EQUAL:
+            return ABS(diff)>RCLIB_DB_QUERY_PLAN_DOUBLE_EPSILON;
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_GREATER:
+            return diff>RCLIB_DB_QUERY_PLAN_DOUBLE_EPSILON;
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_GREATER_OR_EQUAL:
+            return diff>=0;
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_LESS:
+            return diff<-RCLIB_DB_QUERY_PLAN_DOUBLE_EPSILON;
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_LESS_OR_EQUAL:
+            return diff<=0;
+        default:
+            break;
+    }
+    return FALSE;
+}
+
+static gboolean rclib_db_query_plan_node_eval(
+    const RCLibDbQueryPlanNode *node, gconstpointer view)
+{
+    const gchar *str, *uri;
+    gchar *name = NULL;
+    gboolean result;
+    switch(node->field_type)
+    {
+        case RCLIB_DB_QUERY_PLAN_FIELD_STRING:
+        {
+            str = G_STRUCT_MEMBER(const gchar *, view, node->offset);
+            if(str==NULL) str = "";
+            return rclib_db_query_plan_string_match(node, str);
+        }
+        case RCLIB_DB_QUERY_PLAN_FIELD_TITLE:
+        {
+            str = G_STRUCT_MEMBER(const gchar *, view, node->offset);
+            if(str==NULL || *str=='\0')
+            {
+                uri = ((const RCLibDbLibraryDataView *)view)->uri;
+                if(uri!=NULL)
+                    name = rclib_tag_get_name_from_uri(uri);
+                str = name;
+            }
+            if(str==NULL) str = "";
+            result = rclib_db_query_plan_string_match(node, str);
+            g_free(name);
+            return result;
+        }
+        case RCLIB_DB_QUERY_PLAN_FIELD_INT:
+            return rclib_db_query_plan_int_match(node,
+                G_STRUCT_MEMBER(gint, view, node->offset));
+        case RCLIB_DB_QUERY_PLAN_FIELD_INT64:
+            return rclib_db_query_plan_int_match(node,
+                G_STRUCT_MEMBER(gint64, view, node->offset));
+        case RCLIB_DB_QUERY_PLAN_FIELD_FLOAT:
+            return rclib_db_query_plan_double_match(node,
+                G_STRUCT_MEMBER(gfloat, view, node->offset));
+        case RCLIB_DB_QUERY_PLAN_FIELD_SUBPLAN:
+            return _rclib_db_query_plan_eval(node->subplan, view);
+        default:
+            break;
+    }
+    return FALSE;
+}
+
+/*
+ * Evaluate the plan on a #RCLibDbLibraryDataView or a
+ * #RCLibDbPlaylistDataView, which must be kept valid during the call.
+ */
+
+gboolean _rclib_db_query_plan_eval(const RCLibDbQueryPlan *plan,
+    gconstpointer view)
+{
+    const RCLibDbQueryPlanNode *node;
+    guint i;
+    if(plan==NULL || view==NULL) return FALSE;
+    if(plan->constant) return plan->value;
+    for(i=0;i<plan->length;i++)
+    {
+        node = plan->nodes + i;
+        if(rclib_db_query_plan_node_eval(node, view))
+        {
+            if(node->head) return TRUE;
+        }
+        else if(!node->head)
+            return FALSE;
+    }
+    return plan->value;
+}
+
@@ -0,0 +1,295 @@
+/*
+ * RhythmCat Library Music Database Module (Sort Key Part.)
+ * Sort the library and playlist records by their collation keys.
+ *
+ * rclib-db-sort.c
+ * This file is part of RhythmCat Library (LibRhythmCat)
+ *
+ * Copyright (C) 2012 - SuperCat, license: GPL v3
+ *
+ * RhythmCat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RhythmCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RhythmCat; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include "rclib-db.h"
+#include "rclib-db-priv.h"
+#include "rclib-common.h"
+#include "rclib-tag.h"
+
+/*
+ * Each record keeps the collation keys of its string fields, so the
+ * comparison of two records only compares bytes. A key is made on the
+ * first comparison which needs it after the record is created or
+ * changed, and all keys are dropped when the record is changed. The
+ * title key is made from the name in the URI if the title is empty,
+ * which is the same title the player shows for the record.
+ *
+ * The keys are made with only the reader lock of the record held, so
+ * they are published with an atomic exchange. They are only dropped
+ * with the writer lock held.
+ */
+
+typedef struct _RCLibDbSortEntry
+{
+    GSequenceIter *iter;
+    gpointer data;
+    gint position;
+}RCLibDbSortEntry;
+
+typedef struct _RCLibDbSortContext
+{
+    const RCLibDbQueryDataType *columns;
+    guint n_columns;
+    gboolean playlist_flag;
+    gboolean direction;
+}RCLibDbSortContext;
+
+static inline gint rclib_db_sort_key_index(RCLibDbQueryDataType column)
+{
+    switch(column)
+    {
+        case RCLIB_DB_QUERY_DATA_TYPE_TITLE:
+            return RCLIB_DB_SORT_KEY_TITLE;
+        case RCLIB_DB_QUERY_DATA_TYPE_ARTIST:
+            return RCLIB_DB_SORT_KEY_ARTIST;
+        case RCLIB_DB_QUERY_DATA_TYPE_ALBUM:
+            return RCLIB_DB_SORT_KEY_ALBUM;
+        case RCLIB_DB_QUERY_DATA_TYPE_FTYPE:
+            return RCLIB_DB_SORT_KEY_FTYPE;
+        case RCLIB_DB_QUERY_DATA_TYPE_GENRE:
+            return RCLIB_DB_SORT_KEY_GENRE;
+        default:
+            break;
+    }
+    return -1;
+}
+
+static const gchar *rclib_db_sort_key_get(gchar **sort_keys,
+    const RCLibDbLibraryDataView *view, RCLibDbQueryDataType column)
+{
+    const gchar *str = NULL;
+    gchar *name = NULL;
+    gchar *key;
+    gint index;
+    index = rclib_db_sort_key_index(column);
+    if(sort_keys==NULL || index<0) return "";
+    key = g_atomic_pointer_get(&sort_keys[index]);
+    if(key!=NULL) return key;
+    switch(column)
+    {
+        case RCLIB_DB_QUERY_DATA_TYPE_TITLE:
+        {
+            str = view->title;
+            if((str==NULL || *str=='\0') && view->uri!=NULL)
+            {
+                name = rclib_tag_get_name_from_uri(view->uri);
+                str = name;
+            }
+            break;
+        }
+        case RCLIB_DB_QUERY_DATA_TYPE_ARTIST:
+            str = view->artist;
+            break;
+        case RCLIB_DB_QUERY_DATA_TYPE_ALBUM:
+            str = view->album;
+            break;
+        case RCLIB_DB_QUERY_DATA_TYPE_FTYPE:
+            str = view->ftype;
+            break;
+        case RCLIB_DB_QUERY_DATA_TYPE_GENRE:
+            str = view->genre;
+            break;
+        default:
+            break;
+    }
+    key = g_utf8_collate_key(str!=NULL ? str : "", -1);
+    g_free(name);
+    if(!g_atomic_pointer_compare_and_exchange(&sort_keys[index], NULL,
+        key))
+    {
+        g_free(key);
+        key = g_atomic_pointer_get(&sort_keys[index]);
+    }
+    return key;
+}
+
+static inline gint rclib_db_sort_view_compare(
+    const RCLibDbLibraryDataView *view1, gchar **keys1,
+    const RCLibDbLibraryDataView *view2, gchar **keys2,
+    RCLibDbQueryDataType column)
+{
+    switch(column)
+    {
+        case RCLIB_DB_QUERY_DATA_TYPE_URI:
+            return g_strcmp0(view1->uri, view2->uri);
+        case RCLIB_DB_QUERY_DATA_TYPE_TITLE:
+        case RCLIB_DB_QUERY_DATA_TYPE_ARTIST:
+        case RCLIB_DB_QUERY_DATA_TYPE_ALBUM:
+        case RCLIB_DB_QUERY_DATA_TYPE_FTYPE:
+        case RCLIB_DB_QUERY_DATA_TYPE_GENRE:
+            return strcmp(rclib_db_sort_key_get(keys1, view1, column),
+                rclib_db_sort_key_get(keys2, view2, column));
+        case RCLIB_DB_QUERY_DATA_TYPE_LENGTH:
+            return (view1->length > view2->length) -
+                (view1->length < view2->length);
+        case RCLIB_DB_QUERY_DATA_TYPE_TRACKNUM:
+            return (view1->tracknum > view2->tracknum) -
+                (view1->tracknum < view2->tracknum);
+        case RCLIB_DB_QUERY_DATA_TYPE_YEAR:
+            return (view1->year > view2->year) -
+                (view1->year < view2->year);
+        case RCLIB_DB_QUERY_DATA_TYPE_RATING:
+            return (view1->rating > view2->rating) -
+                (view1->rating < view2->rating);
+        default:
+            break;
+    }
+    return 0;
+}
+
+/* The playlist view has the same layout as the library view, which is
+ * checked in the query plan part. */
+
+static inline gchar **rclib_db_sort_view_begin(gpointer data,
+    gboolean playlist_flag, RCLibDbLibraryDataView *view)
+{
+    if(playlist_flag)
+    {
+        rclib_db_playlist_data_view_begin((RCLibDbPlaylistData *)data,
+            (RCLibDbPlaylistDataView *)view);
+        if(data==NULL) return NULL;
+        return ((RCLibDbPlaylistData *)data)->sort_keys;
+    }
+    rclib_db_library_data_view_begin((RCLibDbLibraryData *)data, view);
+    if(data==NULL) return NULL;
+    return ((RCLibDbLibraryData *)data)->sort_keys;
+}
+
+static inline void rclib_db_sort_view_end(gpointer data,
+    gboolean playlist_flag, RCLibDbLibraryDataView *view)
+{
+    if(playlist_flag)
+    {
+        rclib_db_playlist_data_view_end((RCLibDbPlaylistData *)data,
+            (RCLibDbPlaylistDataView *)view);
+    }
+    else
+        rclib_db_library_data_view_end((RCLibDbLibraryData *)data, view);
+}
+
+/*
+ * Compare two library records (or two playlist records if playlist_flag
+ * is TRUE) by the columns in order, the later columns are only used
+ * when the former ones are equal. The columns are in
+ * #RCLibDbQueryDataType. Returns a negative value if data1 is before
+ * data2 in ascending order.
+ */
+
+gint _rclib_db_sort_data_compare(gpointer data1, gpointer data2,
+    gboolean playlist_flag, const RCLibDbQueryDataType *columns,
+    guint n_columns)
+{
+    RCLibDbLibraryDataView view1, view2;
+    gchar **keys1, **keys2;
+    gint ret = 0;
+    guint i;
+    if(data1==data2 || columns==NULL) return 0;
+    keys1 = rclib_db_sort_view_begin(data1, playlist_flag, &view1);
+    keys2 = rclib_db_sort_view_begin(data2, playlist_flag, &view2);
+    for(i=0;i<n_columns && ret==0;i++)
+    {
+        ret = rclib_db_sort_view_compare(&view1, keys1, &view2, keys2,
+            columns[i]);
+    }
+    rclib_db_sort_view_end(data2, playlist_flag, &view2);
+    rclib_db_sort_view_end(data1, playlist_flag, &view1);
+    return ret;
+}
+
+static gint rclib_db_sort_entry_compare(gconstpointer a, gconstpointer b,
+    gpointer data)
+{
+    const RCLibDbSortEntry *entry1 = a;
+    const RCLibDbSortEntry *entry2 = b;
+    const RCLibDbSortContext *context = data;
+    gint ret;
+    ret = _rclib_db_sort_data_compare(entry1->data, entry2->data,
+        context->playlist_flag, context->columns, context->n_columns);
+    if(context->direction) ret = -ret;
+    if(ret==0) ret = entry1->position - entry2->position;
+    return ret;
+}
+
+/*
+ * Sort the records in the sequence by the columns, the sort is stable.
+ * Returns the new order of the items, which should be freed after
+ * usage, and the number of the items is stored in length.
+ */
+
+gint *_rclib_db_sort_sequence(GSequence *sequence, gboolean playlist_flag,
+    const RCLibDbQueryDataType *columns, guint n_columns,
+    gboolean direction, gint *length)
+{
+    RCLibDbSortContext context;
+    RCLibDbSortEntry *entries;
+    GSequenceIter *iter, *end_iter;
+    gint *order;
+    gint i, n;
+    if(length!=NULL) *length = 0;
+    if(sequence==NULL) return NULL;
+    n = g_sequence_get_length(sequence);
+    entries = g_new(RCLibDbSortEntry, n>0 ? n : 1);
+    for(i=0, iter=g_sequence_get_begin_iter(sequence);
+        i<n && !g_sequence_iter_is_end(iter);
+        i++, iter=g_sequence_iter_next(iter))
+    {
+        entries[i].iter = iter;
+        entries[i].data = g_sequence_get(iter);
+        entries[i].position = i;
+    }
+    n = i;
+    context.columns = columns;
+    context.n_columns = n_columns;
+    context.playlist_flag = playlist_flag;
+    context.direction = direction;
+    g_qsort_with_data(entries, n, sizeof(RCLibDbSortEntry),
+        rclib_db_sort_entry_compare, &context);
+    order = g_new(gint, n>0 ? n : 1);
+    end_iter = g_sequence_get_end_iter(sequence);
+    for(i=0;i<n;i++)
+    {
+        g_sequence_move(entries[i].iter, end_iter);
+        order[i] = entries[i].position;
+    }
+    g_free(entries);
+    if(length!=NULL) *length = n;
+    return order;
+}
+
+/*
+ * Drop the collation keys of a record after it is changed, the writer
+ * lock of the record must be held.
+ */
+
+void _rclib_db_sort_keys_clear(gchar **sort_keys)
+{
+    guint i;
+    if(sort_keys==NULL) return;
+    for(i=0;i<RCLIB_DB_SORT_KEY_NUM;i++)
+    {
+        g_free(sort_keys[i]);
+        sort_keys[i] = NULL;
+    }
+}
@@ -0,0 +1,710 @@
+/*
+ * RhythmCat Library Music Database Module (Library Watch Part.)
+ * Watch the library directories and keep the library up to date.
+ *
+ * rclib-db-watch.c
+ * This file is part of RhythmCat Library (LibRhythmCat)
+ *
+ * Copyright (C) 2012 - SuperCat, license: GPL v3
+ *
+ * RhythmCat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RhythmCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RhythmCat; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include "rclib-db.h"
+#include "rclib-db-priv.h"
+#include "rclib-common.h"
+#include "rclib-util.h"
+
+typedef struct RCLibDbWatchScanData
+{
+    gchar *path;
+    gboolean scan_flag;
+    gboolean refresh_flag;
+    gboolean monitor_flag;
+    guint monitor_limit;
+}RCLibDbWatchScanData;
+
+typedef struct RCLibDbWatchMonitorData
+{
+    GPtrArray *dirs;
+}RCLibDbWatchMonitorData;
+
+static const guint db_watch_depth = 16;
+static const guint db_watch_flush_delay = 1000;
+static const guint db_watch_limit_default = 1024;
+static const guint db_watch_scan_interval_default = 600;
+
+static void rclib_db_watch_scan_data_free(RCLibDbWatchScanData *data)
+{
+    if(data==NULL) return;
+    g_free(data->path);
+    g_free(data);
+}
+
+static void rclib_db_watch_monitor_data_free(RCLibDbWatchMonitorData *data)
+{
+    if(data==NULL) return;
+    g_ptr_array_free(data->dirs, TRUE);
+    g_free(data);
+}
+
+static void rclib_db_watch_monitor_free(GFileMonitor *monitor)
+{
+    if(monitor==NULL) return;
+    g_file_monitor_cancel(monitor);
+    g_object_unref(monitor);
+}
+
+static inline gboolean rclib_db_watch_path_has_prefix(const gchar *path,
+    const gchar *prefix)
+{
+    gsize len;
+    len = strlen(prefix);
+    if(strncmp(path, prefix, len)!=0) return FALSE;
+    return (path[len]=='\0' || path[len]==G_DIR_SEPARATOR);
+}
+
+static gboolean rclib_db_watch_path_is_watched(RCLibDbPrivate *priv,
+    const gchar *path)
+{
+    GHashTableIter iter;
+    const gchar *root;
+    g_hash_table_iter_init(&iter, priv->watch_root_table);
+    while(g_hash_table_iter_next(&iter, (gpointer *)&root, NULL))
+    {
+        if(rclib_db_watch_path_has_prefix(path, root)) return TRUE;
+    }
+    return FALSE;
+}
+
+/*
+ * Queue a job for the watch thread: scan the directory for the new
+ * music files (and refresh the existing ones), and/or list the
+ * directories to watch, the monitors are created in main thread later.
+ */
+
+static void rclib_db_watch_scan_push(RCLibDbPrivate *priv, const gchar *path,
+    gboolean scan_flag, gboolean refresh_flag, gboolean monitor_flag)
+{
+    RCLibDbWatchScanData *scan_data;
+    if(priv->watch_queue==NULL || path==NULL) return;
+    scan_data = g_new0(RCLibDbWatchScanData, 1);
+    scan_data->path = g_strdup(path);
+    scan_data->scan_flag = scan_flag;
+    scan_data->refresh_flag = refresh_flag;
+    scan_data->monitor_flag = monitor_flag;
+    scan_data->monitor_limit = priv->watch_limit;
+    g_async_queue_push(priv->watch_queue, scan_data);
+}
+
+static gboolean rclib_db_watch_scan_timeout_cb(gpointer data)
+{
+    RCLibDbPrivate *priv = (RCLibDbPrivate *)data;
+    GHashTableIter iter;
+    const gchar *path;
+    if(priv==NULL) return FALSE;
+    if(g_async_queue_length(priv->watch_queue)>0) return TRUE;
+    g_hash_table_iter_init(&iter, priv->watch_root_table);
+    while(g_hash_table_iter_next(&iter, (gpointer *)&path, NULL))
+        rclib_db_watch_scan_push(priv, path, TRUE, TRUE, FALSE);
+    return TRUE;
+}
+
+static void rclib_db_watch_fallback_update(RCLibDbPrivate *priv)
+{
+    if(priv->watch_overflow_flag &&
+        g_hash_table_size(priv->watch_root_table)>0)
+    {
+        if(priv->watch_scan_timeout>0) return;
+        g_message("Too many directories to watch, scan the library "
+            "every %u seconds instead.", priv->watch_scan_interval);
+        priv->watch_scan_timeout = g_timeout_add_seconds(
+            priv->watch_scan_interval, rclib_db_watch_scan_timeout_cb, priv);
+    }
+    else if(priv->watch_scan_timeout>0)
+    {
+        g_source_remove(priv->watch_scan_timeout);
+        priv->watch_scan_timeout = 0;
+    }
+}
+
+static void rclib_db_watch_monitor_remove(RCLibDbPrivate *priv,
+    const gchar *path)
+{
+    GHashTableIter iter;
+    const gchar *monitor_path;
+    g_hash_table_iter_init(&iter, priv->watch_monitor_table);
+    while(g_hash_table_iter_next(&iter, (gpointer *)&monitor_path, NULL))
+    {
+        if(rclib_db_watch_path_has_prefix(monitor_path, path))
+            g_hash_table_iter_remove(&iter);
+    }
+}
+
+static gboolean rclib_db_watch_flush_timeout_cb(gpointer data)
+{
+    RCLibDbPrivate *priv = (RCLibDbPrivate *)data;
+    GHashTable *file_table;
+    GHashTableIter iter;
+    GSList *dir_list = NULL;
+    const gchar *path;
+    gchar *uri;
+    gpointer matched;
+    gchar *filename;
+    if(priv==NULL) return FALSE;
+    priv->watch_flush_timeout = 0;
+
+    /* GHashTable<gchar *, gboolean>, whether the file is in library. */
+    file_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+        NULL);
+    g_hash_table_iter_init(&iter, priv->watch_pending_table);
+    while(g_hash_table_iter_next(&iter, (gpointer *)&path, NULL))
+    {
+        if(g_file_test(path, G_FILE_TEST_IS_DIR))
+        {
+            /* A new directory, maybe moved here with its contents. */
+            if(!g_hash_table_contains(priv->watch_monitor_table, path))
+                rclib_db_watch_scan_push(priv, path, TRUE, FALSE, TRUE);
+            continue;
+        }
+        uri = g_filename_to_uri(path, NULL, NULL);
+        if(uri==NULL) continue;
+        if(g_file_test(path, G_FILE_TEST_IS_REGULAR))
+        {
+            if(rclib_util_is_supported_media(path))
+                g_hash_table_replace(file_table, uri, NULL);
+            else
+                g_free(uri);
+            continue;
+        }
+
+        /* The file (or directory) was deleted or moved away. */
+        rclib_db_watch_monitor_remove(priv, path);
+        g_hash_table_replace(file_table, g_strdup(uri), NULL);
+        dir_list = g_slist_prepend(dir_list, uri);
+    }
+    g_hash_table_remove_all(priv->watch_pending_table);
+    _rclib_db_library_refresh_matched(priv, file_table, dir_list);
+    g_slist_free_full(dir_list, g_free);
+    g_hash_table_iter_init(&iter, file_table);
+    while(g_hash_table_iter_next(&iter, (gpointer *)&uri, &matched))
+    {
+        if(GPOINTER_TO_INT(matched)) continue;
+        filename = g_filename_from_uri(uri, NULL, NULL);
+        if(filename!=NULL && g_file_test(filename, G_FILE_TEST_IS_REGULAR))
+            rclib_db_library_add_music(uri);
+        g_free(filename);
+    }
+    g_hash_table_destroy(file_table);
+    rclib_db_watch_fallback_update(priv);
+    return FALSE;
+}
+
+static void rclib_db_watch_monitor_changed_cb(GFileMonitor *monitor,
+    GFile *file, GFile *other_file, GFileMonitorEvent event_type,
+    gpointer data)
+{
+    RCLibDbPrivate *priv = (RCLibDbPrivate *)data;
+    gchar *path;
+    if(priv==NULL || file==NULL) return;
+    switch(event_type)
+    {
+        case G_FILE_MONITOR_EVENT_CREATED:
+        case G_FILE_MONITOR_EVENT_DELETED:
+        case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+            break;
+        default:
+            return;
+    }
+    path = g_file_get_path(file);
+    if(path==NULL) return;
+    g_hash_table_replace(priv->watch_pending_table, path, NULL);
+    if(priv->watch_flush_timeout==0)
+    {
+        priv->watch_flush_timeout = g_timeout_add(db_watch_flush_delay,
+            rclib_db_watch_flush_timeout_cb, priv);
+    }
+}
+
+static void rclib_db_watch_monitor_add(RCLibDbPrivate *priv,
+    const gchar *path)
+{
+    GFileMonitor *monitor;
+    GFile *file;
+    GError *error = NULL;
+    if(priv->watch_overflow_flag) return;
+    if(g_hash_table_contains(priv->watch_monitor_table, path)) return;
+    if(g_hash_table_size(priv->watch_monitor_table)>=priv->watch_limit)
+    {
+        priv->watch_overflow_flag = TRUE;
+        return;
+    }
+    file = g_file_new_for_path(path);
+    monitor = g_file_monitor_directory(file, G_FILE_MONITOR_NONE, NULL,
+        &error);
+    g_object_unref(file);
+    if(monitor==NULL)
+    {
+        /* Most likely the inotify watch limit of the system is hit. */
+        if(error!=NULL)
+        {
+            g_warning("Cannot watch directory %s: %s", path,
+                error->message);
+            g_error_free(error);
+        }
+        priv->watch_overflow_flag = TRUE;
+        return;
+    }
+    g_signal_connect(monitor, "changed",
+        G_CALLBACK(rclib_db_watch_monitor_changed_cb), priv);
+    g_hash_table_replace(priv->watch_monitor_table, g_strdup(path), monitor);
+}
+
+static gboolean rclib_db_watch_monitor_idle_cb(gpointer data)
+{
+    RCLibDbWatchMonitorData *monitor_data = (RCLibDbWatchMonitorData *)data;
+    RCLibDbPrivate *priv = NULL;
+    GObject *instance;
+    const gchar *path;
+    guint i;
+    if(data==NULL) return FALSE;
+    instance = rclib_db_get_instance();
+    if(instance!=NULL) priv = RCLIB_DB(instance)->priv;
+    if(priv==NULL || priv->watch_monitor_table==NULL)
+    {
+        rclib_db_watch_monitor_data_free(monitor_data);
+        return FALSE;
+    }
+    for(i=0;i<monitor_data->dirs->len;i++)
+    {
+        path = g_ptr_array_index(monitor_data->dirs, i);
+
+        /* The root directory may be removed while the list is made. */
+        if(!rclib_db_watch_path_is_watched(priv, path)) continue;
+        rclib_db_watch_monitor_add(priv, path);
+        if(priv->watch_overflow_flag) break;
+    }
+    rclib_db_watch_monitor_data_free(monitor_data);
+    rclib_db_watch_fallback_update(priv);
+    return FALSE;
+}
+
+static void rclib_db_watch_rebuild(RCLibDbPrivate *priv)
+{
+    GHashTableIter iter;
+    const gchar *path;
+    g_hash_table_remove_all(priv->watch_monitor_table);
+    priv->watch_overflow_flag = FALSE;
+    g_hash_table_iter_init(&iter, priv->watch_root_table);
+    while(g_hash_table_iter_next(&iter, (gpointer *)&path, NULL))
+        rclib_db_watch_scan_push(priv, path, FALSE, FALSE, TRUE);
+    rclib_db_watch_fallback_update(priv);
+}
+
+static void rclib_db_watch_list_directory(RCLibDbPrivate *priv,
+    GPtrArray *dirs, const gchar *path, guint depth, guint limit)
+{
+    GDir *dir;
+    const gchar *filename;
+    gchar *full_path;
+    if(depth==0 || !priv->work_flag || dirs->len>limit) return;
+    g_ptr_array_add(dirs, g_strdup(path));
+    dir = g_dir_open(path, 0, NULL);
+    if(dir==NULL) return;
+    while((filename = g_dir_read_name(dir))!=NULL && dirs->len<=limit)
+    {
+        full_path = g_build_filename(path, filename, NULL);
+        if(g_file_test(full_path, G_FILE_TEST_IS_DIR) &&
+            !g_file_test(full_path, G_FILE_TEST_IS_SYMLINK))
+            rclib_db_watch_list_directory(priv, dirs, full_path, depth-1,
+                limit);
+        g_free(full_path);
+    }
+    g_dir_close(dir);
+}
+
+static void rclib_db_watch_scan_directory(RCLibDbPrivate *priv,
+    GHashTable *file_table, const gchar *path, guint depth)
+{
+    GDir *dir;
+    const gchar *filename;
+    gchar *full_path;
+    gchar *uri;
+    if(depth==0 || !priv->work_flag) return;
+    dir = g_dir_open(path, 0, NULL);
+    if(dir==NULL) return;
+    while((filename = g_dir_read_name(dir))!=NULL && priv->work_flag)
+    {
+        full_path = g_build_filename(path, filename, NULL);
+        if(g_file_test(full_path, G_FILE_TEST_IS_DIR))
+        {
+            if(!g_file_test(full_path, G_FILE_TEST_IS_SYMLINK))
+                rclib_db_watch_scan_directory(priv, file_table, full_path,
+                    depth-1);
+        }
+        else if(g_file_test(full_path, G_FILE_TEST_IS_REGULAR) &&
+            rclib_util_is_supported_media(full_path))
+        {
+            uri = g_filename_to_uri(full_path, NULL, NULL);
+            if(uri!=NULL && !g_hash_table_contains(file_table, uri))
+                rclib_db_library_add_music(uri);
+            g_free(uri);
+        }
+        g_free(full_path);
+    }
+    g_dir_close(dir);
+}
+
+static gpointer rclib_db_watch_thread_cb(gpointer data)
+{
+    RCLibDbWatchScanData *scan_data;
+    RCLibDbWatchMonitorData *monitor_data;
+    RCLibDbPrivate *priv;
+    GHashTable *file_table;
+    GSList *dir_list;
+    gchar *uri;
+    GObject *object = G_OBJECT(data);
+    if(object==NULL)
+    {
+        g_thread_exit(NULL);
+        return NULL;
+    }
+    priv = RCLIB_DB(object)->priv;
+    while(priv->watch_queue!=NULL)
+    {
+        scan_data = g_async_queue_pop(priv->watch_queue);
+        if(scan_data->path==NULL)
+        {
+            rclib_db_watch_scan_data_free(scan_data);
+            break;
+        }
+        if(!priv->work_flag)
+        {
+            rclib_db_watch_scan_data_free(scan_data);
+            continue;
+        }
+        if(scan_data->monitor_flag)
+        {
+            /* List one more directory than the limit to detect overflow. */
+            monitor_data = g_new0(RCLibDbWatchMonitorData, 1);
+            monitor_data->dirs = g_ptr_array_new_with_free_func(g_free);
+            rclib_db_watch_list_directory(priv, monitor_data->dirs,
+                scan_data->path, db_watch_depth, scan_data->monitor_limit);
+            g_idle_add(rclib_db_watch_monitor_idle_cb, monitor_data);
+        }
+        if(scan_data->scan_flag)
+        {
+            file_table = _rclib_db_library_get_file_table(priv);
+            rclib_db_watch_scan_directory(priv, file_table,
+                scan_data->path, db_watch_depth);
+            g_hash_table_destroy(file_table);
+        }
+        uri = g_filename_to_uri(scan_data->path, NULL, NULL);
+        if(scan_data->refresh_flag && uri!=NULL && priv->work_flag)
+        {
+            /* Catch the changes which are not reported by the monitors. */
+            dir_list = g_slist_prepend(NULL, uri);
+            _rclib_db_library_refresh_matched(priv, NULL, dir_list);
+            g_slist_free(dir_list);
+        }
+        g_free(uri);
+        rclib_db_watch_scan_data_free(scan_data);
+    }
+    g_thread_exit(NULL);
+    return NULL;
+}
+
+gboolean _rclib_db_instance_init_watch(RCLibDb *db, RCLibDbPrivate *priv)
+{
+    if(db==NULL || priv==NULL) return FALSE;
+
+    /* GHashTable<gchar *, gpointer>, the watched root directories. */
+    priv->watch_root_table = g_hash_table_new_full(g_str_hash, g_str_equal,
+        g_free, NULL);
+
+    /* GHashTable<gchar *, GFileMonitor *> */
+    priv->watch_monitor_table = g_hash_table_new_full(g_str_hash,
+        g_str_equal, g_free, (GDestroyNotify)rclib_db_watch_monitor_free);
+
+    /* GHashTable<gchar *, gpointer>, the paths changed since last flush. */
+    priv->watch_pending_table = g_hash_table_new_full(g_str_hash,
+        g_str_equal, g_free, NULL);
+
+    priv->watch_limit = db_watch_limit_default;
+    priv->watch_scan_interval = db_watch_scan_interval_default;
+    priv->watch_queue = g_async_queue_new_full((GDestroyNotify)
+        rclib_db_watch_scan_data_free);
+    priv->watch_thread = g_thread_new("RC2-Watch-Thread",
+        rclib_db_watch_thread_cb, db);
+    return TRUE;
+}
+
+void _rclib_db_instance_finalize_watch(RCLibDbPrivate *priv)
+{
+    RCLibDbWatchScanData *scan_data;
+    if(priv==NULL) return;
+    if(priv->watch_flush_timeout>0)
+        g_source_remove(priv->watch_flush_timeout);
+    if(priv->watch_scan_timeout>0)
+        g_source_remove(priv->watch_scan_timeout);
+    priv->watch_flush_timeout = 0;
+    priv->watch_scan_timeout = 0;
+    if(priv->watch_monitor_table!=NULL)
+        g_hash_table_destroy(priv->watch_monitor_table);
+    priv->watch_monitor_table = NULL;
+    if(priv->watch_thread!=NULL)
+    {
+        scan_data = g_new0(RCLibDbWatchScanData, 1);
+        g_async_queue_push(priv->watch_queue, scan_data);
+        g_thread_join(priv->watch_thread);
+        priv->watch_thread = NULL;
+    }
+    if(priv->watch_queue!=NULL)
+        g_async_queue_unref(priv->watch_queue);
+    priv->watch_queue = NULL;
+    if(priv->watch_pending_table!=NULL)
+        g_hash_table_destroy(priv->watch_pending_table);
+    if(priv->watch_root_table!=NULL)
+        g_hash_table_destroy(priv->watch_root_table);
+    priv->watch_pending_table = NULL;
+    priv->watch_root_table = NULL;
+}
+
+/**
+ * rclib_db_library_watch_add_directory:
+ * @dir: the directory path
+ *
+ * Watch the directory (and its sub-directories) for changes, the new
+ * music files in it are added to the music library, and the changed or
+ * removed ones are refreshed, without calling rclib_db_library_refresh().
+ * The existing music files in the directory which are not in the library
+ * yet are also added. If there are too many directories to watch, the
+ * directories are scanned periodically instead.
+ * Must be called in main thread.
+ *
+ * Returns: Whether the directory is watched.
+ */
+
+gboolean rclib_db_library_watch_add_directory(const gchar *dir)
+{
+    RCLibDbPrivate *priv;
+    GObject *instance;
+    GHashTableIter iter;
+    GFile *file;
+    const gchar *root;
+    gchar *path;
+    instance = rclib_db_get_instance();
+    if(instance==NULL || dir==NULL) return FALSE;
+    priv = RCLIB_DB(instance)->priv;
+    if(priv==NULL || priv->watch_root_table==NULL) return FALSE;
+    if(!g_file_test(dir, G_FILE_TEST_IS_DIR)) return FALSE;
+    file = g_file_new_for_path(dir);
+    path = g_file_get_path(file);
+    g_object_unref(file);
+    if(path==NULL) return FALSE;
+    g_hash_table_iter_init(&iter, priv->watch_root_table);
+    while(g_hash_table_iter_next(&iter, (gpointer *)&root, NULL))
+    {
+        if(rclib_db_watch_path_has_prefix(path, root))
+        {
+            g_free(path);
+            return TRUE;
+        }
+        if(rclib_db_watch_path_has_prefix(root, path))
+            g_hash_table_iter_remove(&iter);
+    }
+    g_hash_table_replace(priv->watch_root_table, path, NULL);
+    rclib_db_watch_scan_push(priv, path, TRUE, TRUE, TRUE);
+    return TRUE;
+}
+
+/**
+ * rclib_db_library_watch_remove_directory:
+ * @dir: the directory path
+ *
+ * Stop watching the directory added by
+ * rclib_db_library_watch_add_directory(). The music in the library
+ * is not removed. Must be called in main thread.
+ */
+
+void rclib_db_library_watch_remove_directory(const gchar *dir)
+{
+    RCLibDbPrivate *priv;
+    GObject *instance;
+    GFile *file;
+    gchar *path;
+    instance = rclib_db_get_instance();
+    if(instance==NULL || dir==NULL) return;
+    priv = RCLIB_DB(instance)->priv;
+    if(priv==NULL || priv->watch_root_table==NULL) return;
+    file = g_file_new_for_path(dir);
+    path = g_file_get_path(file);
+    g_object_unref(file);
+    if(path==NULL) return;
+    if(g_hash_table_remove(priv->watch_root_table, path))
+    {
+        rclib_db_watch_monitor_remove(priv, path);
+        if(priv->watch_overflow_flag)
+            rclib_db_watch_rebuild(priv);
+        else
+            rclib_db_watch_fallback_update(priv);
+    }
+    g_free(path);
+}
+
+/**
+ * rclib_db_library_watch_get_directories:
+ *
+ * Get the directories watched by the music library.
+ *
+ * Returns: (transfer full): The directory path array, free it with
+ *     g_strfreev() after usage.
+ */
+
+gchar **rclib_db_library_watch_get_directories()
+{
+    RCLibDbPrivate *priv;
+    GObject *instance;
+    GHashTableIter iter;
+    const gchar *path;
+    gchar **dirs;
+    guint i = 0;
+    instance = rclib_db_get_instance();
+    if(instance==NULL) return NULL;
+    priv = RCLIB_DB(instance)->priv;
+    if(priv==NULL || priv->watch_root_table==NULL) return NULL;
+    dirs = g_new0(gchar *, g_hash_table_size(priv->watch_root_table)+1);
+    g_hash_table_iter_init(&iter, priv->watch_root_table);
+    while(g_hash_table_iter_next(&iter, (gpointer *)&path, NULL))
+    {
+        dirs[i] = g_strdup(path);
+        i++;
+    }
+    return dirs;
+}
+
+/**
+ * rclib_db_library_watch_set_limit:
+ * @limit: the maximum number of the watched directories, 0 to use
+ *     the default value
+ *
+ * Set the maximum number of the directories which can be watched at
+ * the same time, each watched directory uses a watch descriptor of
+ * the system. If the limit is hit, all watched directories are
+ * scanned periodically instead. Must be called in main thread.
+ */
+
+void rclib_db_library_watch_set_limit(guint limit)
+{
+    RCLibDbPrivate *priv;
+    GObject *instance;
+    instance = rclib_db_get_instance();
+    if(instance==NULL) return;
+    priv = RCLIB_DB(instance)->priv;
+    if(priv==NULL || priv->watch_monitor_table==NULL) return;
+    if(limit==0) limit = db_watch_limit_default;
+    if(limit==priv->watch_limit) return;
+    priv->watch_limit = limit;
+    if(priv->watch_overflow_flag ||
+        g_hash_table_size(priv->watch_monitor_table)>limit)
+        rclib_db_watch_rebuild(priv);
+}
+
+/**
+ * rclib_db_library_watch_get_limit:
+ *
+ * Get the maximum number of the directories which can be watched at
+ * the same time.
+ *
+ * Returns: The maximum number of the watched directories.
+ */
+
+guint rclib_db_library_watch_get_limit()
+{
+    RCLibDbPrivate *priv;
+    GObject *instance;
+    instance = rclib_db_get_instance();
+    if(instance==NULL) return 0;
+    priv = RCLIB_DB(instance)->priv;
+    if(priv==NULL) return 0;
+    return priv->watch_limit;
+}
+
+/**
+ * rclib_db_library_watch_set_scan_interval:
+ * @interval: the interval in seconds, 0 to use the default value
+ *
+ * Set the interval of the periodic scan, which is used when there are
+ * too many directories to watch. Must be called in main thread.
+ */
+
+void rclib_db_library_watch_set_scan_interval(guint interval)
+{
+    RCLibDbPrivate *priv;
+    GObject *instance;
+    instance = rclib_db_get_instance();
+    if(instance==NULL) return;
+    priv = RCLIB_DB(instance)->priv;
+    if(priv==NULL) return;
+    if(interval==0) interval = db_watch_scan_interval_default;
+    if(interval==priv->watch_scan_interval) return;
+    priv->watch_scan_interval = interval;
+    if(priv->watch_scan_timeout>0)
+    {
+        g_source_remove(priv->watch_scan_timeout);
+        priv->watch_scan_timeout = 0;
+        rclib_db_watch_fallback_update(priv);
+    }
+}
+
+/**
+ * rclib_db_library_watch_get_scan_interval:
+ *
+ * Get the interval of the periodic scan.
+ *
+ * Returns: The interval in seconds.
+ */
+
+guint rclib_db_library_watch_get_scan_interval()
+{
+    RCLibDbPrivate *priv;
+    GObject *instance;
+    instance = rclib_db_get_instance();
+    if(instance==NULL) return 0;
+    priv = RCLIB_DB(instance)->priv;
+    if(priv==NULL) return 0;
+    return priv->watch_scan_interval;
+}
+
+/**
+ * rclib_db_library_watch_is_polling:
+ *
+ * Check whether the watched directories are scanned periodically,
+ * because the watch limit is hit.
+ *
+ * Returns: Whether the periodic scan is used.
+ */
+
+gboolean rclib_db_library_watch_is_polling()
+{
+    RCLibDbPrivate *priv;
+    GObject *instance;
+    instance = rclib_db_get_instance();
+    if(instance==NULL) return FALSE;
+    priv = RCLIB_DB(instance)->priv;
+    if(priv==NULL) return FALSE;
+    return priv->watch_scan_timeout>0;
+}
@@ -23,6 +23,7 @@
  * Boston, MA  02110-1301  USA
  */
 
+#include <glib/gstdio.h>
 #include <gobject/gvaluecollector.h>
 #include "rclib-db.h"
 #include "rclib-db-priv.h"
@@ -66,6 +67,25 @@ typedef struct RCLibDbXMLParserData
     gulong library_count;
 }RCLibDbXMLParserData;
 
+typedef struct RCLibDbImportIdleItem
+{
+    GSourceFunc func;
+    gpointer data;
+}RCLibDbImportIdleItem;
+
+typedef struct RCLibDbImportBatch
+{
+    guint seq;
+    GSList *idle_list;
+}RCLibDbImportBatch;
+
+typedef struct RCLibDbRefreshSummary
+{
+    guint unchanged;
+    guint changed;
+    guint missing;
+}RCLibDbRefreshSummary;
+
 enum
 {
     SIGNAL_CATALOG_ADDED,
@@ -81,6 +101,7 @@ enum
     SIGNAL_LIBRARY_ADDED,
     SIGNAL_LIBRARY_CHANGED,
     SIGNAL_LIBRARY_DELETED,
+    SIGNAL_REFRESH_SUMMARY,
     SIGNAL_LAST
 };
 
@@ -88,6 +109,7 @@ static GObject *db_instance = NULL;
 static gpointer rclib_db_parent_class = NULL;
 static gint db_signals[SIGNAL_LAST] = {0};
 static const gint db_autosave_timeout = 120;
+static const gint64 db_journal_compact_size = 8 * 1024 * 1024;
 
 static gboolean rclib_db_import_update_idle_cb(gpointer data)
 {
@@ -119,6 +141,19 @@ static gboolean rclib_db_refresh_update_idle_cb(gpointer data)
     return FALSE;
 }
 
+static gboolean rclib_db_refresh_summary_idle_cb(gpointer data)
+{
+    RCLibDbRefreshSummary *summary = (RCLibDbRefreshSummary *)data;
+    if(data==NULL) return FALSE;
+    if(db_instance!=NULL)
+    {
+        g_signal_emit(db_instance, db_signals[SIGNAL_REFRESH_SUMMARY], 0,
+            summary->unchanged, summary->changed, summary->missing);
+    }
+    g_free(summary);
+    return FALSE;
+}
+
 static void rclib_db_import_data_free(RCLibDbImportData *data)
 {
     if(data==NULL) return;
@@ -133,6 +168,148 @@ static void rclib_db_refresh_data_free(RCLibDbRefreshData *data)
     g_free(data);
 }
 
+static void rclib_db_import_batch_add(RCLibDbImportBatch *batch,
+    GSourceFunc func, gpointer data)
+{
+    RCLibDbImportIdleItem *item;
+    item = g_new0(RCLibDbImportIdleItem, 1);
+    item->func = func;
+    item->data = data;
+    batch->idle_list = g_slist_prepend(batch->idle_list, item);
+}
+
+/*
+ * Import workers finish their jobs in any order, the results are held
+ * here until all jobs submitted before them are done, so that the music
+ * is added to the playlist (or library) in the order it is submitted.
+ */
+
+static void rclib_db_import_batch_commit(RCLibDbPrivate *priv,
+    RCLibDbImportBatch *batch)
+{
+    GSList *foreach;
+    RCLibDbImportIdleItem *item;
+    gint length;
+    g_mutex_lock(&(priv->import_order_mutex));
+    batch->idle_list = g_slist_reverse(batch->idle_list);
+    g_hash_table_insert(priv->import_order_table,
+        GUINT_TO_POINTER(batch->seq), batch);
+    g_atomic_int_add(&(priv->import_busy_count), -1);
+    while((batch=g_hash_table_lookup(priv->import_order_table,
+        GUINT_TO_POINTER(priv->import_deliver_seq)))!=NULL)
+    {
+        g_hash_table_steal(priv->import_order_table,
+            GUINT_TO_POINTER(priv->import_deliver_seq));
+        for(foreach=batch->idle_list;foreach!=NULL;
+            foreach=g_slist_next(foreach))
+        {
+            item = foreach->data;
+            g_idle_add(item->func, item->data);
+            g_free(item);
+        }
+        g_slist_free(batch->idle_list);
+        g_free(batch);
+        priv->import_deliver_seq++;
+    }
+    length = g_async_queue_length(priv->import_queue);
+    if(length<0) length = 0;
+    length += g_atomic_int_get(&(priv->import_busy_count));
+    length += g_hash_table_size(priv->import_order_table);
+    g_idle_add(rclib_db_import_update_idle_cb, GINT_TO_POINTER(length));
+    g_mutex_unlock(&(priv->import_order_mutex));
+}
+
+static guint rclib_db_import_worker_get_limit(RCLibDbPrivate *priv)
+{
+    guint limit = priv->import_worker_limit;
+    if(limit==0 || limit>priv->import_thread_num)
+        limit = priv->import_thread_num;
+    return limit;
+}
+
+/*
+ * Get the fingerprint (modification time, size and inode) of the local
+ * file pointed to by the URI. If the URI is a CUE track (with the track
+ * number at the end), the fingerprint of the CUE (or audio) file is used.
+ */
+
+static gboolean rclib_db_get_file_fingerprint(const gchar *uri,
+    RCLibDbFileFingerprint *fingerprint)
+{
+    GStatBuf buf;
+    gchar *filename;
+    gchar *file_uri = NULL;
+    gint ret;
+    memset(fingerprint, 0, sizeof(RCLibDbFileFingerprint));
+    if(uri==NULL) return FALSE;
+    filename = g_filename_from_uri(uri, NULL, NULL);
+    if(filename==NULL) return FALSE;
+    ret = g_stat(filename, &buf);
+    g_free(filename);
+    if(ret!=0)
+    {
+        if(!rclib_cue_get_track_num(uri, &file_uri, NULL)) return FALSE;
+        filename = g_filename_from_uri(file_uri, NULL, NULL);
+        g_free(file_uri);
+        if(filename==NULL) return FALSE;
+        ret = g_stat(filename, &buf);
+        g_free(filename);
+        if(ret!=0) return FALSE;
+    }
+    fingerprint->mtime = buf.st_mtime;
+    fingerprint->filesize = buf.st_size;
+    fingerprint->inode = buf.st_ino;
+    return TRUE;
+}
+
+static void rclib_db_refresh_idle_add(RCLibDbPrivate *priv,
+    const RCLibDbRefreshData *refresh_data, RCLibTagMetadata *mmd,
+    gboolean cue_flag)
+{
+    RCLibDbPlaylistRefreshIdleData *idle_data;
+    RCLibDbLibraryRefreshIdleData *library_idle_data;
+    if(mmd!=NULL)
+        priv->refresh_changed_count++;
+    else
+        priv->refresh_missing_count++;
+    if(refresh_data->type==RCLIB_DB_REFRESH_TYPE_PLAYLIST)
+    {
+        idle_data = g_new0(RCLibDbPlaylistRefreshIdleData, 1);
+        idle_data->catalog_iter = refresh_data->catalog_iter;
+        idle_data->playlist_iter = refresh_data->playlist_iter;
+        idle_data->mmd = mmd;
+        if(mmd==NULL)
+            idle_data->type = RCLIB_DB_PLAYLIST_TYPE_MISSING;
+        else if(cue_flag)
+            idle_data->type = RCLIB_DB_PLAYLIST_TYPE_CUE;
+        else
+            idle_data->type = RCLIB_DB_PLAYLIST_TYPE_MUSIC;
+        if(mmd!=NULL)
+            idle_data->fingerprint = refresh_data->fingerprint;
+        g_idle_add(_rclib_db_playlist_refresh_idle_cb, idle_data);
+    }
+    else if(refresh_data->type==RCLIB_DB_REFRESH_TYPE_LIBRARY)
+    {
+        library_idle_data = g_new0(RCLibDbLibraryRefreshIdleData, 1);
+        library_idle_data->uri = g_strdup(refresh_data->uri);
+        library_idle_data->mmd = mmd;
+        if(mmd==NULL)
+            library_idle_data->type = RCLIB_DB_LIBRARY_TYPE_MISSING;
+        else if(cue_flag)
+            library_idle_data->type = RCLIB_DB_LIBRARY_TYPE_CUE;
+        else
+            library_idle_data->type = RCLIB_DB_LIBRARY_TYPE_MUSIC;
+        if(mmd!=NULL)
+            library_idle_data->fingerprint = refresh_data->fingerprint;
+        g_idle_add(_rclib_db_library_refresh_idle_cb, library_idle_data);
+    }
+    else
+    {
+        g_warning("Unknown refresh type!");
+        if(mmd!=NULL) rclib_tag_free(mmd);
+    }
+}
+
 
 static RCLibTagMetadata *rclib_db_get_metadata_from_cue(
     RCLibCueData *cue_data, guint track_num, RCLibTagMetadata *cue_mmd)
@@ -193,13 +370,15 @@ static gpointer rclib_db_playlist_import_thread_cb(gpointer data)
     RCLibDbLibraryImportIdleData *library_idle_data;
     RCLibTagMetadata *mmd = NULL, *cue_mmd = NULL;
     RCLibDbImportData *import_data;
+    RCLibDbImportBatch *batch = NULL;
+    RCLibDbFileFingerprint fingerprint;
     RCLibDbPrivate *priv;
     RCLibCueData cue_data;
     gchar *cue_uri;
     gchar *scheme;
     guint i;
+    guint index;
     gint track = 0;
-    gint length;
     gboolean local_flag;
     GObject *object = G_OBJECT(data);
     if(object==NULL)
@@ -208,9 +387,27 @@ static gpointer rclib_db_playlist_import_thread_cb(gpointer data)
         return NULL;
     }
     priv = RCLIB_DB(object)->priv;
+    index = g_atomic_int_add(&(priv->import_thread_started), 1);
     while(priv->import_queue!=NULL)
     {
-        import_data = g_async_queue_pop(priv->import_queue);
+        g_mutex_lock(&(priv->import_worker_mutex));
+        while(priv->work_flag &&
+            index>=rclib_db_import_worker_get_limit(priv))
+        {
+            g_cond_wait(&(priv->import_worker_cond),
+                &(priv->import_worker_mutex));
+        }
+        g_mutex_unlock(&(priv->import_worker_mutex));
+        if(!priv->work_flag) break;
+        g_async_queue_lock(priv->import_queue);
+        import_data = g_async_queue_pop_unlocked(priv->import_queue);
+        if(import_data->uri!=NULL)
+        {
+            batch = g_new0(RCLibDbImportBatch, 1);
+            batch->seq = priv->import_pop_seq++;
+            g_atomic_int_inc(&(priv->import_busy_count));
+        }
+        g_async_queue_unlock(priv->import_queue);
         if(import_data->uri==NULL)
         {
             g_free(import_data);
@@ -220,6 +417,10 @@ static gpointer rclib_db_playlist_import_thread_cb(gpointer data)
         if(g_strcmp0(scheme, "file")==0) local_flag = TRUE;
         else local_flag = FALSE;
         g_free(scheme);
+        if(local_flag)
+            rclib_db_get_file_fingerprint(import_data->uri, &fingerprint);
+        else
+            memset(&fingerprint, 0, sizeof(RCLibDbFileFingerprint));
         G_STMT_START
         {
             /* Import CUE */
@@ -251,8 +452,9 @@ static gpointer rclib_db_playlist_import_thread_cb(gpointer data)
                             if(i==0)
                                 idle_data->play_flag = import_data->play_flag;
                             idle_data->type = RCLIB_DB_PLAYLIST_TYPE_CUE;
-                            g_idle_add(_rclib_db_playlist_import_idle_cb,
-                                idle_data);
+                            idle_data->fingerprint = fingerprint;
+                            rclib_db_import_batch_add(batch,
+                                _rclib_db_playlist_import_idle_cb, idle_data);
                         }
                         else if(import_data->type==
                             RCLIB_DB_IMPORT_TYPE_LIBRARY)
@@ -267,7 +469,9 @@ static gpointer rclib_db_playlist_import_thread_cb(gpointer data)
                             }
                             library_idle_data->type =
                                 RCLIB_DB_LIBRARY_TYPE_CUE;
-                            g_idle_add(_rclib_db_library_import_idle_cb,
+                            library_idle_data->fingerprint = fingerprint;
+                            rclib_db_import_batch_add(batch,
+                                _rclib_db_library_import_idle_cb,
                                 library_idle_data);
                         }
                         else
@@ -309,7 +513,9 @@ static gpointer rclib_db_playlist_import_thread_cb(gpointer data)
                                 idle_data->mmd = mmd;
                                  idle_data->play_flag = import_data->play_flag;
                                 idle_data->type = RCLIB_DB_PLAYLIST_TYPE_CUE;
-                                g_idle_add(_rclib_db_playlist_import_idle_cb,
+                                idle_data->fingerprint = fingerprint;
+                                rclib_db_import_batch_add(batch,
+                                    _rclib_db_playlist_import_idle_cb,
                                     idle_data);
                             }
                             else if(import_data->type==
@@ -322,7 +528,9 @@ static gpointer rclib_db_playlist_import_thread_cb(gpointer data)
                                     import_data->play_flag;
                                 library_idle_data->type =
                                     RCLIB_DB_LIBRARY_TYPE_CUE;
-                                g_idle_add(_rclib_db_library_import_idle_cb,
+                                library_idle_data->fingerprint = fingerprint;
+                                rclib_db_import_batch_add(batch,
+                                    _rclib_db_library_import_idle_cb,
                                     library_idle_data);
                             }
                             else
@@ -369,7 +577,9 @@ static gpointer rclib_db_playlist_import_thread_cb(gpointer data)
                                 idle_data->mmd = cue_mmd;
                                 idle_data->play_flag = import_data->play_flag;
                                 idle_data->type = RCLIB_DB_PLAYLIST_TYPE_CUE;
-                                g_idle_add(_rclib_db_playlist_import_idle_cb,
+                                idle_data->fingerprint = fingerprint;
+                                rclib_db_import_batch_add(batch,
+                                    _rclib_db_playlist_import_idle_cb,
                                     idle_data);
                             }
                             else if(import_data->type==
@@ -382,7 +592,9 @@ static gpointer rclib_db_playlist_import_thread_cb(gpointer data)
                                     import_data->play_flag;
                                 library_idle_data->type =
                                     RCLIB_DB_LIBRARY_TYPE_CUE;
-                                g_idle_add(_rclib_db_library_import_idle_cb,
+                                library_idle_data->fingerprint = fingerprint;
+                                rclib_db_import_batch_add(batch,
+                                    _rclib_db_library_import_idle_cb,
                                     library_idle_data);
                             }
                             else
@@ -415,7 +627,9 @@ static gpointer rclib_db_playlist_import_thread_cb(gpointer data)
                                        import_data->play_flag;
                                 }
                                 idle_data->type = RCLIB_DB_PLAYLIST_TYPE_CUE;
-                                g_idle_add(_rclib_db_playlist_import_idle_cb,
+                                idle_data->fingerprint = fingerprint;
+                                rclib_db_import_batch_add(batch,
+                                    _rclib_db_playlist_import_idle_cb,
                                     idle_data);
                             }
                             else if(import_data->type==
@@ -431,7 +645,9 @@ static gpointer rclib_db_playlist_import_thread_cb(gpointer data)
                                 }
                                 library_idle_data->type =
                                     RCLIB_DB_LIBRARY_TYPE_CUE;
-                                g_idle_add(_rclib_db_library_import_idle_cb,
+                                library_idle_data->fingerprint = fingerprint;
+                                rclib_db_import_batch_add(batch,
+                                    _rclib_db_library_import_idle_cb,
                                     library_idle_data);
                             }
                             else
@@ -454,7 +670,9 @@ static gpointer rclib_db_playlist_import_thread_cb(gpointer data)
                 idle_data->mmd = mmd;
                 idle_data->play_flag = import_data->play_flag;
                 idle_data->type = RCLIB_DB_PLAYLIST_TYPE_MUSIC;
-                g_idle_add(_rclib_db_playlist_import_idle_cb, idle_data);
+                idle_data->fingerprint = fingerprint;
+                rclib_db_import_batch_add(batch,
+                    _rclib_db_playlist_import_idle_cb, idle_data);
             }
             else if(import_data->type==RCLIB_DB_IMPORT_TYPE_LIBRARY)
             {
@@ -462,8 +680,9 @@ static gpointer rclib_db_playlist_import_thread_cb(gpointer data)
                 library_idle_data->mmd = mmd;
                 library_idle_data->play_flag = import_data->play_flag;
                 library_idle_data->type = RCLIB_DB_LIBRARY_TYPE_MUSIC;
-                g_idle_add(_rclib_db_library_import_idle_cb,
-                    library_idle_data);
+                library_idle_data->fingerprint = fingerprint;
+                rclib_db_import_batch_add(batch,
+                    _rclib_db_library_import_idle_cb, library_idle_data);
             }
             else
             {
@@ -473,8 +692,7 @@ static gpointer rclib_db_playlist_import_thread_cb(gpointer data)
         }
         G_STMT_END;
         rclib_db_import_data_free(import_data);
-        length = g_async_queue_length(priv->import_queue);
-        g_idle_add(rclib_db_import_update_idle_cb, GINT_TO_POINTER(length));
+        rclib_db_import_batch_commit(priv, batch);
     }
     g_thread_exit(NULL);
     return NULL;
@@ -482,14 +700,15 @@ static gpointer rclib_db_playlist_import_thread_cb(gpointer data)
 
 static gpointer rclib_db_playlist_refresh_thread_cb(gpointer data)
 {
-    RCLibDbPlaylistRefreshIdleData *idle_data;
-    RCLibDbLibraryRefreshIdleData *library_idle_data;
     RCLibDbRefreshData *refresh_data;
+    RCLibDbRefreshSummary *summary;
+    RCLibDbFileFingerprint fingerprint;
     RCLibTagMetadata *mmd = NULL, *cue_mmd = NULL;
     RCLibDbPrivate *priv;
     RCLibCueData cue_data;
     gchar *cue_uri;
     gchar *scheme;
+    gchar *uri;
     gint track = 0;
     gint length;
     gboolean local_flag;
@@ -508,208 +727,116 @@ static gpointer rclib_db_playlist_refresh_thread_cb(gpointer data)
             g_free(refresh_data);
             break;
         }
-        if(refresh_data->catalog_iter==NULL ||
-            refresh_data->playlist_iter==NULL) continue;
+        if(refresh_data->type==RCLIB_DB_REFRESH_TYPE_PLAYLIST &&
+            (refresh_data->catalog_iter==NULL ||
+            refresh_data->playlist_iter==NULL))
+        {
+            rclib_db_refresh_data_free(refresh_data);
+            continue;
+        }
         scheme = g_uri_parse_scheme(refresh_data->uri);
         if(g_strcmp0(scheme, "file")==0) local_flag = TRUE;
         else local_flag = FALSE;
         g_free(scheme);
+        track = 0;
+        uri = g_strdup(refresh_data->uri);
         G_STMT_START
         {
-            if(local_flag && rclib_cue_get_track_num(refresh_data->uri,
-                &cue_uri, &track))
+            /* Skip the files which are not modified since last reading. */
+            if(local_flag)
+            {
+                if(!rclib_db_get_file_fingerprint(uri, &fingerprint))
+                {
+                    rclib_db_refresh_idle_add(priv, refresh_data, NULL,
+                        FALSE);
+                    break;
+                }
+                if(refresh_data->incremental_flag &&
+                    refresh_data->fingerprint.mtime!=0 &&
+                    refresh_data->fingerprint.mtime==fingerprint.mtime &&
+                    refresh_data->fingerprint.filesize==fingerprint.filesize &&
+                    refresh_data->fingerprint.inode==fingerprint.inode)
+                {
+                    priv->refresh_unchanged_count++;
+                    break;
+                }
+                refresh_data->fingerprint = fingerprint;
+            }
+            else if(refresh_data->incremental_flag)
+            {
+                priv->refresh_unchanged_count++;
+                break;
+            }
+            else
+            {
+                memset(&(refresh_data->fingerprint), 0,
+                    sizeof(RCLibDbFileFingerprint));
+            }
+            if(local_flag && rclib_cue_get_track_num(uri, &cue_uri, &track))
             {
                 if(g_regex_match_simple("(.CUE)$", cue_uri,
                     G_REGEX_CASELESS, 0))
                 {
+                    mmd = NULL;
                     memset(&cue_data, 0, sizeof(RCLibCueData));
                     if(rclib_cue_read_data(cue_uri, RCLIB_CUE_INPUT_URI,
                         &cue_data)>0)
                     {
                         mmd = rclib_db_get_metadata_from_cue(&cue_data,
                             track-1, NULL);
-                        if(mmd!=NULL) g_free(mmd->uri);
-                        if(refresh_data->type==
-                            RCLIB_DB_REFRESH_TYPE_PLAYLIST)
-                        {
-                            if(mmd!=NULL)
-                            {
-                                mmd->uri = g_strdup(refresh_data->uri);
-                                idle_data =
-                                    g_new0(RCLibDbPlaylistRefreshIdleData, 1);
-                                idle_data->catalog_iter =
-                                    refresh_data->catalog_iter;
-                                idle_data->playlist_iter =
-                                    refresh_data->playlist_iter;
-                                idle_data->mmd = mmd;
-                                idle_data->type = RCLIB_DB_PLAYLIST_TYPE_CUE;
-                                g_idle_add(_rclib_db_playlist_refresh_idle_cb,
-                                    idle_data);
-                            }
-                            else
-                            {
-                                idle_data =
-                                    g_new0(RCLibDbPlaylistRefreshIdleData, 1);
-                                idle_data->catalog_iter =
-                                    refresh_data->catalog_iter;
-                                idle_data->playlist_iter =
-                                    refresh_data->playlist_iter;
-                                idle_data->mmd = NULL;
-                                idle_data->type =
-                                    RCLIB_DB_PLAYLIST_TYPE_MISSING;
-                                g_idle_add(_rclib_db_playlist_refresh_idle_cb,
-                                    idle_data);
-                            }
-                        }
-                        else if(refresh_data->type==
-                            RCLIB_DB_REFRESH_TYPE_LIBRARY)
-                        {
-                            if(mmd!=NULL)
-                            {
-                                library_idle_data = g_new0(
-                                    RCLibDbLibraryRefreshIdleData, 1);
-                                library_idle_data->mmd = mmd;
-                                library_idle_data->type =
-                                    RCLIB_DB_PLAYLIST_TYPE_CUE;
-                                g_idle_add(_rclib_db_library_refresh_idle_cb,
-                                    library_idle_data);
-                            }
-                            else
-                            {
-                                library_idle_data = g_new0(
-                                    RCLibDbLibraryRefreshIdleData, 1);
-                                library_idle_data->mmd = NULL;
-                                library_idle_data->type =
-                                    RCLIB_DB_PLAYLIST_TYPE_MISSING;
-                                g_idle_add(_rclib_db_library_refresh_idle_cb,
-                                    library_idle_data);
-                            }
-                        }
-                        else
+                        if(mmd!=NULL)
                         {
-                            g_warning("Unknown refresh type!");
-                            if(mmd!=NULL) rclib_tag_free(mmd);
+                            g_free(mmd->uri);
+                            mmd->uri = g_strdup(refresh_data->uri);
                         }
                     }
                     rclib_cue_free(&cue_data);
                     g_free(cue_uri);
+                    rclib_db_refresh_idle_add(priv, refresh_data, mmd, TRUE);
                     break;
                 }
                 else /* Maybe a embedded CUE audio file? */
                 {
-                    g_free(refresh_data->uri);
-                    refresh_data->uri = g_strdup(cue_uri);
-                    g_free(cue_uri);
+                    g_free(uri);
+                    uri = cue_uri;
                 }
             }
-            mmd = rclib_tag_read_metadata(refresh_data->uri);
-            if(mmd!=NULL && mmd->emb_cue!=NULL) /* Embedded CUE check */
+            mmd = rclib_tag_read_metadata(uri);
+            if(mmd!=NULL && mmd->emb_cue!=NULL && track>0)
             {
+                /* Embedded CUE check */
+                memset(&cue_data, 0, sizeof(RCLibCueData));
                 if(rclib_cue_read_data(mmd->emb_cue,
                     RCLIB_CUE_INPUT_EMBEDDED, &cue_data)>0)
                 {
-                    if(track>0)
-                    {
-                        cue_mmd = rclib_db_get_metadata_from_cue(&cue_data,
-                            track-1, mmd);
-                        rclib_tag_free(mmd);
-                        if(refresh_data->type==
-                            RCLIB_DB_REFRESH_TYPE_PLAYLIST)
-                        {
-                            if(cue_mmd!=NULL)
-                            {
-                                idle_data =
-                                    g_new0(RCLibDbPlaylistRefreshIdleData, 1);
-                                idle_data->catalog_iter =
-                                    refresh_data->catalog_iter;
-                                idle_data->playlist_iter =
-                                    refresh_data->playlist_iter;
-                                idle_data->mmd = cue_mmd;
-                                idle_data->type = RCLIB_DB_PLAYLIST_TYPE_CUE;
-                                g_idle_add(_rclib_db_playlist_refresh_idle_cb,
-                                    idle_data);
-                            }
-                            else
-                            {
-                                idle_data =
-                                    g_new0(RCLibDbPlaylistRefreshIdleData, 1);
-                                idle_data->catalog_iter =
-                                    refresh_data->catalog_iter;
-                                idle_data->playlist_iter =
-                                    refresh_data->playlist_iter;
-                                idle_data->mmd = NULL;
-                                idle_data->type =
-                                    RCLIB_DB_PLAYLIST_TYPE_MISSING;
-                                g_idle_add(_rclib_db_playlist_refresh_idle_cb,
-                                    idle_data);
-                            }
-                        }
-                        else if(refresh_data->type==
-                                RCLIB_DB_REFRESH_TYPE_LIBRARY)
-                        {
-                            if(cue_mmd!=NULL)
-                            {
-                                library_idle_data = g_new0(
-                                    RCLibDbLibraryRefreshIdleData, 1);
-                                library_idle_data->mmd = cue_mmd;
-                                library_idle_data->type =
-                                    RCLIB_DB_PLAYLIST_TYPE_CUE;
-                                g_idle_add(_rclib_db_library_refresh_idle_cb,
-                                    library_idle_data);
-                            }
-                            else
-                            {
-                                library_idle_data = g_new0(
-                                    RCLibDbLibraryRefreshIdleData, 1);
-                                library_idle_data->mmd = NULL;
-                                library_idle_data->type =
-                                    RCLIB_DB_PLAYLIST_TYPE_MISSING;
-                                g_idle_add(_rclib_db_library_refresh_idle_cb,
-                                    library_idle_data);
-                            }
-                        }
-                        else
-                        {
-                            g_warning("Unknown refresh type!");
-                            if(cue_mmd!=NULL) rclib_tag_free(cue_mmd);
-                        }
-                    }
+                    cue_mmd = rclib_db_get_metadata_from_cue(&cue_data,
+                        track-1, mmd);
+                    rclib_tag_free(mmd);
+                    rclib_cue_free(&cue_data);
+                    rclib_db_refresh_idle_add(priv, refresh_data, cue_mmd,
+                        TRUE);
                     break;
                 }
+                rclib_cue_free(&cue_data);
             }
-            if(refresh_data->type==RCLIB_DB_REFRESH_TYPE_PLAYLIST)
-            {
-                idle_data = g_new0(RCLibDbPlaylistRefreshIdleData, 1);
-                idle_data->catalog_iter = refresh_data->catalog_iter;
-                idle_data->playlist_iter = refresh_data->playlist_iter;
-                idle_data->mmd = mmd;
-                if(mmd!=NULL)
-                    idle_data->type = RCLIB_DB_PLAYLIST_TYPE_MUSIC;
-                else
-                    idle_data->type = RCLIB_DB_PLAYLIST_TYPE_MISSING;
-                g_idle_add(_rclib_db_playlist_refresh_idle_cb, idle_data);
-            }
-            else if(refresh_data->type==RCLIB_DB_REFRESH_TYPE_LIBRARY)
-            {
-                library_idle_data = g_new0(RCLibDbLibraryRefreshIdleData, 1);
-                library_idle_data->mmd = mmd;
-                if(mmd!=NULL)
-                    library_idle_data->type = RCLIB_DB_PLAYLIST_TYPE_MUSIC;
-                else
-                    library_idle_data->type = RCLIB_DB_PLAYLIST_TYPE_MISSING;
-                g_idle_add(_rclib_db_library_refresh_idle_cb,
-                    library_idle_data);
-            }
-            else
-            {
-                g_warning("Unknown refresh type!");
-                if(mmd!=NULL) rclib_tag_free(mmd);
-            }
+            rclib_db_refresh_idle_add(priv, refresh_data, mmd, FALSE);
         }
         G_STMT_END;
+        g_free(uri);
         rclib_db_refresh_data_free(refresh_data);
         length = g_async_queue_length(priv->refresh_queue);
         g_idle_add(rclib_db_refresh_update_idle_cb, GINT_TO_POINTER(length));
+        if(length<=0)
+        {
+            summary = g_new0(RCLibDbRefreshSummary, 1);
+            summary->unchanged = priv->refresh_unchanged_count;
+            summary->changed = priv->refresh_changed_count;
+            summary->missing = priv->refresh_missing_count;
+            priv->refresh_unchanged_count = 0;
+            priv->refresh_changed_count = 0;
+            priv->refresh_missing_count = 0;
+            g_idle_add(rclib_db_refresh_summary_idle_cb, summary);
+        }
     }
     g_thread_exit(NULL);
     return NULL;
@@ -836,6 +963,27 @@ static void rclib_db_xml_parser_start_element_cb(GMarkupParseContext *context,
                     RCLIB_DB_PLAYLIST_DATA_TYPE_GENRE, attribute_values[i],
                     RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
             }
+            else if(g_strcmp0(attribute_names[i], "mtime")==0)
+            {
+                rclib_db_playlist_data_set(playlist_data,
+                    RCLIB_DB_PLAYLIST_DATA_TYPE_MTIME,
+                    g_ascii_strtoll(attribute_values[i], NULL, 10),
+                    RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
+            }
+            else if(g_strcmp0(attribute_names[i], "filesize")==0)
+            {
+                rclib_db_playlist_data_set(playlist_data,
+                    RCLIB_DB_PLAYLIST_DATA_TYPE_FILESIZE,
+                    g_ascii_strtoll(attribute_values[i], NULL, 10),
+                    RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
+            }
+            else if(g_strcmp0(attribute_names[i], "inode")==0)
+            {
+                rclib_db_playlist_data_set(playlist_data,
+                    RCLIB_DB_PLAYLIST_DATA_TYPE_INODE,
+                    g_ascii_strtoull(attribute_values[i], NULL, 10),
+                    RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
+            }
         }
         _rclib_db_playlist_append_data_internal(parser_data->catalog_iter,
             NULL, playlist_data);
@@ -885,17 +1033,20 @@ static void rclib_db_xml_parser_start_element_cb(GMarkupParseContext *context,
             else if(library_data->artist==NULL &&
                 g_strcmp0(attribute_names[i], "artist")==0)
             {
-                library_data->artist = g_strdup(attribute_values[i]);
+                library_data->artist = _rclib_db_string_intern(
+                    attribute_values[i]);
             }
             else if(library_data->album==NULL &&
                 g_strcmp0(attribute_names[i], "album")==0)
             {
-                library_data->album = g_strdup(attribute_values[i]);
+                library_data->album = _rclib_db_string_intern(
+                    attribute_values[i]);
             }
             else if(library_data->ftype==NULL &&
                 g_strcmp0(attribute_names[i], "filetype")==0)
             {
-                library_data->ftype = g_strdup(attribute_values[i]);
+                library_data->ftype = _rclib_db_string_intern(
+                    attribute_values[i]);
             }
             else if(g_strcmp0(attribute_names[i], "length")==0)
             {
@@ -935,7 +1086,48 @@ static void rclib_db_xml_parser_start_element_cb(GMarkupParseContext *context,
             else if(library_data->genre==NULL &&
                 g_strcmp0(attribute_names[i], "genre")==0)
             {
-                library_data->genre = g_strdup(attribute_values[i]);
+                library_data->genre = _rclib_db_string_intern(
+                    attribute_values[i]);
+            }
+            else if(g_strcmp0(attribute_names[i], "mtime")==0)
+            {
+                library_data->mtime = g_ascii_strtoll(attribute_values[i],
+                    NULL, 10);
+            }
+            else if(g_strcmp0(attribute_names[i], "filesize")==0)
+            {
+                library_data->filesize = g_ascii_strtoll(attribute_values[i],
+                    NULL, 10);
+            }
+            else if(g_strcmp0(attribute_names[i], "inode")==0)
+            {
+                library_data->inode = g_ascii_strtoull(attribute_values[i],
+                    NULL, 10);
+            }
+            else if(g_strcmp0(attribute_names[i], "gainflags")==0)
+            {
+                library_data->gain_flags = g_ascii_strtoull(
+                    attribute_values[i], NULL, 10);
+            }
+            else if(g_strcmp0(attribute_names[i], "trackgain")==0)
+            {
+                library_data->track_gain = g_ascii_strtod(
+                    attribute_values[i], NULL);
+            }
+            else if(g_strcmp0(attribute_names[i], "trackpeak")==0)
+            {
+                library_data->track_peak = g_ascii_strtod(
+                    attribute_values[i], NULL);
+            }
+            else if(g_strcmp0(attribute_names[i], "albumgain")==0)
+            {
+                library_data->album_gain = g_ascii_strtod(
+                    attribute_values[i], NULL);
+            }
+            else if(g_strcmp0(attribute_names[i], "albumpeak")==0)
+            {
+                library_data->album_peak = g_ascii_strtod(
+                    attribute_values[i], NULL);
             }
         }
         _rclib_db_library_append_data_internal(library_data->uri,
@@ -1035,6 +1227,7 @@ static inline GString *rclib_db_build_xml_data(RCLibDbCatalogSequence *catalog,
     GString *data_str;
     gchar *tmp;
     gchar *catalog_name;
+    gchar gain_str[4][G_ASCII_DTOSTR_BUF_SIZE];
     guint catalog_type;
     extern guint rclib_major_version;
     extern guint rclib_minor_version;
@@ -1141,6 +1334,13 @@ static inline GString *rclib_db_build_xml_data(RCLibDbCatalogSequence *catalog,
                     g_string_append(data_str, tmp);
                     g_free(tmp);
                 }
+                if(playlist_data->mtime!=0)
+                {
+                    g_string_append_printf(data_str, "mtime=\"%"
+                        G_GINT64_FORMAT"\" filesize=\"%"G_GINT64_FORMAT"\" "
+                        "inode=\"%"G_GUINT64_FORMAT"\" ", playlist_data->mtime,
+                        playlist_data->filesize, playlist_data->inode);
+                }
                 g_string_append(data_str, "/>\n");
                 playlist_count++;
             }    
@@ -1230,6 +1430,28 @@ static inline GString *rclib_db_build_xml_data(RCLibDbCatalogSequence *catalog,
                 g_string_append(data_str, tmp);
                 g_free(tmp);
             }
+            if(library_data->mtime!=0)
+            {
+                g_string_append_printf(data_str, "mtime=\"%"G_GINT64_FORMAT
+                    "\" filesize=\"%"G_GINT64_FORMAT"\" inode=\"%"
+                    G_GUINT64_FORMAT"\" ", library_data->mtime,
+                    library_data->filesize, library_data->inode);
+            }
+            if(library_data->gain_flags!=0)
+            {
+                g_ascii_dtostr(gain_str[0], G_ASCII_DTOSTR_BUF_SIZE,
+                    library_data->track_gain);
+                g_ascii_dtostr(gain_str[1], G_ASCII_DTOSTR_BUF_SIZE,
+                    library_data->track_peak);
+                g_ascii_dtostr(gain_str[2], G_ASCII_DTOSTR_BUF_SIZE,
+                    library_data->album_gain);
+                g_ascii_dtostr(gain_str[3], G_ASCII_DTOSTR_BUF_SIZE,
+                    library_data->album_peak);
+                g_string_append_printf(data_str, "gainflags=\"%u\" "
+                    "trackgain=\"%s\" trackpeak=\"%s\" albumgain=\"%s\" "
+                    "albumpeak=\"%s\" ", library_data->gain_flags,
+                    gain_str[0], gain_str[1], gain_str[2], gain_str[3]);
+            }
             g_string_append(data_str, "/>\n");
             library_count++;
         }
@@ -1299,100 +1521,1190 @@ static gboolean rclib_db_save_library_db(RCLibDbCatalogSequence *catalog,
     return flag;
 }
 
-static gpointer rclib_db_playlist_autosave_thread_cb(gpointer data)
+static guint32 rclib_db_binary_string_add(GByteArray *string_data,
+    GHashTable *string_table, const gchar *str)
 {
-    RCLibDbPrivate *priv = (RCLibDbPrivate *)data;
-    gchar *filename;
-    GZlibCompressor *compressor;
-    GFileOutputStream *file_ostream;
-    GOutputStream *compress_ostream;
-    GFile *output_file;
-    gssize write_size;
-    GError *error = NULL;
-    gboolean flag = TRUE;
-    if(data==NULL)
+    gpointer offset;
+    guint32 pos;
+    if(str==NULL) return 0;
+    if(g_hash_table_lookup_extended(string_table, str, NULL, &offset))
+        return GPOINTER_TO_UINT(offset);
+    pos = string_data->len;
+    g_byte_array_append(string_data, (const guint8 *)str, strlen(str)+1);
+    g_hash_table_insert(string_table, g_strdup(str), GUINT_TO_POINTER(pos));
+    return pos;
+}
+
+static inline gchar *rclib_db_binary_string_dup(const gchar *strings,
+    guint64 size, guint32 offset)
+{
+    if(offset==0 || offset>=size) return NULL;
+    return g_strdup(strings+offset);
+}
+
+static inline gchar *rclib_db_binary_string_intern(const gchar *strings,
+    guint64 size, guint32 offset)
+{
+    if(offset==0 || offset>=size) return NULL;
+    return _rclib_db_string_intern(strings+offset);
+}
+
+static GPtrArray *rclib_db_library_get_data_array(RCLibDbPrivate *priv,
+    GHashTable *uri_table, GPtrArray *deleted_array)
+{
+    GPtrArray *array;
+    GHashTableIter iter;
+    RCLibDbLibraryData *library_data;
+    const gchar *uri;
+    array = g_ptr_array_new_with_free_func((GDestroyNotify)
+        rclib_db_library_data_unref);
+    g_rw_lock_reader_lock(&(priv->library_rw_lock));
+    if(uri_table==NULL)
     {
-        g_thread_exit(NULL);
-        return NULL;
+        g_hash_table_iter_init(&iter, priv->library_table);
+        while(g_hash_table_iter_next(&iter, NULL, (gpointer *)&library_data))
+        {
+            if(library_data==NULL) continue;
+            g_ptr_array_add(array, rclib_db_library_data_ref(library_data));
+        }
     }
-    while(priv->work_flag)
+    else
     {
-        g_mutex_lock(&(priv->autosave_mutex));
-        g_cond_wait(&(priv->autosave_cond), &(priv->autosave_mutex));
-        G_STMT_START
+        g_hash_table_iter_init(&iter, uri_table);
+        while(g_hash_table_iter_next(&iter, (gpointer *)&uri, NULL))
         {
-            if(priv->autosave_xml_data==NULL) break;
-            filename = g_strdup_printf("%s.autosave", priv->filename);
-            output_file = g_file_new_for_path(filename);
-            g_free(filename);
-            if(output_file==NULL) break;
-            file_ostream = g_file_replace(output_file, NULL, FALSE,
-                G_FILE_CREATE_PRIVATE, NULL, NULL);
-            g_object_unref(output_file);
-            if(file_ostream==NULL) break;
-            compressor = g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_ZLIB,
-                5);
-            compress_ostream = g_converter_output_stream_new(G_OUTPUT_STREAM(
-                file_ostream), G_CONVERTER(compressor));
-            g_object_unref(file_ostream);
-            g_object_unref(compressor);
-            write_size = g_output_stream_write(compress_ostream,
-                priv->autosave_xml_data->str, priv->autosave_xml_data->len,
-                NULL, &error);
-            if(error!=NULL)
-            {
-                g_error_free(error);
-                error = NULL;
-                flag = FALSE;
-            }
-            g_output_stream_close(compress_ostream, NULL, &error);
-            if(error!=NULL)
-            {
-                g_error_free(error);
-                error = NULL;
-                flag = FALSE;
-            }
-            g_object_unref(compress_ostream);
-            if(flag)
-            {
-                g_message("Auto save successfully, wrote %ld bytes.",
-                    (glong)write_size);
+            library_data = g_hash_table_lookup(priv->library_table, uri);
+            if(library_data!=NULL)
+            {
+                g_ptr_array_add(array, rclib_db_library_data_ref(
+                    library_data));
             }
+            else if(deleted_array!=NULL)
+                g_ptr_array_add(deleted_array, g_strdup(uri));
         }
-        G_STMT_END;
-        if(priv->autosave_xml_data!=NULL)
-            g_string_free(priv->autosave_xml_data, TRUE);
-        priv->autosave_xml_data = NULL;
-        priv->dirty_flag = FALSE;
-        g_mutex_unlock(&(priv->autosave_mutex));
     }
-    g_thread_exit(NULL);
-    return NULL;
+    g_rw_lock_reader_unlock(&(priv->library_rw_lock));
+    return array;
 }
 
-static gboolean rclib_db_autosave_timeout_cb(gpointer data)
+/*
+ * Find the position of the catalog in the catalog list written last time,
+ * or return -1 if the catalog is new.
+ */
+
+static gint rclib_db_journal_catalog_lookup(GArray *id_array,
+    guint journal_id)
 {
-    RCLibDbPrivate *priv = (RCLibDbPrivate *)data;
-    if(data==NULL) return FALSE;
-    if(!priv->dirty_flag) return TRUE;
-    if(priv->filename==NULL) return TRUE;
-    if(priv->autosave_xml_data!=NULL) return TRUE;
-    priv->autosave_xml_data = rclib_db_build_xml_data(priv->catalog,
-        priv->library_table);
-    g_mutex_lock(&(priv->autosave_mutex));
-    g_cond_signal(&(priv->autosave_cond));
-    g_mutex_unlock(&(priv->autosave_mutex));
-    return TRUE;
+    guint i;
+    for(i=0;id_array!=NULL && i<id_array->len;i++)
+    {
+        if(g_array_index(id_array, guint, i)==journal_id)
+            return i;
+    }
+    return -1;
 }
 
-static void rclib_db_finalize(GObject *object)
-{
+/*
+ * Build a binary database image. If @playlist_table is not NULL, only
+ * the playlists of the catalogs in it are written, the other catalogs
+ * are marked with RCLIB_DB_JOURNAL_PLAYLIST_UNCHANGED. If @id_array is
+ * not NULL, these catalogs also refer to their positions in it, the
+ * catalogs not in it have their playlists written, and it is replaced
+ * by the journal IDs of the catalogs written here.
+ */
+
+static GByteArray *rclib_db_build_binary_data(RCLibDbPrivate *priv,
+    gboolean catalog_flag, GHashTable *playlist_table,
+    GArray *id_array, GPtrArray *library_data_array)
+{
+    RCLibDbBinaryHeader header;
+    RCLibDbBinaryCatalogRecord catalog_record;
+    RCLibDbBinaryItemRecord item_record;
+    RCLibDbCatalogData *catalog_data;
+    RCLibDbPlaylistData *playlist_data;
+    RCLibDbLibraryData *library_data;
+    GSequence *playlist;
+    GSequenceIter *catalog_iter;
+    GSequenceIter *playlist_iter;
+    GArray *catalog_array, *playlist_array, *library_array;
+    GByteArray *string_data, *data;
+    GHashTable *string_table;
+    GArray *written_id_array = NULL;
+    guint64 offset;
+    guint journal_id;
+    gint position;
+    guint i;
+    static const guint8 padding[8] = {0};
+    catalog_array = g_array_new(FALSE, TRUE,
+        sizeof(RCLibDbBinaryCatalogRecord));
+    playlist_array = g_array_new(FALSE, TRUE,
+        sizeof(RCLibDbBinaryItemRecord));
+    library_array = g_array_new(FALSE, TRUE,
+        sizeof(RCLibDbBinaryItemRecord));
+    string_data = g_byte_array_new();
+    string_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+        NULL);
+
+    /* Offset 0 is reserved for NULL strings. */
+    g_byte_array_append(string_data, padding, 1);
+    if(catalog_flag && priv->catalog!=NULL)
+    {
+        if(id_array!=NULL)
+            written_id_array = g_array_new(FALSE, FALSE, sizeof(guint));
+        g_rw_lock_reader_lock(&(priv->catalog_rw_lock));
+        g_rw_lock_reader_lock(&(priv->playlist_rw_lock));
+        for(catalog_iter = g_sequence_get_begin_iter((GSequence *)
+            priv->catalog);!g_sequence_iter_is_end(catalog_iter);
+            catalog_iter = g_sequence_iter_next(catalog_iter))
+        {
+            catalog_data = g_sequence_get(catalog_iter);
+            if(catalog_data==NULL) continue;
+            memset(&catalog_record, 0, sizeof(RCLibDbBinaryCatalogRecord));
+            g_rw_lock_reader_lock(&(catalog_data->lock));
+            catalog_record.name = rclib_db_binary_string_add(string_data,
+                string_table, catalog_data->name);
+            catalog_record.type = catalog_data->type;
+            playlist = (GSequence *)catalog_data->playlist;
+            journal_id = catalog_data->journal_id;
+            g_rw_lock_reader_unlock(&(catalog_data->lock));
+            if(written_id_array!=NULL)
+                g_array_append_val(written_id_array, journal_id);
+            position = rclib_db_journal_catalog_lookup(id_array, journal_id);
+            if(playlist_table!=NULL &&
+                !g_hash_table_contains(playlist_table, catalog_iter) &&
+                (id_array==NULL || position>=0))
+            {
+                catalog_record.playlist_index =
+                    RCLIB_DB_JOURNAL_PLAYLIST_UNCHANGED;
+                if(position>=0) catalog_record.playlist_count = position;
+                g_array_append_val(catalog_array, catalog_record);
+                continue;
+            }
+            catalog_record.playlist_index = playlist_array->len;
+            playlist_iter = NULL;
+            if(playlist!=NULL)
+                playlist_iter = g_sequence_get_begin_iter(playlist);
+            for(;playlist_iter!=NULL && !g_sequence_iter_is_end(
+                playlist_iter);
+                playlist_iter = g_sequence_iter_next(playlist_iter))
+            {
+                playlist_data = g_sequence_get(playlist_iter);
+                if(playlist_data==NULL) continue;
+                memset(&item_record, 0, sizeof(RCLibDbBinaryItemRecord));
+                g_rw_lock_reader_lock(&(playlist_data->lock));
+                item_record.type = playlist_data->type;
+                item_record.uri = rclib_db_binary_string_add(string_data,
+                    string_table, playlist_data->uri);
+                item_record.title = rclib_db_binary_string_add(string_data,
+                    string_table, playlist_data->title);
+                item_record.artist = rclib_db_binary_string_add(string_data,
+                    string_table, playlist_data->artist);
+                item_record.album = rclib_db_binary_string_add(string_data,
+                    string_table, playlist_data->album);
+                item_record.ftype = rclib_db_binary_string_add(string_data,
+                    string_table, playlist_data->ftype);
+                item_record.genre = rclib_db_binary_string_add(string_data,
+                    string_table, playlist_data->genre);
+                item_record.lyricfile = rclib_db_binary_string_add(
+                    string_data, string_table, playlist_data->lyricfile);
+                item_record.lyricsecfile = rclib_db_binary_string_add(
+                    string_data, string_table, playlist_data->lyricsecfile);
+                item_record.albumfile = rclib_db_binary_string_add(
+                    string_data, string_table, playlist_data->albumfile);
+                item_record.tracknum = playlist_data->tracknum;
+                item_record.year = playlist_data->year;
+                item_record.rating = playlist_data->rating;
+                item_record.length = playlist_data->length;
+                item_record.mtime = playlist_data->mtime;
+                item_record.filesize = playlist_data->filesize;
+                item_record.inode = playlist_data->inode;
+                g_rw_lock_reader_unlock(&(playlist_data->lock));
+                g_array_append_val(playlist_array, item_record);
+            }
+            catalog_record.playlist_count = playlist_array->len -
+                catalog_record.playlist_index;
+            g_array_append_val(catalog_array, catalog_record);
+        }
+        g_rw_lock_reader_unlock(&(priv->playlist_rw_lock));
+        g_rw_lock_reader_unlock(&(priv->catalog_rw_lock));
+    }
+    if(written_id_array!=NULL)
+    {
+        g_array_set_size(id_array, 0);
+        g_array_append_vals(id_array, written_id_array->data,
+            written_id_array->len);
+        g_array_free(written_id_array, TRUE);
+    }
+    for(i=0;library_data_array!=NULL && i<library_data_array->len;i++)
+    {
+        library_data = g_ptr_array_index(library_data_array, i);
+        memset(&item_record, 0, sizeof(RCLibDbBinaryItemRecord));
+        g_rw_lock_reader_lock(&(priv->library_rw_lock));
+        g_rw_lock_reader_lock(&(library_data->lock));
+        item_record.type = library_data->type;
+        item_record.uri = rclib_db_binary_string_add(string_data,
+            string_table, library_data->uri);
+        item_record.title = rclib_db_binary_string_add(string_data,
+            string_table, library_data->title);
+        item_record.artist = rclib_db_binary_string_add(string_data,
+            string_table, library_data->artist);
+        item_record.album = rclib_db_binary_string_add(string_data,
+            string_table, library_data->album);
+        item_record.ftype = rclib_db_binary_string_add(string_data,
+            string_table, library_data->ftype);
+        item_record.genre = rclib_db_binary_string_add(string_data,
+            string_table, library_data->genre);
+        item_record.lyricfile = rclib_db_binary_string_add(string_data,
+            string_table, library_data->lyricfile);
+        item_record.lyricsecfile = rclib_db_binary_string_add(
+            string_data, string_table, library_data->lyricsecfile);
+        item_record.albumfile = rclib_db_binary_string_add(string_data,
+            string_table, library_data->albumfile);
+        item_record.tracknum = library_data->tracknum;
+        item_record.year = library_data->year;
+        item_record.rating = library_data->rating;
+        item_record.length = library_data->length;
+        item_record.mtime = library_data->mtime;
+        item_record.filesize = library_data->filesize;
+        item_record.inode = library_data->inode;
+        item_record.track_gain = library_data->track_gain;
+        item_record.track_peak = library_data->track_peak;
+        item_record.album_gain = library_data->album_gain;
+        item_record.album_peak = library_data->album_peak;
+        item_record.gain_flags = library_data->gain_flags;
+        g_rw_lock_reader_unlock(&(library_data->lock));
+        g_rw_lock_reader_unlock(&(priv->library_rw_lock));
+        g_array_append_val(library_array, item_record);
+    }
+    g_hash_table_destroy(string_table);
+    memset(&header, 0, sizeof(RCLibDbBinaryHeader));
+    memcpy(header.magic, RCLIB_DB_BINARY_MAGIC, 8);
+    header.version = RCLIB_DB_BINARY_VERSION;
+    header.byte_order = RCLIB_DB_BINARY_BYTE_ORDER;
+    header.header_size = sizeof(RCLibDbBinaryHeader);
+    header.record_size = sizeof(RCLibDbBinaryItemRecord);
+    header.catalog_count = catalog_array->len;
+    header.playlist_count = playlist_array->len;
+    header.library_count = library_array->len;
+    offset = sizeof(RCLibDbBinaryHeader);
+    header.catalog_offset = offset;
+    offset += (guint64)catalog_array->len *
+        sizeof(RCLibDbBinaryCatalogRecord);
+    header.playlist_offset = offset;
+    offset += (guint64)playlist_array->len * sizeof(RCLibDbBinaryItemRecord);
+    header.library_offset = offset;
+    offset += (guint64)library_array->len * sizeof(RCLibDbBinaryItemRecord);
+    header.string_offset = offset;
+    header.string_size = string_data->len;
+    data = g_byte_array_sized_new(offset + string_data->len);
+    g_byte_array_append(data, (const guint8 *)&header,
+        sizeof(RCLibDbBinaryHeader));
+    g_byte_array_append(data, (const guint8 *)catalog_array->data,
+        catalog_array->len * sizeof(RCLibDbBinaryCatalogRecord));
+    g_byte_array_append(data, (const guint8 *)playlist_array->data,
+        playlist_array->len * sizeof(RCLibDbBinaryItemRecord));
+    g_byte_array_append(data, (const guint8 *)library_array->data,
+        library_array->len * sizeof(RCLibDbBinaryItemRecord));
+    g_byte_array_append(data, string_data->data, string_data->len);
+    g_array_free(catalog_array, TRUE);
+    g_array_free(playlist_array, TRUE);
+    g_array_free(library_array, TRUE);
+    g_byte_array_free(string_data, TRUE);
+    return data;
+}
+
+static gboolean rclib_db_save_binary_db(RCLibDbPrivate *priv,
+    const gchar *file, gboolean *dirty_flag)
+{
+    GPtrArray *library_data_array;
+    GByteArray *data;
+    GArray *id_array;
+    GError *error = NULL;
+    gchar *journal_file;
+    gboolean flag;
+    g_mutex_lock(&(priv->journal_mutex));
+    library_data_array = rclib_db_library_get_data_array(priv, NULL, NULL);
+    id_array = g_array_new(FALSE, FALSE, sizeof(guint));
+    data = rclib_db_build_binary_data(priv, TRUE, NULL, id_array,
+        library_data_array);
+    g_ptr_array_free(library_data_array, TRUE);
+    flag = g_file_set_contents(file, (const gchar *)data->data, data->len,
+        &error);
+    if(flag)
+    {
+        g_message("Player Database saved, wrote %lu bytes.",
+            (gulong)data->len);
+
+        /* All changes in the journal are in the database file now. */
+        journal_file = g_strdup_printf("%s.journal", file);
+        g_remove(journal_file);
+        g_free(journal_file);
+        g_array_free(priv->journal_catalog_array, TRUE);
+        priv->journal_catalog_array = id_array;
+        id_array = NULL;
+        if(dirty_flag!=NULL) *dirty_flag = FALSE;
+    }
+    else
+    {
+        g_warning("Cannot save player database: %s", error->message);
+        g_error_free(error);
+    }
+    g_mutex_unlock(&(priv->journal_mutex));
+    if(id_array!=NULL) g_array_free(id_array, TRUE);
+    g_byte_array_free(data, TRUE);
+    return flag;
+}
+
+static inline void rclib_db_binary_playlist_data_fill(
+    RCLibDbPlaylistData *playlist_data, const RCLibDbBinaryItemRecord *record,
+    const gchar *strings, guint64 size)
+{
+    playlist_data->type = record->type;
+    playlist_data->uri = rclib_db_binary_string_dup(strings, size,
+        record->uri);
+    playlist_data->title = rclib_db_binary_string_dup(strings, size,
+        record->title);
+    playlist_data->artist = rclib_db_binary_string_intern(strings, size,
+        record->artist);
+    playlist_data->album = rclib_db_binary_string_intern(strings, size,
+        record->album);
+    playlist_data->ftype = rclib_db_binary_string_intern(strings, size,
+        record->ftype);
+    playlist_data->genre = rclib_db_binary_string_intern(strings, size,
+        record->genre);
+    playlist_data->lyricfile = rclib_db_binary_string_dup(strings, size,
+        record->lyricfile);
+    playlist_data->lyricsecfile = rclib_db_binary_string_dup(strings, size,
+        record->lyricsecfile);
+    playlist_data->albumfile = rclib_db_binary_string_dup(strings, size,
+        record->albumfile);
+    playlist_data->tracknum = record->tracknum;
+    playlist_data->year = record->year;
+    playlist_data->rating = record->rating;
+    playlist_data->length = record->length;
+    playlist_data->mtime = record->mtime;
+    playlist_data->filesize = record->filesize;
+    playlist_data->inode = record->inode;
+}
+
+static inline void rclib_db_binary_library_data_fill(
+    RCLibDbLibraryData *library_data, const RCLibDbBinaryItemRecord *record,
+    const gchar *strings, guint64 size)
+{
+    library_data->type = record->type;
+    library_data->uri = rclib_db_binary_string_dup(strings, size,
+        record->uri);
+    library_data->title = rclib_db_binary_string_dup(strings, size,
+        record->title);
+    library_data->artist = rclib_db_binary_string_intern(strings, size,
+        record->artist);
+    library_data->album = rclib_db_binary_string_intern(strings, size,
+        record->album);
+    library_data->ftype = rclib_db_binary_string_intern(strings, size,
+        record->ftype);
+    library_data->genre = rclib_db_binary_string_intern(strings, size,
+        record->genre);
+    library_data->lyricfile = rclib_db_binary_string_dup(strings, size,
+        record->lyricfile);
+    library_data->lyricsecfile = rclib_db_binary_string_dup(strings, size,
+        record->lyricsecfile);
+    library_data->albumfile = rclib_db_binary_string_dup(strings, size,
+        record->albumfile);
+    library_data->tracknum = record->tracknum;
+    library_data->year = record->year;
+    library_data->rating = record->rating;
+    library_data->length = record->length;
+    library_data->mtime = record->mtime;
+    library_data->filesize = record->filesize;
+    library_data->inode = record->inode;
+    library_data->track_gain = record->track_gain;
+    library_data->track_peak = record->track_peak;
+    library_data->album_gain = record->album_gain;
+    library_data->album_peak = record->album_peak;
+    library_data->gain_flags = record->gain_flags;
+}
+
+#define RCLIB_DB_LIBRARY_STRING_MOVE(dst, src, member) G_STMT_START \
+{ \
+    g_free((dst)->member); \
+    (dst)->member = (src)->member; \
+    (src)->member = NULL; \
+} \
+G_STMT_END
+
+#define RCLIB_DB_LIBRARY_INTERN_MOVE(dst, src, member) G_STMT_START \
+{ \
+    _rclib_db_string_release((dst)->member); \
+    (dst)->member = (src)->member; \
+    (src)->member = NULL; \
+} \
+G_STMT_END
+
+static gboolean rclib_db_binary_library_data_update(RCLibDbPrivate *priv,
+    RCLibDbLibraryData *new_data)
+{
+    RCLibDbLibraryData *library_data;
+    g_rw_lock_writer_lock(&(priv->library_rw_lock));
+    library_data = g_hash_table_lookup(priv->library_table, new_data->uri);
+    if(library_data==NULL)
+    {
+        g_rw_lock_writer_unlock(&(priv->library_rw_lock));
+        return FALSE;
+    }
+    g_rw_lock_writer_lock(&(library_data->lock));
+    library_data->type = new_data->type;
+    RCLIB_DB_LIBRARY_STRING_MOVE(library_data, new_data, title);
+    RCLIB_DB_LIBRARY_INTERN_MOVE(library_data, new_data, artist);
+    RCLIB_DB_LIBRARY_INTERN_MOVE(library_data, new_data, album);
+    RCLIB_DB_LIBRARY_INTERN_MOVE(library_data, new_data, ftype);
+    RCLIB_DB_LIBRARY_INTERN_MOVE(library_data, new_data, genre);
+    RCLIB_DB_LIBRARY_STRING_MOVE(library_data, new_data, lyricfile);
+    RCLIB_DB_LIBRARY_STRING_MOVE(library_data, new_data, lyricsecfile);
+    RCLIB_DB_LIBRARY_STRING_MOVE(library_data, new_data, albumfile);
+    library_data->tracknum = new_data->tracknum;
+    library_data->year = new_data->year;
+    library_data->rating = new_data->rating;
+    library_data->length = new_data->length;
+    library_data->mtime = new_data->mtime;
+    library_data->filesize = new_data->filesize;
+    library_data->inode = new_data->inode;
+    library_data->track_gain = new_data->track_gain;
+    library_data->track_peak = new_data->track_peak;
+    library_data->album_gain = new_data->album_gain;
+    library_data->album_peak = new_data->album_peak;
+    library_data->gain_flags = new_data->gain_flags;
+    g_rw_lock_writer_unlock(&(library_data->lock));
+    g_rw_lock_writer_unlock(&(priv->library_rw_lock));
+    g_signal_emit_by_name(rclib_db_get_instance(), "library-changed",
+        new_data->uri);
+    return TRUE;
+}
+
+static gboolean rclib_db_binary_check_header(const RCLibDbBinaryHeader *header,
+    gsize size)
+{
+    gsize record_size = sizeof(RCLibDbBinaryItemRecord);
+    if(size<sizeof(RCLibDbBinaryHeader)) return FALSE;
+    if(memcmp(header->magic, RCLIB_DB_BINARY_MAGIC, 8)!=0) return FALSE;
+    if(header->byte_order!=RCLIB_DB_BINARY_BYTE_ORDER)
+    {
+        g_warning("The byte order of the player database is not supported!");
+        return FALSE;
+    }
+    if(header->version>RCLIB_DB_BINARY_VERSION)
+    {
+        g_warning("The player database version %u is not supported!",
+            header->version);
+        return FALSE;
+    }
+    if(header->version<2)
+        record_size = RCLIB_DB_BINARY_RECORD_SIZE_V1;
+    if(header->header_size<sizeof(RCLibDbBinaryHeader) ||
+        header->record_size!=record_size)
+    {
+        g_warning("The player database is broken!");
+        return FALSE;
+    }
+    if(header->catalog_offset>size || header->playlist_offset>size ||
+        header->library_offset>size || header->string_offset>size ||
+        (size - header->catalog_offset) / sizeof(RCLibDbBinaryCatalogRecord)
+        < header->catalog_count ||
+        (size - header->playlist_offset) / record_size
+        < header->playlist_count ||
+        (size - header->library_offset) / record_size
+        < header->library_count ||
+        size - header->string_offset < header->string_size)
+    {
+        g_warning("The player database is broken!");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Read the item record at the index, the records written by an older
+ * version are shorter, and the missing fields are zero.
+ */
+
+static inline void rclib_db_binary_get_record(const gchar *contents,
+    guint64 offset, const RCLibDbBinaryHeader *header, guint index,
+    RCLibDbBinaryItemRecord *record)
+{
+    memset(record, 0, sizeof(RCLibDbBinaryItemRecord));
+    memcpy(record, contents + offset + (guint64)index * header->record_size,
+        header->record_size);
+}
+
+static const gchar *rclib_db_binary_get_strings(const gchar *contents,
+    const RCLibDbBinaryHeader *header, guint64 *string_size)
+{
+    /* The string table must be terminated, or ignore all strings. */
+    *string_size = 0;
+    if(header->string_size==0 ||
+        contents[header->string_offset+header->string_size-1]!='\0')
+        return NULL;
+    *string_size = header->string_size;
+    return contents + header->string_offset;
+}
+
+static gulong rclib_db_binary_load_playlist(const gchar *contents,
+    const RCLibDbBinaryHeader *header,
+    const RCLibDbBinaryCatalogRecord *catalog_record,
+    RCLibDbCatalogIter *catalog_iter, const gchar *strings,
+    guint64 string_size)
+{
+    RCLibDbBinaryItemRecord playlist_record;
+    RCLibDbPlaylistData *playlist_data;
+    guint i;
+    gulong playlist_count = 0;
+    if(catalog_record->playlist_index>header->playlist_count ||
+        header->playlist_count - catalog_record->playlist_index <
+        catalog_record->playlist_count)
+        return 0;
+    for(i=catalog_record->playlist_index;i<catalog_record->playlist_index +
+        catalog_record->playlist_count;i++)
+    {
+        playlist_data = rclib_db_playlist_data_new();
+        playlist_data->catalog = catalog_iter;
+        rclib_db_binary_get_record(contents, header->playlist_offset,
+            header, i, &playlist_record);
+        rclib_db_binary_playlist_data_fill(playlist_data, &playlist_record,
+            strings, string_size);
+        _rclib_db_playlist_append_data_internal(catalog_iter, NULL,
+            playlist_data);
+        playlist_count++;
+    }
+    return playlist_count;
+}
+
+static gulong rclib_db_binary_load_catalog(const gchar *contents,
+    const RCLibDbBinaryHeader *header)
+{
+    const RCLibDbBinaryCatalogRecord *catalog_records;
+    RCLibDbCatalogData *catalog_data;
+    RCLibDbCatalogIter *catalog_iter;
+    const gchar *strings;
+    guint64 string_size;
+    guint i;
+    gulong playlist_count = 0;
+    catalog_records = (const RCLibDbBinaryCatalogRecord *)(contents +
+        header->catalog_offset);
+    strings = rclib_db_binary_get_strings(contents, header, &string_size);
+    for(i=0;i<header->catalog_count;i++)
+    {
+        catalog_data = rclib_db_catalog_data_new();
+        catalog_data->name = rclib_db_binary_string_dup(strings,
+            string_size, catalog_records[i].name);
+        catalog_data->type = catalog_records[i].type;
+        catalog_iter = _rclib_db_catalog_append_data_internal(NULL,
+            catalog_data);
+        if(catalog_iter==NULL) continue;
+        playlist_count += rclib_db_binary_load_playlist(contents, header,
+            catalog_records + i, catalog_iter, strings, string_size);
+    }
+    return playlist_count;
+}
+
+/*
+ * Replace the playlists of the changed catalogs in a journal playlist
+ * entry. The catalogs in the entry must be the same as the current ones,
+ * otherwise the entry is skipped, a later catalog entry has the changes.
+ */
+
+static gboolean rclib_db_binary_load_playlist_changes(const gchar *contents,
+    const RCLibDbBinaryHeader *header)
+{
+    const RCLibDbBinaryCatalogRecord *catalog_records;
+    RCLibDbCatalogIter *catalog_iter;
+    RCLibDbPlaylistIter *playlist_iter;
+    const gchar *strings;
+    gchar *name, *record_name;
+    guint64 string_size;
+    RCLibDbCatalogType type;
+    guint i;
+    gboolean flag = TRUE;
+    if(rclib_db_catalog_get_length()!=(gint)header->catalog_count)
+        return FALSE;
+    catalog_records = (const RCLibDbBinaryCatalogRecord *)(contents +
+        header->catalog_offset);
+    strings = rclib_db_binary_get_strings(contents, header, &string_size);
+    catalog_iter = rclib_db_catalog_get_begin_iter();
+    for(i=0;flag && i<header->catalog_count;i++)
+    {
+        name = NULL;
+        type = 0;
+        rclib_db_catalog_data_iter_get(catalog_iter,
+            RCLIB_DB_CATALOG_DATA_TYPE_NAME, &name,
+            RCLIB_DB_CATALOG_DATA_TYPE_TYPE, &type,
+            RCLIB_DB_CATALOG_DATA_TYPE_NONE);
+        record_name = rclib_db_binary_string_dup(strings, string_size,
+            catalog_records[i].name);
+        flag = (guint)type==catalog_records[i].type &&
+            g_strcmp0(name, record_name)==0;
+        g_free(record_name);
+        g_free(name);
+        catalog_iter = rclib_db_catalog_iter_next(catalog_iter);
+    }
+    if(!flag) return FALSE;
+    catalog_iter = rclib_db_catalog_get_begin_iter();
+    for(i=0;i<header->catalog_count;i++)
+    {
+        if(catalog_records[i].playlist_index!=
+            RCLIB_DB_JOURNAL_PLAYLIST_UNCHANGED)
+        {
+            while(rclib_db_playlist_get_length(catalog_iter)>0)
+            {
+                playlist_iter = rclib_db_playlist_get_begin_iter(
+                    catalog_iter);
+                rclib_db_playlist_delete(playlist_iter);
+            }
+            rclib_db_binary_load_playlist(contents, header,
+                catalog_records + i, catalog_iter, strings, string_size);
+        }
+        catalog_iter = rclib_db_catalog_iter_next(catalog_iter);
+    }
+    return TRUE;
+}
+
+/*
+ * Apply a journal catalog entry. The unchanged catalogs are kept with
+ * their playlists and moved to their new positions, the others are
+ * loaded from the entry, and the catalogs not in the entry are deleted.
+ */
+
+static void rclib_db_binary_load_catalog_changes(const gchar *contents,
+    const RCLibDbBinaryHeader *header)
+{
+    const RCLibDbBinaryCatalogRecord *catalog_records;
+    RCLibDbCatalogData *catalog_data;
+    RCLibDbCatalogIter *catalog_iter;
+    GPtrArray *old_array, *new_array;
+    const gchar *strings;
+    gchar *name;
+    guint64 string_size;
+    gint *new_order;
+    guint i, position;
+    gboolean reorder_flag = FALSE;
+    catalog_records = (const RCLibDbBinaryCatalogRecord *)(contents +
+        header->catalog_offset);
+    strings = rclib_db_binary_get_strings(contents, header, &string_size);
+    old_array = g_ptr_array_new();
+    for(catalog_iter=rclib_db_catalog_get_begin_iter();catalog_iter!=NULL;
+        catalog_iter=rclib_db_catalog_iter_next(catalog_iter))
+    {
+        g_ptr_array_add(old_array, catalog_iter);
+    }
+    new_array = g_ptr_array_new();
+    for(i=0;i<header->catalog_count;i++)
+    {
+        if(catalog_records[i].playlist_index==
+            RCLIB_DB_JOURNAL_PLAYLIST_UNCHANGED)
+        {
+            position = catalog_records[i].playlist_count;
+            if(position>=old_array->len ||
+                g_ptr_array_index(old_array, position)==NULL)
+            {
+                g_warning("Invalid catalog position %u in the journal, "
+                    "skip it.", position);
+                continue;
+            }
+            catalog_iter = g_ptr_array_index(old_array, position);
+            old_array->pdata[position] = NULL;
+            name = rclib_db_binary_string_dup(strings, string_size,
+                catalog_records[i].name);
+            rclib_db_catalog_data_iter_set(catalog_iter,
+                RCLIB_DB_CATALOG_DATA_TYPE_NAME, name,
+                RCLIB_DB_CATALOG_DATA_TYPE_TYPE, catalog_records[i].type,
+                RCLIB_DB_CATALOG_DATA_TYPE_NONE);
+            g_free(name);
+        }
+        else
+        {
+            catalog_data = rclib_db_catalog_data_new();
+            catalog_data->name = rclib_db_binary_string_dup(strings,
+                string_size, catalog_records[i].name);
+            catalog_data->type = catalog_records[i].type;
+            catalog_iter = _rclib_db_catalog_append_data_internal(NULL,
+                catalog_data);
+            if(catalog_iter==NULL) continue;
+            rclib_db_binary_load_playlist(contents, header,
+                catalog_records + i, catalog_iter, strings, string_size);
+        }
+        g_ptr_array_add(new_array, catalog_iter);
+    }
+    for(i=0;i<old_array->len;i++)
+    {
+        catalog_iter = g_ptr_array_index(old_array, i);
+        if(catalog_iter!=NULL) rclib_db_catalog_delete(catalog_iter);
+    }
+    g_ptr_array_free(old_array, TRUE);
+    new_order = g_new(gint, new_array->len);
+    for(i=0;i<new_array->len;i++)
+    {
+        new_order[i] = rclib_db_catalog_iter_get_position(
+            g_ptr_array_index(new_array, i));
+        if(new_order[i]!=(gint)i) reorder_flag = TRUE;
+    }
+    if(reorder_flag) rclib_db_catalog_reorder(new_order);
+    g_free(new_order);
+    g_ptr_array_free(new_array, TRUE);
+}
+
+static gulong rclib_db_binary_load_library(RCLibDbPrivate *priv,
+    const gchar *contents, const RCLibDbBinaryHeader *header,
+    gboolean update_flag)
+{
+    RCLibDbBinaryItemRecord library_record;
+    RCLibDbLibraryData *library_data;
+    const gchar *strings;
+    guint64 string_size;
+    guint i;
+    gulong library_count = 0;
+    strings = rclib_db_binary_get_strings(contents, header, &string_size);
+    for(i=0;i<header->library_count;i++)
+    {
+        rclib_db_binary_get_record(contents, header->library_offset, header,
+            i, &library_record);
+        if(library_record.uri==0 || library_record.uri>=string_size)
+            continue;
+        library_data = rclib_db_library_data_new();
+        rclib_db_binary_library_data_fill(library_data, &library_record,
+            strings, string_size);
+        if(!update_flag || !rclib_db_binary_library_data_update(priv,
+            library_data))
+        {
+            _rclib_db_library_append_data_internal(library_data->uri,
+                library_data);
+        }
+        rclib_db_library_data_unref(library_data);
+        library_count++;
+    }
+    return library_count;
+}
+
+/*
+ * Load the binary database. The file is mapped, but all catalogs,
+ * playlist items and library items are still built from the records
+ * here, because the sequences and the library table own their data, so
+ * the loading time still grows with the size of the library. It is only
+ * faster than loading the XML database because nothing is decompressed
+ * or parsed.
+ */
+
+static gboolean rclib_db_load_binary_db(RCLibDbPrivate *priv,
+    const gchar *file, gboolean *dirty_flag)
+{
+    const RCLibDbBinaryHeader *header;
+    GMappedFile *mapped_file;
+    const gchar *contents;
+    gsize size;
+    gulong playlist_count, library_count;
+    mapped_file = g_mapped_file_new(file, FALSE, NULL);
+    if(mapped_file==NULL) return FALSE;
+    contents = g_mapped_file_get_contents(mapped_file);
+    size = g_mapped_file_get_length(mapped_file);
+    header = (const RCLibDbBinaryHeader *)contents;
+    if(contents==NULL || !rclib_db_binary_check_header(header, size))
+    {
+        g_mapped_file_unref(mapped_file);
+        return FALSE;
+    }
+    playlist_count = rclib_db_binary_load_catalog(contents, header);
+    library_count = rclib_db_binary_load_library(priv, contents, header,
+        FALSE);
+    g_message("Player Database loaded, catalog count: %u, playlist count: "
+        "%lu, library count: %lu.", header->catalog_count, playlist_count,
+        library_count);
+    g_mapped_file_unref(mapped_file);
+    if(dirty_flag!=NULL) *dirty_flag = FALSE;
+    return TRUE;
+}
+
+/*
+ * Remember the catalogs loaded from the database file, the catalog
+ * entries in the journal refer to them.
+ */
+
+static void rclib_db_journal_catalog_reset(RCLibDbPrivate *priv)
+{
+    RCLibDbCatalogData *catalog_data;
+    GSequenceIter *catalog_iter;
+    g_mutex_lock(&(priv->journal_mutex));
+    g_array_set_size(priv->journal_catalog_array, 0);
+    g_rw_lock_reader_lock(&(priv->catalog_rw_lock));
+    for(catalog_iter = g_sequence_get_begin_iter((GSequence *)
+        priv->catalog);!g_sequence_iter_is_end(catalog_iter);
+        catalog_iter = g_sequence_iter_next(catalog_iter))
+    {
+        catalog_data = g_sequence_get(catalog_iter);
+        if(catalog_data==NULL) continue;
+        g_array_append_val(priv->journal_catalog_array,
+            catalog_data->journal_id);
+    }
+    g_rw_lock_reader_unlock(&(priv->catalog_rw_lock));
+    g_mutex_unlock(&(priv->journal_mutex));
+}
+
+static gboolean rclib_db_journal_write_entry(FILE *fp, guint32 type,
+    const guint8 *data, gsize size)
+{
+    RCLibDbJournalEntry entry;
+    gsize padding_size;
+    static const guint8 padding[8] = {0};
+    memset(&entry, 0, sizeof(RCLibDbJournalEntry));
+    entry.type = type;
+    entry.size = size;
+    padding_size = (8 - size % 8) % 8;
+    if(fwrite(&entry, sizeof(RCLibDbJournalEntry), 1, fp)!=1)
+        return FALSE;
+    if(size>0 && fwrite(data, 1, size, fp)!=size)
+        return FALSE;
+    if(padding_size>0 && fwrite(padding, 1, padding_size, fp)!=padding_size)
+        return FALSE;
+    return TRUE;
+}
+
+static gboolean rclib_db_journal_append(RCLibDbPrivate *priv,
+    gboolean catalog_flag, GHashTable *playlist_table,
+    GHashTable *library_table, gint64 *journal_size)
+{
+    RCLibDbJournalHeader header;
+    GPtrArray *library_data_array, *deleted_array;
+    GHashTable *empty_table = NULL;
+    GByteArray *data;
+    GArray *id_array;
+    GStatBuf stat_buf;
+    gchar *journal_file;
+    const gchar *uri;
+    FILE *fp;
+    guint i;
+    gboolean flag = TRUE;
+    journal_file = g_strdup_printf("%s.journal", priv->filename);
+    g_mutex_lock(&(priv->journal_mutex));
+    fp = g_fopen(journal_file, "ab");
+    if(fp==NULL)
+    {
+        g_warning("Cannot open the journal file: %s", journal_file);
+        g_mutex_unlock(&(priv->journal_mutex));
+        g_free(journal_file);
+        return FALSE;
+    }
+    if(g_stat(journal_file, &stat_buf)!=0 || stat_buf.st_size==0)
+    {
+        memset(&header, 0, sizeof(RCLibDbJournalHeader));
+        memcpy(header.magic, RCLIB_DB_JOURNAL_MAGIC, 8);
+        header.version = RCLIB_DB_JOURNAL_VERSION;
+        header.byte_order = RCLIB_DB_BINARY_BYTE_ORDER;
+        flag = fwrite(&header, sizeof(RCLibDbJournalHeader), 1, fp)==1;
+    }
+    if(flag && catalog_flag)
+    {
+        /* Only the catalogs with changed playlists carry their items. */
+        id_array = g_array_new(FALSE, FALSE, sizeof(guint));
+        g_array_append_vals(id_array, priv->journal_catalog_array->data,
+            priv->journal_catalog_array->len);
+        if(playlist_table==NULL)
+            empty_table = g_hash_table_new(g_direct_hash, g_direct_equal);
+        data = rclib_db_build_binary_data(priv, TRUE,
+            playlist_table!=NULL ? playlist_table : empty_table, id_array,
+            NULL);
+        flag = rclib_db_journal_write_entry(fp,
+            RCLIB_DB_JOURNAL_ENTRY_CATALOG, data->data, data->len);
+        g_byte_array_free(data, TRUE);
+        if(empty_table!=NULL) g_hash_table_destroy(empty_table);
+        if(flag)
+        {
+            g_array_free(priv->journal_catalog_array, TRUE);
+            priv->journal_catalog_array = id_array;
+        }
+        else
+            g_array_free(id_array, TRUE);
+    }
+    else if(flag && playlist_table!=NULL &&
+        g_hash_table_size(playlist_table)>0)
+    {
+        data = rclib_db_build_binary_data(priv, TRUE, playlist_table,
+            NULL, NULL);
+        flag = rclib_db_journal_write_entry(fp,
+            RCLIB_DB_JOURNAL_ENTRY_PLAYLIST, data->data, data->len);
+        g_byte_array_free(data, TRUE);
+    }
+    if(flag && library_table!=NULL && g_hash_table_size(library_table)>0)
+    {
+        deleted_array = g_ptr_array_new_with_free_func(g_free);
+        library_data_array = rclib_db_library_get_data_array(priv,
+            library_table, deleted_array);
+        if(library_data_array->len>0)
+        {
+            data = rclib_db_build_binary_data(priv, FALSE, NULL, NULL,
+                library_data_array);
+            flag = rclib_db_journal_write_entry(fp,
+                RCLIB_DB_JOURNAL_ENTRY_LIBRARY_UPDATE, data->data,
+                data->len);
+            g_byte_array_free(data, TRUE);
+        }
+        if(flag && deleted_array->len>0)
+        {
+            data = g_byte_array_new();
+            for(i=0;i<deleted_array->len;i++)
+            {
+                uri = g_ptr_array_index(deleted_array, i);
+                g_byte_array_append(data, (const guint8 *)uri,
+                    strlen(uri)+1);
+            }
+            flag = rclib_db_journal_write_entry(fp,
+                RCLIB_DB_JOURNAL_ENTRY_LIBRARY_DELETE, data->data,
+                data->len);
+            g_byte_array_free(data, TRUE);
+        }
+        g_ptr_array_free(library_data_array, TRUE);
+        g_ptr_array_free(deleted_array, TRUE);
+    }
+    if(fflush(fp)!=0) flag = FALSE;
+    fclose(fp);
+    if(journal_size!=NULL)
+    {
+        if(g_stat(journal_file, &stat_buf)==0)
+            *journal_size = stat_buf.st_size;
+        else
+            *journal_size = 0;
+    }
+    g_mutex_unlock(&(priv->journal_mutex));
+    if(!flag)
+        g_warning("Cannot write the journal file: %s", journal_file);
+    g_free(journal_file);
+    return flag;
+}
+
+static gboolean rclib_db_journal_replay(RCLibDbPrivate *priv,
+    const gchar *file)
+{
+    const RCLibDbJournalHeader *header;
+    const RCLibDbJournalEntry *entry;
+    const RCLibDbBinaryHeader *binary_header;
+    GMappedFile *mapped_file;
+    const gchar *contents, *payload, *uri, *uri_end;
+    gsize size, offset;
+    guint entry_count = 0;
+    mapped_file = g_mapped_file_new(file, FALSE, NULL);
+    if(mapped_file==NULL) return FALSE;
+    contents = g_mapped_file_get_contents(mapped_file);
+    size = g_mapped_file_get_length(mapped_file);
+    header = (const RCLibDbJournalHeader *)contents;
+    if(contents==NULL || size<sizeof(RCLibDbJournalHeader) ||
+        memcmp(header->magic, RCLIB_DB_JOURNAL_MAGIC, 8)!=0 ||
+        header->byte_order!=RCLIB_DB_BINARY_BYTE_ORDER ||
+        header->version>RCLIB_DB_JOURNAL_VERSION)
+    {
+        g_mapped_file_unref(mapped_file);
+        return FALSE;
+    }
+    offset = sizeof(RCLibDbJournalHeader);
+    while(size - offset >= sizeof(RCLibDbJournalEntry))
+    {
+        entry = (const RCLibDbJournalEntry *)(contents + offset);
+        offset += sizeof(RCLibDbJournalEntry);
+
+        /* Stop at the entry which is not written completely. */
+        if(entry->size > size - offset) break;
+        payload = contents + offset;
+        binary_header = (const RCLibDbBinaryHeader *)payload;
+        switch(entry->type)
+        {
+            case RCLIB_DB_JOURNAL_ENTRY_CATALOG:
+            {
+                if(!rclib_db_binary_check_header(binary_header,
+                    entry->size))
+                    break;
+                rclib_db_binary_load_catalog_changes(payload,
+                    binary_header);
+                break;
+            }
+            case RCLIB_DB_JOURNAL_ENTRY_PLAYLIST:
+            {
+                if(!rclib_db_binary_check_header(binary_header,
+                    entry->size))
+                    break;
+                if(!rclib_db_binary_load_playlist_changes(payload,
+                    binary_header))
+                {
+                    g_warning("The catalogs in the journal do not match, "
+                        "skip the playlist changes.");
+                }
+                break;
+            }
+            case RCLIB_DB_JOURNAL_ENTRY_LIBRARY_UPDATE:
+            {
+                if(!rclib_db_binary_check_header(binary_header,
+                    entry->size))
+                    break;
+                rclib_db_binary_load_library(priv, payload, binary_header,
+                    TRUE);
+                break;
+            }
+            case RCLIB_DB_JOURNAL_ENTRY_LIBRARY_DELETE:
+            {
+                for(uri=payload;uri<payload+entry->size;uri=uri_end+1)
+                {
+                    uri_end = memchr(uri, '\0', payload+entry->size-uri);
+                    if(uri_end==NULL) break;
+                    if(rclib_db_library_has_uri(uri))
+                        rclib_db_library_delete(uri);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        if(entry->size + (8 - entry->size % 8) % 8 > size - offset)
+            break;
+        offset += entry->size + (8 - entry->size % 8) % 8;
+        entry_count++;
+    }
+    g_message("Player Database journal replayed, entry count: %u.",
+        entry_count);
+    g_mapped_file_unref(mapped_file);
+    return TRUE;
+}
+
+static gpointer rclib_db_playlist_autosave_thread_cb(gpointer data)
+{
+    RCLibDbPrivate *priv = (RCLibDbPrivate *)data;
+    GHashTable *playlist_table, *library_table;
+    gboolean catalog_flag;
+    gint64 journal_size = 0;
+    if(data==NULL)
+    {
+        g_thread_exit(NULL);
+        return NULL;
+    }
+    while(priv->work_flag)
+    {
+        g_mutex_lock(&(priv->autosave_mutex));
+        while(priv->work_flag && !priv->autosave_pending_flag)
+            g_cond_wait(&(priv->autosave_cond), &(priv->autosave_mutex));
+        if(!priv->work_flag)
+        {
+            g_mutex_unlock(&(priv->autosave_mutex));
+            break;
+        }
+        playlist_table = priv->autosave_playlist_table;
+        library_table = priv->autosave_library_table;
+        catalog_flag = priv->autosave_catalog_flag;
+        priv->autosave_playlist_table = NULL;
+        priv->autosave_library_table = NULL;
+        priv->autosave_catalog_flag = FALSE;
+        priv->autosave_pending_flag = FALSE;
+        g_mutex_unlock(&(priv->autosave_mutex));
+        if(rclib_db_journal_append(priv, catalog_flag, playlist_table,
+            library_table, &journal_size))
+        {
+            g_message("Auto save successfully, journal size: %ld bytes.",
+                (glong)journal_size);
+        }
+        if(playlist_table!=NULL)
+            g_hash_table_destroy(playlist_table);
+        if(library_table!=NULL)
+            g_hash_table_destroy(library_table);
+
+        /* Compact the journal into the database file. */
+        if(journal_size>=db_journal_compact_size)
+            rclib_db_save_binary_db(priv, priv->filename, NULL);
+    }
+    g_thread_exit(NULL);
+    return NULL;
+}
+
+static gboolean rclib_db_autosave_timeout_cb(gpointer data)
+{
+    RCLibDbPrivate *priv = (RCLibDbPrivate *)data;
+    if(data==NULL) return FALSE;
+    if(priv->filename==NULL) return TRUE;
+    if(!priv->journal_catalog_flag &&
+        g_hash_table_size(priv->journal_playlist_table)==0 &&
+        g_hash_table_size(priv->journal_library_table)==0)
+        return TRUE;
+    g_mutex_lock(&(priv->autosave_mutex));
+    if(!priv->autosave_pending_flag)
+    {
+        priv->autosave_playlist_table = priv->journal_playlist_table;
+        priv->autosave_library_table = priv->journal_library_table;
+        priv->autosave_catalog_flag = priv->journal_catalog_flag;
+        priv->autosave_pending_flag = TRUE;
+        priv->journal_playlist_table = g_hash_table_new(g_direct_hash,
+            g_direct_equal);
+        priv->journal_library_table = g_hash_table_new_full(g_str_hash,
+            g_str_equal, g_free, NULL);
+        priv->journal_catalog_flag = FALSE;
+        g_cond_signal(&(priv->autosave_cond));
+    }
+    g_mutex_unlock(&(priv->autosave_mutex));
+    return TRUE;
+}
+
+static void rclib_db_journal_catalog_cb(RCLibDb *db,
+    RCLibDbCatalogIter *iter)
+{
+    if(db->priv==NULL) return;
+    db->priv->journal_catalog_flag = TRUE;
+}
+
+static void rclib_db_journal_catalog_reordered_cb(RCLibDb *db,
+    gint *new_order)
+{
+    if(db->priv==NULL) return;
+    db->priv->journal_catalog_flag = TRUE;
+}
+
+static void rclib_db_journal_playlist_cb(RCLibDb *db,
+    RCLibDbPlaylistIter *iter)
+{
+    RCLibDbCatalogIter *catalog_iter = NULL;
+    if(db->priv==NULL || db->priv->journal_playlist_table==NULL) return;
+    rclib_db_playlist_data_iter_get(iter,
+        RCLIB_DB_PLAYLIST_DATA_TYPE_CATALOG, &catalog_iter,
+        RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
+    if(catalog_iter!=NULL)
+        g_hash_table_add(db->priv->journal_playlist_table, catalog_iter);
+    else
+        db->priv->journal_catalog_flag = TRUE;
+}
+
+static void rclib_db_journal_playlist_reordered_cb(RCLibDb *db,
+    RCLibDbCatalogIter *iter, gint *new_order)
+{
+    if(db->priv==NULL || db->priv->journal_playlist_table==NULL) return;
+    if(iter!=NULL)
+        g_hash_table_add(db->priv->journal_playlist_table, iter);
+    else
+        db->priv->journal_catalog_flag = TRUE;
+}
+
+static void rclib_db_journal_library_cb(RCLibDb *db, const gchar *uri)
+{
+    if(db->priv==NULL || db->priv->journal_library_table==NULL ||
+        uri==NULL)
+        return;
+    g_hash_table_add(db->priv->journal_library_table, g_strdup(uri));
+}
+
+static void rclib_db_finalize(GObject *object)
+{
     RCLibDbImportData *import_data;
     RCLibDbRefreshData *refresh_data;
     gchar *autosave_file;
+    gchar *journal_file;
+    guint i;
     RCLibDbPrivate *priv = RCLIB_DB(object)->priv;
     RCLIB_DB(object)->priv = NULL;
+    g_mutex_lock(&(priv->import_worker_mutex));
     priv->work_flag = FALSE;
+    g_cond_broadcast(&(priv->import_worker_cond));
+    g_mutex_unlock(&(priv->import_worker_mutex));
+    _rclib_db_instance_finalize_gain(priv);
+    _rclib_db_instance_finalize_watch(priv);
+    _rclib_db_instance_finalize_index(priv);
+    _rclib_db_instance_finalize_facet(priv);
     g_mutex_lock(&(priv->autosave_mutex));
     g_cond_signal(&(priv->autosave_cond));
     g_mutex_unlock(&(priv->autosave_mutex));
@@ -1400,14 +2712,30 @@ static void rclib_db_finalize(GObject *object)
     g_thread_join(priv->autosave_thread);
     g_mutex_clear(&(priv->autosave_mutex));
     g_cond_clear(&(priv->autosave_cond));
+    if(!priv->dirty_flag && priv->filename!=NULL)
+    {
+        /* The database is saved, the journal is useless now. */
+        journal_file = g_strdup_printf("%s.journal", priv->filename);
+        g_remove(journal_file);
+        g_free(journal_file);
+    }
     rclib_db_import_cancel();
     rclib_db_refresh_cancel();
-    import_data = g_new0(RCLibDbImportData, 1);
+    for(i=0;i<priv->import_thread_num;i++)
+    {
+        import_data = g_new0(RCLibDbImportData, 1);
+        g_async_queue_push(priv->import_queue, import_data);
+    }
     refresh_data = g_new0(RCLibDbRefreshData, 1);
-    g_async_queue_push(priv->import_queue, import_data);
     g_async_queue_push(priv->refresh_queue, refresh_data);
-    g_thread_join(priv->import_thread);
+    for(i=0;i<priv->import_thread_num;i++)
+        g_thread_join(priv->import_threads[i]);
+    g_free(priv->import_threads);
     g_thread_join(priv->refresh_thread);
+    g_hash_table_destroy(priv->import_order_table);
+    g_mutex_clear(&(priv->import_worker_mutex));
+    g_cond_clear(&(priv->import_worker_cond));
+    g_mutex_clear(&(priv->import_order_mutex));
     autosave_file = g_strdup_printf("%s.autosave", priv->filename);
     g_remove(autosave_file);
     g_free(autosave_file);
@@ -1415,6 +2743,14 @@ static void rclib_db_finalize(GObject *object)
     g_async_queue_unref(priv->import_queue);
     _rclib_db_instance_finalize_playlist(priv);
     _rclib_db_instance_finalize_library(priv);
+    if(priv->autosave_playlist_table!=NULL)
+        g_hash_table_destroy(priv->autosave_playlist_table);
+    if(priv->autosave_library_table!=NULL)
+        g_hash_table_destroy(priv->autosave_library_table);
+    g_hash_table_destroy(priv->journal_playlist_table);
+    g_hash_table_destroy(priv->journal_library_table);
+    g_array_free(priv->journal_catalog_array, TRUE);
+    g_mutex_clear(&(priv->journal_mutex));
     priv->import_queue = NULL;
     priv->refresh_queue = NULL;
     G_OBJECT_CLASS(rclib_db_parent_class)->finalize(object);
@@ -1439,6 +2775,17 @@ static void rclib_db_class_init(RCLibDbClass *klass)
     object_class->finalize = rclib_db_finalize;
     object_class->constructor = rclib_db_constructor;
     g_type_class_add_private(klass, sizeof(RCLibDbPrivate));
+    klass->catalog_added = rclib_db_journal_catalog_cb;
+    klass->catalog_changed = rclib_db_journal_catalog_cb;
+    klass->catalog_delete = rclib_db_journal_catalog_cb;
+    klass->catalog_reordered = rclib_db_journal_catalog_reordered_cb;
+    klass->playlist_added = rclib_db_journal_playlist_cb;
+    klass->playlist_changed = rclib_db_journal_playlist_cb;
+    klass->playlist_delete = rclib_db_journal_playlist_cb;
+    klass->playlist_reordered = rclib_db_journal_playlist_reordered_cb;
+    klass->library_added = rclib_db_journal_library_cb;
+    klass->library_changed = rclib_db_journal_library_cb;
+    klass->library_deleted = rclib_db_journal_library_cb;
     
     /**
      * RCLibDb::catalog-added:
@@ -1614,10 +2961,28 @@ static void rclib_db_class_init(RCLibDbClass *klass)
         RCLIB_TYPE_DB, G_SIGNAL_RUN_FIRST, G_STRUCT_OFFSET(RCLibDbClass,
         library_deleted), NULL, NULL, g_cclosure_marshal_VOID__STRING,
         G_TYPE_NONE, 1, G_TYPE_STRING, NULL);
+
+    /**
+     * RCLibDb::refresh-summary:
+     * @db: the #RCLibDb that received the signal
+     * @unchanged: the number of the items which are skipped because their
+     *     files are not modified
+     * @changed: the number of the items whose metadata is read again
+     * @missing: the number of the items whose files are missing
+     *
+     * The ::refresh-summary signal is emitted when all jobs in the refresh
+     * queue have been processed. This signal is emitted in main thread.
+     */
+    db_signals[SIGNAL_REFRESH_SUMMARY] = g_signal_new("refresh-summary",
+        RCLIB_TYPE_DB, G_SIGNAL_RUN_FIRST, G_STRUCT_OFFSET(RCLibDbClass,
+        refresh_summary), NULL, NULL, rclib_marshal_VOID__UINT_UINT_UINT,
+        G_TYPE_NONE, 3, G_TYPE_UINT, G_TYPE_UINT, G_TYPE_UINT, NULL);
 }
 
 static void rclib_db_instance_init(RCLibDb *db)
 {
+    gchar *thread_name;
+    guint i;
     RCLibDbPrivate *priv = G_TYPE_INSTANCE_GET_PRIVATE(db, RCLIB_TYPE_DB,
         RCLibDbPrivate);
     db->priv = priv;
@@ -1628,10 +2993,37 @@ static void rclib_db_instance_init(RCLibDb *db)
         rclib_db_import_data_free);
     priv->refresh_queue = g_async_queue_new_full((GDestroyNotify)
         rclib_db_refresh_data_free);
+    _rclib_db_instance_init_watch(db, priv);
+    _rclib_db_instance_init_index(db, priv);
+    _rclib_db_instance_init_facet(db, priv);
+    _rclib_db_instance_init_gain(db, priv);
     g_mutex_init(&(priv->autosave_mutex));
     g_cond_init(&(priv->autosave_cond));
-    priv->import_thread = g_thread_new("RC2-Import-Thread",
-        rclib_db_playlist_import_thread_cb, db);
+    g_mutex_init(&(priv->journal_mutex));
+
+    /* GArray<guint>, the catalogs written to the journal last time. */
+    priv->journal_catalog_array = g_array_new(FALSE, FALSE, sizeof(guint));
+
+    /* GHashTable<RCLibDbCatalogIter *>, the changed playlists. */
+    priv->journal_playlist_table = g_hash_table_new(g_direct_hash,
+        g_direct_equal);
+    priv->journal_library_table = g_hash_table_new_full(g_str_hash,
+        g_str_equal, g_free, NULL);
+    g_mutex_init(&(priv->import_worker_mutex));
+    g_cond_init(&(priv->import_worker_cond));
+    g_mutex_init(&(priv->import_order_mutex));
+    priv->import_order_table = g_hash_table_new(g_direct_hash,
+        g_direct_equal);
+    priv->import_worker_limit = 0;
+    priv->import_thread_num = rclib_util_get_processor_count();
+    priv->import_threads = g_new0(GThread *, priv->import_thread_num);
+    for(i=0;i<priv->import_thread_num;i++)
+    {
+        thread_name = g_strdup_printf("RC2-Import-Thread-%u", i);
+        priv->import_threads[i] = g_thread_new(thread_name,
+            rclib_db_playlist_import_thread_cb, db);
+        g_free(thread_name);
+    }
     priv->refresh_thread = g_thread_new("RC2-Refresh-Thread",
         rclib_db_playlist_refresh_thread_cb, db);
     priv->autosave_thread = g_thread_new("RC2-Autosave-Thread",
@@ -1792,6 +3184,7 @@ GType rclib_db_query_get_type(void)
 gboolean rclib_db_init(const gchar *file)
 {
     RCLibDbPrivate *priv;
+    gchar *journal_file, *autosave_file;
     g_message("Loading music library database....");
     if(db_instance!=NULL)
     {
@@ -1801,17 +3194,33 @@ gboolean rclib_db_init(const gchar *file)
     db_instance = g_object_new(RCLIB_TYPE_DB, NULL);
     priv = RCLIB_DB(db_instance)->priv;
     if(priv->catalog==NULL || priv->import_queue==NULL ||
-        priv->import_thread==NULL)
+        priv->import_threads==NULL)
     {
         g_object_unref(db_instance);
         db_instance = NULL;
         g_warning("Failed to load database!");
         return FALSE;
     }
-    rclib_db_load_library_db(priv->catalog, priv->catalog_iter_table,
-        priv->playlist_iter_table, priv->library_table, file,
-        &(priv->dirty_flag));
+    if(!rclib_db_load_binary_db(priv, file, &(priv->dirty_flag)))
+    {
+        /* Fallback to the old XML database format. */
+        rclib_db_load_library_db(priv->catalog, priv->catalog_iter_table,
+            priv->playlist_iter_table, priv->library_table, file,
+            &(priv->dirty_flag));
+    }
     priv->filename = g_strdup(file);
+
+    /* Keep the journal left by the last session for recovery. */
+    journal_file = g_strdup_printf("%s.journal", file);
+    autosave_file = g_strdup_printf("%s.autosave", file);
+    if(g_file_test(journal_file, G_FILE_TEST_IS_REGULAR))
+        g_rename(journal_file, autosave_file);
+    g_free(journal_file);
+    g_free(autosave_file);
+    rclib_db_journal_catalog_reset(priv);
+    g_hash_table_remove_all(priv->journal_playlist_table);
+    g_hash_table_remove_all(priv->journal_library_table);
+    priv->journal_catalog_flag = FALSE;
     g_message("Database loaded.");
     rclib_db_library_query_result_query_start(RCLIB_DB_LIBRARY_QUERY_RESULT(
         priv->library_query_base), TRUE);
@@ -1832,8 +3241,8 @@ void rclib_db_exit()
         priv = RCLIB_DB(db_instance)->priv;
         if(priv!=NULL)
         {
-            rclib_db_save_library_db(priv->catalog, priv->library_table,
-                priv->filename, &(priv->dirty_flag));
+            rclib_db_save_binary_db(priv, priv->filename,
+                &(priv->dirty_flag));
         }
         g_object_unref(db_instance);
     }
@@ -1955,6 +3364,50 @@ gint rclib_db_import_queue_get_length()
     return g_async_queue_length(priv->refresh_queue);
 }
 
+/**
+ * rclib_db_import_set_worker_limit:
+ * @limit: the maximum number of the import jobs which run at the same time,
+ *     0 to use all online processors
+ *
+ * Set the maximum number of import jobs (which read the metadata of the
+ * music) running concurrently. A small number is preferred if the music
+ * files are stored on a spinning disk.
+ */
+
+void rclib_db_import_set_worker_limit(guint limit)
+{
+    RCLibDbPrivate *priv;
+    GObject *instance;
+    instance = rclib_db_get_instance();
+    if(instance==NULL) return;
+    priv = RCLIB_DB(instance)->priv;
+    if(priv==NULL) return;
+    g_mutex_lock(&(priv->import_worker_mutex));
+    priv->import_worker_limit = limit;
+    g_cond_broadcast(&(priv->import_worker_cond));
+    g_mutex_unlock(&(priv->import_worker_mutex));
+}
+
+/**
+ * rclib_db_import_get_worker_limit:
+ *
+ * Get the maximum number of import jobs running concurrently.
+ *
+ * Returns: The maximum number of import jobs, 0 if all online processors
+ *     are used.
+ */
+
+guint rclib_db_import_get_worker_limit()
+{
+    RCLibDbPrivate *priv;
+    GObject *instance;
+    instance = rclib_db_get_instance();
+    if(instance==NULL) return 0;
+    priv = RCLIB_DB(instance)->priv;
+    if(priv==NULL) return 0;
+    return priv->import_worker_limit;
+}
+
 /**
  * rclib_db_refresh_queue_get_length:
  *
@@ -1990,14 +3443,63 @@ gboolean rclib_db_sync()
     if(priv==NULL || priv->catalog==NULL || priv->filename==NULL)
         return FALSE;
     if(!priv->dirty_flag) return TRUE;
+    return rclib_db_save_binary_db(priv, priv->filename,
+        &(priv->dirty_flag));
+}
+
+/**
+ * rclib_db_import_xml:
+ * @file: the XML database file to import
+ *
+ * Import the playlists and the library from a (zlib compressed) XML
+ * database file, which is written by rclib_db_export_xml() or the older
+ * versions of the player. The imported playlists are appended to the
+ * catalog. Must be called in main thread.
+ *
+ * Returns: Whether the operation succeeded.
+ */
+
+gboolean rclib_db_import_xml(const gchar *file)
+{
+    RCLibDbPrivate *priv;
+    gboolean flag;
+    if(db_instance==NULL || file==NULL) return FALSE;
+    priv = RCLIB_DB(db_instance)->priv;
+    if(priv==NULL || priv->catalog==NULL) return FALSE;
+    flag = rclib_db_load_library_db(priv->catalog, priv->catalog_iter_table,
+        priv->playlist_iter_table, priv->library_table, file, NULL);
+    if(flag) priv->dirty_flag = TRUE;
+    _rclib_db_library_index_invalidate(priv);
+    _rclib_db_library_facet_invalidate(priv);
+    return flag;
+}
+
+/**
+ * rclib_db_export_xml:
+ * @file: the XML database file to write
+ *
+ * Export the playlists and the library to a (zlib compressed) XML
+ * database file. Must be called in main thread.
+ *
+ * Returns: Whether the operation succeeded.
+ */
+
+gboolean rclib_db_export_xml(const gchar *file)
+{
+    RCLibDbPrivate *priv;
+    if(db_instance==NULL || file==NULL) return FALSE;
+    priv = RCLIB_DB(db_instance)->priv;
+    if(priv==NULL || priv->catalog==NULL) return FALSE;
     return rclib_db_save_library_db(priv->catalog, priv->library_table,
-        priv->filename, &(priv->dirty_flag));
+        file, NULL);
 }
 
 /**
  * rclib_db_load_autosaved:
  *
- * Load all playlist data from auto-saved playlist.
+ * Load all playlist data from auto-saved playlist. The changes journaled
+ * by the last session which did not exit normally are applied to the
+ * database, and then the database is saved to disk.
  */
 
 gboolean rclib_db_load_autosaved()
@@ -2010,15 +3512,29 @@ gboolean rclib_db_load_autosaved()
     priv = RCLIB_DB(db_instance)->priv;
     if(priv==NULL || priv->catalog==NULL || priv->filename==NULL)
         return FALSE;
-    while(rclib_db_catalog_get_length()>0)
+    filename = g_strdup_printf("%s.autosave", priv->filename);
+    flag = rclib_db_journal_replay(priv, filename);
+    if(flag)
     {
-        iter = rclib_db_catalog_get_begin_iter();
-        rclib_db_catalog_delete(iter);
+        rclib_db_save_binary_db(priv, priv->filename, &(priv->dirty_flag));
+        g_hash_table_remove_all(priv->journal_playlist_table);
+        g_hash_table_remove_all(priv->journal_library_table);
+        priv->journal_catalog_flag = FALSE;
     }
-    filename = g_strdup_printf("%s.autosave", priv->filename);
-    flag = rclib_db_load_library_db(priv->catalog, priv->catalog_iter_table,
-        priv->playlist_iter_table, priv->library_table, filename,
-        &(priv->dirty_flag));
+    else
+    {
+        /* Fallback to the auto-saved file written by older versions. */
+        while(rclib_db_catalog_get_length()>0)
+        {
+            iter = rclib_db_catalog_get_begin_iter();
+            rclib_db_catalog_delete(iter);
+        }
+        flag = rclib_db_load_library_db(priv->catalog,
+            priv->catalog_iter_table, priv->playlist_iter_table,
+            priv->library_table, filename, &(priv->dirty_flag));
+    }
+    _rclib_db_library_index_invalidate(priv);
+    _rclib_db_library_facet_invalidate(priv);
     g_free(filename);
     return flag;
 }
@@ -112,6 +112,22 @@ typedef enum {
     RCLIB_DB_LIBRARY_TYPE_CUE = 2
 }RCLibDbLibraryType;
 
+/**
+ * RCLibDbGainFlags:
+ * @RCLIB_DB_GAIN_FLAG_TRACK: the track gain and peak are valid
+ * @RCLIB_DB_GAIN_FLAG_ALBUM: the album gain and peak are valid
+ * @RCLIB_DB_GAIN_FLAG_ANALYZED: the track gain is measured by the
+ *     loudness analysis instead of read from the tags
+ *
+ * The flags for the ReplayGain values of a library item.
+ */
+
+typedef enum {
+    RCLIB_DB_GAIN_FLAG_TRACK = 1 << 0,
+    RCLIB_DB_GAIN_FLAG_ALBUM = 1 << 1,
+    RCLIB_DB_GAIN_FLAG_ANALYZED = 1 << 2
+}RCLibDbGainFlags;
+
 /**
  * RCLibDbCatalogDataType:
  * @RCLIB_DB_CATALOG_DATA_TYPE_NONE: none type, not used by data
@@ -157,6 +173,12 @@ typedef enum {
  *     path (string)
  * @RCLIB_DB_PLAYLIST_DATA_TYPE_ALBUMFILE: the album image file path (string)
  * @RCLIB_DB_PLAYLIST_DATA_TYPE_GENRE: the genre (string)
+ * @RCLIB_DB_PLAYLIST_DATA_TYPE_MTIME: the modification time of the file
+ *     when the metadata was read (#gint64)
+ * @RCLIB_DB_PLAYLIST_DATA_TYPE_FILESIZE: the size of the file when the
+ *     metadata was read (#gint64)
+ * @RCLIB_DB_PLAYLIST_DATA_TYPE_INODE: the inode number of the file when the
+ *     metadata was read (#guint64)
  *
  * The enum type for set/get the data in the #RCLibDbPlaylistData
  */
@@ -178,7 +200,10 @@ typedef enum {
     RCLIB_DB_PLAYLIST_DATA_TYPE_LYRICFILE = 13,
     RCLIB_DB_PLAYLIST_DATA_TYPE_LYRICSECFILE = 14,
     RCLIB_DB_PLAYLIST_DATA_TYPE_ALBUMFILE = 15,
-    RCLIB_DB_PLAYLIST_DATA_TYPE_GENRE = 16
+    RCLIB_DB_PLAYLIST_DATA_TYPE_GENRE = 16,
+    RCLIB_DB_PLAYLIST_DATA_TYPE_MTIME = 17,
+    RCLIB_DB_PLAYLIST_DATA_TYPE_FILESIZE = 18,
+    RCLIB_DB_PLAYLIST_DATA_TYPE_INODE = 19
 }RCLibDbPlaylistDataType;
 
 /**
@@ -200,6 +225,18 @@ typedef enum {
  *     path (string)
  * @RCLIB_DB_LIBRARY_DATA_TYPE_ALBUMFILE: the album image file path (string)
  * @RCLIB_DB_LIBRARY_DATA_TYPE_GENRE: the genre (string)
+ * @RCLIB_DB_LIBRARY_DATA_TYPE_MTIME: the modification time of the file
+ *     when the metadata was read (#gint64)
+ * @RCLIB_DB_LIBRARY_DATA_TYPE_FILESIZE: the size of the file when the
+ *     metadata was read (#gint64)
+ * @RCLIB_DB_LIBRARY_DATA_TYPE_INODE: the inode number of the file when the
+ *     metadata was read (#guint64)
+ * @RCLIB_DB_LIBRARY_DATA_TYPE_TRACK_GAIN: the track gain in dB (#gdouble)
+ * @RCLIB_DB_LIBRARY_DATA_TYPE_TRACK_PEAK: the track peak (#gdouble)
+ * @RCLIB_DB_LIBRARY_DATA_TYPE_ALBUM_GAIN: the album gain in dB (#gdouble)
+ * @RCLIB_DB_LIBRARY_DATA_TYPE_ALBUM_PEAK: the album peak (#gdouble)
+ * @RCLIB_DB_LIBRARY_DATA_TYPE_GAIN_FLAGS: which gain values are valid
+ *     (#RCLibDbGainFlags)
  * 
  * The enum type for set/get the data in the #RCLibDbPlaylistData
  */
@@ -219,7 +256,15 @@ typedef enum {
     RCLIB_DB_LIBRARY_DATA_TYPE_LYRICFILE = 11,
     RCLIB_DB_LIBRARY_DATA_TYPE_LYRICSECFILE = 12,
     RCLIB_DB_LIBRARY_DATA_TYPE_ALBUMFILE = 13,
-    RCLIB_DB_LIBRARY_DATA_TYPE_GENRE = 14
+    RCLIB_DB_LIBRARY_DATA_TYPE_GENRE = 14,
+    RCLIB_DB_LIBRARY_DATA_TYPE_MTIME = 15,
+    RCLIB_DB_LIBRARY_DATA_TYPE_FILESIZE = 16,
+    RCLIB_DB_LIBRARY_DATA_TYPE_INODE = 17,
+    RCLIB_DB_LIBRARY_DATA_TYPE_TRACK_GAIN = 18,
+    RCLIB_DB_LIBRARY_DATA_TYPE_TRACK_PEAK = 19,
+    RCLIB_DB_LIBRARY_DATA_TYPE_ALBUM_GAIN = 20,
+    RCLIB_DB_LIBRARY_DATA_TYPE_ALBUM_PEAK = 21,
+    RCLIB_DB_LIBRARY_DATA_TYPE_GAIN_FLAGS = 22
 }RCLibDbLibraryDataType;
 
 /**
@@ -281,7 +326,11 @@ typedef enum {
  * @RCLIB_DB_QUERY_CONDITION_TYPE_LAST: not used, just a last enum type 
  * 
  * The enum type for query the properties of the items in the library
- * by the given condition type.
+ * by the given condition type. The conditions in a query are evaluated
+ * from left to right without precedence, each condition is joined to
+ * the result of the conditions before it with AND, or with OR if an
+ * %RCLIB_DB_QUERY_CONDITION_TYPE_OR condition is in front of it, so
+ * "A OR B C" means "(A OR B) AND C". Use a sub-query to group them.
  */
 
 typedef enum {
@@ -322,6 +371,89 @@ typedef struct _RCLibDbLibraryQueryResultPropIter RCLibDbLibraryQueryResultPropI
 
 typedef struct _RCLibDbQuery RCLibDbQuery;
 
+typedef struct _RCLibDbPlaylistDataView RCLibDbPlaylistDataView;
+typedef struct _RCLibDbLibraryDataView RCLibDbLibraryDataView;
+
+/**
+ * RCLibDbPlaylistDataView:
+ * @type: the type of the playlist item
+ * @uri: the URI of the music
+ * @title: the title of the music
+ * @artist: the artist of the music
+ * @album: the album of the music
+ * @ftype: the file type of the music
+ * @genre: the genre of the music
+ * @length: the length of the music
+ * @tracknum: the track number of the music
+ * @year: the year of the music
+ * @rating: the rating of the music
+ * @lyricfile: the lyric file path of the music
+ * @lyricsecfile: the secondary lyric file path of the music
+ * @albumfile: the album image file path of the music
+ *
+ * A read-only view of a #RCLibDbPlaylistData, filled by
+ * rclib_db_playlist_data_view_begin(). The strings are borrowed from the
+ * playlist item, and they are only valid until
+ * rclib_db_playlist_data_view_end() is called.
+ */
+
+struct _RCLibDbPlaylistDataView {
+    RCLibDbPlaylistType type;
+    const gchar *uri;
+    const gchar *title;
+    const gchar *artist;
+    const gchar *album;
+    const gchar *ftype;
+    const gchar *genre;
+    gint64 length;
+    gint tracknum;
+    gint year;
+    gfloat rating;
+    const gchar *lyricfile;
+    const gchar *lyricsecfile;
+    const gchar *albumfile;
+};
+
+/**
+ * RCLibDbLibraryDataView:
+ * @type: the type of the library item
+ * @uri: the URI of the music
+ * @title: the title of the music
+ * @artist: the artist of the music
+ * @album: the album of the music
+ * @ftype: the file type of the music
+ * @genre: the genre of the music
+ * @length: the length of the music
+ * @tracknum: the track number of the music
+ * @year: the year of the music
+ * @rating: the rating of the music
+ * @lyricfile: the lyric file path of the music
+ * @lyricsecfile: the secondary lyric file path of the music
+ * @albumfile: the album image file path of the music
+ *
+ * A read-only view of a #RCLibDbLibraryData, filled by
+ * rclib_db_library_data_view_begin(). The strings are borrowed from the
+ * library item, and they are only valid until
+ * rclib_db_library_data_view_end() is called.
+ */
+
+struct _RCLibDbLibraryDataView {
+    RCLibDbLibraryType type;
+    const gchar *uri;
+    const gchar *title;
+    const gchar *artist;
+    const gchar *album;
+    const gchar *ftype;
+    const gchar *genre;
+    gint64 length;
+    gint tracknum;
+    gint year;
+    gfloat rating;
+    const gchar *lyricfile;
+    const gchar *lyricsecfile;
+    const gchar *albumfile;
+};
+
 /**
  * RCLibDb:
  *
@@ -358,6 +490,8 @@ struct _RCLibDbClass {
     void (*library_added)(RCLibDb *db, const gchar *uri);
     void (*library_changed)(RCLibDb *db, const gchar *uri);
     void (*library_deleted)(RCLibDb *db, const gchar *uri);
+    void (*refresh_summary)(RCLibDb *db, guint unchanged, guint changed,
+        guint missing);
 };
 
 /**
@@ -399,6 +533,7 @@ struct _RCLibDbLibraryQueryResultClass {
         guint prop_type, const gchar *prop_string);
     void (*prop_reordered)(RCLibDbLibraryQueryResult *qr,
         guint prop_type, gint *new_order);
+    void (*query_result_reset)(RCLibDbLibraryQueryResult *qr);
 };
 
 /*< private >*/
@@ -422,8 +557,14 @@ void rclib_db_signal_disconnect(gulong handler_id);
 void rclib_db_import_cancel();
 void rclib_db_refresh_cancel();
 gint rclib_db_import_queue_get_length();
+void rclib_db_import_set_worker_limit(guint limit);
+guint rclib_db_import_get_worker_limit();
 gint rclib_db_refresh_queue_get_length();
 gboolean rclib_db_sync();
+gboolean rclib_db_import_xml(const gchar *file);
+gboolean rclib_db_export_xml(const gchar *file);
+void rclib_db_string_pool_get_stats(guint *count, guint64 *refs,
+    guint64 *size, guint64 *saved);
 gboolean rclib_db_load_autosaved();
 gboolean rclib_db_autosaved_exist();
 void rclib_db_autosaved_remove();
@@ -449,6 +590,12 @@ void rclib_db_playlist_data_set(RCLibDbPlaylistData *data,
     RCLibDbPlaylistDataType type1, ...);
 void rclib_db_playlist_data_get(RCLibDbPlaylistData *data,
     RCLibDbPlaylistDataType type1, ...);
+const gchar *rclib_db_playlist_data_get_interned(RCLibDbPlaylistData *data,
+    RCLibDbPlaylistDataType type);
+void rclib_db_playlist_data_view_begin(RCLibDbPlaylistData *data,
+    RCLibDbPlaylistDataView *view);
+void rclib_db_playlist_data_view_end(RCLibDbPlaylistData *data,
+    RCLibDbPlaylistDataView *view);
 void rclib_db_playlist_data_iter_set(RCLibDbPlaylistIter *iter,
     RCLibDbPlaylistDataType type1, ...);
 void rclib_db_playlist_data_iter_get(RCLibDbPlaylistIter *iter,
@@ -529,6 +676,7 @@ gboolean rclib_db_playlist_export_m3u_file(RCLibDbCatalogIter *iter,
     const gchar *sfilename);
 gboolean rclib_db_playlist_export_all_m3u_files(const gchar *dir);
 void rclib_db_playlist_refresh(RCLibDbCatalogIter *iter);
+void rclib_db_playlist_refresh_incremental(RCLibDbCatalogIter *iter);
 gboolean rclib_db_load_legacy();
 gboolean rclib_db_playlist_data_query(RCLibDbPlaylistData *playlist_data,
     RCLibDbQuery *query, GCancellable *cancellable);
@@ -547,6 +695,9 @@ RCLibDbPlaylistIter *rclib_db_playlist_iter_get_random_iter(
 void rclib_db_catalog_name_sort(gboolean direction);
 void rclib_db_playlist_item_sort(RCLibDbCatalogIter *catalog_iter,
     RCLibDbPlaylistDataType column, gboolean direction);
+void rclib_db_playlist_item_sort_multi(RCLibDbCatalogIter *catalog_iter,
+    const RCLibDbPlaylistDataType *columns, guint n_columns,
+    gboolean direction);
 
 /* Library Interface */
 RCLibDbLibraryData *rclib_db_library_data_new();
@@ -557,12 +708,30 @@ void rclib_db_library_data_set(RCLibDbLibraryData *data,
     RCLibDbLibraryDataType type1, ...);
 void rclib_db_library_data_get(RCLibDbLibraryData *data,
     RCLibDbLibraryDataType type1, ...);
+const gchar *rclib_db_library_data_get_interned(RCLibDbLibraryData *data,
+    RCLibDbLibraryDataType type);
+void rclib_db_library_data_view_begin(RCLibDbLibraryData *data,
+    RCLibDbLibraryDataView *view);
+void rclib_db_library_data_view_end(RCLibDbLibraryData *data,
+    RCLibDbLibraryDataView *view);
 GHashTable *rclib_db_get_library_table();
 gboolean rclib_db_library_has_uri(const gchar *uri);
 gboolean rclib_db_library_exist(RCLibDbLibraryData *library_data);
 void rclib_db_library_add_music(const gchar *uri);
 void rclib_db_library_add_music_and_play(const gchar *uri);
 void rclib_db_library_delete(const gchar *uri);
+void rclib_db_library_refresh();
+void rclib_db_library_refresh_incremental();
+gboolean rclib_db_library_watch_add_directory(const gchar *dir);
+void rclib_db_library_watch_remove_directory(const gchar *dir);
+gchar **rclib_db_library_watch_get_directories();
+void rclib_db_library_watch_set_limit(guint limit);
+guint rclib_db_library_watch_get_limit();
+void rclib_db_library_watch_set_scan_interval(guint interval);
+guint rclib_db_library_watch_get_scan_interval();
+gboolean rclib_db_library_watch_is_polling();
+void rclib_db_library_set_gain_analysis(gboolean enabled);
+gboolean rclib_db_library_get_gain_analysis();
 RCLibDbLibraryData *rclib_db_library_get_data(const gchar *uri);
 void rclib_db_library_data_uri_set(const gchar *uri,
     RCLibDbLibraryDataType type1, ...);
@@ -630,6 +799,10 @@ const RCLibDbQuery *rclib_db_library_query_result_get_query(
 void rclib_db_library_query_result_sort(
     RCLibDbLibraryQueryResult *query_result, RCLibDbLibraryDataType column,
     gboolean direction);
+void rclib_db_library_query_result_sort_multi(
+    RCLibDbLibraryQueryResult *query_result,
+    const RCLibDbLibraryDataType *columns, guint n_columns,
+    gboolean direction);
 gboolean rclib_db_library_query_result_prop_get_data(
     RCLibDbLibraryQueryResult *query_result, RCLibDbQueryDataType prop_type,
     RCLibDbLibraryQueryResultPropIter *iter, gchar **prop_name,
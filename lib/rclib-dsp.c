@@ -0,0 +1,1054 @@
+/*
+ * RhythmCat Library DSP Element Module
+ * The audio filter element which processes the sound effects.
+ *
+ * rclib-dsp.c
+ * This file is part of RhythmCat Library (LibRhythmCat)
+ *
+ * Copyright (C) 2012 - SuperCat, license: GPL v3
+ *
+ * RhythmCat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RhythmCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RhythmCat; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include "rclib-dsp.h"
+#include "rclib-common.h"
+#include <string.h>
+#include <math.h>
+
+/**
+ * SECTION: rclib-dsp
+ * @Short_description: The audio DSP element
+ * @Title: RCLibDsp
+ * @Include: rclib-dsp.h
+ *
+ * The #RCLibDsp is a GStreamer audio filter element which processes the
+ * sound effects of the player in 32-bit float samples. The effects are
+ * stages in the element, which are processed in the order they are
+ * added, so only one format conversion is needed before the element and
+ * after it, however many effects are used.
+ *
+ * The buffers are processed in small blocks which stay in the CPU cache,
+ * every stage runs over a block before the next block is processed. The
+ * stages without effect (like the equalizer with all bands at 0dB) are
+ * skipped, and the element works in passthrough mode if no stage needs
+ * to process the samples. The balance and karaoke stages only work on
+ * stereo streams.
+ *
+ * The parameters of the stages are the properties of the element, which
+ * can be set at any time, even if the stage is not added. Setting them
+ * never waits for the processing of a buffer, the streaming thread takes
+ * a copy of the parameters before it processes each buffer.
+ */
+
+#define DSP_STAGE_NUM 5
+#define DSP_EQ_BANDS 10
+#define DSP_EQ_Q 1.41
+#define DSP_BLOCK_FRAMES 256
+#define DSP_ECHO_MAX_DELAY GST_SECOND
+#define DSP_DENORMAL_LIMIT 1e-20
+
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+    #define DSP_USE_SSE2
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+    #include <arm_neon.h>
+    #define DSP_USE_NEON
+#endif
+
+#if GST_VERSION_MAJOR==1
+    #define DSP_CAPS "audio/x-raw, format=(string)" GST_AUDIO_NE(F32) \
+        ", rate=(int)[1, MAX], channels=(int)[1, MAX], " \
+        "layout=(string)interleaved"
+#else
+    #define DSP_CAPS "audio/x-raw-float, width=(int)32, " \
+        "endianness=(int)BYTE_ORDER, rate=(int)[1, MAX], " \
+        "channels=(int)[1, MAX]"
+#endif
+
+typedef struct RCLibDspBiquad
+{
+    gdouble b0;
+    gdouble b1;
+    gdouble b2;
+    gdouble a1;
+    gdouble a2;
+}RCLibDspBiquad;
+
+/*
+ * The parameters used by the kernels. They are changed under the object
+ * lock, and the streaming thread copies them before processing a buffer,
+ * so setting a property never waits for the processing.
+ */
+
+typedef struct RCLibDspParams
+{
+    RCLibDspStage stages[DSP_STAGE_NUM];
+    guint stage_num;
+    gint channels;
+    gdouble gain;
+    gboolean eq_active[DSP_EQ_BANDS];
+    RCLibDspBiquad eq_coeffs[DSP_EQ_BANDS];
+    gfloat panorama;
+    gfloat echo_feedback;
+    gfloat echo_intensity;
+    guint echo_delay_frames;
+    gfloat kara_level;
+    gfloat kara_mono_level;
+    gfloat kara_a;
+    gfloat kara_b;
+    gfloat kara_c;
+}RCLibDspParams;
+
+struct _RCLibDspPrivate
+{
+    RCLibDspParams params;
+    guint reset_stages;
+    guint reset_bands;
+    gint rate;
+    gdouble bands[DSP_EQ_BANDS];
+    guint64 echo_delay;
+    gfloat kara_band;
+    gfloat kara_width;
+    guint echo_frames;
+    
+    /* The filter states, only used in the streaming thread. */
+    gdouble *eq_state;
+    gfloat *echo_buffer;
+    guint echo_index;
+    gfloat kara_y1;
+    gfloat kara_y2;
+};
+
+enum
+{
+    PROP_O,
+    PROP_GAIN,
+    PROP_PANORAMA,
+    PROP_ECHO_DELAY,
+    PROP_ECHO_FEEDBACK,
+    PROP_ECHO_INTENSITY,
+    PROP_KARAOKE_LEVEL,
+    PROP_KARAOKE_MONO_LEVEL,
+    PROP_KARAOKE_FILTER_BAND,
+    PROP_KARAOKE_FILTER_WIDTH,
+    PROP_BAND0
+};
+
+/* The center frequencies of the bands, the same as equalizer-10bands. */
+static const gdouble dsp_eq_freqs[DSP_EQ_BANDS] = {29.0, 59.0, 119.0,
+    237.0, 474.0, 947.0, 1889.0, 3770.0, 7523.0, 15011.0};
+
+static gpointer rclib_dsp_parent_class = NULL;
+
+static inline gdouble rclib_dsp_flush_denormal(gdouble value)
+{
+    if(value<DSP_DENORMAL_LIMIT && value>-DSP_DENORMAL_LIMIT)
+        return 0.0;
+    return value;
+}
+
+/*
+ * Calculate the coefficients of the peaking filter of the band (from
+ * the Audio EQ Cookbook by Robert Bristow-Johnson), the band is disabled
+ * if its gain is 0dB, or its frequency is over the Nyquist frequency.
+ */
+
+static void rclib_dsp_eq_update(RCLibDspPrivate *priv, guint band)
+{
+    RCLibDspParams *params = &(priv->params);
+    RCLibDspBiquad *bq = params->eq_coeffs + band;
+    gboolean active = params->eq_active[band];
+    gdouble amp, omega, sine, cosine, alpha, a0;
+    params->eq_active[band] = FALSE;
+    if(priv->rate<=0) return;
+    if(priv->bands[band]>-0.01 && priv->bands[band]<0.01) return;
+    if(dsp_eq_freqs[band]*2.0>=priv->rate) return;
+    amp = pow(10.0, priv->bands[band] / 40.0);
+    omega = 2.0 * G_PI * dsp_eq_freqs[band] / priv->rate;
+    sine = sin(omega);
+    cosine = cos(omega);
+    alpha = sine / (2.0 * DSP_EQ_Q);
+    a0 = 1.0 + alpha / amp;
+    bq->b0 = (1.0 + alpha * amp) / a0;
+    bq->b1 = -2.0 * cosine / a0;
+    bq->b2 = (1.0 - alpha * amp) / a0;
+    bq->a1 = bq->b1;
+    bq->a2 = (1.0 - alpha / amp) / a0;
+    
+    /* The streaming thread clears the state of a band turned on. */
+    if(!active)
+        priv->reset_bands |= 1 << band;
+    params->eq_active[band] = TRUE;
+}
+
+static void rclib_dsp_echo_update(RCLibDspPrivate *priv)
+{
+    RCLibDspParams *params = &(priv->params);
+    if(priv->rate<=0) return;
+    params->echo_delay_frames = gst_util_uint64_scale_int(priv->echo_delay,
+        priv->rate, GST_SECOND);
+    params->echo_delay_frames = CLAMP(params->echo_delay_frames, 1,
+        priv->echo_frames);
+}
+
+/* The band-pass filter of the mono part, the same as audiokaraoke. */
+
+static void rclib_dsp_karaoke_update(RCLibDspPrivate *priv)
+{
+    RCLibDspParams *params = &(priv->params);
+    gdouble a, b;
+    if(priv->rate<=0) return;
+    a = exp(-2.0 * G_PI * priv->kara_width / priv->rate);
+    b = -4.0 * a / (1.0 + a) * cos(2.0 * G_PI * priv->kara_band /
+        priv->rate);
+    params->kara_a = a;
+    params->kara_b = b;
+    params->kara_c = sqrt(1.0 - b * b / (4.0 * a)) * (1.0 - a);
+}
+
+/*
+ * Clear the filter states of the stages and the equalizer bands in the
+ * masks. Only called in the streaming thread, or when it is stopped.
+ */
+
+static void rclib_dsp_state_reset(RCLibDspPrivate *priv, gint channels,
+    guint stages, guint bands)
+{
+    guint band;
+    if(stages & (1 << RCLIB_DSP_STAGE_EQUALIZER))
+        bands = (1 << DSP_EQ_BANDS) - 1;
+    if(priv->eq_state!=NULL)
+    {
+        for(band=0;band<DSP_EQ_BANDS;band++)
+        {
+            if(!(bands & (1 << band))) continue;
+            memset(priv->eq_state + band * channels * 2, 0,
+                channels * 2 * sizeof(gdouble));
+        }
+    }
+    if(stages & (1 << RCLIB_DSP_STAGE_ECHO))
+    {
+        if(priv->echo_buffer!=NULL)
+        {
+            memset(priv->echo_buffer, 0, priv->echo_frames * channels *
+                sizeof(gfloat));
+        }
+        priv->echo_index = 0;
+    }
+    if(stages & (1 << RCLIB_DSP_STAGE_KARAOKE))
+    {
+        priv->kara_y1 = 0.0;
+        priv->kara_y2 = 0.0;
+    }
+}
+
+static gboolean rclib_dsp_stage_is_active(const RCLibDspParams *params,
+    RCLibDspStage stage)
+{
+    guint i;
+    switch(stage)
+    {
+        case RCLIB_DSP_STAGE_GAIN:
+            return params->gain!=1.0;
+        case RCLIB_DSP_STAGE_EQUALIZER:
+        {
+            for(i=0;i<DSP_EQ_BANDS;i++)
+            {
+                if(params->eq_active[i]) return TRUE;
+            }
+            return FALSE;
+        }
+        case RCLIB_DSP_STAGE_BALANCE:
+            return params->channels==2 && params->panorama!=0.0;
+        case RCLIB_DSP_STAGE_ECHO:
+            return params->echo_intensity>0.0;
+        case RCLIB_DSP_STAGE_KARAOKE:
+            return params->channels==2;
+        default:
+            break;
+    }
+    return FALSE;
+}
+
+static void rclib_dsp_update_passthrough(RCLibDsp *dsp)
+{
+    RCLibDspParams *params = &(dsp->priv->params);
+    gboolean active = FALSE;
+    guint i;
+    GST_OBJECT_LOCK(dsp);
+    for(i=0;i<params->stage_num && !active;i++)
+        active = rclib_dsp_stage_is_active(params, params->stages[i]);
+    GST_OBJECT_UNLOCK(dsp);
+    gst_base_transform_set_passthrough(GST_BASE_TRANSFORM(dsp), !active);
+}
+
+/*
+ * The kernels of the stages. The stereo streams (the common case) have
+ * their own kernels which process both channels in the same loop. The
+ * gain, balance and equalizer kernels use SSE2 or NEON if the compiler
+ * targets them, the scalar loops process the rest of the samples.
+ */
+
+static void rclib_dsp_process_gain(const RCLibDspParams *params,
+    RCLibDspPrivate *priv, gfloat *data, guint frames)
+{
+    gfloat gain = params->gain;
+    guint i = 0, samples = frames * params->channels;
+    #if defined(DSP_USE_SSE2)
+        __m128 vgain = _mm_set1_ps(gain);
+        for(;i+4<=samples;i+=4)
+        {
+            _mm_storeu_ps(data + i, _mm_mul_ps(_mm_loadu_ps(data + i),
+                vgain));
+        }
+    #elif defined(DSP_USE_NEON)
+        for(;i+4<=samples;i+=4)
+            vst1q_f32(data + i, vmulq_n_f32(vld1q_f32(data + i), gain));
+    #endif
+    for(;i<samples;i++)
+        data[i] *= gain;
+}
+
+static inline void rclib_dsp_biquad(const RCLibDspBiquad *bq,
+    gdouble *state, gfloat *data, guint frames, gint stride)
+{
+    gdouble x, y, z1 = state[0], z2 = state[1];
+    guint i;
+    for(i=0;i<frames;i++)
+    {
+        x = *data;
+        y = bq->b0 * x + z1;
+        z1 = bq->b1 * x - bq->a1 * y + z2;
+        z2 = bq->b2 * x - bq->a2 * y;
+        *data = y;
+        data += stride;
+    }
+    state[0] = rclib_dsp_flush_denormal(z1);
+    state[1] = rclib_dsp_flush_denormal(z2);
+}
+
+/*
+ * The filter of the stereo streams. The two channels are independent, so
+ * the vector kernels run them in the two lanes of a double vector (NEON
+ * only has double vectors on AArch64).
+ */
+
+static inline void rclib_dsp_biquad_stereo(const RCLibDspBiquad *bq,
+    gdouble *state, gfloat *data, guint frames)
+{
+    gdouble x[2], y[2];
+    gdouble z1[2] = {state[0], state[2]};
+    gdouble z2[2] = {state[1], state[3]};
+    guint i = 0;
+    #if defined(DSP_USE_SSE2)
+        __m128d vx, vy;
+        __m128d vz1 = _mm_loadu_pd(z1), vz2 = _mm_loadu_pd(z2);
+        __m128d b0 = _mm_set1_pd(bq->b0), b1 = _mm_set1_pd(bq->b1);
+        __m128d b2 = _mm_set1_pd(bq->b2), a1 = _mm_set1_pd(bq->a1);
+        __m128d a2 = _mm_set1_pd(bq->a2);
+        for(;i<frames;i++)
+        {
+            vx = _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64(
+                (const __m128i *)data)));
+            vy = _mm_add_pd(_mm_mul_pd(b0, vx), vz1);
+            vz1 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(b1, vx),
+                _mm_mul_pd(a1, vy)), vz2);
+            vz2 = _mm_sub_pd(_mm_mul_pd(b2, vx), _mm_mul_pd(a2, vy));
+            _mm_storel_epi64((__m128i *)data, _mm_castps_si128(
+                _mm_cvtpd_ps(vy)));
+            data += 2;
+        }
+        _mm_storeu_pd(z1, vz1);
+        _mm_storeu_pd(z2, vz2);
+    #elif defined(DSP_USE_NEON) && defined(__aarch64__)
+        float64x2_t vx, vy;
+        float64x2_t vz1 = vld1q_f64(z1), vz2 = vld1q_f64(z2);
+        float64x2_t b0 = vdupq_n_f64(bq->b0), b1 = vdupq_n_f64(bq->b1);
+        float64x2_t b2 = vdupq_n_f64(bq->b2), a1 = vdupq_n_f64(bq->a1);
+        float64x2_t a2 = vdupq_n_f64(bq->a2);
+        for(;i<frames;i++)
+        {
+            vx = vcvt_f64_f32(vld1_f32(data));
+            vy = vfmaq_f64(vz1, b0, vx);
+            vz1 = vfmsq_f64(vfmaq_f64(vz2, b1, vx), a1, vy);
+            vz2 = vfmsq_f64(vmulq_f64(b2, vx), a2, vy);
+            vst1_f32(data, vcvt_f32_f64(vy));
+            data += 2;
+        }
+        vst1q_f64(z1, vz1);
+        vst1q_f64(z2, vz2);
+    #endif
+    for(;i<frames;i++)
+    {
+        x[0] = data[0];
+        x[1] = data[1];
+        y[0] = bq->b0 * x[0] + z1[0];
+        y[1] = bq->b0 * x[1] + z1[1];
+        z1[0] = bq->b1 * x[0] - bq->a1 * y[0] + z2[0];
+        z1[1] = bq->b1 * x[1] - bq->a1 * y[1] + z2[1];
+        z2[0] = bq->b2 * x[0] - bq->a2 * y[0];
+        z2[1] = bq->b2 * x[1] - bq->a2 * y[1];
+        data[0] = y[0];
+        data[1] = y[1];
+        data += 2;
+    }
+    state[0] = rclib_dsp_flush_denormal(z1[0]);
+    state[1] = rclib_dsp_flush_denormal(z2[0]);
+    state[2] = rclib_dsp_flush_denormal(z1[1]);
+    state[3] = rclib_dsp_flush_denormal(z2[1]);
+}
+
+static void rclib_dsp_process_eq(const RCLibDspParams *params,
+    RCLibDspPrivate *priv, gfloat *data, guint frames)
+{
+    gint channels = params->channels;
+    gdouble *state;
+    guint band;
+    gint i;
+    if(priv->eq_state==NULL) return;
+    for(band=0;band<DSP_EQ_BANDS;band++)
+    {
+        if(!params->eq_active[band]) continue;
+        state = priv->eq_state + band * channels * 2;
+        if(channels==2)
+        {
+            rclib_dsp_biquad_stereo(params->eq_coeffs + band, state, data,
+                frames);
+            continue;
+        }
+        for(i=0;i<channels;i++)
+        {
+            rclib_dsp_biquad(params->eq_coeffs + band, state + i * 2,
+                data + i, frames, channels);
+        }
+    }
+}
+
+static void rclib_dsp_process_balance(const RCLibDspParams *params,
+    RCLibDspPrivate *priv, gfloat *data, guint frames)
+{
+    gfloat lpan = params->panorama>0.0 ? 1.0 - params->panorama : 1.0;
+    gfloat rpan = params->panorama>0.0 ? 1.0 : 1.0 + params->panorama;
+    guint i = 0;
+    #if defined(DSP_USE_SSE2)
+        __m128 vpan = _mm_setr_ps(lpan, rpan, lpan, rpan);
+        for(;i+2<=frames;i+=2)
+        {
+            _mm_storeu_ps(data, _mm_mul_ps(_mm_loadu_ps(data), vpan));
+            data += 4;
+        }
+    #elif defined(DSP_USE_NEON)
+        const gfloat pan[4] = {lpan, rpan, lpan, rpan};
+        float32x4_t vpan = vld1q_f32(pan);
+        for(;i+2<=frames;i+=2)
+        {
+            vst1q_f32(data, vmulq_f32(vld1q_f32(data), vpan));
+            data += 4;
+        }
+    #endif
+    for(;i<frames;i++)
+    {
+        data[0] *= lpan;
+        data[1] *= rpan;
+        data += 2;
+    }
+}
+
+static void rclib_dsp_process_echo(const RCLibDspParams *params,
+    RCLibDspPrivate *priv, gfloat *data, guint frames)
+{
+    gint channels = params->channels;
+    gfloat feedback = params->echo_feedback;
+    gfloat intensity = params->echo_intensity;
+    gfloat *echo, *write;
+    gfloat in;
+    guint rpos, wpos, i;
+    gint j;
+    if(priv->echo_buffer==NULL || priv->echo_frames==0) return;
+    wpos = priv->echo_index;
+    rpos = (wpos + priv->echo_frames - params->echo_delay_frames) %
+        priv->echo_frames;
+    for(i=0;i<frames;i++)
+    {
+        echo = priv->echo_buffer + rpos * channels;
+        write = priv->echo_buffer + wpos * channels;
+        for(j=0;j<channels;j++)
+        {
+            in = data[j];
+            data[j] = in + intensity * echo[j];
+            write[j] = in + feedback * echo[j];
+        }
+        data += channels;
+        if(++rpos>=priv->echo_frames) rpos = 0;
+        if(++wpos>=priv->echo_frames) wpos = 0;
+    }
+    priv->echo_index = wpos;
+}
+
+static void rclib_dsp_process_karaoke(const RCLibDspParams *params,
+    RCLibDspPrivate *priv, gfloat *data, guint frames)
+{
+    gfloat a = params->kara_a, b = params->kara_b, c = params->kara_c;
+    gfloat level = params->kara_level;
+    gfloat mono_level = params->kara_mono_level;
+    gfloat y1 = priv->kara_y1, y2 = priv->kara_y2;
+    gfloat l, r, y;
+    guint i;
+    for(i=0;i<frames;i++)
+    {
+        l = data[0];
+        r = data[1];
+        y = c * (l + r) / 2.0f - b * y1 - a * y2;
+        y2 = y1;
+        y1 = y;
+        y *= mono_level;
+        data[0] = l - r * level + y;
+        data[1] = r - l * level + y;
+        data += 2;
+    }
+    priv->kara_y1 = rclib_dsp_flush_denormal(y1);
+    priv->kara_y2 = rclib_dsp_flush_denormal(y2);
+}
+
+static void rclib_dsp_stage_process(const RCLibDspParams *params,
+    RCLibDspPrivate *priv, RCLibDspStage stage, gfloat *data, guint frames)
+{
+    switch(stage)
+    {
+        case RCLIB_DSP_STAGE_GAIN:
+            rclib_dsp_process_gain(params, priv, data, frames);
+            break;
+        case RCLIB_DSP_STAGE_EQUALIZER:
+            rclib_dsp_process_eq(params, priv, data, frames);
+            break;
+        case RCLIB_DSP_STAGE_BALANCE:
+            rclib_dsp_process_balance(params, priv, data, frames);
+            break;
+        case RCLIB_DSP_STAGE_ECHO:
+            rclib_dsp_process_echo(params, priv, data, frames);
+            break;
+        case RCLIB_DSP_STAGE_KARAOKE:
+            rclib_dsp_process_karaoke(params, priv, data, frames);
+            break;
+        default:
+            break;
+    }
+}
+
+static GstFlowReturn rclib_dsp_transform_ip(GstBaseTransform *base,
+    GstBuffer *buffer)
+{
+    RCLibDspPrivate *priv = RCLIB_DSP(base)->priv;
+    RCLibDspParams params;
+    RCLibDspStage stages[DSP_STAGE_NUM];
+    guint stage_num = 0;
+    guint reset_stages, reset_bands;
+    gfloat *data;
+    gsize size;
+    guint frames = 0, block, i;
+    #if GST_VERSION_MAJOR==1
+        GstMapInfo map;
+    #endif
+    if(gst_base_transform_is_passthrough(base)) return GST_FLOW_OK;
+    GST_OBJECT_LOCK(base);
+    params = priv->params;
+    reset_stages = priv->reset_stages;
+    reset_bands = priv->reset_bands;
+    priv->reset_stages = 0;
+    priv->reset_bands = 0;
+    GST_OBJECT_UNLOCK(base);
+    if(reset_stages!=0 || reset_bands!=0)
+    {
+        rclib_dsp_state_reset(priv, params.channels, reset_stages,
+            reset_bands);
+    }
+    for(i=0;i<params.stage_num;i++)
+    {
+        if(rclib_dsp_stage_is_active(&params, params.stages[i]))
+            stages[stage_num++] = params.stages[i];
+    }
+    if(stage_num==0 || params.channels<=0) return GST_FLOW_OK;
+    #if GST_VERSION_MAJOR==1
+        if(!gst_buffer_map(buffer, &map, GST_MAP_READWRITE))
+            return GST_FLOW_ERROR;
+        data = (gfloat *)map.data;
+        size = map.size;
+    #else
+        data = (gfloat *)GST_BUFFER_DATA(buffer);
+        size = GST_BUFFER_SIZE(buffer);
+    #endif
+    frames = size / (params.channels * sizeof(gfloat));
+    while(frames>0)
+    {
+        block = MIN(frames, DSP_BLOCK_FRAMES);
+        for(i=0;i<stage_num;i++)
+            rclib_dsp_stage_process(&params, priv, stages[i], data, block);
+        data += block * params.channels;
+        frames -= block;
+    }
+    #if GST_VERSION_MAJOR==1
+        gst_buffer_unmap(buffer, &map);
+    #endif
+    return GST_FLOW_OK;
+}
+
+#if GST_VERSION_MAJOR==1
+static gboolean rclib_dsp_setup(GstAudioFilter *filter,
+    const GstAudioInfo *info)
+#else
+static gboolean rclib_dsp_setup(GstAudioFilter *filter,
+    GstRingBufferSpec *format)
+#endif
+{
+    RCLibDsp *dsp = RCLIB_DSP(filter);
+    RCLibDspPrivate *priv = dsp->priv;
+    gint rate, channels;
+    guint echo_frames;
+    guint i;
+    #if GST_VERSION_MAJOR==1
+        rate = GST_AUDIO_INFO_RATE(info);
+        channels = GST_AUDIO_INFO_CHANNELS(info);
+    #else
+        rate = format->rate;
+        channels = format->channels;
+    #endif
+    if(rate<=0 || channels<=0) return FALSE;
+    
+    /*
+     * The states are only used in the streaming thread, which is the
+     * thread calling this function, so they are allocated here, and the
+     * delay line of the echo is never allocated while processing.
+     */
+    g_free(priv->eq_state);
+    priv->eq_state = g_new0(gdouble, channels * DSP_EQ_BANDS * 2);
+    echo_frames = gst_util_uint64_scale_int(DSP_ECHO_MAX_DELAY, rate,
+        GST_SECOND);
+    g_free(priv->echo_buffer);
+    priv->echo_buffer = g_new0(gfloat, echo_frames * channels);
+    priv->echo_index = 0;
+    priv->kara_y1 = 0.0;
+    priv->kara_y2 = 0.0;
+    GST_OBJECT_LOCK(dsp);
+    priv->rate = rate;
+    priv->params.channels = channels;
+    priv->echo_frames = echo_frames;
+    for(i=0;i<DSP_EQ_BANDS;i++)
+        rclib_dsp_eq_update(priv, i);
+    rclib_dsp_echo_update(priv);
+    rclib_dsp_karaoke_update(priv);
+    priv->reset_stages = 0;
+    priv->reset_bands = 0;
+    GST_OBJECT_UNLOCK(dsp);
+    rclib_dsp_update_passthrough(dsp);
+    return TRUE;
+}
+
+static gboolean rclib_dsp_stop(GstBaseTransform *base)
+{
+    RCLibDspPrivate *priv = RCLIB_DSP(base)->priv;
+    gint channels;
+    GST_OBJECT_LOCK(base);
+    channels = priv->params.channels;
+    priv->reset_stages = 0;
+    priv->reset_bands = 0;
+    GST_OBJECT_UNLOCK(base);
+    rclib_dsp_state_reset(priv, channels, (1 << DSP_STAGE_NUM) - 1, 0);
+    return TRUE;
+}
+
+static void rclib_dsp_set_property(GObject *object, guint prop_id,
+    const GValue *value, GParamSpec *pspec)
+{
+    RCLibDsp *dsp = RCLIB_DSP(object);
+    RCLibDspPrivate *priv = dsp->priv;
+    guint band;
+    GST_OBJECT_LOCK(dsp);
+    switch(prop_id)
+    {
+        case PROP_GAIN:
+            priv->params.gain = g_value_get_double(value);
+            break;
+        case PROP_PANORAMA:
+            priv->params.panorama = g_value_get_float(value);
+            break;
+        case PROP_ECHO_DELAY:
+            priv->echo_delay = g_value_get_uint64(value);
+            rclib_dsp_echo_update(priv);
+            break;
+        case PROP_ECHO_FEEDBACK:
+            priv->params.echo_feedback = g_value_get_float(value);
+            break;
+        case PROP_ECHO_INTENSITY:
+            priv->params.echo_intensity = g_value_get_float(value);
+            break;
+        case PROP_KARAOKE_LEVEL:
+            priv->params.kara_level = g_value_get_float(value);
+            break;
+        case PROP_KARAOKE_MONO_LEVEL:
+            priv->params.kara_mono_level = g_value_get_float(value);
+            break;
+        case PROP_KARAOKE_FILTER_BAND:
+            priv->kara_band = g_value_get_float(value);
+            rclib_dsp_karaoke_update(priv);
+            break;
+        case PROP_KARAOKE_FILTER_WIDTH:
+            priv->kara_width = g_value_get_float(value);
+            rclib_dsp_karaoke_update(priv);
+            break;
+        default:
+        {
+            if(prop_id<PROP_BAND0 || prop_id>=PROP_BAND0+DSP_EQ_BANDS)
+            {
+                G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+                break;
+            }
+            band = prop_id - PROP_BAND0;
+            priv->bands[band] = g_value_get_double(value);
+            rclib_dsp_eq_update(priv, band);
+            break;
+        }
+    }
+    GST_OBJECT_UNLOCK(dsp);
+    rclib_dsp_update_passthrough(dsp);
+}
+
+static void rclib_dsp_get_property(GObject *object, guint prop_id,
+    GValue *value, GParamSpec *pspec)
+{
+    RCLibDsp *dsp = RCLIB_DSP(object);
+    RCLibDspPrivate *priv = dsp->priv;
+    GST_OBJECT_LOCK(dsp);
+    switch(prop_id)
+    {
+        case PROP_GAIN:
+            g_value_set_double(value, priv->params.gain);
+            break;
+        case PROP_PANORAMA:
+            g_value_set_float(value, priv->params.panorama);
+            break;
+        case PROP_ECHO_DELAY:
+            g_value_set_uint64(value, priv->echo_delay);
+            break;
+        case PROP_ECHO_FEEDBACK:
+            g_value_set_float(value, priv->params.echo_feedback);
+            break;
+        case PROP_ECHO_INTENSITY:
+            g_value_set_float(value, priv->params.echo_intensity);
+            break;
+        case PROP_KARAOKE_LEVEL:
+            g_value_set_float(value, priv->params.kara_level);
+            break;
+        case PROP_KARAOKE_MONO_LEVEL:
+            g_value_set_float(value,
+                priv->params.kara_mono_level);
+            break;
+        case PROP_KARAOKE_FILTER_BAND:
+            g_value_set_float(value, priv->kara_band);
+            break;
+        case PROP_KARAOKE_FILTER_WIDTH:
+            g_value_set_float(value, priv->kara_width);
+            break;
+        default:
+        {
+            if(prop_id<PROP_BAND0 || prop_id>=PROP_BAND0+DSP_EQ_BANDS)
+            {
+                G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+                break;
+            }
+            g_value_set_double(value, priv->bands[prop_id-PROP_BAND0]);
+            break;
+        }
+    }
+    GST_OBJECT_UNLOCK(dsp);
+}
+
+static void rclib_dsp_finalize(GObject *object)
+{
+    RCLibDspPrivate *priv = RCLIB_DSP(object)->priv;
+    g_free(priv->eq_state);
+    g_free(priv->echo_buffer);
+    G_OBJECT_CLASS(rclib_dsp_parent_class)->finalize(object);
+}
+
+static void rclib_dsp_class_init(RCLibDspClass *klass)
+{
+    GObjectClass *object_class = (GObjectClass *)klass;
+    GstElementClass *element_class = (GstElementClass *)klass;
+    GstBaseTransformClass *transform_class = (GstBaseTransformClass *)klass;
+    GstAudioFilterClass *filter_class = (GstAudioFilterClass *)klass;
+    GstCaps *caps;
+    gchar band_name[16];
+    gchar band_nick[32];
+    guint i;
+    rclib_dsp_parent_class = g_type_class_peek_parent(klass);
+    object_class->set_property = rclib_dsp_set_property;
+    object_class->get_property = rclib_dsp_get_property;
+    object_class->finalize = rclib_dsp_finalize;
+    transform_class->transform_ip = rclib_dsp_transform_ip;
+    transform_class->stop = rclib_dsp_stop;
+    filter_class->setup = rclib_dsp_setup;
+    g_type_class_add_private(klass, sizeof(RCLibDspPrivate));
+    #if GST_VERSION_MAJOR==1
+        transform_class->transform_ip_on_passthrough = FALSE;
+        gst_element_class_set_metadata(element_class, "RhythmCat DSP",
+            "Filter/Effect/Audio", "Process the sound effects of the player",
+            "SuperCat <supercatexpert@gmail.com>");
+    #else
+        gst_element_class_set_details_simple(element_class, "RhythmCat DSP",
+            "Filter/Effect/Audio", "Process the sound effects of the player",
+            "SuperCat <supercatexpert@gmail.com>");
+    #endif
+    caps = gst_caps_from_string(DSP_CAPS);
+    gst_audio_filter_class_add_pad_templates(filter_class, caps);
+    gst_caps_unref(caps);
+
+    /**
+     * RCLibDsp:gain:
+     *
+     * The volume of the gain stage.
+     */
+    g_object_class_install_property(object_class, PROP_GAIN,
+        g_param_spec_double("gain", "Gain", "The volume of the gain stage",
+        0.0, 10.0, 1.0, G_PARAM_READWRITE));
+
+    /**
+     * RCLibDsp:panorama:
+     *
+     * The position in stereo panorama of the balance stage.
+     */
+    g_object_class_install_property(object_class, PROP_PANORAMA,
+        g_param_spec_float("panorama", "Panorama", "The position in stereo "
+        "panorama (-1.0 left -> 1.0 right)", -1.0, 1.0, 0.0,
+        G_PARAM_READWRITE));
+
+    /**
+     * RCLibDsp:echo-delay:
+     *
+     * The delay of the echo stage in nanoseconds, at most 1 second.
+     */
+    g_object_class_install_property(object_class, PROP_ECHO_DELAY,
+        g_param_spec_uint64("echo-delay", "Echo Delay", "The delay of the "
+        "echo in nanoseconds", 1, DSP_ECHO_MAX_DELAY, 1, G_PARAM_READWRITE));
+
+    /**
+     * RCLibDsp:echo-feedback:
+     *
+     * The amount of the echo which is fed back into the echo stage.
+     */
+    g_object_class_install_property(object_class, PROP_ECHO_FEEDBACK,
+        g_param_spec_float("echo-feedback", "Echo Feedback", "The amount of "
+        "feedback of the echo", 0.0, 1.0, 0.0, G_PARAM_READWRITE));
+
+    /**
+     * RCLibDsp:echo-intensity:
+     *
+     * The intensity of the echo in the echo stage.
+     */
+    g_object_class_install_property(object_class, PROP_ECHO_INTENSITY,
+        g_param_spec_float("echo-intensity", "Echo Intensity", "The "
+        "intensity of the echo", 0.0, 1.0, 0.0, G_PARAM_READWRITE));
+
+    /**
+     * RCLibDsp:karaoke-level:
+     *
+     * The level of the voice removal in the karaoke stage.
+     */
+    g_object_class_install_property(object_class, PROP_KARAOKE_LEVEL,
+        g_param_spec_float("karaoke-level", "Karaoke Level", "The level "
+        "of the effect", 0.0, 1.0, 1.0, G_PARAM_READWRITE));
+
+    /**
+     * RCLibDsp:karaoke-mono-level:
+     *
+     * The level of the mono part kept in the karaoke stage.
+     */
+    g_object_class_install_property(object_class, PROP_KARAOKE_MONO_LEVEL,
+        g_param_spec_float("karaoke-mono-level", "Karaoke Mono Level",
+        "The level of the mono channel", 0.0, 1.0, 1.0, G_PARAM_READWRITE));
+
+    /**
+     * RCLibDsp:karaoke-filter-band:
+     *
+     * The frequency band of the mono part kept in the karaoke stage.
+     */
+    g_object_class_install_property(object_class, PROP_KARAOKE_FILTER_BAND,
+        g_param_spec_float("karaoke-filter-band", "Karaoke Filter Band",
+        "The frequency band of the filter", 0.0, 441.0, 220.0,
+        G_PARAM_READWRITE));
+
+    /**
+     * RCLibDsp:karaoke-filter-width:
+     *
+     * The frequency width of the mono part kept in the karaoke stage.
+     */
+    g_object_class_install_property(object_class,
+        PROP_KARAOKE_FILTER_WIDTH, g_param_spec_float("karaoke-filter-width",
+        "Karaoke Filter Width", "The frequency width of the filter", 0.0,
+        100.0, 100.0, G_PARAM_READWRITE));
+
+    /* The gains of the equalizer bands in dB, from band0 to band9. */
+    for(i=0;i<DSP_EQ_BANDS;i++)
+    {
+        g_snprintf(band_name, 15, "band%u", i);
+        g_snprintf(band_nick, 31, "%.0f Hz", dsp_eq_freqs[i]);
+        g_object_class_install_property(object_class, PROP_BAND0 + i,
+            g_param_spec_double(band_name, band_nick, "The gain of the "
+            "frequency band", -24.0, 12.0, 0.0, G_PARAM_READWRITE));
+    }
+}
+
+static void rclib_dsp_instance_init(RCLibDsp *dsp)
+{
+    RCLibDspPrivate *priv = G_TYPE_INSTANCE_GET_PRIVATE(dsp,
+        RCLIB_TYPE_DSP, RCLibDspPrivate);
+    dsp->priv = priv;
+    priv->params.gain = 1.0;
+    priv->echo_delay = 1;
+    priv->params.kara_level = 1.0;
+    priv->params.kara_mono_level = 1.0;
+    priv->kara_band = 220.0;
+    priv->kara_width = 100.0;
+    gst_base_transform_set_in_place(GST_BASE_TRANSFORM(dsp), TRUE);
+    gst_base_transform_set_passthrough(GST_BASE_TRANSFORM(dsp), TRUE);
+}
+
+GType rclib_dsp_get_type()
+{
+    static volatile gsize g_define_type_id__volatile = 0;
+    GType g_define_type_id;
+    static const GTypeInfo dsp_info = {
+        .class_size = sizeof(RCLibDspClass),
+        .base_init = NULL,
+        .base_finalize = NULL,
+        .class_init = (GClassInitFunc)rclib_dsp_class_init,
+        .class_finalize = NULL,
+        .class_data = NULL,
+        .instance_size = sizeof(RCLibDsp),
+        .n_preallocs = 0,
+        .instance_init = (GInstanceInitFunc)rclib_dsp_instance_init
+    };
+    if(g_once_init_enter(&g_define_type_id__volatile))
+    {
+        g_define_type_id = g_type_register_static(GST_TYPE_AUDIO_FILTER,
+            g_intern_static_string("RCLibDsp"), &dsp_info, 0);
+        g_once_init_leave(&g_define_type_id__volatile, g_define_type_id);
+    }
+    return g_define_type_id__volatile;
+}
+
+/**
+ * rclib_dsp_new:
+ *
+ * Create a new DSP element with no stage added.
+ *
+ * Returns: (transfer full): The new DSP element.
+ */
+
+GstElement *rclib_dsp_new()
+{
+    return GST_ELEMENT(g_object_new(RCLIB_TYPE_DSP, NULL));
+}
+
+/**
+ * rclib_dsp_stage_add:
+ * @dsp: the #RCLibDsp element
+ * @stage: the stage to add
+ *
+ * Add a stage to the end of the stage chain in the DSP element. The
+ * stage can be added when the element is playing.
+ *
+ * Returns: Whether the stage is added, FALSE if it is already added.
+ */
+
+gboolean rclib_dsp_stage_add(RCLibDsp *dsp, RCLibDspStage stage)
+{
+    RCLibDspParams *params;
+    guint i;
+    if(dsp==NULL || (guint)stage>=DSP_STAGE_NUM) return FALSE;
+    params = &(dsp->priv->params);
+    GST_OBJECT_LOCK(dsp);
+    for(i=0;i<params->stage_num;i++)
+    {
+        if(params->stages[i]==stage) break;
+    }
+    if(i<params->stage_num)
+    {
+        GST_OBJECT_UNLOCK(dsp);
+        return FALSE;
+    }
+    dsp->priv->reset_stages |= 1 << stage;
+    params->stages[params->stage_num] = stage;
+    params->stage_num++;
+    GST_OBJECT_UNLOCK(dsp);
+    rclib_dsp_update_passthrough(dsp);
+    return TRUE;
+}
+
+/**
+ * rclib_dsp_stage_remove:
+ * @dsp: the #RCLibDsp element
+ * @stage: the stage to remove
+ *
+ * Remove a stage from the DSP element. The stage can be removed when
+ * the element is playing.
+ */
+
+void rclib_dsp_stage_remove(RCLibDsp *dsp, RCLibDspStage stage)
+{
+    RCLibDspParams *params;
+    guint i;
+    if(dsp==NULL) return;
+    params = &(dsp->priv->params);
+    GST_OBJECT_LOCK(dsp);
+    for(i=0;i<params->stage_num;i++)
+    {
+        if(params->stages[i]==stage) break;
+    }
+    if(i<params->stage_num)
+    {
+        memmove(params->stages+i, params->stages+i+1,
+            (params->stage_num-i-1) * sizeof(RCLibDspStage));
+        params->stage_num--;
+        dsp->priv->reset_stages |= 1 << stage;
+    }
+    GST_OBJECT_UNLOCK(dsp);
+    rclib_dsp_update_passthrough(dsp);
+}
+
+/**
+ * rclib_dsp_stage_is_added:
+ * @dsp: the #RCLibDsp element
+ * @stage: the stage to check
+ *
+ * Check whether the stage is added in the DSP element.
+ *
+ * Returns: Whether the stage is added.
+ */
+
+gboolean rclib_dsp_stage_is_added(RCLibDsp *dsp, RCLibDspStage stage)
+{
+    RCLibDspParams *params;
+    gboolean flag = FALSE;
+    guint i;
+    if(dsp==NULL) return FALSE;
+    params = &(dsp->priv->params);
+    GST_OBJECT_LOCK(dsp);
+    for(i=0;i<params->stage_num && !flag;i++)
+        flag = (params->stages[i]==stage);
+    GST_OBJECT_UNLOCK(dsp);
+    return flag;
+}
+
@@ -0,0 +1,105 @@
+/*
+ * RhythmCat Library DSP Element Header Declaration
+ *
+ * rclib-dsp.h
+ * This file is part of RhythmCat Library (LibRhythmCat)
+ *
+ * Copyright (C) 2012 - SuperCat, license: GPL v3
+ *
+ * RhythmCat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RhythmCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RhythmCat; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef HAVE_RC_LIB_DSP_H
+#define HAVE_RC_LIB_DSP_H
+
+#include <glib.h>
+#include <glib-object.h>
+#include <gst/gst.h>
+#include <gst/audio/gstaudiofilter.h>
+#include <gst/audio/audio.h>
+
+G_BEGIN_DECLS
+
+#define RCLIB_TYPE_DSP (rclib_dsp_get_type())
+#define RCLIB_DSP(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), RCLIB_TYPE_DSP, \
+    RCLibDsp))
+#define RCLIB_DSP_CLASS(k) (G_TYPE_CHECK_CLASS_CAST((k), RCLIB_TYPE_DSP, \
+    RCLibDspClass))
+#define RCLIB_IS_DSP(o) (G_TYPE_CHECK_INSTANCE_TYPE((o), RCLIB_TYPE_DSP))
+#define RCLIB_IS_DSP_CLASS(k) (G_TYPE_CHECK_CLASS_TYPE((k), RCLIB_TYPE_DSP))
+#define RCLIB_DSP_GET_CLASS(o) (G_TYPE_INSTANCE_GET_CLASS((o), \
+    RCLIB_TYPE_DSP, RCLibDspClass))
+
+/**
+ * RCLibDspStage:
+ * @RCLIB_DSP_STAGE_GAIN: the volume gain stage
+ * @RCLIB_DSP_STAGE_EQUALIZER: the 10-band equalizer stage
+ * @RCLIB_DSP_STAGE_BALANCE: the stereo balance stage
+ * @RCLIB_DSP_STAGE_ECHO: the echo stage
+ * @RCLIB_DSP_STAGE_KARAOKE: the karaoke (center-cut) stage
+ *
+ * The enum type for the stages in the DSP element.
+ */
+
+typedef enum {
+    RCLIB_DSP_STAGE_GAIN = 0,
+    RCLIB_DSP_STAGE_EQUALIZER = 1,
+    RCLIB_DSP_STAGE_BALANCE = 2,
+    RCLIB_DSP_STAGE_ECHO = 3,
+    RCLIB_DSP_STAGE_KARAOKE = 4
+}RCLibDspStage;
+
+typedef struct _RCLibDsp RCLibDsp;
+typedef struct _RCLibDspClass RCLibDspClass;
+typedef struct _RCLibDspPrivate RCLibDspPrivate;
+
+/**
+ * RCLibDsp:
+ *
+ * The audio DSP element. The contents of the #RCLibDsp structure are
+ * private and should only be accessed via the provided API.
+ */
+
+struct _RCLibDsp {
+    /*< private >*/
+    GstAudioFilter parent;
+    RCLibDspPrivate *priv;
+};
+
+/**
+ * RCLibDspClass:
+ *
+ * #RCLibDsp class.
+ */
+
+struct _RCLibDspClass {
+    /*< private >*/
+    GstAudioFilterClass parent_class;
+};
+
+/*< private >*/
+GType rclib_dsp_get_type();
+
+/*< public >*/
+GstElement *rclib_dsp_new();
+gboolean rclib_dsp_stage_add(RCLibDsp *dsp, RCLibDspStage stage);
+void rclib_dsp_stage_remove(RCLibDsp *dsp, RCLibDspStage stage);
+gboolean rclib_dsp_stage_is_added(RCLibDsp *dsp, RCLibDspStage stage);
+
+G_END_DECLS
+
+#endif
+
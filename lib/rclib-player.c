@@ -23,11 +23,14 @@
  * Boston, MA  02110-1301  USA
  */
 
+#include <string.h>
 #include "rclib-player.h"
 #include "rclib-common.h"
 #include "rclib-db.h"
 #include "rclib-core.h"
 
+#define RCLIB_PLAYER_SHUFFLE_HISTORY_SIZE 64
+
 /**
  * SECTION: rclib-player
  * @Short_description: The player scheduler
@@ -37,8 +40,44 @@
  * The #RCLibPlayer is a class which schedules the player, like sequential
  * playing, repeat playing, and random playing. The playing mode can be set
  * easily by the given API.
+ *
+ * In random playing mode, the player shuffles the music in the playing
+ * scope (the current playlist, all playlists, or the library query
+ * result), and plays every music in the scope once before shuffling them
+ * again. The music played recently can be played again by
+ * rclib_player_play_prev().
+ *
+ * If gapless mode of the core is enabled, the player chooses the next
+ * music when a music starts, and queues it in the core, so that the core
+ * can play it right after the current one.
  */
 
+/*
+ * The shuffle order of the items in the scope, the items before the
+ * cursor have been played in the current round. The items are playlist
+ * iters, or the URIs (owned by the order array) in library playing.
+ * The cursor and the history only move when the playing music really
+ * changes, choosing the next music (e.g. to prefetch it) only peeks.
+ */
+
+typedef struct _RCLibPlayerShuffle
+{
+    gboolean valid;
+    RCLibCorePlaySource source_type;
+    RCLibDbCatalogIter *catalog_iter;
+    GObject *query_result;
+    GPtrArray *order;
+    GHashTable *position_table;
+    guint cursor;
+    gpointer current;
+    gpointer history[RCLIB_PLAYER_SHUFFLE_HISTORY_SIZE];
+    guint history_head;
+    guint history_length;
+    gulong added_handler;
+    gulong delete_handler;
+    gulong reset_handler;
+}RCLibPlayerShuffle;
+
 struct _RCLibPlayerPrivate
 {
     RCLibPlayerRepeatMode repeat_mode;
@@ -47,6 +86,17 @@ struct _RCLibPlayerPrivate
     gboolean limit_state;
     gfloat limit_rating;
     gboolean limit_condition;
+    RCLibPlayerShuffle shuffle;
+    gulong playlist_added_handler;
+    gulong playlist_delete_handler;
+    gulong catalog_delete_handler;
+    GKeyFile *shuffle_state;
+    gulong uri_changed_handler;
+    gboolean prefetch_flag;
+    gboolean prefetch_queued;
+    gpointer prefetch_reference;
+    gchar *prefetch_uri;
+    guint prefetch_id;
 };
 
 enum
@@ -60,6 +110,646 @@ static GObject *player_instance = NULL;
 static gpointer rclib_player_parent_class = NULL;
 static gint player_signals[SIGNAL_LAST] = {0};
 
+static inline gboolean rclib_player_rating_match(RCLibPlayerPrivate *priv,
+    gfloat rating)
+{
+    if(!priv->limit_state) return TRUE;
+    if(rating<-0.1) return FALSE;
+    if(priv->limit_condition)
+        return rating<=priv->limit_rating;
+    return rating>=priv->limit_rating;
+}
+
+static inline void rclib_player_shuffle_swap(RCLibPlayerShuffle *shuffle,
+    guint i, guint j)
+{
+    gpointer item;
+    if(i==j) return;
+    item = shuffle->order->pdata[i];
+    shuffle->order->pdata[i] = shuffle->order->pdata[j];
+    shuffle->order->pdata[j] = item;
+    g_hash_table_insert(shuffle->position_table, shuffle->order->pdata[i],
+        GUINT_TO_POINTER(i+1));
+    g_hash_table_insert(shuffle->position_table, shuffle->order->pdata[j],
+        GUINT_TO_POINTER(j+1));
+}
+
+/* Fisher-Yates shuffle on the items from the start position to the end. */
+
+static void rclib_player_shuffle_permute(RCLibPlayerShuffle *shuffle,
+    guint start)
+{
+    guint i, j;
+    for(i=shuffle->order->len;i>start+1;i--)
+    {
+        j = start + g_random_int_range(0, i-start);
+        rclib_player_shuffle_swap(shuffle, i-1, j);
+    }
+}
+
+/* Get the item in the order which is equal to the given reference. */
+
+static gpointer rclib_player_shuffle_get_item(RCLibPlayerShuffle *shuffle,
+    gconstpointer reference)
+{
+    gpointer item = NULL;
+    if(!shuffle->valid || reference==NULL) return NULL;
+    if(!g_hash_table_lookup_extended(shuffle->position_table, reference,
+        &item, NULL))
+    {
+        return NULL;
+    }
+    return item;
+}
+
+static void rclib_player_shuffle_history_push(RCLibPlayerShuffle *shuffle,
+    gpointer item)
+{
+    guint index;
+    if(item==NULL) return;
+    index = (shuffle->history_head + shuffle->history_length) %
+        RCLIB_PLAYER_SHUFFLE_HISTORY_SIZE;
+    shuffle->history[index] = item;
+    if(shuffle->history_length<RCLIB_PLAYER_SHUFFLE_HISTORY_SIZE)
+        shuffle->history_length++;
+    else
+    {
+        shuffle->history_head = (shuffle->history_head + 1) %
+            RCLIB_PLAYER_SHUFFLE_HISTORY_SIZE;
+    }
+}
+
+static gpointer rclib_player_shuffle_history_pop(RCLibPlayerShuffle *shuffle)
+{
+    guint index;
+    gpointer item;
+    if(shuffle->history_length==0) return NULL;
+    shuffle->history_length--;
+    index = (shuffle->history_head + shuffle->history_length) %
+        RCLIB_PLAYER_SHUFFLE_HISTORY_SIZE;
+    item = shuffle->history[index];
+    shuffle->history[index] = NULL;
+    return item;
+}
+
+static void rclib_player_shuffle_history_remove(RCLibPlayerShuffle *shuffle,
+    gconstpointer item)
+{
+    guint i, j;
+    gpointer entry;
+    for(i=0, j=0;i<shuffle->history_length;i++)
+    {
+        entry = shuffle->history[(shuffle->history_head + i) %
+            RCLIB_PLAYER_SHUFFLE_HISTORY_SIZE];
+        if(entry==item) continue;
+        shuffle->history[(shuffle->history_head + j) %
+            RCLIB_PLAYER_SHUFFLE_HISTORY_SIZE] = entry;
+        j++;
+    }
+    for(i=j;i<shuffle->history_length;i++)
+    {
+        shuffle->history[(shuffle->history_head + i) %
+            RCLIB_PLAYER_SHUFFLE_HISTORY_SIZE] = NULL;
+    }
+    shuffle->history_length = j;
+}
+
+/*
+ * Put a new item at a random position after the cursor, so it is played
+ * in the current round like the items shuffled with it at first.
+ */
+
+static void rclib_player_shuffle_insert(RCLibPlayerShuffle *shuffle,
+    gpointer item)
+{
+    guint length;
+    g_ptr_array_add(shuffle->order, item);
+    length = shuffle->order->len;
+    g_hash_table_insert(shuffle->position_table, item,
+        GUINT_TO_POINTER(length));
+    rclib_player_shuffle_swap(shuffle, length-1, shuffle->cursor +
+        g_random_int_range(0, length-shuffle->cursor));
+}
+
+static void rclib_player_shuffle_remove(RCLibPlayerShuffle *shuffle,
+    gconstpointer reference)
+{
+    gpointer item;
+    guint pos, last;
+    if(!shuffle->valid || reference==NULL) return;
+    pos = GPOINTER_TO_UINT(g_hash_table_lookup(shuffle->position_table,
+        reference));
+    if(pos==0) return;
+    pos--;
+    item = g_ptr_array_index(shuffle->order, pos);
+    rclib_player_shuffle_history_remove(shuffle, item);
+    if(shuffle->current==item)
+        shuffle->current = NULL;
+    if(pos<shuffle->cursor)
+    {
+        rclib_player_shuffle_swap(shuffle, pos, shuffle->cursor-1);
+        pos = shuffle->cursor-1;
+        shuffle->cursor--;
+    }
+    last = shuffle->order->len-1;
+    rclib_player_shuffle_swap(shuffle, pos, last);
+    g_hash_table_remove(shuffle->position_table, item);
+    g_ptr_array_remove_index(shuffle->order, last);
+}
+
+static void rclib_player_shuffle_mark_played(RCLibPlayerShuffle *shuffle,
+    gconstpointer item)
+{
+    guint pos;
+    pos = GPOINTER_TO_UINT(g_hash_table_lookup(shuffle->position_table,
+        item));
+    if(pos==0) return;
+    pos--;
+    if(pos<shuffle->cursor) return;
+    rclib_player_shuffle_swap(shuffle, pos, shuffle->cursor);
+    shuffle->cursor++;
+}
+
+static void rclib_player_shuffle_query_result_added_cb(
+    RCLibDbLibraryQueryResult *qr, const gchar *uri, gpointer data)
+{
+    RCLibPlayerPrivate *priv = (RCLibPlayerPrivate *)data;
+    if(priv==NULL || uri==NULL) return;
+    if(!priv->shuffle.valid) return;
+    if(g_hash_table_contains(priv->shuffle.position_table, uri)) return;
+    rclib_player_shuffle_insert(&(priv->shuffle), g_strdup(uri));
+}
+
+static void rclib_player_shuffle_query_result_delete_cb(
+    RCLibDbLibraryQueryResult *qr, const gchar *uri, gpointer data)
+{
+    RCLibPlayerPrivate *priv = (RCLibPlayerPrivate *)data;
+    if(priv==NULL || uri==NULL) return;
+    rclib_player_shuffle_remove(&(priv->shuffle), uri);
+}
+
+static void rclib_player_shuffle_query_result_reset_cb(
+    RCLibDbLibraryQueryResult *qr, gpointer data)
+{
+    RCLibPlayerPrivate *priv = (RCLibPlayerPrivate *)data;
+    if(priv==NULL) return;
+    priv->shuffle.valid = FALSE;
+}
+
+static void rclib_player_shuffle_clear(RCLibPlayerShuffle *shuffle)
+{
+    if(shuffle->query_result!=NULL)
+    {
+        g_signal_handler_disconnect(shuffle->query_result,
+            shuffle->added_handler);
+        g_signal_handler_disconnect(shuffle->query_result,
+            shuffle->delete_handler);
+        g_signal_handler_disconnect(shuffle->query_result,
+            shuffle->reset_handler);
+        g_object_unref(shuffle->query_result);
+    }
+    if(shuffle->position_table!=NULL)
+        g_hash_table_destroy(shuffle->position_table);
+    if(shuffle->order!=NULL)
+        g_ptr_array_free(shuffle->order, TRUE);
+    memset(shuffle, 0, sizeof(RCLibPlayerShuffle));
+}
+
+/*
+ * Add the items in the scope of the shuffle to the array, in the order
+ * of the scope (the order used to save the state). The URIs added in
+ * library playing should be freed after usage.
+ */
+
+static void rclib_player_shuffle_collect(RCLibPlayerShuffle *shuffle,
+    GPtrArray *items)
+{
+    RCLibDbCatalogIter *cforeach_iter;
+    RCLibDbPlaylistIter *pforeach_iter;
+    RCLibDbLibraryQueryResultIter *lforeach_iter;
+    RCLibDbLibraryQueryResult *query_result;
+    RCLibDbLibraryData *library_data;
+    gchar *uri;
+    if(shuffle->source_type==RCLIB_CORE_PLAY_SOURCE_LIBRARY)
+    {
+        if(shuffle->query_result==NULL) return;
+        query_result = RCLIB_DB_LIBRARY_QUERY_RESULT(shuffle->query_result);
+        for(lforeach_iter=rclib_db_library_query_result_get_begin_iter(
+            query_result);lforeach_iter!=NULL;
+            lforeach_iter=rclib_db_library_query_result_get_next_iter(
+            query_result, lforeach_iter))
+        {
+            library_data = rclib_db_library_query_result_get_data(
+                query_result, lforeach_iter);
+            if(library_data==NULL) continue;
+            uri = NULL;
+            rclib_db_library_data_get(library_data,
+                RCLIB_DB_LIBRARY_DATA_TYPE_URI, &uri,
+                RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
+            rclib_db_library_data_unref(library_data);
+            if(uri==NULL) continue;
+            g_ptr_array_add(items, uri);
+        }
+    }
+    else if(shuffle->source_type==RCLIB_CORE_PLAY_SOURCE_PLAYLIST)
+    {
+        for(cforeach_iter=shuffle->catalog_iter!=NULL ?
+            shuffle->catalog_iter : rclib_db_catalog_get_begin_iter();
+            cforeach_iter!=NULL;
+            cforeach_iter=rclib_db_catalog_iter_next(cforeach_iter))
+        {
+            for(pforeach_iter=rclib_db_playlist_get_begin_iter(
+                cforeach_iter);pforeach_iter!=NULL;
+                pforeach_iter=rclib_db_playlist_iter_next(pforeach_iter))
+            {
+                g_ptr_array_add(items, pforeach_iter);
+            }
+            if(shuffle->catalog_iter!=NULL) break;
+        }
+    }
+}
+
+/*
+ * Set up the shuffle for the scope, the items are added in the order of
+ * the scope, and not shuffled yet.
+ */
+
+static void rclib_player_shuffle_setup(RCLibPlayerPrivate *priv,
+    RCLibCorePlaySource source_type, RCLibDbCatalogIter *catalog_iter)
+{
+    RCLibPlayerShuffle *shuffle = &(priv->shuffle);
+    guint i;
+    rclib_player_shuffle_clear(shuffle);
+    shuffle->source_type = source_type;
+    shuffle->catalog_iter = catalog_iter;
+    if(source_type==RCLIB_CORE_PLAY_SOURCE_LIBRARY)
+    {
+        shuffle->order = g_ptr_array_new_with_free_func(g_free);
+        shuffle->position_table = g_hash_table_new(g_str_hash,
+            g_str_equal);
+        shuffle->query_result = rclib_db_library_get_album_query_result();
+    }
+    else
+    {
+        shuffle->order = g_ptr_array_new();
+        shuffle->position_table = g_hash_table_new(g_direct_hash,
+            g_direct_equal);
+    }
+    if(shuffle->query_result!=NULL)
+    {
+        shuffle->added_handler = g_signal_connect(shuffle->query_result,
+            "query-result-added",
+            G_CALLBACK(rclib_player_shuffle_query_result_added_cb), priv);
+        shuffle->delete_handler = g_signal_connect(shuffle->query_result,
+            "query-result-delete",
+            G_CALLBACK(rclib_player_shuffle_query_result_delete_cb), priv);
+        shuffle->reset_handler = g_signal_connect(shuffle->query_result,
+            "query-result-reset",
+            G_CALLBACK(rclib_player_shuffle_query_result_reset_cb), priv);
+    }
+    rclib_player_shuffle_collect(shuffle, shuffle->order);
+    for(i=0;i<shuffle->order->len;i++)
+    {
+        g_hash_table_insert(shuffle->position_table,
+            g_ptr_array_index(shuffle->order, i), GUINT_TO_POINTER(i+1));
+    }
+}
+
+/* A hash of the URIs of the items in the order, to check a saved state. */
+
+static guint rclib_player_shuffle_checksum(RCLibPlayerShuffle *shuffle,
+    gpointer *items, guint length)
+{
+    guint checksum = 0;
+    gchar *uri;
+    guint i;
+    for(i=0;i<length;i++)
+    {
+        if(shuffle->source_type==RCLIB_CORE_PLAY_SOURCE_LIBRARY)
+        {
+            checksum = checksum * 31 + g_str_hash(items[i]);
+            continue;
+        }
+        uri = NULL;
+        rclib_db_playlist_data_iter_get((RCLibDbPlaylistIter *)items[i],
+            RCLIB_DB_PLAYLIST_DATA_TYPE_URI, &uri,
+            RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
+        checksum = checksum * 31 + (uri!=NULL ? g_str_hash(uri) : 0);
+        g_free(uri);
+    }
+    return checksum;
+}
+
+/*
+ * Restore the shuffle order saved by rclib_player_save_shuffle_state(),
+ * the shuffle must be just set up for the same scope. Returns FALSE if
+ * the items in the scope are not the ones saved.
+ */
+
+static gboolean rclib_player_shuffle_restore(RCLibPlayerShuffle *shuffle,
+    GKeyFile *keyfile)
+{
+    gint *order = NULL, *history = NULL;
+    gsize order_length = 0, history_length = 0;
+    gpointer *items;
+    gboolean *used;
+    gboolean flag = TRUE;
+    guint length, checksum, i;
+    gint cursor;
+    length = shuffle->order->len;
+    if(g_key_file_get_integer(keyfile, "Shuffle", "Length", NULL)!=
+        (gint)length)
+    {
+        return FALSE;
+    }
+    checksum = rclib_player_shuffle_checksum(shuffle,
+        shuffle->order->pdata, length);
+    if((guint)g_key_file_get_integer(keyfile, "Shuffle", "Checksum",
+        NULL)!=checksum)
+    {
+        return FALSE;
+    }
+    cursor = g_key_file_get_integer(keyfile, "Shuffle", "Cursor", NULL);
+    order = g_key_file_get_integer_list(keyfile, "Shuffle", "Order",
+        &order_length, NULL);
+    history = g_key_file_get_integer_list(keyfile, "Shuffle", "History",
+        &history_length, NULL);
+    if(order_length!=length || cursor<0 || cursor>(gint)length)
+    {
+        g_free(order);
+        g_free(history);
+        return FALSE;
+    }
+    items = g_new(gpointer, length>0 ? length : 1);
+    used = g_new0(gboolean, length>0 ? length : 1);
+    for(i=0;i<length && flag;i++)
+    {
+        if(order[i]<0 || order[i]>=(gint)length || used[order[i]])
+            flag = FALSE;
+        else
+        {
+            used[order[i]] = TRUE;
+            items[i] = g_ptr_array_index(shuffle->order, order[i]);
+        }
+    }
+    if(flag)
+    {
+        for(i=0;i<length;i++)
+        {
+            shuffle->order->pdata[i] = items[i];
+            g_hash_table_insert(shuffle->position_table, items[i],
+                GUINT_TO_POINTER(i+1));
+        }
+        shuffle->cursor = cursor;
+        for(i=0;history!=NULL && i<history_length;i++)
+        {
+            if(history[i]<0 || history[i]>=(gint)length) continue;
+            rclib_player_shuffle_history_push(shuffle,
+                g_ptr_array_index(shuffle->order, history[i]));
+        }
+    }
+    g_free(items);
+    g_free(used);
+    g_free(order);
+    g_free(history);
+    return flag;
+}
+
+/*
+ * Make sure the shuffle is built for the scope, restore the saved state
+ * if it is for the same scope.
+ */
+
+static void rclib_player_shuffle_prepare(RCLibPlayerPrivate *priv,
+    RCLibCorePlaySource source_type, RCLibDbCatalogIter *catalog_iter)
+{
+    RCLibPlayerShuffle *shuffle = &(priv->shuffle);
+    RCLibDbCatalogIter *saved_catalog_iter = NULL;
+    gint source, catalog_pos;
+    gboolean flag = FALSE;
+    if(shuffle->valid && shuffle->source_type==source_type &&
+        shuffle->catalog_iter==catalog_iter)
+    {
+        return;
+    }
+    rclib_player_shuffle_setup(priv, source_type, catalog_iter);
+    if(priv->shuffle_state!=NULL)
+    {
+        source = g_key_file_get_integer(priv->shuffle_state, "Shuffle",
+            "Source", NULL);
+        catalog_pos = g_key_file_get_integer(priv->shuffle_state, "Shuffle",
+            "Catalog", NULL);
+        if(catalog_pos>=0)
+            saved_catalog_iter = rclib_db_catalog_get_iter_at_pos(catalog_pos);
+        if(source==source_type && saved_catalog_iter==catalog_iter)
+        {
+            flag = rclib_player_shuffle_restore(shuffle,
+                priv->shuffle_state);
+        }
+        g_key_file_free(priv->shuffle_state);
+        priv->shuffle_state = NULL;
+    }
+    if(!flag)
+    {
+        shuffle->cursor = 0;
+        rclib_player_shuffle_permute(shuffle, 0);
+    }
+    shuffle->valid = TRUE;
+}
+
+static gboolean rclib_player_shuffle_item_match(RCLibPlayerPrivate *priv,
+    gpointer item)
+{
+    gfloat rating = -1.0;
+    if(!priv->limit_state) return TRUE;
+    if(priv->shuffle.source_type==RCLIB_CORE_PLAY_SOURCE_LIBRARY)
+    {
+        rclib_db_library_data_uri_get((const gchar *)item,
+            RCLIB_DB_LIBRARY_DATA_TYPE_RATING, &rating,
+            RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
+    }
+    else
+    {
+        rclib_db_playlist_data_iter_get((RCLibDbPlaylistIter *)item,
+            RCLIB_DB_PLAYLIST_DATA_TYPE_RATING, &rating,
+            RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
+    }
+    return rclib_player_rating_match(priv, rating);
+}
+
+/*
+ * Get the next item in the shuffle order without moving the cursor, so
+ * it can be asked again (e.g. when the next music is prefetched again)
+ * without using up the items. A new round is started if all items have
+ * been played, and the first item of the new round is not the one played
+ * just now.
+ */
+
+static gpointer rclib_player_shuffle_peek(RCLibPlayerPrivate *priv,
+    gconstpointer current)
+{
+    RCLibPlayerShuffle *shuffle = &(priv->shuffle);
+    gpointer item;
+    guint length, i, round;
+    length = shuffle->order->len;
+    if(length==0) return NULL;
+    for(round=0;round<2;round++)
+    {
+        if(shuffle->cursor>=length)
+        {
+            shuffle->cursor = 0;
+            rclib_player_shuffle_permute(shuffle, 0);
+            if(length>1 && g_ptr_array_index(shuffle->order, 0)==current)
+            {
+                rclib_player_shuffle_swap(shuffle, 0,
+                    1 + g_random_int_range(0, length-1));
+            }
+        }
+        for(i=shuffle->cursor;i<length;i++)
+        {
+            item = g_ptr_array_index(shuffle->order, i);
+            if(rclib_player_shuffle_item_match(priv, item)) return item;
+        }
+        
+        /* None of the items left in this round matches the limit. */
+        shuffle->cursor = length;
+    }
+    return NULL;
+}
+
+/*
+ * Move the cursor and the history after the playing music is changed,
+ * the music which was played is put into the history.
+ */
+
+static void rclib_player_shuffle_commit(RCLibPlayerPrivate *priv)
+{
+    RCLibPlayerShuffle *shuffle = &(priv->shuffle);
+    RCLibCorePlaySource source_type = RCLIB_CORE_PLAY_SOURCE_NONE;
+    gpointer reference = NULL;
+    gpointer item;
+    if(!shuffle->valid) return;
+    rclib_core_get_play_source(&source_type, &reference, NULL);
+    if(source_type!=shuffle->source_type) return;
+    item = rclib_player_shuffle_get_item(shuffle, reference);
+    if(item==NULL || item==shuffle->current) return;
+    if(shuffle->current!=NULL)
+        rclib_player_shuffle_history_push(shuffle, shuffle->current);
+    rclib_player_shuffle_mark_played(shuffle, item);
+    shuffle->current = item;
+}
+
+/*
+ * Play the music, or queue it in the core if the next music is being
+ * prefetched for gapless playing.
+ */
+
+static void rclib_player_schedule_playlist(RCLibPlayerPrivate *priv,
+    gpointer iter)
+{
+    gchar *uri = NULL;
+    if(!priv->prefetch_flag)
+    {
+        rclib_player_play_playlist(iter);
+        return;
+    }
+    if(iter==NULL) return;
+    if(!rclib_db_playlist_is_valid_iter((RCLibDbPlaylistIter *)iter))
+        return;
+    rclib_db_playlist_data_iter_get((RCLibDbPlaylistIter *)iter,
+        RCLIB_DB_PLAYLIST_DATA_TYPE_URI, &uri,
+        RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
+    if(uri==NULL) return;
+    priv->prefetch_reference = iter;
+    priv->prefetch_queued = rclib_core_set_next_uri_with_play_source(uri,
+        RCLIB_CORE_PLAY_SOURCE_PLAYLIST, iter, NULL, NULL);
+    g_free(uri);
+}
+
+static void rclib_player_schedule_library(RCLibPlayerPrivate *priv,
+    const gchar *uri)
+{
+    gchar *new_uri;
+    if(!priv->prefetch_flag)
+    {
+        rclib_player_play_library(uri);
+        return;
+    }
+    if(uri==NULL) return;
+    new_uri = g_strdup(uri);
+    priv->prefetch_queued = rclib_core_set_next_uri_with_play_source(new_uri,
+        RCLIB_CORE_PLAY_SOURCE_LIBRARY, new_uri, g_free, NULL);
+    if(!priv->prefetch_queued)
+        priv->prefetch_uri = new_uri;
+}
+
+static gboolean rclib_player_shuffle_play_next(RCLibPlayerPrivate *priv)
+{
+    gpointer reference = NULL;
+    RCLibCorePlaySource source_type = RCLIB_CORE_PLAY_SOURCE_NONE;
+    RCLibDbCatalogIter *catalog_iter = NULL;
+    gpointer current, item;
+    rclib_core_get_play_source(&source_type, &reference, NULL);
+    if(source_type==RCLIB_CORE_PLAY_SOURCE_PLAYLIST)
+    {
+        if(reference!=NULL && !rclib_db_playlist_is_valid_iter(
+            (RCLibDbPlaylistIter *)reference))
+        {
+            reference = NULL;
+        }
+        if(priv->random_mode==RCLIB_PLAYER_RANDOM_SINGLE)
+        {
+            if(reference==NULL) return FALSE;
+            rclib_db_playlist_data_iter_get((RCLibDbPlaylistIter *)reference,
+                RCLIB_DB_PLAYLIST_DATA_TYPE_CATALOG, &catalog_iter,
+                RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
+            if(catalog_iter==NULL) return FALSE;
+        }
+    }
+    else if(source_type!=RCLIB_CORE_PLAY_SOURCE_LIBRARY)
+        return FALSE;
+    rclib_player_shuffle_prepare(priv, source_type, catalog_iter);
+    current = rclib_player_shuffle_get_item(&(priv->shuffle), reference);
+    if(current!=NULL && current!=priv->shuffle.current)
+    {
+        rclib_player_shuffle_mark_played(&(priv->shuffle), current);
+        priv->shuffle.current = current;
+    }
+    item = rclib_player_shuffle_peek(priv, current);
+    if(item==NULL) return FALSE;
+    if(source_type==RCLIB_CORE_PLAY_SOURCE_PLAYLIST)
+        rclib_player_schedule_playlist(priv, item);
+    else
+        rclib_player_schedule_library(priv, (const gchar *)item);
+    return TRUE;
+}
+
+static gboolean rclib_player_shuffle_play_prev(RCLibPlayerPrivate *priv)
+{
+    RCLibCorePlaySource source_type = RCLIB_CORE_PLAY_SOURCE_NONE;
+    RCLibPlayerShuffle *shuffle = &(priv->shuffle);
+    gpointer item;
+    rclib_core_get_play_source(&source_type, NULL, NULL);
+    if(!shuffle->valid || shuffle->source_type!=source_type) return FALSE;
+    while((item=rclib_player_shuffle_history_pop(shuffle))!=NULL)
+    {
+        if(source_type!=RCLIB_CORE_PLAY_SOURCE_LIBRARY &&
+            !rclib_db_playlist_is_valid_iter((RCLibDbPlaylistIter *)item))
+        {
+            continue;
+        }
+        
+        /* Going back must not put the music played now into history. */
+        shuffle->current = item;
+        if(source_type==RCLIB_CORE_PLAY_SOURCE_LIBRARY)
+            rclib_player_play_library((const gchar *)item);
+        else
+            rclib_player_play_playlist(item);
+        return TRUE;
+    }
+    return FALSE;
+}
+
 static inline void rclib_player_repeat_list(RCLibPlayerPrivate *priv)
 {
     gpointer reference = NULL;
@@ -91,7 +781,7 @@ static inline void rclib_player_repeat_list(RCLibPlayerPrivate *priv)
                     {
                         if(rating<=priv->limit_rating)
                         {
-                            rclib_player_play_playlist(foreach_iter);
+                            rclib_player_schedule_playlist(priv, foreach_iter);
                             return;
                         }
                     }
@@ -99,7 +789,7 @@ static inline void rclib_player_repeat_list(RCLibPlayerPrivate *priv)
                     {
                         if(rating>=priv->limit_rating)
                         {
-                            rclib_player_play_playlist(foreach_iter);
+                            rclib_player_schedule_playlist(priv, foreach_iter);
                             return;
                         }
                     }
@@ -134,7 +824,7 @@ static inline void rclib_player_repeat_list(RCLibPlayerPrivate *priv)
                 }
             }
             if(iter_new!=NULL)
-                rclib_player_play_playlist(iter_new);
+                rclib_player_schedule_playlist(priv, iter_new);
         }
         else
         {
@@ -143,7 +833,7 @@ static inline void rclib_player_repeat_list(RCLibPlayerPrivate *priv)
                 iter = rclib_db_playlist_iter_get_begin_iter(
                     (RCLibDbPlaylistIter *)reference);
             }
-            rclib_player_play_playlist(iter);
+            rclib_player_schedule_playlist(priv, iter);
         }
     }
 }
@@ -178,7 +868,7 @@ static inline void rclib_player_play_next_internal(RCLibPlayerPrivate *priv,
                 {
                     if(rating<=priv->limit_rating)
                     {
-                        rclib_player_play_playlist(pforeach_iter);
+                        rclib_player_schedule_playlist(priv, pforeach_iter);
                         return;
                     }
                 }
@@ -186,7 +876,7 @@ static inline void rclib_player_play_next_internal(RCLibPlayerPrivate *priv,
                 {
                     if(rating>=priv->limit_rating)
                     {
-                        rclib_player_play_playlist(pforeach_iter);
+                        rclib_player_schedule_playlist(priv, pforeach_iter);
                         return;
                     }
                 }
@@ -212,7 +902,7 @@ static inline void rclib_player_play_next_internal(RCLibPlayerPrivate *priv,
                     {
                         if(rating<=priv->limit_rating)
                         {
-                            rclib_player_play_playlist(iter);
+                            rclib_player_schedule_playlist(priv, iter);
                             return;
                         }
                     }
@@ -220,7 +910,7 @@ static inline void rclib_player_play_next_internal(RCLibPlayerPrivate *priv,
                     {
                         if(rating>=priv->limit_rating)
                         {
-                            rclib_player_play_playlist(iter);
+                            rclib_player_schedule_playlist(priv, iter);
                             return;
                         }
                     }
@@ -242,7 +932,7 @@ static inline void rclib_player_play_next_internal(RCLibPlayerPrivate *priv,
                     {
                         if(rating<=priv->limit_rating)
                         {
-                            rclib_player_play_playlist(iter);
+                            rclib_player_schedule_playlist(priv, iter);
                             return;
                         }
                     }
@@ -250,7 +940,7 @@ static inline void rclib_player_play_next_internal(RCLibPlayerPrivate *priv,
                     {
                         if(rating>=priv->limit_rating)
                         {
-                            rclib_player_play_playlist(iter);
+                            rclib_player_schedule_playlist(priv, iter);
                             return;
                         }
                     }
@@ -292,16 +982,16 @@ static inline void rclib_player_play_next_internal(RCLibPlayerPrivate *priv,
                     }
                     iter = rclib_db_playlist_get_begin_iter(catalog_iter);
                     if(iter==NULL) return;
-                    rclib_player_play_playlist(iter);
+                    rclib_player_schedule_playlist(priv, iter);
                     return;
                 }
                 iter = rclib_db_playlist_get_begin_iter(catalog_iter);
                 if(iter==NULL) return;
-                rclib_player_play_playlist(iter);
+                rclib_player_schedule_playlist(priv, iter);
                 return;
             }
             if(iter!=NULL)
-                rclib_player_play_playlist(iter);
+                rclib_player_schedule_playlist(priv, iter);
         }
     }
     else if(source_type==RCLIB_CORE_PLAY_SOURCE_LIBRARY)
@@ -349,7 +1039,7 @@ static inline void rclib_player_play_next_internal(RCLibPlayerPrivate *priv,
                 {
                     if(rating<=priv->limit_rating)
                     {
-                        rclib_player_play_library(uri);
+                        rclib_player_schedule_library(priv, uri);
                         g_free(uri);
                         g_object_unref(library_query_result);
                         return;
@@ -359,7 +1049,7 @@ static inline void rclib_player_play_next_internal(RCLibPlayerPrivate *priv,
                 {
                     if(rating>=priv->limit_rating)
                     {
-                        rclib_player_play_library(uri);
+                        rclib_player_schedule_library(priv, uri);
                         g_free(uri);
                         g_object_unref(library_query_result);
                         return;
@@ -399,7 +1089,7 @@ static inline void rclib_player_play_next_internal(RCLibPlayerPrivate *priv,
                 {
                     if(rating<=priv->limit_rating)
                     {
-                        rclib_player_play_library(uri);
+                        rclib_player_schedule_library(priv, uri);
                         g_free(uri);
                         g_object_unref(library_query_result);
                         return;
@@ -409,7 +1099,7 @@ static inline void rclib_player_play_next_internal(RCLibPlayerPrivate *priv,
                 {
                     if(rating>=priv->limit_rating)
                     {
-                        rclib_player_play_library(uri);
+                        rclib_player_schedule_library(priv, uri);
                         g_free(uri);
                         g_object_unref(library_query_result);
                         return;
@@ -436,7 +1126,7 @@ static inline void rclib_player_play_next_internal(RCLibPlayerPrivate *priv,
                     RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
                 rclib_db_library_data_unref(library_data);
                 if(uri==NULL) continue;
-                rclib_player_play_library(uri);
+                rclib_player_schedule_library(priv, uri);
                 g_free(uri);
                 g_object_unref(library_query_result);
                 return;
@@ -462,7 +1152,7 @@ static inline void rclib_player_play_next_internal(RCLibPlayerPrivate *priv,
                     RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
                 rclib_db_library_data_unref(library_data);
                 if(uri==NULL) continue;
-                rclib_player_play_library(uri);
+                rclib_player_schedule_library(priv, uri);
                 g_free(uri);
                 g_object_unref(library_query_result);
                 return;
@@ -472,46 +1162,28 @@ static inline void rclib_player_play_next_internal(RCLibPlayerPrivate *priv,
     }
 }
 
-static void rclib_player_eos_cb(RCLibCore *core, gpointer data)
+/*
+ * Play the music after the current one by the playing mode, or queue it
+ * in the core if the next music is being prefetched.
+ */
+
+static void rclib_player_schedule_next(RCLibPlayerPrivate *priv)
 {
     gpointer reference = NULL;
     RCLibCorePlaySource source_type = RCLIB_CORE_PLAY_SOURCE_NONE;
-    RCLibPlayer *player;
-    RCLibPlayerPrivate *priv;
-    if(data==NULL) return;
-    player = RCLIB_PLAYER(data);
-    priv = player->priv;
     rclib_core_get_play_source(&source_type, &reference, NULL);
     if(source_type==RCLIB_CORE_PLAY_SOURCE_PLAYLIST)
     {
-        RCLibDbPlaylistIter *iter;
         if(priv->random_mode!=RCLIB_PLAYER_RANDOM_NONE)
         {
-            switch(priv->random_mode)
-            {
-                case RCLIB_PLAYER_RANDOM_SINGLE:
-                    iter = rclib_db_playlist_iter_get_random_iter(
-                        (RCLibDbPlaylistIter *)reference, priv->limit_state,
-                        priv->limit_condition, priv->limit_rating);
-                    if(iter!=NULL) rclib_player_play_playlist(iter);
-                    break;
-                case RCLIB_PLAYER_RANDOM_ALL:
-                    iter = rclib_db_playlist_iter_get_random_iter(NULL,
-                        priv->limit_state, priv->limit_condition,
-                        priv->limit_rating);
-                    if(iter!=NULL) rclib_player_play_playlist(iter);
-                        break;
-                    break;
-                default:
-                    rclib_player_play_next_internal(priv, FALSE);
-                    break;
-            }
+            rclib_player_shuffle_play_next(priv);
             return;
         }
         switch(priv->repeat_mode)
         {
             case RCLIB_PLAYER_REPEAT_SINGLE:
-                if(reference!=NULL) rclib_player_play_playlist(reference);
+                if(reference!=NULL)
+                    rclib_player_schedule_playlist(priv, reference);
                 break;
             case RCLIB_PLAYER_REPEAT_LIST:
                 rclib_player_repeat_list(priv);
@@ -526,44 +1198,16 @@ static void rclib_player_eos_cb(RCLibCore *core, gpointer data)
     }
     else if(source_type==RCLIB_CORE_PLAY_SOURCE_LIBRARY)
     {
-        RCLibDbLibraryQueryResultIter *iter = NULL;
         GObject *library_query_result = NULL;
         gchar *uri = NULL;
         RCLibDbLibraryData *library_data = NULL;
         if(priv->random_mode!=RCLIB_PLAYER_RANDOM_NONE)
         {
-            switch(priv->random_mode)
-            {
-                /*
-                 * No difference between the two random modes in library
-                 * playing. So merge them.
-                 */
-                case RCLIB_PLAYER_RANDOM_SINGLE: 
-                case RCLIB_PLAYER_RANDOM_ALL:
-                    library_query_result =
-                        rclib_db_library_get_album_query_result();
-                    if(library_query_result==NULL) break;
-                    iter = rclib_db_library_query_result_get_random_iter(
-                        RCLIB_DB_LIBRARY_QUERY_RESULT(library_query_result));
-                    if(iter!=NULL)
-                    {
-                        library_data = rclib_db_library_query_result_get_data(
-                            RCLIB_DB_LIBRARY_QUERY_RESULT(library_query_result),
-                            (RCLibDbLibraryQueryResultIter *)iter);
-                    }
-                    g_object_unref(library_query_result);
-                    if(library_data==NULL) break;
-                    rclib_db_library_data_get(library_data,
-                        RCLIB_DB_LIBRARY_DATA_TYPE_URI, &uri,
-                        RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
-                    rclib_db_library_data_unref(library_data);
-                    rclib_player_play_library(uri);
-                    g_free(uri);
-                    break;
-                default:
-                    rclib_player_play_next_internal(priv, FALSE);
-                    break;
-            }
+            /*
+             * No difference between the two random modes in library
+             * playing, the whole query result is shuffled.
+             */
+            rclib_player_shuffle_play_next(priv);
             return;
         }
         switch(priv->repeat_mode)
@@ -585,7 +1229,7 @@ static void rclib_player_eos_cb(RCLibCore *core, gpointer data)
                         RCLIB_DB_LIBRARY_DATA_TYPE_URI, &uri,
                         RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
                     rclib_db_library_data_unref(library_data);
-                    rclib_player_play_library(uri);
+                    rclib_player_schedule_library(priv, uri);
                     g_free(uri);
                 }
                 break;
@@ -606,11 +1250,168 @@ static void rclib_player_eos_cb(RCLibCore *core, gpointer data)
     }
 }
 
+static void rclib_player_prefetch_clear(RCLibPlayerPrivate *priv)
+{
+    priv->prefetch_queued = FALSE;
+    priv->prefetch_reference = NULL;
+    g_free(priv->prefetch_uri);
+    priv->prefetch_uri = NULL;
+}
+
+static void rclib_player_eos_cb(RCLibCore *core, gpointer data)
+{
+    RCLibPlayerPrivate *priv;
+    gpointer reference;
+    gchar *uri;
+    if(data==NULL) return;
+    priv = RCLIB_PLAYER(data)->priv;
+
+    /* The music chosen ahead which the core could not queue, e.g. CUE. */
+    if(!priv->prefetch_queued && priv->prefetch_reference!=NULL)
+    {
+        reference = priv->prefetch_reference;
+        rclib_player_prefetch_clear(priv);
+        rclib_player_play_playlist(reference);
+        return;
+    }
+    if(!priv->prefetch_queued && priv->prefetch_uri!=NULL)
+    {
+        uri = priv->prefetch_uri;
+        priv->prefetch_uri = NULL;
+        rclib_player_prefetch_clear(priv);
+        rclib_player_play_library(uri);
+        g_free(uri);
+        return;
+    }
+    rclib_player_schedule_next(priv);
+}
+
+static gboolean rclib_player_prefetch_idle_cb(gpointer data)
+{
+    RCLibPlayerPrivate *priv = (RCLibPlayerPrivate *)data;
+    if(data==NULL) return FALSE;
+    priv->prefetch_id = 0;
+    rclib_player_prefetch_clear(priv);
+    rclib_core_set_next_uri_with_play_source(NULL,
+        RCLIB_CORE_PLAY_SOURCE_NONE, NULL, NULL, NULL);
+    if(!rclib_core_get_gapless()) return FALSE;
+    priv->prefetch_flag = TRUE;
+    rclib_player_schedule_next(priv);
+    priv->prefetch_flag = FALSE;
+    return FALSE;
+}
+
+/*
+ * Choose the next music again in the main loop, after the music or the
+ * playing mode is changed.
+ */
+
+static void rclib_player_prefetch_queue(RCLibPlayerPrivate *priv)
+{
+    if(priv->prefetch_id!=0) return;
+    if(!rclib_core_get_gapless()) return;
+    priv->prefetch_id = g_idle_add(rclib_player_prefetch_idle_cb, priv);
+}
+
+static void rclib_player_uri_changed_cb(RCLibCore *core, const gchar *uri,
+    gpointer data)
+{
+    RCLibPlayerPrivate *priv = (RCLibPlayerPrivate *)data;
+    if(priv==NULL) return;
+    rclib_player_shuffle_commit(priv);
+    rclib_player_prefetch_clear(priv);
+    rclib_player_prefetch_queue(priv);
+}
+
+static void rclib_player_playlist_added_cb(RCLibDb *db,
+    RCLibDbPlaylistIter *iter, gpointer data)
+{
+    RCLibPlayerPrivate *priv = (RCLibPlayerPrivate *)data;
+    RCLibPlayerShuffle *shuffle;
+    RCLibDbCatalogIter *catalog_iter = NULL;
+    if(priv==NULL || iter==NULL) return;
+    shuffle = &(priv->shuffle);
+    if(!shuffle->valid ||
+        shuffle->source_type!=RCLIB_CORE_PLAY_SOURCE_PLAYLIST)
+    {
+        return;
+    }
+    if(shuffle->catalog_iter!=NULL)
+    {
+        rclib_db_playlist_data_iter_get(iter,
+            RCLIB_DB_PLAYLIST_DATA_TYPE_CATALOG, &catalog_iter,
+            RCLIB_DB_PLAYLIST_DATA_TYPE_NONE);
+        if(catalog_iter!=shuffle->catalog_iter) return;
+    }
+    if(g_hash_table_contains(shuffle->position_table, iter)) return;
+    rclib_player_shuffle_insert(shuffle, iter);
+}
+
+static void rclib_player_playlist_delete_cb(RCLibDb *db,
+    RCLibDbPlaylistIter *iter, gpointer data)
+{
+    RCLibPlayerPrivate *priv = (RCLibPlayerPrivate *)data;
+    if(priv==NULL || iter==NULL) return;
+    if(priv->prefetch_reference==(gpointer)iter)
+    {
+        rclib_player_prefetch_clear(priv);
+        rclib_player_prefetch_queue(priv);
+    }
+    if(priv->shuffle.source_type!=RCLIB_CORE_PLAY_SOURCE_PLAYLIST) return;
+    rclib_player_shuffle_remove(&(priv->shuffle), iter);
+}
+
+static void rclib_player_catalog_delete_cb(RCLibDb *db,
+    RCLibDbCatalogIter *iter, gpointer data)
+{
+    RCLibPlayerPrivate *priv = (RCLibPlayerPrivate *)data;
+    RCLibPlayerShuffle *shuffle;
+    RCLibDbPlaylistIter *pforeach_iter;
+    if(priv==NULL || iter==NULL) return;
+    if(priv->prefetch_reference!=NULL)
+    {
+        rclib_player_prefetch_clear(priv);
+        rclib_player_prefetch_queue(priv);
+    }
+    shuffle = &(priv->shuffle);
+    if(!shuffle->valid ||
+        shuffle->source_type!=RCLIB_CORE_PLAY_SOURCE_PLAYLIST)
+    {
+        return;
+    }
+    if(shuffle->catalog_iter==iter)
+    {
+        shuffle->valid = FALSE;
+        return;
+    }
+    if(shuffle->catalog_iter!=NULL) return;
+    for(pforeach_iter=rclib_db_playlist_get_begin_iter(iter);
+        pforeach_iter!=NULL;
+        pforeach_iter=rclib_db_playlist_iter_next(pforeach_iter))
+    {
+        rclib_player_shuffle_remove(shuffle, pforeach_iter);
+    }
+}
+
 static void rclib_player_finalize(GObject *object)
 {
     RCLibPlayerPrivate *priv = RCLIB_PLAYER(object)->priv;
     RCLIB_PLAYER(object)->priv = NULL;
     rclib_core_signal_disconnect(priv->eos_handler);
+    if(priv->uri_changed_handler>0)
+        rclib_core_signal_disconnect(priv->uri_changed_handler);
+    if(priv->prefetch_id!=0)
+        g_source_remove(priv->prefetch_id);
+    rclib_player_prefetch_clear(priv);
+    if(priv->playlist_added_handler>0)
+        rclib_db_signal_disconnect(priv->playlist_added_handler);
+    if(priv->playlist_delete_handler>0)
+        rclib_db_signal_disconnect(priv->playlist_delete_handler);
+    if(priv->catalog_delete_handler>0)
+        rclib_db_signal_disconnect(priv->catalog_delete_handler);
+    rclib_player_shuffle_clear(&(priv->shuffle));
+    if(priv->shuffle_state!=NULL)
+        g_key_file_free(priv->shuffle_state);
     G_OBJECT_CLASS(rclib_player_parent_class)->finalize(object);
 }
 
@@ -670,6 +1471,14 @@ static void rclib_player_instance_init(RCLibPlayer *player)
     priv->random_mode = RCLIB_PLAYER_RANDOM_NONE;
     priv->eos_handler = rclib_core_signal_connect("eos",
         G_CALLBACK(rclib_player_eos_cb), player);
+    priv->uri_changed_handler = rclib_core_signal_connect("uri-changed",
+        G_CALLBACK(rclib_player_uri_changed_cb), priv);
+    priv->playlist_added_handler = rclib_db_signal_connect("playlist-added",
+        G_CALLBACK(rclib_player_playlist_added_cb), priv);
+    priv->playlist_delete_handler = rclib_db_signal_connect(
+        "playlist-delete", G_CALLBACK(rclib_player_playlist_delete_cb), priv);
+    priv->catalog_delete_handler = rclib_db_signal_connect("catalog-delete",
+        G_CALLBACK(rclib_player_catalog_delete_cb), priv);
 }
 
 GType rclib_player_get_type()
@@ -825,7 +1634,8 @@ void rclib_player_play_library(const gchar *uri)
  * @loop: whether the player should be jump to the last playlist
  *   if the playing one is the first
  *
- * Play the previous music.
+ * Play the previous music. In random playing mode, the music played
+ * before the current one is played again.
  *
  * Returns: Whether the player is set to play.
  */
@@ -835,6 +1645,13 @@ gboolean rclib_player_play_prev(gboolean jump, gboolean repeat,
 {
     gpointer reference = NULL;
     RCLibCorePlaySource source_type = RCLIB_CORE_PLAY_SOURCE_NONE;
+    RCLibPlayerPrivate *priv = NULL;
+    if(player_instance!=NULL)
+        priv = RCLIB_PLAYER(player_instance)->priv;
+    if(priv!=NULL && priv->random_mode!=RCLIB_PLAYER_RANDOM_NONE)
+    {
+        if(rclib_player_shuffle_play_prev(priv)) return TRUE;
+    }
     rclib_core_get_play_source(&source_type, &reference, NULL);
     if(source_type==RCLIB_CORE_PLAY_SOURCE_PLAYLIST)
     {
@@ -979,7 +1796,8 @@ gboolean rclib_player_play_prev(gboolean jump, gboolean repeat,
  * @loop: whether the player should be jump to the first playlist
  *   if the playing one is the last
  *
- * Play the next music.
+ * Play the next music. In random playing mode, the next music in the
+ * shuffle order is played.
  *
  * Returns: Whether the player is set to play.
  */
@@ -989,6 +1807,13 @@ gboolean rclib_player_play_next(gboolean jump, gboolean repeat,
 {
     gpointer reference = NULL;
     RCLibCorePlaySource source_type = RCLIB_CORE_PLAY_SOURCE_NONE;
+    RCLibPlayerPrivate *priv = NULL;
+    if(player_instance!=NULL)
+        priv = RCLIB_PLAYER(player_instance)->priv;
+    if(priv!=NULL && priv->random_mode!=RCLIB_PLAYER_RANDOM_NONE)
+    {
+        if(rclib_player_shuffle_play_next(priv)) return TRUE;
+    }
     rclib_core_get_play_source(&source_type, &reference, NULL);
     if(source_type==RCLIB_CORE_PLAY_SOURCE_PLAYLIST)
     {
@@ -1126,6 +1951,7 @@ void rclib_player_set_repeat_mode(RCLibPlayerRepeatMode mode)
     priv = RCLIB_PLAYER(player_instance)->priv;
     if(priv==NULL) return;
     priv->repeat_mode = mode;
+    rclib_player_prefetch_queue(priv);
     g_signal_emit(player_instance,
         player_signals[SIGNAL_REPEAT_MODE_CHANGED], 0, mode);
 }
@@ -1144,6 +1970,7 @@ void rclib_player_set_random_mode(RCLibPlayerRandomMode mode)
     priv = RCLIB_PLAYER(player_instance)->priv;
     if(priv==NULL) return;
     priv->random_mode = mode;
+    rclib_player_prefetch_queue(priv);
     g_signal_emit(player_instance,
         player_signals[SIGNAL_RANDOM_MODE_CHANGED], 0, mode);
 }
@@ -1206,6 +2033,7 @@ void rclib_player_set_rating_limit(gboolean state, gfloat rating,
     if(rating<0.0) rating = 0.0;
     priv->limit_rating = rating;
     priv->limit_condition = condition;
+    rclib_player_prefetch_queue(priv);
 }
 
 /**
@@ -1229,9 +2057,145 @@ gboolean rclib_player_get_rating_limit(gfloat *rating, gboolean *condition)
     return priv->limit_state;
 }
 
+/**
+ * rclib_player_load_shuffle_state:
+ * @filename: the path of the shuffle state file
+ *
+ * Load the shuffle state saved by rclib_player_save_shuffle_state(). The
+ * state is used when the player shuffles the same playing scope for the
+ * first time, if the music in the scope is not changed after the state
+ * is saved, the player continues the saved shuffle order and history.
+ *
+ * Returns: Whether the state file is loaded.
+ */
 
+gboolean rclib_player_load_shuffle_state(const gchar *filename)
+{
+    RCLibPlayerPrivate *priv;
+    GKeyFile *keyfile;
+    if(player_instance==NULL || filename==NULL) return FALSE;
+    priv = RCLIB_PLAYER(player_instance)->priv;
+    if(priv==NULL) return FALSE;
+    keyfile = g_key_file_new();
+    if(!g_key_file_load_from_file(keyfile, filename, G_KEY_FILE_NONE, NULL))
+    {
+        g_key_file_free(keyfile);
+        return FALSE;
+    }
+    if(priv->shuffle_state!=NULL)
+        g_key_file_free(priv->shuffle_state);
+    priv->shuffle_state = keyfile;
+    return TRUE;
+}
 
+/**
+ * rclib_player_save_shuffle_state:
+ * @filename: the path of the shuffle state file
+ *
+ * Save the shuffle order and the play history of the random playing mode
+ * to the file. The music is saved by the positions in the playing scope.
+ *
+ * Returns: Whether the state is saved successfully.
+ */
 
-
-
-
+gboolean rclib_player_save_shuffle_state(const gchar *filename)
+{
+    RCLibPlayerPrivate *priv;
+    RCLibPlayerShuffle *shuffle;
+    GKeyFile *keyfile;
+    GHashTable *index_table;
+    GPtrArray *items;
+    gint *order, *history;
+    gchar *data;
+    gsize length;
+    guint i;
+    gint catalog_pos = -1;
+    GError *error = NULL;
+    gboolean flag;
+    if(player_instance==NULL || filename==NULL) return FALSE;
+    priv = RCLIB_PLAYER(player_instance)->priv;
+    if(priv==NULL) return FALSE;
+    shuffle = &(priv->shuffle);
+    if(!shuffle->valid)
+    {
+        /* Keep the loaded state if the scope is not shuffled. */
+        if(priv->shuffle_state==NULL) return FALSE;
+        data = g_key_file_to_data(priv->shuffle_state, &length, NULL);
+    }
+    else
+    {
+        /* Get the positions of the items in the scope. */
+        if(shuffle->source_type==RCLIB_CORE_PLAY_SOURCE_LIBRARY)
+        {
+            items = g_ptr_array_new_with_free_func(g_free);
+            index_table = g_hash_table_new(g_str_hash, g_str_equal);
+        }
+        else
+        {
+            items = g_ptr_array_new();
+            index_table = g_hash_table_new(g_direct_hash, g_direct_equal);
+        }
+        rclib_player_shuffle_collect(shuffle, items);
+        for(i=0;i<items->len;i++)
+        {
+            g_hash_table_insert(index_table, g_ptr_array_index(items, i),
+                GUINT_TO_POINTER(i+1));
+        }
+        length = shuffle->order->len;
+        order = g_new(gint, length>0 ? length : 1);
+        history = g_new(gint, RCLIB_PLAYER_SHUFFLE_HISTORY_SIZE);
+        flag = (items->len==length);
+        for(i=0;i<length && flag;i++)
+        {
+            order[i] = GPOINTER_TO_UINT(g_hash_table_lookup(index_table,
+                g_ptr_array_index(shuffle->order, i))) - 1;
+            if(order[i]<0) flag = FALSE;
+        }
+        for(i=0;i<shuffle->history_length && flag;i++)
+        {
+            history[i] = GPOINTER_TO_UINT(g_hash_table_lookup(index_table,
+                shuffle->history[(shuffle->history_head + i) %
+                RCLIB_PLAYER_SHUFFLE_HISTORY_SIZE])) - 1;
+            if(history[i]<0) flag = FALSE;
+        }
+        if(shuffle->catalog_iter!=NULL)
+        {
+            catalog_pos = rclib_db_catalog_iter_get_position(
+                shuffle->catalog_iter);
+        }
+        data = NULL;
+        if(flag)
+        {
+            keyfile = g_key_file_new();
+            g_key_file_set_integer(keyfile, "Shuffle", "Source",
+                shuffle->source_type);
+            g_key_file_set_integer(keyfile, "Shuffle", "Catalog",
+                catalog_pos);
+            g_key_file_set_integer(keyfile, "Shuffle", "Length", length);
+            g_key_file_set_integer(keyfile, "Shuffle", "Checksum",
+                (gint)rclib_player_shuffle_checksum(shuffle, items->pdata,
+                items->len));
+            g_key_file_set_integer(keyfile, "Shuffle", "Cursor",
+                shuffle->cursor);
+            g_key_file_set_integer_list(keyfile, "Shuffle", "Order",
+                order, length);
+            g_key_file_set_integer_list(keyfile, "Shuffle", "History",
+                history, shuffle->history_length);
+            data = g_key_file_to_data(keyfile, &length, NULL);
+            g_key_file_free(keyfile);
+        }
+        g_hash_table_destroy(index_table);
+        g_ptr_array_free(items, TRUE);
+        g_free(order);
+        g_free(history);
+    }
+    if(data==NULL) return FALSE;
+    flag = g_file_set_contents(filename, data, length, &error);
+    if(!flag)
+    {
+        g_warning("Shuffle state cannot be saved: %s", error->message);
+        g_error_free(error);
+    }
+    g_free(data);
+    return flag;
+}
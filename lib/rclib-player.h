@@ -130,6 +130,8 @@ RCLibPlayerRandomMode rclib_player_get_random_mode();
 void rclib_player_set_rating_limit(gboolean state, gfloat rating,
     gboolean condition);
 gboolean rclib_player_get_rating_limit(gfloat *rating, gboolean *condition);
+gboolean rclib_player_load_shuffle_state(const gchar *filename);
+gboolean rclib_player_save_shuffle_state(const gchar *filename);
 
 G_END_DECLS
 
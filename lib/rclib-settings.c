@@ -123,6 +123,9 @@ gboolean rclib_settings_init()
     rclib_settings_set_boolean("Player", "RatingLimitEnabled", FALSE);
     rclib_settings_set_boolean("Player", "RatingLimitCondition", FALSE);
     rclib_settings_set_double("Player", "RatingLimitValue", 3.0);
+    rclib_settings_set_integer("Player", "ReplayGainMode",
+        RCLIB_CORE_REPLAYGAIN_MODE_TRACK);
+    rclib_settings_set_double("Player", "ReplayGainPreamp", 0.0);
     rclib_settings_set_boolean("Player", "LoadLastPosition", FALSE);
     rclib_settings_set_integer("Player", "LastPlayedCatalog", 0);
     rclib_settings_set_integer("Player", "LastPlayedMusic", 0);
@@ -132,6 +135,10 @@ gboolean rclib_settings_init()
     rclib_settings_set_double("SoundEffect", "Balance", 0.0);
     rclib_settings_set_boolean("Playlist", "AutoEncodingDetect", TRUE);
     rclib_settings_set_boolean("Metadata", "AutoDetectEncoding", TRUE);
+    rclib_settings_set_integer("Database", "ImportWorkers", 0);
+    rclib_settings_set_integer("Database", "WatchLimit", 0);
+    rclib_settings_set_integer("Database", "WatchScanInterval", 0);
+    rclib_settings_set_boolean("Database", "GainAnalysis", TRUE);
     settings_dirty = FALSE;
     g_message("Settings module loaded.");
     return TRUE;
@@ -191,7 +198,10 @@ void rclib_settings_apply()
     gdouble *darray;
     gsize size;
     gchar *encoding, *id3_encoding;
+    gchar **watch_dirs;
     gboolean bvalue2;
+    gint ivalue2;
+    guint i;
     ivalue = rclib_settings_get_integer("Player", "AudioOutputPluginType",
         &error);
     if(error==NULL)
@@ -244,6 +254,29 @@ void rclib_settings_apply()
     bvalue2 = rclib_settings_get_boolean("Player", "RatingLimitCondition",
         NULL);
     rclib_player_set_rating_limit(bvalue, dvalue, bvalue2);
+    bvalue = rclib_settings_get_boolean("Player", "Gapless", NULL);
+    rclib_core_set_gapless(bvalue);
+    ivalue = rclib_settings_get_integer("Player", "CrossfadeDuration", NULL);
+    ivalue2 = rclib_settings_get_integer("Player", "CrossfadeCurve", NULL);
+    if(ivalue2<RCLIB_CORE_CROSSFADE_CURVE_LINEAR ||
+        ivalue2>RCLIB_CORE_CROSSFADE_CURVE_S_CURVE)
+        ivalue2 = RCLIB_CORE_CROSSFADE_CURVE_LINEAR;
+    if(ivalue>0)
+        rclib_core_set_crossfade((gint64)ivalue * GST_MSECOND, ivalue2);
+    ivalue = rclib_settings_get_integer("Player", "ReplayGainMode", &error);
+    if(error==NULL)
+    {
+        dvalue = rclib_settings_get_double("Player", "ReplayGainPreamp",
+            NULL);
+        if(ivalue>=RCLIB_CORE_REPLAYGAIN_MODE_NONE &&
+            ivalue<=RCLIB_CORE_REPLAYGAIN_MODE_ALBUM)
+            rclib_core_set_replaygain(ivalue, dvalue);
+    }
+    else
+    {
+        g_error_free(error);
+        error = NULL;
+    }
     ivalue = rclib_settings_get_integer("SoundEffect", "EQStyle", &error);
     if(error==NULL)
     {
@@ -267,6 +300,56 @@ void rclib_settings_apply()
     }
     dvalue = rclib_settings_get_double("SoundEffect", "Balance", NULL);
     rclib_core_set_balance(dvalue);
+    ivalue = rclib_settings_get_integer("Database", "ImportWorkers", &error);
+    if(error==NULL)
+    {
+        if(ivalue>=0)
+            rclib_db_import_set_worker_limit(ivalue);
+    }
+    else
+    {
+        g_error_free(error);
+        error = NULL;
+    }
+    ivalue = rclib_settings_get_integer("Database", "WatchLimit", &error);
+    if(error==NULL)
+    {
+        if(ivalue>=0)
+            rclib_db_library_watch_set_limit(ivalue);
+    }
+    else
+    {
+        g_error_free(error);
+        error = NULL;
+    }
+    ivalue = rclib_settings_get_integer("Database", "WatchScanInterval",
+        &error);
+    if(error==NULL)
+    {
+        if(ivalue>=0)
+            rclib_db_library_watch_set_scan_interval(ivalue);
+    }
+    else
+    {
+        g_error_free(error);
+        error = NULL;
+    }
+    bvalue = rclib_settings_get_boolean("Database", "GainAnalysis", &error);
+    if(error==NULL)
+        rclib_db_library_set_gain_analysis(bvalue);
+    else
+    {
+        g_error_free(error);
+        error = NULL;
+    }
+    watch_dirs = rclib_settings_get_string_list("Database",
+        "WatchDirectories", NULL, NULL);
+    if(watch_dirs!=NULL)
+    {
+        for(i=0;watch_dirs[i]!=NULL;i++)
+            rclib_db_library_watch_add_directory(watch_dirs[i]);
+        g_strfreev(watch_dirs);
+    }
     bvalue = rclib_settings_get_boolean("Metadata", "AutoDetectEncoding",
         NULL);
     if(bvalue)
@@ -322,10 +405,12 @@ void rclib_settings_apply()
 void rclib_settings_update()
 {
     gint ivalue;
+    gint64 lvalue = 0;
     gdouble dvalue;
     gdouble eq_array[10] = {0.0};
     gfloat fvalue;
     gboolean bvalue, bvalue2;
+    gchar **watch_dirs;
     RCLibCoreAudioOutputType output_type;
     RCLibCorePlaySource source_type = RCLIB_CORE_PLAY_SOURCE_NONE;
     gpointer db_reference = NULL;
@@ -343,6 +428,19 @@ void rclib_settings_update()
     rclib_settings_set_boolean("Player", "RatingLimitEnabled", bvalue);
     rclib_settings_set_boolean("Player", "RatingLimitCondition", bvalue2);
     rclib_settings_set_double("Player", "RatingLimitValue", fvalue);
+    bvalue = rclib_core_get_gapless();
+    rclib_settings_set_boolean("Player", "Gapless", bvalue);
+    ivalue = RCLIB_CORE_CROSSFADE_CURVE_LINEAR;
+    rclib_core_get_crossfade(&lvalue, (RCLibCoreCrossfadeCurve *)&ivalue);
+    rclib_settings_set_integer("Player", "CrossfadeDuration",
+        lvalue / GST_MSECOND);
+    rclib_settings_set_integer("Player", "CrossfadeCurve", ivalue);
+    if(rclib_core_get_replaygain((RCLibCoreReplayGainMode *)&ivalue,
+        &dvalue))
+    {
+        rclib_settings_set_integer("Player", "ReplayGainMode", ivalue);
+        rclib_settings_set_double("Player", "ReplayGainPreamp", dvalue);
+    }
     if(rclib_core_get_volume(&dvalue))
         rclib_settings_set_double("Player", "Volume", dvalue);
     if(rclib_core_get_eq((RCLibCoreEQType *)&ivalue, eq_array))
@@ -352,6 +450,21 @@ void rclib_settings_update()
     }
     if(rclib_core_get_balance(&fvalue))
         rclib_settings_set_double("SoundEffect", "Balance", fvalue);
+    ivalue = rclib_db_import_get_worker_limit();
+    rclib_settings_set_integer("Database", "ImportWorkers", ivalue);
+    ivalue = rclib_db_library_watch_get_limit();
+    rclib_settings_set_integer("Database", "WatchLimit", ivalue);
+    ivalue = rclib_db_library_watch_get_scan_interval();
+    rclib_settings_set_integer("Database", "WatchScanInterval", ivalue);
+    bvalue = rclib_db_library_get_gain_analysis();
+    rclib_settings_set_boolean("Database", "GainAnalysis", bvalue);
+    watch_dirs = rclib_db_library_watch_get_directories();
+    if(watch_dirs!=NULL)
+    {
+        rclib_settings_set_string_list("Database", "WatchDirectories",
+            (const gchar * const *)watch_dirs, g_strv_length(watch_dirs));
+        g_strfreev(watch_dirs);
+    }
     rclib_core_get_play_source(&source_type, &db_reference, NULL);
     if(db_reference!=NULL)
     {
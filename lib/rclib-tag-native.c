@@ -0,0 +1,1392 @@
+/*
+ * RhythmCat Library Native Tag Reader Module
+ * Read the tags of common music files without GStreamer.
+ *
+ * rclib-tag-native.c
+ * This file is part of RhythmCat Library (LibRhythmCat)
+ *
+ * Copyright (C) 2012 - SuperCat, license: GPL v3
+ *
+ * RhythmCat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RhythmCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RhythmCat; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA  02110-1301  USA
+ */
+
+#include "rclib-tag.h"
+#include "rclib-tag-priv.h"
+#include "rclib-common.h"
+#include <string.h>
+
+/*
+ * The native tag reader parses the headers of MPEG audio (ID3v2/ID3v1),
+ * FLAC, Ogg (Vorbis, Opus, FLAC) and MPEG-4 (AAC, ALAC) files directly
+ * from the memory mapped file, so that the importer does not need to
+ * pre-roll a GStreamer pipeline for each of them. Any file which cannot
+ * be parsed here is read by GStreamer in rclib_tag_read_metadata().
+ */
+
+#define TAG_NATIVE_MPEG_SYNC_SEARCH 65536
+#define TAG_NATIVE_OGG_PACKET_MAX 16777216
+#define TAG_NATIVE_OGG_PAGE_MAX 65307
+
+typedef struct RCLibTagNativeMpegHeader
+{
+    guint version;
+    guint layer;
+    guint bitrate;
+    guint samplerate;
+    guint channels;
+    guint frame_size;
+    guint samples;
+    guint mode;
+}RCLibTagNativeMpegHeader;
+
+static const gchar *tag_native_id3_genres[] = {
+    "Blues", "Classic Rock", "Country", "Dance", "Disco", "Funk", "Grunge",
+    "Hip-Hop", "Jazz", "Metal", "New Age", "Oldies", "Other", "Pop", "R&B",
+    "Rap", "Reggae", "Rock", "Techno", "Industrial", "Alternative", "Ska",
+    "Death Metal", "Pranks", "Soundtrack", "Euro-Techno", "Ambient",
+    "Trip-Hop", "Vocal", "Jazz+Funk", "Fusion", "Trance", "Classical",
+    "Instrumental", "Acid", "House", "Game", "Sound Clip", "Gospel", "Noise",
+    "Alternative Rock", "Bass", "Soul", "Punk", "Space", "Meditative",
+    "Instrumental Pop", "Instrumental Rock", "Ethnic", "Gothic", "Darkwave",
+    "Techno-Industrial", "Electronic", "Pop-Folk", "Eurodance", "Dream",
+    "Southern Rock", "Comedy", "Cult", "Gangsta", "Top 40", "Christian Rap",
+    "Pop/Funk", "Jungle", "Native American", "Cabaret", "New Wave",
+    "Psychedelic", "Rave", "Showtunes", "Trailer", "Lo-Fi", "Tribal",
+    "Acid Punk", "Acid Jazz", "Polka", "Retro", "Musical", "Rock & Roll",
+    "Hard Rock", "Folk", "Folk-Rock", "National Folk", "Swing", "Fast Fusion",
+    "Bebob", "Latin", "Revival", "Celtic", "Bluegrass", "Avantgarde",
+    "Gothic Rock", "Progressive Rock", "Psychedelic Rock", "Symphonic Rock",
+    "Slow Rock", "Big Band", "Chorus", "Easy Listening", "Acoustic", "Humour",
+    "Speech", "Chanson", "Opera", "Chamber Music", "Sonata", "Symphony",
+    "Booty Bass", "Primus", "Porn Groove", "Satire", "Slow Jam", "Club",
+    "Tango", "Samba", "Folklore", "Ballad", "Power Ballad", "Rhythmic Soul",
+    "Freestyle", "Duet", "Punk Rock", "Drum Solo", "A Capella", "Euro-House",
+    "Dance Hall", "Goa", "Drum & Bass", "Club-House", "Hardcore", "Terror",
+    "Indie", "BritPop", "Negerpunk", "Polsk Punk", "Beat",
+    "Christian Gangsta Rap", "Heavy Metal", "Black Metal", "Crossover",
+    "Contemporary Christian", "Christian Rock", "Merengue", "Salsa",
+    "Thrash Metal", "Anime", "JPop", "Synthpop"
+};
+
+static const guint tag_native_mpeg_bitrates[2][3][16] = {
+    {
+        {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416,
+            448, 0},
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384,
+            0},
+        {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320,
+            0}
+    },
+    {
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256,
+            0},
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0},
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0}
+    }
+};
+
+static const guint tag_native_mpeg_samplerates[3][3] = {
+    {44100, 48000, 32000},
+    {22050, 24000, 16000},
+    {11025, 12000, 8000}
+};
+
+static const gchar *tag_native_mpeg_versions[3] = {"1", "2", "2.5"};
+
+static inline guint16 rclib_tag_native_be16(const guint8 *p)
+{
+    return ((guint16)p[0] << 8) | p[1];
+}
+
+static inline guint32 rclib_tag_native_be24(const guint8 *p)
+{
+    return ((guint32)p[0] << 16) | ((guint32)p[1] << 8) | p[2];
+}
+
+static inline guint32 rclib_tag_native_be32(const guint8 *p)
+{
+    return ((guint32)p[0] << 24) | ((guint32)p[1] << 16) |
+        ((guint32)p[2] << 8) | p[3];
+}
+
+static inline guint64 rclib_tag_native_be64(const guint8 *p)
+{
+    return ((guint64)rclib_tag_native_be32(p) << 32) |
+        rclib_tag_native_be32(p+4);
+}
+
+static inline guint16 rclib_tag_native_le16(const guint8 *p)
+{
+    return ((guint16)p[1] << 8) | p[0];
+}
+
+static inline guint32 rclib_tag_native_le32(const guint8 *p)
+{
+    return ((guint32)p[3] << 24) | ((guint32)p[2] << 16) |
+        ((guint32)p[1] << 8) | p[0];
+}
+
+static inline guint64 rclib_tag_native_le64(const guint8 *p)
+{
+    return ((guint64)rclib_tag_native_le32(p+4) << 32) |
+        rclib_tag_native_le32(p);
+}
+
+static inline guint32 rclib_tag_native_synchsafe32(const guint8 *p)
+{
+    return ((guint32)(p[0] & 0x7F) << 21) | ((guint32)(p[1] & 0x7F) << 14) |
+        ((guint32)(p[2] & 0x7F) << 7) | (p[3] & 0x7F);
+}
+
+/*
+ * Set the string field only if it is not set yet, the string will be
+ * freed if it is not used.
+ */
+
+static void rclib_tag_native_set_string(gchar **field, gchar *str)
+{
+    if(str!=NULL) g_strstrip(str);
+    if(str==NULL || *str=='\0' || *field!=NULL)
+    {
+        g_free(str);
+        return;
+    }
+    *field = str;
+}
+
+static void rclib_tag_native_set_year(RCLibTagMetadata *mmd,
+    const gchar *str)
+{
+    gint64 year;
+    if(str==NULL || mmd->year!=0) return;
+    year = g_ascii_strtoll(str, NULL, 10);
+    if(year>0 && year<10000)
+        mmd->year = year;
+}
+
+static void rclib_tag_native_set_tracknum(RCLibTagMetadata *mmd,
+    const gchar *str)
+{
+    guint64 track;
+    if(str==NULL || mmd->tracknum!=0) return;
+    track = g_ascii_strtoull(str, NULL, 10);
+    if(track>0 && track<G_MAXUINT)
+        mmd->tracknum = track;
+}
+
+/*
+ * Set the ReplayGain value if the key is a ReplayGain key, the value is
+ * like "-6.48 dB" for gains and "0.988" for peaks.
+ */
+
+static gboolean rclib_tag_native_set_gain(RCLibTagMetadata *mmd,
+    const gchar *key, gsize key_len, const gchar *value)
+{
+    static const gchar *gain_keys[] = {"REPLAYGAIN_TRACK_GAIN",
+        "REPLAYGAIN_TRACK_PEAK", "REPLAYGAIN_ALBUM_GAIN",
+        "REPLAYGAIN_ALBUM_PEAK"};
+    gdouble number;
+    gchar *end = NULL;
+    guint i;
+    for(i=0;i<G_N_ELEMENTS(gain_keys);i++)
+    {
+        if(strlen(gain_keys[i])==key_len &&
+            g_ascii_strncasecmp(key, gain_keys[i], key_len)==0)
+            break;
+    }
+    if(i>=G_N_ELEMENTS(gain_keys)) return FALSE;
+    if(value==NULL) return TRUE;
+    number = g_ascii_strtod(value, &end);
+    if(end==value) return TRUE;
+    switch(i)
+    {
+        case 0:
+            mmd->track_gain = number;
+            mmd->track_gain_flag = TRUE;
+            break;
+        case 1:
+            mmd->track_peak = number;
+            break;
+        case 2:
+            mmd->album_gain = number;
+            mmd->album_gain_flag = TRUE;
+            break;
+        default:
+            mmd->album_peak = number;
+            break;
+    }
+    return TRUE;
+}
+
+static gchar *rclib_tag_native_genre_from_id(gint id)
+{
+    if(id<0 || id>=(gint)G_N_ELEMENTS(tag_native_id3_genres)) return NULL;
+    return g_strdup(tag_native_id3_genres[id]);
+}
+
+static gsize rclib_tag_native_strnlen(const guint8 *data, gsize len)
+{
+    const guint8 *end;
+    end = memchr(data, 0, len);
+    if(end==NULL) return len;
+    return end - data;
+}
+
+static gsize rclib_tag_native_utf16_strnlen(const guint8 *data, gsize len)
+{
+    gsize i;
+    for(i=0;i+1<len;i+=2)
+    {
+        if(data[i]==0 && data[i+1]==0)
+            return i;
+    }
+    return len - (len % 2);
+}
+
+/*
+ * Convert the 8-bit text to UTF-8, the text is assumed to be in
+ * ISO-8859-1 if it is neither valid UTF-8 nor in the fallback encoding.
+ */
+
+static gchar *rclib_tag_native_latin1_to_utf8(const guint8 *data, gsize len)
+{
+    const gchar *fallback;
+    gchar **encodings;
+    gchar *str = NULL;
+    guint i;
+    len = rclib_tag_native_strnlen(data, len);
+    if(len==0) return NULL;
+    if(g_utf8_validate((const gchar *)data, len, NULL))
+        return g_strndup((const gchar *)data, len);
+    fallback = rclib_tag_get_fallback_encoding();
+    if(fallback!=NULL && *fallback!='\0')
+    {
+        encodings = g_strsplit(fallback, ":", -1);
+        for(i=0;encodings[i]!=NULL && str==NULL;i++)
+        {
+            if(*encodings[i]=='\0') continue;
+            if(g_ascii_strcasecmp(encodings[i], "UTF-8")==0) continue;
+            str = g_convert((const gchar *)data, len, "UTF-8",
+                encodings[i], NULL, NULL, NULL);
+        }
+        g_strfreev(encodings);
+    }
+    if(str==NULL)
+    {
+        str = g_convert((const gchar *)data, len, "UTF-8", "ISO-8859-1",
+            NULL, NULL, NULL);
+    }
+    return str;
+}
+
+static gchar *rclib_tag_native_id3v2_text(const guint8 *data, gsize len,
+    guint8 encoding)
+{
+    const gchar *charset = "UTF-16LE";
+    gchar *str = NULL;
+    switch(encoding)
+    {
+        case 0:
+        {
+            str = rclib_tag_native_latin1_to_utf8(data, len);
+            break;
+        }
+        case 1:
+        case 2:
+        {
+            if(encoding==2)
+                charset = "UTF-16BE";
+            if(len>=2 && data[0]==0xFF && data[1]==0xFE)
+            {
+                charset = "UTF-16LE";
+                data += 2;
+                len -= 2;
+            }
+            else if(len>=2 && data[0]==0xFE && data[1]==0xFF)
+            {
+                charset = "UTF-16BE";
+                data += 2;
+                len -= 2;
+            }
+            len = rclib_tag_native_utf16_strnlen(data, len);
+            if(len==0) break;
+            str = g_convert((const gchar *)data, len, "UTF-8", charset,
+                NULL, NULL, NULL);
+            break;
+        }
+        case 3:
+        {
+            len = rclib_tag_native_strnlen(data, len);
+            if(len==0) break;
+            if(g_utf8_validate((const gchar *)data, len, NULL))
+                str = g_strndup((const gchar *)data, len);
+            break;
+        }
+        default:
+            break;
+    }
+    return str;
+}
+
+/*
+ * Return the length of the terminated string (including the terminator)
+ * at the beginning of the ID3v2 frame data.
+ */
+
+static gsize rclib_tag_native_id3v2_text_skip(const guint8 *data, gsize len,
+    guint8 encoding)
+{
+    gsize i;
+    if(encoding==1 || encoding==2)
+    {
+        for(i=0;i+1<len;i+=2)
+        {
+            if(data[i]==0 && data[i+1]==0)
+                return i + 2;
+        }
+        return len;
+    }
+    for(i=0;i<len;i++)
+    {
+        if(data[i]==0)
+            return i + 1;
+    }
+    return len;
+}
+
+static gchar *rclib_tag_native_id3v2_genre(gchar *str)
+{
+    gchar *genre = NULL;
+    gchar *end = NULL;
+    gint64 id;
+    if(str==NULL) return NULL;
+    if(str[0]=='(' && g_ascii_isdigit(str[1]))
+    {
+        id = g_ascii_strtoll(str+1, &end, 10);
+        if(end!=NULL && *end==')')
+        {
+            if(end[1]!='\0')
+                genre = g_strdup(end+1);
+            else
+                genre = rclib_tag_native_genre_from_id(id);
+        }
+    }
+    else if(g_ascii_isdigit(str[0]))
+    {
+        id = g_ascii_strtoll(str, &end, 10);
+        if(end!=NULL && *end=='\0')
+            genre = rclib_tag_native_genre_from_id(id);
+    }
+    else if(strcmp(str, "(RX)")==0)
+        genre = g_strdup("Remix");
+    else if(strcmp(str, "(CR)")==0)
+        genre = g_strdup("Cover");
+    if(genre==NULL)
+        return str;
+    g_free(str);
+    return genre;
+}
+
+static void rclib_tag_native_id3v2_frame(RCLibTagMetadata *mmd,
+    const gchar *id, const guint8 *data, gsize len, gint64 *tlen)
+{
+    gchar *str, *value;
+    gsize skip;
+    guint8 encoding;
+    if(len<2) return;
+    encoding = data[0];
+    if(strcmp(id, "TIT2")==0 || strcmp(id, "TT2")==0)
+    {
+        rclib_tag_native_set_string(&(mmd->title),
+            rclib_tag_native_id3v2_text(data+1, len-1, encoding));
+    }
+    else if(strcmp(id, "TPE1")==0 || strcmp(id, "TP1")==0)
+    {
+        rclib_tag_native_set_string(&(mmd->artist),
+            rclib_tag_native_id3v2_text(data+1, len-1, encoding));
+    }
+    else if(strcmp(id, "TALB")==0 || strcmp(id, "TAL")==0)
+    {
+        rclib_tag_native_set_string(&(mmd->album),
+            rclib_tag_native_id3v2_text(data+1, len-1, encoding));
+    }
+    else if(strcmp(id, "TCON")==0 || strcmp(id, "TCO")==0)
+    {
+        str = rclib_tag_native_id3v2_text(data+1, len-1, encoding);
+        rclib_tag_native_set_string(&(mmd->genre),
+            rclib_tag_native_id3v2_genre(str));
+    }
+    else if(strcmp(id, "TRCK")==0 || strcmp(id, "TRK")==0)
+    {
+        str = rclib_tag_native_id3v2_text(data+1, len-1, encoding);
+        rclib_tag_native_set_tracknum(mmd, str);
+        g_free(str);
+    }
+    else if(strcmp(id, "TYER")==0 || strcmp(id, "TYE")==0 ||
+        strcmp(id, "TDRC")==0)
+    {
+        str = rclib_tag_native_id3v2_text(data+1, len-1, encoding);
+        rclib_tag_native_set_year(mmd, str);
+        g_free(str);
+    }
+    else if(strcmp(id, "TLEN")==0 || strcmp(id, "TLE")==0)
+    {
+        str = rclib_tag_native_id3v2_text(data+1, len-1, encoding);
+        if(str!=NULL)
+            *tlen = g_ascii_strtoll(str, NULL, 10) * GST_MSECOND;
+        g_free(str);
+    }
+    else if(strcmp(id, "COMM")==0 || strcmp(id, "COM")==0)
+    {
+        /* Encoding, language, short description, then the text. */
+        if(len<5) return;
+        skip = 4 + rclib_tag_native_id3v2_text_skip(data+4, len-4,
+            encoding);
+        if(skip>=len) return;
+        rclib_tag_native_set_string(&(mmd->comment),
+            rclib_tag_native_id3v2_text(data+skip, len-skip, encoding));
+    }
+    else if(strcmp(id, "TXXX")==0 || strcmp(id, "TXX")==0)
+    {
+        str = rclib_tag_native_id3v2_text(data+1, len-1, encoding);
+        skip = 1 + rclib_tag_native_id3v2_text_skip(data+1, len-1,
+            encoding);
+        if(str!=NULL && skip<len && g_ascii_strcasecmp(str, "CUESHEET")==0)
+        {
+            rclib_tag_native_set_string(&(mmd->emb_cue),
+                rclib_tag_native_id3v2_text(data+skip, len-skip, encoding));
+        }
+        else if(str!=NULL && skip<len)
+        {
+            value = rclib_tag_native_id3v2_text(data+skip, len-skip,
+                encoding);
+            rclib_tag_native_set_gain(mmd, str, strlen(str), value);
+            g_free(value);
+        }
+        g_free(str);
+    }
+}
+
+/*
+ * Remove the unsynchronisation scheme (0xFF 0x00 -> 0xFF) from the data,
+ * the returned data should be freed after usage.
+ */
+
+static guint8 *rclib_tag_native_id3v2_unsync(const guint8 *data, gsize len,
+    gsize *new_len)
+{
+    guint8 *buffer;
+    gsize i, j;
+    buffer = g_malloc(len>0 ? len : 1);
+    for(i=0, j=0;i<len;i++)
+    {
+        buffer[j++] = data[i];
+        if(data[i]==0xFF && i+1<len && data[i+1]==0x00)
+            i++;
+    }
+    *new_len = j;
+    return buffer;
+}
+
+/*
+ * Parse the ID3v2 tag at the beginning of the data, and return the
+ * size of the whole tag (0 if there is no ID3v2 tag).
+ */
+
+static gsize rclib_tag_native_parse_id3v2(RCLibTagMetadata *mmd,
+    const guint8 *data, gsize size, gint64 *tlen)
+{
+    guint8 major, flags;
+    gsize total, end, body_len, pos = 0, header_size;
+    gsize frame_len, unsync_len;
+    guint32 frame_size;
+    guint16 frame_flags = 0;
+    const guint8 *body, *frame_data;
+    guint8 *body_buffer = NULL, *frame_buffer;
+    gchar id[5] = {0};
+    if(size<10 || memcmp(data, "ID3", 3)!=0) return 0;
+    major = data[3];
+    flags = data[5];
+    total = 10 + rclib_tag_native_synchsafe32(data+6);
+    if(flags & 0x10) total += 10;
+    if(major<2 || major>4) return total;
+    if(major==2 && (flags & 0x40)) return total;
+    end = MIN(10 + (gsize)rclib_tag_native_synchsafe32(data+6), size);
+    body = data + 10;
+    body_len = end - 10;
+    if((flags & 0x80) && major<4)
+    {
+        body_buffer = rclib_tag_native_id3v2_unsync(body, body_len,
+            &body_len);
+        body = body_buffer;
+    }
+    if((flags & 0x40) && body_len>=4)
+    {
+        if(major==3)
+            pos = rclib_tag_native_be32(body) + 4;
+        else
+            pos = rclib_tag_native_synchsafe32(body);
+    }
+    header_size = (major==2) ? 6 : 10;
+    while(pos+header_size<=body_len)
+    {
+        if(body[pos]==0) break;
+        if(major==2)
+        {
+            memcpy(id, body+pos, 3);
+            id[3] = 0;
+            frame_size = rclib_tag_native_be24(body+pos+3);
+        }
+        else
+        {
+            memcpy(id, body+pos, 4);
+            if(major==4)
+                frame_size = rclib_tag_native_synchsafe32(body+pos+4);
+            else
+                frame_size = rclib_tag_native_be32(body+pos+4);
+            frame_flags = rclib_tag_native_be16(body+pos+8);
+        }
+        pos += header_size;
+        if(frame_size>body_len-pos) break;
+        frame_data = body + pos;
+        frame_len = frame_size;
+        frame_buffer = NULL;
+        pos += frame_size;
+        if(major==3)
+        {
+            if(frame_flags & 0x00C0) continue;
+            if((frame_flags & 0x0020) && frame_len>0)
+            {
+                frame_data++;
+                frame_len--;
+            }
+        }
+        else if(major==4)
+        {
+            if(frame_flags & 0x000C) continue;
+            if((frame_flags & 0x0040) && frame_len>0)
+            {
+                frame_data++;
+                frame_len--;
+            }
+            if((frame_flags & 0x0001) && frame_len>=4)
+            {
+                frame_data += 4;
+                frame_len -= 4;
+            }
+            if(frame_flags & 0x0002)
+            {
+                frame_buffer = rclib_tag_native_id3v2_unsync(frame_data,
+                    frame_len, &unsync_len);
+                frame_data = frame_buffer;
+                frame_len = unsync_len;
+            }
+        }
+        rclib_tag_native_id3v2_frame(mmd, id, frame_data, frame_len, tlen);
+        g_free(frame_buffer);
+    }
+    g_free(body_buffer);
+    return total;
+}
+
+static void rclib_tag_native_parse_id3v1(RCLibTagMetadata *mmd,
+    const guint8 *data)
+{
+    gchar *str;
+    rclib_tag_native_set_string(&(mmd->title),
+        rclib_tag_native_latin1_to_utf8(data+3, 30));
+    rclib_tag_native_set_string(&(mmd->artist),
+        rclib_tag_native_latin1_to_utf8(data+33, 30));
+    rclib_tag_native_set_string(&(mmd->album),
+        rclib_tag_native_latin1_to_utf8(data+63, 30));
+    str = g_strndup((const gchar *)data+93, 4);
+    rclib_tag_native_set_year(mmd, str);
+    g_free(str);
+    if(data[125]==0 && data[126]!=0)
+    {
+        rclib_tag_native_set_string(&(mmd->comment),
+            rclib_tag_native_latin1_to_utf8(data+97, 28));
+        if(mmd->tracknum==0)
+            mmd->tracknum = data[126];
+    }
+    else
+    {
+        rclib_tag_native_set_string(&(mmd->comment),
+            rclib_tag_native_latin1_to_utf8(data+97, 30));
+    }
+    rclib_tag_native_set_string(&(mmd->genre),
+        rclib_tag_native_genre_from_id(data[127]));
+}
+
+static gboolean rclib_tag_native_mpeg_header(const guint8 *p,
+    RCLibTagNativeMpegHeader *header)
+{
+    guint32 value;
+    guint version_bits, layer_bits, bitrate_index, samplerate_index;
+    guint padding;
+    value = rclib_tag_native_be32(p);
+    if((value & 0xFFE00000)!=0xFFE00000) return FALSE;
+    version_bits = (value >> 19) & 0x3;
+    layer_bits = (value >> 17) & 0x3;
+    bitrate_index = (value >> 12) & 0xF;
+    samplerate_index = (value >> 10) & 0x3;
+    padding = (value >> 9) & 0x1;
+    if(version_bits==1 || layer_bits==0) return FALSE;
+    if(bitrate_index==0 || bitrate_index==15) return FALSE;
+    if(samplerate_index==3) return FALSE;
+    switch(version_bits)
+    {
+        case 3:
+            header->version = 0;
+            break;
+        case 2:
+            header->version = 1;
+            break;
+        default:
+            header->version = 2;
+            break;
+    }
+    header->layer = 4 - layer_bits;
+    header->mode = (value >> 6) & 0x3;
+    header->channels = (header->mode==3) ? 1 : 2;
+    header->bitrate = tag_native_mpeg_bitrates[header->version>0 ? 1 : 0]
+        [header->layer-1][bitrate_index] * 1000;
+    header->samplerate = tag_native_mpeg_samplerates[header->version]
+        [samplerate_index];
+    if(header->layer==1)
+    {
+        header->samples = 384;
+        header->frame_size = (12 * header->bitrate / header->samplerate +
+            padding) * 4;
+    }
+    else
+    {
+        if(header->layer==3 && header->version>0)
+            header->samples = 576;
+        else
+            header->samples = 1152;
+        header->frame_size = header->samples / 8 * header->bitrate /
+            header->samplerate + padding;
+    }
+    return header->frame_size>4;
+}
+
+/*
+ * Find the first MPEG audio frame, a frame is only accepted if it is
+ * followed by another frame with the same format.
+ */
+
+static gboolean rclib_tag_native_mpeg_find_frame(const guint8 *data,
+    gsize size, gsize offset, gsize search_len, gsize *frame_offset,
+    RCLibTagNativeMpegHeader *header)
+{
+    RCLibTagNativeMpegHeader next;
+    gsize pos, end, next_pos;
+    end = MIN(size, offset + search_len);
+    for(pos=offset;pos+4<=end;pos++)
+    {
+        if(data[pos]!=0xFF || (data[pos+1] & 0xE0)!=0xE0) continue;
+        if(!rclib_tag_native_mpeg_header(data+pos, header)) continue;
+        next_pos = pos + header->frame_size;
+        if(next_pos+4<=size)
+        {
+            if(!rclib_tag_native_mpeg_header(data+next_pos, &next))
+                continue;
+            if(next.version!=header->version || next.layer!=header->layer ||
+                next.samplerate!=header->samplerate)
+                continue;
+        }
+        *frame_offset = pos;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static gboolean rclib_tag_native_parse_mpeg(RCLibTagMetadata *mmd,
+    const guint8 *data, gsize size)
+{
+    RCLibTagNativeMpegHeader header;
+    gsize offset, frame_offset, side_info, audio_end;
+    const guint8 *xing;
+    guint32 frames = 0;
+    gint64 tlen = 0;
+    offset = rclib_tag_native_parse_id3v2(mmd, data, size, &tlen);
+    if(offset>=size) return FALSE;
+    if(!rclib_tag_native_mpeg_find_frame(data, size, offset,
+        offset>0 ? TAG_NATIVE_MPEG_SYNC_SEARCH : 4, &frame_offset, &header))
+        return FALSE;
+    audio_end = size;
+    if(size>=128 && size-128>frame_offset &&
+        memcmp(data+size-128, "TAG", 3)==0)
+    {
+        rclib_tag_native_parse_id3v1(mmd, data+size-128);
+        audio_end = size - 128;
+    }
+    if(header.version==0)
+        side_info = (header.mode==3) ? 17 : 32;
+    else
+        side_info = (header.mode==3) ? 9 : 17;
+    xing = data + frame_offset + 4 + side_info;
+    if(frame_offset+4+side_info+12<=size && (memcmp(xing, "Xing", 4)==0 ||
+        memcmp(xing, "Info", 4)==0))
+    {
+        if(rclib_tag_native_be32(xing+4) & 0x1)
+            frames = rclib_tag_native_be32(xing+8);
+    }
+    xing = data + frame_offset + 36;
+    if(frames==0 && frame_offset+36+18<=size && memcmp(xing, "VBRI", 4)==0)
+        frames = rclib_tag_native_be32(xing+14);
+    if(frames>0)
+    {
+        mmd->length = gst_util_uint64_scale((guint64)frames * header.samples,
+            GST_SECOND, header.samplerate);
+        if(mmd->length>0)
+        {
+            mmd->bitrate = gst_util_uint64_scale(audio_end - frame_offset,
+                8 * GST_SECOND, mmd->length);
+        }
+    }
+    else
+    {
+        mmd->length = gst_util_uint64_scale(audio_end - frame_offset,
+            8 * GST_SECOND, header.bitrate);
+        mmd->bitrate = header.bitrate;
+    }
+    if(mmd->length<=0 && tlen>0)
+        mmd->length = tlen;
+    mmd->samplerate = header.samplerate;
+    mmd->channels = header.channels;
+    mmd->ftype = g_strdup_printf("MPEG-%s Layer %u (MP%u)",
+        tag_native_mpeg_versions[header.version], header.layer, header.layer);
+    return TRUE;
+}
+
+static gboolean rclib_tag_native_key_equal(const guint8 *key, gsize len,
+    const gchar *name)
+{
+    if(strlen(name)!=len) return FALSE;
+    return g_ascii_strncasecmp((const gchar *)key, name, len)==0;
+}
+
+static void rclib_tag_native_parse_vorbis_comment(RCLibTagMetadata *mmd,
+    const guint8 *data, gsize len)
+{
+    guint32 count, i, comment_len;
+    gsize pos, key_len;
+    const guint8 *comment, *eq;
+    gchar *value;
+    if(len<8) return;
+    pos = 4 + (gsize)rclib_tag_native_le32(data);
+    if(pos+4>len || pos<4) return;
+    count = rclib_tag_native_le32(data+pos);
+    pos += 4;
+    for(i=0;i<count && pos+4<=len;i++)
+    {
+        comment_len = rclib_tag_native_le32(data+pos);
+        pos += 4;
+        if(comment_len>len-pos) break;
+        comment = data + pos;
+        pos += comment_len;
+        eq = memchr(comment, '=', comment_len);
+        if(eq==NULL) continue;
+        key_len = eq - comment;
+        if(!g_utf8_validate((const gchar *)eq+1, comment_len-key_len-1,
+            NULL))
+            continue;
+        value = g_strndup((const gchar *)eq+1, comment_len-key_len-1);
+        if(rclib_tag_native_key_equal(comment, key_len, "TITLE"))
+            rclib_tag_native_set_string(&(mmd->title), value);
+        else if(rclib_tag_native_key_equal(comment, key_len, "ARTIST"))
+            rclib_tag_native_set_string(&(mmd->artist), value);
+        else if(rclib_tag_native_key_equal(comment, key_len, "ALBUM"))
+            rclib_tag_native_set_string(&(mmd->album), value);
+        else if(rclib_tag_native_key_equal(comment, key_len, "GENRE"))
+            rclib_tag_native_set_string(&(mmd->genre), value);
+        else if(rclib_tag_native_key_equal(comment, key_len, "COMMENT") ||
+            rclib_tag_native_key_equal(comment, key_len, "DESCRIPTION"))
+            rclib_tag_native_set_string(&(mmd->comment), value);
+        else if(rclib_tag_native_key_equal(comment, key_len, "CUESHEET"))
+            rclib_tag_native_set_string(&(mmd->emb_cue), value);
+        else if(rclib_tag_native_key_equal(comment, key_len, "TRACKNUMBER"))
+        {
+            rclib_tag_native_set_tracknum(mmd, value);
+            g_free(value);
+        }
+        else if(rclib_tag_native_key_equal(comment, key_len, "DATE"))
+        {
+            rclib_tag_native_set_year(mmd, value);
+            g_free(value);
+        }
+        else
+        {
+            rclib_tag_native_set_gain(mmd, (const gchar *)comment, key_len,
+                value);
+            g_free(value);
+        }
+    }
+}
+
+/*
+ * Parse the STREAMINFO metadata block of FLAC (34 bytes).
+ */
+
+static gboolean rclib_tag_native_parse_flac_streaminfo(
+    RCLibTagMetadata *mmd, const guint8 *data, gsize len)
+{
+    guint64 total_samples;
+    if(len<34) return FALSE;
+    mmd->samplerate = ((guint)data[10] << 12) | ((guint)data[11] << 4) |
+        (data[12] >> 4);
+    mmd->channels = ((data[12] >> 1) & 0x7) + 1;
+    total_samples = ((guint64)(data[13] & 0x0F) << 32) |
+        rclib_tag_native_be32(data+14);
+    if(mmd->samplerate<=0) return FALSE;
+    mmd->length = gst_util_uint64_scale(total_samples, GST_SECOND,
+        mmd->samplerate);
+    return TRUE;
+}
+
+static gboolean rclib_tag_native_parse_flac(RCLibTagMetadata *mmd,
+    const guint8 *data, gsize size, gsize offset)
+{
+    gboolean streaminfo_flag = FALSE;
+    gboolean last_flag = FALSE;
+    gsize pos, block_len;
+    guint8 block_type;
+    if(offset+4>size || memcmp(data+offset, "fLaC", 4)!=0) return FALSE;
+    pos = offset + 4;
+    while(!last_flag)
+    {
+        if(pos+4>size) return FALSE;
+        last_flag = (data[pos] & 0x80)!=0;
+        block_type = data[pos] & 0x7F;
+        block_len = rclib_tag_native_be24(data+pos+1);
+        pos += 4;
+        if(block_len>size-pos) return FALSE;
+        if(block_type==0)
+        {
+            streaminfo_flag = rclib_tag_native_parse_flac_streaminfo(mmd,
+                data+pos, block_len);
+        }
+        else if(block_type==4)
+            rclib_tag_native_parse_vorbis_comment(mmd, data+pos, block_len);
+        else if(block_type==127)
+            return FALSE;
+        pos += block_len;
+    }
+    if(!streaminfo_flag) return FALSE;
+    if(mmd->length>0)
+    {
+        mmd->bitrate = gst_util_uint64_scale(size - pos, 8 * GST_SECOND,
+            mmd->length);
+    }
+    mmd->ftype = g_strdup("Free Lossless Audio Codec (FLAC)");
+    return TRUE;
+}
+
+static gboolean rclib_tag_native_parse_ogg(RCLibTagMetadata *mmd,
+    const guint8 *data, gsize size)
+{
+    GByteArray *packet;
+    gsize pos = 0, body, body_len, lower, i;
+    guint32 serial = 0, page_serial;
+    guint segments, segment, packet_count = 0;
+    guint64 granule, granule_rate = 0;
+    guint pre_skip = 0, nominal_bitrate = 0;
+    gboolean first_page = TRUE;
+    gboolean error_flag = FALSE;
+    const guint8 *p;
+    enum {
+        TAG_NATIVE_OGG_NONE,
+        TAG_NATIVE_OGG_VORBIS,
+        TAG_NATIVE_OGG_OPUS,
+        TAG_NATIVE_OGG_FLAC
+    }codec = TAG_NATIVE_OGG_NONE;
+    packet = g_byte_array_new();
+    while(pos+27<=size && packet_count<2 && !error_flag)
+    {
+        if(memcmp(data+pos, "OggS", 4)!=0) break;
+        segments = data[pos+26];
+        if(pos+27+segments>size) break;
+        page_serial = rclib_tag_native_le32(data+pos+14);
+        body = pos + 27 + segments;
+        for(i=0, body_len=0;i<segments;i++)
+            body_len += data[pos+27+i];
+        if(body+body_len>size) break;
+        if(first_page)
+        {
+            serial = page_serial;
+            first_page = FALSE;
+        }
+        if(page_serial!=serial)
+        {
+            pos = body + body_len;
+            continue;
+        }
+        for(i=0;i<segments && packet_count<2;i++)
+        {
+            segment = data[pos+27+i];
+            g_byte_array_append(packet, data+body, segment);
+            body += segment;
+            if(packet->len>TAG_NATIVE_OGG_PACKET_MAX)
+            {
+                error_flag = TRUE;
+                break;
+            }
+            if(segment==255) continue;
+            p = packet->data;
+            if(packet_count==0)
+            {
+                if(packet->len>=30 && p[0]==0x01 &&
+                    memcmp(p+1, "vorbis", 6)==0)
+                {
+                    codec = TAG_NATIVE_OGG_VORBIS;
+                    mmd->channels = p[11];
+                    mmd->samplerate = rclib_tag_native_le32(p+12);
+                    nominal_bitrate = rclib_tag_native_le32(p+20);
+                    granule_rate = mmd->samplerate;
+                }
+                else if(packet->len>=19 && memcmp(p, "OpusHead", 8)==0)
+                {
+                    codec = TAG_NATIVE_OGG_OPUS;
+                    mmd->channels = p[9];
+                    pre_skip = rclib_tag_native_le16(p+10);
+                    mmd->samplerate = 48000;
+                    granule_rate = 48000;
+                }
+                else if(packet->len>=51 && p[0]==0x7F &&
+                    memcmp(p+1, "FLAC", 4)==0 && memcmp(p+9, "fLaC", 4)==0)
+                {
+                    codec = TAG_NATIVE_OGG_FLAC;
+                    if(rclib_tag_native_parse_flac_streaminfo(mmd, p+17,
+                        packet->len-17))
+                        granule_rate = mmd->samplerate;
+                }
+                if(codec==TAG_NATIVE_OGG_NONE || granule_rate==0)
+                {
+                    error_flag = TRUE;
+                    break;
+                }
+            }
+            else
+            {
+                if(codec==TAG_NATIVE_OGG_VORBIS && packet->len>=7 &&
+                    p[0]==0x03 && memcmp(p+1, "vorbis", 6)==0)
+                {
+                    rclib_tag_native_parse_vorbis_comment(mmd, p+7,
+                        packet->len-7);
+                }
+                else if(codec==TAG_NATIVE_OGG_OPUS && packet->len>=8 &&
+                    memcmp(p, "OpusTags", 8)==0)
+                {
+                    rclib_tag_native_parse_vorbis_comment(mmd, p+8,
+                        packet->len-8);
+                }
+                else if(codec==TAG_NATIVE_OGG_FLAC && packet->len>=4 &&
+                    (p[0] & 0x7F)==4)
+                {
+                    rclib_tag_native_parse_vorbis_comment(mmd, p+4,
+                        packet->len-4);
+                }
+            }
+            packet_count++;
+            g_byte_array_set_size(packet, 0);
+        }
+        pos = pos + 27 + segments + body_len;
+    }
+    g_byte_array_unref(packet);
+    if(error_flag || packet_count<1 || codec==TAG_NATIVE_OGG_NONE)
+        return FALSE;
+    /* Search the last page of the stream for the granule position. */
+    lower = size>TAG_NATIVE_OGG_PAGE_MAX*2 ? size-TAG_NATIVE_OGG_PAGE_MAX*2 :
+        0;
+    for(i=size>=27 ? size-27 : 0;size>=27 && i+1>lower;i--)
+    {
+        p = data + i;
+        if(p[0]=='O' && memcmp(p, "OggS", 4)==0 &&
+            rclib_tag_native_le32(p+14)==serial)
+        {
+            granule = rclib_tag_native_le64(p+6);
+            if(granule!=G_MAXUINT64)
+            {
+                if(codec==TAG_NATIVE_OGG_OPUS)
+                    granule = granule>pre_skip ? granule-pre_skip : 0;
+                mmd->length = gst_util_uint64_scale(granule, GST_SECOND,
+                    granule_rate);
+                break;
+            }
+        }
+        if(i==0) break;
+    }
+    if(codec==TAG_NATIVE_OGG_VORBIS && nominal_bitrate>0 &&
+        nominal_bitrate<G_MAXINT32)
+        mmd->bitrate = nominal_bitrate;
+    else if(mmd->length>0)
+    {
+        mmd->bitrate = gst_util_uint64_scale(size, 8 * GST_SECOND,
+            mmd->length);
+    }
+    switch(codec)
+    {
+        case TAG_NATIVE_OGG_VORBIS:
+            mmd->ftype = g_strdup("Vorbis");
+            break;
+        case TAG_NATIVE_OGG_OPUS:
+            mmd->ftype = g_strdup("Opus");
+            break;
+        default:
+            mmd->ftype = g_strdup("Free Lossless Audio Codec (FLAC)");
+            break;
+    }
+    return TRUE;
+}
+
+/*
+ * Find the first child atom with the given type in the range
+ * [start, end), and return the range of its body.
+ */
+
+static gboolean rclib_tag_native_mp4_find(const guint8 *data, gsize start,
+    gsize end, const gchar *type, gsize *body_start, gsize *body_end)
+{
+    gsize pos = start;
+    guint64 atom_size;
+    gsize header_size;
+    while(pos+8<=end)
+    {
+        atom_size = rclib_tag_native_be32(data+pos);
+        header_size = 8;
+        if(atom_size==1)
+        {
+            if(pos+16>end) return FALSE;
+            atom_size = rclib_tag_native_be64(data+pos+8);
+            header_size = 16;
+        }
+        else if(atom_size==0)
+            atom_size = end - pos;
+        if(atom_size<header_size || atom_size>end-pos) return FALSE;
+        if(memcmp(data+pos+4, type, 4)==0)
+        {
+            *body_start = pos + header_size;
+            *body_end = pos + atom_size;
+            return TRUE;
+        }
+        pos += atom_size;
+    }
+    return FALSE;
+}
+
+static void rclib_tag_native_parse_mp4_ilst(RCLibTagMetadata *mmd,
+    const guint8 *data, gsize start, gsize end)
+{
+    gsize pos = start, item_end, data_start, data_end, len;
+    gsize name_start, name_end;
+    guint32 item_size;
+    const guint8 *type, *payload;
+    gchar *str;
+    while(pos+8<=end)
+    {
+        item_size = rclib_tag_native_be32(data+pos);
+        if(item_size<8 || item_size>end-pos) break;
+        type = data + pos + 4;
+        item_end = pos + item_size;
+        if(rclib_tag_native_mp4_find(data, pos+8, item_end, "data",
+            &data_start, &data_end) && data_end-data_start>=8)
+        {
+            payload = data + data_start + 8;
+            len = data_end - data_start - 8;
+            if(memcmp(type, "trkn", 4)==0)
+            {
+                if(len>=4 && mmd->tracknum==0)
+                    mmd->tracknum = rclib_tag_native_be16(payload+2);
+            }
+            else if(memcmp(type, "gnre", 4)==0)
+            {
+                if(len>=2)
+                {
+                    rclib_tag_native_set_string(&(mmd->genre),
+                        rclib_tag_native_genre_from_id(
+                        (gint)rclib_tag_native_be16(payload)-1));
+                }
+            }
+            else if(type[0]==0xA9 && g_utf8_validate((const gchar *)payload,
+                len, NULL))
+            {
+                str = g_strndup((const gchar *)payload, len);
+                if(memcmp(type+1, "nam", 3)==0)
+                    rclib_tag_native_set_string(&(mmd->title), str);
+                else if(memcmp(type+1, "ART", 3)==0)
+                    rclib_tag_native_set_string(&(mmd->artist), str);
+                else if(memcmp(type+1, "alb", 3)==0)
+                    rclib_tag_native_set_string(&(mmd->album), str);
+                else if(memcmp(type+1, "gen", 3)==0)
+                    rclib_tag_native_set_string(&(mmd->genre), str);
+                else if(memcmp(type+1, "cmt", 3)==0)
+                    rclib_tag_native_set_string(&(mmd->comment), str);
+                else if(memcmp(type+1, "day", 3)==0)
+                {
+                    rclib_tag_native_set_year(mmd, str);
+                    g_free(str);
+                }
+                else
+                    g_free(str);
+            }
+            else if(memcmp(type, "----", 4)==0 &&
+                rclib_tag_native_mp4_find(data, pos+8, item_end, "name",
+                &name_start, &name_end) && name_end-name_start>4)
+            {
+                /* The freeform atom, the name has 4 bytes of flags. */
+                str = g_strndup((const gchar *)payload, len);
+                rclib_tag_native_set_gain(mmd,
+                    (const gchar *)data+name_start+4, name_end-name_start-4,
+                    str);
+                g_free(str);
+            }
+        }
+        pos = item_end;
+    }
+}
+
+static gboolean rclib_tag_native_parse_mp4(RCLibTagMetadata *mmd,
+    const guint8 *data, gsize size)
+{
+    gsize moov_start, moov_end, start, end, trak_start, trak_end;
+    gsize mdia_start, mdia_end, sub_start, sub_end, entry;
+    guint64 timescale = 0, duration = 0;
+    const guint8 *p;
+    const gchar *codec = NULL;
+    if(size<16 || memcmp(data+4, "ftyp", 4)!=0) return FALSE;
+    if(!rclib_tag_native_mp4_find(data, 0, size, "moov", &moov_start,
+        &moov_end))
+        return FALSE;
+    if(rclib_tag_native_mp4_find(data, moov_start, moov_end, "mvhd",
+        &start, &end) && end-start>=32)
+    {
+        p = data + start;
+        if(p[0]==1)
+        {
+            timescale = rclib_tag_native_be32(p+20);
+            duration = rclib_tag_native_be64(p+24);
+        }
+        else
+        {
+            timescale = rclib_tag_native_be32(p+12);
+            duration = rclib_tag_native_be32(p+16);
+        }
+    }
+    /* Walk all tracks, give up if there is a video track. */
+    trak_start = moov_start;
+    while(rclib_tag_native_mp4_find(data, trak_start, moov_end, "trak",
+        &start, &trak_end))
+    {
+        trak_start = trak_end;
+        if(!rclib_tag_native_mp4_find(data, start, trak_end, "mdia",
+            &mdia_start, &mdia_end))
+            continue;
+        if(rclib_tag_native_mp4_find(data, mdia_start, mdia_end, "hdlr",
+            &sub_start, &sub_end) && sub_end-sub_start>=12 &&
+            memcmp(data+sub_start+8, "vide", 4)==0)
+            return FALSE;
+        if(codec!=NULL) continue;
+        if(!rclib_tag_native_mp4_find(data, mdia_start, mdia_end, "minf",
+            &start, &end))
+            continue;
+        if(!rclib_tag_native_mp4_find(data, start, end, "stbl", &start,
+            &end))
+            continue;
+        if(!rclib_tag_native_mp4_find(data, start, end, "stsd", &start,
+            &end))
+            continue;
+        entry = start + 8;
+        if(entry+36>end) continue;
+        p = data + entry;
+        if(memcmp(p+4, "mp4a", 4)==0)
+            codec = "MPEG-4 AAC";
+        else if(memcmp(p+4, "alac", 4)==0)
+            codec = "Apple Lossless Audio";
+        else
+            continue;
+        mmd->channels = rclib_tag_native_be16(p+24);
+        mmd->samplerate = rclib_tag_native_be32(p+32) >> 16;
+        if(rclib_tag_native_mp4_find(data, mdia_start, mdia_end, "mdhd",
+            &sub_start, &sub_end) && sub_end-sub_start>=32)
+        {
+            p = data + sub_start;
+            if(p[0]==1)
+            {
+                timescale = rclib_tag_native_be32(p+20);
+                duration = rclib_tag_native_be64(p+24);
+            }
+            else
+            {
+                timescale = rclib_tag_native_be32(p+12);
+                duration = rclib_tag_native_be32(p+16);
+            }
+        }
+    }
+    if(codec==NULL || timescale==0) return FALSE;
+    mmd->length = gst_util_uint64_scale(duration, GST_SECOND, timescale);
+    if(mmd->length>0)
+    {
+        mmd->bitrate = gst_util_uint64_scale(size, 8 * GST_SECOND,
+            mmd->length);
+    }
+    mmd->ftype = g_strdup(codec);
+    if(rclib_tag_native_mp4_find(data, moov_start, moov_end, "udta",
+        &start, &end) && rclib_tag_native_mp4_find(data, start, end,
+        "meta", &start, &end))
+    {
+        /* The meta atom is a full atom, except in some QuickTime files. */
+        if(end-start>=12 && memcmp(data+start+8, "hdlr", 4)!=0)
+            start += 4;
+        if(rclib_tag_native_mp4_find(data, start, end, "ilst", &start,
+            &end))
+            rclib_tag_native_parse_mp4_ilst(mmd, data, start, end);
+    }
+    return TRUE;
+}
+
+static RCLibTagReaderFormat rclib_tag_native_detect_format(
+    const guint8 *data, gsize size, gsize *offset)
+{
+    RCLibTagNativeMpegHeader header;
+    gsize frame_offset, pos = 0;
+    *offset = 0;
+    if(size>=10 && memcmp(data, "ID3", 3)==0)
+    {
+        pos = 10 + rclib_tag_native_synchsafe32(data+6);
+        if(data[5] & 0x10) pos += 10;
+        while(pos<size && data[pos]==0) pos++;
+        if(pos+4<=size && memcmp(data+pos, "fLaC", 4)==0)
+        {
+            *offset = pos;
+            return RCLIB_TAG_READER_FORMAT_FLAC;
+        }
+        return RCLIB_TAG_READER_FORMAT_MPEG;
+    }
+    if(size>=4 && memcmp(data, "fLaC", 4)==0)
+        return RCLIB_TAG_READER_FORMAT_FLAC;
+    if(size>=4 && memcmp(data, "OggS", 4)==0)
+        return RCLIB_TAG_READER_FORMAT_OGG;
+    if(size>=8 && memcmp(data+4, "ftyp", 4)==0)
+        return RCLIB_TAG_READER_FORMAT_MP4;
+    if(rclib_tag_native_mpeg_find_frame(data, size, 0, 4, &frame_offset,
+        &header))
+        return RCLIB_TAG_READER_FORMAT_MPEG;
+    return RCLIB_TAG_READER_FORMAT_OTHER;
+}
+
+/*
+ * Move the parsed metadata into the destination structure.
+ */
+
+static void rclib_tag_native_move_data(RCLibTagMetadata *dst,
+    RCLibTagMetadata *src)
+{
+    dst->length = src->length;
+    dst->tracknum = src->tracknum;
+    dst->bitrate = src->bitrate;
+    dst->samplerate = src->samplerate;
+    dst->channels = src->channels;
+    dst->year = src->year;
+    dst->title = src->title;
+    dst->artist = src->artist;
+    dst->album = src->album;
+    dst->comment = src->comment;
+    dst->ftype = src->ftype;
+    dst->genre = src->genre;
+    dst->emb_cue = src->emb_cue;
+    dst->track_gain = src->track_gain;
+    dst->track_peak = src->track_peak;
+    dst->album_gain = src->album_gain;
+    dst->album_peak = src->album_peak;
+    dst->track_gain_flag = src->track_gain_flag;
+    dst->album_gain_flag = src->album_gain_flag;
+    dst->audio_flag = TRUE;
+    dst->video_flag = FALSE;
+    memset(src, 0, sizeof(RCLibTagMetadata));
+}
+
+/**
+ * _rclib_tag_native_read_metadata: (skip)
+ * @mmd: the metadata with the URI to read
+ * @format: (out): the detected file format
+ *
+ * Read the metadata of local music files in common formats without
+ * GStreamer. The @mmd is only modified if the read operation succeeds.
+ *
+ * Returns: Whether the metadata is read.
+ */
+
+gboolean _rclib_tag_native_read_metadata(RCLibTagMetadata *mmd,
+    RCLibTagReaderFormat *format)
+{
+    GMappedFile *mapped_file;
+    RCLibTagMetadata *native_mmd;
+    const guint8 *data;
+    gchar *filename;
+    gsize size, offset = 0;
+    gboolean flag = FALSE;
+    *format = RCLIB_TAG_READER_FORMAT_OTHER;
+    if(mmd==NULL || mmd->uri==NULL) return FALSE;
+    filename = g_filename_from_uri(mmd->uri, NULL, NULL);
+    if(filename==NULL) return FALSE;
+    mapped_file = g_mapped_file_new(filename, FALSE, NULL);
+    g_free(filename);
+    if(mapped_file==NULL) return FALSE;
+    data = (const guint8 *)g_mapped_file_get_contents(mapped_file);
+    size = g_mapped_file_get_length(mapped_file);
+    if(data==NULL || size==0)
+    {
+        g_mapped_file_unref(mapped_file);
+        return FALSE;
+    }
+    *format = rclib_tag_native_detect_format(data, size, &offset);
+    native_mmd = g_new0(RCLibTagMetadata, 1);
+    switch(*format)
+    {
+        case RCLIB_TAG_READER_FORMAT_MPEG:
+            flag = rclib_tag_native_parse_mpeg(native_mmd, data, size);
+            break;
+        case RCLIB_TAG_READER_FORMAT_FLAC:
+        {
+            if(offset>0)
+            {
+                gint64 tlen = 0;
+                rclib_tag_native_parse_id3v2(native_mmd, data, size, &tlen);
+            }
+            flag = rclib_tag_native_parse_flac(native_mmd, data, size,
+                offset);
+            break;
+        }
+        case RCLIB_TAG_READER_FORMAT_OGG:
+            flag = rclib_tag_native_parse_ogg(native_mmd, data, size);
+            break;
+        case RCLIB_TAG_READER_FORMAT_MP4:
+            flag = rclib_tag_native_parse_mp4(native_mmd, data, size);
+            break;
+        default:
+            break;
+    }
+    g_mapped_file_unref(mapped_file);
+    if(flag && native_mmd->length>0)
+        rclib_tag_native_move_data(mmd, native_mmd);
+    else
+        flag = FALSE;
+    rclib_tag_free(native_mmd);
+    return flag;
+}
+
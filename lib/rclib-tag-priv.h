@@ -0,0 +1,35 @@
+/*
+ * RhythmCat Library Tag Manager Private Header Declaration
+ *
+ * rclib-tag-priv.h
+ * This file is part of RhythmCat Library (LibRhythmCat)
+ *
+ * Copyright (C) 2012 - SuperCat, license: GPL v3
+ *
+ * RhythmCat is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RhythmCat is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RhythmCat; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, 
+ * Boston, MA  02110-1301  USA
+ */
+
+#ifndef HAVE_RC_LIB_TAG_PRIVATE_H
+#define HAVE_RC_LIB_TAG_PRIVATE_H
+
+#include "rclib-tag.h"
+
+/*< private >*/
+gboolean _rclib_tag_native_read_metadata(RCLibTagMetadata *mmd,
+    RCLibTagReaderFormat *format);
+
+#endif
+
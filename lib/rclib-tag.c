@@ -24,6 +24,7 @@
  */
 
 #include "rclib-tag.h"
+#include "rclib-tag-priv.h"
 #include "rclib-common.h"
 #include <gst/pbutils/pbutils.h>
 #include <gst/audio/audio.h>
@@ -45,6 +46,8 @@
 #endif
 
 static gchar *tag_fallback_encoding = NULL;
+static gint tag_reader_native_count[RCLIB_TAG_READER_FORMAT_LAST] = {0};
+static gint tag_reader_fallback_count[RCLIB_TAG_READER_FORMAT_LAST] = {0};
 
 typedef struct RCTagDecodedPadData
 {
@@ -88,6 +91,7 @@ static void rclib_tag_get_tag_cb(const GstTagList *tags, RCLibTagMetadata *mmd)
     guint tracknum = 0;
     guint cue_num = 0;
     guint i = 0;
+    gdouble gain = 0.0;
     if(mmd==NULL || mmd->uri==NULL || tags==NULL) return;
     if(gst_tag_list_get_string(tags, GST_TAG_AUDIO_CODEC, &string))
     {
@@ -161,6 +165,20 @@ static void rclib_tag_get_tag_cb(const GstTagList *tags, RCLibTagMetadata *mmd)
         mmd->year = g_date_get_year(date);
         g_date_free(date);
     }
+    if(gst_tag_list_get_double(tags, GST_TAG_TRACK_GAIN, &gain))
+    {
+        mmd->track_gain = gain;
+        mmd->track_gain_flag = TRUE;
+    }
+    if(gst_tag_list_get_double(tags, GST_TAG_TRACK_PEAK, &gain))
+        mmd->track_peak = gain;
+    if(gst_tag_list_get_double(tags, GST_TAG_ALBUM_GAIN, &gain))
+    {
+        mmd->album_gain = gain;
+        mmd->album_gain_flag = TRUE;
+    }
+    if(gst_tag_list_get_double(tags, GST_TAG_ALBUM_PEAK, &gain))
+        mmd->album_peak = gain;
     cue_num = gst_tag_list_get_tag_size(tags, GST_TAG_EXTENDED_COMMENT);
     for(i=0;i<cue_num && mmd->emb_cue==NULL;i++)
     {
@@ -244,7 +262,9 @@ static void rc_tag_gst_new_decoded_pad_cb(GstElement *decodebin,
  * rclib_tag_read_metadata:
  * @uri: the URI of the music file
  *
- * Read tag (metadata) from given URI.
+ * Read tag (metadata) from given URI. Local files in common formats
+ * (MP3, FLAC, Ogg, MP4) are parsed directly, other files are read by
+ * a GStreamer pipeline.
  *
  * Returns: The Metadata of the music, NULL if the file is not a music file,
  * free after usage.
@@ -269,12 +289,20 @@ RCLibTagMetadata *rclib_tag_read_metadata(const gchar *uri)
     gboolean error_check = FALSE;
     GTimer *timer;
     GstMessageType msg_type = GST_MESSAGE_UNKNOWN;
+    RCLibTagReaderFormat format = RCLIB_TAG_READER_FORMAT_OTHER;
     if(uri==NULL)
     {
         return NULL;
     }
     mmd = g_new0(RCLibTagMetadata, 1);
     mmd->uri = g_strdup(uri);
+    if(_rclib_tag_native_read_metadata(mmd, &format))
+    {
+        g_atomic_int_inc(&(tag_reader_native_count[format]));
+        g_debug("Read tag natively from URI: %s", uri);
+        return mmd;
+    }
+    g_atomic_int_inc(&(tag_reader_fallback_count[format]));
     #if GST_VERSION_MAJOR==1
         urisrc = gst_element_make_from_uri(GST_URI_SRC, mmd->uri, "urisrc",
             NULL);
@@ -764,3 +792,47 @@ const gchar *rclib_tag_get_fallback_encoding()
     return tag_fallback_encoding;
 }
 
+/**
+ * rclib_tag_get_reader_stats:
+ * @format: the file format
+ * @native_count: (out) (allow-none): the number of the files read by the
+ *     native tag reader
+ * @fallback_count: (out) (allow-none): the number of the files read by
+ *     GStreamer
+ *
+ * Get how many files of the given format have been read by the native
+ * tag reader, and how many files fell back to GStreamer.
+ *
+ * Returns: Whether the format is valid.
+ */
+
+gboolean rclib_tag_get_reader_stats(RCLibTagReaderFormat format,
+    guint *native_count, guint *fallback_count)
+{
+    if((guint)format>=RCLIB_TAG_READER_FORMAT_LAST) return FALSE;
+    if(native_count!=NULL)
+        *native_count = g_atomic_int_get(&(tag_reader_native_count[format]));
+    if(fallback_count!=NULL)
+    {
+        *fallback_count = g_atomic_int_get(
+            &(tag_reader_fallback_count[format]));
+    }
+    return TRUE;
+}
+
+/**
+ * rclib_tag_reset_reader_stats:
+ *
+ * Reset the statistics of the tag reader.
+ */
+
+void rclib_tag_reset_reader_stats()
+{
+    guint i;
+    for(i=0;i<RCLIB_TAG_READER_FORMAT_LAST;i++)
+    {
+        g_atomic_int_set(&(tag_reader_native_count[i]), 0);
+        g_atomic_int_set(&(tag_reader_fallback_count[i]), 0);
+    }
+}
+
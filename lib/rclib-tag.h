@@ -35,6 +35,28 @@ G_BEGIN_DECLS
 
 typedef struct _RCLibTagMetadata RCLibTagMetadata;
 
+/**
+ * RCLibTagReaderFormat:
+ * @RCLIB_TAG_READER_FORMAT_MPEG: MPEG audio with ID3v2/ID3v1 tags
+ * @RCLIB_TAG_READER_FORMAT_FLAC: native FLAC
+ * @RCLIB_TAG_READER_FORMAT_OGG: Ogg Vorbis, Ogg Opus and Ogg FLAC
+ * @RCLIB_TAG_READER_FORMAT_MP4: MPEG-4 audio (AAC, ALAC)
+ * @RCLIB_TAG_READER_FORMAT_OTHER: other formats, which are always read
+ *     by GStreamer
+ * @RCLIB_TAG_READER_FORMAT_LAST: the number of the formats
+ *
+ * The enum type for the file formats recognized by the tag reader.
+ */
+
+typedef enum {
+    RCLIB_TAG_READER_FORMAT_MPEG = 0,
+    RCLIB_TAG_READER_FORMAT_FLAC = 1,
+    RCLIB_TAG_READER_FORMAT_OGG = 2,
+    RCLIB_TAG_READER_FORMAT_MP4 = 3,
+    RCLIB_TAG_READER_FORMAT_OTHER = 4,
+    RCLIB_TAG_READER_FORMAT_LAST = 5
+}RCLibTagReaderFormat;
+
 /**
  * RCLibTagMetadata:
  * @length: the length of the music
@@ -55,6 +77,12 @@ typedef struct _RCLibTagMetadata RCLibTagMetadata;
  * @eos: the EOS signal
  * @audio_flag: whether this file has audio
  * @video_flag: whether this file has video
+ * @track_gain: the ReplayGain track gain of the music (in dB)
+ * @track_peak: the ReplayGain track peak of the music
+ * @album_gain: the ReplayGain album gain of the music (in dB)
+ * @album_peak: the ReplayGain album peak of the music
+ * @track_gain_flag: whether the track gain is found in the tags
+ * @album_gain_flag: whether the album gain is found in the tags
  * @user_data: the user data
  *
  * The structure for storing the music metadata.
@@ -79,6 +107,12 @@ struct _RCLibTagMetadata {
     gboolean eos;
     gboolean audio_flag;
     gboolean video_flag;
+    gdouble track_gain;
+    gdouble track_peak;
+    gdouble album_gain;
+    gdouble album_peak;
+    gboolean track_gain_flag;
+    gboolean album_gain_flag;
     gpointer user_data;
 };
 
@@ -93,6 +127,9 @@ gchar *rclib_tag_get_name_from_fpath(const gchar *filename);
 gchar *rclib_tag_get_name_from_uri(const gchar *uri);
 void rclib_tag_set_fallback_encoding(const gchar *encoding);
 const gchar *rclib_tag_get_fallback_encoding();
+gboolean rclib_tag_get_reader_stats(RCLibTagReaderFormat format,
+    guint *native_count, guint *fallback_count);
+void rclib_tag_reset_reader_stats();
 
 G_END_DECLS
 
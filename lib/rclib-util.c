@@ -32,6 +32,10 @@
 #include "rclib-common.h"
 #include "rclib-tag.h"
 
+#ifdef G_OS_UNIX
+    #include <unistd.h>
+#endif
+
 /**
  * SECTION: rclib-util
  * @Short_description: Some utility API
@@ -363,3 +367,28 @@ gchar *rclib_util_detect_encoding_by_locale()
     return encoding;
 }
 
+
+/**
+ * rclib_util_get_processor_count:
+ *
+ * Get the number of the processors which are online in the system.
+ *
+ * Returns: The number of the processors, at least 1.
+ */
+
+guint rclib_util_get_processor_count()
+{
+    glong count = 1;
+    #if GLIB_CHECK_VERSION(2, 36, 0)
+        count = g_get_num_processors();
+    #elif defined(G_OS_UNIX) && defined(_SC_NPROCESSORS_ONLN)
+        count = sysconf(_SC_NPROCESSORS_ONLN);
+    #elif defined(G_OS_WIN32)
+        SYSTEM_INFO system_info;
+        GetSystemInfo(&system_info);
+        count = system_info.dwNumberOfProcessors;
+    #endif
+    if(count<1) count = 1;
+    return (guint)count;
+}
+
@@ -41,6 +41,7 @@ const gchar *rclib_util_get_cover_search_dir();
 gchar *rclib_util_search_cover(const gchar *uri, const gchar *title,
     const gchar *artist, const gchar *album);
 gchar *rclib_util_detect_encoding_by_locale();
+guint rclib_util_get_processor_count();
 
 G_END_DECLS
 
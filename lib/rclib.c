@@ -46,6 +46,7 @@ const gchar *rclib_build_date = __DATE__;
 const gchar *rclib_build_time = __TIME__;
 
 static gchar *db_file = NULL;
+static gchar *shuffle_file = NULL;
 static gulong main_tag_found_handler = 0;
 static gulong main_new_duration_handler = 0;
 static gulong main_catalog_delete_handler = 0;
@@ -203,6 +204,8 @@ gboolean rclib_init(gint *argc, gchar **argv[], const gchar *dir,
 {
     gchar *lyric_dir, *album_dir;
     gchar *settings_file;
+    gchar *legacy_db_file;
+    gboolean legacy_flag;
     if(dir==NULL) return FALSE;
     g_type_init();
     if(!gst_init_check(argc, argv, error))
@@ -210,12 +213,22 @@ gboolean rclib_init(gint *argc, gchar **argv[], const gchar *dir,
     if(!rclib_core_init(error))
         return FALSE;
     g_mkdir_with_parents(dir, 0700);
-    db_file = g_build_filename(dir, "library.zdb", NULL);
+    db_file = g_build_filename(dir, "library.rcdb", NULL);
+    legacy_db_file = g_build_filename(dir, "library.zdb", NULL);
+    legacy_flag = !g_file_test(db_file, G_FILE_TEST_EXISTS) &&
+        g_file_test(legacy_db_file, G_FILE_TEST_EXISTS);
     if(!rclib_db_init(db_file))
     {
+        g_free(legacy_db_file);
         rclib_core_exit();
         return FALSE;
     }
+    if(legacy_flag)
+    {
+        /* Import the XML database used by the older versions. */
+        rclib_db_import_xml(legacy_db_file);
+    }
+    g_free(legacy_db_file);
     rclib_player_init();
     rclib_lyric_init();
     rclib_album_init();
@@ -231,6 +244,8 @@ gboolean rclib_init(gint *argc, gchar **argv[], const gchar *dir,
     settings_file = g_build_filename(dir, "settings.conf", NULL);
     rclib_settings_load_from_file(settings_file);
     g_free(settings_file);
+    shuffle_file = g_build_filename(dir, "shuffle.conf", NULL);
+    rclib_player_load_shuffle_state(shuffle_file);
     main_tag_found_handler = rclib_core_signal_connect("tag-found",
         G_CALLBACK(rclib_main_update_db_metadata_cb), NULL);
     main_new_duration_handler = rclib_core_signal_connect("new-duration",
@@ -262,6 +277,8 @@ void rclib_exit()
         rclib_db_signal_disconnect(main_playist_delete_handler);
     if(main_error_handler>0)
         rclib_core_signal_disconnect(main_error_handler);
+    rclib_player_save_shuffle_state(shuffle_file);
+    g_free(shuffle_file);
     g_free(db_file);
     rclib_settings_exit();
     rclib_album_exit();
@@ -28,6 +28,7 @@
 #include <glib.h>
 #include <gst/gst.h>
 #include "rclib-core.h"
+#include "rclib-dsp.h"
 #include "rclib-db.h"
 #include "rclib-tag.h"
 #include "rclib-cue.h"
@@ -33,7 +33,7 @@
 
 typedef struct RCPluginEchoEffectPrivate
 {
-    GstElement *echo_element;
+    GstElement *dsp_element;
     GtkToggleAction *action;
     guint menu_id;
     GtkWidget *echo_window;
@@ -90,7 +90,7 @@ static void rc_plugin_echoeff_delay_scale_changed_cb(GtkRange *range,
     value = gtk_range_get_value(range);
     delay = value * GST_MSECOND;
     if(delay==0) delay = 1;
-    g_object_set(priv->echo_element, "delay", delay, NULL);
+    g_object_set(priv->dsp_element, "echo-delay", delay, NULL);
     priv->delay = delay;
 }
 
@@ -101,7 +101,8 @@ static void rc_plugin_echoeff_fb_scale_changed_cb(GtkRange *range,
     gdouble value = 0.0;
     if(data==NULL) return;
     value = gtk_range_get_value(range);
-    g_object_set(priv->echo_element, "feedback", (gfloat)value, NULL);
+    g_object_set(priv->dsp_element, "echo-feedback", (gfloat)value,
+        NULL);
     priv->feedback = value;
 }
 
@@ -112,7 +113,8 @@ static void rc_plugin_echoeff_intensity_scale_changed_cb(
     gdouble value = 0.0;
     if(data==NULL) return;
     value = gtk_range_get_value(range);
-    g_object_set(priv->echo_element, "intensity", (gfloat)value, NULL);
+    g_object_set(priv->dsp_element, "echo-intensity", (gfloat)value,
+        NULL);
     priv->intensity = value;
 }
 
@@ -211,17 +213,17 @@ static void rc_plugin_echoeff_shutdown_cb(RCLibPlugin *plugin, gpointer data)
 static gboolean rc_plugin_echoeff_load(RCLibPluginData *plugin)
 {
     RCPluginEchoEffectPrivate *priv = &echoeff_priv;
-    gboolean flag;
-    priv->echo_element = gst_element_factory_make("audioecho", NULL);
-    flag = rclib_core_effect_plugin_add(priv->echo_element);
-    if(!flag)
+    gboolean flag = FALSE;
+    priv->dsp_element = rclib_core_effect_get_dsp();
+    if(priv->dsp_element!=NULL)
     {
-        gst_object_unref(priv->echo_element);
-        priv->echo_element = NULL;
+        g_object_set(priv->dsp_element, "echo-delay", priv->delay,
+            "echo-feedback", priv->feedback, "echo-intensity",
+            priv->intensity, NULL);
+        flag = rclib_dsp_stage_add(RCLIB_DSP(priv->dsp_element),
+            RCLIB_DSP_STAGE_ECHO);
     }
-    g_object_set(priv->echo_element, "max-delay", 1 * GST_SECOND,
-        "delay", priv->delay, "feedback", priv->feedback, "intensity",
-        priv->intensity, NULL);
+    if(!flag) priv->dsp_element = NULL;
     rc_plugin_echoeff_window_init(priv);
     priv->action = gtk_toggle_action_new("RC2ViewPluginEchoEffect",
         _("Echo Effect"), _("Show/hide echo audio effect "
@@ -248,10 +250,11 @@ static gboolean rc_plugin_echoeff_unload(RCLibPluginData *plugin)
         gtk_widget_destroy(priv->echo_window);
         priv->echo_window = NULL;
     }
-    if(priv->echo_element!=NULL)
+    if(priv->dsp_element!=NULL)
     {
-        rclib_core_effect_plugin_remove(priv->echo_element);
-        priv->echo_element = NULL;
+        rclib_dsp_stage_remove(RCLIB_DSP(priv->dsp_element),
+            RCLIB_DSP_STAGE_ECHO);
+        priv->dsp_element = NULL;
     }
     return TRUE;
 }
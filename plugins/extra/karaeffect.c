@@ -33,7 +33,7 @@
 
 typedef struct RCPluginKaraEffectPrivate
 {
-    GstElement *kara_element;
+    GstElement *dsp_element;
     GtkToggleAction *action;
     guint menu_id;
     GtkWidget *kara_window;
@@ -114,7 +114,8 @@ static void rc_plugin_karaeff_fb_scale_changed_cb(GtkRange *range,
     gdouble value = 0.0;
     if(data==NULL) return;
     value = gtk_range_get_value(range);
-    g_object_set(priv->kara_element, "filter-band", (gfloat)value, NULL);
+    g_object_set(priv->dsp_element, "karaoke-filter-band", (gfloat)value,
+        NULL);
     priv->filter_band = value;
 }
 
@@ -125,7 +126,8 @@ static void rc_plugin_karaeff_fw_scale_changed_cb(GtkRange *range,
     gdouble value = 0.0;
     if(data==NULL) return;
     value = gtk_range_get_value(range);
-    g_object_set(priv->kara_element, "filter-width", (gfloat)value, NULL);
+    g_object_set(priv->dsp_element, "karaoke-filter-width", (gfloat)value,
+        NULL);
     priv->filter_width = value;
 }
 
@@ -136,7 +138,8 @@ static void rc_plugin_karaeff_level_scale_changed_cb(GtkRange *range,
     gdouble value = 0.0;
     if(data==NULL) return;
     value = gtk_range_get_value(range);
-    g_object_set(priv->kara_element, "level", (gfloat)value, NULL);
+    g_object_set(priv->dsp_element, "karaoke-level", (gfloat)value,
+        NULL);
     priv->level = value;
 }
 
@@ -147,7 +150,8 @@ static void rc_plugin_karaeff_mono_level_scale_changed_cb(GtkRange *range,
     gdouble value = 0.0;
     if(data==NULL) return;
     value = gtk_range_get_value(range);
-    g_object_set(priv->kara_element, "mono-level", (gfloat)value, NULL);
+    g_object_set(priv->dsp_element, "karaoke-mono-level", (gfloat)value,
+        NULL);
     priv->mono_level = value;
 }
 
@@ -263,17 +267,18 @@ static void rc_plugin_karaeff_shutdown_cb(RCLibPlugin *plugin, gpointer data)
 static gboolean rc_plugin_karaeff_load(RCLibPluginData *plugin)
 {
     RCPluginKaraEffectPrivate *priv = &karaeff_priv;
-    gboolean flag;
-    priv->kara_element = gst_element_factory_make("audiokaraoke", NULL);
-    flag = rclib_core_effect_plugin_add(priv->kara_element);
-    if(!flag)
+    gboolean flag = FALSE;
+    priv->dsp_element = rclib_core_effect_get_dsp();
+    if(priv->dsp_element!=NULL)
     {
-        gst_object_unref(priv->kara_element);
-        priv->kara_element = NULL;
+        g_object_set(priv->dsp_element, "karaoke-filter-band",
+            priv->filter_band, "karaoke-filter-width", priv->filter_width,
+            "karaoke-level", priv->level, "karaoke-mono-level",
+            priv->mono_level, NULL);
+        flag = rclib_dsp_stage_add(RCLIB_DSP(priv->dsp_element),
+            RCLIB_DSP_STAGE_KARAOKE);
     }
-    g_object_set(priv->kara_element, "filter-band", priv->filter_band,
-        "filter-width", priv->filter_width, "level", priv->level,
-        "mono-level", priv->mono_level, NULL);
+    if(!flag) priv->dsp_element = NULL;
     rc_plugin_karaeff_window_init(priv);
     priv->action = gtk_toggle_action_new("RC2ViewPluginKaraokeEffect",
         _("Karaoke Effect"), _("Show/hide karaoke audio effect "
@@ -300,10 +305,11 @@ static gboolean rc_plugin_karaeff_unload(RCLibPluginData *plugin)
         gtk_widget_destroy(priv->kara_window);
         priv->kara_window = NULL;
     }
-    if(priv->kara_element!=NULL)
+    if(priv->dsp_element!=NULL)
     {
-        rclib_core_effect_plugin_remove(priv->kara_element);
-        priv->kara_element = NULL;
+        rclib_dsp_stage_remove(RCLIB_DSP(priv->dsp_element),
+            RCLIB_DSP_STAGE_KARAOKE);
+        priv->dsp_element = NULL;
     }
     return TRUE;
 }
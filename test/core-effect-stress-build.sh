@@ -0,0 +1,2 @@
+#!/bin/sh
+gcc -o core-effect-stress core-effect-stress.c `pkg-config --cflags --libs librhythmcat-2.0`
@@ -0,0 +1,437 @@
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+#include <rclib-core.h>
+
+/*
+ * Add and remove a sound effect plug-in many times while the core is
+ * playing a sine wave made by audiotestsrc, through the pad probe path
+ * used with GStreamer 1.0. The test fails if the core reports an error
+ * (like a not-linked flow error), if the main loop or the playback stops
+ * moving (a deadlock), or if any removed effect element is leaked. A
+ * buffer probe on the sink pad of the audio sink also fails the test if
+ * a buffer is dropped by the swap: a buffer marked as discontinuous, or
+ * a gap in the timestamps longer than one buffer. The QoS messages from
+ * the audio sink (which are posted when it drops late buffers) fail the
+ * test too.
+ *
+ * Usage: core-effect-stress [TOGGLE_COUNT]
+ */
+
+#define STRESS_DEFAULT_TOGGLES 1000
+#define STRESS_STEP_INTERVAL 3
+#define STRESS_SOURCE_SECONDS 60
+#define STRESS_WATCHDOG_SECONDS 10
+#define STRESS_CLEANUP_SECONDS 5
+
+static GMainLoop *stress_loop = NULL;
+static GstElement *stress_element = NULL;
+static guint stress_toggles = STRESS_DEFAULT_TOGGLES;
+static guint stress_toggle_count = 0;
+static guint stress_cleanup_count = 0;
+static gint64 stress_start_position = -1;
+static gint64 stress_end_position = -1;
+static volatile gint stress_progress = 0;
+static volatile gint stress_finished = 0;
+static volatile gint stress_created = 0;
+static volatile gint stress_finalized = 0;
+static gchar *stress_error = NULL;
+static gchar * volatile stress_glitch = NULL;
+static GstElement *stress_sink = NULL;
+static GstPad *stress_sink_pad = NULL;
+static gulong stress_probe_id = 0;
+static gulong stress_qos_handler = 0;
+static GstClockTime stress_last_pts = GST_CLOCK_TIME_NONE;
+static GstClockTime stress_last_duration = GST_CLOCK_TIME_NONE;
+static guint64 stress_buffer_count = 0;
+
+static gboolean stress_make_source(const gchar *file)
+{
+    GstElement *pipeline;
+    GstMessage *message;
+    GError *error = NULL;
+    gchar *description;
+    gboolean flag = FALSE;
+    description = g_strdup_printf("audiotestsrc wave=sine num-buffers=%u "
+        "samplesperbuffer=4410 ! audio/x-raw, rate=44100, channels=2 ! "
+        "wavenc ! filesink location=\"%s\"", STRESS_SOURCE_SECONDS * 10,
+        file);
+    pipeline = gst_parse_launch(description, &error);
+    g_free(description);
+    if(pipeline==NULL)
+    {
+        g_warning("Cannot build the source pipeline: %s", error->message);
+        g_error_free(error);
+        return FALSE;
+    }
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    message = gst_bus_timed_pop_filtered(GST_ELEMENT_BUS(pipeline),
+        GST_CLOCK_TIME_NONE, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+    if(message!=NULL)
+    {
+        flag = (GST_MESSAGE_TYPE(message)==GST_MESSAGE_EOS);
+        gst_message_unref(message);
+    }
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    return flag;
+}
+
+static void stress_element_finalized_cb(gpointer data, GObject *object)
+{
+    /* WARNING: This function may be not called in main thread! */
+    g_atomic_int_inc(&stress_finalized);
+}
+
+static void stress_error_cb(RCLibCore *core, const gchar *message,
+    gpointer data)
+{
+    if(stress_error==NULL)
+        stress_error = g_strdup(message!=NULL ? message : "Unknown error");
+    g_main_loop_quit(stress_loop);
+}
+
+static void stress_eos_cb(RCLibCore *core, gpointer data)
+{
+    if(stress_error==NULL)
+        stress_error = g_strdup("The source ended before the test");
+    g_main_loop_quit(stress_loop);
+}
+
+#if GST_VERSION_MAJOR==1
+
+/* Keep the first glitch found by the buffer probe. */
+static void stress_glitch_set(gchar *message)
+{
+    if(!g_atomic_pointer_compare_and_exchange(&stress_glitch, NULL,
+        message))
+    {
+        g_free(message);
+    }
+}
+
+static GstPadProbeReturn stress_sink_probe_cb(GstPad *pad,
+    GstPadProbeInfo *info, gpointer data)
+{
+    /* WARNING: This function is called in the streaming thread! */
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    GstClockTime pts, expected;
+    if(buffer==NULL) return GST_PAD_PROBE_OK;
+    pts = GST_BUFFER_PTS(buffer);
+    if(GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DISCONT))
+    {
+        stress_glitch_set(g_strdup_printf("A discontinuous buffer at %"
+            GST_TIME_FORMAT " reached the sink", GST_TIME_ARGS(pts)));
+    }
+    if(GST_CLOCK_TIME_IS_VALID(pts) &&
+        GST_CLOCK_TIME_IS_VALID(stress_last_pts) &&
+        GST_CLOCK_TIME_IS_VALID(stress_last_duration))
+    {
+        expected = stress_last_pts + stress_last_duration;
+        if(pts>expected+stress_last_duration ||
+            pts+stress_last_duration<expected)
+        {
+            stress_glitch_set(g_strdup_printf("The buffers jumped from %"
+                GST_TIME_FORMAT " to %" GST_TIME_FORMAT " at the sink",
+                GST_TIME_ARGS(expected), GST_TIME_ARGS(pts)));
+        }
+    }
+    stress_last_pts = pts;
+    stress_last_duration = GST_BUFFER_DURATION(buffer);
+    stress_buffer_count++;
+    return GST_PAD_PROBE_OK;
+}
+
+static void stress_qos_cb(GstBus *bus, GstMessage *message, gpointer data)
+{
+    GstObject *src = GST_MESSAGE_SRC(message);
+    if(stress_sink==NULL || src==NULL) return;
+    if(src!=GST_OBJECT(stress_sink) && !gst_object_has_ancestor(src,
+        GST_OBJECT(stress_sink)))
+    {
+        return;
+    }
+    if(stress_error==NULL)
+    {
+        stress_error = g_strdup_printf("The audio sink %s reported QoS, "
+            "some buffers are dropped", GST_OBJECT_NAME(src));
+    }
+    g_main_loop_quit(stress_loop);
+}
+
+/*
+ * Find the audio sink of the core from its DSP element, and watch the
+ * buffers on its sink pad and the QoS messages from it.
+ */
+
+static gboolean stress_sink_watch()
+{
+    GstObject *object, *parent;
+    GstElement *sink = NULL;
+    GstBus *bus;
+    object = gst_object_ref(GST_OBJECT(rclib_core_effect_get_dsp()));
+    while((parent=gst_object_get_parent(object))!=NULL)
+    {
+        gst_object_unref(object);
+        object = parent;
+    }
+    if(GST_IS_BIN(object))
+        sink = gst_bin_get_by_name(GST_BIN(object), "rclib-audiosink");
+    gst_object_unref(object);
+    if(sink==NULL) return FALSE;
+    stress_sink = sink;
+    stress_sink_pad = gst_element_get_static_pad(sink, "sink");
+    if(stress_sink_pad==NULL) return FALSE;
+    stress_probe_id = gst_pad_add_probe(stress_sink_pad,
+        GST_PAD_PROBE_TYPE_BUFFER, stress_sink_probe_cb, NULL, NULL);
+    bus = gst_element_get_bus(sink);
+    if(bus!=NULL)
+    {
+        stress_qos_handler = g_signal_connect(bus, "message::qos",
+            G_CALLBACK(stress_qos_cb), NULL);
+        gst_object_unref(bus);
+    }
+    return TRUE;
+}
+
+static void stress_sink_unwatch()
+{
+    GstBus *bus;
+    if(stress_sink_pad!=NULL)
+    {
+        if(stress_probe_id>0)
+            gst_pad_remove_probe(stress_sink_pad, stress_probe_id);
+        gst_object_unref(stress_sink_pad);
+    }
+    if(stress_sink!=NULL)
+    {
+        bus = gst_element_get_bus(stress_sink);
+        if(bus!=NULL)
+        {
+            if(stress_qos_handler>0)
+                g_signal_handler_disconnect(bus, stress_qos_handler);
+            gst_object_unref(bus);
+        }
+        gst_object_unref(stress_sink);
+    }
+    stress_sink_pad = NULL;
+    stress_sink = NULL;
+    stress_probe_id = 0;
+    stress_qos_handler = 0;
+}
+
+#endif
+
+static gboolean stress_cleanup_cb(gpointer data)
+{
+    g_atomic_int_inc(&stress_progress);
+    stress_cleanup_count++;
+    if(g_atomic_int_get(&stress_finalized)<
+        g_atomic_int_get(&stress_created) &&
+        stress_cleanup_count<STRESS_CLEANUP_SECONDS * 10)
+    {
+        return TRUE;
+    }
+    g_main_loop_quit(stress_loop);
+    return FALSE;
+}
+
+static gboolean stress_step_cb(gpointer data)
+{
+    g_atomic_int_inc(&stress_progress);
+    if(g_atomic_pointer_get(&stress_glitch)!=NULL)
+    {
+        g_main_loop_quit(stress_loop);
+        return FALSE;
+    }
+    if(stress_element==NULL)
+    {
+        if(stress_toggle_count>=stress_toggles)
+        {
+            stress_end_position = rclib_core_query_position();
+            #if GST_VERSION_MAJOR==1
+                stress_sink_unwatch();
+            #endif
+            rclib_core_stop();
+            g_timeout_add(100, stress_cleanup_cb, NULL);
+            return FALSE;
+        }
+        stress_element = gst_element_factory_make("volume", NULL);
+        if(stress_element==NULL)
+        {
+            stress_error = g_strdup("Cannot create the effect element");
+            g_main_loop_quit(stress_loop);
+            return FALSE;
+        }
+        g_object_set(stress_element, "volume", 0.5, NULL);
+        g_object_weak_ref(G_OBJECT(stress_element),
+            stress_element_finalized_cb, NULL);
+        g_atomic_int_inc(&stress_created);
+        if(!rclib_core_effect_plugin_add(stress_element))
+        {
+            stress_error = g_strdup("Cannot add the effect element");
+            g_main_loop_quit(stress_loop);
+            return FALSE;
+        }
+    }
+    else
+    {
+        rclib_core_effect_plugin_remove(stress_element);
+        stress_element = NULL;
+        stress_toggle_count++;
+        if(stress_toggle_count%100==0)
+            g_message("%u toggles done.", stress_toggle_count);
+    }
+    return TRUE;
+}
+
+static gboolean stress_start_cb(gpointer data)
+{
+    stress_start_position = rclib_core_query_position();
+    #if GST_VERSION_MAJOR==1
+        if(!stress_sink_watch())
+        {
+            stress_error = g_strdup("Cannot find the audio sink");
+            g_main_loop_quit(stress_loop);
+            return FALSE;
+        }
+    #endif
+    g_timeout_add(STRESS_STEP_INTERVAL, stress_step_cb, NULL);
+    return FALSE;
+}
+
+/*
+ * Abort the test if the main loop stops moving, the timeouts above are
+ * not called any more if the main thread is blocked by a pad probe.
+ */
+
+static gpointer stress_watchdog_thread(gpointer data)
+{
+    gint progress, last_progress = -1;
+    guint idle_seconds = 0;
+    while(!g_atomic_int_get(&stress_finished))
+    {
+        g_usleep(G_USEC_PER_SEC);
+        progress = g_atomic_int_get(&stress_progress);
+        if(progress!=last_progress)
+        {
+            last_progress = progress;
+            idle_seconds = 0;
+            continue;
+        }
+        idle_seconds++;
+        if(idle_seconds>=STRESS_WATCHDOG_SECONDS)
+        {
+            g_printerr("The main loop is blocked for %u seconds, "
+                "deadlock!\n", idle_seconds);
+            abort();
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    GError *error = NULL;
+    GThread *watchdog;
+    gchar *source_file, *source_uri;
+    gint fd;
+    gint created, finalized;
+    gint result = 0;
+    g_type_init();
+    gst_init(&argc, &argv);
+    #if GST_VERSION_MAJOR!=1
+        g_print("The pad probe path needs GStreamer 1.0, skipped.\n");
+        return 0;
+    #endif
+    if(argc>1)
+        stress_toggles = strtoul(argv[1], NULL, 10);
+    if(stress_toggles==0) stress_toggles = STRESS_DEFAULT_TOGGLES;
+    fd = g_file_open_tmp("rclib-stress-XXXXXX.wav", &source_file, &error);
+    if(fd<0)
+    {
+        g_error("Cannot create the source file: %s", error->message);
+        return 1;
+    }
+    close(fd);
+    g_message("Making the source file %s...", source_file);
+    if(!stress_make_source(source_file))
+    {
+        g_unlink(source_file);
+        g_error("Cannot make the source file!");
+        return 1;
+    }
+    if(!rclib_core_init(&error))
+    {
+        g_unlink(source_file);
+        g_error("Cannot load the core: %s", error->message);
+        return 1;
+    }
+    stress_loop = g_main_loop_new(NULL, FALSE);
+    rclib_core_signal_connect("error", G_CALLBACK(stress_error_cb), NULL);
+    rclib_core_signal_connect("eos", G_CALLBACK(stress_eos_cb), NULL);
+    source_uri = g_filename_to_uri(source_file, NULL, NULL);
+    rclib_core_set_uri(source_uri);
+    g_free(source_uri);
+    rclib_core_play();
+    g_timeout_add_seconds(1, stress_start_cb, NULL);
+    watchdog = g_thread_new("stress-watchdog", stress_watchdog_thread,
+        NULL);
+    g_message("Toggling the effect %u times...", stress_toggles);
+    g_main_loop_run(stress_loop);
+    g_atomic_int_set(&stress_finished, 1);
+    g_thread_join(watchdog);
+    #if GST_VERSION_MAJOR==1
+        stress_sink_unwatch();
+    #endif
+    created = g_atomic_int_get(&stress_created);
+    finalized = g_atomic_int_get(&stress_finalized);
+    if(stress_error!=NULL)
+    {
+        g_printerr("Core error: %s\n", stress_error);
+        result = 1;
+    }
+    else if(stress_glitch!=NULL)
+    {
+        g_printerr("Glitch while toggling: %s\n", stress_glitch);
+        result = 1;
+    }
+    else if(stress_buffer_count==0)
+    {
+        g_printerr("No buffer reached the audio sink!\n");
+        result = 1;
+    }
+    else if(stress_toggle_count<stress_toggles)
+    {
+        g_printerr("Only %u of %u toggles done!\n", stress_toggle_count,
+            stress_toggles);
+        result = 1;
+    }
+    else if(stress_end_position<=stress_start_position)
+    {
+        g_printerr("The playback did not move while toggling!\n");
+        result = 1;
+    }
+    else if(finalized!=created ||
+        rclib_core_effect_plugin_get_list()!=NULL)
+    {
+        g_printerr("%d of %d effect elements are leaked!\n",
+            created - finalized, created);
+        result = 1;
+    }
+    rclib_core_exit();
+    g_main_loop_unref(stress_loop);
+    g_unlink(source_file);
+    g_free(source_file);
+    g_free(stress_error);
+    g_free(stress_glitch);
+    if(result==0)
+    {
+        g_print("Effect stress test passed, %u toggles, %d elements "
+            "freed.\n", stress_toggle_count, finalized);
+    }
+    return result;
+}
@@ -0,0 +1,2 @@
+#!/bin/sh
+gcc -o db-binary-converter db-binary-converter.c -I../lib `pkg-config --cflags --libs glib-2.0 gobject-2.0 gio-2.0`
@@ -0,0 +1,694 @@
+#include <string.h>
+#include <stdlib.h>
+#include <glib.h>
+#include <gio/gio.h>
+#include <rclib-db-binary.h>
+
+/*
+ * Convert the player database between the XML format (library.zdb) and
+ * the binary format (library.rcdb). The direction is detected from the
+ * input file. The binary database is always written in the current
+ * version, the older versions can still be read.
+ *
+ * Usage: db-binary-converter [INPUT OUTPUT]
+ */
+
+enum
+{
+    CONV_STRING_URI,
+    CONV_STRING_TITLE,
+    CONV_STRING_ARTIST,
+    CONV_STRING_ALBUM,
+    CONV_STRING_FTYPE,
+    CONV_STRING_GENRE,
+    CONV_STRING_LYRICFILE,
+    CONV_STRING_LYRICSECFILE,
+    CONV_STRING_ALBUMFILE,
+    CONV_STRING_LAST
+};
+
+/* The attribute names in XML, in the order of the string enum above. */
+static const gchar *conv_string_names[CONV_STRING_LAST] =
+{
+    "uri", "title", "artist", "album", "filetype", "genre", "lyricfile",
+    "lyricsecondfile", "albumfile"
+};
+
+typedef struct ConvItemData
+{
+    guint type;
+    gchar *strings[CONV_STRING_LAST];
+    gint tracknum;
+    gint year;
+    gfloat rating;
+    gint64 length;
+    gint64 mtime;
+    gint64 filesize;
+    guint64 inode;
+    gdouble track_gain;
+    gdouble track_peak;
+    gdouble album_gain;
+    gdouble album_peak;
+    guint gain_flags;
+}ConvItemData;
+
+typedef struct ConvCatalogData
+{
+    gchar *name;
+    guint type;
+    GPtrArray *playlist;
+}ConvCatalogData;
+
+typedef struct ConvParserData
+{
+    gboolean db_flag;
+    gboolean library_flag;
+    ConvCatalogData *catalog_data;
+}ConvParserData;
+
+static GPtrArray *conv_catalog = NULL;
+static GPtrArray *conv_library = NULL;
+
+static void conv_item_data_free(ConvItemData *data)
+{
+    guint i;
+    if(data==NULL) return;
+    for(i=0;i<CONV_STRING_LAST;i++)
+        g_free(data->strings[i]);
+    g_free(data);
+}
+
+static void conv_catalog_data_free(ConvCatalogData *data)
+{
+    if(data==NULL) return;
+    g_free(data->name);
+    g_ptr_array_free(data->playlist, TRUE);
+    g_free(data);
+}
+
+static ConvItemData *conv_item_data_parse(const gchar **attribute_names,
+    const gchar **attribute_values)
+{
+    ConvItemData *data;
+    guint i, j;
+    data = g_new0(ConvItemData, 1);
+    for(i=0;attribute_names[i]!=NULL;i++)
+    {
+        for(j=0;j<CONV_STRING_LAST;j++)
+        {
+            if(data->strings[j]==NULL &&
+                g_strcmp0(attribute_names[i], conv_string_names[j])==0)
+            {
+                data->strings[j] = g_strdup(attribute_values[i]);
+                break;
+            }
+        }
+        if(j<CONV_STRING_LAST) continue;
+        if(g_strcmp0(attribute_names[i], "type")==0)
+            data->type = atoi(attribute_values[i]);
+        else if(g_strcmp0(attribute_names[i], "length")==0)
+            data->length = g_ascii_strtoll(attribute_values[i], NULL, 10);
+        else if(g_strcmp0(attribute_names[i], "tracknum")==0)
+            data->tracknum = atoi(attribute_values[i]);
+        else if(g_strcmp0(attribute_names[i], "year")==0)
+            data->year = atoi(attribute_values[i]);
+        else if(g_strcmp0(attribute_names[i], "rating")==0)
+            data->rating = g_ascii_strtod(attribute_values[i], NULL);
+        else if(g_strcmp0(attribute_names[i], "mtime")==0)
+            data->mtime = g_ascii_strtoll(attribute_values[i], NULL, 10);
+        else if(g_strcmp0(attribute_names[i], "filesize")==0)
+            data->filesize = g_ascii_strtoll(attribute_values[i], NULL, 10);
+        else if(g_strcmp0(attribute_names[i], "inode")==0)
+            data->inode = g_ascii_strtoull(attribute_values[i], NULL, 10);
+        else if(g_strcmp0(attribute_names[i], "gainflags")==0)
+        {
+            data->gain_flags = g_ascii_strtoull(attribute_values[i],
+                NULL, 10);
+        }
+        else if(g_strcmp0(attribute_names[i], "trackgain")==0)
+            data->track_gain = g_ascii_strtod(attribute_values[i], NULL);
+        else if(g_strcmp0(attribute_names[i], "trackpeak")==0)
+            data->track_peak = g_ascii_strtod(attribute_values[i], NULL);
+        else if(g_strcmp0(attribute_names[i], "albumgain")==0)
+            data->album_gain = g_ascii_strtod(attribute_values[i], NULL);
+        else if(g_strcmp0(attribute_names[i], "albumpeak")==0)
+            data->album_peak = g_ascii_strtod(attribute_values[i], NULL);
+    }
+    return data;
+}
+
+static void conv_xml_parser_start_element_cb(GMarkupParseContext *context,
+    const gchar *element_name, const gchar **attribute_names,
+    const gchar **attribute_values, gpointer data, GError **error)
+{
+    ConvParserData *parser_data = (ConvParserData *)data;
+    ConvCatalogData *catalog_data;
+    guint i;
+    if(g_strcmp0(element_name, "rclibdb")==0)
+    {
+        parser_data->db_flag = TRUE;
+        return;
+    }
+    if(!parser_data->db_flag) return;
+    if(parser_data->catalog_data!=NULL && g_strcmp0(element_name, "item")==0)
+    {
+        g_ptr_array_add(parser_data->catalog_data->playlist,
+            conv_item_data_parse(attribute_names, attribute_values));
+    }
+    else if(g_strcmp0(element_name, "playlist")==0)
+    {
+        catalog_data = g_new0(ConvCatalogData, 1);
+        catalog_data->playlist = g_ptr_array_new_with_free_func(
+            (GDestroyNotify)conv_item_data_free);
+        for(i=0;attribute_names[i]!=NULL;i++)
+        {
+            if(catalog_data->name==NULL &&
+                g_strcmp0(attribute_names[i], "name")==0)
+                catalog_data->name = g_strdup(attribute_values[i]);
+            else if(g_strcmp0(attribute_names[i], "type")==0)
+                catalog_data->type = atoi(attribute_values[i]);
+        }
+        g_ptr_array_add(conv_catalog, catalog_data);
+        parser_data->catalog_data = catalog_data;
+    }
+    else if(g_strcmp0(element_name, "library")==0)
+        parser_data->library_flag = TRUE;
+    else if(parser_data->library_flag &&
+        g_strcmp0(element_name, "libitem")==0)
+    {
+        g_ptr_array_add(conv_library, conv_item_data_parse(attribute_names,
+            attribute_values));
+    }
+}
+
+static void conv_xml_parser_end_element_cb(GMarkupParseContext *context,
+    const gchar *element_name, gpointer data, GError **error)
+{
+    ConvParserData *parser_data = (ConvParserData *)data;
+    if(g_strcmp0(element_name, "rclibdb")==0)
+        parser_data->db_flag = FALSE;
+    else if(g_strcmp0(element_name, "playlist")==0)
+        parser_data->catalog_data = NULL;
+    else if(g_strcmp0(element_name, "library")==0)
+        parser_data->library_flag = FALSE;
+}
+
+static gboolean conv_load_xml_db(const gchar *file)
+{
+    ConvParserData parser_data = {0};
+    GMarkupParseContext *parse_context;
+    GMarkupParser markup_parser =
+    {
+        .start_element = conv_xml_parser_start_element_cb,
+        .end_element = conv_xml_parser_end_element_cb,
+        .text = NULL,
+        .passthrough = NULL,
+        .error = NULL
+    };
+    GError *error = NULL;
+    GFile *input_file;
+    GZlibDecompressor *decompressor;
+    GFileInputStream *file_istream;
+    GInputStream *decompress_istream;
+    gchar buffer[4096];
+    gssize read_size;
+    gboolean flag = TRUE;
+    input_file = g_file_new_for_path(file);
+    file_istream = g_file_read(input_file, NULL, &error);
+    g_object_unref(input_file);
+    if(file_istream==NULL)
+    {
+        g_warning("Cannot open input stream: %s", error->message);
+        g_error_free(error);
+        return FALSE;
+    }
+    decompressor = g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_ZLIB);
+    decompress_istream = g_converter_input_stream_new(G_INPUT_STREAM(
+        file_istream), G_CONVERTER(decompressor));
+    g_object_unref(file_istream);
+    g_object_unref(decompressor);
+    parse_context = g_markup_parse_context_new(&markup_parser, 0,
+        &parser_data, NULL);
+    while((read_size=g_input_stream_read(decompress_istream, buffer, 4096,
+        NULL, &error))>0)
+    {
+        if(!g_markup_parse_context_parse(parse_context, buffer, read_size,
+            &error))
+            break;
+    }
+    if(error==NULL)
+        g_markup_parse_context_end_parse(parse_context, &error);
+    if(error!=NULL)
+    {
+        g_warning("Cannot parse XML database: %s", error->message);
+        g_error_free(error);
+        flag = FALSE;
+    }
+    g_object_unref(decompress_istream);
+    g_markup_parse_context_free(parse_context);
+    return flag;
+}
+
+static gboolean conv_save_xml_db(const gchar *file)
+{
+    ConvCatalogData *catalog_data;
+    ConvItemData *item_data;
+    GString *xml_str;
+    GZlibCompressor *compressor;
+    GFileOutputStream *file_ostream;
+    GOutputStream *compress_ostream;
+    GFile *output_file;
+    GError *error = NULL;
+    gchar gain_str[4][G_ASCII_DTOSTR_BUF_SIZE];
+    gchar *tmp;
+    guint i, j, k;
+    gboolean flag = TRUE;
+    xml_str = g_string_new("<?xml version=\"1.0\" standalone=\"yes\"?>\n");
+    g_string_append(xml_str, "<rclibdb version=\"1.9.4\">\n");
+    for(i=0;i<conv_catalog->len+1;i++)
+    {
+        if(i<conv_catalog->len)
+        {
+            catalog_data = g_ptr_array_index(conv_catalog, i);
+            tmp = g_markup_printf_escaped("  <playlist name=\"%s\" "
+                "type=\"%u\">\n", catalog_data->name!=NULL ?
+                catalog_data->name : "", catalog_data->type);
+            g_string_append(xml_str, tmp);
+            g_free(tmp);
+        }
+        else
+        {
+            catalog_data = NULL;
+            g_string_append(xml_str, "  <library>\n");
+        }
+        for(j=0;j<(catalog_data!=NULL ? catalog_data->playlist->len :
+            conv_library->len);j++)
+        {
+            if(catalog_data!=NULL)
+                item_data = g_ptr_array_index(catalog_data->playlist, j);
+            else
+                item_data = g_ptr_array_index(conv_library, j);
+            g_string_append_printf(xml_str, "    <%s type=\"%u\" ",
+                catalog_data!=NULL ? "item" : "libitem", item_data->type);
+            for(k=0;k<CONV_STRING_LAST;k++)
+            {
+                if(item_data->strings[k]==NULL) continue;
+                tmp = g_markup_printf_escaped("%s=\"%s\" ",
+                    conv_string_names[k], item_data->strings[k]);
+                g_string_append(xml_str, tmp);
+                g_free(tmp);
+            }
+            g_string_append_printf(xml_str, "length=\"%"G_GINT64_FORMAT
+                "\" tracknum=\"%d\" year=\"%d\" rating=\"%f\" ",
+                item_data->length, item_data->tracknum, item_data->year,
+                item_data->rating);
+            if(item_data->mtime!=0)
+            {
+                g_string_append_printf(xml_str, "mtime=\"%"G_GINT64_FORMAT
+                    "\" filesize=\"%"G_GINT64_FORMAT"\" inode=\"%"
+                    G_GUINT64_FORMAT"\" ", item_data->mtime,
+                    item_data->filesize, item_data->inode);
+            }
+            if(item_data->gain_flags!=0)
+            {
+                g_ascii_dtostr(gain_str[0], G_ASCII_DTOSTR_BUF_SIZE,
+                    item_data->track_gain);
+                g_ascii_dtostr(gain_str[1], G_ASCII_DTOSTR_BUF_SIZE,
+                    item_data->track_peak);
+                g_ascii_dtostr(gain_str[2], G_ASCII_DTOSTR_BUF_SIZE,
+                    item_data->album_gain);
+                g_ascii_dtostr(gain_str[3], G_ASCII_DTOSTR_BUF_SIZE,
+                    item_data->album_peak);
+                g_string_append_printf(xml_str, "gainflags=\"%u\" "
+                    "trackgain=\"%s\" trackpeak=\"%s\" albumgain=\"%s\" "
+                    "albumpeak=\"%s\" ", item_data->gain_flags,
+                    gain_str[0], gain_str[1], gain_str[2], gain_str[3]);
+            }
+            g_string_append(xml_str, "/>\n");
+        }
+        if(catalog_data!=NULL)
+            g_string_append(xml_str, "  </playlist>\n");
+        else
+            g_string_append(xml_str, "  </library>\n");
+    }
+    g_string_append(xml_str, "</rclibdb>\n");
+    output_file = g_file_new_for_path(file);
+    file_ostream = g_file_replace(output_file, NULL, FALSE,
+        G_FILE_CREATE_PRIVATE, NULL, &error);
+    g_object_unref(output_file);
+    if(file_ostream==NULL)
+    {
+        g_warning("Cannot open output file stream: %s", error->message);
+        g_error_free(error);
+        g_string_free(xml_str, TRUE);
+        return FALSE;
+    }
+    compressor = g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_ZLIB, 5);
+    compress_ostream = g_converter_output_stream_new(G_OUTPUT_STREAM(
+        file_ostream), G_CONVERTER(compressor));
+    g_object_unref(file_ostream);
+    g_object_unref(compressor);
+    if(!g_output_stream_write_all(compress_ostream, xml_str->str,
+        xml_str->len, NULL, NULL, &error) ||
+        !g_output_stream_close(compress_ostream, NULL, &error))
+    {
+        g_warning("Cannot save XML database: %s", error->message);
+        g_error_free(error);
+        flag = FALSE;
+    }
+    g_object_unref(compress_ostream);
+    g_string_free(xml_str, TRUE);
+    return flag;
+}
+
+static gboolean conv_is_binary_db(const gchar *file)
+{
+    gchar magic[8] = {0};
+    FILE *fp;
+    gsize size;
+    fp = fopen(file, "rb");
+    if(fp==NULL) return FALSE;
+    size = fread(magic, 1, 8, fp);
+    fclose(fp);
+    return (size==8 && memcmp(magic, RCLIB_DB_BINARY_MAGIC, 8)==0);
+}
+
+/*
+ * Read the item record at the index, the records written by an older
+ * version are shorter, and the missing fields are zero.
+ */
+
+static ConvItemData *conv_item_data_from_record(const gchar *records,
+    guint32 record_size, guint index, const gchar *strings, guint64 size)
+{
+    RCLibDbBinaryItemRecord record;
+    ConvItemData *data;
+    guint32 offsets[CONV_STRING_LAST];
+    guint i;
+    memset(&record, 0, sizeof(RCLibDbBinaryItemRecord));
+    memcpy(&record, records + (guint64)index * record_size, record_size);
+    offsets[CONV_STRING_URI] = record.uri;
+    offsets[CONV_STRING_TITLE] = record.title;
+    offsets[CONV_STRING_ARTIST] = record.artist;
+    offsets[CONV_STRING_ALBUM] = record.album;
+    offsets[CONV_STRING_FTYPE] = record.ftype;
+    offsets[CONV_STRING_GENRE] = record.genre;
+    offsets[CONV_STRING_LYRICFILE] = record.lyricfile;
+    offsets[CONV_STRING_LYRICSECFILE] = record.lyricsecfile;
+    offsets[CONV_STRING_ALBUMFILE] = record.albumfile;
+    data = g_new0(ConvItemData, 1);
+    data->type = record.type;
+    for(i=0;i<CONV_STRING_LAST;i++)
+    {
+        if(offsets[i]>0 && offsets[i]<size)
+            data->strings[i] = g_strdup(strings+offsets[i]);
+    }
+    data->tracknum = record.tracknum;
+    data->year = record.year;
+    data->rating = record.rating;
+    data->length = record.length;
+    data->mtime = record.mtime;
+    data->filesize = record.filesize;
+    data->inode = record.inode;
+    data->track_gain = record.track_gain;
+    data->track_peak = record.track_peak;
+    data->album_gain = record.album_gain;
+    data->album_peak = record.album_peak;
+    data->gain_flags = record.gain_flags;
+    return data;
+}
+
+static gboolean conv_load_binary_db(const gchar *file)
+{
+    const RCLibDbBinaryHeader *header;
+    const RCLibDbBinaryCatalogRecord *catalog_records;
+    const gchar *item_records;
+    ConvCatalogData *catalog_data;
+    GMappedFile *mapped_file;
+    GError *error = NULL;
+    const gchar *contents;
+    const gchar *strings;
+    gsize size;
+    guint32 record_size = sizeof(RCLibDbBinaryItemRecord);
+    guint i, j;
+    mapped_file = g_mapped_file_new(file, FALSE, &error);
+    if(mapped_file==NULL)
+    {
+        g_warning("Cannot open binary database: %s", error->message);
+        g_error_free(error);
+        return FALSE;
+    }
+    contents = g_mapped_file_get_contents(mapped_file);
+    size = g_mapped_file_get_length(mapped_file);
+    header = (const RCLibDbBinaryHeader *)contents;
+    if(size>=sizeof(RCLibDbBinaryHeader) && header->version<2)
+        record_size = RCLIB_DB_BINARY_RECORD_SIZE_V1;
+    if(size<sizeof(RCLibDbBinaryHeader) ||
+        header->byte_order!=RCLIB_DB_BINARY_BYTE_ORDER ||
+        header->version>RCLIB_DB_BINARY_VERSION ||
+        header->record_size!=record_size ||
+        header->string_offset+header->string_size>size ||
+        header->string_size==0 ||
+        contents[header->string_offset+header->string_size-1]!='\0' ||
+        header->catalog_offset+(guint64)header->catalog_count*
+        sizeof(RCLibDbBinaryCatalogRecord)>size ||
+        header->playlist_offset+(guint64)header->playlist_count*
+        record_size>size ||
+        header->library_offset+(guint64)header->library_count*
+        record_size>size)
+    {
+        g_warning("The binary database is broken or not supported!");
+        g_mapped_file_unref(mapped_file);
+        return FALSE;
+    }
+    g_message("Binary database version: %u", header->version);
+    strings = contents + header->string_offset;
+    catalog_records = (const RCLibDbBinaryCatalogRecord *)(contents +
+        header->catalog_offset);
+    item_records = contents + header->playlist_offset;
+    for(i=0;i<header->catalog_count;i++)
+    {
+        catalog_data = g_new0(ConvCatalogData, 1);
+        catalog_data->playlist = g_ptr_array_new_with_free_func(
+            (GDestroyNotify)conv_item_data_free);
+        if(catalog_records[i].name>0 &&
+            catalog_records[i].name<header->string_size)
+            catalog_data->name = g_strdup(strings+catalog_records[i].name);
+        catalog_data->type = catalog_records[i].type;
+        g_ptr_array_add(conv_catalog, catalog_data);
+        if((guint64)catalog_records[i].playlist_index+
+            catalog_records[i].playlist_count>header->playlist_count)
+            continue;
+        for(j=0;j<catalog_records[i].playlist_count;j++)
+        {
+            g_ptr_array_add(catalog_data->playlist,
+                conv_item_data_from_record(item_records, record_size,
+                catalog_records[i].playlist_index+j, strings,
+                header->string_size));
+        }
+    }
+    item_records = contents + header->library_offset;
+    for(i=0;i<header->library_count;i++)
+    {
+        g_ptr_array_add(conv_library, conv_item_data_from_record(
+            item_records, record_size, i, strings, header->string_size));
+    }
+    g_mapped_file_unref(mapped_file);
+    return TRUE;
+}
+
+static guint32 conv_string_add(GByteArray *string_data,
+    GHashTable *string_table, const gchar *str)
+{
+    gpointer offset;
+    guint32 pos;
+    if(str==NULL) return 0;
+    if(g_hash_table_lookup_extended(string_table, str, NULL, &offset))
+        return GPOINTER_TO_UINT(offset);
+    pos = string_data->len;
+    g_byte_array_append(string_data, (const guint8 *)str, strlen(str)+1);
+    g_hash_table_insert(string_table, g_strdup(str), GUINT_TO_POINTER(pos));
+    return pos;
+}
+
+static void conv_item_record_fill(RCLibDbBinaryItemRecord *record,
+    const ConvItemData *data, GByteArray *string_data,
+    GHashTable *string_table)
+{
+    guint32 offsets[CONV_STRING_LAST];
+    guint i;
+    for(i=0;i<CONV_STRING_LAST;i++)
+    {
+        offsets[i] = conv_string_add(string_data, string_table,
+            data->strings[i]);
+    }
+    memset(record, 0, sizeof(RCLibDbBinaryItemRecord));
+    record->type = data->type;
+    record->uri = offsets[CONV_STRING_URI];
+    record->title = offsets[CONV_STRING_TITLE];
+    record->artist = offsets[CONV_STRING_ARTIST];
+    record->album = offsets[CONV_STRING_ALBUM];
+    record->ftype = offsets[CONV_STRING_FTYPE];
+    record->genre = offsets[CONV_STRING_GENRE];
+    record->lyricfile = offsets[CONV_STRING_LYRICFILE];
+    record->lyricsecfile = offsets[CONV_STRING_LYRICSECFILE];
+    record->albumfile = offsets[CONV_STRING_ALBUMFILE];
+    record->tracknum = data->tracknum;
+    record->year = data->year;
+    record->rating = data->rating;
+    record->length = data->length;
+    record->mtime = data->mtime;
+    record->filesize = data->filesize;
+    record->inode = data->inode;
+    record->track_gain = data->track_gain;
+    record->track_peak = data->track_peak;
+    record->album_gain = data->album_gain;
+    record->album_peak = data->album_peak;
+    record->gain_flags = data->gain_flags;
+}
+
+static gboolean conv_save_binary_db(const gchar *file)
+{
+    RCLibDbBinaryHeader header;
+    RCLibDbBinaryCatalogRecord catalog_record;
+    RCLibDbBinaryItemRecord item_record;
+    ConvCatalogData *catalog_data;
+    GArray *catalog_array, *playlist_array, *library_array;
+    GByteArray *string_data, *data;
+    GHashTable *string_table;
+    GError *error = NULL;
+    guint i, j;
+    gboolean flag;
+    catalog_array = g_array_new(FALSE, TRUE,
+        sizeof(RCLibDbBinaryCatalogRecord));
+    playlist_array = g_array_new(FALSE, TRUE,
+        sizeof(RCLibDbBinaryItemRecord));
+    library_array = g_array_new(FALSE, TRUE,
+        sizeof(RCLibDbBinaryItemRecord));
+    string_data = g_byte_array_new();
+    string_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+        NULL);
+    g_byte_array_append(string_data, (const guint8 *)"", 1);
+    for(i=0;i<conv_catalog->len;i++)
+    {
+        catalog_data = g_ptr_array_index(conv_catalog, i);
+        memset(&catalog_record, 0, sizeof(RCLibDbBinaryCatalogRecord));
+        catalog_record.name = conv_string_add(string_data, string_table,
+            catalog_data->name);
+        catalog_record.type = catalog_data->type;
+        catalog_record.playlist_index = playlist_array->len;
+        catalog_record.playlist_count = catalog_data->playlist->len;
+        g_array_append_val(catalog_array, catalog_record);
+        for(j=0;j<catalog_data->playlist->len;j++)
+        {
+            conv_item_record_fill(&item_record, g_ptr_array_index(
+                catalog_data->playlist, j), string_data, string_table);
+            g_array_append_val(playlist_array, item_record);
+        }
+    }
+    for(i=0;i<conv_library->len;i++)
+    {
+        conv_item_record_fill(&item_record, g_ptr_array_index(conv_library,
+            i), string_data, string_table);
+        g_array_append_val(library_array, item_record);
+    }
+    g_hash_table_destroy(string_table);
+    memset(&header, 0, sizeof(RCLibDbBinaryHeader));
+    memcpy(header.magic, RCLIB_DB_BINARY_MAGIC, 8);
+    header.version = RCLIB_DB_BINARY_VERSION;
+    header.byte_order = RCLIB_DB_BINARY_BYTE_ORDER;
+    header.header_size = sizeof(RCLibDbBinaryHeader);
+    header.record_size = sizeof(RCLibDbBinaryItemRecord);
+    header.catalog_count = catalog_array->len;
+    header.playlist_count = playlist_array->len;
+    header.library_count = library_array->len;
+    header.catalog_offset = sizeof(RCLibDbBinaryHeader);
+    header.playlist_offset = header.catalog_offset +
+        (guint64)catalog_array->len * sizeof(RCLibDbBinaryCatalogRecord);
+    header.library_offset = header.playlist_offset +
+        (guint64)playlist_array->len * sizeof(RCLibDbBinaryItemRecord);
+    header.string_offset = header.library_offset +
+        (guint64)library_array->len * sizeof(RCLibDbBinaryItemRecord);
+    header.string_size = string_data->len;
+    data = g_byte_array_new();
+    g_byte_array_append(data, (const guint8 *)&header,
+        sizeof(RCLibDbBinaryHeader));
+    g_byte_array_append(data, (const guint8 *)catalog_array->data,
+        catalog_array->len * sizeof(RCLibDbBinaryCatalogRecord));
+    g_byte_array_append(data, (const guint8 *)playlist_array->data,
+        playlist_array->len * sizeof(RCLibDbBinaryItemRecord));
+    g_byte_array_append(data, (const guint8 *)library_array->data,
+        library_array->len * sizeof(RCLibDbBinaryItemRecord));
+    g_byte_array_append(data, string_data->data, string_data->len);
+    flag = g_file_set_contents(file, (const gchar *)data->data, data->len,
+        &error);
+    if(!flag)
+    {
+        g_warning("Cannot save binary database: %s", error->message);
+        g_error_free(error);
+    }
+    g_array_free(catalog_array, TRUE);
+    g_array_free(playlist_array, TRUE);
+    g_array_free(library_array, TRUE);
+    g_byte_array_free(string_data, TRUE);
+    g_byte_array_free(data, TRUE);
+    return flag;
+}
+
+int main(int argc, char *argv[])
+{
+    const gchar *home_dir = NULL;
+    gchar *input_file, *output_file;
+    gboolean binary_flag;
+    gboolean flag;
+    g_type_init();
+    if(argc==3)
+    {
+        input_file = g_strdup(argv[1]);
+        output_file = g_strdup(argv[2]);
+    }
+    else
+    {
+        home_dir = g_getenv("HOME");
+        if(home_dir==NULL)
+            home_dir = g_get_home_dir();
+        input_file = g_build_filename(home_dir, ".RhythmCat2",
+            "library.zdb", NULL);
+        output_file = g_build_filename(home_dir, ".RhythmCat2",
+            "library.rcdb", NULL);
+    }
+    conv_catalog = g_ptr_array_new_with_free_func((GDestroyNotify)
+        conv_catalog_data_free);
+    conv_library = g_ptr_array_new_with_free_func((GDestroyNotify)
+        conv_item_data_free);
+    binary_flag = conv_is_binary_db(input_file);
+    g_message("Loading %s database %s...", binary_flag ? "binary" : "XML",
+        input_file);
+    if(binary_flag)
+        flag = conv_load_binary_db(input_file);
+    else
+        flag = conv_load_xml_db(input_file);
+    g_free(input_file);
+    if(!flag)
+    {
+        g_free(output_file);
+        g_error("Cannot read database data!");
+        return 1;
+    }
+    g_message("Database loaded, catalog count: %u, library count: %u.",
+        conv_catalog->len, conv_library->len);
+    if(binary_flag)
+        flag = conv_save_xml_db(output_file);
+    else
+        flag = conv_save_binary_db(output_file);
+    g_message("Database %s written.", output_file);
+    g_free(output_file);
+    g_ptr_array_free(conv_catalog, TRUE);
+    g_ptr_array_free(conv_library, TRUE);
+    if(!flag)
+    {
+        g_error("Cannot save database data!");
+        return 1;
+    }
+    return 0;
+}
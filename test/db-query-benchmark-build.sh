@@ -0,0 +1,2 @@
+#!/bin/sh
+gcc -o db-query-benchmark db-query-benchmark.c `pkg-config --cflags --libs librhythmcat-2.0`
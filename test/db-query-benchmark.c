@@ -0,0 +1,341 @@
+#include <string.h>
+#include <stdlib.h>
+#include <glib.h>
+#include <rclib-db.h>
+#include <rclib-db-priv.h>
+#include <rclib-tag.h>
+
+/*
+ * Compare the query evaluation with the per-record interpreter used
+ * before (which duplicated every field for each condition) and with the
+ * compiled query plan, on a synthetic library.
+ *
+ * Usage: db-query-benchmark [RECORD_COUNT [ROUNDS]]
+ */
+
+#define BENCH_DEFAULT_COUNT 100000
+#define BENCH_DEFAULT_ROUNDS 5
+
+typedef struct BenchQuery
+{
+    const gchar *name;
+    RCLibDbQuery *query;
+}BenchQuery;
+
+static GPtrArray *bench_library = NULL;
+
+static RCLibDbLibraryDataType bench_query_type_to_data_type(guint propid)
+{
+    switch(propid)
+    {
+        case RCLIB_DB_QUERY_DATA_TYPE_URI:
+            return RCLIB_DB_LIBRARY_DATA_TYPE_URI;
+        case RCLIB_DB_QUERY_DATA_TYPE_TITLE:
+            return RCLIB_DB_LIBRARY_DATA_TYPE_TITLE;
+        case RCLIB_DB_QUERY_DATA_TYPE_ARTIST:
+            return RCLIB_DB_LIBRARY_DATA_TYPE_ARTIST;
+        case RCLIB_DB_QUERY_DATA_TYPE_ALBUM:
+            return RCLIB_DB_LIBRARY_DATA_TYPE_ALBUM;
+        case RCLIB_DB_QUERY_DATA_TYPE_FTYPE:
+            return RCLIB_DB_LIBRARY_DATA_TYPE_FTYPE;
+        case RCLIB_DB_QUERY_DATA_TYPE_GENRE:
+            return RCLIB_DB_LIBRARY_DATA_TYPE_GENRE;
+        case RCLIB_DB_QUERY_DATA_TYPE_LENGTH:
+            return RCLIB_DB_LIBRARY_DATA_TYPE_LENGTH;
+        case RCLIB_DB_QUERY_DATA_TYPE_TRACKNUM:
+            return RCLIB_DB_LIBRARY_DATA_TYPE_TRACKNUM;
+        case RCLIB_DB_QUERY_DATA_TYPE_YEAR:
+            return RCLIB_DB_LIBRARY_DATA_TYPE_YEAR;
+        default:
+            break;
+    }
+    return RCLIB_DB_LIBRARY_DATA_TYPE_NONE;
+}
+
+static gint bench_legacy_compare(guint condition, gint cmp)
+{
+    switch(condition)
+    {
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_EQUALS:
+            return cmp==0;
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_NOT_EQUAL:
+            return cmp!=0;
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_GREATER:
+            return cmp>0;
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_GREATER_OR_EQUAL:
+            return cmp>=0;
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_LESS:
+            return cmp<0;
+        case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_LESS_OR_EQUAL:
+            return cmp<=0;
+        default:
+            break;
+    }
+    return FALSE;
+}
+
+/*
+ * The old way: resolve the property type, check the value type and
+ * duplicate the field from the record for every condition of every
+ * record. The conditions are folded from left to right, like the plan,
+ * so the results of both ways can be compared.
+ */
+
+static gboolean bench_legacy_condition(RCLibDbLibraryData *library_data,
+    const RCLibDbQueryData *query_data)
+{
+    RCLibDbLibraryDataType ltype;
+    GType dtype;
+    gchar *lstring = NULL, *uri = NULL;
+    const gchar *needle;
+    gint lint = 0;
+    gint64 lint64 = 0;
+    gboolean result = FALSE;
+    if(query_data->val==NULL) return FALSE;
+    ltype = bench_query_type_to_data_type(query_data->propid);
+    dtype = rclib_db_query_get_query_data_type(query_data->propid);
+    switch(dtype)
+    {
+        case G_TYPE_STRING:
+        {
+            if(!G_VALUE_HOLDS_STRING(query_data->val)) return FALSE;
+            rclib_db_library_data_get(library_data, ltype, &lstring,
+                RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
+            if(ltype==RCLIB_DB_LIBRARY_DATA_TYPE_TITLE &&
+                (lstring==NULL || strlen(lstring)==0))
+            {
+                g_free(lstring);
+                lstring = NULL;
+                rclib_db_library_data_get(library_data,
+                    RCLIB_DB_LIBRARY_DATA_TYPE_URI, &uri,
+                    RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
+                if(uri!=NULL)
+                    lstring = rclib_tag_get_name_from_uri(uri);
+                g_free(uri);
+            }
+            if(lstring==NULL) lstring = g_strdup("");
+            needle = g_value_get_string(query_data->val);
+            switch(query_data->type)
+            {
+                case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_LIKE:
+                    result = g_strstr_len(lstring, -1, needle)!=NULL;
+                    break;
+                case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_NOT_LIKE:
+                    result = g_strstr_len(lstring, -1, needle)==NULL;
+                    break;
+                case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_PREFIX:
+                    result = g_str_has_prefix(lstring, needle);
+                    break;
+                case RCLIB_DB_QUERY_CONDITION_TYPE_PROP_SUFFIX:
+                    result = g_str_has_suffix(lstring, needle);
+                    break;
+                default:
+                    result = bench_legacy_compare(query_data->type,
+                        g_strcmp0(needle, lstring));
+                    break;
+            }
+            g_free(lstring);
+            break;
+        }
+        case G_TYPE_INT:
+        {
+            if(!G_VALUE_HOLDS_INT(query_data->val)) return FALSE;
+            rclib_db_library_data_get(library_data, ltype, &lint,
+                RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
+            result = bench_legacy_compare(query_data->type,
+                g_value_get_int(query_data->val)>lint ? 1 :
+                (g_value_get_int(query_data->val)<lint ? -1 : 0));
+            break;
+        }
+        case G_TYPE_INT64:
+        {
+            if(!G_VALUE_HOLDS_INT64(query_data->val)) return FALSE;
+            rclib_db_library_data_get(library_data, ltype, &lint64,
+                RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
+            result = bench_legacy_compare(query_data->type,
+                g_value_get_int64(query_data->val)>lint64 ? 1 :
+                (g_value_get_int64(query_data->val)<lint64 ? -1 : 0));
+            break;
+        }
+        default:
+            break;
+    }
+    return result;
+}
+
+static gboolean bench_legacy_query(RCLibDbLibraryData *library_data,
+    const RCLibDbQuery *query)
+{
+    const RCLibDbQueryData *query_data;
+    gboolean or_flag = FALSE;
+    gboolean result, ret = TRUE;
+    guint i;
+    for(i=0;i<((const GPtrArray *)query)->len;i++)
+    {
+        query_data = g_ptr_array_index((const GPtrArray *)query, i);
+        if(query_data==NULL) continue;
+        if(query_data->type==RCLIB_DB_QUERY_CONDITION_TYPE_OR)
+        {
+            or_flag = TRUE;
+            continue;
+        }
+        if(query_data->type==RCLIB_DB_QUERY_CONDITION_TYPE_NONE)
+            result = (i==0);
+        else
+            result = bench_legacy_condition(library_data, query_data);
+        if(or_flag)
+            ret = ret || result;
+        else
+            ret = ret && result;
+        or_flag = FALSE;
+    }
+    return ret;
+}
+
+static void bench_library_build(guint count)
+{
+    RCLibDbLibraryData *library_data;
+    gchar *uri, *title, *artist, *album, *genre;
+    guint i;
+    bench_library = g_ptr_array_new_with_free_func((GDestroyNotify)
+        rclib_db_library_data_unref);
+    for(i=0;i<count;i++)
+    {
+        uri = g_strdup_printf("file:///music/%05u/track-%u.mp3",
+            i % 8000, i);
+        title = (i % 50==0) ? g_strdup("") :
+            g_strdup_printf("Title %u", i);
+        artist = g_strdup_printf("Artist %u", i % 2000);
+        album = g_strdup_printf("Album %u", i % 8000);
+        genre = g_strdup_printf("Genre %u", i % 40);
+        library_data = rclib_db_library_data_new();
+        rclib_db_library_data_set(library_data,
+            RCLIB_DB_LIBRARY_DATA_TYPE_TYPE, RCLIB_DB_LIBRARY_TYPE_MUSIC,
+            RCLIB_DB_LIBRARY_DATA_TYPE_URI, uri,
+            RCLIB_DB_LIBRARY_DATA_TYPE_TITLE, title,
+            RCLIB_DB_LIBRARY_DATA_TYPE_ARTIST, artist,
+            RCLIB_DB_LIBRARY_DATA_TYPE_ALBUM, album,
+            RCLIB_DB_LIBRARY_DATA_TYPE_FTYPE, "MPEG-1 Layer 3 (MP3)",
+            RCLIB_DB_LIBRARY_DATA_TYPE_GENRE, genre,
+            RCLIB_DB_LIBRARY_DATA_TYPE_LENGTH,
+                (gint64)(120 + i % 300) * GST_SECOND,
+            RCLIB_DB_LIBRARY_DATA_TYPE_TRACKNUM, (gint)(i % 20 + 1),
+            RCLIB_DB_LIBRARY_DATA_TYPE_YEAR, (gint)(1960 + i % 60),
+            RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
+        g_ptr_array_add(bench_library, library_data);
+        g_free(uri);
+        g_free(title);
+        g_free(artist);
+        g_free(album);
+        g_free(genre);
+    }
+}
+
+static void bench_run(const BenchQuery *bench_query, guint rounds)
+{
+    RCLibDbQueryPlan *plan;
+    RCLibDbLibraryDataView view;
+    RCLibDbLibraryData *library_data;
+    gint64 legacy_time = 0, plan_time = 0, start;
+    guint legacy_count = 0, plan_count = 0;
+    guint i, j;
+    for(j=0;j<rounds;j++)
+    {
+        legacy_count = 0;
+        start = g_get_monotonic_time();
+        for(i=0;i<bench_library->len;i++)
+        {
+            library_data = g_ptr_array_index(bench_library, i);
+            if(bench_legacy_query(library_data, bench_query->query))
+                legacy_count++;
+        }
+        legacy_time += g_get_monotonic_time() - start;
+        plan_count = 0;
+        start = g_get_monotonic_time();
+        plan = _rclib_db_query_plan_new(bench_query->query);
+        for(i=0;i<bench_library->len;i++)
+        {
+            library_data = g_ptr_array_index(bench_library, i);
+            rclib_db_library_data_view_begin(library_data, &view);
+            if(_rclib_db_query_plan_eval(plan, &view))
+                plan_count++;
+            rclib_db_library_data_view_end(library_data, &view);
+        }
+        _rclib_db_query_plan_free(plan);
+        plan_time += g_get_monotonic_time() - start;
+    }
+    if(legacy_count!=plan_count)
+    {
+        g_warning("%s: result mismatch, legacy: %u, plan: %u",
+            bench_query->name, legacy_count, plan_count);
+    }
+    g_print("%-24s %8u %12.2f %12.2f %8.2fx\n", bench_query->name,
+        plan_count, (gdouble)legacy_time / rounds / 1000,
+        (gdouble)plan_time / rounds / 1000,
+        plan_time>0 ? (gdouble)legacy_time / plan_time : 0.0);
+}
+
+int main(int argc, char *argv[])
+{
+    BenchQuery bench_queries[5];
+    guint count = BENCH_DEFAULT_COUNT;
+    guint rounds = BENCH_DEFAULT_ROUNDS;
+    guint i;
+    g_type_init();
+    if(argc>1)
+        count = strtoul(argv[1], NULL, 10);
+    if(argc>2)
+        rounds = strtoul(argv[2], NULL, 10);
+    if(count==0) count = BENCH_DEFAULT_COUNT;
+    if(rounds==0) rounds = BENCH_DEFAULT_ROUNDS;
+    bench_queries[0].name = "search-as-you-type";
+    bench_queries[0].query = rclib_db_query_parse(
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_LIKE,
+        RCLIB_DB_QUERY_DATA_TYPE_TITLE, "k 12",
+        RCLIB_DB_QUERY_CONDITION_TYPE_OR,
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_LIKE,
+        RCLIB_DB_QUERY_DATA_TYPE_ARTIST, "t 12",
+        RCLIB_DB_QUERY_CONDITION_TYPE_OR,
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_LIKE,
+        RCLIB_DB_QUERY_DATA_TYPE_ALBUM, "m 12",
+        RCLIB_DB_QUERY_CONDITION_TYPE_OR,
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_LIKE,
+        RCLIB_DB_QUERY_DATA_TYPE_GENRE, "e 12",
+        RCLIB_DB_QUERY_CONDITION_TYPE_NONE);
+    bench_queries[1].name = "genre-equals";
+    bench_queries[1].query = rclib_db_query_parse(
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_EQUALS,
+        RCLIB_DB_QUERY_DATA_TYPE_GENRE, "Genre 7",
+        RCLIB_DB_QUERY_CONDITION_TYPE_NONE);
+    bench_queries[2].name = "artist-prefix-and-year";
+    bench_queries[2].query = rclib_db_query_parse(
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_PREFIX,
+        RCLIB_DB_QUERY_DATA_TYPE_ARTIST, "Artist 1",
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_GREATER,
+        RCLIB_DB_QUERY_DATA_TYPE_YEAR, 1990,
+        RCLIB_DB_QUERY_CONDITION_TYPE_NONE);
+    bench_queries[3].name = "length-range";
+    bench_queries[3].query = rclib_db_query_parse(
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_LESS_OR_EQUAL,
+        RCLIB_DB_QUERY_DATA_TYPE_LENGTH, (gint64)180 * GST_SECOND,
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_GREATER,
+        RCLIB_DB_QUERY_DATA_TYPE_LENGTH, (gint64)300 * GST_SECOND,
+        RCLIB_DB_QUERY_CONDITION_TYPE_NONE);
+    bench_queries[4].name = "title-suffix";
+    bench_queries[4].query = rclib_db_query_parse(
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_SUFFIX,
+        RCLIB_DB_QUERY_DATA_TYPE_TITLE, "99",
+        RCLIB_DB_QUERY_CONDITION_TYPE_NONE);
+    g_message("Building a synthetic library with %u records...", count);
+    bench_library_build(count);
+    g_print("%-24s %8s %12s %12s %9s\n", "query", "matched",
+        "legacy (ms)", "plan (ms)", "speedup");
+    for(i=0;i<G_N_ELEMENTS(bench_queries);i++)
+    {
+        bench_run(&bench_queries[i], rounds);
+        rclib_db_query_free(bench_queries[i].query);
+    }
+    g_ptr_array_free(bench_library, TRUE);
+    return 0;
+}
+
@@ -0,0 +1,2 @@
+#!/bin/sh
+gcc -o db-query-test db-query-test.c `pkg-config --cflags --libs librhythmcat-2.0`
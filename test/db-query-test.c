@@ -0,0 +1,213 @@
+#include <string.h>
+#include <stdlib.h>
+#include <glib.h>
+#include <rclib-db.h>
+#include <rclib-db-priv.h>
+
+/*
+ * Check that the compiled query plans fold the AND and OR conditions
+ * from left to right without precedence, so "A OR B C" means
+ * "(A OR B) AND C", and "X A OR B" means "(X AND A) OR B". The old
+ * evaluation dropped X in the latter, and matched "A OR B".
+ */
+
+typedef struct TestRecord
+{
+    const gchar *artist;
+    gint year;
+}TestRecord;
+
+typedef struct TestQuery
+{
+    const gchar *name;
+    RCLibDbQuery *query;
+    guint expected;
+}TestQuery;
+
+static const TestRecord test_records[] =
+{
+    { "Alpha", 1990 },
+    { "Beta", 2000 },
+    { "Alpha", 2000 },
+    { "Gamma", 1980 }
+};
+
+static GPtrArray *test_library = NULL;
+
+static void test_library_build()
+{
+    RCLibDbLibraryData *library_data;
+    gchar *uri;
+    guint i;
+    test_library = g_ptr_array_new_with_free_func((GDestroyNotify)
+        rclib_db_library_data_unref);
+    for(i=0;i<G_N_ELEMENTS(test_records);i++)
+    {
+        uri = g_strdup_printf("file:///music/track-%u.ogg", i);
+        library_data = rclib_db_library_data_new();
+        rclib_db_library_data_set(library_data,
+            RCLIB_DB_LIBRARY_DATA_TYPE_TYPE, RCLIB_DB_LIBRARY_TYPE_MUSIC,
+            RCLIB_DB_LIBRARY_DATA_TYPE_URI, uri,
+            RCLIB_DB_LIBRARY_DATA_TYPE_ARTIST, test_records[i].artist,
+            RCLIB_DB_LIBRARY_DATA_TYPE_YEAR, test_records[i].year,
+            RCLIB_DB_LIBRARY_DATA_TYPE_NONE);
+        g_ptr_array_add(test_library, library_data);
+        g_free(uri);
+    }
+}
+
+static gboolean test_run(const TestQuery *test_query)
+{
+    RCLibDbQueryPlan *plan;
+    RCLibDbLibraryDataView view;
+    RCLibDbLibraryData *library_data;
+    guint i, matched = 0;
+    plan = _rclib_db_query_plan_new(test_query->query);
+    for(i=0;i<test_library->len;i++)
+    {
+        library_data = g_ptr_array_index(test_library, i);
+        rclib_db_library_data_view_begin(library_data, &view);
+        if(_rclib_db_query_plan_eval(plan, &view))
+            matched |= 1 << i;
+        rclib_db_library_data_view_end(library_data, &view);
+    }
+    _rclib_db_query_plan_free(plan);
+    if(matched!=test_query->expected)
+    {
+        g_printerr("%s: matched 0x%x, expected 0x%x\n", test_query->name,
+            matched, test_query->expected);
+        return FALSE;
+    }
+    g_print("%s: OK\n", test_query->name);
+    return TRUE;
+}
+
+int main(int argc, char *argv[])
+{
+    TestQuery test_queries[8];
+    RCLibDbQuery *subquery;
+    guint i, failed = 0;
+    g_type_init();
+    test_library_build();
+
+    /* (Alpha AND 2000) OR Gamma */
+    test_queries[0].name = "and-then-or";
+    test_queries[0].query = rclib_db_query_parse(
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_EQUALS,
+        RCLIB_DB_QUERY_DATA_TYPE_ARTIST, "Alpha",
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_EQUALS,
+        RCLIB_DB_QUERY_DATA_TYPE_YEAR, 2000,
+        RCLIB_DB_QUERY_CONDITION_TYPE_OR,
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_EQUALS,
+        RCLIB_DB_QUERY_DATA_TYPE_ARTIST, "Gamma",
+        RCLIB_DB_QUERY_CONDITION_TYPE_NONE);
+    test_queries[0].expected = 0xC;
+
+    /* (Beta OR Alpha) AND 1990, not Beta OR (Alpha AND 1990) */
+    test_queries[1].name = "or-then-and";
+    test_queries[1].query = rclib_db_query_parse(
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_EQUALS,
+        RCLIB_DB_QUERY_DATA_TYPE_ARTIST, "Beta",
+        RCLIB_DB_QUERY_CONDITION_TYPE_OR,
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_EQUALS,
+        RCLIB_DB_QUERY_DATA_TYPE_ARTIST, "Alpha",
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_EQUALS,
+        RCLIB_DB_QUERY_DATA_TYPE_YEAR, 1990,
+        RCLIB_DB_QUERY_CONDITION_TYPE_NONE);
+    test_queries[1].expected = 0x1;
+
+    /* ((LIKE "a" OR 1980) AND LIKE "mm") OR Beta */
+    test_queries[2].name = "mixed-chain";
+    test_queries[2].query = rclib_db_query_parse(
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_LIKE,
+        RCLIB_DB_QUERY_DATA_TYPE_ARTIST, "a",
+        RCLIB_DB_QUERY_CONDITION_TYPE_OR,
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_EQUALS,
+        RCLIB_DB_QUERY_DATA_TYPE_YEAR, 1980,
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_LIKE,
+        RCLIB_DB_QUERY_DATA_TYPE_ARTIST, "mm",
+        RCLIB_DB_QUERY_CONDITION_TYPE_OR,
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_EQUALS,
+        RCLIB_DB_QUERY_DATA_TYPE_ARTIST, "Beta",
+        RCLIB_DB_QUERY_CONDITION_TYPE_NONE);
+    test_queries[2].expected = 0xA;
+
+    /* Alpha AND (1990 OR 1980) */
+    subquery = rclib_db_query_parse(
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_EQUALS,
+        RCLIB_DB_QUERY_DATA_TYPE_YEAR, 1990,
+        RCLIB_DB_QUERY_CONDITION_TYPE_OR,
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_EQUALS,
+        RCLIB_DB_QUERY_DATA_TYPE_YEAR, 1980,
+        RCLIB_DB_QUERY_CONDITION_TYPE_NONE);
+    test_queries[3].name = "subquery";
+    test_queries[3].query = rclib_db_query_parse(
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_EQUALS,
+        RCLIB_DB_QUERY_DATA_TYPE_ARTIST, "Alpha",
+        RCLIB_DB_QUERY_CONDITION_TYPE_SUBQUERY, subquery,
+        RCLIB_DB_QUERY_CONDITION_TYPE_NONE);
+    test_queries[3].expected = 0x1;
+    rclib_db_query_free(subquery);
+
+    /* The repeated and trailing ORs do nothing. */
+    test_queries[4].name = "repeated-or";
+    test_queries[4].query = rclib_db_query_parse(
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_EQUALS,
+        RCLIB_DB_QUERY_DATA_TYPE_ARTIST, "Beta",
+        RCLIB_DB_QUERY_CONDITION_TYPE_OR,
+        RCLIB_DB_QUERY_CONDITION_TYPE_OR,
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_EQUALS,
+        RCLIB_DB_QUERY_DATA_TYPE_ARTIST, "Gamma",
+        RCLIB_DB_QUERY_CONDITION_TYPE_OR,
+        RCLIB_DB_QUERY_CONDITION_TYPE_NONE);
+    test_queries[4].expected = 0xA;
+
+    /* A leading OR is joined to the empty query, which is always true. */
+    test_queries[5].name = "leading-or";
+    test_queries[5].query = rclib_db_query_parse(
+        RCLIB_DB_QUERY_CONDITION_TYPE_OR,
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_EQUALS,
+        RCLIB_DB_QUERY_DATA_TYPE_ARTIST, "Beta",
+        RCLIB_DB_QUERY_CONDITION_TYPE_NONE);
+    test_queries[5].expected = 0xF;
+
+    /* (2000 AND 1980) OR Alpha, the first part is always false. */
+    test_queries[6].name = "false-then-or";
+    test_queries[6].query = rclib_db_query_parse(
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_EQUALS,
+        RCLIB_DB_QUERY_DATA_TYPE_YEAR, 2000,
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_EQUALS,
+        RCLIB_DB_QUERY_DATA_TYPE_YEAR, 1980,
+        RCLIB_DB_QUERY_CONDITION_TYPE_OR,
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_EQUALS,
+        RCLIB_DB_QUERY_DATA_TYPE_ARTIST, "Alpha",
+        RCLIB_DB_QUERY_CONDITION_TYPE_NONE);
+    test_queries[6].expected = 0x5;
+
+    /* (Beta AND Alpha) OR 1980, not Alpha OR 1980 as it used to be. */
+    test_queries[7].name = "and-before-or";
+    test_queries[7].query = rclib_db_query_parse(
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_EQUALS,
+        RCLIB_DB_QUERY_DATA_TYPE_ARTIST, "Beta",
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_EQUALS,
+        RCLIB_DB_QUERY_DATA_TYPE_ARTIST, "Alpha",
+        RCLIB_DB_QUERY_CONDITION_TYPE_OR,
+        RCLIB_DB_QUERY_CONDITION_TYPE_PROP_EQUALS,
+        RCLIB_DB_QUERY_DATA_TYPE_YEAR, 1980,
+        RCLIB_DB_QUERY_CONDITION_TYPE_NONE);
+    test_queries[7].expected = 0x8;
+
+    for(i=0;i<G_N_ELEMENTS(test_queries);i++)
+    {
+        if(!test_run(&test_queries[i])) failed++;
+        rclib_db_query_free(test_queries[i].query);
+    }
+    g_ptr_array_free(test_library, TRUE);
+    if(failed>0)
+    {
+        g_printerr("%u of %u query tests failed!\n", failed,
+            (guint)G_N_ELEMENTS(test_queries));
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,2 @@
+#!/bin/sh
+gcc -o db-string-pool-test db-string-pool-test.c `pkg-config --cflags --libs librhythmcat-2.0`
@@ -0,0 +1,64 @@
+#include <string.h>
+#include <stdlib.h>
+#include <glib.h>
+#include <rclib-db.h>
+#include <rclib-db-priv.h>
+
+/*
+ * Check the reference counting of the database string pool: intern the
+ * same string several times, then release it, and check that the pooled
+ * string stays valid until the last reference is released.
+ *
+ * Usage: db-string-pool-test
+ */
+
+#define POOL_TEST_STRING "Some Artist"
+#define POOL_TEST_TIMES 3
+
+static void pool_test_check_stats(guint expect_count, guint64 expect_refs)
+{
+    guint count = 0;
+    guint64 refs = 0;
+    rclib_db_string_pool_get_stats(&count, &refs, NULL, NULL);
+    if(count!=expect_count || refs!=expect_refs)
+    {
+        g_error("Pool has %u strings with %"G_GUINT64_FORMAT" references, "
+            "expected %u strings with %"G_GUINT64_FORMAT" references!",
+            count, refs, expect_count, expect_refs);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    gchar *strs[POOL_TEST_TIMES];
+    gchar *source;
+    guint i;
+    g_type_init();
+    pool_test_check_stats(0, 0);
+    for(i=0;i<POOL_TEST_TIMES;i++)
+    {
+        /* Use a fresh copy every time, so that the pool must look up
+         * the string by its content. */
+        source = g_strdup(POOL_TEST_STRING);
+        strs[i] = _rclib_db_string_intern(source);
+        g_free(source);
+        if(strs[i]==NULL || strcmp(strs[i], POOL_TEST_STRING)!=0)
+            g_error("Interned string %u is broken!", i);
+        if(i>0 && strs[i]!=strs[0])
+            g_error("Interned string %u is not shared!", i);
+        if(strcmp(strs[0], POOL_TEST_STRING)!=0)
+            g_error("Pooled string is broken after intern %u!", i);
+        pool_test_check_stats(1, i+1);
+    }
+    for(i=0;i<POOL_TEST_TIMES;i++)
+    {
+        if(strcmp(strs[0], POOL_TEST_STRING)!=0)
+            g_error("Pooled string is broken before release %u!", i);
+        _rclib_db_string_release(strs[i]);
+        if(i+1<POOL_TEST_TIMES)
+            pool_test_check_stats(1, POOL_TEST_TIMES-i-1);
+    }
+    pool_test_check_stats(0, 0);
+    g_print("String pool test passed.\n");
+    return 0;
+}
@@ -1091,6 +1091,181 @@ void rc_ui_dialog_show_supported_format()
     gtk_widget_show_all(dialog);
 }
 
+/* Get the upper bound of the bucket which reaches the percentile. */
+static guint rc_ui_dialog_pipeline_stats_percentile(
+    const RCLibCoreHistogram *hist, gdouble percentile)
+{
+    guint i;
+    guint sum = 0;
+    if(hist->count==0) return 0;
+    for(i=0;i<RCLIB_CORE_HISTOGRAM_BUCKETS-1;i++)
+    {
+        sum += hist->buckets[i];
+        if(sum>=hist->count * percentile) break;
+    }
+    if(i>=RCLIB_CORE_HISTOGRAM_BUCKETS-1) return hist->max;
+    return MIN((2U << i) - 1, hist->max);
+}
+
+static gboolean rc_ui_dialog_pipeline_stats_update(gpointer data)
+{
+    GtkWidget *dialog = GTK_WIDGET(data);
+    GtkListStore *list_store;
+    GtkWidget *label;
+    GtkTreeIter iter;
+    RCLibCorePipelineStats *stats;
+    const RCLibCoreHistogram *hist;
+    gchar *latency, *text;
+    gdouble speed = 0.0;
+    gint rate;
+    guint i;
+    list_store = g_object_get_data(G_OBJECT(dialog), "rc-stats-store");
+    label = g_object_get_data(G_OBJECT(dialog), "rc-stats-label");
+    if(list_store==NULL || label==NULL) return FALSE;
+    stats = rclib_core_get_pipeline_stats();
+    gtk_list_store_clear(list_store);
+    if(stats==NULL)
+    {
+        gtk_label_set_text(GTK_LABEL(label),
+            _("The pipeline statistics are not available, they need "
+            "GStreamer 1.0."));
+        return TRUE;
+    }
+    for(i=0;i<stats->stage_num;i++)
+    {
+        hist = &(stats->stages[i].process_time);
+        gtk_list_store_append(list_store, &iter);
+        gtk_list_store_set(list_store, &iter, 0, stats->stages[i].name,
+            1, hist->count, 2, hist->count>0 ?
+            (guint)(hist->sum / hist->count) : 0, 3,
+            rc_ui_dialog_pipeline_stats_percentile(hist, 0.99), 4,
+            hist->max, -1);
+    }
+    rate = rclib_core_query_sample_rate();
+    if(rate>0 && stats->elapsed>0)
+        speed = (gdouble)stats->frames * 1000000 / stats->elapsed / rate;
+    if(stats->min_latency>=0)
+        latency = g_strdup_printf("%.1f ms",
+            (gdouble)stats->min_latency / 1000000);
+    else
+        latency = g_strdup(_("Unknown"));
+    hist = &(stats->headroom);
+    text = g_strdup_printf(_("Buffer size: %u frames on average, "
+        "%u frames at most\nSink headroom: %.1f ms on average, "
+        "%u late buffers\nSink latency: %s\nThroughput: %.2f x real time"),
+        stats->buffer_size.count>0 ? (guint)(stats->buffer_size.sum /
+        stats->buffer_size.count) : 0, stats->buffer_size.max,
+        hist->count>0 ? (gdouble)hist->sum / hist->count / 1000 : 0.0,
+        stats->late_buffers, latency, speed);
+    gtk_label_set_text(GTK_LABEL(label), text);
+    g_free(text);
+    g_free(latency);
+    rclib_core_pipeline_stats_free(stats);
+    return TRUE;
+}
+
+static void rc_ui_dialog_pipeline_stats_close_button_clicked(
+    GtkWidget *widget, gpointer data)
+{
+    if(data==NULL) return;
+    gtk_widget_destroy(GTK_WIDGET(data));
+}
+
+static void rc_ui_dialog_pipeline_stats_destroy_cb(GtkWidget *widget,
+    gpointer data)
+{
+    guint timeout_id = GPOINTER_TO_UINT(data);
+    if(timeout_id>0)
+        g_source_remove(timeout_id);
+    rclib_core_set_instrumentation(FALSE);
+}
+
+/**
+ * rc_ui_dialog_show_pipeline_stats:
+ *
+ * Show a dialog with the statistics of the playback pipeline, which
+ * shows the processing time of the elements in the audio path, the size
+ * of the buffers and how early the buffers reach the audio sink. The
+ * instrumentation mode of the core is enabled while the dialog is shown.
+ */
+
+void rc_ui_dialog_show_pipeline_stats()
+{
+    static GtkWidget *dialog = NULL;
+    GtkWidget *main_grid;
+    GtkWidget *button_hbox;
+    GtkWidget *scrolled_window;
+    GtkWidget *treeview;
+    GtkWidget *label;
+    GtkWidget *close_button;
+    GtkListStore *list_store;
+    GtkTreeViewColumn *columns[5];
+    GtkCellRenderer *renderers[5];
+    guint timeout_id;
+    gint i;
+    if(dialog!=NULL)
+    {
+        gtk_widget_show_all(dialog);
+        return;
+    }
+    rclib_core_set_instrumentation(TRUE);
+    dialog = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    list_store = gtk_list_store_new(5, G_TYPE_STRING, G_TYPE_UINT,
+        G_TYPE_UINT, G_TYPE_UINT, G_TYPE_UINT);
+    for(i=0;i<5;i++)
+        renderers[i] = gtk_cell_renderer_text_new();
+    columns[0] = gtk_tree_view_column_new_with_attributes(
+        _("Element"), renderers[0], "text", 0, NULL);
+    columns[1] = gtk_tree_view_column_new_with_attributes(
+        _("Buffers"), renderers[1], "text", 1, NULL);
+    columns[2] = gtk_tree_view_column_new_with_attributes(
+        _("Average (us)"), renderers[2], "text", 2, NULL);
+    columns[3] = gtk_tree_view_column_new_with_attributes(
+        _("99% (us)"), renderers[3], "text", 3, NULL);
+    columns[4] = gtk_tree_view_column_new_with_attributes(
+        _("Max (us)"), renderers[4], "text", 4, NULL);
+    gtk_tree_view_column_set_expand(columns[0], TRUE);
+    treeview = gtk_tree_view_new_with_model(GTK_TREE_MODEL(list_store));
+    for(i=0;i<5;i++)
+        gtk_tree_view_append_column(GTK_TREE_VIEW(treeview), columns[i]);
+    label = gtk_label_new(NULL);
+    close_button = gtk_button_new_from_stock(GTK_STOCK_CLOSE);
+    scrolled_window = gtk_scrolled_window_new(NULL, NULL);
+    main_grid = gtk_grid_new();
+    button_hbox = gtk_button_box_new(GTK_ORIENTATION_HORIZONTAL);
+    gtk_window_set_position(GTK_WINDOW(dialog), GTK_WIN_POS_CENTER);
+    gtk_window_set_title(GTK_WINDOW(dialog), _("Pipeline Statistics"));
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_window),
+        GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+    gtk_widget_set_size_request(dialog, 480, 320);
+    gtk_misc_set_alignment(GTK_MISC(label), 0.0, 0.5);
+    g_object_set(main_grid, "row-spacing", 2, NULL);
+    g_object_set(scrolled_window, "expand", TRUE, NULL);
+    g_object_set(button_hbox, "layout-style", GTK_BUTTONBOX_END, "spacing",
+        5, NULL);
+    gtk_container_add(GTK_CONTAINER(scrolled_window), treeview);
+    gtk_box_pack_start(GTK_BOX(button_hbox), close_button, FALSE, FALSE, 2);
+    gtk_grid_attach(GTK_GRID(main_grid), scrolled_window, 0, 0, 1, 1);
+    gtk_grid_attach(GTK_GRID(main_grid), label, 0, 1, 1, 1);
+    gtk_grid_attach(GTK_GRID(main_grid), button_hbox, 0, 2, 1, 1);
+    gtk_container_add(GTK_CONTAINER(dialog), main_grid);
+    g_object_set_data_full(G_OBJECT(dialog), "rc-stats-store", list_store,
+        g_object_unref);
+    g_object_set_data(G_OBJECT(dialog), "rc-stats-label", label);
+    rc_ui_dialog_pipeline_stats_update(dialog);
+    timeout_id = g_timeout_add_seconds(1, (GSourceFunc)
+        rc_ui_dialog_pipeline_stats_update, dialog);
+    g_signal_connect(close_button, "clicked",
+        G_CALLBACK(rc_ui_dialog_pipeline_stats_close_button_clicked),
+        dialog);
+    g_signal_connect(dialog, "destroy",
+        G_CALLBACK(rc_ui_dialog_pipeline_stats_destroy_cb),
+        GUINT_TO_POINTER(timeout_id));
+    g_signal_connect(dialog, "destroy",
+        G_CALLBACK(gtk_widget_destroyed), &dialog);
+    gtk_widget_show_all(dialog);
+}
+
 static void rc_ui_dialog_autosaved_response_cb(GtkDialog *dialog,
     gint response_id, gpointer user_data)
 {
@@ -50,6 +50,7 @@ struct _RCUiLibraryListStorePrivate
     gulong query_result_delete_id;
     gulong query_result_changed_id;
     gulong query_result_reordered_id;
+    gulong query_result_reset_id;
 };
 
 struct _RCUiLibraryPropStorePrivate
@@ -58,10 +59,12 @@ struct _RCUiLibraryPropStorePrivate
     RCLibDbQueryDataType prop_type;
     gint stamp;
     gint n_columns;
+    guint length;
     gulong prop_added_id;
     gulong prop_delete_id;
     gulong prop_changed_id;
     gulong prop_reordered_id;
+    gulong prop_reset_id;
 };
 
 enum
@@ -167,6 +170,20 @@ static void rc_ui_library_list_query_result_reordered_cb(
     gtk_tree_path_free(path);
 }
 
+static void rc_ui_library_list_query_result_reset_cb(
+    RCLibDbLibraryQueryResult *qr, gpointer data)
+{
+    RCUiLibraryListStorePrivate *priv;
+    if(data==NULL) return;
+    g_return_if_fail(RC_UI_IS_LIBRARY_LIST_STORE(data));
+    priv = RC_UI_LIBRARY_LIST_STORE(data)->priv;
+    if(priv==NULL) return;
+    
+    /* All iters are invalid now, the views which use this model should
+     * be attached to the model again to load the new rows. */
+    priv->stamp++;
+}
+
 static void rc_ui_library_prop_prop_added_cb(RCLibDbLibraryQueryResult *qr,
     guint prop_type, const gchar *prop_text, gpointer data)
 {
@@ -187,6 +204,7 @@ static void rc_ui_library_prop_prop_added_cb(RCLibDbLibraryQueryResult *qr,
     if(iter==NULL) return;
     pos = rclib_db_library_query_result_prop_get_position(qr,
         priv->prop_type, iter) + 1;
+    priv->length++;
     path = gtk_tree_path_new();
     gtk_tree_path_append_index(path, pos);
     tree_iter.user_data = iter;
@@ -217,6 +235,7 @@ static void rc_ui_library_prop_prop_delete_cb(RCLibDbLibraryQueryResult *qr,
     pos = rclib_db_library_query_result_prop_get_position(qr, priv->prop_type,
         iter) + 1;
     if(pos==0) return;
+    if(priv->length>0) priv->length--;
     path = gtk_tree_path_new();
     gtk_tree_path_append_index(path, pos);
     gtk_tree_model_row_deleted(model, path);
@@ -276,6 +295,54 @@ static void rc_ui_library_prop_prop_reordered_cb(RCLibDbLibraryQueryResult *qr,
     gtk_tree_path_free(path);
 }
 
+static void rc_ui_library_prop_query_result_reset_cb(
+    RCLibDbLibraryQueryResult *qr, gpointer data)
+{
+    RCUiLibraryPropStorePrivate *priv;
+    GtkTreeModel *model;
+    GtkTreePath *path;
+    GtkTreeIter tree_iter;
+    RCLibDbLibraryQueryResultPropIter *iter;
+    gint pos;
+    if(data==NULL) return;
+    model = GTK_TREE_MODEL(data);
+    g_return_if_fail(RC_UI_IS_LIBRARY_PROP_STORE(model));
+    priv = RC_UI_LIBRARY_PROP_STORE(model)->priv;
+    if(priv==NULL) return;
+    
+    /* The first row is kept, so the selection of it is not lost. */
+    for(pos=priv->length;pos>0;pos--)
+    {
+        path = gtk_tree_path_new();
+        gtk_tree_path_append_index(path, pos);
+        gtk_tree_model_row_deleted(model, path);
+        gtk_tree_path_free(path);
+    }
+    priv->stamp++;
+    priv->length = rclib_db_library_query_result_prop_get_length(qr,
+        priv->prop_type);
+    pos = 1;
+    for(iter=rclib_db_library_query_result_prop_get_begin_iter(qr,
+        priv->prop_type);iter!=NULL &&
+        !rclib_db_library_query_result_prop_iter_is_end(qr, priv->prop_type,
+        iter);iter=rclib_db_library_query_result_prop_get_next_iter(qr,
+        priv->prop_type, iter))
+    {
+        path = gtk_tree_path_new();
+        gtk_tree_path_append_index(path, pos);
+        tree_iter.user_data = iter;
+        tree_iter.stamp = priv->stamp;
+        gtk_tree_model_row_inserted(model, path, &tree_iter);
+        gtk_tree_path_free(path);
+        pos++;
+    }
+    
+    path = gtk_tree_path_new_first();
+    gtk_tree_model_get_iter_first(model, &tree_iter);
+    gtk_tree_model_row_changed(model, path, &tree_iter);
+    gtk_tree_path_free(path);
+}
+
 static GtkTreeModelFlags rc_ui_library_list_store_get_flags(
     GtkTreeModel *model)
 {
@@ -1209,6 +1276,12 @@ static void rc_ui_library_list_set_property(GObject *object,
                         priv->query_result_reordered_id);
                     priv->query_result_reordered_id = 0;
                 }
+                if(priv->query_result_reset_id>0)
+                {
+                    g_signal_handler_disconnect(priv->query_result,
+                        priv->query_result_reset_id);
+                    priv->query_result_reset_id = 0;
+                }
                 g_object_unref(priv->query_result);
                 priv->query_result = NULL;
             }
@@ -1229,6 +1302,10 @@ static void rc_ui_library_list_set_property(GObject *object,
                 priv->query_result, "query-result-reordered",
                 G_CALLBACK(rc_ui_library_list_query_result_reordered_cb),
                 object);
+            priv->query_result_reset_id = g_signal_connect(
+                priv->query_result, "query-result-reset",
+                G_CALLBACK(rc_ui_library_list_query_result_reset_cb),
+                object);
             break;
         }
         default:
@@ -1276,6 +1353,12 @@ static void rc_ui_library_prop_set_property(GObject *object,
                         priv->prop_reordered_id);
                     priv->prop_reordered_id = 0;
                 }
+                if(priv->prop_reset_id>0)
+                {
+                    g_signal_handler_disconnect(priv->base,
+                        priv->prop_reset_id);
+                    priv->prop_reset_id = 0;
+                }
                 g_object_unref(priv->base);
                 priv->base = NULL;
             }
@@ -1290,11 +1373,21 @@ static void rc_ui_library_prop_set_property(GObject *object,
             priv->prop_reordered_id = g_signal_connect(priv->base,
                 "prop-reordered",
                 G_CALLBACK(rc_ui_library_prop_prop_reordered_cb), object);
+            priv->prop_reset_id = g_signal_connect(priv->base,
+                "query-result-reset",
+                G_CALLBACK(rc_ui_library_prop_query_result_reset_cb), object);
+            priv->length = rclib_db_library_query_result_prop_get_length(
+                priv->base, priv->prop_type);
             break;
         }
         case PROP_STORE_PROP_PROP_TYPE:
         {
             priv->prop_type = g_value_get_uint(value);
+            if(priv->base!=NULL)
+            {
+                priv->length = rclib_db_library_query_result_prop_get_length(
+                    priv->base, priv->prop_type);
+            }
             break;
         }
         default:
@@ -1385,6 +1478,12 @@ static void rc_ui_library_list_store_finalize(GObject *object)
                 priv->query_result_reordered_id);
             priv->query_result_reordered_id = 0;
         }
+        if(priv->query_result_reset_id>0)
+        {
+            g_signal_handler_disconnect(priv->query_result,
+                priv->query_result_reset_id);
+            priv->query_result_reset_id = 0;
+        }
         g_object_unref(priv->query_result);
         priv->query_result = NULL;
     }
@@ -1424,6 +1523,11 @@ static void rc_ui_library_prop_store_finalize(GObject *object)
             g_signal_handler_disconnect(priv->base, priv->prop_reordered_id);
             priv->prop_reordered_id = 0;
         }
+        if(priv->prop_reset_id>0)
+        {
+            g_signal_handler_disconnect(priv->base, priv->prop_reset_id);
+            priv->prop_reset_id = 0;
+        }
         g_object_unref(priv->base);
         priv->base = NULL;
     }   
@@ -59,6 +59,7 @@ struct _RCUiLibraryWindowPrivate
     GtkWidget *library_list_scr_window;
     RCUiLibraryWindowSearchType search_type;
     gulong state_changed_id;
+    gulong list_reset_id;
     guint search_timeout;
 };
 
@@ -476,7 +477,7 @@ static void rc_ui_library_window_search_entry_text_changed_cb(GtkEntry *entry,
     {
         g_source_remove(priv->search_timeout);
     }
-    priv->search_timeout = g_timeout_add(500, (GSourceFunc)
+    priv->search_timeout = g_timeout_add(150, (GSourceFunc)
         rc_ui_library_search_timeout_cb, priv);
 }
 
@@ -488,6 +489,19 @@ static void rc_ui_library_window_core_state_changed_cb(RCLibCore *core,
     gtk_widget_queue_draw(priv->library_list_view);
 }
 
+static void rc_ui_library_window_list_reset_cb(RCLibDbLibraryQueryResult *qr,
+    gpointer data)
+{
+    RCUiLibraryWindowPrivate *priv = (RCUiLibraryWindowPrivate *)data;
+    if(data==NULL) return;
+    
+    /* Attach the model again, so the view loads all rows at once instead
+     * of handling a row-inserted signal for each row. */
+    gtk_tree_view_set_model(GTK_TREE_VIEW(priv->library_list_view), NULL);
+    gtk_tree_view_set_model(GTK_TREE_VIEW(priv->library_list_view),
+        priv->library_list_model);
+}
+
 static gboolean rc_ui_library_window_delete_event_cb(GtkWidget *widget,
     GdkEvent *event, gpointer data)
 {
@@ -498,12 +512,21 @@ static gboolean rc_ui_library_window_delete_event_cb(GtkWidget *widget,
 static void rc_ui_library_window_finalize(GObject *object)
 {
     RCUiLibraryWindowPrivate *priv = RC_UI_LIBRARY_WINDOW(object)->priv;
+    GObject *library_query_result;
     RC_UI_LIBRARY_WINDOW(object)->priv = NULL;
     if(priv->state_changed_id>0)
     {
         rclib_core_signal_disconnect(priv->state_changed_id);
         priv->state_changed_id = 0;
     }
+    if(priv->list_reset_id>0)
+    {
+        library_query_result = rclib_db_library_get_album_query_result();
+        g_signal_handler_disconnect(library_query_result,
+            priv->list_reset_id);
+        g_object_unref(library_query_result);
+        priv->list_reset_id = 0;
+    }
     if(priv->search_timeout>0)
     {
         g_source_remove(priv->search_timeout);
@@ -576,6 +599,11 @@ static void rc_ui_library_window_instance_init(RCUiLibraryWindow *window)
     priv->library_list_view = rc_ui_library_list_view_new();
     gtk_tree_view_set_model(GTK_TREE_VIEW(priv->library_list_view),
         priv->library_list_model);
+    library_query_result = rclib_db_library_get_album_query_result();
+    priv->list_reset_id = g_signal_connect(library_query_result,
+        "query-result-reset", G_CALLBACK(rc_ui_library_window_list_reset_cb),
+        priv);
+    g_object_unref(library_query_result);
     priv->library_prop_genre_view = rc_ui_library_prop_view_new(_("Genre"));
     gtk_tree_view_set_model(GTK_TREE_VIEW(priv->library_prop_genre_view),
         priv->library_genre_model);
@@ -547,6 +547,10 @@ static GtkActionEntry ui_menu_entries[] =
       N_("_Supported Format"), NULL,
       N_("Check the supported music format of this player"),
       G_CALLBACK(rc_ui_dialog_show_supported_format) },
+    { "HelpPipelineStats", NULL,
+      N_("_Pipeline Statistics"), NULL,
+      N_("Show the statistics of the playback pipeline"),
+      G_CALLBACK(rc_ui_dialog_show_pipeline_stats) },
     { "CatalogNewList", GTK_STOCK_NEW,
       N_("_New Playlist"), NULL,
       N_("Create a new playlist"),
@@ -921,6 +925,7 @@ static const gchar *ui_menu_info =
     "    <menu action='HelpMenu'>"
     "      <menuitem action='HelpAbout'/>"
     "      <menuitem action='HelpSupportedFormat'/>"
+    "      <menuitem action='HelpPipelineStats'/>"
     "    </menu>"
     "  </menubar>"
     "  <popup action='CatalogPopupMenu'>"
@@ -24,7 +24,6 @@
  */
  
 #include "rc-ui-spectrum.h"
-#include <gst/audio/audio.h>
 
 /**
  * SECTION: rc-ui-spectrum
@@ -33,42 +32,71 @@
  * @Include: rc-ui-slabel.h
  *
  * The spectrum show widget. It shows the spectrum gragh in the player.
+ * The widget reads the samples from the PCM ring buffer of the core by
+ * rclib_core_pcm_read() at its own frame rate, and analyzes them in the
+ * main thread.
  */
 
 #define RC_UI_SPECTRUM_STYLE_PARAM_READABLE G_PARAM_READABLE | \
     G_PARAM_STATIC_NAME | G_PARAM_STATIC_NICK | G_PARAM_STATIC_BLURB
     
-#define RC_UI_SPECTRUM_BANDS 4096
+#define RC_UI_SPECTRUM_NFFT 8192
+#define RC_UI_SPECTRUM_BINS (RC_UI_SPECTRUM_NFFT / 2 + 1)
+#define RC_UI_SPECTRUM_THRESHOLD -60.0
+#define RC_UI_SPECTRUM_PCM_SIZE 65536
+#define RC_UI_SPECTRUM_WAVE_FRAMES 1024
+
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+    #define RC_UI_SPECTRUM_USE_SSE2
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+    #include <arm_neon.h>
+    #define RC_UI_SPECTRUM_USE_NEON
+#endif
 
-typedef struct RCUiSpectrumChannel
+/*
+ * The analyzer keeps the latest mono samples in the history, and runs
+ * one FFT on them every frame of the widget. The window table and the
+ * dB offset are computed only once.
+ */
+
+typedef struct RCUiSpectrumAnalyzer
 {
+    GstFFTF32 *fft_ctx;
+    gfloat *history;
+    gfloat *window;
     gfloat *input;
-    gfloat *input_tmp;
     GstFFTF32Complex *freqdata;
-    gfloat *spect_magnitude;
-    GstFFTF32 *fft_ctx;
-}RCUiSpectrumChannel;
+    gfloat *magnitude;
+    gfloat db_offset;
+}RCUiSpectrumAnalyzer;
+
+typedef struct RCUiSpectrumBand
+{
+    guint lower;
+    guint upper;
+    gfloat weight;
+}RCUiSpectrumBand;
 
 struct _RCUiSpectrumWidgetPrivate
 {
     guint fps;
     RCUiSpectrumStyle style;
-    GstBuffer *buffer;
-    GstCaps *caps;
-    GMutex buffer_mutex; 
-    guint64 spectrum_num_frames;
-    guint64 spectrum_num_fft;
-    guint64 spectrum_accumulated_error;
-    RCUiSpectrumChannel *spectrum_channel_data;
-    guint spectrum_rate;
+    gsize pcm_position;
+    gfloat *pcm_data;
+    guint pcm_frames;
+    gint pcm_rate;
+    gint pcm_channels;
+    RCUiSpectrumAnalyzer *analyzer;
     gfloat spectrum_threshold;
     gfloat *spectrum_data;
-    gfloat *spectrum_band_data;
     guint spectrum_data_size;
+    RCUiSpectrumBand *spectrum_bands;
+    guint spectrum_bands_size;
+    gint spectrum_bands_rate;
     guint32 *wave_vdata;
     guint wave_vdata_size;
     guint timeout_id;
-    gulong buffer_probe_id;
 };
 
 static gpointer rc_ui_spectrum_widget_parent_class = NULL;
@@ -145,504 +173,301 @@ static gpointer rc_ui_spectrum_widget_parent_class = NULL;
     }                                                                     \
 } G_STMT_END
 
-static inline void rc_ui_spectrum_flush(RCUiSpectrumWidgetPrivate *priv)
-{
-    priv->spectrum_num_frames = 0;
-    priv->spectrum_num_fft = 0;
-    priv->spectrum_accumulated_error = 0;
-}
-
-static inline void rc_ui_spectrum_alloc_channel_data(
-    RCUiSpectrumWidgetPrivate *priv, guint bands)
+static RCUiSpectrumAnalyzer *rc_ui_spectrum_analyzer_new()
 {
-    RCUiSpectrumChannel *cd;
-    guint nfft = 2 * bands - 2;
-    if(priv->spectrum_channel_data!=NULL) return;
-    priv->spectrum_channel_data = g_new(RCUiSpectrumChannel, 1);
-    cd = priv->spectrum_channel_data;
-    cd->fft_ctx = gst_fft_f32_new(nfft, FALSE);
-    cd->input = g_new0(gfloat, nfft);
-    cd->input_tmp = g_new0(gfloat, nfft);
-    cd->freqdata = g_new0(GstFFTF32Complex, bands);
-    cd->spect_magnitude = g_new0(gfloat, bands);
+    RCUiSpectrumAnalyzer *analyzer;
+    guint i;
+    guint nfft = RC_UI_SPECTRUM_NFFT;
+    analyzer = g_new0(RCUiSpectrumAnalyzer, 1);
+    analyzer->fft_ctx = gst_fft_f32_new(nfft, FALSE);
+    analyzer->history = g_new0(gfloat, nfft);
+    analyzer->window = g_new(gfloat, nfft);
+    analyzer->input = g_new(gfloat, nfft);
+    analyzer->freqdata = g_new0(GstFFTF32Complex, RC_UI_SPECTRUM_BINS);
+    analyzer->magnitude = g_new(gfloat, RC_UI_SPECTRUM_BINS);
+    for(i=0;i<nfft;i++)
+        analyzer->window[i] = 0.53836 - 0.46164 * cos(2.0 * G_PI * i / nfft);
+    for(i=0;i<RC_UI_SPECTRUM_BINS;i++)
+        analyzer->magnitude[i] = RC_UI_SPECTRUM_THRESHOLD;
+    /* The power is divided by nfft^2 before it is converted to dB. */
+    analyzer->db_offset = -2.0 * log2(nfft);
+    return analyzer;
 }
 
-static inline void rc_ui_spectrum_free_channel_data(
-    RCUiSpectrumWidgetPrivate *priv)
+static void rc_ui_spectrum_analyzer_free(RCUiSpectrumAnalyzer *analyzer)
 {
-    RCUiSpectrumChannel *cd;
-    if(priv->spectrum_channel_data==NULL) return;
-    cd = priv->spectrum_channel_data;
-    if(cd->fft_ctx!=NULL)
-        gst_fft_f32_free(cd->fft_ctx);
-    g_free(cd->input);
-    g_free(cd->input_tmp);
-    g_free(cd->freqdata);
-    g_free(cd->spect_magnitude);
-    g_free(priv->spectrum_channel_data);
-    priv->spectrum_channel_data = NULL;
+    if(analyzer==NULL) return;
+    if(analyzer->fft_ctx!=NULL)
+        gst_fft_f32_free(analyzer->fft_ctx);
+    g_free(analyzer->history);
+    g_free(analyzer->window);
+    g_free(analyzer->input);
+    g_free(analyzer->freqdata);
+    g_free(analyzer->magnitude);
+    g_free(analyzer);
 }
 
-static inline void rc_ui_spectrum_reset_state(
-    RCUiSpectrumWidgetPrivate *priv)
+static void rc_ui_spectrum_analyzer_reset(RCUiSpectrumAnalyzer *analyzer)
 {
-    rc_ui_spectrum_free_channel_data(priv);
-    rc_ui_spectrum_flush(priv);
+    guint i;
+    if(analyzer==NULL) return;
+    memset(analyzer->history, 0, RC_UI_SPECTRUM_NFFT * sizeof(gfloat));
+    for(i=0;i<RC_UI_SPECTRUM_BINS;i++)
+        analyzer->magnitude[i] = RC_UI_SPECTRUM_THRESHOLD;
 }
 
-static inline void rc_ui_spectrum_input_data_mixed_float(
-    const guint8 *_in, gfloat *out, guint len, guint channels,
-    gfloat max_value, guint op, guint nfft)
+/* Deinterleave and downmix the samples in one pass. */
+static inline void rc_ui_spectrum_downmix(gfloat *out, const gfloat *in,
+    guint frames, gint channels)
 {
-    guint i, j, ip = 0;
+    guint i = 0;
+    gint c;
     gfloat v;
-    gfloat *in = (gfloat *)_in;
-    for(j=0;j<len;j++)
+    gfloat scale = 1.0 / channels;
+    if(channels==1)
     {
-        v = in[ip++];
-        for(i=1;i<channels;i++)
-            v+=in[ip++];
-        out[op] = v / channels;
-        op = (op + 1)%nfft;
+        memcpy(out, in, frames * sizeof(gfloat));
+        return;
     }
-}
-
-static inline void rc_ui_spectrum_input_data_mixed_double(
-    const guint8 *_in, gfloat *out, guint len, guint channels,
-    gfloat max_value, guint op, guint nfft)
-{
-    guint i, j, ip = 0;
-    gfloat v;
-    gdouble *in = (gdouble *)_in;
-    for(j=0;j<len;j++)
+    if(channels==2)
     {
-        v = in[ip++];
-        for(i=1;i<channels;i++)
-            v+=in[ip++];
-        out[op] = v / channels;
-        op = (op + 1)%nfft;
-    }
-}
-
-static inline void rc_ui_spectrum_input_data_mixed_int32(
-    const guint8 *_in, gfloat *out, guint len, guint channels,
-    gfloat max_value, guint op, guint nfft)
-{
-    guint i, j, ip = 0;
-    gint32 *in = (gint32 *)_in;
-    gfloat v;
-    for(j=0;j<len;j++)
-    {
-        v = in[ip++] * 2 + 1;
-        for(i=1;i<channels;i++)
-            v += in[ip++] * 2 + 1;
-        out[op] = v / channels;
-        op = (op + 1)%nfft;
+        #if defined(RC_UI_SPECTRUM_USE_SSE2)
+            __m128 a, b;
+            __m128 half = _mm_set1_ps(0.5);
+            for(;i+4<=frames;i+=4)
+            {
+                a = _mm_loadu_ps(in + i * 2);
+                b = _mm_loadu_ps(in + i * 2 + 4);
+                _mm_storeu_ps(out + i, _mm_mul_ps(_mm_add_ps(
+                    _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)),
+                    _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))), half));
+            }
+        #elif defined(RC_UI_SPECTRUM_USE_NEON)
+            float32x4x2_t lr;
+            for(;i+4<=frames;i+=4)
+            {
+                lr = vld2q_f32(in + i * 2);
+                vst1q_f32(out + i, vmulq_n_f32(vaddq_f32(lr.val[0],
+                    lr.val[1]), 0.5));
+            }
+        #endif
+        for(;i<frames;i++)
+            out[i] = (in[i*2] + in[i*2+1]) * 0.5;
+        return;
     }
-}
-
-static inline void rc_ui_spectrum_input_data_mixed_int32_max(
-    const guint8 *_in, gfloat *out, guint len, guint channels,
-    gfloat max_value, guint op, guint nfft)
-{
-    guint i, j, ip = 0;
-    gint32 *in = (gint32 *) _in;
-    gfloat v;
-    for(j=0;j<len;j++)
-    {
-        v = in[ip++] / max_value;
-        for(i=1;i<channels;i++)
-            v += in[ip++] / max_value;
-        out[op] = v / channels;
-        op = (op + 1) % nfft;
-  }
-}
-
-static inline void rc_ui_spectrum_input_data_mixed_int24(
-    const guint8 *_in, gfloat *out, guint len, guint channels,
-    gfloat max_value, guint op, guint nfft)
-{
-    guint i, j;
-    gfloat v = 0.0;
-    gint32 value;
-    for(j=0;j<len;j++)
+    for(i=0;i<frames;i++)
     {
-        for(i=0;i<channels;i++)
-        {
-            #if G_BYTE_ORDER==G_BIG_ENDIAN
-                value = GST_READ_UINT24_BE (_in);
-            #else
-                value = GST_READ_UINT24_LE (_in);
-            #endif
-           if(value & 0x00800000)
-               value |= 0xff000000;
-           v += value * 2 + 1;
-           _in += 3;
-        }
-        out[op] = v / channels;
-        op = (op + 1)%nfft;
+        v = in[0];
+        for(c=1;c<channels;c++)
+            v += in[c];
+        out[i] = v * scale;
+        in += channels;
     }
 }
 
-static inline void rc_ui_spectrum_input_data_mixed_int24_max(
-    const guint8 * _in, gfloat *out, guint len, guint channels,
-    gfloat max_value, guint op, guint nfft)
+static void rc_ui_spectrum_analyzer_push(RCUiSpectrumAnalyzer *analyzer,
+    const gfloat *data, guint frames, gint channels)
 {
-    guint i, j;
-    gfloat v = 0.0;
-    gint32 value;
-    for(j=0;j<len;j++)
+    guint nfft = RC_UI_SPECTRUM_NFFT;
+    if(frames>=nfft)
     {
-        for(i=0;i< channels;i++)
-        {
-            #if G_BYTE_ORDER==G_BIG_ENDIAN
-                value = GST_READ_UINT24_BE (_in);
-            #else
-                value = GST_READ_UINT24_LE (_in);
-            #endif
-            if(value & 0x00800000)
-                value |= 0xff000000;
-            v += value / max_value;
-            _in += 3;
-        }
-        out[op] = v / channels;
-        op = (op + 1) % nfft;
+        data += (frames - nfft) * channels;
+        frames = nfft;
     }
-}
-
-static inline void rc_ui_spectrum_input_data_mixed_int16(
-    const guint8 *_in, gfloat *out, guint len, guint channels,
-    gfloat max_value, guint op, guint nfft)
-{
-    guint i, j, ip = 0;
-    gint16 *in = (gint16 *)_in;
-    gfloat v;
-    for(j=0;j<len;j++)
+    else
     {
-        v = in[ip++] * 2 + 1;
-        for(i=1;i<channels;i++)
-            v += in[ip++] * 2 + 1;
-        out[op] = v / channels;
-        op = (op + 1)%nfft;
+        memmove(analyzer->history, analyzer->history + frames,
+            (nfft - frames) * sizeof(gfloat));
     }
+    rc_ui_spectrum_downmix(analyzer->history + nfft - frames, data,
+        frames, channels);
 }
 
-static void rc_ui_spectrum_input_data_mixed_int16_max(
-    const guint8 *_in, gfloat *out, guint len, guint channels,
-    gfloat max_value, guint op, guint nfft)
-{
-    guint i, j, ip = 0;
-    gint16 *in = (gint16 *)_in;
-    gfloat v;
-    for(j=0;j<len;j++)
-    {
-        v = in[ip++] / max_value;
-        for(i=1;i<channels;i++)
-            v += in[ip++] / max_value;
-        out[op] = v / channels;
-        op = (op + 1)%nfft;
-    }
-}
+/*
+ * Approximate log2(x) by the exponent and a quadratic polynomial of the
+ * mantissa, the error is less than 0.01 (0.03 dB).
+ */
 
-static inline void rc_ui_spectrum_input_data(const gchar *mimetype,
-    gint width, gint depth, const guint8 *in, gfloat *out, guint len,
-    guint channels, gfloat _max_value, guint op, guint nfft)
-{
-    gboolean is_float = FALSE;
-    guint max_value = (1UL << (depth - 1)) - 1;
-    if(g_strcmp0(mimetype, "audio/x-raw-float")==0)
-        is_float = TRUE;
-    if(is_float)
-    {
-        if(width==4)
-            rc_ui_spectrum_input_data_mixed_float(in, out, len,
-                channels, _max_value, op, nfft);
-        else if(width==8)
-            rc_ui_spectrum_input_data_mixed_double(in, out, len,
-                channels, _max_value, op, nfft);
-    }
-    else
-    {
-        if(width==4)
+static inline gfloat rc_ui_spectrum_fast_log2(gfloat x)
+{
+    union {
+        gfloat f;
+        guint32 i;
+    }v;
+    gfloat e;
+    v.f = x;
+    e = (gfloat)((gint)((v.i >> 23) & 0xFF) - 128);
+    v.i = (v.i & 0x007FFFFF) | 0x3F800000;
+    return e + (-0.34484843 * v.f + 2.02466578) * v.f - 0.67487759;
+}
+
+#if defined(RC_UI_SPECTRUM_USE_SSE2)
+static inline __m128 rc_ui_spectrum_fast_log2_sse2(__m128 x)
+{
+    __m128i i = _mm_castps_si128(x);
+    __m128 e, m;
+    e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_and_si128(_mm_srli_epi32(i, 23),
+        _mm_set1_epi32(0xFF)), _mm_set1_epi32(128)));
+    m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(i,
+        _mm_set1_epi32(0x007FFFFF)), _mm_set1_epi32(0x3F800000)));
+    m = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(m,
+        _mm_set1_ps(-0.34484843)), _mm_set1_ps(2.02466578)), m),
+        _mm_set1_ps(-0.67487759));
+    return _mm_add_ps(e, m);
+}
+#elif defined(RC_UI_SPECTRUM_USE_NEON)
+static inline float32x4_t rc_ui_spectrum_fast_log2_neon(float32x4_t x)
+{
+    uint32x4_t i = vreinterpretq_u32_f32(x);
+    float32x4_t e, m;
+    e = vcvtq_f32_s32(vsubq_s32(vreinterpretq_s32_u32(vandq_u32(
+        vshrq_n_u32(i, 23), vdupq_n_u32(0xFF))), vdupq_n_s32(128)));
+    m = vreinterpretq_f32_u32(vorrq_u32(vandq_u32(i,
+        vdupq_n_u32(0x007FFFFF)), vdupq_n_u32(0x3F800000)));
+    m = vmlaq_f32(vdupq_n_f32(-0.67487759), vmlaq_f32(
+        vdupq_n_f32(2.02466578), m, vdupq_n_f32(-0.34484843)), m);
+    return vaddq_f32(e, m);
+}
+#endif
+
+/* Window the history, run the FFT, and convert the power to dB. */
+static void rc_ui_spectrum_analyzer_run(RCUiSpectrumAnalyzer *analyzer,
+    gfloat threshold)
+{
+    const gfloat db_scale = 3.01029996; /* 10 * log10(2) */
+    const gfloat *history = analyzer->history;
+    const gfloat *window = analyzer->window;
+    const gfloat *freqdata = (const gfloat *)analyzer->freqdata;
+    gfloat *input = analyzer->input;
+    gfloat *magnitude = analyzer->magnitude;
+    gfloat db_offset = analyzer->db_offset;
+    gfloat power, val;
+    guint i = 0;
+    #if defined(RC_UI_SPECTRUM_USE_SSE2)
+        __m128 a, b, vre, vim;
+        for(;i+4<=RC_UI_SPECTRUM_NFFT;i+=4)
         {
-            if(max_value)
-                rc_ui_spectrum_input_data_mixed_int32_max(in, out, len,
-                    channels, _max_value, op, nfft);
-            else
-                rc_ui_spectrum_input_data_mixed_int32(in, out, len,
-                    channels, _max_value, op, nfft);
+            _mm_storeu_ps(input + i, _mm_mul_ps(_mm_loadu_ps(history + i),
+                _mm_loadu_ps(window + i)));
         }
-        else if(width==3)
+    #elif defined(RC_UI_SPECTRUM_USE_NEON)
+        float32x4x2_t ri;
+        float32x4_t vpower;
+        for(;i+4<=RC_UI_SPECTRUM_NFFT;i+=4)
         {
-            if(max_value)
-                rc_ui_spectrum_input_data_mixed_int24_max(in, out, len,
-                    channels, _max_value, op, nfft);
-            else
-                rc_ui_spectrum_input_data_mixed_int24(in, out, len,
-                    channels, _max_value, op, nfft);
+            vst1q_f32(input + i, vmulq_f32(vld1q_f32(history + i),
+                vld1q_f32(window + i)));
         }
-        else if(width==2)
-        {
-            if(max_value)
-                rc_ui_spectrum_input_data_mixed_int16_max(in, out, len,
-                    channels, _max_value, op, nfft);
-            else
-                rc_ui_spectrum_input_data_mixed_int16(in, out, len,
-                    channels, _max_value, op, nfft);
-        }
-    }
-}
-
-static inline void rc_ui_spectrum_run_fft(RCUiSpectrumChannel *cd,
-    guint bands, gfloat threshold, guint input_pos)
-{
-    guint i;
-    guint nfft = 2 * bands - 2;
-    gdouble val;
-    gfloat *input = cd->input;
-    gfloat *input_tmp = cd->input_tmp;
-    gfloat *spect_magnitude = cd->spect_magnitude;
-    GstFFTF32Complex *freqdata = cd->freqdata;
-    GstFFTF32 *fft_ctx = cd->fft_ctx;
-    for(i=0;i<nfft;i++)
-        input_tmp[i] = input[(input_pos + i) % nfft];
-    gst_fft_f32_window(fft_ctx, input_tmp, GST_FFT_WINDOW_HAMMING);
-    gst_fft_f32_fft(fft_ctx, input_tmp, freqdata);
-    for(i=0;i<bands;i++)
-    {
-        val = freqdata[i].r * freqdata[i].r;
-        val += freqdata[i].i * freqdata[i].i;
-        val /= nfft * nfft;
-        val = 10.0 * log10 (val);
-        if (val < threshold)
-            val = threshold;
-        spect_magnitude[i] += val;
-    }
-}
-
-static inline void rc_ui_spectrum_run(RCUiSpectrumWidget *spectrum,
-    GstBuffer *buf, const gchar *mimetype, gint rate, gint channels,
-    gint width, gint depth)
-{
-    RCUiSpectrumWidgetPrivate *priv;
-    static guint spectrum_input_pos = 0;
-    static guint64 spectrum_error_per_interval = 0;
-    static guint64 spectrum_frames_per_interval = 0;
-    static guint64 spectrum_frames_todo = 0;
-    gint i;
-    RCUiSpectrumChannel *cd;
-    const guint8 *buf_data;
-    gfloat max_value;
-    gfloat threshold = -60;
-    guint bands;
-    guint nfft;
-    guint size;
-    gint64 interval = GST_SECOND / 10;
-    gint frame_size;
-    gfloat *input;
-    guint input_pos;
-    guint fft_todo, msg_todo, block_size;
-    gboolean have_full_interval;
-    if(spectrum==NULL) return;
-    priv = spectrum->priv;
-    if(priv==NULL) return;
-    #if GST_VERSION_MAJOR==1
-        GstMapInfo map_info;
-        memset(&map_info, 0, sizeof(GstMapInfo));
-        if(gst_buffer_map(buf, &map_info, GST_MAP_READ))
+    #endif
+    for(;i<RC_UI_SPECTRUM_NFFT;i++)
+        input[i] = history[i] * window[i];
+    gst_fft_f32_fft(analyzer->fft_ctx, input, analyzer->freqdata);
+    i = 0;
+    #if defined(RC_UI_SPECTRUM_USE_SSE2)
+        for(;i+4<=RC_UI_SPECTRUM_BINS;i+=4)
         {
-            buf_data = map_info.data;
-            size = map_info.size;
+            a = _mm_loadu_ps(freqdata + i * 2);
+            b = _mm_loadu_ps(freqdata + i * 2 + 4);
+            vre = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+            vim = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+            a = _mm_add_ps(_mm_mul_ps(vre, vre), _mm_mul_ps(vim, vim));
+            a = _mm_mul_ps(_mm_add_ps(rc_ui_spectrum_fast_log2_sse2(a),
+                _mm_set1_ps(db_offset)), _mm_set1_ps(db_scale));
+            _mm_storeu_ps(magnitude + i, _mm_max_ps(a,
+                _mm_set1_ps(threshold)));
         }
-        else
+    #elif defined(RC_UI_SPECTRUM_USE_NEON)
+        for(;i+4<=RC_UI_SPECTRUM_BINS;i+=4)
         {
-            g_warning("Cannot map buffer!\n");
-            return;
+            ri = vld2q_f32(freqdata + i * 2);
+            vpower = vmlaq_f32(vmulq_f32(ri.val[0], ri.val[0]), ri.val[1],
+                ri.val[1]);
+            vpower = vmulq_n_f32(vaddq_f32(rc_ui_spectrum_fast_log2_neon(
+                vpower), vdupq_n_f32(db_offset)), db_scale);
+            vst1q_f32(magnitude + i, vmaxq_f32(vpower,
+                vdupq_n_f32(threshold)));
         }
-    #else
-        buf_data = GST_BUFFER_DATA(buf);
-        size = GST_BUFFER_SIZE(buf);
     #endif
-    width = width / 8;
-    frame_size = width * channels;
-    max_value = (1UL << (depth - 1)) - 1;
-    bands = RC_UI_SPECTRUM_BANDS;
-    nfft = 2*bands - 2;
-    if(GST_BUFFER_IS_DISCONT(buf)) /* Discontinuity detect */
-        rc_ui_spectrum_flush(priv);
-    if(priv->spectrum_channel_data==NULL)
+    for(;i<RC_UI_SPECTRUM_BINS;i++)
     {
-        rc_ui_spectrum_alloc_channel_data(priv, bands);
-        spectrum_frames_per_interval = gst_util_uint64_scale(interval,
-            rate, GST_SECOND);
-        spectrum_frames_todo = spectrum_frames_per_interval;
-        spectrum_error_per_interval = (interval * rate) % GST_SECOND;
-        if(spectrum_frames_per_interval==0)
-            spectrum_frames_per_interval = 1;
-        spectrum_input_pos = 0;
-        rc_ui_spectrum_flush(priv);
+        power = freqdata[i*2] * freqdata[i*2];
+        power += freqdata[i*2+1] * freqdata[i*2+1];
+        val = (rc_ui_spectrum_fast_log2(power) + db_offset) * db_scale;
+        magnitude[i] = MAX(val, threshold);
     }
-    input_pos = spectrum_input_pos;
-    while(size>=frame_size)
-    {
-        fft_todo = nfft - (priv->spectrum_num_frames % nfft);
-        msg_todo = spectrum_frames_todo - priv->spectrum_num_frames;
-        block_size = msg_todo;
-        if(block_size > (size / frame_size))
-            block_size = (size / frame_size);
-        if(block_size > fft_todo)
-            block_size = fft_todo;
-        cd = priv->spectrum_channel_data;
-        input = cd->input;
-        rc_ui_spectrum_input_data(mimetype, width, depth,
-            (const guint8 *)buf_data, input, block_size, channels,
-            max_value, input_pos, nfft);
-        buf_data += block_size * frame_size;
-        size -= block_size * frame_size;
-        input_pos = (input_pos + block_size) % nfft;
-        priv->spectrum_num_frames += block_size;
-        have_full_interval = (priv->spectrum_num_frames ==
-            spectrum_frames_todo);
-        if((priv->spectrum_num_frames % nfft == 0) ||
-            (have_full_interval && !priv->spectrum_num_fft))
-        { 
-            cd = priv->spectrum_channel_data;
-            rc_ui_spectrum_run_fft(cd, bands, threshold, input_pos);
-            priv->spectrum_num_fft++;
-        }
-        if(have_full_interval)
-        {
-            spectrum_frames_todo = spectrum_frames_per_interval;
-            if(priv->spectrum_accumulated_error >= GST_SECOND)
-            {
-                priv->spectrum_accumulated_error -= GST_SECOND;
-                spectrum_frames_todo++;
-            }
-            priv->spectrum_accumulated_error +=
-                spectrum_error_per_interval;
-            cd = priv->spectrum_channel_data;
-            for(i=0;i<bands;i++)
-            {
-                cd->spect_magnitude[i] /= priv->spectrum_num_fft;
-                priv->spectrum_band_data[i] = cd->spect_magnitude[i];
-            }
-            priv->spectrum_rate = rate;
-            priv->spectrum_threshold = threshold;            
-            cd = priv->spectrum_channel_data;
-            memset(cd->spect_magnitude, 0, bands*sizeof(gfloat));
-            priv->spectrum_num_frames = 0;
-            priv->spectrum_num_fft = 0;
-        }
-    }
-    spectrum_input_pos = input_pos;
-    #if GST_VERSION_MAJOR==1
-        gst_buffer_unmap(buf, &map_info);
-    #endif
 }
 
-static inline gfloat rc_ui_spectrum_wave_get_unit_data(const guint8 *adata,
-    guint asize, guint s, gboolean is_float, gint width)
+/*
+ * Group the FFT bins into logarithmic bands, the bands are denser in
+ * the low frequency. The table is only updated when the number of the
+ * bands or the sample rate is changed.
+ */
+
+static void rc_ui_spectrum_bands_update(RCUiSpectrumWidgetPrivate *priv,
+    guint num, gint rate)
 {
-    gfloat ret = 0.0;
-    if(s*width > asize) return 0.0;
-    if(is_float)
-    {
-        if(width==8)
-            ret = (gfloat)((gdouble *)adata)[s];
-        else if(width==4)
-            ret = (gfloat)((gfloat *)adata)[s];
-    }
-    else
+    const gdouble maxfreq = 20000;
+    const gdouble midfreq = 1000;
+    const gdouble bin_width = (gdouble)rate / RC_UI_SPECTRUM_NFFT;
+    RCUiSpectrumBand *band;
+    gdouble level;
+    gdouble lower, upper;
+    guint i;
+    if(priv->spectrum_bands!=NULL && priv->spectrum_bands_size==num &&
+        priv->spectrum_bands_rate==rate)
+        return;
+    priv->spectrum_bands = g_renew(RCUiSpectrumBand, priv->spectrum_bands,
+        num);
+    priv->spectrum_bands_size = num;
+    priv->spectrum_bands_rate = rate;
+    level = 2 * log2(maxfreq/midfreq) / num;
+    for(i=0;i<num;i++)
     {
-        switch(width)
-        {
-            case 4:
-                ret = (gfloat)((gint32 *)adata)[s];
-                    break;
-            case 3:
-            {
-                gint32 tmp = 0.0;
-                #if G_BYTE_ORDER==G_BIG_ENDIAN
-                    tmp = GST_READ_UINT24_BE(adata+s*3);
-                #else
-                    tmp = GST_READ_UINT24_LE(adata+s*3);
-                #endif
-                if(tmp & 0x00800000)
-                    tmp |= 0xFF000000;
-                ret = (gfloat)tmp;
-                    break;
-            }
-            case 2:
-                ret = (gfloat)((gint16 *)adata)[s];
-                break;
-            case 1:
-                ret = (gfloat)((guint8 *)adata)[s] - 128;
-                    break;
-            default:
-                break;
-        }
+        band = priv->spectrum_bands + i;
+        if(i==0)
+            lower = 0;
+        else
+            lower = maxfreq / pow(2, (level * (num - i)));
+        upper = maxfreq / pow(2, (level * (num - i - 1)));
+        band->lower = lower / bin_width;
+        band->upper = MIN(upper / bin_width, RC_UI_SPECTRUM_BINS);
+        band->weight = (lower + upper) / 2 / bin_width - band->lower;
+        band->weight = CLAMP(band->weight, 0.0, 1.0);
     }
-    return ret;
 }
 
 static inline void rc_ui_spectrum_spectrum_calculate(gfloat *sdata,
-    guint ssize, gfloat *bands, guint bsize, gint rate, gfloat threshold)
+    guint ssize, const gfloat *magnitude, const RCUiSpectrumBand *bands,
+    gfloat threshold)
 {
-    const gdouble maxfreq = 20000;
-    const gdouble midfreq = 1000;
-    gdouble midlog;
-    gdouble level;
-    gdouble lower, upper, mid;
-    gdouble freq1, freq2;
-    gint i, j;
-    guint l, u;
+    const RCUiSpectrumBand *band;
     gfloat value;
-    midlog = log2(maxfreq/midfreq);
-    level = 2 * midlog / (ssize);
-    for(i=0;i<ssize;i++) sdata[i] = threshold;
+    guint i, j;
     for(i=0;i<ssize;i++)
     {
-        if(i==0)
-            lower = 0;
-        else
-            lower = maxfreq / pow(2, (level * (ssize - i)));
-        upper = maxfreq / pow(2, (level * (ssize - i - 1)));
-        l = (lower/rate*2) * bsize;
-        u = (upper/rate*2) * bsize;
-        if(l>=bsize) break;
-        value = 0.0;
-        if(u-l>1)
+        band = bands + i;
+        if(band->lower>=RC_UI_SPECTRUM_BINS)
+            value = threshold;
+        else if(band->upper > band->lower + 1)
         {
-            value = bands[l];
-            for(j=l;j<u;j++)
-            {
-                if(j>=bsize) break;
-                value = MAX(value, bands[j]);
-            }
+            value = magnitude[band->lower];
+            for(j=band->lower+1;j<band->upper;j++)
+                value = MAX(value, magnitude[j]);
         }
-        else
+        else if(band->lower + 1 < RC_UI_SPECTRUM_BINS)
         {
-            mid = (lower + upper) / 2;
-            freq1 = l * rate / 2 / bsize;
-            freq2 = (l+1) * rate / 2 /bsize;
-            freq1 = ABS(freq1 - mid);
-            freq2 = ABS(freq2 - mid);
-            if(l+1<bsize)
-            {
-                value = bands[l] * freq2 / (freq1+freq2) +
-                    bands[l+1] * freq1 / (freq1+freq2);
-            }
-            else
-                value = bands[l];
+            value = magnitude[band->lower] * (1.0 - band->weight) +
+                magnitude[band->lower+1] * band->weight;
         }
+        else
+            value = magnitude[band->lower];
         sdata[i] = value;
     }
 }
 
 static inline void rc_ui_spectrum_wave_render_lines(guint32 *vdata,
-    guint vsize, guint vwidth, guint vheight, const guint8 *adata,
-    guint asize, const gchar *mimetype, guint num_samples, gint channels,
-    gint awidth, gint adepth, guint32 bg_color, guint32 fg_color1,
+    guint vsize, guint vwidth, guint vheight, const gfloat *adata,
+    guint num_samples, gint channels, guint32 bg_color, guint32 fg_color1,
     guint32 fg_color2, gboolean multi_channel)
 {
     guint i, c, s, x = 0, y = 0, oy;
@@ -650,16 +475,10 @@ static inline void rc_ui_spectrum_wave_render_lines(guint32 *vdata,
     gint x2 = 0, y2 = 0;
     guint tsize;
     guint32 fg_color;
-    gboolean is_float = FALSE;
-    gfloat max_value = (1UL << (adepth));
+    gfloat max_value = 2.0;
     tsize = vwidth * vheight;
     for(i=0;i<tsize;i++)
         vdata[i] = bg_color;
-    if(g_strcmp0(mimetype, "audio/x-raw-float")==0)
-    {
-        is_float = TRUE;
-        max_value = 2.0;
-    }
     if(num_samples>=4096)
         num_samples /= 8;
     else if(num_samples>=2048)
@@ -669,15 +488,13 @@ static inline void rc_ui_spectrum_wave_render_lines(guint32 *vdata,
     dx = (gfloat) (vwidth - 1) / (gfloat) num_samples;
     dy = (vheight - 1) / max_value;
     oy = (vheight - 1) / 2;
-    awidth = awidth / 8;
     if(multi_channel)
     {
         for(c=0;c<channels;c++)
         {
             s = c;
             x2 = 0;
-            y2 = (guint)(oy + rc_ui_spectrum_wave_get_unit_data(adata, asize,
-                s, is_float, awidth) * dy);
+            y2 = (guint)(oy + adata[s] * dy);
             if(c%2==1)
                 fg_color = fg_color2;
             else
@@ -685,8 +502,7 @@ static inline void rc_ui_spectrum_wave_render_lines(guint32 *vdata,
             for(i=1;i<num_samples;i++)
             {
                 x = (guint)((gfloat) i * dx);
-                y = (guint)(oy + rc_ui_spectrum_wave_get_unit_data(adata,
-                    asize, s, is_float, awidth) * dy);
+                y = (guint)(oy + adata[s] * dy);
                 s += channels;
                 x = CLAMP(x, 0, vwidth-1);
                 y = CLAMP(y, 0, vheight-1);
@@ -706,8 +522,7 @@ static inline void rc_ui_spectrum_wave_render_lines(guint32 *vdata,
         y2 = 0;
         for(c=0;c<channels;c++)
         {
-            y2 += (guint)(oy + rc_ui_spectrum_wave_get_unit_data(adata, asize,
-                s+c, is_float, awidth) * dy);
+            y2 += (guint)(oy + adata[s+c] * dy);
         }
         y2 = y2 / channels;
         for(i=1;i<num_samples;i++)
@@ -716,8 +531,7 @@ static inline void rc_ui_spectrum_wave_render_lines(guint32 *vdata,
             y = 0;
             for(c=0;c<channels;c++)
             {
-                y += (guint)(oy + rc_ui_spectrum_wave_get_unit_data(adata,
-                    asize, s+c, is_float, awidth) * dy);
+                y += (guint)(oy + adata[s+c] * dy);
             }
             y = y / channels;
             s += channels;
@@ -733,46 +547,50 @@ static inline void rc_ui_spectrum_wave_render_lines(guint32 *vdata,
     }
 }
 
-static void rc_ui_spectrum_buffer_probe_cb(RCLibCore *core, GstBuffer *buf,
-    GstCaps *caps, gpointer data)
+/*
+ * Read the new samples from the core, and analyze them in the spectrum
+ * style. It runs at the frame rate of the widget.
+ */
+
+static void rc_ui_spectrum_update(RCUiSpectrumWidget *spectrum)
 {
-    /* WARNING: This function is not called in main thread! */
-    RCUiSpectrumWidget *spectrum;
-    RCUiSpectrumWidgetPrivate *priv;
-    GstAudioInfo audio_info;
-    gint rate = 0;
-    gint channels = 0;
-    gint width = 0;
-    gint depth = 0;
-    const gchar *mimetype;
-    GstStructure *structure;
-    if(data==NULL) return;
-    spectrum = RC_UI_SPECTRUM_WIDGET(data);
-    if(spectrum==NULL) return;
-    priv = spectrum->priv;
-    if(priv==NULL) return;
-    if(buf==NULL) return;
-    g_mutex_lock(&(priv->buffer_mutex));
-    gst_buffer_replace(&(priv->buffer), buf);
-    gst_caps_replace(&(priv->caps), caps);
-    g_mutex_unlock(&(priv->buffer_mutex));
-    if(caps==NULL) return;
+    RCUiSpectrumWidgetPrivate *priv = spectrum->priv;
+    gsize end;
+    guint frames;
+    guint keep = RC_UI_SPECTRUM_WAVE_FRAMES;
+    gint rate = 0, channels = 0;
+    gboolean updated = FALSE;
+    if(priv==NULL || priv->pcm_data==NULL) return;
+    if(priv->style==RC_UI_SPECTRUM_STYLE_NONE) return;
     if(priv->style==RC_UI_SPECTRUM_STYLE_SPECTRUM)
     {
-        gst_audio_info_init(&audio_info);
-        if(gst_audio_info_from_caps(&audio_info, caps))
+        keep = RC_UI_SPECTRUM_NFFT;
+        if(priv->analyzer==NULL)
+            priv->analyzer = rc_ui_spectrum_analyzer_new();
+    }
+    /* Only the latest samples are shown. */
+    end = rclib_core_pcm_get_position();
+    if(end - priv->pcm_position > keep)
+        priv->pcm_position = end - keep;
+    while((frames=rclib_core_pcm_read(&(priv->pcm_position),
+        priv->pcm_data, RC_UI_SPECTRUM_PCM_SIZE, &rate, &channels))>0)
+    {
+        if(rate!=priv->pcm_rate || channels!=priv->pcm_channels)
+            rc_ui_spectrum_analyzer_reset(priv->analyzer);
+        priv->pcm_frames = frames;
+        priv->pcm_rate = rate;
+        priv->pcm_channels = channels;
+        if(priv->style==RC_UI_SPECTRUM_STYLE_SPECTRUM)
         {
-            rate = GST_AUDIO_INFO_RATE(&audio_info);
-            channels = GST_AUDIO_INFO_CHANNELS(&audio_info);
-            width = GST_AUDIO_INFO_WIDTH(&audio_info);
-            depth = GST_AUDIO_INFO_DEPTH(&audio_info);
+            rc_ui_spectrum_analyzer_push(priv->analyzer, priv->pcm_data,
+                frames, channels);
+            updated = TRUE;
         }
-        structure = gst_caps_get_structure(caps, 0);
-        mimetype = gst_structure_get_name(structure);
-        if(depth==0) depth = width;
-        if(rate==0 || width==0 || channels==0) return;
-        rc_ui_spectrum_run(spectrum, buf, mimetype, rate, channels,
-            width, depth);
+    }
+    if(updated)
+    {
+        rc_ui_spectrum_analyzer_run(priv->analyzer,
+            priv->spectrum_threshold);
     }
 }
 
@@ -836,16 +654,7 @@ static gboolean rc_ui_spectrum_widget_draw(GtkWidget *widget, cairo_t *cr)
 {
     RCUiSpectrumWidget *spectrum;
     RCUiSpectrumWidgetPrivate *priv;
-    GstCaps *caps = NULL;
-    GstStructure *structure;
-    GstAudioInfo audio_info;
     GtkAllocation allocation;
-    GstBuffer *buffer = NULL;
-    const guint8 *adata = NULL;
-    guint asize = 0;
-    guint num_samples = 0;
-    gint rate = 0, channels = 0, width = 0, depth = 0;
-    const gchar *mimetype = NULL;
     gfloat percent;
     gint i;
     GdkRGBA color;
@@ -865,42 +674,9 @@ static gboolean rc_ui_spectrum_widget_draw(GtkWidget *widget, cairo_t *cr)
         &color);
     gtk_style_context_get_background_color(style_context,
         GTK_STATE_FLAG_NORMAL, &bg_color);
-    g_mutex_lock(&(priv->buffer_mutex));
-    if(priv->buffer!=NULL)
-        buffer = gst_buffer_ref(priv->buffer);
-    if(priv->caps!=NULL)
-        caps = gst_caps_ref(priv->caps);
-    g_mutex_unlock(&(priv->buffer_mutex));
     G_STMT_START
     {
-        if(buffer==NULL) break;
-        if(caps==NULL) break;
-        structure = gst_caps_get_structure(caps, 0);
-        if(structure==NULL) break;
-        mimetype = gst_structure_get_name(structure);
-        gst_audio_info_init(&audio_info);
-        if(gst_audio_info_from_caps(&audio_info, caps))
-        {
-            rate = GST_AUDIO_INFO_RATE(&audio_info);
-            channels = GST_AUDIO_INFO_CHANNELS(&audio_info);
-            width = GST_AUDIO_INFO_WIDTH(&audio_info);
-            depth = GST_AUDIO_INFO_DEPTH(&audio_info);
-        }
-        if(depth==0) depth = width;
-        if(rate==0 || width==0 || channels==0) break;
-        #if GST_VERSION_MAJOR==1
-            GstMapInfo map_info;
-            memset(&map_info, 0, sizeof(GstMapInfo));
-            if(gst_buffer_map(buffer, &map_info, GST_MAP_READ))
-            {
-                adata = map_info.data;
-                asize = map_info.size;
-            }
-        #else
-            adata = GST_BUFFER_DATA(buffer);
-            asize = GST_BUFFER_SIZE(buffer);
-        #endif
-        num_samples = asize / (channels * width / 8);
+        if(priv->pcm_frames==0 || priv->pcm_channels==0) break;
         switch(priv->style)
         {
             case RC_UI_SPECTRUM_STYLE_NONE:
@@ -952,9 +728,9 @@ static gboolean rc_ui_spectrum_widget_draw(GtkWidget *widget, cairo_t *cr)
                 multi_channel =
                     (priv->style==RC_UI_SPECTRUM_STYLE_WAVE_MULTI);
                 rc_ui_spectrum_wave_render_lines(priv->wave_vdata, vsize,
-                    allocation.width, allocation.height, adata, asize,
-                    mimetype, num_samples, channels, width, depth,
-                    bg_icolor, c1_icolor, c2_icolor, multi_channel);
+                    allocation.width, allocation.height, priv->pcm_data,
+                    priv->pcm_frames, priv->pcm_channels, bg_icolor,
+                    c1_icolor, c2_icolor, multi_channel);
                 surface = cairo_image_surface_create_for_data(
                     (guchar *)priv->wave_vdata, CAIRO_FORMAT_ARGB32,
                     allocation.width, allocation.height,
@@ -975,7 +751,7 @@ static gboolean rc_ui_spectrum_widget_draw(GtkWidget *widget, cairo_t *cr)
                 num = allocation.width / (swidth + space);
                 cairo_set_source_rgba(cr, color.red, color.green,
                     color.blue, color.alpha);
-                if(priv->spectrum_band_data==NULL) break;
+                if(priv->analyzer==NULL || num==0) break;
                 if(priv->spectrum_data==NULL)
                 {
                     priv->spectrum_data = g_new0(gfloat, num);
@@ -987,9 +763,10 @@ static gboolean rc_ui_spectrum_widget_draw(GtkWidget *widget, cairo_t *cr)
                         priv->spectrum_data, num);
                     priv->spectrum_data_size = num;
                 }
+                rc_ui_spectrum_bands_update(priv, num, priv->pcm_rate);
                 rc_ui_spectrum_spectrum_calculate(priv->spectrum_data, num,
-                    priv->spectrum_band_data, RC_UI_SPECTRUM_BANDS,
-                    priv->spectrum_rate, priv->spectrum_threshold);
+                    priv->analyzer->magnitude, priv->spectrum_bands,
+                    priv->spectrum_threshold);
                 for(i=0;i<num;i++)
                 {
                     percent = (priv->spectrum_data[i] -
@@ -1005,13 +782,8 @@ static gboolean rc_ui_spectrum_widget_draw(GtkWidget *widget, cairo_t *cr)
             default:
                 break;
         }
-        #if GST_VERSION_MAJOR==1
-            gst_buffer_unmap(buffer, &map_info);
-        #endif
     }
     G_STMT_END;
-    if(buffer!=NULL) gst_buffer_unref(buffer);
-    if(caps!=NULL) gst_caps_unref(caps);
     return TRUE;
 }
 
@@ -1019,6 +791,7 @@ static gboolean rc_ui_spectrum_draw_timeout_cb(gpointer data)
 {
     RCUiSpectrumWidget *widget = (RCUiSpectrumWidget *)data;
     if(data==NULL) return FALSE;
+    rc_ui_spectrum_update(widget);
     gtk_widget_queue_draw(GTK_WIDGET(widget));
     return TRUE;
 }
@@ -1031,12 +804,11 @@ static void rc_ui_spectrum_widget_init(RCUiSpectrumWidget *spectrum)
     spectrum->priv = priv;
     priv->fps = 10;
     priv->style = RC_UI_SPECTRUM_STYLE_WAVE_MULTI;
-    priv->spectrum_band_data = g_new(gfloat, RC_UI_SPECTRUM_BANDS);
-    g_mutex_init(&(priv->buffer_mutex));
+    priv->spectrum_threshold = RC_UI_SPECTRUM_THRESHOLD;
+    priv->pcm_data = g_new0(gfloat, RC_UI_SPECTRUM_PCM_SIZE);
+    priv->pcm_position = rclib_core_pcm_get_position();
     priv->timeout_id = g_timeout_add(1000/priv->fps, (GSourceFunc)
         rc_ui_spectrum_draw_timeout_cb, spectrum);
-    priv->buffer_probe_id = rclib_core_signal_connect("buffer-probe",
-        G_CALLBACK(rc_ui_spectrum_buffer_probe_cb), spectrum);
 }
 
 static void rc_ui_spectrum_widget_finalize(GObject *object)
@@ -1045,20 +817,13 @@ static void rc_ui_spectrum_widget_finalize(GObject *object)
     RCUiSpectrumWidgetPrivate *priv;
     priv = spectrum->priv;
     spectrum->priv = NULL;
-    rc_ui_spectrum_reset_state(priv);
-    if(priv->buffer_probe_id>0)
-        rclib_core_signal_disconnect(priv->buffer_probe_id);
-    g_mutex_lock(&(priv->buffer_mutex));
-    if(priv->caps!=NULL)
-        gst_caps_unref(priv->caps);
-    if(priv->buffer!=NULL)
-        gst_buffer_unref(priv->buffer);
-    g_mutex_unlock(&(priv->buffer_mutex));
-    g_mutex_clear(&(priv->buffer_mutex));
     if(priv->timeout_id>0)
         g_source_remove(priv->timeout_id);
+    rc_ui_spectrum_analyzer_free(priv->analyzer);
+    g_free(priv->pcm_data);
     g_free(priv->wave_vdata);
-    g_free(priv->spectrum_band_data);
+    g_free(priv->spectrum_data);
+    g_free(priv->spectrum_bands);
     G_OBJECT_CLASS(rc_ui_spectrum_widget_parent_class)->finalize(object);
 }
 
@@ -1215,20 +980,9 @@ void rc_ui_spectrum_widget_clean(RCUiSpectrumWidget *spectrum)
 {
     RCUiSpectrumWidgetPrivate *priv;
     if(spectrum==NULL) return;
-    GstBuffer *buffer;
-    GstCaps *caps;
     priv = RC_UI_SPECTRUM_WIDGET(spectrum)->priv;
     if(priv==NULL) return;
-    g_mutex_lock(&(priv->buffer_mutex));
-    buffer = priv->buffer;
-    caps = priv->caps;
-    priv->buffer = NULL;
-    priv->caps = NULL;
-    if(buffer!=NULL)
-        gst_buffer_unref(buffer);
-    if(caps!=NULL)
-        gst_caps_unref(caps);
-    g_mutex_unlock(&(priv->buffer_mutex));
+    priv->pcm_frames = 0;
     g_free(priv->wave_vdata);
     g_free(priv->spectrum_data);
     priv->wave_vdata = NULL;